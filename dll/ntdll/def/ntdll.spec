@@ -482,7 +482,7 @@
 @ stdcall NtReleaseSemaphore(long long ptr)
 @ stub -version=0x600+ NtReleaseWorkerFactoryWorker
 @ stdcall NtRemoveIoCompletion(ptr ptr ptr ptr ptr)
-@ stub -version=0x600+ NtRemoveIoCompletionEx
+@ stdcall NtRemoveIoCompletionEx(ptr ptr long ptr ptr long)
 @ stdcall NtRemoveProcessDebug(ptr ptr)
 @ stdcall NtRenameKey(ptr ptr)
 @ stub -version=0x600+ NtRenameTransactionManager
@@ -549,6 +549,7 @@
 @ stdcall NtSetSystemTime(ptr ptr)
 @ stdcall NtSetThreadExecutionState(long ptr)
 @ stdcall NtSetTimer(long ptr ptr ptr long long ptr)
+@ stdcall NtSetTimerEx(ptr long ptr long)
 @ stdcall NtSetTimerResolution(long long ptr)
 @ stdcall NtSetUuidSeed(ptr)
 @ stdcall NtSetValueKey(long long long long long long)
@@ -1311,45 +1312,45 @@
 @ stub -version=0x600+ ShipAssertMsgA
 @ stub -version=0x600+ ShipAssertMsgW
 @ stub -version=0x600+ TpAllocAlpcCompletion
-@ stub -version=0x600+ TpAllocCleanupGroup
-@ stub -version=0x600+ TpAllocIoCompletion
-@ stub -version=0x600+ TpAllocPool
-@ stub -version=0x600+ TpAllocTimer
-@ stub -version=0x600+ TpAllocWait
-@ stub -version=0x600+ TpAllocWork
-@ stub -version=0x600+ TpCallbackLeaveCriticalSectionOnCompletion
-@ stub -version=0x600+ TpCallbackMayRunLong
-@ stub -version=0x600+ TpCallbackReleaseMutexOnCompletion
-@ stub -version=0x600+ TpCallbackReleaseSemaphoreOnCompletion
-@ stub -version=0x600+ TpCallbackSetEventOnCompletion
-@ stub -version=0x600+ TpCallbackUnloadDllOnCompletion
-@ stub -version=0x600+ TpCancelAsyncIoOperation
+@ stdcall -stub -version=0x600+ TpAllocCleanupGroup(ptr)
+@ stdcall -stub -version=0x600+ TpAllocIoCompletion(ptr ptr ptr ptr ptr)
+@ stdcall -stub -version=0x600+ TpAllocPool(ptr ptr)
+@ stdcall -stub -version=0x600+ TpAllocTimer(ptr ptr ptr ptr)
+@ stdcall -stub -version=0x600+ TpAllocWait(ptr ptr ptr ptr)
+@ stdcall -stub -version=0x600+ TpAllocWork(ptr ptr ptr ptr)
+@ stdcall -stub -version=0x600+ TpCallbackLeaveCriticalSectionOnCompletion(ptr ptr)
+@ stdcall -stub -version=0x600+ TpCallbackMayRunLong(ptr)
+@ stdcall -stub -version=0x600+ TpCallbackReleaseMutexOnCompletion(ptr ptr)
+@ stdcall -stub -version=0x600+ TpCallbackReleaseSemaphoreOnCompletion(ptr ptr long)
+@ stdcall -stub -version=0x600+ TpCallbackSetEventOnCompletion(ptr ptr)
+@ stdcall -stub -version=0x600+ TpCallbackUnloadDllOnCompletion(ptr ptr)
+@ stdcall -stub -version=0x600+ TpCancelAsyncIoOperation(ptr)
 @ stub -version=0x600+ TpCaptureCaller
 @ stub -version=0x600+ TpCheckTerminateWorker
 @ stub -version=0x600+ TpDbgDumpHeapUsage
 @ stub -version=0x600+ TpDbgSetLogRoutine
-@ stub -version=0x600+ TpDisassociateCallback
-@ stub -version=0x600+ TpIsTimerSet
-@ stub -version=0x600+ TpPostWork
+@ stdcall -stub -version=0x600+ TpDisassociateCallback(ptr)
+@ stdcall -stub -version=0x600+ TpIsTimerSet(ptr)
+@ stdcall -stub -version=0x600+ TpPostWork(ptr)
 @ stub -version=0x600+ TpReleaseAlpcCompletion
-@ stub -version=0x600+ TpReleaseCleanupGroup
-@ stub -version=0x600+ TpReleaseCleanupGroupMembers
-@ stub -version=0x600+ TpReleaseIoCompletion
-@ stub -version=0x600+ TpReleasePool
-@ stub -version=0x600+ TpReleaseTimer
-@ stub -version=0x600+ TpReleaseWait
-@ stub -version=0x600+ TpReleaseWork
-@ stub -version=0x600+ TpSetPoolMaxThreads
-@ stub -version=0x600+ TpSetPoolMinThreads
-@ stub -version=0x600+ TpSetTimer
-@ stub -version=0x600+ TpSetWait
-@ stub -version=0x600+ TpSimpleTryPost
-@ stub -version=0x600+ TpStartAsyncIoOperation
+@ stdcall -stub -version=0x600+ TpReleaseCleanupGroup(ptr)
+@ stdcall -stub -version=0x600+ TpReleaseCleanupGroupMembers(ptr long ptr)
+@ stdcall -stub -version=0x600+ TpReleaseIoCompletion(ptr)
+@ stdcall -stub -version=0x600+ TpReleasePool(ptr)
+@ stdcall -stub -version=0x600+ TpReleaseTimer(ptr)
+@ stdcall -stub -version=0x600+ TpReleaseWait(ptr)
+@ stdcall -stub -version=0x600+ TpReleaseWork(ptr)
+@ stdcall -stub -version=0x600+ TpSetPoolMaxThreads(ptr long)
+@ stdcall -stub -version=0x600+ TpSetPoolMinThreads(ptr long)
+@ stdcall -stub -version=0x600+ TpSetTimer(ptr ptr long long)
+@ stdcall -stub -version=0x600+ TpSetWait(ptr ptr ptr)
+@ stdcall -stub -version=0x600+ TpSimpleTryPost(ptr ptr ptr)
+@ stdcall -stub -version=0x600+ TpStartAsyncIoOperation(ptr)
 @ stub -version=0x600+ TpWaitForAlpcCompletion
-@ stub -version=0x600+ TpWaitForIoCompletion
-@ stub -version=0x600+ TpWaitForTimer
-@ stub -version=0x600+ TpWaitForWait
-@ stub -version=0x600+ TpWaitForWork
+@ stdcall -stub -version=0x600+ TpWaitForIoCompletion(ptr long)
+@ stdcall -stub -version=0x600+ TpWaitForTimer(ptr long)
+@ stdcall -stub -version=0x600+ TpWaitForWait(ptr long)
+@ stdcall -stub -version=0x600+ TpWaitForWork(ptr long)
 @ stdcall -ret64 VerSetConditionMask(double long long)
 @ stub -version=0x600+ WerCheckEventEscalation
 @ stub -version=0x600+ WerReportSQMEvent
@@ -1640,7 +1641,7 @@
 @ stdcall ZwReleaseSemaphore(long long ptr)
 @ stub -version=0x600+ ZwReleaseWorkerFactoryWorker
 @ stdcall ZwRemoveIoCompletion(ptr ptr ptr ptr ptr)
-@ stub -version=0x600+ ZwRemoveIoCompletionEx
+@ stdcall ZwRemoveIoCompletionEx(ptr ptr long ptr ptr long)
 @ stdcall ZwRemoveProcessDebug(ptr ptr)
 @ stdcall ZwRenameKey(ptr ptr)
 @ stub -version=0x600+ ZwRenameTransactionManager
@@ -1707,6 +1708,7 @@
 @ stdcall ZwSetSystemTime(ptr ptr)
 @ stdcall ZwSetThreadExecutionState(long ptr)
 @ stdcall ZwSetTimer(long ptr ptr ptr long long ptr)
+@ stdcall ZwSetTimerEx(ptr long ptr long)
 @ stdcall ZwSetTimerResolution(long long ptr)
 @ stdcall ZwSetUuidSeed(ptr)
 @ stdcall ZwSetValueKey(long long long long long long)
@@ -29,6 +29,35 @@ typedef struct _LDRP_TLS_DATA
     IMAGE_TLS_DIRECTORY TlsDirectory;
 } LDRP_TLS_DATA, *PLDRP_TLS_DATA;
 
+typedef struct _LDRP_EXPORT_HASH
+{
+    ULONG BucketMask;
+    ULONG NumberOfNames;
+    PULONG Hashes;
+    PULONG Next;
+    ULONG Buckets[ANYSIZE_ARRAY];
+} LDRP_EXPORT_HASH, *PLDRP_EXPORT_HASH;
+
+typedef struct _LDRP_ADDRESS_INDEX_ENTRY
+{
+    ULONG_PTR Base;
+    ULONG_PTR End;
+    PLDR_DATA_TABLE_ENTRY LdrEntry;
+    PLDRP_EXPORT_HASH ExportHash;
+} LDRP_ADDRESS_INDEX_ENTRY, *PLDRP_ADDRESS_INDEX_ENTRY;
+
+typedef struct _LDRP_PREFETCHED_DLL
+{
+    UNICODE_STRING FullDllName;
+    UNICODE_STRING BaseDllName;
+    HANDLE SectionHandle;
+    PVOID ViewBase;
+    SIZE_T ViewSize;
+    NTSTATUS MapStatus;
+    BOOLEAN KnownDll;
+    BOOLEAN Relocated;
+} LDRP_PREFETCHED_DLL, *PLDRP_PREFETCHED_DLL;
+
 typedef
 NTSTATUS
 (NTAPI* PLDR_APP_COMPAT_DLL_REDIRECTION_CALLBACK_FUNCTION)(
@@ -57,6 +86,9 @@ extern ULONG LdrpActiveUnloadCount;
 extern BOOLEAN LdrpShutdownInProgress;
 extern UNICODE_STRING LdrpKnownDllPath;
 extern PLDR_DATA_TABLE_ENTRY LdrpGetModuleHandleCache, LdrpLoadedDllHandleCache;
+extern RTL_CRITICAL_SECTION LdrpAddressIndexLock;
+extern BOOLEAN LdrpAddressIndexValid;
+extern ULONG LdrpMaxLoaderThreads;
 extern BOOLEAN RtlpPageHeapEnabled;
 extern ULONG RtlpDphGlobalFlags;
 extern BOOLEAN g_ShimsEnabled;
@@ -98,6 +130,16 @@ LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
 
 
 /* ldrutils.c */
+NTSTATUS NTAPI
+LdrpAllocateUnicodeString(IN OUT PUNICODE_STRING StringOut,
+                          IN ULONG Length);
+
+BOOLEAN NTAPI
+LdrpResolveDllName(PWSTR DllPath,
+                   PWSTR DllName,
+                   PUNICODE_STRING FullDllName,
+                   PUNICODE_STRING BaseDllName);
+
 NTSTATUS NTAPI
 LdrpGetProcedureAddress(IN PVOID BaseAddress,
                         IN PANSI_STRING Name,
@@ -111,6 +153,15 @@ LdrpAllocateDataTableEntry(IN PVOID BaseAddress);
 VOID NTAPI
 LdrpInsertMemoryTableEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry);
 
+VOID NTAPI
+LdrpInitializeAddressIndex(VOID);
+
+PLDRP_ADDRESS_INDEX_ENTRY NTAPI
+LdrpLookupAddressIndex(IN PVOID Address);
+
+VOID NTAPI
+LdrpRemoveAddressIndexEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry);
+
 NTSTATUS NTAPI
 LdrpLoadDll(IN BOOLEAN Redirected,
             IN PWSTR DllPath OPTIONAL,
@@ -173,6 +224,25 @@ LdrpLoadShimEngine(IN PWSTR ImageName,
 VOID NTAPI
 LdrpUnloadShimEngine(VOID);
 
+/* ldrwork.c */
+VOID NTAPI
+LdrpInitializeLoaderWorkers(VOID);
+
+BOOLEAN NTAPI
+LdrpIsLoaderWorkerThread(VOID);
+
+VOID NTAPI
+LdrpBeginImportPrefetch(IN PWSTR DllPath OPTIONAL,
+                        IN PLDR_DATA_TABLE_ENTRY LdrEntry);
+
+VOID NTAPI
+LdrpEndImportPrefetch(VOID);
+
+BOOLEAN NTAPI
+LdrpTakePrefetchedDll(IN PWSTR DllPath OPTIONAL,
+                      IN PWSTR DllName,
+                      OUT PLDRP_PREFETCHED_DLL Dll);
+
 /* verifier.c */
 
 NTSTATUS NTAPI
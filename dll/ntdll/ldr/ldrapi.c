@@ -445,6 +445,7 @@ LdrFindEntryForAddress(PVOID Address,
 {
     PLIST_ENTRY ListHead, NextEntry;
     PLDR_DATA_TABLE_ENTRY LdrEntry;
+    PLDRP_ADDRESS_INDEX_ENTRY IndexEntry;
     PIMAGE_NT_HEADERS NtHeader;
     PPEB_LDR_DATA Ldr = NtCurrentPeb()->Ldr;
     ULONG_PTR DllBase, DllEnd;
@@ -477,6 +478,26 @@ LdrFindEntryForAddress(PVOID Address,
         }
     }
 
+    /* Look it up in the address index */
+    if (LdrpAddressIndexValid)
+    {
+        LdrEntry = NULL;
+        RtlEnterCriticalSection(&LdrpAddressIndexLock);
+        IndexEntry = LdrpLookupAddressIndex(Address);
+        if (IndexEntry) LdrEntry = IndexEntry->LdrEntry;
+        RtlLeaveCriticalSection(&LdrpAddressIndexLock);
+
+        if (LdrEntry)
+        {
+            /* Return it */
+            *Module = LdrEntry;
+            return STATUS_SUCCESS;
+        }
+
+        /* It has every module the list has */
+        goto NotFound;
+    }
+
     /* Loop the module list */
     ListHead = &Ldr->InMemoryOrderModuleList;
     NextEntry = ListHead->Flink;
@@ -505,6 +526,7 @@ LdrFindEntryForAddress(PVOID Address,
         }
     }
 
+NotFound:
     /* Nothing found */
     DbgPrintEx(DPFLTR_LDR_ID,
                DPFLTR_WARNING_LEVEL,
@@ -1423,6 +1445,7 @@ LdrUnloadDll(IN PVOID BaseAddress)
             RemoveEntryList(&CurrentEntry->InInitializationOrderLinks);
             RemoveEntryList(&CurrentEntry->InMemoryOrderLinks);
             RemoveEntryList(&CurrentEntry->HashLinks);
+            LdrpRemoveAddressIndexEntry(CurrentEntry);
 
             /* If there's more then one active unload */
             if (LdrpActiveUnloadCount > 1)
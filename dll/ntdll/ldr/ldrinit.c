@@ -1486,6 +1486,14 @@ LdrpInitializeExecutionOptions(PUNICODE_STRING ImagePathName, PPEB Peb, PHANDLE
                                    sizeof(MinimumStackCommit),
                                    NULL);
 
+        /* Map imports on loader workers if more than one loader thread is allowed */
+        LdrQueryImageFileKeyOption(KeyHandle,
+                                   L"MaxLoaderThreads",
+                                   REG_DWORD,
+                                   &LdrpMaxLoaderThreads,
+                                   sizeof(LdrpMaxLoaderThreads),
+                                   NULL);
+
         /* Update PEB's minimum stack commit if it's lower */
         if (Peb->MinimumStackCommit < MinimumStackCommit)
             Peb->MinimumStackCommit = MinimumStackCommit;
@@ -1984,6 +1992,12 @@ LdrpInitializeProcess(IN PCONTEXT Context,
     RtlInitializeCriticalSection(&LdrpLoaderLock);
     LdrpLoaderLockInit = TRUE;
 
+    /* Initialize the module address index */
+    LdrpInitializeAddressIndex();
+
+    /* Initialize the loader worker queue */
+    LdrpInitializeLoaderWorkers();
+
     /* Check if User Stack Trace Database support was requested */
     if (Peb->NtGlobalFlag & FLG_USER_STACK_TRACE_DB)
     {
@@ -2588,6 +2602,10 @@ LdrpInit(PCONTEXT Context,
         Teb->DeallocationStack = MemoryBasicInfo.AllocationBase;
     }
 
+    /* Loader workers only map images for the thread holding the loader lock,
+       they must neither wait for process initialization nor attach to DLLs */
+    if (LdrpIsLoaderWorkerThread()) return;
+
     /* Now check if the process is already being initialized */
     while (_InterlockedCompareExchange(&LdrpProcessInitialized,
                                       1,
@@ -665,6 +665,117 @@ LdrpNameToOrdinal(IN LPSTR ImportName,
     return OrdinalTable[Next];
 }
 
+static
+ULONG
+LdrpHashExportName(IN LPSTR Name)
+{
+    ULONG Hash = 2166136261UL;
+
+    /* FNV-1a, export names are short and case sensitive */
+    while (*Name)
+    {
+        Hash ^= (UCHAR)*Name++;
+        Hash *= 16777619UL;
+    }
+
+    return Hash;
+}
+
+static
+PLDRP_EXPORT_HASH
+LdrpBuildExportHash(IN ULONG NumberOfNames,
+                    IN PVOID ExportBase,
+                    IN PULONG NameTable)
+{
+    PLDRP_EXPORT_HASH ExportHash;
+    ULONG BucketCount, i, Bucket;
+
+    /* One bucket per name, rounded up so the hash can be masked */
+    BucketCount = 16;
+    while (BucketCount < NumberOfNames) BucketCount <<= 1;
+
+    ExportHash = RtlAllocateHeap(LdrpHeap,
+                                 HEAP_ZERO_MEMORY,
+                                 FIELD_OFFSET(LDRP_EXPORT_HASH, Buckets[BucketCount]) +
+                                 2 * NumberOfNames * sizeof(ULONG));
+    if (!ExportHash) return NULL;
+
+    ExportHash->BucketMask = BucketCount - 1;
+    ExportHash->NumberOfNames = NumberOfNames;
+    ExportHash->Hashes = &ExportHash->Buckets[BucketCount];
+    ExportHash->Next = ExportHash->Hashes + NumberOfNames;
+
+    /* Chain every name into its bucket, an empty bucket is 0 so store index + 1 */
+    for (i = 0; i < NumberOfNames; i++)
+    {
+        ExportHash->Hashes[i] = LdrpHashExportName((LPSTR)((ULONG_PTR)ExportBase + NameTable[i]));
+        Bucket = ExportHash->Hashes[i] & ExportHash->BucketMask;
+        ExportHash->Next[i] = ExportHash->Buckets[Bucket];
+        ExportHash->Buckets[Bucket] = i + 1;
+    }
+
+    return ExportHash;
+}
+
+USHORT
+NTAPI
+LdrpExportNameToOrdinal(IN LPSTR ImportName,
+                        IN ULONG NumberOfNames,
+                        IN PVOID ExportBase,
+                        IN PULONG NameTable,
+                        IN PUSHORT OrdinalTable)
+{
+    PLDRP_ADDRESS_INDEX_ENTRY IndexEntry = NULL;
+    PLDRP_EXPORT_HASH ExportHash;
+    ULONG Hash, Next;
+
+    /* The hash hangs off the module's address index entry. We hold the
+       loader lock, so nobody else is changing the index or the hash. */
+    if ((LdrpAddressIndexValid) && (NumberOfNames))
+        IndexEntry = LdrpLookupAddressIndex(ExportBase);
+    if (!(IndexEntry) || (IndexEntry->Base != (ULONG_PTR)ExportBase))
+    {
+        return LdrpNameToOrdinal(ImportName,
+                                 NumberOfNames,
+                                 ExportBase,
+                                 NameTable,
+                                 OrdinalTable);
+    }
+
+    /* Build it on the first lookup the hint didn't answer */
+    ExportHash = IndexEntry->ExportHash;
+    if (!ExportHash)
+    {
+        ExportHash = LdrpBuildExportHash(NumberOfNames, ExportBase, NameTable);
+        if (!ExportHash)
+        {
+            return LdrpNameToOrdinal(ImportName,
+                                     NumberOfNames,
+                                     ExportBase,
+                                     NameTable,
+                                     OrdinalTable);
+        }
+
+        IndexEntry->ExportHash = ExportHash;
+    }
+
+    /* Walk the bucket, only compare the names whose hash matches */
+    Hash = LdrpHashExportName(ImportName);
+    for (Next = ExportHash->Buckets[Hash & ExportHash->BucketMask];
+         Next;
+         Next = ExportHash->Next[Next - 1])
+    {
+        if ((ExportHash->Hashes[Next - 1] == Hash) &&
+            !(strcmp(ImportName, (PCHAR)((ULONG_PTR)ExportBase + NameTable[Next - 1]))))
+        {
+            return OrdinalTable[Next - 1];
+        }
+    }
+
+    /* Not exported */
+    return -1;
+}
+
 NTSTATUS
 NTAPI
 LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
@@ -731,6 +842,9 @@ LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
     RtlActivateActivationContextUnsafeFast(&ActCtx,
                                            LdrEntry->EntryPointActivationContext);
 
+    /* Have the loader workers map the imports while we walk them */
+    LdrpBeginImportPrefetch(DllPath, LdrEntry);
+
     /* Check if we were redirected */
     if (!(LdrEntry->Flags & LDRP_REDIRECTED))
     {
@@ -794,6 +908,9 @@ LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
         }
     }
 
+    /* Drop what the workers mapped for nothing once the outermost walk is done */
+    LdrpEndImportPrefetch();
+
     /* Release the activation context */
     RtlDeactivateActivationContextUnsafeFast(&ActCtx);
 
@@ -1012,12 +1129,12 @@ LdrpSnapThunk(IN PVOID ExportBase,
         }
         else
         {
-            /* Well bummer, hint didn't work, do it the long way */
-            Ordinal = LdrpNameToOrdinal(ImportName,
-                                        ExportDirectory->NumberOfNames,
-                                        ExportBase,
-                                        NameTable,
-                                        OrdinalTable);
+            /* Well bummer, hint didn't work, look it up in the export hash */
+            Ordinal = LdrpExportNameToOrdinal(ImportName,
+                                              ExportDirectory->NumberOfNames,
+                                              ExportBase,
+                                              NameTable,
+                                              OrdinalTable);
         }
     }
 
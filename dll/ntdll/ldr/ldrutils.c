@@ -26,6 +26,12 @@ PVOID g_pfnSE_InstallBeforeInit;
 PVOID g_pfnSE_InstallAfterInit;
 PVOID g_pfnSE_ProcessDying;
 
+/* Loaded modules by address range, for address lookups that don't take the
+   loader lock. Changes hold both the loader lock and the index lock. */
+RTL_AVL_TABLE LdrpAddressIndex;
+RTL_CRITICAL_SECTION LdrpAddressIndexLock;
+BOOLEAN LdrpAddressIndexValid;
+
 /* FUNCTIONS *****************************************************************/
 
 NTSTATUS
@@ -1054,6 +1060,8 @@ LdrpMapDll(IN PWSTR SearchPath OPTIONAL,
     UNICODE_STRING IllegalDll;
     PVOID RelocData;
     ULONG RelocDataSize = 0;
+    LDRP_PREFETCHED_DLL PrefetchedDll;
+    BOOLEAN Relocated = FALSE;
 
     // FIXME: AppCompat stuff is missing
 
@@ -1064,6 +1072,20 @@ LdrpMapDll(IN PWSTR SearchPath OPTIONAL,
                 SearchPath ? SearchPath : L"");
     }
 
+    /* Check if a loader worker mapped it for us already */
+    if (Static && !Redirect && LdrpTakePrefetchedDll(SearchPath, DllName, &PrefetchedDll))
+    {
+        FullDllName = PrefetchedDll.FullDllName;
+        BaseDllName = PrefetchedDll.BaseDllName;
+        SectionHandle = PrefetchedDll.SectionHandle;
+        KnownDll = PrefetchedDll.KnownDll;
+        ViewBase = PrefetchedDll.ViewBase;
+        ViewSize = PrefetchedDll.ViewSize;
+        Relocated = PrefetchedDll.Relocated;
+        Status = PrefetchedDll.MapStatus;
+        goto Mapped;
+    }
+
     /* Check if we have a known dll directory */
     if (LdrpKnownDllObjectDirectory && Redirect == FALSE)
     {
@@ -1205,6 +1227,7 @@ SkipCheck:
     /* Restore */
     Teb->NtTib.ArbitraryUserPointer = ArbitraryUserPointer;
 
+Mapped:
     /* Fail if we couldn't map it */
     if (!NT_SUCCESS(Status))
     {
@@ -1287,6 +1310,7 @@ SkipCheck:
             RemoveEntryList(&LdrEntry->InLoadOrderLinks);
             RemoveEntryList(&LdrEntry->InMemoryOrderLinks);
             RemoveEntryList(&LdrEntry->HashLinks);
+            LdrpRemoveAddressIndexEntry(LdrEntry);
 
             /* Remove the LDR Entry */
             RtlFreeHeap(LdrpHeap, 0, LdrEntry );
@@ -1396,6 +1420,13 @@ SkipCheck:
                 }
             }
 
+            /* The loader worker that mapped it may have applied the fixups */
+            if (Relocated)
+            {
+                Status = STATUS_SUCCESS;
+                goto FailRelocate;
+            }
+
             /* See if this is an Illegal DLL - IE: user32 and kernel32 */
             RtlInitUnicodeString(&IllegalDll,L"user32.dll");
             if (RtlEqualUnicodeString(&BaseDllName, &IllegalDll, TRUE))
@@ -1481,6 +1512,7 @@ FailRelocate:
                 RemoveEntryList(&LdrEntry->InLoadOrderLinks);
                 RemoveEntryList(&LdrEntry->InMemoryOrderLinks);
                 RemoveEntryList(&LdrEntry->HashLinks);
+                LdrpRemoveAddressIndexEntry(LdrEntry);
 
                 /* Unmap it, clear the entry */
                 NtUnmapViewOfSection(NtCurrentProcess(), ViewBase);
@@ -1577,6 +1609,118 @@ LdrpAllocateDataTableEntry(IN PVOID BaseAddress)
     return LdrEntry;
 }
 
+static
+RTL_GENERIC_COMPARE_RESULTS
+NTAPI
+LdrpCompareAddressIndexEntries(IN PRTL_AVL_TABLE Table,
+                               IN PVOID FirstStruct,
+                               IN PVOID SecondStruct)
+{
+    PLDRP_ADDRESS_INDEX_ENTRY First = FirstStruct, Second = SecondStruct;
+
+    /* Modules don't overlap, so any overlap with one means it's that one */
+    if (First->End <= Second->Base) return GenericLessThan;
+    if (First->Base >= Second->End) return GenericGreaterThan;
+    return GenericEqual;
+}
+
+static
+PVOID
+NTAPI
+LdrpAllocateAddressIndexEntry(IN PRTL_AVL_TABLE Table,
+                              IN CLONG ByteSize)
+{
+    return RtlAllocateHeap(LdrpHeap, 0, ByteSize);
+}
+
+static
+VOID
+NTAPI
+LdrpFreeAddressIndexEntry(IN PRTL_AVL_TABLE Table,
+                          IN PVOID Buffer)
+{
+    RtlFreeHeap(LdrpHeap, 0, Buffer);
+}
+
+VOID
+NTAPI
+LdrpInitializeAddressIndex(VOID)
+{
+    RtlInitializeCriticalSection(&LdrpAddressIndexLock);
+    RtlInitializeGenericTableAvl(&LdrpAddressIndex,
+                                 LdrpCompareAddressIndexEntries,
+                                 LdrpAllocateAddressIndexEntry,
+                                 LdrpFreeAddressIndexEntry,
+                                 NULL);
+    LdrpAddressIndexValid = TRUE;
+}
+
+PLDRP_ADDRESS_INDEX_ENTRY
+NTAPI
+LdrpLookupAddressIndex(IN PVOID Address)
+{
+    LDRP_ADDRESS_INDEX_ENTRY Key;
+
+    /* The caller holds either the loader lock or the index lock */
+    Key.Base = (ULONG_PTR)Address;
+    Key.End = Key.Base + 1;
+    return RtlLookupElementGenericTableAvl(&LdrpAddressIndex, &Key);
+}
+
+static
+VOID
+LdrpInsertAddressIndexEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry)
+{
+    LDRP_ADDRESS_INDEX_ENTRY IndexEntry;
+    PIMAGE_NT_HEADERS NtHeader;
+    BOOLEAN NewElement = FALSE;
+
+    if (!LdrpAddressIndexValid) return;
+
+    /* Use the mapped size, like the module list walks always did */
+    NtHeader = RtlImageNtHeader(LdrEntry->DllBase);
+    IndexEntry.Base = (ULONG_PTR)LdrEntry->DllBase;
+    IndexEntry.End = IndexEntry.Base + (NtHeader ? NtHeader->OptionalHeader.SizeOfImage :
+                                                   LdrEntry->SizeOfImage);
+    IndexEntry.LdrEntry = LdrEntry;
+    IndexEntry.ExportHash = NULL;
+
+    RtlEnterCriticalSection(&LdrpAddressIndexLock);
+    if (!RtlInsertElementGenericTableAvl(&LdrpAddressIndex,
+                                         &IndexEntry,
+                                         sizeof(IndexEntry),
+                                         &NewElement) || !NewElement)
+    {
+        /* Lookups go back to walking the module list from now on */
+        DPRINT1("LDR: Can't index %wZ at %p, disabling the address index\n",
+                &LdrEntry->BaseDllName, LdrEntry->DllBase);
+        LdrpAddressIndexValid = FALSE;
+    }
+    RtlLeaveCriticalSection(&LdrpAddressIndexLock);
+}
+
+VOID
+NTAPI
+LdrpRemoveAddressIndexEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry)
+{
+    PLDRP_ADDRESS_INDEX_ENTRY IndexEntry;
+    PLDRP_EXPORT_HASH ExportHash = NULL;
+
+    /* Even once the index is disabled, the modules indexed before that are
+       still in the table and their entries and export hashes must be freed */
+    RtlEnterCriticalSection(&LdrpAddressIndexLock);
+    IndexEntry = LdrpLookupAddressIndex(LdrEntry->DllBase);
+    if ((IndexEntry) && (IndexEntry->LdrEntry == LdrEntry))
+    {
+        ExportHash = IndexEntry->ExportHash;
+        RtlDeleteElementGenericTableAvl(&LdrpAddressIndex, IndexEntry);
+    }
+    RtlLeaveCriticalSection(&LdrpAddressIndexLock);
+
+    /* Free the export name hash built for it, if any */
+    if (ExportHash) RtlFreeHeap(LdrpHeap, 0, ExportHash);
+}
+
 VOID
 NTAPI
 LdrpInsertMemoryTableEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry)
@@ -1591,6 +1735,9 @@ LdrpInsertMemoryTableEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry)
     /* Insert into other lists */
     InsertTailList(&PebData->InLoadOrderModuleList, &LdrEntry->InLoadOrderLinks);
     InsertTailList(&PebData->InMemoryOrderModuleList, &LdrEntry->InMemoryOrderLinks);
+
+    /* And into the address index */
+    LdrpInsertAddressIndexEntry(LdrEntry);
 }
 
 VOID
@@ -1622,6 +1769,7 @@ LdrpCheckForLoadedDllHandle(IN PVOID Base,
                             OUT PLDR_DATA_TABLE_ENTRY *LdrEntry)
 {
     PLDR_DATA_TABLE_ENTRY Current;
+    PLDRP_ADDRESS_INDEX_ENTRY IndexEntry;
     PLIST_ENTRY ListHead, Next;
 
     /* Check the cache first */
@@ -1633,6 +1781,25 @@ LdrpCheckForLoadedDllHandle(IN PVOID Base,
         return TRUE;
     }
 
+    /* Use the address index if we can */
+    if (LdrpAddressIndexValid)
+    {
+        Current = NULL;
+        RtlEnterCriticalSection(&LdrpAddressIndexLock);
+        IndexEntry = LdrpLookupAddressIndex(Base);
+        if ((IndexEntry) && (IndexEntry->Base == (ULONG_PTR)Base))
+            Current = IndexEntry->LdrEntry;
+        RtlLeaveCriticalSection(&LdrpAddressIndexLock);
+
+        /* Make sure it's not unloading */
+        if (!(Current) || !(Current->InMemoryOrderLinks.Flink)) return FALSE;
+
+        /* Save in cache and return it */
+        LdrpLoadedDllHandleCache = Current;
+        *LdrEntry = Current;
+        return TRUE;
+    }
+
     /* Time for a lookup */
     ListHead = &NtCurrentPeb()->Ldr->InLoadOrderModuleList;
     Next = ListHead->Flink;
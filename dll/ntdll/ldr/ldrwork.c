@@ -0,0 +1,620 @@
+/*
+ * PROJECT:     ReactOS NT User Mode Library
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Loader worker threads mapping imports ahead of the import walk
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <ntdll.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* GLOBALS *******************************************************************/
+
+#define LDRP_MAX_LOADER_WORKERS     16
+#define LDRP_WORKER_IDLE_TIMEOUT    Int32x32To64(2000, -10000)
+
+#define LDRP_PREFETCH_QUEUED        0
+#define LDRP_PREFETCH_MAPPING       1
+#define LDRP_PREFETCH_DONE          2
+
+/*
+ * The thread walking the imports holds the loader lock and is the only one
+ * queueing, taking and discarding entries. The workers only ever touch the
+ * entry they dequeued, and never the loader's own lists.
+ */
+typedef struct _LDRP_PREFETCH_ENTRY
+{
+    LIST_ENTRY Links;
+    LIST_ENTRY QueueLinks;
+    volatile LONG State;
+    PWSTR DllPath;
+    UNICODE_STRING DllName;
+    LDRP_PREFETCHED_DLL Dll;
+    BOOLEAN Mapped;
+} LDRP_PREFETCH_ENTRY, *PLDRP_PREFETCH_ENTRY;
+
+/* IFEO MaxLoaderThreads, including the thread walking the imports */
+ULONG LdrpMaxLoaderThreads;
+
+static RTL_CRITICAL_SECTION LdrpPrefetchLock;
+static LIST_ENTRY LdrpPrefetchList;
+static LIST_ENTRY LdrpPrefetchQueue;
+static HANDLE LdrpPrefetchSemaphore;
+static HANDLE LdrpPrefetchDoneEvent;
+static ULONG LdrpImportWalkDepth;
+static ULONG LdrpLoaderWorkers;
+static HANDLE LdrpLoaderWorkerIds[LDRP_MAX_LOADER_WORKERS];
+
+/* FUNCTIONS *****************************************************************/
+
+static
+NTSTATUS
+LdrpPrefetchCreateSection(IN PUNICODE_STRING FullDllName,
+                          OUT PHANDLE SectionHandle)
+{
+    UNICODE_STRING NtPathDllName;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    HANDLE FileHandle;
+    NTSTATUS Status;
+
+    if (!RtlDosPathNameToNtPathName_U(FullDllName->Buffer, &NtPathDllName, NULL, NULL))
+        return STATUS_OBJECT_PATH_SYNTAX_BAD;
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &NtPathDllName,
+                               OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+
+    /* Same as LdrpCreateDllSection, minus the hard errors: on failure the
+       import walk maps the DLL itself and reports the error from there */
+    Status = NtOpenFile(&FileHandle,
+                        SYNCHRONIZE | FILE_EXECUTE | FILE_READ_DATA,
+                        &ObjectAttributes,
+                        &IoStatusBlock,
+                        FILE_SHARE_READ | FILE_SHARE_DELETE,
+                        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT);
+    if (!NT_SUCCESS(Status))
+    {
+        Status = NtOpenFile(&FileHandle,
+                            SYNCHRONIZE | FILE_EXECUTE,
+                            &ObjectAttributes,
+                            &IoStatusBlock,
+                            FILE_SHARE_READ | FILE_SHARE_DELETE,
+                            FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT);
+    }
+    RtlFreeHeap(RtlGetProcessHeap(), 0, NtPathDllName.Buffer);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    Status = NtCreateSection(SectionHandle,
+                             SECTION_MAP_READ | SECTION_MAP_EXECUTE |
+                             SECTION_MAP_WRITE | SECTION_QUERY,
+                             NULL,
+                             NULL,
+                             PAGE_EXECUTE,
+                             SEC_IMAGE,
+                             FileHandle);
+    NtClose(FileHandle);
+    return Status;
+}
+
+static
+NTSTATUS
+LdrpPrefetchOpenKnownDll(IN PUNICODE_STRING DllName,
+                         OUT PLDRP_PREFETCHED_DLL Dll)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    NTSTATUS Status;
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               DllName,
+                               OBJ_CASE_INSENSITIVE,
+                               LdrpKnownDllObjectDirectory,
+                               NULL);
+    Status = NtOpenSection(&Dll->SectionHandle,
+                           SECTION_MAP_READ | SECTION_MAP_EXECUTE | SECTION_MAP_WRITE,
+                           &ObjectAttributes);
+    if (!NT_SUCCESS(Status))
+    {
+        Dll->SectionHandle = NULL;
+        return Status;
+    }
+
+    /* Build the same names LdrpCheckForKnownDll does */
+    Status = LdrpAllocateUnicodeString(&Dll->BaseDllName, DllName->Length);
+    if (NT_SUCCESS(Status))
+    {
+        RtlCopyUnicodeString(&Dll->BaseDllName, DllName);
+        Status = LdrpAllocateUnicodeString(&Dll->FullDllName,
+                                           LdrpKnownDllPath.Length + sizeof(WCHAR) + DllName->Length);
+    }
+    if (!NT_SUCCESS(Status))
+    {
+        LdrpFreeUnicodeString(&Dll->BaseDllName);
+        NtClose(Dll->SectionHandle);
+        Dll->SectionHandle = NULL;
+        return Status;
+    }
+
+    RtlCopyUnicodeString(&Dll->FullDllName, &LdrpKnownDllPath);
+    RtlAppendUnicodeToString(&Dll->FullDllName, L"\\");
+    RtlAppendUnicodeStringToString(&Dll->FullDllName, DllName);
+    Dll->KnownDll = TRUE;
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+LdrpPrefetchDiscardDll(IN PLDRP_PREFETCHED_DLL Dll)
+{
+    if (Dll->ViewBase)
+        NtUnmapViewOfSection(NtCurrentProcess(), Dll->ViewBase);
+    if (Dll->SectionHandle)
+        NtClose(Dll->SectionHandle);
+    LdrpFreeUnicodeString(&Dll->FullDllName);
+    LdrpFreeUnicodeString(&Dll->BaseDllName);
+}
+
+/* Runs on a loader worker, so nothing here may look at the loader lists */
+static
+VOID
+LdrpPrefetchDll(IN PLDRP_PREFETCH_ENTRY Entry)
+{
+    PLDRP_PREFETCHED_DLL Dll = &Entry->Dll;
+    PTEB Teb = NtCurrentTeb();
+    PVOID ArbitraryUserPointer;
+    PIMAGE_NT_HEADERS NtHeaders;
+    UNICODE_STRING IllegalDll;
+    PVOID RelocData;
+    ULONG RelocDataSize = 0;
+    NTSTATUS Status;
+
+    /* The import walk already skipped names with a path, so try Known DLLs first like LdrpMapDll */
+    if (LdrpKnownDllObjectDirectory)
+        LdrpPrefetchOpenKnownDll(&Entry->DllName, Dll);
+
+    if (!Dll->SectionHandle)
+    {
+        if (!LdrpResolveDllName(Entry->DllPath,
+                                Entry->DllName.Buffer,
+                                &Dll->FullDllName,
+                                &Dll->BaseDllName))
+        {
+            return;
+        }
+
+        Status = LdrpPrefetchCreateSection(&Dll->FullDllName, &Dll->SectionHandle);
+        if (!NT_SUCCESS(Status))
+        {
+            Dll->SectionHandle = NULL;
+            goto Discard;
+        }
+    }
+
+    /* Stuff the image name in the TIB, for the debugger */
+    ArbitraryUserPointer = Teb->NtTib.ArbitraryUserPointer;
+    Teb->NtTib.ArbitraryUserPointer = Dll->FullDllName.Buffer;
+
+    Dll->ViewSize = 0;
+    Dll->MapStatus = NtMapViewOfSection(Dll->SectionHandle,
+                                        NtCurrentProcess(),
+                                        &Dll->ViewBase,
+                                        0,
+                                        0,
+                                        NULL,
+                                        &Dll->ViewSize,
+                                        ViewShare,
+                                        0,
+                                        PAGE_READWRITE);
+
+    Teb->NtTib.ArbitraryUserPointer = ArbitraryUserPointer;
+
+    /* Anything unusual is left to LdrpMapDll */
+    if ((Dll->MapStatus != STATUS_SUCCESS) &&
+        (Dll->MapStatus != STATUS_IMAGE_NOT_AT_BASE))
+    {
+        goto Discard;
+    }
+
+    NtHeaders = RtlImageNtHeader(Dll->ViewBase);
+    if (!NtHeaders)
+        goto Discard;
+
+    /* Apply the fixups here too, unless LdrpMapDll would refuse to or has nothing to do */
+    if ((Dll->MapStatus == STATUS_IMAGE_NOT_AT_BASE) &&
+        (NtHeaders->FileHeader.Characteristics & IMAGE_FILE_DLL) &&
+        !(NtHeaders->FileHeader.Characteristics & IMAGE_FILE_RELOCS_STRIPPED))
+    {
+        RelocData = RtlImageDirectoryEntryToData(Dll->ViewBase,
+                                                 TRUE,
+                                                 IMAGE_DIRECTORY_ENTRY_BASERELOC,
+                                                 &RelocDataSize);
+        if (!RelocData && !RelocDataSize)
+            goto Done;
+
+        RtlInitUnicodeString(&IllegalDll, L"user32.dll");
+        if (RtlEqualUnicodeString(&Dll->BaseDllName, &IllegalDll, TRUE))
+            goto Done;
+        RtlInitUnicodeString(&IllegalDll, L"kernel32.dll");
+        if (RtlEqualUnicodeString(&Dll->BaseDllName, &IllegalDll, TRUE))
+            goto Done;
+
+        Status = LdrpSetProtection(Dll->ViewBase, FALSE);
+        if (NT_SUCCESS(Status))
+        {
+            Status = LdrRelocateImageWithBias(Dll->ViewBase, 0LL, NULL, STATUS_SUCCESS,
+                STATUS_CONFLICTING_ADDRESSES, STATUS_INVALID_IMAGE_FORMAT);
+            if (NT_SUCCESS(Status))
+                Status = LdrpSetProtection(Dll->ViewBase, TRUE);
+        }
+        if (!NT_SUCCESS(Status))
+            goto Discard;
+
+        Dll->Relocated = TRUE;
+    }
+
+Done:
+    Entry->Mapped = TRUE;
+    return;
+
+Discard:
+    LdrpPrefetchDiscardDll(Dll);
+    RtlZeroMemory(Dll, sizeof(*Dll));
+}
+
+static
+ULONG
+NTAPI
+LdrpLoaderWorker(IN PVOID Parameter)
+{
+    LARGE_INTEGER Timeout;
+    PLDRP_PREFETCH_ENTRY Entry;
+    PLIST_ENTRY ListEntry;
+    NTSTATUS Status;
+    ULONG i;
+
+    Timeout.QuadPart = LDRP_WORKER_IDLE_TIMEOUT;
+
+    for (;;)
+    {
+        Status = NtWaitForSingleObject(LdrpPrefetchSemaphore, FALSE, &Timeout);
+
+        RtlEnterCriticalSection(&LdrpPrefetchLock);
+        if (IsListEmpty(&LdrpPrefetchQueue))
+        {
+            /* The loader took the entry back, or we have been idle for long enough */
+            if (Status == STATUS_TIMEOUT)
+                break;
+
+            RtlLeaveCriticalSection(&LdrpPrefetchLock);
+            continue;
+        }
+
+        ListEntry = RemoveHeadList(&LdrpPrefetchQueue);
+        Entry = CONTAINING_RECORD(ListEntry, LDRP_PREFETCH_ENTRY, QueueLinks);
+        Entry->State = LDRP_PREFETCH_MAPPING;
+        RtlLeaveCriticalSection(&LdrpPrefetchLock);
+
+        LdrpPrefetchDll(Entry);
+
+        InterlockedExchange(&Entry->State, LDRP_PREFETCH_DONE);
+        NtSetEvent(LdrpPrefetchDoneEvent, NULL);
+    }
+
+    for (i = 0; i < LDRP_MAX_LOADER_WORKERS; i++)
+    {
+        if (LdrpLoaderWorkerIds[i] == NtCurrentTeb()->ClientId.UniqueThread)
+        {
+            LdrpLoaderWorkerIds[i] = NULL;
+            break;
+        }
+    }
+    LdrpLoaderWorkers--;
+    RtlLeaveCriticalSection(&LdrpPrefetchLock);
+
+    /* We never ran LdrpInitializeThread, so don't go through LdrShutdownThread either */
+    NtCurrentTeb()->FreeStackOnTermination = TRUE;
+    NtTerminateThread(NtCurrentThread(), STATUS_SUCCESS);
+    return 0;
+}
+
+/* The caller holds the prefetch lock */
+static
+VOID
+LdrpStartLoaderWorkers(IN ULONG Queued)
+{
+    CLIENT_ID ClientId;
+    HANDLE Thread;
+    NTSTATUS Status;
+    ULONG MaxWorkers, i;
+
+    MaxWorkers = min(LdrpMaxLoaderThreads - 1, LDRP_MAX_LOADER_WORKERS);
+
+    while ((LdrpLoaderWorkers < MaxWorkers) && (LdrpLoaderWorkers < Queued))
+    {
+        /* Start it suspended, so LdrpInit knows what it is before it runs */
+        Status = RtlCreateUserThread(NtCurrentProcess(),
+                                     NULL,
+                                     TRUE,
+                                     0,
+                                     0,
+                                     0,
+                                     LdrpLoaderWorker,
+                                     NULL,
+                                     &Thread,
+                                     &ClientId);
+        if (!NT_SUCCESS(Status))
+            break;
+
+        for (i = 0; i < LDRP_MAX_LOADER_WORKERS; i++)
+        {
+            if (!LdrpLoaderWorkerIds[i])
+            {
+                LdrpLoaderWorkerIds[i] = ClientId.UniqueThread;
+                break;
+            }
+        }
+        ASSERT(i < LDRP_MAX_LOADER_WORKERS);
+        LdrpLoaderWorkers++;
+
+        NtResumeThread(Thread, NULL);
+        NtClose(Thread);
+    }
+}
+
+static
+PLDRP_PREFETCH_ENTRY
+LdrpFindPrefetchEntry(IN PWSTR DllPath OPTIONAL,
+                      IN PUNICODE_STRING DllName)
+{
+    PLDRP_PREFETCH_ENTRY Entry;
+    PLIST_ENTRY ListEntry;
+
+    for (ListEntry = LdrpPrefetchList.Flink;
+         ListEntry != &LdrpPrefetchList;
+         ListEntry = ListEntry->Flink)
+    {
+        Entry = CONTAINING_RECORD(ListEntry, LDRP_PREFETCH_ENTRY, Links);
+        if ((Entry->DllPath == DllPath) &&
+            RtlEqualUnicodeString(&Entry->DllName, DllName, TRUE))
+        {
+            return Entry;
+        }
+    }
+
+    return NULL;
+}
+
+/* Unlinks an entry, waiting for its worker if one picked it up already */
+static
+VOID
+LdrpRemovePrefetchEntry(IN PLDRP_PREFETCH_ENTRY Entry)
+{
+    RtlEnterCriticalSection(&LdrpPrefetchLock);
+    RemoveEntryList(&Entry->Links);
+    if (Entry->State == LDRP_PREFETCH_QUEUED)
+    {
+        RemoveEntryList(&Entry->QueueLinks);
+        Entry->State = LDRP_PREFETCH_DONE;
+    }
+    RtlLeaveCriticalSection(&LdrpPrefetchLock);
+
+    while (InterlockedCompareExchange(&Entry->State, 0, 0) != LDRP_PREFETCH_DONE)
+    {
+        NtWaitForSingleObject(LdrpPrefetchDoneEvent, FALSE, NULL);
+    }
+}
+
+VOID
+NTAPI
+LdrpInitializeLoaderWorkers(VOID)
+{
+    RtlInitializeCriticalSection(&LdrpPrefetchLock);
+    InitializeListHead(&LdrpPrefetchList);
+    InitializeListHead(&LdrpPrefetchQueue);
+}
+
+BOOLEAN
+NTAPI
+LdrpIsLoaderWorkerThread(VOID)
+{
+    HANDLE ThreadId = NtCurrentTeb()->ClientId.UniqueThread;
+    ULONG i;
+
+    /* Slots are filled in before the worker is resumed */
+    for (i = 0; i < LDRP_MAX_LOADER_WORKERS; i++)
+    {
+        if (LdrpLoaderWorkerIds[i] == ThreadId)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+VOID
+NTAPI
+LdrpBeginImportPrefetch(IN PWSTR DllPath OPTIONAL,
+                        IN PLDR_DATA_TABLE_ENTRY LdrEntry)
+{
+    PIMAGE_IMPORT_DESCRIPTOR ImportEntry;
+    PIMAGE_THUNK_DATA FirstThunk;
+    PLDRP_PREFETCH_ENTRY Entry;
+    PLDR_DATA_TABLE_ENTRY DllLdrEntry;
+    UNICODE_STRING DllName, RedirectedName, *NewName;
+    WCHAR NameBuffer[MAX_PATH];
+    ANSI_STRING ImportName;
+    ULONG IatSize, Queued = 0;
+    BOOLEAN GotPath, GotExtension;
+    NTSTATUS Status;
+    PWCHAR p;
+
+    LdrpImportWalkDepth++;
+
+    if (LdrpMaxLoaderThreads <= 1)
+        return;
+
+    ImportEntry = RtlImageDirectoryEntryToData(LdrEntry->DllBase,
+                                               TRUE,
+                                               IMAGE_DIRECTORY_ENTRY_IMPORT,
+                                               &IatSize);
+    if (!ImportEntry)
+        return;
+
+    /* Create the queue objects on first use */
+    if (!LdrpPrefetchSemaphore)
+    {
+        Status = NtCreateSemaphore(&LdrpPrefetchSemaphore, SEMAPHORE_ALL_ACCESS, NULL, 0, MAXLONG);
+        if (NT_SUCCESS(Status))
+        {
+            Status = NtCreateEvent(&LdrpPrefetchDoneEvent, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+            if (!NT_SUCCESS(Status))
+            {
+                NtClose(LdrpPrefetchSemaphore);
+                LdrpPrefetchSemaphore = NULL;
+            }
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("LDR: Loader workers disabled, status %lx\n", Status);
+            LdrpMaxLoaderThreads = 0;
+            return;
+        }
+    }
+
+    for (; ImportEntry->Name && ImportEntry->FirstThunk; ImportEntry++)
+    {
+        FirstThunk = (PIMAGE_THUNK_DATA)((ULONG_PTR)LdrEntry->DllBase + ImportEntry->FirstThunk);
+        if (!FirstThunk->u1.Function)
+            continue;
+
+        /* Name it the way LdrpLoadImportModule will */
+        RtlInitEmptyUnicodeString(&DllName, NameBuffer, sizeof(NameBuffer));
+        RtlInitAnsiString(&ImportName, (PSTR)((ULONG_PTR)LdrEntry->DllBase + ImportEntry->Name));
+        Status = RtlAnsiStringToUnicodeString(&DllName, &ImportName, FALSE);
+        if (!NT_SUCCESS(Status))
+            continue;
+
+        GotPath = GotExtension = FALSE;
+        for (p = DllName.Buffer; p < DllName.Buffer + DllName.Length / sizeof(WCHAR); p++)
+        {
+            if ((*p == L'\\') || (*p == L'/'))
+                GotPath = TRUE;
+            else if (*p == L'.')
+                GotExtension = TRUE;
+        }
+
+        /* Names with a path are rare, leave them to the walk */
+        if (GotPath)
+            continue;
+        if (!GotExtension &&
+            !NT_SUCCESS(RtlAppendUnicodeStringToString(&DllName, &LdrApiDefaultExtension)))
+        {
+            continue;
+        }
+
+        /* Redirected DLLs go through the walk as well */
+        RtlInitEmptyUnicodeString(&RedirectedName, NULL, 0);
+        NewName = &DllName;
+        Status = RtlDosApplyFileIsolationRedirection_Ustr(TRUE,
+                                                          &DllName,
+                                                          &LdrApiDefaultExtension,
+                                                          NULL,
+                                                          &RedirectedName,
+                                                          &NewName,
+                                                          NULL,
+                                                          NULL,
+                                                          NULL);
+        RtlFreeUnicodeString(&RedirectedName);
+        if (Status != STATUS_SXS_KEY_NOT_FOUND)
+            continue;
+
+        if (LdrpCheckForLoadedDll(DllPath, &DllName, TRUE, FALSE, &DllLdrEntry))
+            continue;
+
+        /* Another image may have queued it already */
+        if (LdrpFindPrefetchEntry(DllPath, &DllName))
+            continue;
+
+        Entry = RtlAllocateHeap(LdrpHeap,
+                                HEAP_ZERO_MEMORY,
+                                sizeof(*Entry) + DllName.Length + sizeof(UNICODE_NULL));
+        if (!Entry)
+            break;
+
+        Entry->DllPath = DllPath;
+        Entry->DllName.Buffer = (PWSTR)(Entry + 1);
+        Entry->DllName.MaximumLength = DllName.Length + sizeof(UNICODE_NULL);
+        RtlCopyUnicodeString(&Entry->DllName, &DllName);
+        Entry->State = LDRP_PREFETCH_QUEUED;
+
+        RtlEnterCriticalSection(&LdrpPrefetchLock);
+        InsertTailList(&LdrpPrefetchList, &Entry->Links);
+        InsertTailList(&LdrpPrefetchQueue, &Entry->QueueLinks);
+        RtlLeaveCriticalSection(&LdrpPrefetchLock);
+
+        NtReleaseSemaphore(LdrpPrefetchSemaphore, 1, NULL);
+        Queued++;
+    }
+
+    if (Queued)
+    {
+        RtlEnterCriticalSection(&LdrpPrefetchLock);
+        LdrpStartLoaderWorkers(Queued);
+        RtlLeaveCriticalSection(&LdrpPrefetchLock);
+    }
+}
+
+VOID
+NTAPI
+LdrpEndImportPrefetch(VOID)
+{
+    PLDRP_PREFETCH_ENTRY Entry;
+
+    if (--LdrpImportWalkDepth)
+        return;
+
+    /* Whatever the walk didn't take is not needed anymore */
+    while (!IsListEmpty(&LdrpPrefetchList))
+    {
+        Entry = CONTAINING_RECORD(LdrpPrefetchList.Flink, LDRP_PREFETCH_ENTRY, Links);
+        LdrpRemovePrefetchEntry(Entry);
+        if (Entry->Mapped)
+            LdrpPrefetchDiscardDll(&Entry->Dll);
+        RtlFreeHeap(LdrpHeap, 0, Entry);
+    }
+}
+
+BOOLEAN
+NTAPI
+LdrpTakePrefetchedDll(IN PWSTR DllPath OPTIONAL,
+                      IN PWSTR DllName,
+                      OUT PLDRP_PREFETCHED_DLL Dll)
+{
+    PLDRP_PREFETCH_ENTRY Entry;
+    UNICODE_STRING Name;
+    BOOLEAN Mapped;
+
+    if (IsListEmpty(&LdrpPrefetchList))
+        return FALSE;
+
+    RtlInitUnicodeString(&Name, DllName);
+    Entry = LdrpFindPrefetchEntry(DllPath, &Name);
+    if (!Entry)
+        return FALSE;
+
+    LdrpRemovePrefetchEntry(Entry);
+
+    Mapped = Entry->Mapped;
+    if (Mapped)
+        *Dll = Entry->Dll;
+
+    RtlFreeHeap(LdrpHeap, 0, Entry);
+    return Mapped;
+}
+
+/* EOF */
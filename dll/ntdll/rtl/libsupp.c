@@ -664,6 +664,16 @@ RtlPcToFileHeader(IN PVOID PcValue,
     PLDR_DATA_TABLE_ENTRY Module;
     PVOID ImageBase = NULL;
 
+    /* The loader indexes modules by address, no need for the loader lock */
+    if (LdrpAddressIndexValid)
+    {
+        if (NT_SUCCESS(LdrFindEntryForAddress(PcValue, &Module)))
+            ImageBase = Module->DllBase;
+
+        *BaseOfImage = ImageBase;
+        return ImageBase;
+    }
+
     RtlEnterCriticalSection (NtCurrentPeb()->LoaderLock);
     ModuleListHead = &NtCurrentPeb()->Ldr->InLoadOrderModuleList;
     Entry = ModuleListHead->Flink;
@@ -342,6 +342,7 @@ ReadFileScatter(HANDLE hFile,
 {
     PIO_STATUS_BLOCK pIOStatus;
     LARGE_INTEGER Offset;
+    PVOID ApcContext;
     NTSTATUS Status;
 
     DPRINT("(%p %p %u %p)\n", hFile, aSegmentArray, nNumberOfBytesToRead, lpOverlapped);
@@ -352,19 +353,23 @@ ReadFileScatter(HANDLE hFile,
     pIOStatus->Status = STATUS_PENDING;
     pIOStatus->Information = 0;
 
+    /* Completion ports are not told about it when the low bit of the event is set */
+    ApcContext = (((ULONG_PTR)lpOverlapped->hEvent & 0x1) ? NULL : lpOverlapped);
+
     Status = NtReadFileScatter(hFile,
+                               lpOverlapped->hEvent,
                                NULL,
-                               NULL,
-                               NULL,
+                               ApcContext,
                                pIOStatus,
                                aSegmentArray,
                                nNumberOfBytesToRead,
                                &Offset,
                                NULL);
 
-    if (!NT_SUCCESS(Status))
+    /* return FALSE in case of failure and pending operations! */
+    if (!NT_SUCCESS(Status) || Status == STATUS_PENDING)
     {
-        SetLastError(RtlNtStatusToDosError(Status));
+        BaseSetLastNTError(Status);
         return FALSE;
     }
 
@@ -384,6 +389,7 @@ WriteFileGather(HANDLE hFile,
 {
     PIO_STATUS_BLOCK IOStatus;
     LARGE_INTEGER Offset;
+    PVOID ApcContext;
     NTSTATUS Status;
 
     DPRINT("%p %p %u %p\n", hFile, aSegmentArray, nNumberOfBytesToWrite, lpOverlapped);
@@ -394,19 +400,23 @@ WriteFileGather(HANDLE hFile,
     IOStatus->Status = STATUS_PENDING;
     IOStatus->Information = 0;
 
+    /* Completion ports are not told about it when the low bit of the event is set */
+    ApcContext = (((ULONG_PTR)lpOverlapped->hEvent & 0x1) ? NULL : lpOverlapped);
+
     Status = NtWriteFileGather(hFile,
+                               lpOverlapped->hEvent,
                                NULL,
-                               NULL,
-                               NULL,
+                               ApcContext,
                                IOStatus,
                                aSegmentArray,
                                nNumberOfBytesToWrite,
                                &Offset,
                                NULL);
 
-    if (!NT_SUCCESS(Status))
+    /* return FALSE in case of failure and pending operations! */
+    if (!NT_SUCCESS(Status) || Status == STATUS_PENDING)
     {
-        SetLastError(RtlNtStatusToDosError(Status));
+        BaseSetLastNTError(Status);
         return FALSE;
     }
 
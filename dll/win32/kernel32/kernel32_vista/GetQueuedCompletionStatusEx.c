@@ -0,0 +1,121 @@
+
+#include "k32_vista.h"
+
+#include <ndk/iofuncs.h>
+#include <ndk/ldrfuncs.h>
+
+#define NDEBUG
+#include <debug.h>
+
+typedef NTSTATUS (NTAPI *PNT_REMOVE_IO_COMPLETION_EX)(HANDLE, PFILE_IO_COMPLETION_INFORMATION, ULONG, PULONG, PLARGE_INTEGER, BOOLEAN);
+
+/* ntdll only exports the system call when it is built for Vista and higher */
+static
+PNT_REMOVE_IO_COMPLETION_EX
+GetNtRemoveIoCompletionEx(VOID)
+{
+    static PNT_REMOVE_IO_COMPLETION_EX pNtRemoveIoCompletionEx = NULL;
+    static BOOLEAN Resolved = FALSE;
+    ANSI_STRING ProcedureName = RTL_CONSTANT_STRING("NtRemoveIoCompletionEx");
+    PVOID Procedure;
+
+    if (!Resolved)
+    {
+        if (!NT_SUCCESS(LdrGetProcedureAddress(GetModuleHandleW(L"ntdll.dll"),
+                                               &ProcedureName,
+                                               0,
+                                               &Procedure)))
+        {
+            Procedure = NULL;
+        }
+        pNtRemoveIoCompletionEx = (PNT_REMOVE_IO_COMPLETION_EX)Procedure;
+        Resolved = TRUE;
+    }
+
+    return pNtRemoveIoCompletionEx;
+}
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+GetQueuedCompletionStatusEx(IN HANDLE CompletionPort,
+                            OUT LPOVERLAPPED_ENTRY lpCompletionPortEntries,
+                            IN ULONG ulCount,
+                            OUT PULONG ulNumEntriesRemoved,
+                            IN DWORD dwMilliseconds,
+                            IN BOOL fAlertable)
+{
+    PNT_REMOVE_IO_COMPLETION_EX pNtRemoveIoCompletionEx;
+    NTSTATUS Status;
+    LARGE_INTEGER Time;
+    PLARGE_INTEGER TimePtr;
+
+    /* The entries have the same layout as the native packets, so fill them in place */
+    C_ASSERT(sizeof(OVERLAPPED_ENTRY) == sizeof(FILE_IO_COMPLETION_INFORMATION));
+    C_ASSERT(FIELD_OFFSET(OVERLAPPED_ENTRY, lpOverlapped) ==
+             FIELD_OFFSET(FILE_IO_COMPLETION_INFORMATION, ApcContext));
+    C_ASSERT(FIELD_OFFSET(OVERLAPPED_ENTRY, Internal) ==
+             FIELD_OFFSET(FILE_IO_COMPLETION_INFORMATION, IoStatusBlock.Status));
+    C_ASSERT(FIELD_OFFSET(OVERLAPPED_ENTRY, dwNumberOfBytesTransferred) ==
+             FIELD_OFFSET(FILE_IO_COMPLETION_INFORMATION, IoStatusBlock.Information));
+
+    if (!ulCount)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    pNtRemoveIoCompletionEx = GetNtRemoveIoCompletionEx();
+    if (!pNtRemoveIoCompletionEx)
+    {
+        SetLastError(ERROR_CALL_NOT_IMPLEMENTED);
+        return FALSE;
+    }
+
+    /* Convert the timeout and then call the native API */
+    if (dwMilliseconds == INFINITE)
+    {
+        TimePtr = NULL;
+    }
+    else
+    {
+        Time.QuadPart = (ULONGLONG)dwMilliseconds * -10000;
+        TimePtr = &Time;
+    }
+
+    Status = pNtRemoveIoCompletionEx(CompletionPort,
+                                     (PFILE_IO_COMPLETION_INFORMATION)lpCompletionPortEntries,
+                                     ulCount,
+                                     ulNumEntriesRemoved,
+                                     TimePtr,
+                                     (BOOLEAN)fAlertable);
+    if (Status != STATUS_SUCCESS)
+    {
+        *ulNumEntriesRemoved = 0;
+
+        /* Check what kind of error we got */
+        if (Status == STATUS_TIMEOUT)
+        {
+            /* Timeout error is set directly since there's no conversion */
+            SetLastError(WAIT_TIMEOUT);
+        }
+        else if ((Status == STATUS_USER_APC) || (Status == STATUS_ALERTED))
+        {
+            /* Woken up for an APC, like the other alertable waits */
+            SetLastError(WAIT_IO_COMPLETION);
+        }
+        else
+        {
+            /* Any other error gets converted */
+            BaseSetLastNTError(Status);
+        }
+
+        /* This is a failure case */
+        return FALSE;
+    }
+
+    /* Unlike the single packet version, failed I/Os are left to the caller to check */
+    return TRUE;
+}
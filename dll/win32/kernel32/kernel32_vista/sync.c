@@ -1,5 +1,9 @@
 #include "k32_vista.h"
 
+#include <ndk/ldrfuncs.h>
+#include <csr/csr.h>
+#include <win/basemsg.h>
+
 #define NDEBUG
 #include <debug.h>
 
@@ -173,3 +177,251 @@ BOOL WINAPI InitializeCriticalSectionEx(OUT LPCRITICAL_SECTION lpCriticalSection
     return TRUE;
 }
 
+
+typedef NTSTATUS (NTAPI *PNT_SET_TIMER_EX)(HANDLE, TIMER_SET_INFORMATION_CLASS, PVOID, ULONG);
+
+/* ntdll only exports the system call when it is built for Windows 7 and higher */
+static
+NTSTATUS
+SetTimerEx(IN HANDLE TimerHandle,
+           IN TIMER_SET_INFORMATION_CLASS TimerSetInformationClass,
+           IN OUT PVOID TimerSetInformation,
+           IN ULONG TimerSetInformationLength)
+{
+    static PNT_SET_TIMER_EX pNtSetTimerEx = NULL;
+    static BOOLEAN Resolved = FALSE;
+    ANSI_STRING ProcedureName = RTL_CONSTANT_STRING("NtSetTimerEx");
+    PVOID Procedure;
+
+    if (!Resolved)
+    {
+        if (!NT_SUCCESS(LdrGetProcedureAddress(GetModuleHandleW(L"ntdll.dll"),
+                                               &ProcedureName,
+                                               0,
+                                               &Procedure)))
+        {
+            Procedure = NULL;
+        }
+        pNtSetTimerEx = (PNT_SET_TIMER_EX)Procedure;
+        Resolved = TRUE;
+    }
+
+    if (!pNtSetTimerEx) return STATUS_NOT_IMPLEMENTED;
+
+    return pNtSetTimerEx(TimerHandle,
+                         TimerSetInformationClass,
+                         TimerSetInformation,
+                         TimerSetInformationLength);
+}
+
+/* Opens the named object directory of the session, like kernel32 does for its objects */
+static
+HANDLE
+GetNamedObjectDirectory(VOID)
+{
+    static HANDLE NamedObjectDirectory = NULL;
+    PBASE_STATIC_SERVER_DATA StaticServerData;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    HANDLE Directory;
+    NTSTATUS Status;
+
+    if (NamedObjectDirectory) return NamedObjectDirectory;
+
+    StaticServerData = NtCurrentPeb()->ReadOnlyStaticServerData[BASESRV_SERVERDLL_INDEX];
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &StaticServerData->NamedObjectDirectory,
+                               OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+    Status = NtOpenDirectoryObject(&Directory,
+                                   DIRECTORY_TRAVERSE | DIRECTORY_CREATE_OBJECT,
+                                   &ObjectAttributes);
+    if (!NT_SUCCESS(Status)) return NULL;
+
+    /* Another thread may have opened it in the meantime */
+    if (InterlockedCompareExchangePointer(&NamedObjectDirectory, Directory, NULL))
+        NtClose(Directory);
+
+    return NamedObjectDirectory;
+}
+
+/*
+ * @implemented
+ */
+HANDLE
+WINAPI
+CreateWaitableTimerExW(IN LPSECURITY_ATTRIBUTES lpTimerAttributes OPTIONAL,
+                       IN LPCWSTR lpTimerName OPTIONAL,
+                       IN DWORD dwFlags,
+                       IN DWORD dwDesiredAccess)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    UNICODE_STRING TimerName;
+    PUNICODE_STRING ObjectName = NULL;
+    ULONG Attributes = 0;
+    HANDLE RootDirectory = NULL, Timer, Handle;
+    ACCESS_MASK DesiredAccess = dwDesiredAccess;
+    BOOLEAN HighResolution = TRUE;
+    NTSTATUS Status;
+    DWORD LastError;
+
+    if (dwFlags & ~(CREATE_WAITABLE_TIMER_MANUAL_RESET |
+                    CREATE_WAITABLE_TIMER_HIGH_RESOLUTION))
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    /* Named timers go into the session's named object directory */
+    if (lpTimerName)
+    {
+        RtlInitUnicodeString(&TimerName, lpTimerName);
+        ObjectName = &TimerName;
+        Attributes = OBJ_OPENIF;
+        RootDirectory = GetNamedObjectDirectory();
+    }
+
+    if (lpTimerAttributes && lpTimerAttributes->bInheritHandle)
+        Attributes |= OBJ_INHERIT;
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               ObjectName,
+                               Attributes,
+                               RootDirectory,
+                               lpTimerAttributes ? lpTimerAttributes->lpSecurityDescriptor : NULL);
+
+    /* Marking the timer as high resolution needs the right to modify it */
+    if (dwFlags & CREATE_WAITABLE_TIMER_HIGH_RESOLUTION)
+        DesiredAccess |= TIMER_MODIFY_STATE;
+
+    /* Create or open the timer */
+    Status = NtCreateTimer(&Timer,
+                           DesiredAccess,
+                           &ObjectAttributes,
+                           (dwFlags & CREATE_WAITABLE_TIMER_MANUAL_RESET) ?
+                           NotificationTimer : SynchronizationTimer);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return NULL;
+    }
+
+    /* Keep ERROR_ALREADY_EXISTS for a timer that was opened */
+    LastError = (Status == STATUS_OBJECT_NAME_EXISTS) ? ERROR_ALREADY_EXISTS : ERROR_SUCCESS;
+
+    /*
+     * Have the kernel run the clock at its fastest rate while the timer is set.
+     * A timer that already existed belongs to whoever created it, leave it be.
+     */
+    if ((dwFlags & CREATE_WAITABLE_TIMER_HIGH_RESOLUTION) &&
+        (Status != STATUS_OBJECT_NAME_EXISTS))
+    {
+        Status = SetTimerEx(Timer,
+                            TimerSetHighResolution,
+                            &HighResolution,
+                            sizeof(HighResolution));
+        if (!NT_SUCCESS(Status))
+        {
+            NtClose(Timer);
+            BaseSetLastNTError(Status);
+            return NULL;
+        }
+    }
+
+    /* Drop the right again if it was not asked for */
+    if (DesiredAccess != dwDesiredAccess)
+    {
+        Status = NtDuplicateObject(NtCurrentProcess(),
+                                   Timer,
+                                   NtCurrentProcess(),
+                                   &Handle,
+                                   dwDesiredAccess,
+                                   Attributes & OBJ_INHERIT,
+                                   DUPLICATE_CLOSE_SOURCE);
+        if (!NT_SUCCESS(Status))
+        {
+            BaseSetLastNTError(Status);
+            return NULL;
+        }
+        Timer = Handle;
+    }
+
+    SetLastError(LastError);
+    return Timer;
+}
+
+/*
+ * @implemented
+ */
+HANDLE
+WINAPI
+CreateWaitableTimerExA(IN LPSECURITY_ATTRIBUTES lpTimerAttributes OPTIONAL,
+                       IN LPCSTR lpTimerName OPTIONAL,
+                       IN DWORD dwFlags,
+                       IN DWORD dwDesiredAccess)
+{
+    UNICODE_STRING TimerName;
+    ANSI_STRING AnsiName;
+    NTSTATUS Status;
+    HANDLE Timer;
+
+    if (!lpTimerName)
+    {
+        return CreateWaitableTimerExW(lpTimerAttributes, NULL, dwFlags, dwDesiredAccess);
+    }
+
+    RtlInitAnsiString(&AnsiName, lpTimerName);
+    Status = RtlAnsiStringToUnicodeString(&TimerName, &AnsiName, TRUE);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return NULL;
+    }
+
+    Timer = CreateWaitableTimerExW(lpTimerAttributes, TimerName.Buffer, dwFlags, dwDesiredAccess);
+    RtlFreeUnicodeString(&TimerName);
+    return Timer;
+}
+
+/* SetWaitableTimerEx is a Windows 7 function, and the kernel only checks for a wake context */
+typedef struct _REASON_CONTEXT *PREASON_CONTEXT;
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+SetWaitableTimerEx(IN HANDLE hTimer,
+                   IN const LARGE_INTEGER *lpDueTime,
+                   IN LONG lPeriod,
+                   IN PTIMERAPCROUTINE pfnCompletionRoutine OPTIONAL,
+                   IN LPVOID lpArgToCompletionRoutine OPTIONAL,
+                   IN PREASON_CONTEXT WakeContext OPTIONAL,
+                   IN ULONG TolerableDelay)
+{
+    TIMER_SET_COALESCABLE_TIMER_INFO TimerInfo;
+    NTSTATUS Status;
+
+    /*
+     * The kernel cannot wake the system and only checks whether there is
+     * a wake context, so the reason strings are not converted.
+     */
+    TimerInfo.DueTime = *lpDueTime;
+    TimerInfo.TimerApcRoutine = (PTIMER_APC_ROUTINE)pfnCompletionRoutine;
+    TimerInfo.TimerContext = lpArgToCompletionRoutine;
+    TimerInfo.WakeContext = (struct _COUNTED_REASON_CONTEXT *)WakeContext;
+    TimerInfo.Period = lPeriod;
+    TimerInfo.TolerableDelay = TolerableDelay;
+    TimerInfo.PreviousState = NULL;
+
+    /* Set the timer */
+    Status = SetTimerEx(hTimer,
+                        TimerSetCoalescableTimer,
+                        &TimerInfo,
+                        sizeof(TimerInfo));
+    if (NT_SUCCESS(Status)) return TRUE;
+
+    /* If we got here, then we failed */
+    BaseSetLastNTError(Status);
+    return FALSE;
+}
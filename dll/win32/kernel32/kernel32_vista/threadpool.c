@@ -0,0 +1,512 @@
+/*
+ * PROJECT:         ReactOS Win32 Base API
+ * LICENSE:         See COPYING in the top level directory
+ * FILE:            dll/win32/kernel32/kernel32_vista/threadpool.c
+ * PURPOSE:         Vista thread pool API, on top of the ntdll Tp* functions
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include "k32_vista.h"
+
+#define NDEBUG
+#include <debug.h>
+
+/* PRIVATE FUNCTIONS **********************************************************/
+
+static
+VOID
+NTAPI
+BasepTpIoCallback(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                  IN OUT PVOID Context,
+                  IN PVOID ApcContext,
+                  IN PIO_STATUS_BLOCK IoStatusBlock,
+                  IN OUT PTP_IO Io)
+{
+    /* ntdll leaves the first pointer of the I/O object to us */
+    PTP_WIN32_IO_CALLBACK Callback = *(PTP_WIN32_IO_CALLBACK*)Io;
+
+    Callback(Instance,
+             Context,
+             ApcContext,
+             RtlNtStatusToDosError(IoStatusBlock->Status),
+             IoStatusBlock->Information,
+             Io);
+}
+
+/* PUBLIC FUNCTIONS ***********************************************************/
+
+/*
+ * @implemented
+ */
+PTP_POOL
+WINAPI
+CreateThreadpool(IN PVOID Reserved)
+{
+    PTP_POOL Pool;
+    NTSTATUS Status;
+
+    Status = TpAllocPool(&Pool, Reserved);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return NULL;
+    }
+
+    return Pool;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+SetThreadpoolThreadMaximum(IN OUT PTP_POOL Pool,
+                           IN DWORD MaxThreads)
+{
+    TpSetPoolMaxThreads(Pool, MaxThreads);
+}
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+SetThreadpoolThreadMinimum(IN OUT PTP_POOL Pool,
+                           IN DWORD MinThreads)
+{
+    NTSTATUS Status;
+
+    Status = TpSetPoolMinThreads(Pool, MinThreads);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpool(IN OUT PTP_POOL Pool)
+{
+    TpReleasePool(Pool);
+}
+
+/*
+ * @implemented
+ */
+PTP_CLEANUP_GROUP
+WINAPI
+CreateThreadpoolCleanupGroup(VOID)
+{
+    PTP_CLEANUP_GROUP CleanupGroup;
+    NTSTATUS Status;
+
+    Status = TpAllocCleanupGroup(&CleanupGroup);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return NULL;
+    }
+
+    return CleanupGroup;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolCleanupGroupMembers(IN OUT PTP_CLEANUP_GROUP CleanupGroup,
+                                   IN BOOL CancelPendingCallbacks,
+                                   IN OUT PVOID CleanupContext OPTIONAL)
+{
+    TpReleaseCleanupGroupMembers(CleanupGroup, CancelPendingCallbacks, CleanupContext);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolCleanupGroup(IN OUT PTP_CLEANUP_GROUP CleanupGroup)
+{
+    TpReleaseCleanupGroup(CleanupGroup);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+SetEventWhenCallbackReturns(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                            IN HANDLE Event)
+{
+    TpCallbackSetEventOnCompletion(Instance, Event);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+ReleaseSemaphoreWhenCallbackReturns(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                    IN HANDLE Semaphore,
+                                    IN DWORD ReleaseCount)
+{
+    TpCallbackReleaseSemaphoreOnCompletion(Instance, Semaphore, ReleaseCount);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+ReleaseMutexWhenCallbackReturns(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                IN HANDLE Mutex)
+{
+    TpCallbackReleaseMutexOnCompletion(Instance, Mutex);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+LeaveCriticalSectionWhenCallbackReturns(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                        IN OUT PCRITICAL_SECTION CriticalSection)
+{
+    TpCallbackLeaveCriticalSectionOnCompletion(Instance, (PRTL_CRITICAL_SECTION)CriticalSection);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+FreeLibraryWhenCallbackReturns(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                               IN HMODULE Module)
+{
+    TpCallbackUnloadDllOnCompletion(Instance, Module);
+}
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+CallbackMayRunLong(IN OUT PTP_CALLBACK_INSTANCE Instance)
+{
+    NTSTATUS Status;
+
+    Status = TpCallbackMayRunLong(Instance);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+DisassociateCurrentThreadFromCallback(IN OUT PTP_CALLBACK_INSTANCE Instance)
+{
+    TpDisassociateCallback(Instance);
+}
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+TrySubmitThreadpoolCallback(IN PTP_SIMPLE_CALLBACK Callback,
+                            IN OUT PVOID Context OPTIONAL,
+                            IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    NTSTATUS Status;
+
+    Status = TpSimpleTryPost(Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * @implemented
+ */
+PTP_WORK
+WINAPI
+CreateThreadpoolWork(IN PTP_WORK_CALLBACK Callback,
+                     IN OUT PVOID Context OPTIONAL,
+                     IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTP_WORK Work;
+    NTSTATUS Status;
+
+    Status = TpAllocWork(&Work, Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return NULL;
+    }
+
+    return Work;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+SubmitThreadpoolWork(IN OUT PTP_WORK Work)
+{
+    TpPostWork(Work);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+WaitForThreadpoolWorkCallbacks(IN OUT PTP_WORK Work,
+                               IN BOOL CancelPendingCallbacks)
+{
+    TpWaitForWork(Work, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolWork(IN OUT PTP_WORK Work)
+{
+    TpReleaseWork(Work);
+}
+
+/*
+ * @implemented
+ */
+PTP_TIMER
+WINAPI
+CreateThreadpoolTimer(IN PTP_TIMER_CALLBACK Callback,
+                      IN OUT PVOID Context OPTIONAL,
+                      IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTP_TIMER Timer;
+    NTSTATUS Status;
+
+    Status = TpAllocTimer(&Timer, Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return NULL;
+    }
+
+    return Timer;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+SetThreadpoolTimer(IN OUT PTP_TIMER Timer,
+                   IN PFILETIME DueTime OPTIONAL,
+                   IN DWORD Period,
+                   IN DWORD WindowLength OPTIONAL)
+{
+    LARGE_INTEGER Time;
+
+    /* Same convention as NT times, negative is relative */
+    if (DueTime)
+    {
+        Time.LowPart = DueTime->dwLowDateTime;
+        Time.HighPart = DueTime->dwHighDateTime;
+    }
+
+    TpSetTimer(Timer, DueTime ? &Time : NULL, Period, WindowLength);
+}
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+IsThreadpoolTimerSet(IN OUT PTP_TIMER Timer)
+{
+    return TpIsTimerSet(Timer);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+WaitForThreadpoolTimerCallbacks(IN OUT PTP_TIMER Timer,
+                                IN BOOL CancelPendingCallbacks)
+{
+    TpWaitForTimer(Timer, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolTimer(IN OUT PTP_TIMER Timer)
+{
+    TpReleaseTimer(Timer);
+}
+
+/*
+ * @implemented
+ */
+PTP_WAIT
+WINAPI
+CreateThreadpoolWait(IN PTP_WAIT_CALLBACK Callback,
+                     IN OUT PVOID Context OPTIONAL,
+                     IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTP_WAIT Wait;
+    NTSTATUS Status;
+
+    Status = TpAllocWait(&Wait, Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return NULL;
+    }
+
+    return Wait;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+SetThreadpoolWait(IN OUT PTP_WAIT Wait,
+                  IN HANDLE Handle OPTIONAL,
+                  IN PFILETIME Timeout OPTIONAL)
+{
+    LARGE_INTEGER Time;
+
+    if (Timeout)
+    {
+        Time.LowPart = Timeout->dwLowDateTime;
+        Time.HighPart = Timeout->dwHighDateTime;
+    }
+
+    TpSetWait(Wait, Handle, Timeout ? &Time : NULL);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+WaitForThreadpoolWaitCallbacks(IN OUT PTP_WAIT Wait,
+                               IN BOOL CancelPendingCallbacks)
+{
+    TpWaitForWait(Wait, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolWait(IN OUT PTP_WAIT Wait)
+{
+    TpReleaseWait(Wait);
+}
+
+/*
+ * @implemented
+ */
+PTP_IO
+WINAPI
+CreateThreadpoolIo(IN HANDLE File,
+                   IN PTP_WIN32_IO_CALLBACK Callback,
+                   IN OUT PVOID Context OPTIONAL,
+                   IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTP_IO Io;
+    NTSTATUS Status;
+
+    if (!Callback)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    Status = TpAllocIoCompletion(&Io, File, BasepTpIoCallback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return NULL;
+    }
+
+    /* No I/O was started yet, so nothing can complete before this is set */
+    *(PTP_WIN32_IO_CALLBACK*)Io = Callback;
+
+    return Io;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+StartThreadpoolIo(IN OUT PTP_IO Io)
+{
+    TpStartAsyncIoOperation(Io);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CancelThreadpoolIo(IN OUT PTP_IO Io)
+{
+    TpCancelAsyncIoOperation(Io);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+WaitForThreadpoolIoCallbacks(IN OUT PTP_IO Io,
+                             IN BOOL CancelPendingCallbacks)
+{
+    TpWaitForIoCompletion(Io, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolIo(IN OUT PTP_IO Io)
+{
+    TpReleaseIoCompletion(Io);
+}
+
+/* EOF */
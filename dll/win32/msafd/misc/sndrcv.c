@@ -253,7 +253,7 @@ WSPRecv(SOCKET Handle,
         if (lpCompletionRoutine == NULL)
         {
             /* Using Overlapped Structure, but no Completion Routine, so no need for APC */
-            APCContext = lpOverlapped;
+            APCContext = (((ULONG_PTR)lpOverlapped->hEvent & 0x1) ? NULL : lpOverlapped);
             APCFunction = NULL;
             Event = lpOverlapped->hEvent;
         }
@@ -474,7 +474,7 @@ WSPRecvFrom(SOCKET Handle,
         if (lpCompletionRoutine == NULL)
         {
             /* Using Overlapped Structure, but no Completion Routine, so no need for APC */
-            APCContext = lpOverlapped;
+            APCContext = (((ULONG_PTR)lpOverlapped->hEvent & 0x1) ? NULL : lpOverlapped);
             APCFunction = NULL;
             Event = lpOverlapped->hEvent;
         }
@@ -647,7 +647,7 @@ WSPSend(SOCKET Handle,
         if (lpCompletionRoutine == NULL)
         {
             /* Using Overlapped Structure, but no Completion Routine, so no need for APC */
-            APCContext = lpOverlapped;
+            APCContext = (((ULONG_PTR)lpOverlapped->hEvent & 0x1) ? NULL : lpOverlapped);
             APCFunction = NULL;
             Event = lpOverlapped->hEvent;
         }
@@ -846,7 +846,7 @@ WSPSendTo(SOCKET Handle,
         if (lpCompletionRoutine == NULL)
         {
             /* Using Overlapped Structure, but no Completion Routine, so no need for APC */
-            APCContext = lpOverlapped;
+            APCContext = (((ULONG_PTR)lpOverlapped->hEvent & 0x1) ? NULL : lpOverlapped);
             APCFunction = NULL;
             Event = lpOverlapped->hEvent;
         }
@@ -176,6 +176,16 @@ FindFile(
             ExFreePoolWithTag(PathNameBuffer, TAG_NAME);
             return Status;
         }
+
+        /* then in the name index of the directory */
+        Status = vfatNameIndexFind(DeviceExt, Parent, FileToFindU, DirContext);
+        if (Status != STATUS_NOT_SUPPORTED)
+        {
+            DPRINT("FindFile: indexed lookup of %wZ: %x, DirIndex %u\n",
+                   FileToFindU, Status, DirContext->DirIndex);
+            ExFreePoolWithTag(PathNameBuffer, TAG_NAME);
+            return Status;
+        }
     }
 
     /* FsRtlIsNameInExpression need the searched string to be upcase,
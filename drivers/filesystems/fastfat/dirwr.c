@@ -269,6 +269,7 @@ vfatFindDirSpace(
     PVOID Context = NULL;
     NTSTATUS Status;
     ULONG SizeDirEntry;
+    PVFAT_NAME_INDEX Index;
     BOOLEAN IsFatX = vfatVolumeIsFatX(DeviceExt);
     FileOffset.QuadPart = 0;
 
@@ -285,41 +286,68 @@ vfatFindDirSpace(
 
     count = pDirFcb->RFCB.FileSize.u.LowPart / SizeDirEntry;
     size = DeviceExt->FatInfo.BytesPerCluster / SizeDirEntry;
-    for (i = 0; i < count; i++, pFatEntry = (PDIR_ENTRY)((ULONG_PTR)pFatEntry + SizeDirEntry))
+    Index = vfatNameIndexGet(DeviceExt, pDirFcb);
+    if (Index != NULL)
     {
-        if (Context == NULL || (i % size) == 0)
+        /* Same outcome as the scan below, from the free slot map */
+        i = RtlFindClearBits(&Index->UsedSlots, nbSlots, 0);
+        if (i != MAXULONG && i + nbSlots <= Index->EndIndex)
         {
-            if (Context)
-            {
-                CcUnpinData(Context);
-            }
-            _SEH2_TRY
+            nbFree = nbSlots;
+            i += nbSlots - 1;
+        }
+        else
+        {
+            i = Index->EndIndex;
+            while (nbFree < nbSlots && nbFree < i &&
+                   !RtlCheckBit(&Index->UsedSlots, i - nbFree - 1))
             {
-                CcPinRead(pDirFcb->FileObject, &FileOffset, DeviceExt->FatInfo.BytesPerCluster, PIN_WAIT, &Context, (PVOID*)&pFatEntry);
+                nbFree++;
             }
-            _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+            if (nbFree == nbSlots)
             {
-                _SEH2_YIELD(return FALSE);
+                i--;
             }
-            _SEH2_END;
-
-            FileOffset.u.LowPart += DeviceExt->FatInfo.BytesPerCluster;
-        }
-        if (ENTRY_END(IsFatX, pFatEntry))
-        {
-            break;
-        }
-        if (ENTRY_DELETED(IsFatX, pFatEntry))
-        {
-            nbFree++;
         }
-        else
-        {
-            nbFree = 0;
-        }
-        if (nbFree == nbSlots)
+    }
+    else
+    {
+        for (i = 0; i < count; i++, pFatEntry = (PDIR_ENTRY)((ULONG_PTR)pFatEntry + SizeDirEntry))
         {
-            break;
+            if (Context == NULL || (i % size) == 0)
+            {
+                if (Context)
+                {
+                    CcUnpinData(Context);
+                }
+                _SEH2_TRY
+                {
+                    CcPinRead(pDirFcb->FileObject, &FileOffset, DeviceExt->FatInfo.BytesPerCluster, PIN_WAIT, &Context, (PVOID*)&pFatEntry);
+                }
+                _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+                {
+                    _SEH2_YIELD(return FALSE);
+                }
+                _SEH2_END;
+
+                FileOffset.u.LowPart += DeviceExt->FatInfo.BytesPerCluster;
+            }
+            if (ENTRY_END(IsFatX, pFatEntry))
+            {
+                break;
+            }
+            if (ENTRY_DELETED(IsFatX, pFatEntry))
+            {
+                nbFree++;
+            }
+            else
+            {
+                nbFree = 0;
+            }
+            if (nbFree == nbSlots)
+            {
+                break;
+            }
         }
     }
     if (Context)
@@ -763,6 +791,8 @@ FATAddEntry(
     CcSetDirtyPinnedData(Context, NULL);
     CcUnpinData(Context);
 
+    vfatNameIndexAddEntry(DeviceExt, ParentFcb, DirContext.StartIndex, DirContext.DirIndex);
+
     if (MoveContext != NULL)
     {
         /* We're modifying an existing FCB - likely rename/move */
@@ -977,6 +1007,7 @@ FATDelEntry(
 
     DPRINT("delEntry PathName \'%wZ\'\n", &pFcb->PathNameU);
     DPRINT("delete entry: %u to %u\n", pFcb->startIndex, pFcb->dirIndex);
+    vfatNameIndexRemoveEntry(DeviceExt, pFcb->parentFcb, pFcb->startIndex, pFcb->dirIndex);
     Offset.u.HighPart = 0;
     for (i = pFcb->startIndex; i <= pFcb->dirIndex; i++)
     {
@@ -1026,6 +1057,7 @@ FATDelEntry(
     /* In case of moving, don't delete data */
     if (MoveContext == NULL)
     {
+        FsRtlResetLargeMcb(&pFcb->Mcb, FALSE);
         while (CurrentCluster && CurrentCluster != 0xffffffff)
         {
             GetNextCluster(DeviceExt, CurrentCluster, &NextCluster);
@@ -1105,6 +1137,7 @@ FATXDelEntry(
     /* In case of moving, don't delete data */
     if (MoveContext == NULL)
     {
+        FsRtlResetLargeMcb(&pFcb->Mcb, FALSE);
         while (CurrentCluster && CurrentCluster != 0xffffffff)
         {
             GetNextCluster(DeviceExt, CurrentCluster, &NextCluster);
@@ -418,7 +418,11 @@ FAT12CountAvailableClusters(
         }
 
         if (Entry == 0)
+        {
             ulCount++;
+            if (DeviceExt->FreeClusterBitmap.Buffer != NULL)
+                RtlClearBit(&DeviceExt->FreeClusterBitmap, i);
+        }
     }
 
     CcUnpinData(Context);
@@ -469,7 +473,11 @@ FAT16CountAvailableClusters(
         while (Block < BlockEnd && i < FatLength)
         {
             if (*Block == 0)
+            {
                 ulCount++;
+                if (DeviceExt->FreeClusterBitmap.Buffer != NULL)
+                    RtlClearBit(&DeviceExt->FreeClusterBitmap, i);
+            }
             Block++;
             i++;
         }
@@ -525,7 +533,11 @@ FAT32CountAvailableClusters(
         while (Block < BlockEnd && i < FatLength)
         {
             if ((*Block & 0x0fffffff) == 0)
+            {
                 ulCount++;
+                if (DeviceExt->FreeClusterBitmap.Buffer != NULL)
+                    RtlClearBit(&DeviceExt->FreeClusterBitmap, i);
+            }
             Block++;
             i++;
         }
@@ -539,6 +551,33 @@ FAT32CountAvailableClusters(
     return STATUS_SUCCESS;
 }
 
+/*
+ * FUNCTION: Allocates the free cluster bitmap with every cluster marked as
+ *           used; counting the free clusters then clears their bits
+ */
+static
+VOID
+InitializeFreeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    ULONG NumberOfBits;
+    PULONG Buffer;
+
+    NumberOfBits = DeviceExt->FatInfo.NumberOfClusters + 2;
+    Buffer = ExAllocatePoolWithTag(PagedPool,
+                                   ROUND_UP(NumberOfBits, 32) / 8,
+                                   TAG_BITMAP);
+    if (Buffer == NULL)
+    {
+        /* Not fatal, allocations will scan the FAT instead */
+        DPRINT1("No free cluster bitmap for %u clusters\n", NumberOfBits);
+        return;
+    }
+
+    RtlInitializeBitMap(&DeviceExt->FreeClusterBitmap, Buffer, NumberOfBits);
+    RtlSetAllBits(&DeviceExt->FreeClusterBitmap);
+}
+
 NTSTATUS
 CountAvailableClusters(
     PDEVICE_EXTENSION DeviceExt,
@@ -548,12 +587,22 @@ CountAvailableClusters(
     ExAcquireResourceExclusiveLite (&DeviceExt->FatResource, TRUE);
     if (!DeviceExt->AvailableClustersValid)
     {
+        if (DeviceExt->FreeClusterBitmap.Buffer == NULL)
+            InitializeFreeClusterBitmap(DeviceExt);
+
         if (DeviceExt->FatInfo.FatType == FAT12)
             Status = FAT12CountAvailableClusters(DeviceExt);
         else if (DeviceExt->FatInfo.FatType == FAT16 || DeviceExt->FatInfo.FatType == FATX16)
             Status = FAT16CountAvailableClusters(DeviceExt);
         else
             Status = FAT32CountAvailableClusters(DeviceExt);
+
+        /* A partial scan leaves used bits on free clusters, don't trust it */
+        if (!NT_SUCCESS(Status) && DeviceExt->FreeClusterBitmap.Buffer != NULL)
+        {
+            ExFreePoolWithTag(DeviceExt->FreeClusterBitmap.Buffer, TAG_BITMAP);
+            DeviceExt->FreeClusterBitmap.Buffer = NULL;
+        }
     }
     if (Clusters != NULL)
     {
@@ -699,6 +748,168 @@ FAT32WriteCluster(
     return STATUS_SUCCESS;
 }
 
+/*
+ * FUNCTION: Chains a run of consecutive clusters in a FAT12 table, the last
+ *           one gets LastValue
+ */
+NTSTATUS
+FAT12WriteClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG StartCluster,
+    ULONG ClusterCount,
+    ULONG LastValue)
+{
+    ULONG FATOffset;
+    PUCHAR CBlock;
+    PVOID BaseAddress;
+    PVOID Context;
+    LARGE_INTEGER Offset;
+    ULONG i, EndCluster, NewValue;
+
+    Offset.QuadPart = 0;
+    _SEH2_TRY
+    {
+        CcPinRead(DeviceExt->FATFileObject, &Offset, DeviceExt->FatInfo.FATSectors * DeviceExt->FatInfo.BytesPerSector, PIN_WAIT, &Context, &BaseAddress);
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        _SEH2_YIELD(return _SEH2_GetExceptionCode());
+    }
+    _SEH2_END;
+    CBlock = (PUCHAR)BaseAddress;
+
+    DPRINT("Chaining 0x%x clusters from 0x%x\n", ClusterCount, StartCluster);
+    EndCluster = StartCluster + ClusterCount;
+    for (i = StartCluster; i < EndCluster; i++)
+    {
+        NewValue = (i + 1 < EndCluster) ? i + 1 : LastValue;
+        FATOffset = (i * 12) / 8;
+        if ((i % 2) == 0)
+        {
+            CBlock[FATOffset] = (UCHAR)NewValue;
+            CBlock[FATOffset + 1] &= 0xf0;
+            CBlock[FATOffset + 1] |= (NewValue & 0xf00) >> 8;
+        }
+        else
+        {
+            CBlock[FATOffset] &= 0x0f;
+            CBlock[FATOffset] |= (NewValue & 0xf) << 4;
+            CBlock[FATOffset + 1] = (UCHAR)(NewValue >> 4);
+        }
+    }
+    CcSetDirtyPinnedData(Context, NULL);
+    CcUnpinData(Context);
+    return STATUS_SUCCESS;
+}
+
+/*
+ * FUNCTION: Chains a run of consecutive clusters in a FAT16 table, pinning
+ *           each FAT page once
+ */
+NTSTATUS
+FAT16WriteClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG StartCluster,
+    ULONG ClusterCount,
+    ULONG LastValue)
+{
+    PVOID BaseAddress;
+    ULONG ChunkSize;
+    PVOID Context;
+    LARGE_INTEGER Offset;
+    PUSHORT Block;
+    PUSHORT BlockEnd;
+    ULONG i, EndCluster;
+
+    ChunkSize = CACHEPAGESIZE(DeviceExt);
+    EndCluster = StartCluster + ClusterCount;
+
+    DPRINT("Chaining 0x%x clusters from 0x%x\n", ClusterCount, StartCluster);
+    for (i = StartCluster; i < EndCluster;)
+    {
+        Offset.QuadPart = ROUND_DOWN(i * 2, ChunkSize);
+        _SEH2_TRY
+        {
+            CcPinRead(DeviceExt->FATFileObject, &Offset, ChunkSize, PIN_WAIT, &Context, &BaseAddress);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            DPRINT1("CcPinRead(Offset %x, Length %u) failed\n", (ULONG)Offset.QuadPart, ChunkSize);
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+        Block = (PUSHORT)((ULONG_PTR)BaseAddress + (i * 2) % ChunkSize);
+        BlockEnd = (PUSHORT)((ULONG_PTR)BaseAddress + ChunkSize);
+
+        /* Now process the whole block */
+        while (Block < BlockEnd && i < EndCluster)
+        {
+            i++;
+            *Block = (USHORT)((i < EndCluster) ? i : LastValue);
+            Block++;
+        }
+
+        CcSetDirtyPinnedData(Context, NULL);
+        CcUnpinData(Context);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * FUNCTION: Chains a run of consecutive clusters in a FAT32 table, pinning
+ *           each FAT page once
+ */
+NTSTATUS
+FAT32WriteClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG StartCluster,
+    ULONG ClusterCount,
+    ULONG LastValue)
+{
+    PVOID BaseAddress;
+    ULONG ChunkSize;
+    PVOID Context;
+    LARGE_INTEGER Offset;
+    PULONG Block;
+    PULONG BlockEnd;
+    ULONG i, EndCluster;
+
+    ChunkSize = CACHEPAGESIZE(DeviceExt);
+    EndCluster = StartCluster + ClusterCount;
+
+    DPRINT("Chaining 0x%x clusters from 0x%x\n", ClusterCount, StartCluster);
+    for (i = StartCluster; i < EndCluster;)
+    {
+        Offset.QuadPart = ROUND_DOWN(i * 4, ChunkSize);
+        _SEH2_TRY
+        {
+            CcPinRead(DeviceExt->FATFileObject, &Offset, ChunkSize, PIN_WAIT, &Context, &BaseAddress);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            DPRINT1("CcPinRead(Offset %x, Length %u) failed\n", (ULONG)Offset.QuadPart, ChunkSize);
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+        Block = (PULONG)((ULONG_PTR)BaseAddress + (i * 4) % ChunkSize);
+        BlockEnd = (PULONG)((ULONG_PTR)BaseAddress + ChunkSize);
+
+        /* Now process the whole block */
+        while (Block < BlockEnd && i < EndCluster)
+        {
+            i++;
+            *Block = (*Block & 0xf0000000) | (((i < EndCluster) ? i : LastValue) & 0x0fffffff);
+            Block++;
+        }
+
+        CcSetDirtyPinnedData(Context, NULL);
+        CcUnpinData(Context);
+    }
+
+    return STATUS_SUCCESS;
+}
+
 
 /*
  * FUNCTION: Write a changed FAT entry
@@ -721,6 +932,15 @@ WriteCluster(
         else if (OldValue == 0 && NewValue)
             InterlockedDecrement((PLONG)&DeviceExt->AvailableClusters);
     }
+    if (NT_SUCCESS(Status) &&
+        DeviceExt->FreeClusterBitmap.Buffer != NULL &&
+        ClusterToWrite < DeviceExt->FreeClusterBitmap.SizeOfBitMap)
+    {
+        if (NewValue == 0)
+            RtlClearBit(&DeviceExt->FreeClusterBitmap, ClusterToWrite);
+        else
+            RtlSetBit(&DeviceExt->FreeClusterBitmap, ClusterToWrite);
+    }
     ExReleaseResourceLite(&DeviceExt->FatResource);
     return Status;
 }
@@ -783,46 +1003,150 @@ GetNextClusterExtend(
     DPRINT("GetNextClusterExtend(DeviceExt %p, CurrentCluster %x)\n",
            DeviceExt, CurrentCluster);
 
-    ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
     /*
      * If the file hasn't any clusters allocated then we need special
      * handling
      */
     if (CurrentCluster == 0)
     {
-        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
-        if (!NT_SUCCESS(Status))
-        {
-            ExReleaseResourceLite(&DeviceExt->FatResource);
-            return Status;
-        }
-
-        *NextCluster = NewCluster;
-        ExReleaseResourceLite(&DeviceExt->FatResource);
-        return STATUS_SUCCESS;
+        return AllocateClusters(DeviceExt, 0, 1, NextCluster, &NewCluster);
     }
 
+    ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
     Status = DeviceExt->GetNextCluster(DeviceExt, CurrentCluster, NextCluster);
 
     if ((*NextCluster) == 0xFFFFFFFF)
     {
         /* We are after last existing cluster, we must add one to file */
-        /* Firstly, find the next available open allocation unit and
-           mark it as end of file */
-        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
-        if (!NT_SUCCESS(Status))
+        Status = AllocateClusters(DeviceExt, CurrentCluster, 1, NextCluster, &NewCluster);
+    }
+
+    ExReleaseResourceLite(&DeviceExt->FatResource);
+    return Status;
+}
+
+/*
+ * FUNCTION: Allocates ClusterCount clusters and appends them to the chain
+ *           ending at LastCluster, or makes a new chain if it is 0.
+ *           Each step takes a free run that holds all that is left or,
+ *           failing that, the largest one there is, and chains it in one
+ *           pass over its FAT pages. Nothing is allocated on failure.
+ */
+NTSTATUS
+AllocateClusters(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG LastCluster,
+    ULONG ClusterCount,
+    PULONG FirstNewCluster,
+    PULONG LastNewCluster)
+{
+    PRTL_BITMAP Bitmap = &DeviceExt->FreeClusterBitmap;
+    ULONG RunStart, RunLength, Allocated, OldValue;
+    ULONG FirstCluster = 0, PreviousCluster, Cluster, NextCluster;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    DPRINT("AllocateClusters(DeviceExt %p, LastCluster %x, ClusterCount %u)\n",
+           DeviceExt, LastCluster, ClusterCount);
+
+    ASSERT(ClusterCount != 0);
+
+    ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
+
+    if (DeviceExt->AvailableClustersValid && DeviceExt->AvailableClusters < ClusterCount)
+    {
+        ExReleaseResourceLite(&DeviceExt->FatResource);
+        return STATUS_DISK_FULL;
+    }
+
+    PreviousCluster = LastCluster;
+    for (Allocated = 0; Allocated < ClusterCount; Allocated += RunLength)
+    {
+        RunLength = ClusterCount - Allocated;
+        if (Bitmap->Buffer != NULL)
+        {
+            /*
+             * Search from the end of the chain on, so that the file stays
+             * contiguous when the clusters right after it are free. The
+             * search wraps around, so the run may be anywhere else too.
+             */
+            RunStart = RtlFindClearBits(Bitmap, RunLength,
+                                        PreviousCluster ? PreviousCluster + 1 : DeviceExt->LastAvailableCluster);
+            if (RunStart == 0xFFFFFFFF)
+            {
+                RunLength = min(RtlFindLongestRunClear(Bitmap, &RunStart), RunLength);
+                if (RunLength == 0)
+                {
+                    Status = STATUS_DISK_FULL;
+                    break;
+                }
+            }
+
+            Status = DeviceExt->WriteClusterRun(DeviceExt, RunStart, RunLength, 0xffffffff);
+            if (!NT_SUCCESS(Status))
+            {
+                /* Part of the run may be written already, clear it again. It
+                   was never marked in the bitmap nor counted */
+                for (Cluster = RunStart; Cluster < RunStart + RunLength; Cluster++)
+                    DeviceExt->WriteCluster(DeviceExt, Cluster, 0, &OldValue);
+                break;
+            }
+
+            RtlSetBits(Bitmap, RunStart, RunLength);
+            DeviceExt->LastAvailableCluster = RunStart + RunLength - 1;
+            if (DeviceExt->AvailableClustersValid)
+                InterlockedExchangeAdd((PLONG)&DeviceExt->AvailableClusters, -(LONG)RunLength);
+        }
+        else
+        {
+            /* No bitmap, scan the FAT for a single cluster */
+            RunLength = 1;
+            Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &RunStart);
+            if (!NT_SUCCESS(Status))
+                break;
+        }
+
+        DPRINT("Allocated 0x%x clusters from 0x%x\n", RunLength, RunStart);
+
+        /* Now, write the AU of the previous cluster with the start of the run */
+        if (PreviousCluster != 0)
         {
-            ExReleaseResourceLite(&DeviceExt->FatResource);
-            return Status;
+            Status = WriteCluster(DeviceExt, PreviousCluster, RunStart);
+            if (!NT_SUCCESS(Status))
+            {
+                /* The run isn't part of the chain, so free it on its own */
+                for (Cluster = RunStart; Cluster < RunStart + RunLength; Cluster++)
+                    WriteCluster(DeviceExt, Cluster, 0);
+                break;
+            }
         }
+        if (FirstCluster == 0)
+            FirstCluster = RunStart;
+        PreviousCluster = RunStart + RunLength - 1;
+    }
+
+    if (!NT_SUCCESS(Status) && FirstCluster != 0)
+    {
+        /* Give back what was taken so far and end the chain where it was */
+        if (LastCluster != 0)
+            WriteCluster(DeviceExt, LastCluster, 0xffffffff);
 
-        /* Now, write the AU of the LastCluster with the value of the newly
-           found AU */
-        WriteCluster(DeviceExt, CurrentCluster, NewCluster);
-        *NextCluster = NewCluster;
+        Cluster = FirstCluster;
+        while (Cluster != 0xffffffff && Cluster > 1)
+        {
+            if (!NT_SUCCESS(DeviceExt->GetNextCluster(DeviceExt, Cluster, &NextCluster)))
+                NextCluster = 0xffffffff;
+            WriteCluster(DeviceExt, Cluster, 0);
+            Cluster = NextCluster;
+        }
     }
 
     ExReleaseResourceLite(&DeviceExt->FatResource);
+
+    if (NT_SUCCESS(Status))
+    {
+        *FirstNewCluster = FirstCluster;
+        *LastNewCluster = PreviousCluster;
+    }
     return Status;
 }
 
@@ -151,7 +151,7 @@ vfatNewFCB(
     ExInitializeResourceLite(&rcFCB->PagingIoResource);
     ExInitializeResourceLite(&rcFCB->MainResource);
     FsRtlInitializeFileLock(&rcFCB->FileLock, NULL, NULL);
-    ExInitializeFastMutex(&rcFCB->LastMutex);
+    FsRtlInitializeLargeMcb(&rcFCB->Mcb, NonPagedPool);
     rcFCB->RFCB.PagingIoResource = &rcFCB->PagingIoResource;
     rcFCB->RFCB.Resource = &rcFCB->MainResource;
     rcFCB->RFCB.IsFastIoPossible = FastIoIsNotPossible;
@@ -277,6 +277,8 @@ vfatDestroyFCB(
 #endif
 
     FsRtlUninitializeFileLock(&pFCB->FileLock);
+    FsRtlUninitializeLargeMcb(&pFCB->Mcb);
+    vfatNameIndexFree(pFCB);
 
     if (!vfatFCBIsRoot(pFCB) &&
         !BooleanFlagOn(pFCB->Flags, FCB_IS_FAT) && !BooleanFlagOn(pFCB->Flags, FCB_IS_VOLUME))
@@ -435,6 +437,8 @@ vfatInitFCBFromDirEntry(
 
     RtlCopyMemory(&Fcb->entry, &DirContext->DirEntry, sizeof (DIR_ENTRY));
     RtlCopyUnicodeString(&Fcb->ShortNameU, &DirContext->ShortNameU);
+    /* The entry may now describe another chain */
+    FsRtlResetLargeMcb(&Fcb->Mcb, FALSE);
     Fcb->Hash.Hash = vfatNameHash(0, &Fcb->PathNameU);
     if (vfatVolumeIsFatX(Vcb))
     {
@@ -824,6 +828,17 @@ vfatDirFindFile(
     DirContext.ShortNameU.MaximumLength = sizeof(ShortNameBuffer);
     DirContext.DeviceExt = pDeviceExt;
 
+    status = vfatNameIndexFind(pDeviceExt, pDirectoryFCB, FileToFindU, &DirContext);
+    if (status == STATUS_SUCCESS)
+    {
+        return vfatMakeFCBFromDirEntry(pDeviceExt, pDirectoryFCB, &DirContext, pFoundFCB);
+    }
+    else if (status == STATUS_NO_MORE_ENTRIES)
+    {
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+    }
+
+    /* No index, walk the directory */
     while (TRUE)
     {
         status = VfatGetNextDirEntry(pDeviceExt,
@@ -1222,7 +1222,7 @@ VfatSetAllocationSizeInformation(
 
     ULONG ClusterSize = DeviceExt->FatInfo.BytesPerCluster;
     ULONG NewSize = AllocationSize->u.LowPart;
-    ULONG NCluster;
+    ULONG NCluster, ClusterCount, FirstNewCluster;
     BOOLEAN AllocSizeChanged = FALSE, IsFatX = vfatVolumeIsFatX(DeviceExt);
 
     DPRINT("VfatSetAllocationSizeInformation(File <%wZ>, AllocationSize %d %u)\n",
@@ -1248,37 +1248,18 @@ VfatSetAllocationSizeInformation(
     if (NewSize > Fcb->RFCB.AllocationSize.u.LowPart)
     {
         AllocSizeChanged = TRUE;
+        ClusterCount = ROUND_DOWN(NewSize - 1, ClusterSize) / ClusterSize + 1 -
+                       Fcb->RFCB.AllocationSize.u.LowPart / ClusterSize;
         if (FirstCluster == 0)
         {
-            Fcb->LastCluster = Fcb->LastOffset = 0;
-            Status = NextCluster(DeviceExt, FirstCluster, &FirstCluster, TRUE);
+            FsRtlResetLargeMcb(&Fcb->Mcb, FALSE);
+            Status = AllocateClusters(DeviceExt, 0, ClusterCount, &FirstCluster, &NCluster);
             if (!NT_SUCCESS(Status))
             {
-                DPRINT1("NextCluster failed. Status = %x\n", Status);
+                DPRINT1("AllocateClusters failed. Status = %x\n", Status);
                 return Status;
             }
-
-            if (FirstCluster == 0xffffffff)
-            {
-                return STATUS_DISK_FULL;
-            }
-
-            Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                     ROUND_DOWN(NewSize - 1, ClusterSize),
-                                     &NCluster, TRUE);
-            if (NCluster == 0xffffffff || !NT_SUCCESS(Status))
-            {
-                /* disk is full */
-                NCluster = Cluster = FirstCluster;
-                Status = STATUS_SUCCESS;
-                while (NT_SUCCESS(Status) && Cluster != 0xffffffff && Cluster > 1)
-                {
-                    Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
-                    WriteCluster(DeviceExt, Cluster, 0);
-                    Cluster = NCluster;
-                }
-                return STATUS_DISK_FULL;
-            }
+            FirstNewCluster = FirstCluster;
 
             if (IsFatX)
             {
@@ -1300,56 +1281,30 @@ VfatSetAllocationSizeInformation(
         }
         else
         {
-            if (Fcb->LastCluster > 0)
-            {
-                if (Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize == Fcb->LastOffset)
-                {
-                    Cluster = Fcb->LastCluster;
-                    Status = STATUS_SUCCESS;
-                }
-                else
-                {
-                    Status = OffsetToCluster(DeviceExt, Fcb->LastCluster,
-                                             Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize - Fcb->LastOffset,
-                                             &Cluster, FALSE);
-                }
-            }
-            else
-            {
-                Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                         Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize,
-                                         &Cluster, FALSE);
-            }
-
+            Status = OffsetToClusterRun(DeviceExt, Fcb,
+                                        Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize, 1,
+                                        &Cluster, &NCluster);
             if (!NT_SUCCESS(Status))
             {
                 return Status;
             }
 
-            Fcb->LastCluster = Cluster;
-            Fcb->LastOffset = Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize;
-
-            /* FIXME: Check status */
             /* Cluster points now to the last cluster within the chain */
-            Status = OffsetToCluster(DeviceExt, Cluster,
-                                     ROUND_DOWN(NewSize - 1, ClusterSize) - Fcb->LastOffset,
-                                     &NCluster, TRUE);
-            if (NCluster == 0xffffffff || !NT_SUCCESS(Status))
+            Status = AllocateClusters(DeviceExt, Cluster, ClusterCount, &FirstNewCluster, &NCluster);
+            if (!NT_SUCCESS(Status))
             {
-                /* disk is full */
-                NCluster = Cluster;
-                Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
-                WriteCluster(DeviceExt, Cluster, 0xffffffff);
-                Cluster = NCluster;
-                while (NT_SUCCESS(Status) && Cluster != 0xffffffff && Cluster > 1)
-                {
-                    Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
-                    WriteCluster(DeviceExt, Cluster, 0);
-                    Cluster = NCluster;
-                }
-                return STATUS_DISK_FULL;
+                return Status;
             }
         }
+
+        /* The map is a prefix of the chain, so it may only take the new clusters as one run */
+        if (NCluster - FirstNewCluster + 1 == ClusterCount)
+        {
+            FsRtlAddLargeMcbEntry(&Fcb->Mcb,
+                                  Fcb->RFCB.AllocationSize.u.LowPart / ClusterSize,
+                                  FirstNewCluster, ClusterCount);
+        }
+
         UpdateFileSize(FileObject, Fcb, NewSize, ClusterSize, vfatVolumeIsFatX(DeviceExt));
     }
     else if (NewSize + ClusterSize <= Fcb->RFCB.AllocationSize.u.LowPart)
@@ -1364,14 +1319,13 @@ VfatSetAllocationSizeInformation(
         DPRINT("Can set file size\n");
 
         AllocSizeChanged = TRUE;
-        /* FIXME: Use the cached cluster/offset better way. */
-        Fcb->LastCluster = Fcb->LastOffset = 0;
         UpdateFileSize(FileObject, Fcb, NewSize, ClusterSize, vfatVolumeIsFatX(DeviceExt));
         if (NewSize > 0)
         {
-            Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                     ROUND_DOWN(NewSize - 1, ClusterSize),
-                                     &Cluster, FALSE);
+            Status = OffsetToClusterRun(DeviceExt, Fcb,
+                                        ROUND_DOWN(NewSize - 1, ClusterSize), 1,
+                                        &Cluster, &NCluster);
+            FsRtlTruncateLargeMcb(&Fcb->Mcb, ROUND_DOWN(NewSize - 1, ClusterSize) / ClusterSize + 1);
 
             NCluster = Cluster;
             Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
@@ -1397,6 +1351,7 @@ VfatSetAllocationSizeInformation(
                 }
             }
 
+            FsRtlResetLargeMcb(&Fcb->Mcb, FALSE);
             NCluster = Cluster = FirstCluster;
             Status = STATUS_SUCCESS;
         }
@@ -628,6 +628,7 @@ VfatMount(
             DeviceExt->GetNextCluster = FAT12GetNextCluster;
             DeviceExt->FindAndMarkAvailableCluster = FAT12FindAndMarkAvailableCluster;
             DeviceExt->WriteCluster = FAT12WriteCluster;
+            DeviceExt->WriteClusterRun = FAT12WriteClusterRun;
             /* We don't define dirty bit functions here
              * FAT12 doesn't have such bit and they won't get called
              */
@@ -638,6 +639,7 @@ VfatMount(
             DeviceExt->GetNextCluster = FAT16GetNextCluster;
             DeviceExt->FindAndMarkAvailableCluster = FAT16FindAndMarkAvailableCluster;
             DeviceExt->WriteCluster = FAT16WriteCluster;
+            DeviceExt->WriteClusterRun = FAT16WriteClusterRun;
             DeviceExt->GetDirtyStatus = FAT16GetDirtyStatus;
             DeviceExt->SetDirtyStatus = FAT16SetDirtyStatus;
             break;
@@ -647,6 +649,7 @@ VfatMount(
             DeviceExt->GetNextCluster = FAT32GetNextCluster;
             DeviceExt->FindAndMarkAvailableCluster = FAT32FindAndMarkAvailableCluster;
             DeviceExt->WriteCluster = FAT32WriteCluster;
+            DeviceExt->WriteClusterRun = FAT32WriteClusterRun;
             DeviceExt->GetDirtyStatus = FAT32GetDirtyStatus;
             DeviceExt->SetDirtyStatus = FAT32SetDirtyStatus;
             break;
@@ -737,9 +740,10 @@ VfatMount(
     }
     _SEH2_END;
 
+    /* Counting the free clusters takes the FAT lock, and builds the bitmap */
+    ExInitializeResourceLite(&DeviceExt->FatResource);
     DeviceExt->LastAvailableCluster = 2;
     CountAvailableClusters(DeviceExt, NULL);
-    ExInitializeResourceLite(&DeviceExt->FatResource);
 
     InitializeListHead(&DeviceExt->FcbListHead);
 
@@ -830,6 +834,8 @@ ByeBye:
             ExFreePoolWithTag(DeviceExt->SpareVPB, TAG_VPB);
         if (DeviceExt && DeviceExt->Statistics)
             ExFreePoolWithTag(DeviceExt->Statistics, TAG_STATS);
+        if (DeviceExt && DeviceExt->FreeClusterBitmap.Buffer)
+            ExFreePoolWithTag(DeviceExt->FreeClusterBitmap.Buffer, TAG_BITMAP);
         if (DeviceObject)
             IoDeleteDevice(DeviceObject);
     }
@@ -661,6 +661,8 @@ VfatCheckForDismount(
 
         /* Release resources */
         ExFreePoolWithTag(DeviceExt->Statistics, TAG_STATS);
+        if (DeviceExt->FreeClusterBitmap.Buffer != NULL)
+            ExFreePoolWithTag(DeviceExt->FreeClusterBitmap.Buffer, TAG_BITMAP);
         ExDeleteResourceLite(&DeviceExt->DirResource);
         ExDeleteResourceLite(&DeviceExt->FatResource);
 
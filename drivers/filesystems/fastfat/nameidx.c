@@ -0,0 +1,545 @@
+/*
+ * PROJECT:     ReactOS FAT file system driver
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     In-memory name index of large FAT directories
+ */
+
+/* A directory gets its index on the first lookup which needs it. The index
+   hashes the upcased long and 8.3 names of every entry to the directory
+   index of its short name entry, and keeps one bit per directory entry
+   telling whether it is free, so that looking a name up and finding room
+   for a new entry no longer walk the whole directory.
+
+   The index may hold names which are gone from the directory: every hit is
+   checked against the entry on disk. It must never miss a name which is in
+   the directory though, so if it cannot be kept up to date it is dropped
+   and built again on the next lookup. FATX directories are not indexed. */
+
+/* INCLUDES *****************************************************************/
+
+#include "vfat.h"
+
+#define NDEBUG
+#include <debug.h>
+
+#define NAME_INDEX_INITIAL_BUCKETS  64
+
+/* FUNCTIONS ****************************************************************/
+
+static
+ULONG
+vfatNameIndexHash(
+    PUNICODE_STRING NameU)
+{
+    ULONG Hash = 0;
+    USHORT i;
+
+    for (i = 0; i < NameU->Length / sizeof(WCHAR); i++)
+    {
+        Hash = Hash * 37 + RtlUpcaseUnicodeChar(NameU->Buffer[i]);
+    }
+
+    return Hash ^ (Hash >> 16);
+}
+
+static
+BOOLEAN
+vfatNameIndexResizeSlots(
+    PVFAT_NAME_INDEX Index,
+    ULONG SlotCount)
+{
+    PULONG Buffer;
+    ULONG OldCount = Index->UsedSlots.SizeOfBitMap;
+
+    if (SlotCount <= OldCount)
+    {
+        return TRUE;
+    }
+
+    Buffer = ExAllocatePoolWithTag(PagedPool, ROUND_UP(SlotCount, 32) / 8, TAG_INDEX);
+    if (Buffer == NULL)
+    {
+        return FALSE;
+    }
+
+    if (Index->UsedSlots.Buffer != NULL)
+    {
+        RtlCopyMemory(Buffer, Index->UsedSlots.Buffer, ROUND_UP(OldCount, 32) / 8);
+        ExFreePoolWithTag(Index->UsedSlots.Buffer, TAG_INDEX);
+    }
+
+    RtlInitializeBitMap(&Index->UsedSlots, Buffer, SlotCount);
+    RtlClearBits(&Index->UsedSlots, OldCount, SlotCount - OldCount);
+    return TRUE;
+}
+
+static
+VOID
+vfatNameIndexGrowBuckets(
+    PVFAT_NAME_INDEX Index)
+{
+    PVFAT_NAME_INDEX_ENTRY *Buckets, Entry, Next;
+    ULONG BucketCount = Index->BucketCount * 2, i;
+
+    /* Not growing only makes the chains longer */
+    Buckets = ExAllocatePoolWithTag(PagedPool, BucketCount * sizeof(PVFAT_NAME_INDEX_ENTRY), TAG_INDEX);
+    if (Buckets == NULL)
+    {
+        return;
+    }
+    RtlZeroMemory(Buckets, BucketCount * sizeof(PVFAT_NAME_INDEX_ENTRY));
+
+    for (i = 0; i < Index->BucketCount; i++)
+    {
+        for (Entry = Index->Buckets[i]; Entry != NULL; Entry = Next)
+        {
+            Next = Entry->Next;
+            Entry->Next = Buckets[Entry->Hash & (BucketCount - 1)];
+            Buckets[Entry->Hash & (BucketCount - 1)] = Entry;
+        }
+    }
+
+    ExFreePoolWithTag(Index->Buckets, TAG_INDEX);
+    Index->Buckets = Buckets;
+    Index->BucketCount = BucketCount;
+}
+
+static
+BOOLEAN
+vfatNameIndexInsert(
+    PVFAT_NAME_INDEX Index,
+    PVFAT_DIRENTRY_CONTEXT DirContext)
+{
+    PVFAT_NAME_INDEX_ENTRY Entry;
+    ULONG Hash[2], i;
+
+    Hash[0] = vfatNameIndexHash(&DirContext->LongNameU);
+    Hash[1] = vfatNameIndexHash(&DirContext->ShortNameU);
+
+    for (i = 0; i < 2; i++)
+    {
+        /* A lookup checks both names of the entry, so one hash is enough */
+        if (i == 1 && Hash[1] == Hash[0])
+        {
+            break;
+        }
+
+        Entry = ExAllocateFromPagedLookasideList(&VfatGlobalData->NameIndexLookasideList);
+        if (Entry == NULL)
+        {
+            return FALSE;
+        }
+
+        Entry->Hash = Hash[i];
+        Entry->DirIndex = DirContext->DirIndex;
+        Entry->Next = Index->Buckets[Hash[i] & (Index->BucketCount - 1)];
+        Index->Buckets[Hash[i] & (Index->BucketCount - 1)] = Entry;
+        Index->EntryCount++;
+    }
+
+    if (Index->EntryCount > Index->BucketCount * 2)
+    {
+        vfatNameIndexGrowBuckets(Index);
+    }
+
+    return TRUE;
+}
+
+static
+VOID
+vfatNameIndexRemove(
+    PVFAT_NAME_INDEX Index,
+    PUNICODE_STRING NameU,
+    ULONG DirIndex)
+{
+    PVFAT_NAME_INDEX_ENTRY *Link, Entry;
+    ULONG Hash = vfatNameIndexHash(NameU);
+
+    Link = &Index->Buckets[Hash & (Index->BucketCount - 1)];
+    while ((Entry = *Link) != NULL)
+    {
+        if (Entry->Hash == Hash && Entry->DirIndex == DirIndex)
+        {
+            *Link = Entry->Next;
+            ExFreeToPagedLookasideList(&VfatGlobalData->NameIndexLookasideList, Entry);
+            Index->EntryCount--;
+        }
+        else
+        {
+            Link = &Entry->Next;
+        }
+    }
+}
+
+static
+VOID
+vfatNameIndexDelete(
+    PVFAT_NAME_INDEX Index)
+{
+    PVFAT_NAME_INDEX_ENTRY Entry;
+    ULONG i;
+
+    for (i = 0; i < Index->BucketCount; i++)
+    {
+        while ((Entry = Index->Buckets[i]) != NULL)
+        {
+            Index->Buckets[i] = Entry->Next;
+            ExFreeToPagedLookasideList(&VfatGlobalData->NameIndexLookasideList, Entry);
+        }
+    }
+
+    ExFreePoolWithTag(Index->Buckets, TAG_INDEX);
+    if (Index->UsedSlots.Buffer != NULL)
+    {
+        ExFreePoolWithTag(Index->UsedSlots.Buffer, TAG_INDEX);
+    }
+    ExFreePoolWithTag(Index, TAG_INDEX);
+}
+
+/*
+ * Read the entry whose short name is at DirIndex. Returns FALSE if there is
+ * no such entry anymore.
+ */
+static
+BOOLEAN
+vfatNameIndexReadEntry(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB DirFcb,
+    ULONG DirIndex,
+    PVFAT_DIRENTRY_CONTEXT DirContext)
+{
+    PVOID Context = NULL;
+    PVOID Page;
+    NTSTATUS Status;
+
+    DirContext->DirIndex = DirIndex;
+    Status = VfatGetNextDirEntry(DeviceExt, &Context, &Page, DirFcb, DirContext, TRUE);
+    if (Context != NULL)
+    {
+        CcUnpinData(Context);
+    }
+
+    return NT_SUCCESS(Status) && DirContext->DirIndex == DirIndex;
+}
+
+static
+NTSTATUS
+vfatNameIndexBuild(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB DirFcb)
+{
+    PVFAT_NAME_INDEX Index;
+    PFAT_DIR_ENTRY pFatEntry = NULL;
+    PVOID Context = NULL;
+    PVOID Page;
+    LARGE_INTEGER FileOffset;
+    ULONG i, Count;
+    NTSTATUS Status;
+    BOOLEAN First = TRUE;
+    VFAT_DIRENTRY_CONTEXT DirContext;
+    WCHAR LongNameBuffer[260];
+    WCHAR ShortNameBuffer[13];
+
+    Status = vfatFCBInitializeCacheFromVolume(DeviceExt, DirFcb);
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    Index = ExAllocatePoolWithTag(PagedPool, sizeof(VFAT_NAME_INDEX), TAG_INDEX);
+    if (Index == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    RtlZeroMemory(Index, sizeof(VFAT_NAME_INDEX));
+
+    Index->BucketCount = NAME_INDEX_INITIAL_BUCKETS;
+    Index->Buckets = ExAllocatePoolWithTag(PagedPool, Index->BucketCount * sizeof(PVFAT_NAME_INDEX_ENTRY), TAG_INDEX);
+    if (Index->Buckets == NULL)
+    {
+        ExFreePoolWithTag(Index, TAG_INDEX);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    RtlZeroMemory(Index->Buckets, Index->BucketCount * sizeof(PVFAT_NAME_INDEX_ENTRY));
+
+    Count = DirFcb->RFCB.FileSize.u.LowPart / sizeof(FAT_DIR_ENTRY);
+    if (!vfatNameIndexResizeSlots(Index, Count))
+    {
+        vfatNameIndexDelete(Index);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    /* Free slots: same rules as vfatFindDirSpace, everything is free past the end marker */
+    FileOffset.QuadPart = 0;
+    for (i = 0; i < Count; i++, pFatEntry++)
+    {
+        if ((i % FAT_ENTRIES_PER_PAGE) == 0)
+        {
+            if (Context != NULL)
+            {
+                CcUnpinData(Context);
+            }
+            FileOffset.u.LowPart = i * sizeof(FAT_DIR_ENTRY);
+            _SEH2_TRY
+            {
+                CcMapData(DirFcb->FileObject, &FileOffset,
+                          min(PAGE_SIZE, DirFcb->RFCB.FileSize.u.LowPart - FileOffset.u.LowPart),
+                          MAP_WAIT, &Context, (PVOID*)&pFatEntry);
+            }
+            _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+            {
+                Status = _SEH2_GetExceptionCode();
+            }
+            _SEH2_END;
+
+            if (!NT_SUCCESS(Status))
+            {
+                vfatNameIndexDelete(Index);
+                return Status;
+            }
+        }
+
+        if (FAT_ENTRY_END(pFatEntry))
+        {
+            break;
+        }
+        if (!FAT_ENTRY_DELETED(pFatEntry))
+        {
+            RtlSetBit(&Index->UsedSlots, i);
+        }
+    }
+    if (Context != NULL)
+    {
+        CcUnpinData(Context);
+        Context = NULL;
+    }
+    Index->EndIndex = i;
+
+    /* Names: same walk as vfatDirFindFile */
+    DirContext.DirIndex = 0;
+    DirContext.DeviceExt = DeviceExt;
+    DirContext.LongNameU.Buffer = LongNameBuffer;
+    DirContext.LongNameU.MaximumLength = sizeof(LongNameBuffer);
+    DirContext.ShortNameU.Buffer = ShortNameBuffer;
+    DirContext.ShortNameU.MaximumLength = sizeof(ShortNameBuffer);
+
+    while (TRUE)
+    {
+        Status = VfatGetNextDirEntry(DeviceExt, &Context, &Page, DirFcb, &DirContext, First);
+        First = FALSE;
+        if (Status == STATUS_NO_MORE_ENTRIES)
+        {
+            break;
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            if (Context != NULL)
+            {
+                CcUnpinData(Context);
+            }
+            vfatNameIndexDelete(Index);
+            return Status;
+        }
+
+        if (!vfatNameIndexInsert(Index, &DirContext))
+        {
+            CcUnpinData(Context);
+            vfatNameIndexDelete(Index);
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+        DirContext.DirIndex++;
+    }
+
+    DPRINT("Indexed %u names of %u entries in '%wZ'\n", Index->EntryCount, Count, &DirFcb->PathNameU);
+    DirFcb->NameIndex = Index;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * FUNCTION: Returns the name index of a directory, building it first if
+ *           needed. NULL if the directory cannot be indexed.
+ */
+PVFAT_NAME_INDEX
+vfatNameIndexGet(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB DirFcb)
+{
+    ASSERT(ExIsResourceAcquiredExclusive(&DeviceExt->DirResource));
+
+    if (vfatVolumeIsFatX(DeviceExt) || !vfatFCBIsDirectory(DirFcb))
+    {
+        return NULL;
+    }
+
+    if (DirFcb->NameIndex == NULL)
+    {
+        if (!NT_SUCCESS(vfatNameIndexBuild(DeviceExt, DirFcb)))
+        {
+            return NULL;
+        }
+    }
+    else if (!vfatNameIndexResizeSlots(DirFcb->NameIndex,
+                                       DirFcb->RFCB.FileSize.u.LowPart / sizeof(FAT_DIR_ENTRY)))
+    {
+        vfatNameIndexFree(DirFcb);
+        return NULL;
+    }
+
+    return DirFcb->NameIndex;
+}
+
+/*
+ * FUNCTION: Looks up a name without wildcards, with the rules of FindFile
+ *           and vfatDirFindFile, from DirContext->DirIndex on. Returns
+ *           STATUS_NO_MORE_ENTRIES if it is not there, or STATUS_NOT_SUPPORTED
+ *           if the directory has no index and must be searched.
+ */
+NTSTATUS
+vfatNameIndexFind(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB DirFcb,
+    PUNICODE_STRING FileToFindU,
+    PVFAT_DIRENTRY_CONTEXT DirContext)
+{
+    PVFAT_NAME_INDEX Index;
+    PVFAT_NAME_INDEX_ENTRY Entry;
+    ULONG Hash, MinIndex, Found = MAXULONG;
+    BOOLEAN Current = FALSE;
+
+    Index = vfatNameIndexGet(DeviceExt, DirFcb);
+    if (Index == NULL)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    MinIndex = DirContext->DirIndex;
+    Hash = vfatNameIndexHash(FileToFindU);
+    for (Entry = Index->Buckets[Hash & (Index->BucketCount - 1)]; Entry != NULL; Entry = Entry->Next)
+    {
+        if (Entry->Hash != Hash || Entry->DirIndex < MinIndex || Entry->DirIndex >= Found)
+        {
+            continue;
+        }
+
+        /* A linear search would have returned the first matching entry */
+        Current = vfatNameIndexReadEntry(DeviceExt, DirFcb, Entry->DirIndex, DirContext) &&
+                  !FAT_ENTRY_VOLUME(&DirContext->DirEntry.Fat) &&
+                  DirContext->LongNameU.Length != 0 &&
+                  DirContext->ShortNameU.Length != 0 &&
+                  (RtlEqualUnicodeString(FileToFindU, &DirContext->LongNameU, TRUE) ||
+                   RtlEqualUnicodeString(FileToFindU, &DirContext->ShortNameU, TRUE));
+        if (Current)
+        {
+            Found = Entry->DirIndex;
+        }
+    }
+
+    if (Found == MAXULONG)
+    {
+        DirContext->DirIndex = MinIndex;
+        return STATUS_NO_MORE_ENTRIES;
+    }
+
+    /* Checking a later candidate overwrote the context */
+    if (!Current && !vfatNameIndexReadEntry(DeviceExt, DirFcb, Found, DirContext))
+    {
+        DirContext->DirIndex = MinIndex;
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * FUNCTION: Records the entry just written from StartIndex to DirIndex in
+ *           the index of its directory, if it has one.
+ */
+VOID
+vfatNameIndexAddEntry(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB DirFcb,
+    ULONG StartIndex,
+    ULONG DirIndex)
+{
+    PVFAT_NAME_INDEX Index = DirFcb->NameIndex;
+    VFAT_DIRENTRY_CONTEXT DirContext;
+    WCHAR LongNameBuffer[260];
+    WCHAR ShortNameBuffer[13];
+
+    if (Index == NULL)
+    {
+        return;
+    }
+
+    if (!vfatNameIndexResizeSlots(Index, DirFcb->RFCB.FileSize.u.LowPart / sizeof(FAT_DIR_ENTRY)))
+    {
+        vfatNameIndexFree(DirFcb);
+        return;
+    }
+    RtlSetBits(&Index->UsedSlots, StartIndex, DirIndex - StartIndex + 1);
+    Index->EndIndex = max(Index->EndIndex, DirIndex + 1);
+
+    /* Index the names as a directory walk returns them */
+    DirContext.DeviceExt = DeviceExt;
+    DirContext.LongNameU.Buffer = LongNameBuffer;
+    DirContext.LongNameU.MaximumLength = sizeof(LongNameBuffer);
+    DirContext.ShortNameU.Buffer = ShortNameBuffer;
+    DirContext.ShortNameU.MaximumLength = sizeof(ShortNameBuffer);
+    if (!vfatNameIndexReadEntry(DeviceExt, DirFcb, DirIndex, &DirContext) ||
+        !vfatNameIndexInsert(Index, &DirContext))
+    {
+        vfatNameIndexFree(DirFcb);
+    }
+}
+
+/*
+ * FUNCTION: Forgets the entry from StartIndex to DirIndex, before it gets
+ *           marked deleted.
+ */
+VOID
+vfatNameIndexRemoveEntry(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB DirFcb,
+    ULONG StartIndex,
+    ULONG DirIndex)
+{
+    PVFAT_NAME_INDEX Index = DirFcb->NameIndex;
+    VFAT_DIRENTRY_CONTEXT DirContext;
+    WCHAR LongNameBuffer[260];
+    WCHAR ShortNameBuffer[13];
+
+    if (Index == NULL)
+    {
+        return;
+    }
+
+    /* Names which are left behind are harmless, lookups check the entry */
+    DirContext.DeviceExt = DeviceExt;
+    DirContext.LongNameU.Buffer = LongNameBuffer;
+    DirContext.LongNameU.MaximumLength = sizeof(LongNameBuffer);
+    DirContext.ShortNameU.Buffer = ShortNameBuffer;
+    DirContext.ShortNameU.MaximumLength = sizeof(ShortNameBuffer);
+    if (vfatNameIndexReadEntry(DeviceExt, DirFcb, DirIndex, &DirContext))
+    {
+        vfatNameIndexRemove(Index, &DirContext.LongNameU, DirIndex);
+        vfatNameIndexRemove(Index, &DirContext.ShortNameU, DirIndex);
+    }
+
+    if (DirIndex < Index->UsedSlots.SizeOfBitMap)
+    {
+        RtlClearBits(&Index->UsedSlots, StartIndex, DirIndex - StartIndex + 1);
+    }
+}
+
+VOID
+vfatNameIndexFree(
+    PVFATFCB DirFcb)
+{
+    if (DirFcb->NameIndex != NULL)
+    {
+        vfatNameIndexDelete(DirFcb->NameIndex);
+        DirFcb->NameIndex = NULL;
+    }
+}
+
+/* EOF */
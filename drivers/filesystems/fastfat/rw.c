@@ -113,6 +113,93 @@ OffsetToCluster(
    }
 }
 
+/*
+ * Return the cluster at FileOffset and how many clusters follow it
+ * contiguously on disk. The FCB's run map answers when it covers the
+ * offset; otherwise the chain is walked on from the end of the map and
+ * what is found gets added to it, up to ClustersWanted clusters from the
+ * offset. Past the end of the chain, Cluster is 0xffffffff.
+ */
+NTSTATUS
+OffsetToClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb,
+    ULONG FileOffset,
+    ULONG ClustersWanted,
+    PULONG Cluster,
+    PULONG ClusterCount)
+{
+    LONGLONG Lbn, Count, LastVcn;
+    ULONG Vcn, EndVcn, CurrentVcn, CurrentCluster, RunStartVcn, RunStart;
+    NTSTATUS Status;
+
+    ASSERT(vfatDirEntryGetFirstCluster(DeviceExt, &Fcb->entry) != 1);
+
+    Vcn = FileOffset / DeviceExt->FatInfo.BytesPerCluster;
+    if (FsRtlLookupLargeMcbEntry(&Fcb->Mcb, Vcn, &Lbn, &Count, NULL, NULL, NULL) && Lbn != -1)
+    {
+        *Cluster = (ULONG)Lbn;
+        *ClusterCount = (ULONG)min(Count, MAXULONG);
+#ifdef DEBUG_VERIFY_OFFSET_CACHING
+        /* DEBUG VERIFICATION */
+        {
+            ULONG CorrectCluster;
+            OffsetToCluster(DeviceExt, vfatDirEntryGetFirstCluster(DeviceExt, &Fcb->entry),
+                            ROUND_DOWN(FileOffset, DeviceExt->FatInfo.BytesPerCluster),
+                            &CorrectCluster, FALSE);
+            if (CorrectCluster != *Cluster)
+                KeBugCheck(FAT_FILE_SYSTEM);
+        }
+#endif
+        return STATUS_SUCCESS;
+    }
+
+    /* Walk on from the last cluster the map knows about, or from the start */
+    if (FsRtlLookupLastLargeMcbEntry(&Fcb->Mcb, &LastVcn, &Lbn))
+    {
+        CurrentVcn = (ULONG)LastVcn + 1;
+        Status = GetNextCluster(DeviceExt, (ULONG)Lbn, &CurrentCluster);
+        if (!NT_SUCCESS(Status))
+            return Status;
+    }
+    else
+    {
+        CurrentVcn = 0;
+        CurrentCluster = vfatDirEntryGetFirstCluster(DeviceExt, &Fcb->entry);
+    }
+
+    EndVcn = Vcn + max(ClustersWanted, 1);
+    while (CurrentVcn < EndVcn && CurrentCluster != 0xffffffff && CurrentCluster != 0)
+    {
+        /* Gather the clusters that follow each other on disk into one run */
+        RunStart = CurrentCluster;
+        RunStartVcn = CurrentVcn;
+        do
+        {
+            Status = GetNextCluster(DeviceExt, CurrentCluster, &CurrentCluster);
+            if (!NT_SUCCESS(Status))
+                return Status;
+            CurrentVcn++;
+        }
+        while (CurrentVcn < EndVcn && CurrentCluster == RunStart + (CurrentVcn - RunStartVcn));
+
+        FsRtlAddLargeMcbEntry(&Fcb->Mcb, RunStartVcn, RunStart, CurrentVcn - RunStartVcn);
+    }
+
+    if (FsRtlLookupLargeMcbEntry(&Fcb->Mcb, Vcn, &Lbn, &Count, NULL, NULL, NULL) && Lbn != -1)
+    {
+        *Cluster = (ULONG)Lbn;
+        *ClusterCount = (ULONG)min(Count, MAXULONG);
+    }
+    else
+    {
+        /* The chain is shorter than the offset */
+        *Cluster = 0xffffffff;
+        *ClusterCount = 0;
+    }
+    return STATUS_SUCCESS;
+}
+
 /*
  * FUNCTION: Reads data from a file
  */
@@ -124,20 +211,16 @@ VfatReadFileData(
     LARGE_INTEGER ReadOffset,
     PULONG LengthRead)
 {
-    ULONG CurrentCluster;
     ULONG FirstCluster;
     ULONG StartCluster;
     ULONG ClusterCount;
     LARGE_INTEGER StartOffset;
     PDEVICE_EXTENSION DeviceExt;
-    BOOLEAN First = TRUE;
     PVFATFCB Fcb;
     NTSTATUS Status;
     ULONG BytesDone;
     ULONG BytesPerSector;
     ULONG BytesPerCluster;
-    ULONG LastCluster;
-    ULONG LastOffset;
 
     /* PRECONDITION */
     ASSERT(IrpContext);
@@ -194,8 +277,7 @@ VfatReadFileData(
     }
 
     /* Find the first cluster */
-    FirstCluster =
-    CurrentCluster = vfatDirEntryGetFirstCluster (DeviceExt, &Fcb->entry);
+    FirstCluster = vfatDirEntryGetFirstCluster (DeviceExt, &Fcb->entry);
 
     if (FirstCluster == 1)
     {
@@ -215,87 +297,26 @@ VfatReadFileData(
         return Status;
     }
 
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    LastCluster = Fcb->LastCluster;
-    LastOffset = Fcb->LastOffset;
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
-    /* Find the cluster to start the read from */
-    if (LastCluster > 0 && ReadOffset.u.LowPart >= LastOffset)
-    {
-        Status = OffsetToCluster(DeviceExt, LastCluster,
-                                 ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster) -
-                                 LastOffset,
-                                 &CurrentCluster, FALSE);
-#ifdef DEBUG_VERIFY_OFFSET_CACHING
-        /* DEBUG VERIFICATION */
-        {
-            ULONG CorrectCluster;
-            OffsetToCluster(DeviceExt, FirstCluster,
-                            ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster),
-                            &CorrectCluster, FALSE);
-            if (CorrectCluster != CurrentCluster)
-                KeBugCheck(FAT_FILE_SYSTEM);
-        }
-#endif
-    }
-    else
-    {
-        Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                 ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster),
-                                 &CurrentCluster, FALSE);
-    }
-
-    if (!NT_SUCCESS(Status))
-    {
-        return Status;
-    }
-
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    Fcb->LastCluster = CurrentCluster;
-    Fcb->LastOffset = ROUND_DOWN (ReadOffset.u.LowPart, BytesPerCluster);
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
     KeInitializeEvent(&IrpContext->Event, NotificationEvent, FALSE);
     IrpContext->RefCount = 1;
 
-    while (Length > 0 && CurrentCluster != 0xffffffff)
+    while (Length > 0)
     {
-        StartCluster = CurrentCluster;
-        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector;
-        BytesDone = 0;
-        ClusterCount = 0;
-
-        do
+        /* Look up the run holding the offset, and how far it goes on disk */
+        Status = OffsetToClusterRun(DeviceExt, Fcb, ReadOffset.u.LowPart,
+                                    (ReadOffset.u.LowPart % BytesPerCluster + Length + BytesPerCluster - 1) / BytesPerCluster,
+                                    &StartCluster, &ClusterCount);
+        if (!NT_SUCCESS(Status) || StartCluster == 0xffffffff)
         {
-            ClusterCount++;
-            if (First)
-            {
-                BytesDone =  min (Length, BytesPerCluster - (ReadOffset.u.LowPart % BytesPerCluster));
-                StartOffset.QuadPart += ReadOffset.u.LowPart % BytesPerCluster;
-                First = FALSE;
-            }
-            else
-            {
-                if (Length - BytesDone > BytesPerCluster)
-                {
-                    BytesDone += BytesPerCluster;
-                }
-                else
-                {
-                    BytesDone = Length;
-                }
-            }
-            Status = NextCluster(DeviceExt, FirstCluster, &CurrentCluster, FALSE);
+            break;
         }
-        while (StartCluster + ClusterCount == CurrentCluster && NT_SUCCESS(Status) && Length > BytesDone);
-        DPRINT("start %08x, next %08x, count %u\n",
-               StartCluster, CurrentCluster, ClusterCount);
 
-        ExAcquireFastMutex(&Fcb->LastMutex);
-        Fcb->LastCluster = StartCluster + (ClusterCount - 1);
-        Fcb->LastOffset = ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster) + (ClusterCount - 1) * BytesPerCluster;
-        ExReleaseFastMutex(&Fcb->LastMutex);
+        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector +
+                               ReadOffset.u.LowPart % BytesPerCluster;
+        BytesDone = (ULONG)min((ULONGLONG)ClusterCount * BytesPerCluster - ReadOffset.u.LowPart % BytesPerCluster,
+                               Length);
+        DPRINT("start %08x, count %u, bytes %u\n",
+               StartCluster, ClusterCount, BytesDone);
 
         /* Fire up the read command */
         Status = VfatReadDiskPartial (IrpContext, &StartOffset, BytesDone, *LengthRead, FALSE);
@@ -339,18 +360,14 @@ VfatWriteFileData(
     PVFATFCB Fcb;
     ULONG Count;
     ULONG FirstCluster;
-    ULONG CurrentCluster;
     ULONG BytesDone;
     ULONG StartCluster;
     ULONG ClusterCount;
     NTSTATUS Status = STATUS_SUCCESS;
-    BOOLEAN First = TRUE;
     ULONG BytesPerSector;
     ULONG BytesPerCluster;
     LARGE_INTEGER StartOffset;
     ULONG BufferOffset;
-    ULONG LastCluster;
-    ULONG LastOffset;
 
     /* PRECONDITION */
     ASSERT(IrpContext);
@@ -415,8 +432,7 @@ VfatWriteFileData(
     /*
      * Find the first cluster
      */
-    FirstCluster =
-    CurrentCluster = vfatDirEntryGetFirstCluster (DeviceExt, &Fcb->entry);
+    FirstCluster = vfatDirEntryGetFirstCluster (DeviceExt, &Fcb->entry);
 
     if (FirstCluster == 1)
     {
@@ -428,89 +444,26 @@ VfatWriteFileData(
         return Status;
     }
 
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    LastCluster = Fcb->LastCluster;
-    LastOffset = Fcb->LastOffset;
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
-    /*
-     * Find the cluster to start the write from
-     */
-    if (LastCluster > 0 && WriteOffset.u.LowPart >= LastOffset)
-    {
-        Status = OffsetToCluster(DeviceExt, LastCluster,
-                                 ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster) -
-                                 LastOffset,
-                                 &CurrentCluster, FALSE);
-#ifdef DEBUG_VERIFY_OFFSET_CACHING
-        /* DEBUG VERIFICATION */
-        {
-            ULONG CorrectCluster;
-            OffsetToCluster(DeviceExt, FirstCluster,
-                            ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster),
-                            &CorrectCluster, FALSE);
-            if (CorrectCluster != CurrentCluster)
-                KeBugCheck(FAT_FILE_SYSTEM);
-        }
-#endif
-    }
-    else
-    {
-        Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                 ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster),
-                                 &CurrentCluster, FALSE);
-    }
-
-    if (!NT_SUCCESS(Status))
-    {
-        return Status;
-    }
-
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    Fcb->LastCluster = CurrentCluster;
-    Fcb->LastOffset = ROUND_DOWN (WriteOffset.u.LowPart, BytesPerCluster);
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
     IrpContext->RefCount = 1;
     BufferOffset = 0;
 
-    while (Length > 0 && CurrentCluster != 0xffffffff)
+    while (Length > 0)
     {
-        StartCluster = CurrentCluster;
-        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector;
-        BytesDone = 0;
-        ClusterCount = 0;
-
-        do
+        /* Look up the run holding the offset, and how far it goes on disk */
+        Status = OffsetToClusterRun(DeviceExt, Fcb, WriteOffset.u.LowPart,
+                                    (WriteOffset.u.LowPart % BytesPerCluster + Length + BytesPerCluster - 1) / BytesPerCluster,
+                                    &StartCluster, &ClusterCount);
+        if (!NT_SUCCESS(Status) || StartCluster == 0xffffffff)
         {
-            ClusterCount++;
-            if (First)
-            {
-                BytesDone =  min (Length, BytesPerCluster - (WriteOffset.u.LowPart % BytesPerCluster));
-                StartOffset.QuadPart += WriteOffset.u.LowPart % BytesPerCluster;
-                First = FALSE;
-            }
-            else
-            {
-                if (Length - BytesDone > BytesPerCluster)
-                {
-                    BytesDone += BytesPerCluster;
-                }
-                else
-                {
-                    BytesDone = Length;
-                }
-            }
-            Status = NextCluster(DeviceExt, FirstCluster, &CurrentCluster, FALSE);
+            break;
         }
-        while (StartCluster + ClusterCount == CurrentCluster && NT_SUCCESS(Status) && Length > BytesDone);
-        DPRINT("start %08x, next %08x, count %u\n",
-               StartCluster, CurrentCluster, ClusterCount);
-
-        ExAcquireFastMutex(&Fcb->LastMutex);
-        Fcb->LastCluster = StartCluster + (ClusterCount - 1);
-        Fcb->LastOffset = ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster) + (ClusterCount - 1) * BytesPerCluster;
-        ExReleaseFastMutex(&Fcb->LastMutex);
+
+        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector +
+                               WriteOffset.u.LowPart % BytesPerCluster;
+        BytesDone = (ULONG)min((ULONGLONG)ClusterCount * BytesPerCluster - WriteOffset.u.LowPart % BytesPerCluster,
+                               Length);
+        DPRINT("start %08x, count %u, bytes %u\n",
+               StartCluster, ClusterCount, BytesDone);
 
         // Fire up the write command
         Status = VfatWriteDiskPartial (IrpContext, &StartOffset, BytesDone, BufferOffset, FALSE);
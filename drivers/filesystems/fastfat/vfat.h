@@ -280,11 +280,36 @@ typedef struct _HASHENTRY
 }
 HASHENTRY;
 
+/*
+ * In-memory index of a FAT directory, see nameidx.c. Protected by the
+ * volume DirResource, which is held exclusively by every path using it.
+ */
+typedef struct _VFAT_NAME_INDEX_ENTRY
+{
+    struct _VFAT_NAME_INDEX_ENTRY *Next;
+    /* Hash of the upcased long or short name */
+    ULONG Hash;
+    /* Directory index of the short name entry */
+    ULONG DirIndex;
+} VFAT_NAME_INDEX_ENTRY, *PVFAT_NAME_INDEX_ENTRY;
+
+typedef struct _VFAT_NAME_INDEX
+{
+    ULONG BucketCount;
+    ULONG EntryCount;
+    PVFAT_NAME_INDEX_ENTRY *Buckets;
+    /* One bit per directory entry, set when it is not free */
+    RTL_BITMAP UsedSlots;
+    /* First entry past the ones ever used, where the end marker is */
+    ULONG EndIndex;
+} VFAT_NAME_INDEX, *PVFAT_NAME_INDEX;
+
 typedef struct DEVICE_EXTENSION *PDEVICE_EXTENSION;
 
 typedef NTSTATUS (*PGET_NEXT_CLUSTER)(PDEVICE_EXTENSION,ULONG,PULONG);
 typedef NTSTATUS (*PFIND_AND_MARK_AVAILABLE_CLUSTER)(PDEVICE_EXTENSION,PULONG);
 typedef NTSTATUS (*PWRITE_CLUSTER)(PDEVICE_EXTENSION,ULONG,ULONG,PULONG);
+typedef NTSTATUS (*PWRITE_CLUSTER_RUN)(PDEVICE_EXTENSION,ULONG,ULONG,ULONG);
 
 typedef BOOLEAN (*PIS_DIRECTORY_EMPTY)(PDEVICE_EXTENSION,struct _VFATFCB*);
 typedef NTSTATUS (*PADD_ENTRY)(PDEVICE_EXTENSION,PUNICODE_STRING,struct _VFATFCB**,struct _VFATFCB*,ULONG,UCHAR,struct _VFAT_MOVE_CONTEXT*);
@@ -325,6 +350,8 @@ typedef struct DEVICE_EXTENSION
     ULONG LastAvailableCluster;
     ULONG AvailableClusters;
     BOOLEAN AvailableClustersValid;
+    /* One bit per cluster, set when it is in use; no buffer if it couldn't be allocated */
+    RTL_BITMAP FreeClusterBitmap;
     ULONG Flags;
     struct _VFATFCB *VolumeFcb;
     struct _VFATFCB *RootFcb;
@@ -340,6 +367,7 @@ typedef struct DEVICE_EXTENSION
     PGET_NEXT_CLUSTER GetNextCluster;
     PFIND_AND_MARK_AVAILABLE_CLUSTER FindAndMarkAvailableCluster;
     PWRITE_CLUSTER WriteCluster;
+    PWRITE_CLUSTER_RUN WriteClusterRun;
     PGET_DIRTY_STATUS GetDirtyStatus;
     PSET_DIRTY_STATUS SetDirtyStatus;
 
@@ -418,6 +446,7 @@ typedef struct
     NPAGED_LOOKASIDE_LIST CcbLookasideList;
     NPAGED_LOOKASIDE_LIST IrpContextLookasideList;
     PAGED_LOOKASIDE_LIST CloseContextLookasideList;
+    PAGED_LOOKASIDE_LIST NameIndexLookasideList;
     FAST_IO_DISPATCH FastIoDispatch;
     CACHE_MANAGER_CALLBACKS CacheMgrCallbacks;
     FAST_MUTEX CloseMutex;
@@ -520,13 +549,14 @@ typedef struct _VFATFCB
     FILE_LOCK FileLock;
 
     /*
-     * Optimization: caching of last read/write cluster+offset pair. Can't
-     * be in VFATCCB because it must be reset everytime the allocated clusters
-     * change.
+     * Runs of the cluster chain seen so far, file cluster index to cluster
+     * number. Always a prefix of the chain: filled as the chain is walked,
+     * and truncated or reset when clusters are freed.
      */
-    FAST_MUTEX LastMutex;
-    ULONG LastCluster;
-    ULONG LastOffset;
+    LARGE_MCB Mcb;
+
+    /* Name index of a directory, built on first lookup */
+    PVFAT_NAME_INDEX NameIndex;
 
     struct _VFAT_CLOSE_CONTEXT * CloseContext;
 } VFATFCB, *PVFATFCB;
@@ -553,6 +583,8 @@ typedef struct _VFATCCB
 #define TAG_NAME 'ntaF'
 #define TAG_SEARCH 'LtaF'
 #define TAG_DIRENT 'DtaF'
+#define TAG_BITMAP 'BtaF'
+#define TAG_INDEX 'HtaF'
 
 #define ENTRIES_PER_SECTOR (BLOCKSIZE / sizeof(FATDirEntry))
 
@@ -859,6 +891,13 @@ FAT12WriteCluster(
     ULONG NewValue,
     PULONG OldValue);
 
+NTSTATUS
+FAT12WriteClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG StartCluster,
+    ULONG ClusterCount,
+    ULONG LastValue);
+
 NTSTATUS
 FAT16GetNextCluster(
     PDEVICE_EXTENSION DeviceExt,
@@ -877,6 +916,13 @@ FAT16WriteCluster(
     ULONG NewValue,
     PULONG OldValue);
 
+NTSTATUS
+FAT16WriteClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG StartCluster,
+    ULONG ClusterCount,
+    ULONG LastValue);
+
 NTSTATUS
 FAT32GetNextCluster(
     PDEVICE_EXTENSION DeviceExt,
@@ -895,6 +941,13 @@ FAT32WriteCluster(
     ULONG NewValue,
     PULONG OldValue);
 
+NTSTATUS
+FAT32WriteClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG StartCluster,
+    ULONG ClusterCount,
+    ULONG LastValue);
+
 NTSTATUS
 OffsetToCluster(
     PDEVICE_EXTENSION DeviceExt,
@@ -903,6 +956,15 @@ OffsetToCluster(
     PULONG Cluster,
     BOOLEAN Extend);
 
+NTSTATUS
+OffsetToClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb,
+    ULONG FileOffset,
+    ULONG ClustersWanted,
+    PULONG Cluster,
+    PULONG ClusterCount);
+
 ULONGLONG
 ClusterToSector(
     PDEVICE_EXTENSION DeviceExt,
@@ -920,6 +982,14 @@ GetNextClusterExtend(
     ULONG CurrentCluster,
     PULONG NextCluster);
 
+NTSTATUS
+AllocateClusters(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG LastCluster,
+    ULONG ClusterCount,
+    PULONG FirstNewCluster,
+    PULONG LastNewCluster);
+
 NTSTATUS
 CountAvailableClusters(
     PDEVICE_EXTENSION DeviceExt,
@@ -1179,6 +1249,38 @@ VfatHandleDeferredWrite(
     IN PVOID IrpContext,
     IN PVOID Unused);
 
+/* nameidx.c */
+
+PVFAT_NAME_INDEX
+vfatNameIndexGet(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB DirFcb);
+
+NTSTATUS
+vfatNameIndexFind(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB DirFcb,
+    PUNICODE_STRING FileToFindU,
+    PVFAT_DIRENTRY_CONTEXT DirContext);
+
+VOID
+vfatNameIndexAddEntry(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB DirFcb,
+    ULONG StartIndex,
+    ULONG DirIndex);
+
+VOID
+vfatNameIndexRemoveEntry(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB DirFcb,
+    ULONG StartIndex,
+    ULONG DirIndex);
+
+VOID
+vfatNameIndexFree(
+    PVFATFCB DirFcb);
+
 /* pnp.c */
 
 NTSTATUS
@@ -405,6 +405,7 @@ FsdSetFsLabelInformation(
                 RtlCopyMemory(Entry, &VolumeLabelDirEntry, SizeDirEntry);
                 CcSetDirtyPinnedData(Context, NULL);
                 CcUnpinData(Context);
+                vfatNameIndexAddEntry(DeviceExt, pRootFcb, VolumeLabelDirIndex, VolumeLabelDirIndex);
                 Status = STATUS_SUCCESS;
             }
         }
@@ -499,7 +499,8 @@ PB_TREE_FILENAME_NODE
 CreateBTreeNodeFromIndexNode(PDEVICE_EXTENSION Vcb,
                              PINDEX_ROOT_ATTRIBUTE IndexRoot,
                              PNTFS_ATTR_CONTEXT IndexAllocationAttributeCtx,
-                             PINDEX_ENTRY_ATTRIBUTE NodeEntry)
+                             PINDEX_ENTRY_ATTRIBUTE NodeEntry,
+                             BOOLEAN LoadChildren)
 {
     PB_TREE_FILENAME_NODE NewNode;
     PINDEX_ENTRY_ATTRIBUTE CurrentNodeEntry;
@@ -618,12 +619,13 @@ CreateBTreeNodeFromIndexNode(PDEVICE_EXTENSION Vcb,
             RtlCopyMemory(CurrentKey->IndexEntry, CurrentNodeEntry, CurrentNodeEntry->Length);
 
             // See if the current key has a sub-node
-            if (CurrentKey->IndexEntry->Flags & NTFS_INDEX_ENTRY_NODE)
+            if ((CurrentKey->IndexEntry->Flags & NTFS_INDEX_ENTRY_NODE) && LoadChildren)
             {
                 CurrentKey->LesserChild = CreateBTreeNodeFromIndexNode(Vcb,
                                                                        IndexRoot,
                                                                        IndexAllocationAttributeCtx,
-                                                                       CurrentKey->IndexEntry);
+                                                                       CurrentKey->IndexEntry,
+                                                                       TRUE);
             }
 
             CurrentKey = NextKey;
@@ -635,12 +637,13 @@ CreateBTreeNodeFromIndexNode(PDEVICE_EXTENSION Vcb,
             CurrentKey->NextKey = NULL;
 
             // See if the current key has a sub-node
-            if (CurrentKey->IndexEntry->Flags & NTFS_INDEX_ENTRY_NODE)
+            if ((CurrentKey->IndexEntry->Flags & NTFS_INDEX_ENTRY_NODE) && LoadChildren)
             {
                 CurrentKey->LesserChild = CreateBTreeNodeFromIndexNode(Vcb,
                                                                        IndexRoot,
                                                                        IndexAllocationAttributeCtx,
-                                                                       CurrentKey->IndexEntry);
+                                                                       CurrentKey->IndexEntry,
+                                                                       TRUE);
             }
 
             break;
@@ -668,6 +671,10 @@ CreateBTreeNodeFromIndexNode(PDEVICE_EXTENSION Vcb,
 * @param IndexRootContext
 * Pointer to an NTFS_ATTR_CONTEXT that describes the location of the index root attribute.
 *
+* @param LoadChildren
+* If TRUE, every index record of the index is read into the tree. If FALSE, only the index root is read,
+* and the index records are read later by NtfsInsertKey(), when it descends into them.
+*
 * @param NewTree
 * Pointer to a PB_TREE that will receive the pointer to a newly-created B-Tree.
 *
@@ -676,7 +683,9 @@ CreateBTreeNodeFromIndexNode(PDEVICE_EXTENSION Vcb,
 * STATUS_INSUFFICIENT_RESOURCES if an allocation fails.
 * 
 * @remarks
-* Allocates memory for the entire tree. Caller is responsible for destroying the tree with DestroyBTree().
+* Allocates memory for the tree. Caller is responsible for destroying the tree with DestroyBTree().
+* A key of a tree created without LoadChildren can have the NTFS_INDEX_ENTRY_NODE flag and no LesserChild;
+* its child node is then left as it is on the disk.
 */
 NTSTATUS
 CreateBTreeFromIndex(PDEVICE_EXTENSION Vcb,
@@ -684,6 +693,7 @@ CreateBTreeFromIndex(PDEVICE_EXTENSION Vcb,
                      /*PCWSTR IndexName,*/
                      PNTFS_ATTR_CONTEXT IndexRootContext,
                      PINDEX_ROOT_ATTRIBUTE IndexRoot,
+                     BOOLEAN LoadChildren,
                      PB_TREE *NewTree)
 {
     PINDEX_ENTRY_ATTRIBUTE CurrentNodeEntry;
@@ -778,13 +788,14 @@ CreateBTreeFromIndex(PDEVICE_EXTENSION Vcb,
             RtlCopyMemory(CurrentKey->IndexEntry, CurrentNodeEntry, CurrentNodeEntry->Length);
 
             // Does this key have a sub-node?
-            if (CurrentKey->IndexEntry->Flags & NTFS_INDEX_ENTRY_NODE)
+            if ((CurrentKey->IndexEntry->Flags & NTFS_INDEX_ENTRY_NODE) && LoadChildren)
             {
                 // Create the child node
                 CurrentKey->LesserChild = CreateBTreeNodeFromIndexNode(Vcb,
                                                                        IndexRoot,
                                                                        IndexAllocationContext,
-                                                                       CurrentKey->IndexEntry);
+                                                                       CurrentKey->IndexEntry,
+                                                                       TRUE);
                 if (!CurrentKey->LesserChild)
                 {
                     DPRINT1("ERROR: Couldn't create child node!\n");
@@ -806,13 +817,14 @@ CreateBTreeFromIndex(PDEVICE_EXTENSION Vcb,
             CurrentKey->NextKey = NULL;
 
             // Does this key have a sub-node?
-            if (CurrentKey->IndexEntry->Flags & NTFS_INDEX_ENTRY_NODE)
+            if ((CurrentKey->IndexEntry->Flags & NTFS_INDEX_ENTRY_NODE) && LoadChildren)
             {
                 // Create the child node
                 CurrentKey->LesserChild = CreateBTreeNodeFromIndexNode(Vcb,
                                                                        IndexRoot,
                                                                        IndexAllocationContext,
-                                                                       CurrentKey->IndexEntry);
+                                                                       CurrentKey->IndexEntry,
+                                                                       TRUE);
                 if (!CurrentKey->LesserChild)
                 {
                     DPRINT1("ERROR: Couldn't create child node!\n");
@@ -826,6 +838,14 @@ CreateBTreeFromIndex(PDEVICE_EXTENSION Vcb,
         }
     }
 
+    // Keep what we need to read the child nodes later
+    if (!LoadChildren)
+    {
+        Tree->Vcb = Vcb;
+        Tree->IndexAllocationContext = IndexAllocationContext;
+        IndexAllocationContext = NULL;
+    }
+
     *NewTree = Tree;
     Status = STATUS_SUCCESS;
 
@@ -976,8 +996,8 @@ CreateIndexRootFromBTree(PDEVICE_EXTENSION DeviceExt,
                 CurrentNodeEntry->KeyLength,
                 CurrentNodeEntry->Length);
 
-        // Does the current key have any sub-nodes?
-        if (CurrentKey->LesserChild)
+        // Does the current key have any sub-nodes? They may not have been read.
+        if (CurrentKey->LesserChild || (CurrentKey->IndexEntry->Flags & NTFS_INDEX_ENTRY_NODE))
             NewIndexRoot->Header.Flags = INDEX_ROOT_LARGE;
 
         // Add Length of Current Entry to Total Size of Entries
@@ -1343,6 +1363,10 @@ UpdateIndexNode(PDEVICE_EXTENSION DeviceExt,
     {
         ASSERT(CurrentKey);
 
+        // Children which weren't read are unchanged on the disk, but still make this a large node
+        if (CurrentKey->IndexEntry->Flags & NTFS_INDEX_ENTRY_NODE)
+            HasChildren = TRUE;
+
         // If there's a child node
         if (CurrentKey->LesserChild)
         {
@@ -1542,6 +1566,8 @@ VOID
 DestroyBTree(PB_TREE Tree)
 {
     DestroyBTreeNode(Tree->RootNode);
+    if (Tree->IndexAllocationContext)
+        ReleaseAttributeContext(Tree->IndexAllocationContext);
     ExFreePoolWithTag(Tree, TAG_NTFS);
 }
 
@@ -1571,6 +1597,12 @@ DumpBTreeKey(PB_TREE Tree, PB_TREE_KEY Key, ULONG Number, ULONG Depth)
     {
         if (Key->LesserChild)
             DumpBTreeNode(Tree, Key->LesserChild, Number, Depth + 1);
+        else if (Tree->IndexAllocationContext)
+        {
+            for (i = 0; i <= Depth; i++)
+                DbgPrint(" ");
+            DbgPrint("Node VCN: %I64u (not read)\n", GetIndexEntryVCN(Key->IndexEntry));
+        }
         else
         {
             // This will be an assert once nodes with arbitrary depth are debugged
@@ -1647,6 +1679,54 @@ GetIndexEntryVCN(PINDEX_ENTRY_ATTRIBUTE IndexEntry)
     return *Destination;
 }
 
+/**
+* @name ReadBTreeChildNode
+* @implemented
+*
+* Reads the child node of a key from the index allocation, for a tree which was created without its child nodes.
+*
+* @param Tree
+* Pointer to the B_TREE containing the key. It must have been created by CreateBTreeFromIndex() without LoadChildren.
+*
+* @param Key
+* Pointer to a B_TREE_KEY with the NTFS_INDEX_ENTRY_NODE flag set and no LesserChild yet.
+*
+* @return
+* STATUS_SUCCESS on success.
+* STATUS_FILE_CORRUPT_ERROR if the index has no index allocation to read the node from.
+* STATUS_INSUFFICIENT_RESOURCES if the node couldn't be read.
+*
+* @remarks
+* Only the node itself is read; the keys of the new node don't have their children read either.
+*/
+static
+NTSTATUS
+ReadBTreeChildNode(PB_TREE Tree,
+                   PB_TREE_KEY Key)
+{
+    ASSERT(Key->IndexEntry->Flags & NTFS_INDEX_ENTRY_NODE);
+    ASSERT(Key->LesserChild == NULL);
+
+    if (!Tree->IndexAllocationContext)
+    {
+        DPRINT1("ERROR: Index entry has a sub-node but there's no index allocation!\n");
+        return STATUS_FILE_CORRUPT_ERROR;
+    }
+
+    Key->LesserChild = CreateBTreeNodeFromIndexNode(Tree->Vcb,
+                                                    NULL,
+                                                    Tree->IndexAllocationContext,
+                                                    Key->IndexEntry,
+                                                    FALSE);
+    if (!Key->LesserChild)
+    {
+        DPRINT1("ERROR: Couldn't read child node with VCN %I64u!\n", GetIndexEntryVCN(Key->IndexEntry));
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    return STATUS_SUCCESS;
+}
+
 /**
 * @name NtfsInsertKey
 * @implemented
@@ -1686,6 +1766,8 @@ GetIndexEntryVCN(PINDEX_ENTRY_ATTRIBUTE IndexEntry)
 *
 * @remarks
 * A node is always sorted, with the least comparable filename stored first and a dummy key to mark the end.
+* Child nodes that weren't read yet are read on the way down, so only the nodes on the path to the new key
+* need to be in memory.
 */
 NTSTATUS
 NtfsInsertKey(PB_TREE Tree,
@@ -1742,6 +1824,17 @@ NtfsInsertKey(PB_TREE Tree,
         // Is NewKey < CurrentKey?
         if (Comparison < 0)
         {
+            // Is CurrentKey's sub-node still on the disk only?
+            if ((CurrentKey->IndexEntry->Flags & NTFS_INDEX_ENTRY_NODE) && !CurrentKey->LesserChild)
+            {
+                Status = ReadBTreeChildNode(Tree, CurrentKey);
+                if (!NT_SUCCESS(Status))
+                {
+                    DestroyBTreeKey(NewKey);
+                    return Status;
+                }
+            }
+
             // Does CurrentKey have a sub-node?
             if (CurrentKey->LesserChild)
             {
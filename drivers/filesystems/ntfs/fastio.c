@@ -34,15 +34,26 @@
 
 /* FUNCTIONS ****************************************************************/
 
+/*
+ * The lazy writer and read-ahead only need the file size to stay stable
+ * while they run; the paging I/O they issue takes PagingIoResource itself.
+ */
 BOOLEAN
 NTAPI
 NtfsAcqLazyWrite(PVOID Context,
                  BOOLEAN Wait)
 {
-    UNREFERENCED_PARAMETER(Context);
-    UNREFERENCED_PARAMETER(Wait);
-    UNIMPLEMENTED;
-    return FALSE;
+    PNTFS_FCB Fcb = (PNTFS_FCB)Context;
+
+    ASSERT(Fcb);
+    DPRINT("NtfsAcqLazyWrite(%p, %u)\n", Fcb, Wait);
+
+    if (!ExAcquireResourceSharedLite(&Fcb->MainResource, Wait))
+    {
+        return FALSE;
+    }
+
+    return TRUE;
 }
 
 
@@ -50,8 +61,12 @@ VOID
 NTAPI
 NtfsRelLazyWrite(PVOID Context)
 {
-    UNREFERENCED_PARAMETER(Context);
-    UNIMPLEMENTED;
+    PNTFS_FCB Fcb = (PNTFS_FCB)Context;
+
+    ASSERT(Fcb);
+    DPRINT("NtfsRelLazyWrite(%p)\n", Fcb);
+
+    ExReleaseResourceLite(&Fcb->MainResource);
 }
 
 
@@ -60,10 +75,17 @@ NTAPI
 NtfsAcqReadAhead(PVOID Context,
                  BOOLEAN Wait)
 {
-    UNREFERENCED_PARAMETER(Context);
-    UNREFERENCED_PARAMETER(Wait);
-    UNIMPLEMENTED;
-    return FALSE;
+    PNTFS_FCB Fcb = (PNTFS_FCB)Context;
+
+    ASSERT(Fcb);
+    DPRINT("NtfsAcqReadAhead(%p, %u)\n", Fcb, Wait);
+
+    if (!ExAcquireResourceSharedLite(&Fcb->MainResource, Wait))
+    {
+        return FALSE;
+    }
+
+    return TRUE;
 }
 
 
@@ -71,10 +93,18 @@ VOID
 NTAPI
 NtfsRelReadAhead(PVOID Context)
 {
-    UNREFERENCED_PARAMETER(Context);
-    UNIMPLEMENTED;
+    PNTFS_FCB Fcb = (PNTFS_FCB)Context;
+
+    ASSERT(Fcb);
+    DPRINT("NtfsRelReadAhead(%p)\n", Fcb);
+
+    ExReleaseResourceLite(&Fcb->MainResource);
 }
 
+/*
+ * Called by FsRtlCopyRead() and FsRtlCopyWrite(), with the FCB resource held,
+ * as the FCBs are created with IsFastIoPossible set to FastIoIsQuestionable.
+ */
 BOOLEAN
 NTAPI
 NtfsFastIoCheckIfPossible(
@@ -87,16 +117,37 @@ NtfsFastIoCheckIfPossible(
     _Out_ PIO_STATUS_BLOCK IoStatus,
     _In_ PDEVICE_OBJECT DeviceObject)
 {
-    /* Deny FastIo */
-    UNREFERENCED_PARAMETER(FileObject);
-    UNREFERENCED_PARAMETER(FileOffset);
-    UNREFERENCED_PARAMETER(Length);
+    PNTFS_FCB Fcb = (PNTFS_FCB)FileObject->FsContext;
+
     UNREFERENCED_PARAMETER(Wait);
     UNREFERENCED_PARAMETER(LockKey);
-    UNREFERENCED_PARAMETER(CheckForReadOperation);
     UNREFERENCED_PARAMETER(IoStatus);
     UNREFERENCED_PARAMETER(DeviceObject);
-    return FALSE;
+
+    if (Fcb == NULL ||
+        Fcb->Identifier.Type != NTFS_TYPE_FCB ||
+        (Fcb->Flags & (FCB_IS_VOLUME | FCB_IS_VOLUME_STREAM)) ||
+        NtfsFCBIsDirectory(Fcb) ||
+        NtfsFCBIsCompressed(Fcb))
+    {
+        return FALSE;
+    }
+
+    if (!CheckForReadOperation)
+    {
+        if (!NtfsGlobalData->EnableWriteSupport)
+        {
+            return FALSE;
+        }
+
+        /* Growing the file has to update its record and directory entries, leave it to NtfsWrite() */
+        if (FileOffset->QuadPart + Length > Fcb->RFCB.FileSize.QuadPart)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
 }
 
 BOOLEAN
@@ -111,15 +162,16 @@ NtfsFastIoRead(
     _Out_ PIO_STATUS_BLOCK IoStatus,
     _In_ PDEVICE_OBJECT DeviceObject)
 {
-    DBG_UNREFERENCED_PARAMETER(FileObject);
-    DBG_UNREFERENCED_PARAMETER(FileOffset);
-    DBG_UNREFERENCED_PARAMETER(Length);
-    DBG_UNREFERENCED_PARAMETER(Wait);
-    DBG_UNREFERENCED_PARAMETER(LockKey);
-    DBG_UNREFERENCED_PARAMETER(Buffer);
-    DBG_UNREFERENCED_PARAMETER(IoStatus);
-    DBG_UNREFERENCED_PARAMETER(DeviceObject);
-    return FALSE;
+    DPRINT("NtfsFastIoRead(%p, %I64d, %lu)\n", FileObject, FileOffset->QuadPart, Length);
+
+    return FsRtlCopyRead(FileObject,
+                         FileOffset,
+                         Length,
+                         Wait,
+                         LockKey,
+                         Buffer,
+                         IoStatus,
+                         DeviceObject);
 }
 
 BOOLEAN
@@ -134,15 +186,21 @@ NtfsFastIoWrite(
     _Out_ PIO_STATUS_BLOCK IoStatus,
     _In_ PDEVICE_OBJECT DeviceObject)
 {
-    DBG_UNREFERENCED_PARAMETER(FileObject);
-    DBG_UNREFERENCED_PARAMETER(FileOffset);
-    DBG_UNREFERENCED_PARAMETER(Length);
-    DBG_UNREFERENCED_PARAMETER(Wait);
-    DBG_UNREFERENCED_PARAMETER(LockKey);
-    DBG_UNREFERENCED_PARAMETER(Buffer);
-    DBG_UNREFERENCED_PARAMETER(IoStatus);
-    DBG_UNREFERENCED_PARAMETER(DeviceObject);
-    return FALSE;
+    DPRINT("NtfsFastIoWrite(%p, %I64d, %lu)\n", FileObject, FileOffset->QuadPart, Length);
+
+    if (!NtfsGlobalData->EnableWriteSupport)
+    {
+        return FALSE;
+    }
+
+    return FsRtlCopyWrite(FileObject,
+                          FileOffset,
+                          Length,
+                          Wait,
+                          LockKey,
+                          Buffer,
+                          IoStatus,
+                          DeviceObject);
 }
 
 /* EOF */
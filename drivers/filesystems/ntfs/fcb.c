@@ -103,9 +103,12 @@ NtfsCreateFCB(PCWSTR FileName,
         Fcb->Stream[0] = UNICODE_NULL;
     }
 
+    ExInitializeResourceLite(&Fcb->PagingIoResource);
     ExInitializeResourceLite(&Fcb->MainResource);
 
     Fcb->RFCB.Resource = &(Fcb->MainResource);
+    Fcb->RFCB.PagingIoResource = &(Fcb->PagingIoResource);
+    Fcb->RFCB.IsFastIoPossible = FastIoIsQuestionable;
 
     return Fcb;
 }
@@ -118,6 +121,7 @@ NtfsDestroyFCB(PNTFS_FCB Fcb)
     ASSERT(Fcb->Identifier.Type == NTFS_TYPE_FCB);
 
     ExDeleteResourceLite(&Fcb->MainResource);
+    ExDeleteResourceLite(&Fcb->PagingIoResource);
 
     ExFreeToNPagedLookasideList(&NtfsGlobalData->FcbLookasideList, Fcb);
 }
@@ -2300,11 +2300,13 @@ NtfsAddFilenameToDirectory(PDEVICE_EXTENSION DeviceExt,
         return Status;
     }
 
-    // Convert the index to a B*Tree
+    // Convert the index to a B*Tree. Only the index root is read now, NtfsInsertKey() reads
+    // the index records on the way to where the new key goes, and only those get written back.
     Status = CreateBTreeFromIndex(DeviceExt,
                                   ParentFileRecord,
                                   IndexRootContext,
                                   I30IndexRoot,
+                                  FALSE,
                                   &NewTree);
     if (!NT_SUCCESS(Status))
     {
@@ -2575,7 +2577,7 @@ NtfsAddFilenameToDirectory(PDEVICE_EXTENSION DeviceExt,
 #ifndef NDEBUG
         DPRINT1("Dumping new B-Tree:\n");
 
-        Status = CreateBTreeFromIndex(DeviceExt, ParentFileRecord, IndexRootContext, NewIndexRoot, &NewTree);
+        Status = CreateBTreeFromIndex(DeviceExt, ParentFileRecord, IndexRootContext, NewIndexRoot, TRUE, &NewTree);
         if (!NT_SUCCESS(Status))
         {
             DPRINT1("ERROR: Couldn't re-create b-tree\n");
@@ -449,6 +449,9 @@ typedef struct _B_TREE_FILENAME_NODE
 typedef struct
 {
     PB_TREE_FILENAME_NODE RootNode;
+    // Only set if the child nodes are read as they're needed
+    PDEVICE_EXTENSION Vcb;
+    struct _NTFS_ATTR_CONTEXT* IndexAllocationContext;
 } B_TREE, *PB_TREE;
 
 typedef struct
@@ -749,6 +752,7 @@ CreateBTreeFromIndex(PDEVICE_EXTENSION Vcb,
                      /*PCWSTR IndexName,*/
                      PNTFS_ATTR_CONTEXT IndexRootContext,
                      PINDEX_ROOT_ATTRIBUTE IndexRoot,
+                     BOOLEAN LoadChildren,
                      PB_TREE *NewTree);
 
 NTSTATUS
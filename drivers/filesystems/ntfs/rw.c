@@ -205,12 +205,33 @@ NtfsReadFile(PDEVICE_EXTENSION DeviceExt,
 }
 
 
+/**
+* @name NtfsRead
+* @implemented
+*
+* Handles IRP_MJ_READ I/O Request Packets for NTFS.
+*
+* @param IrpContext
+* Points to an NTFS_IRP_CONTEXT which describes the read
+*
+* @return
+* STATUS_SUCCESS if successful, STATUS_PENDING if the request was queued
+* because it could not wait, STATUS_END_OF_FILE if reading at or beyond the end
+* of the file, or the error returned by the cache manager or NtfsReadFile().
+*
+* @remarks Called by NtfsDispatch() in response to an IRP_MJ_READ request.
+* User reads of files go through the cache manager, paging, non-cached and
+* volume reads go to the disk with NtfsReadFile().
+*
+*/
 NTSTATUS
 NtfsRead(PNTFS_IRP_CONTEXT IrpContext)
 {
+    PNTFS_FCB Fcb;
     PDEVICE_EXTENSION DeviceExt;
     PIO_STACK_LOCATION Stack;
     PFILE_OBJECT FileObject;
+    PERESOURCE Resource;
     PVOID Buffer;
     ULONG ReadLength;
     LARGE_INTEGER ReadOffset;
@@ -218,6 +239,7 @@ NtfsRead(PNTFS_IRP_CONTEXT IrpContext)
     NTSTATUS Status = STATUS_SUCCESS;
     PIRP Irp;
     PDEVICE_OBJECT DeviceObject;
+    BOOLEAN PagingIo, CanWait, Cached;
 
     DPRINT("NtfsRead(IrpContext %p)\n", IrpContext);
 
@@ -225,22 +247,128 @@ NtfsRead(PNTFS_IRP_CONTEXT IrpContext)
     Irp = IrpContext->Irp;
     Stack = IrpContext->Stack;
     FileObject = IrpContext->FileObject;
+    Fcb = (PNTFS_FCB)FileObject->FsContext;
 
     DeviceExt = DeviceObject->DeviceExtension;
     ReadLength = Stack->Parameters.Read.Length;
     ReadOffset = Stack->Parameters.Read.ByteOffset;
-    Buffer = NtfsGetUserBuffer(Irp, BooleanFlagOn(Irp->Flags, IRP_PAGING_IO));
-
-    Status = NtfsReadFile(DeviceExt,
-                          FileObject,
-                          Buffer,
-                          ReadLength,
-                          ReadOffset.u.LowPart,
-                          Irp->Flags,
-                          &ReturnedReadLength);
+
+    PagingIo = BooleanFlagOn(Irp->Flags, IRP_PAGING_IO);
+    CanWait = BooleanFlagOn(IrpContext->Flags, IRPCONTEXT_CANWAIT);
+    Cached = !PagingIo &&
+             !BooleanFlagOn(Irp->Flags, IRP_NOCACHE) &&
+             !BooleanFlagOn(FileObject->Flags, FO_NO_INTERMEDIATE_BUFFERING) &&
+             !BooleanFlagOn(Fcb->Flags, FCB_IS_VOLUME) &&
+             !NtfsFCBIsDirectory(Fcb);
+
+    Irp->IoStatus.Information = 0;
+
+    if (ReadLength == 0)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    // Paging reads only need to keep the file size stable
+    Resource = (PagingIo ? &Fcb->PagingIoResource : &Fcb->MainResource);
+    if (!ExAcquireResourceSharedLite(Resource, CanWait))
+    {
+        // The worker thread can't get to the user buffer unless it is locked
+        Status = NtfsLockUserBuffer(Irp, ReadLength, IoWriteAccess);
+        if (!NT_SUCCESS(Status))
+        {
+            return Status;
+        }
+
+        return NtfsMarkIrpContextForQueue(IrpContext);
+    }
+
+    Buffer = NtfsGetUserBuffer(Irp, PagingIo);
+
+    if (Cached)
+    {
+        if (ReadOffset.QuadPart >= Fcb->RFCB.FileSize.QuadPart)
+        {
+            ExReleaseResourceLite(Resource);
+            return STATUS_END_OF_FILE;
+        }
+
+        if (ReadOffset.QuadPart + ReadLength > Fcb->RFCB.FileSize.QuadPart)
+        {
+            ReadLength = (ULONG)(Fcb->RFCB.FileSize.QuadPart - ReadOffset.QuadPart);
+        }
+
+        _SEH2_TRY
+        {
+            if (FileObject->PrivateCacheMap == NULL)
+            {
+                CcInitializeCacheMap(FileObject,
+                                     (PCC_FILE_SIZES)(&Fcb->RFCB.AllocationSize),
+                                     FALSE,
+                                     &(NtfsGlobalData->CacheMgrCallbacks),
+                                     Fcb);
+            }
+
+            if (!CcCopyRead(FileObject,
+                            &ReadOffset,
+                            ReadLength,
+                            CanWait,
+                            Buffer,
+                            &Irp->IoStatus))
+            {
+                ASSERT(!CanWait);
+                Status = STATUS_PENDING;
+            }
+            else
+            {
+                Status = Irp->IoStatus.Status;
+                ReturnedReadLength = (ULONG)Irp->IoStatus.Information;
+            }
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            Status = _SEH2_GetExceptionCode();
+        }
+        _SEH2_END;
+
+        if (Status == STATUS_PENDING)
+        {
+            // Some of the data wasn't in the cache, retry where we can wait for it
+            ExReleaseResourceLite(Resource);
+            Irp->IoStatus.Information = 0;
+
+            Status = NtfsLockUserBuffer(Irp, ReadLength, IoWriteAccess);
+            if (!NT_SUCCESS(Status))
+            {
+                return Status;
+            }
+
+            return NtfsMarkIrpContextForQueue(IrpContext);
+        }
+    }
+    else
+    {
+        // Don't read stale data from the disk if the cache has newer one
+        if (!PagingIo && FileObject->SectionObjectPointer->DataSectionObject != NULL)
+        {
+            IO_STATUS_BLOCK IoStatus;
+
+            CcFlushCache(FileObject->SectionObjectPointer, &ReadOffset, ReadLength, &IoStatus);
+        }
+
+        Status = NtfsReadFile(DeviceExt,
+                              FileObject,
+                              Buffer,
+                              ReadLength,
+                              ReadOffset.u.LowPart,
+                              Irp->Flags,
+                              &ReturnedReadLength);
+    }
+
+    ExReleaseResourceLite(Resource);
+
     if (NT_SUCCESS(Status))
     {
-        if (FileObject->Flags & FO_SYNCHRONOUS_IO)
+        if ((FileObject->Flags & FO_SYNCHRONOUS_IO) && !PagingIo)
         {
             FileObject->CurrentByteOffset.QuadPart =
                 ReadOffset.QuadPart + ReturnedReadLength;
@@ -417,6 +545,23 @@ NTSTATUS NtfsWriteFile(PDEVICE_EXTENSION DeviceExt,
 
     DPRINT("WriteOffset: %lu\tStreamSize: %I64u\n", WriteOffset, StreamSize);
 
+    // Paging writes are rounded up to whole sectors, which may go past the
+    // end of the data but never past the clusters the stream has
+    if ((IrpFlags & IRP_PAGING_IO) &&
+        (WriteOffset + Length > StreamSize) &&
+        (WriteOffset < StreamSize))
+    {
+        if (!DataContext->pRecord->IsNonResident)
+        {
+            // Resident data has no sectors of its own
+            Length = (ULONG)(StreamSize - WriteOffset);
+        }
+        else if (WriteOffset + Length <= AttributeAllocatedLength(DataContext->pRecord))
+        {
+            StreamSize = WriteOffset + Length;
+        }
+    }
+
     // Are we trying to write beyond the end of the stream?
     if (WriteOffset + Length > StreamSize)
     {
@@ -517,13 +662,15 @@ NTSTATUS NtfsWriteFile(PDEVICE_EXTENSION DeviceExt,
 *
 * @return
 * STATUS_SUCCESS if successful,
+* STATUS_PENDING if the request was queued because it could not wait,
 * STATUS_INSUFFICIENT_RESOURCES if an allocation failed,
 * STATUS_INVALID_DEVICE_REQUEST if called on the main device object,
 * STATUS_NOT_IMPLEMENTED or STATUS_ACCESS_DENIED if a required feature isn't implemented.
 * STATUS_PARTIAL_COPY, STATUS_UNSUCCESSFUL, or STATUS_OBJECT_NAME_NOT_FOUND if NtfsWriteFile() fails.
 *
 * @remarks Called by NtfsDispatch() in response to an IRP_MJ_WRITE request. Page files are not implemented.
-* Support for large files (>4gb) is not implemented. Cached writes, file locks, transactions, etc - not implemented.
+* Support for large files (>4gb) is not implemented. User writes of files go through the cache manager,
+* which writes them back later with paging writes. File locks, transactions, etc - not implemented.
 *
 */
 NTSTATUS
@@ -541,6 +688,7 @@ NtfsWrite(PNTFS_IRP_CONTEXT IrpContext)
     PFILE_OBJECT FileObject = NULL;
     PIRP Irp = NULL;
     ULONG BytesPerSector;
+    BOOLEAN PagingIo, CanWait, Cached;
 
     DPRINT("NtfsWrite(IrpContext %p)\n", IrpContext);
     ASSERT(IrpContext);
@@ -570,6 +718,13 @@ NtfsWrite(PNTFS_IRP_CONTEXT IrpContext)
     DeviceExt = DeviceObject->DeviceExtension;
     BytesPerSector = DeviceExt->StorageDevice->SectorSize;
     Length = IrpContext->Stack->Parameters.Write.Length;
+    PagingIo = BooleanFlagOn(Irp->Flags, IRP_PAGING_IO);
+    CanWait = BooleanFlagOn(IrpContext->Flags, IRPCONTEXT_CANWAIT);
+    Cached = !PagingIo &&
+             !BooleanFlagOn(Irp->Flags, IRP_NOCACHE) &&
+             !BooleanFlagOn(FileObject->Flags, FO_NO_INTERMEDIATE_BUFFERING) &&
+             !BooleanFlagOn(Fcb->Flags, FCB_IS_VOLUME) &&
+             !NtfsFCBIsDirectory(Fcb);
 
     // get the file offset we'll be writing to
     ByteOffset = IrpContext->Stack->Parameters.Write.ByteOffset;
@@ -590,8 +745,7 @@ NtfsWrite(PNTFS_IRP_CONTEXT IrpContext)
     }
 
     // Is this a non-cached write? A non-buffered write?
-    if (IrpContext->Irp->Flags & (IRP_PAGING_IO | IRP_NOCACHE) || (Fcb->Flags & FCB_IS_VOLUME) ||
-        IrpContext->FileObject->Flags & FILE_NO_INTERMEDIATE_BUFFERING)
+    if (!Cached)
     {
         // non-cached and non-buffered writes must be sector aligned
         if (ByteOffset.u.LowPart % BytesPerSector != 0 || Length % BytesPerSector != 0)
@@ -622,7 +776,7 @@ NtfsWrite(PNTFS_IRP_CONTEXT IrpContext)
     {
         Resource = &DeviceExt->DirResource;
     }
-    else if (IrpContext->Irp->Flags & IRP_PAGING_IO)
+    else if (PagingIo)
     {
         Resource = &Fcb->PagingIoResource;
     }
@@ -632,9 +786,16 @@ NtfsWrite(PNTFS_IRP_CONTEXT IrpContext)
     }
 
     // acquire exclusive access to the Resource
-    if (!ExAcquireResourceExclusiveLite(Resource, BooleanFlagOn(IrpContext->Flags, IRPCONTEXT_CANWAIT)))
+    if (!ExAcquireResourceExclusiveLite(Resource, CanWait))
     {
-        return STATUS_CANT_WAIT;
+        // Retry in a worker thread, which needs the user buffer locked
+        Status = NtfsLockUserBuffer(Irp, Length, IoReadAccess);
+        if (!NT_SUCCESS(Status))
+        {
+            return Status;
+        }
+
+        return NtfsMarkIrpContextForQueue(IrpContext);
     }
 
     /* From VfatWrite(). Todo: Handle file locks
@@ -648,17 +809,8 @@ NtfsWrite(PNTFS_IRP_CONTEXT IrpContext)
     }
     }*/
 
-    // Is this an async request to a file?
-    if (!(IrpContext->Flags & IRPCONTEXT_CANWAIT) && !(Fcb->Flags & FCB_IS_VOLUME))
-    {
-        DPRINT1("FIXME: Async writes not supported in NTFS!\n");
-
-        ExReleaseResourceLite(Resource);
-        return STATUS_NOT_IMPLEMENTED;
-    }
-
     // get the buffer of data the user is trying to write
-    Buffer = NtfsGetUserBuffer(Irp, BooleanFlagOn(Irp->Flags, IRP_PAGING_IO));
+    Buffer = NtfsGetUserBuffer(Irp, PagingIo);
     ASSERT(Buffer);
 
     // lock the buffer
@@ -678,15 +830,117 @@ NtfsWrite(PNTFS_IRP_CONTEXT IrpContext)
 
     // TODO: handle HighPart of ByteOffset (large files)
 
-    // write the file
-    Status = NtfsWriteFile(DeviceExt,
-                           FileObject,
-                           Buffer,
-                           Length,
-                           ByteOffset.LowPart,
-                           Irp->Flags,
-                           BooleanFlagOn(IrpContext->Stack->Flags, SL_CASE_SENSITIVE),
-                           &ReturnedWriteLength);
+    if (Cached)
+    {
+        LARGE_INTEGER OldFileSize, NewFileSize;
+
+        // The file must be grown on disk before the cache manager can hold the new data
+        OldFileSize = Fcb->RFCB.FileSize;
+        NewFileSize.QuadPart = ByteOffset.QuadPart + Length;
+        if (NewFileSize.QuadPart > OldFileSize.QuadPart)
+        {
+            // Growing the file writes its record and index entries, which blocks
+            if (!CanWait)
+            {
+                ExReleaseResourceLite(Resource);
+                Irp->IoStatus.Information = 0;
+                return NtfsMarkIrpContextForQueue(IrpContext);
+            }
+
+            ExAcquireResourceExclusiveLite(&Fcb->PagingIoResource, TRUE);
+            Status = NtfsSetEndOfFile(Fcb,
+                                      FileObject,
+                                      DeviceExt,
+                                      Irp->Flags,
+                                      BooleanFlagOn(IrpContext->Stack->Flags, SL_CASE_SENSITIVE),
+                                      &NewFileSize);
+            ExReleaseResourceLite(&Fcb->PagingIoResource);
+        }
+
+        if (NT_SUCCESS(Status))
+        {
+            _SEH2_TRY
+            {
+                if (FileObject->PrivateCacheMap == NULL)
+                {
+                    CcInitializeCacheMap(FileObject,
+                                         (PCC_FILE_SIZES)(&Fcb->RFCB.AllocationSize),
+                                         FALSE,
+                                         &(NtfsGlobalData->CacheMgrCallbacks),
+                                         Fcb);
+                }
+
+                // Don't leave whatever was on the disk in a hole left by the write
+                if (ByteOffset.QuadPart > OldFileSize.QuadPart)
+                {
+                    CcZeroData(FileObject, &OldFileSize, &ByteOffset, TRUE);
+                }
+
+                if (!CcCopyWrite(FileObject, &ByteOffset, Length, CanWait, Buffer))
+                {
+                    ASSERT(!CanWait);
+                    Status = STATUS_PENDING;
+                }
+                else
+                {
+                    ReturnedWriteLength = Length;
+                }
+            }
+            _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+            {
+                Status = _SEH2_GetExceptionCode();
+            }
+            _SEH2_END;
+
+            if (Status == STATUS_PENDING)
+            {
+                // Some pages weren't in the cache, retry where we can wait for them
+                ExReleaseResourceLite(Resource);
+                Irp->IoStatus.Information = 0;
+                return NtfsMarkIrpContextForQueue(IrpContext);
+            }
+        }
+    }
+    else
+    {
+        if (PagingIo)
+        {
+            // The cache manager writes whole pages, don't let it grow the file.
+            // Still write whole sectors, so that the last one isn't read back
+            // and merged first; the rest of it is past the end of the data.
+            if (ByteOffset.QuadPart >= Fcb->RFCB.FileSize.QuadPart)
+            {
+                Length = 0;
+            }
+            else if (ByteOffset.QuadPart + Length > Fcb->RFCB.FileSize.QuadPart)
+            {
+                Length = min(Length,
+                             ROUND_UP((ULONG)(Fcb->RFCB.FileSize.QuadPart - ByteOffset.QuadPart),
+                                      BytesPerSector));
+            }
+        }
+        else if (FileObject->SectionObjectPointer->DataSectionObject != NULL)
+        {
+            IO_STATUS_BLOCK IoStatus;
+
+            // Write back what the cache has there, and forget it once it is overwritten
+            CcFlushCache(FileObject->SectionObjectPointer, &ByteOffset, Length, &IoStatus);
+            CcPurgeCacheSection(FileObject->SectionObjectPointer, &ByteOffset, Length, FALSE);
+        }
+
+        // write the file
+        if (Length != 0)
+        {
+            Status = NtfsWriteFile(DeviceExt,
+                                   FileObject,
+                                   Buffer,
+                                   Length,
+                                   ByteOffset.LowPart,
+                                   Irp->Flags,
+                                   BooleanFlagOn(IrpContext->Stack->Flags, SL_CASE_SENSITIVE),
+                                   &ReturnedWriteLength);
+        }
+    }
 
     IrpContext->Irp->IoStatus.Status = Status;
 
@@ -695,7 +949,7 @@ NtfsWrite(PNTFS_IRP_CONTEXT IrpContext)
     {
         // TODO: Update timestamps
 
-        if (FileObject->Flags & FO_SYNCHRONOUS_IO)
+        if ((FileObject->Flags & FO_SYNCHRONOUS_IO) && !PagingIo)
         {
             // advance the file pointer
             FileObject->CurrentByteOffset.QuadPart = ByteOffset.QuadPart + ReturnedWriteLength;
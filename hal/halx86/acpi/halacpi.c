@@ -23,6 +23,7 @@ BOOLEAN HalpPhysicalMemoryMayAppearAbove4GB;
 FADT HalpFixedAcpiDescTable;
 PDEBUG_PORT_TABLE HalpDebugPortTable;
 PACPI_SRAT HalpAcpiSrat;
+PACPI_SLIT HalpAcpiSlit;
 PBOOT_TABLE HalpSimpleBootFlagTable;
 
 PHYSICAL_ADDRESS HalpMaxHotPlugMemoryAddress;
@@ -33,6 +34,14 @@ PVOID HalpLowStub;
 
 PACPI_BIOS_MULTI_NODE HalpAcpiMultiNode;
 
+ULONG HalpNumaNodeCount;
+ULONG HalpNumaNodeDomain[MAXIMUM_NUMA_NODES];
+UCHAR HalpNumaNodeDistance[MAXIMUM_NUMA_NODES][MAXIMUM_NUMA_NODES];
+HALP_NUMA_MEMORY_RANGE HalpNumaMemoryRanges[HALP_MAX_NUMA_MEMORY_RANGES];
+ULONG HalpNumaMemoryRangeCount;
+HALP_NUMA_PROCESSOR HalpNumaProcessors[MAXIMUM_PROCESSORS];
+ULONG HalpNumaProcessorCount;
+
 LIST_ENTRY HalpAcpiTableMatchList;
 
 ULONG HalpInvalidAcpiTable;
@@ -470,16 +479,304 @@ HalAcpiGetTable(IN PLOADER_PARAMETER_BLOCK LoaderBlock,
     return TableHeader;
 }
 
+UCHAR
+NTAPI
+HalpNumaDomainToNode(IN ULONG Domain)
+{
+    ULONG Node;
+
+    /* Look for a node already describing this proximity domain */
+    for (Node = 0; Node < HalpNumaNodeCount; Node++)
+    {
+        if (HalpNumaNodeDomain[Node] == Domain) return (UCHAR)Node;
+    }
+
+    /* Hand out the next node number, folding the excess into the last one */
+    if (HalpNumaNodeCount == MAXIMUM_NUMA_NODES)
+    {
+        DPRINT1("HAL: Too many proximity domains, merging domain %lu\n", Domain);
+        return MAXIMUM_NUMA_NODES - 1;
+    }
+    HalpNumaNodeDomain[HalpNumaNodeCount] = Domain;
+    return (UCHAR)HalpNumaNodeCount++;
+}
+
+PHALP_NUMA_PROCESSOR
+NTAPI
+HalpNumaFindProcessor(IN ULONG ApicId,
+                      IN ULONG Count)
+{
+    ULONG i;
+
+    /* Look in the first Count processors for this APIC ID */
+    for (i = 0; i < Count; i++)
+    {
+        if (HalpNumaProcessors[i].ApicId == ApicId) return &HalpNumaProcessors[i];
+    }
+
+    /* Not found */
+    return NULL;
+}
+
+VOID
+NTAPI
+HalpNumaOrderProcessors(IN PLOADER_PARAMETER_BLOCK LoaderBlock)
+{
+    PACPI_MADT Madt;
+    PACPI_MADT_ENTRY Entry;
+    PUCHAR Current, End;
+    PHALP_NUMA_PROCESSOR Processor;
+    HALP_NUMA_PROCESSOR Swap;
+    ULONG ApicId, Ordered;
+    INT CpuInfo[4];
+
+    /* The boot processor is always processor 0 */
+    Ordered = 0;
+    __cpuid(CpuInfo, 1);
+    ApicId = (ULONG)CpuInfo[1] >> 24;
+    Processor = HalpNumaFindProcessor(ApicId, HalpNumaProcessorCount);
+    if (Processor)
+    {
+        Swap = HalpNumaProcessors[Ordered];
+        HalpNumaProcessors[Ordered] = *Processor;
+        *Processor = Swap;
+        Ordered++;
+    }
+
+    /* The others are numbered in the order the MADT lists them */
+    Madt = HalAcpiGetTable(LoaderBlock, APIC_SIGNATURE);
+    if (!Madt) return;
+
+    Current = (PUCHAR)(Madt + 1);
+    End = (PUCHAR)Madt + Madt->Header.Length;
+    while ((Current + sizeof(ACPI_MADT_ENTRY)) <= End)
+    {
+        Entry = (PACPI_MADT_ENTRY)Current;
+        if ((Entry->Length < sizeof(ACPI_MADT_ENTRY)) || ((Current + Entry->Length) > End)) break;
+
+        /* Pick up the APIC ID of enabled processors */
+        ApicId = MAXULONG;
+        if ((Entry->Type == MADT_LOCAL_APIC) &&
+            (Entry->Length >= sizeof(ACPI_MADT_PROCESSOR_APIC)) &&
+            (((PACPI_MADT_PROCESSOR_APIC)Entry)->Flags & MADT_PROCESSOR_ENABLED))
+        {
+            ApicId = ((PACPI_MADT_PROCESSOR_APIC)Entry)->ApicId;
+        }
+        else if ((Entry->Type == MADT_LOCAL_X2APIC) &&
+                 (Entry->Length >= sizeof(ACPI_MADT_PROCESSOR_X2APIC)) &&
+                 (((PACPI_MADT_PROCESSOR_X2APIC)Entry)->Flags & MADT_PROCESSOR_ENABLED))
+        {
+            ApicId = ((PACPI_MADT_PROCESSOR_X2APIC)Entry)->X2ApicId;
+        }
+
+        /* Move it right behind the ones already numbered */
+        if (ApicId != MAXULONG)
+        {
+            Processor = HalpNumaFindProcessor(ApicId, HalpNumaProcessorCount);
+            if ((Processor) && (Processor >= &HalpNumaProcessors[Ordered]))
+            {
+                Swap = HalpNumaProcessors[Ordered];
+                HalpNumaProcessors[Ordered] = *Processor;
+                *Processor = Swap;
+                Ordered++;
+            }
+        }
+
+        Current += Entry->Length;
+    }
+}
+
 VOID
 NTAPI
 HalpNumaInitializeStaticConfiguration(IN PLOADER_PARAMETER_BLOCK LoaderBlock)
 {
     PACPI_SRAT SratTable;
+    PACPI_SLIT SlitTable;
+    PACPI_SRAT_ENTRY Entry;
+    PACPI_SRAT_PROCESSOR ProcessorAffinity;
+    PACPI_SRAT_X2APIC X2ApicAffinity;
+    PACPI_SRAT_MEMORY MemoryAffinity;
+    PHALP_NUMA_MEMORY_RANGE Range;
+    PUCHAR Current, End;
+    ULONG i, j, Domain, ApicId;
+    ULONGLONG Localities;
 
     /* Get the SRAT, bail out if it doesn't exist */
     SratTable = HalAcpiGetTable(LoaderBlock, SRAT_SIGNATURE);
     HalpAcpiSrat = SratTable;
     if (!SratTable) return;
+
+    /* Collect the enabled processors and their proximity domains */
+    Current = (PUCHAR)(SratTable + 1);
+    End = (PUCHAR)SratTable + SratTable->Header.Length;
+    while ((Current + sizeof(ACPI_SRAT_ENTRY)) <= End)
+    {
+        Entry = (PACPI_SRAT_ENTRY)Current;
+        if ((Entry->Length < sizeof(ACPI_SRAT_ENTRY)) || ((Current + Entry->Length) > End)) break;
+
+        ApicId = MAXULONG;
+        Domain = 0;
+        if ((Entry->Type == SRAT_PROCESSOR_AFFINITY) &&
+            (Entry->Length >= sizeof(ACPI_SRAT_PROCESSOR)))
+        {
+            ProcessorAffinity = (PACPI_SRAT_PROCESSOR)Entry;
+            if (ProcessorAffinity->Flags & SRAT_AFFINITY_ENABLED)
+            {
+                /* The high bits of the domain only exist since SRAT revision 2 */
+                ApicId = ProcessorAffinity->ApicId;
+                Domain = ProcessorAffinity->ProximityDomainLow;
+                if (SratTable->Header.Revision >= 2)
+                {
+                    Domain |= (ProcessorAffinity->ProximityDomainHigh[0] << 8) |
+                              (ProcessorAffinity->ProximityDomainHigh[1] << 16) |
+                              (ProcessorAffinity->ProximityDomainHigh[2] << 24);
+                }
+            }
+        }
+        else if ((Entry->Type == SRAT_X2APIC_AFFINITY) &&
+                 (Entry->Length >= sizeof(ACPI_SRAT_X2APIC)))
+        {
+            X2ApicAffinity = (PACPI_SRAT_X2APIC)Entry;
+            if (X2ApicAffinity->Flags & SRAT_AFFINITY_ENABLED)
+            {
+                ApicId = X2ApicAffinity->X2ApicId;
+                Domain = X2ApicAffinity->ProximityDomain;
+            }
+        }
+
+        /* Remember it, once */
+        if ((ApicId != MAXULONG) &&
+            (HalpNumaProcessorCount < MAXIMUM_PROCESSORS) &&
+            !(HalpNumaFindProcessor(ApicId, HalpNumaProcessorCount)))
+        {
+            HalpNumaProcessors[HalpNumaProcessorCount].ApicId = ApicId;
+            HalpNumaProcessors[HalpNumaProcessorCount].Domain = Domain;
+            HalpNumaProcessorCount++;
+        }
+
+        Current += Entry->Length;
+    }
+
+    /* Number the processors like the kernel will, so the boot processor is on node 0 */
+    HalpNumaOrderProcessors(LoaderBlock);
+    for (i = 0; i < HalpNumaProcessorCount; i++)
+    {
+        HalpNumaProcessors[i].Node = HalpNumaDomainToNode(HalpNumaProcessors[i].Domain);
+    }
+
+    /* Now collect the memory ranges, which may add memory-only nodes */
+    Current = (PUCHAR)(SratTable + 1);
+    while ((Current + sizeof(ACPI_SRAT_ENTRY)) <= End)
+    {
+        Entry = (PACPI_SRAT_ENTRY)Current;
+        if ((Entry->Length < sizeof(ACPI_SRAT_ENTRY)) || ((Current + Entry->Length) > End)) break;
+
+        if ((Entry->Type == SRAT_MEMORY_AFFINITY) &&
+            (Entry->Length >= sizeof(ACPI_SRAT_MEMORY)))
+        {
+            MemoryAffinity = (PACPI_SRAT_MEMORY)Entry;
+            if ((MemoryAffinity->Flags & SRAT_AFFINITY_ENABLED) && (MemoryAffinity->Length))
+            {
+                Domain = MemoryAffinity->ProximityDomain;
+                if (SratTable->Header.Revision < 2) Domain &= 0xFF;
+
+                if (HalpNumaMemoryRangeCount < HALP_MAX_NUMA_MEMORY_RANGES)
+                {
+                    Range = &HalpNumaMemoryRanges[HalpNumaMemoryRangeCount++];
+                    Range->BasePage = (PFN_NUMBER)(MemoryAffinity->Base >> PAGE_SHIFT);
+                    Range->EndPage = (PFN_NUMBER)((MemoryAffinity->Base +
+                                                   MemoryAffinity->Length) >> PAGE_SHIFT);
+                    Range->Node = HalpNumaDomainToNode(Domain);
+                }
+                else
+                {
+                    DPRINT1("HAL: Too many SRAT memory ranges, ignoring %I64x\n",
+                            MemoryAffinity->Base);
+                }
+            }
+        }
+
+        Current += Entry->Length;
+    }
+
+    /* Use the SLIT distances if they cover every domain, or assume remote is twice as far */
+    SlitTable = HalAcpiGetTable(LoaderBlock, SLIT_SIGNATURE);
+    HalpAcpiSlit = SlitTable;
+    Localities = 0;
+    if (SlitTable)
+    {
+        Localities = SlitTable->NumberOfLocalities;
+        if ((Localities > 0xFF) ||
+            ((FIELD_OFFSET(ACPI_SLIT, Entry) + Localities * Localities) > SlitTable->Header.Length))
+        {
+            DPRINT1("HAL: Ignoring invalid SLIT with %I64u localities\n", Localities);
+            Localities = 0;
+        }
+    }
+
+    for (i = 0; i < HalpNumaNodeCount; i++)
+    {
+        for (j = 0; j < HalpNumaNodeCount; j++)
+        {
+            if ((HalpNumaNodeDomain[i] < Localities) && (HalpNumaNodeDomain[j] < Localities))
+            {
+                HalpNumaNodeDistance[i][j] =
+                    SlitTable->Entry[HalpNumaNodeDomain[i] * Localities + HalpNumaNodeDomain[j]];
+            }
+            else
+            {
+                HalpNumaNodeDistance[i][j] = (i == j) ? 10 : 20;
+            }
+        }
+    }
+
+    DPRINT1("HAL: SRAT describes %lu node(s), %lu processor(s), %lu memory range(s)\n",
+            HalpNumaNodeCount, HalpNumaProcessorCount, HalpNumaMemoryRangeCount);
+}
+
+ULONG
+NTAPI
+HalpNumaPageToNode(IN ULONG_PTR PhysicalPageNumber)
+{
+    ULONG i;
+
+    /* Find the SRAT range containing this page */
+    for (i = 0; i < HalpNumaMemoryRangeCount; i++)
+    {
+        if ((PhysicalPageNumber >= HalpNumaMemoryRanges[i].BasePage) &&
+            (PhysicalPageNumber < HalpNumaMemoryRanges[i].EndPage))
+        {
+            return HalpNumaMemoryRanges[i].Node;
+        }
+    }
+
+    /* Memory the SRAT doesn't describe belongs to the first node */
+    return 0;
+}
+
+NTSTATUS
+NTAPI
+HalpNumaQueryProcessorNode(IN ULONG ProcessorNumber,
+                           OUT PUSHORT Identifier,
+                           OUT PUCHAR Node)
+{
+    /* Make sure the SRAT knows about this processor */
+    if (ProcessorNumber >= HalpNumaProcessorCount) return STATUS_NOT_FOUND;
+
+    /* Return its APIC ID and node */
+    *Identifier = (USHORT)HalpNumaProcessors[ProcessorNumber].ApicId;
+    *Node = HalpNumaProcessors[ProcessorNumber].Node;
+    return STATUS_SUCCESS;
+}
+
+UCHAR
+NTAPI
+HalpNumaQueryNodeDistance(IN UCHAR FromNode,
+                          IN UCHAR ToNode)
+{
+    /* Unknown nodes are as far as they can be */
+    if ((FromNode >= HalpNumaNodeCount) || (ToNode >= HalpNumaNodeCount)) return 0xFF;
+    return HalpNumaNodeDistance[FromNode][ToNode];
 }
 
 VOID
@@ -830,9 +1127,9 @@ HalpSetupAcpiPhase0(IN PLOADER_PARAMETER_BLOCK LoaderBlock)
 
     /* Initialize hotplug through the SRAT */
     HalpDynamicSystemResourceConfiguration(LoaderBlock);
-    if (HalpAcpiSrat)
+    if ((HalpAcpiSrat) && (HalpNumaNodeCount <= 1))
     {
-        DPRINT1("Your machine has a SRAT, but NUMA/HotPlug are not supported!\n");
+        DPRINT1("Your machine has a SRAT, but HotPlug is not supported!\n");
     }
 
     /* Can there be memory higher than 4GB? */
@@ -955,6 +1252,21 @@ HalpGetDebugPortTable(VOID)
             (HalpDebugPortTable->BaseAddress.AddressSpaceID == 1));
 }
 
+NTSTATUS
+NTAPI
+HalpGetNumaTopology(OUT PHAL_NUMA_TOPOLOGY_INTERFACE NumaTopology)
+{
+    /* A single node is no NUMA at all */
+    if (HalpNumaNodeCount <= 1) return STATUS_NOT_SUPPORTED;
+
+    /* Hand out the topology built from the SRAT */
+    NumaTopology->NumberOfNodes = HalpNumaNodeCount;
+    NumaTopology->QueryProcessorNode = HalpNumaQueryProcessorNode;
+    NumaTopology->PageToNode = HalpNumaPageToNode;
+    NumaTopology->QueryNodeDistance = HalpNumaQueryNodeDistance;
+    return STATUS_SUCCESS;
+}
+
 CODE_SEG("INIT")
 ULONG
 NTAPI
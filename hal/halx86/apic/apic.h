@@ -9,6 +9,7 @@
 #define DISPATCH_VECTOR      0x41 // IRQL 02
 #define APIC_GENERIC_VECTOR  0xC1 // IRQL 27
 #define APIC_CLOCK_VECTOR    0xD1 // IRQL 28
+#define APIC_WAKE_VECTOR     0xD2 // IRQL 28
 #define APIC_SYNCH_VECTOR    0xD1 // IRQL 28
 #define APIC_IPI_VECTOR      0xE1 // IRQL 29
 #define APIC_ERROR_VECTOR    0xE3
@@ -27,6 +28,7 @@
 #define DISPATCH_VECTOR      0x41 // IRQL 02
 #define APIC_GENERIC_VECTOR  0xC1 // IRQL 27
 #define APIC_CLOCK_VECTOR    0xD1 // IRQL 28
+#define APIC_WAKE_VECTOR     0xD2 // IRQL 28
 #define APIC_SYNCH_VECTOR    0xD1 // IRQL 28
 #define APIC_IPI_VECTOR      0xE1 // IRQL 29
 #define APIC_ERROR_VECTOR    0xE3
@@ -278,9 +280,21 @@ VOID
 NTAPI
 ApicInitializeTimer(ULONG Cpu);
 
+VOID
+NTAPI
+ApicCalibrateTimer(VOID);
+
+VOID
+NTAPI
+ApicSetOneShotTimer(ULONG Count);
+
+extern BOOLEAN HalIsProfiling;
+extern ULONG64 HalpApicTimerFrequency;
+
 VOID
 NTAPI
 HalInitializeProfiling(VOID);
 
 VOID __cdecl ApicSpuriousService(VOID);
+VOID __cdecl HalpWakeInterrupt(VOID);
 
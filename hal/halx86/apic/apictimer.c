@@ -22,6 +22,9 @@ ULONGLONG HalCurProfileInterval = 10000000;
 ULONGLONG HalMinProfileInterval = 1000;
 ULONGLONG HalMaxProfileInterval = 10000000;
 
+/* Local APIC timer ticks per second, with a divider of 1 */
+ULONG64 HalpApicTimerFrequency;
+
 /* TIMER FUNCTIONS ************************************************************/
 
 VOID
@@ -46,6 +49,52 @@ ApicSetTimerInterval(ULONG MicroSeconds)
 
 }
 
+VOID
+NTAPI
+ApicSetOneShotTimer(ULONG Count)
+{
+    LVT_REGISTER LvtEntry;
+
+    /* Set to one-shot on the wake vector */
+    LvtEntry.Long = 0;
+    LvtEntry.TimerMode = 0;
+    LvtEntry.Vector = APIC_WAKE_VECTOR;
+    LvtEntry.Mask = 0;
+    ApicWrite(APIC_TMRLVTR, LvtEntry.Long);
+
+    /* Writing the count starts it, a count of 0 stops it */
+    ApicWrite(APIC_TICR, Count);
+}
+
+VOID
+NTAPI
+ApicCalibrateTimer(VOID)
+{
+    LVT_REGISTER LvtEntry;
+    ULONG64 StartTime, Duration;
+    ULONG Elapsed;
+
+    /* Mask the timer and set clock multiplier to 1 */
+    LvtEntry.Long = 0;
+    LvtEntry.Vector = APIC_WAKE_VECTOR;
+    LvtEntry.Mask = 1;
+    ApicWrite(APIC_TMRLVTR, LvtEntry.Long);
+    ApicWrite(APIC_TDCR, TIMER_DV_DivideBy1);
+
+    /* Count down for 10 ms, measured with the already calibrated TSC */
+    Duration = HalpCpuClockFrequency.QuadPart / 100;
+    ApicWrite(APIC_TICR, MAXULONG);
+    StartTime = __rdtsc();
+    while ((__rdtsc() - StartTime) < Duration) YieldProcessor();
+    Elapsed = MAXULONG - ApicRead(APIC_TCCR);
+
+    /* Stop it again */
+    ApicWrite(APIC_TICR, 0);
+
+    HalpApicTimerFrequency = (ULONG64)Elapsed * 100;
+    DPRINT1("APIC timer frequency: %I64u Hz\n", HalpApicTimerFrequency);
+}
+
 VOID
 NTAPI
 ApicInitializeTimer(ULONG Cpu)
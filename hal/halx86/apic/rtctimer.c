@@ -15,6 +15,9 @@
 #define NDEBUG
 #include <debug.h>
 
+#include "apic.h"
+#include "tsc.h"
+
 /* GLOBALS ********************************************************************/
 
 const UCHAR HalpClockVector = 0xD1;
@@ -25,6 +28,10 @@ ULONG HalpCurrentTimeIncrement;
 static UCHAR RtcMinimumClockRate = 8;  /* Minimum rate  8: 256 Hz / 3.9 ms */
 static UCHAR RtcMaximumClockRate = 12; /* Maximum rate 12: 16 Hz / 62.5 ms */
 
+/* Dynamic tick: the periodic interrupt is off while the processor idles */
+static BOOLEAN HalpClockStopped;
+static ULONG64 HalpLastClockTsc;
+
 /*!
     \brief Converts the CMOS RTC rate into the time increment in 100ns intervals.
 
@@ -115,6 +122,9 @@ HalpInitializeClock(VOID)
     /* Set initial rate */
     RtcSetClockRate(HalpCurrentRate);
 
+    /* Calibrate the local APIC timer, used to wake up from a dynamic tick idle */
+    ApicCalibrateTimer();
+
     /* Restore interrupt state */
     __writeeflags(EFlags);
 
@@ -150,6 +160,9 @@ HalpClockInterruptHandler(IN PKTRAP_FRAME TrapFrame)
     /* Read register C, so that the next interrupt can happen */
     HalpReadCmos(RTC_REGISTER_C);
 
+    /* Remember when this tick happened, for the dynamic tick */
+    HalpLastClockTsc = __rdtsc();
+
     /* Save increment */
     LastIncrement = HalpCurrentTimeIncrement;
 
@@ -167,6 +180,128 @@ HalpClockInterruptHandler(IN PKTRAP_FRAME TrapFrame)
     KeUpdateSystemTime(TrapFrame, LastIncrement, Irql);
 }
 
+VOID
+FASTCALL
+HalpWakeInterruptHandler(IN PKTRAP_FRAME TrapFrame)
+{
+    ULONG64 TscPerTick, Ticks;
+    ULONG Increment = 0;
+    UCHAR RegisterB;
+    KIRQL Irql;
+
+    /* Enter trap */
+    KiEnterInterruptTrap(TrapFrame);
+
+    /* Start the interrupt */
+    if (!HalBeginSystemInterrupt(CLOCK_LEVEL, APIC_WAKE_VECTOR, &Irql))
+    {
+        /* Spurious, just end the interrupt */
+        KiEoiHelper(TrapFrame);
+    }
+
+    /* This can be a late one-shot, after the clock was already restarted */
+    if (HalpClockStopped)
+    {
+        /* Account for the whole clock periods that went by */
+        TscPerTick = HalpCpuClockFrequency.QuadPart * HalpCurrentTimeIncrement / 10000000;
+        Ticks = (__rdtsc() - HalpLastClockTsc) / TscPerTick;
+        HalpLastClockTsc += Ticks * TscPerTick;
+        Increment = (ULONG)Ticks * HalpCurrentTimeIncrement;
+
+        /* Stop the one-shot timer */
+        ApicSetOneShotTimer(0);
+
+        /* Acquire CMOS lock */
+        HalpAcquireCmosSpinLock();
+
+        /*
+         * Drop the periodic flag that was raised while we slept and enable
+         * the interrupt again. The RTC kept counting, so the next tick
+         * arrives in phase with the ones we just accounted for.
+         */
+        HalpReadCmos(RTC_REGISTER_C);
+        RegisterB = HalpReadCmos(RTC_REGISTER_B);
+        HalpWriteCmos(RTC_REGISTER_B, RegisterB | RTC_REG_B_PI);
+
+        /* Release CMOS lock */
+        HalpReleaseCmosSpinLock();
+
+        HalpClockStopped = FALSE;
+    }
+
+    /* Update the system time -- on x86 the kernel will exit this trap  */
+    KeUpdateSystemTime(TrapFrame, Increment, Irql);
+}
+
+BOOLEAN
+NTAPI
+HalpStopClockTick(IN ULONG64 Interval)
+{
+    ULONG64 TscPerTick, Ticks, WakeTsc, CurrentTsc, Count;
+    UCHAR RegisterB;
+
+    /* The local APIC timer is shared with profiling, and rate changes are done on a tick */
+    if (HalIsProfiling || HalpClockSetMSRate) return FALSE;
+
+    /* The kernel wants the clock tick that brings the interrupt time past the interval */
+    Ticks = (Interval + HalpCurrentTimeIncrement - 1) / HalpCurrentTimeIncrement;
+    if (Ticks < 2) return FALSE;
+
+    /*
+     * Wake up half a period before that tick. The wake interrupt accounts
+     * for the ticks before it, and the RTC delivers the due one as usual.
+     */
+    TscPerTick = HalpCpuClockFrequency.QuadPart * HalpCurrentTimeIncrement / 10000000;
+    WakeTsc = HalpLastClockTsc + (Ticks - 1) * TscPerTick + TscPerTick / 2;
+    CurrentTsc = __rdtsc();
+    if (WakeTsc <= CurrentTsc) return FALSE;
+
+    /* Convert to local APIC timer counts */
+    Count = (WakeTsc - CurrentTsc) * HalpApicTimerFrequency / HalpCpuClockFrequency.QuadPart;
+    if (!Count) return FALSE;
+    if (Count > MAXULONG) Count = MAXULONG;
+
+    /* Acquire CMOS lock */
+    HalpAcquireCmosSpinLock();
+
+    /* Disable the periodic interrupt, the RTC keeps counting periods */
+    RegisterB = HalpReadCmos(RTC_REGISTER_B);
+    HalpWriteCmos(RTC_REGISTER_B, RegisterB & ~RTC_REG_B_PI);
+
+    /* Release CMOS lock */
+    HalpReleaseCmosSpinLock();
+
+    /* Start the one-shot timer */
+    HalpClockStopped = TRUE;
+    ApicSetOneShotTimer((ULONG)Count);
+    return TRUE;
+}
+
+VOID
+NTAPI
+HalpRestartClockTick(VOID)
+{
+    /* Fire the wake interrupt right away if something else woke us up */
+    if (HalpClockStopped) ApicSetOneShotTimer(1);
+}
+
+NTSTATUS
+NTAPI
+HalpGetDynamicTickInterface(OUT PHAL_DYNAMIC_TICK_INTERFACE DynamicTick)
+{
+    /* Check if it was disabled, or the local APIC timer doesn't work */
+    if (HalpDynamicTickDisabled || !HalpApicTimerFrequency)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    /* The one-shot timer counts down from at most MAXULONG */
+    DynamicTick->MaximumInterval = (ULONG64)MAXULONG * 10000000 / HalpApicTimerFrequency;
+    DynamicTick->StopClockTick = HalpStopClockTick;
+    DynamicTick->RestartClockTick = HalpRestartClockTick;
+    return STATUS_SUCCESS;
+}
+
 VOID
 FASTCALL
 HalpProfileInterruptHandler(IN PKTRAP_FRAME TrapFrame)
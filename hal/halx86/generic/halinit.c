@@ -15,6 +15,7 @@
 /* GLOBALS *******************************************************************/
 
 BOOLEAN HalpPciLockSettings;
+BOOLEAN HalpDynamicTickDisabled;
 
 /* PRIVATE FUNCTIONS *********************************************************/
 
@@ -34,6 +35,9 @@ HalpGetParameters(IN PLOADER_PARAMETER_BLOCK LoaderBlock)
         /* Check if PCI is locked */
         if (strstr(CommandLine, "PCILOCK")) HalpPciLockSettings = TRUE;
 
+        /* Check if idle processors must keep the periodic clock tick */
+        if (strstr(CommandLine, "DISABLEDYNAMICTICK")) HalpDynamicTickDisabled = TRUE;
+
         /* Check for initial breakpoint */
         if (strstr(CommandLine, "BREAK")) DbgBreakPoint();
     }
@@ -75,7 +75,15 @@ HaliQuerySystemInformation(IN HAL_QUERY_INFORMATION_CLASS InformationClass,
 		}
 		REPORT_THIS_CASE(HalDisplayBiosInformation);
 		REPORT_THIS_CASE(HalProcessorFeatureInformation);
-		REPORT_THIS_CASE(HalNumaTopologyInterface);
+		case HalNumaTopologyInterface:
+		{
+			if (BufferSize < sizeof(HAL_NUMA_TOPOLOGY_INTERFACE))
+				return STATUS_INFO_LENGTH_MISMATCH;
+
+			/* Only ACPI HALs know about NUMA, through the SRAT */
+			*ReturnedLength = sizeof(HAL_NUMA_TOPOLOGY_INTERFACE);
+			return HalpGetNumaTopology(Buffer);
+		}
 		REPORT_THIS_CASE(HalErrorInformation);
 		REPORT_THIS_CASE(HalCmcLogInformation);
 		REPORT_THIS_CASE(HalCpeLogInformation);
@@ -106,6 +114,15 @@ HaliQuerySystemInformation(IN HAL_QUERY_INFORMATION_CLASS InformationClass,
 		REPORT_THIS_CASE(HalHypervisorInformation);
 		REPORT_THIS_CASE(HalPlatformTimerInformation);
 		REPORT_THIS_CASE(HalAcpiAuditInformation);
+		case HalDynamicTickInterface:
+		{
+			if (BufferSize < sizeof(HAL_DYNAMIC_TICK_INTERFACE))
+				return STATUS_INFO_LENGTH_MISMATCH;
+
+			/* Only the APIC HALs have a one-shot timer */
+			*ReturnedLength = sizeof(HAL_DYNAMIC_TICK_INTERFACE);
+			return HalpGetDynamicTickInterface(Buffer);
+		}
 	}
 #undef REPORT_THIS_CASE
 
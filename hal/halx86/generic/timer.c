@@ -202,6 +202,14 @@ HalpProfileInterruptHandler(IN PKTRAP_FRAME TrapFrame)
 
 #endif /* _M_IX86 */
 
+NTSTATUS
+NTAPI
+HalpGetDynamicTickInterface(OUT PHAL_DYNAMIC_TICK_INTERFACE DynamicTick)
+{
+    /* The PIT has no one-shot timer to wake up an idle processor */
+    return STATUS_NOT_SUPPORTED;
+}
+
 /* PUBLIC FUNCTIONS ***********************************************************/
 
 /*
@@ -11,6 +11,25 @@ typedef struct _ACPI_CACHED_TABLE
     // ...
 } ACPI_CACHED_TABLE, *PACPI_CACHED_TABLE;
 
+//
+// NUMA topology built from the SRAT and SLIT
+//
+#define HALP_MAX_NUMA_MEMORY_RANGES     64
+
+typedef struct _HALP_NUMA_MEMORY_RANGE
+{
+    PFN_NUMBER BasePage;
+    PFN_NUMBER EndPage;
+    UCHAR Node;
+} HALP_NUMA_MEMORY_RANGE, *PHALP_NUMA_MEMORY_RANGE;
+
+typedef struct _HALP_NUMA_PROCESSOR
+{
+    ULONG ApicId;
+    ULONG Domain;
+    UCHAR Node;
+} HALP_NUMA_PROCESSOR, *PHALP_NUMA_PROCESSOR;
+
 NTSTATUS
 NTAPI
 HalpAcpiTableCacheInit(
@@ -220,6 +220,8 @@ extern BOOLEAN HalpProfilingStopped;
 VOID NTAPI HalpInitializeClock(VOID);
 VOID __cdecl HalpClockInterrupt(VOID);
 VOID __cdecl HalpProfileInterrupt(VOID);
+NTSTATUS NTAPI HalpGetDynamicTickInterface(OUT PHAL_DYNAMIC_TICK_INTERFACE DynamicTick);
+extern BOOLEAN HalpDynamicTickDisabled;
 
 typedef struct _HALP_ROLLOVER
 {
@@ -441,6 +443,12 @@ HalpGetDebugPortTable(
     VOID
 );
 
+NTSTATUS
+NTAPI
+HalpGetNumaTopology(
+    OUT PHAL_NUMA_TOPOLOGY_INTERFACE NumaTopology
+);
+
 VOID
 NTAPI
 HalpReportSerialNumber(
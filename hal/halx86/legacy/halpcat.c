@@ -59,6 +59,14 @@ HalpGetDebugPortTable(VOID)
     return FALSE;
 }
 
+NTSTATUS
+NTAPI
+HalpGetNumaTopology(OUT PHAL_NUMA_TOPOLOGY_INTERFACE NumaTopology)
+{
+    /* No ACPI, so no SRAT either */
+    return STATUS_NOT_SUPPORTED;
+}
+
 CODE_SEG("INIT")
 ULONG
 NTAPI
@@ -42,6 +42,13 @@ HalpSetupAcpiPhase0(IN PLOADER_PARAMETER_BLOCK LoaderBlock)
     return STATUS_SUCCESS;
 }
 
+NTSTATUS
+NTAPI
+HalpGetNumaTopology(OUT PHAL_NUMA_TOPOLOGY_INTERFACE NumaTopology)
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
 VOID
 NTAPI
 HalpInitializePICs(IN BOOLEAN EnableInterrupts)
@@ -0,0 +1,322 @@
+/*
+ * PROJECT:     ReactOS pool monitor
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Shows the pool tags using the most memory, live
+ */
+
+#define WIN32_NO_STATUS
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <conio.h>
+
+#define NTOS_MODE_USER
+#include <ndk/ntndk.h>
+
+#define DEFAULT_INTERVAL    1000
+#define DEFAULT_LINES       20
+
+/* One tag, with its counters and how they moved since the previous sample */
+typedef struct _TAG_STATS
+{
+    SYSTEM_POOLTAG Current;
+    ULONG AllocRate;
+    ULONG FreeRate;
+    LONGLONG UsedDelta;
+} TAG_STATS, *PTAG_STATS;
+
+/* Big pool allocations summed up per tag */
+typedef struct _BIG_TAG_STATS
+{
+    ULONG TagUlong;
+    ULONG Count;
+    SIZE_T Bytes;
+} BIG_TAG_STATS, *PBIG_TAG_STATS;
+
+static ULONG Interval = DEFAULT_INTERVAL;
+static ULONG Lines = DEFAULT_LINES;
+static BOOL ShowBigPool = FALSE;
+static BOOL Once = FALSE;
+
+static
+PVOID
+QueryInformation(
+    _In_ SYSTEM_INFORMATION_CLASS InformationClass,
+    _Inout_ PULONG BufferSize)
+{
+    NTSTATUS Status;
+    PVOID Buffer;
+    ULONG Length;
+
+    /* The tables can grow between calls, so keep asking until it fits */
+    for (;;)
+    {
+        Buffer = HeapAlloc(GetProcessHeap(), 0, *BufferSize);
+        if (!Buffer)
+            return NULL;
+
+        Status = NtQuerySystemInformation(InformationClass, Buffer, *BufferSize, &Length);
+        if (NT_SUCCESS(Status))
+            return Buffer;
+
+        HeapFree(GetProcessHeap(), 0, Buffer);
+        if (Status != STATUS_INFO_LENGTH_MISMATCH)
+        {
+            fprintf(stderr, "NtQuerySystemInformation(%d) failed: 0x%08lx\n", InformationClass, Status);
+            return NULL;
+        }
+        *BufferSize = max(Length, *BufferSize) + 4096;
+    }
+}
+
+static
+int
+__cdecl
+CompareTagKey(
+    _In_ const void *First,
+    _In_ const void *Second)
+{
+    ULONG FirstTag = ((const SYSTEM_POOLTAG *)First)->TagUlong;
+    ULONG SecondTag = ((const SYSTEM_POOLTAG *)Second)->TagUlong;
+
+    return (FirstTag > SecondTag) - (FirstTag < SecondTag);
+}
+
+static
+int
+__cdecl
+CompareTagUsage(
+    _In_ const void *First,
+    _In_ const void *Second)
+{
+    const SYSTEM_POOLTAG *FirstTag = &((const TAG_STATS *)First)->Current;
+    const SYSTEM_POOLTAG *SecondTag = &((const TAG_STATS *)Second)->Current;
+    SIZE_T FirstUsed = FirstTag->PagedUsed + FirstTag->NonPagedUsed;
+    SIZE_T SecondUsed = SecondTag->PagedUsed + SecondTag->NonPagedUsed;
+
+    return (FirstUsed < SecondUsed) - (FirstUsed > SecondUsed);
+}
+
+static
+int
+__cdecl
+CompareBigTagUsage(
+    _In_ const void *First,
+    _In_ const void *Second)
+{
+    SIZE_T FirstBytes = ((const BIG_TAG_STATS *)First)->Bytes;
+    SIZE_T SecondBytes = ((const BIG_TAG_STATS *)Second)->Bytes;
+
+    return (FirstBytes < SecondBytes) - (FirstBytes > SecondBytes);
+}
+
+static
+VOID
+PrintTag(
+    _In_ ULONG TagUlong)
+{
+    UCHAR Tag[4];
+    ULONG i;
+
+    RtlCopyMemory(Tag, &TagUlong, sizeof(Tag));
+    for (i = 0; i < 4; i++)
+        putchar((Tag[i] >= ' ' && Tag[i] <= '~') ? Tag[i] : '.');
+}
+
+static
+VOID
+PrintBigPool(VOID)
+{
+    static ULONG BufferSize = 64 * 1024;
+    PSYSTEM_BIGPOOL_INFORMATION BigPool;
+    PBIG_TAG_STATS Tags;
+    ULONG i, j, TagCount = 0;
+    SIZE_T Total = 0, NonPaged = 0;
+
+    BigPool = QueryInformation(SystemBigPoolInformation, &BufferSize);
+    if (!BigPool)
+        return;
+
+    Tags = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, max(BigPool->Count, 1) * sizeof(*Tags));
+    if (!Tags)
+    {
+        HeapFree(GetProcessHeap(), 0, BigPool);
+        return;
+    }
+
+    /* Sum up the allocations of every tag */
+    for (i = 0; i < BigPool->Count; i++)
+    {
+        PSYSTEM_BIGPOOL_ENTRY Entry = &BigPool->AllocatedInfo[i];
+
+        Total += Entry->SizeInBytes;
+        if (Entry->NonPaged)
+            NonPaged += Entry->SizeInBytes;
+
+        for (j = 0; j < TagCount; j++)
+        {
+            if (Tags[j].TagUlong == Entry->TagUlong)
+                break;
+        }
+        if (j == TagCount)
+            Tags[TagCount++].TagUlong = Entry->TagUlong;
+        Tags[j].Count++;
+        Tags[j].Bytes += Entry->SizeInBytes;
+    }
+    qsort(Tags, TagCount, sizeof(*Tags), CompareBigTagUsage);
+
+    printf("\nBig pool: %lu allocations, %Iu KB (%Iu KB nonpaged)\n",
+           BigPool->Count, Total / 1024, NonPaged / 1024);
+    printf(" Tag  Allocs       Bytes\n");
+    for (i = 0; i < min(TagCount, Lines / 2); i++)
+    {
+        putchar(' ');
+        PrintTag(Tags[i].TagUlong);
+        printf(" %6lu %11Iu\n", Tags[i].Count, Tags[i].Bytes);
+    }
+
+    HeapFree(GetProcessHeap(), 0, Tags);
+    HeapFree(GetProcessHeap(), 0, BigPool);
+}
+
+static
+VOID
+ClearScreen(VOID)
+{
+    HANDLE Console = GetStdHandle(STD_OUTPUT_HANDLE);
+    CONSOLE_SCREEN_BUFFER_INFO Info;
+    COORD Origin = { 0, 0 };
+    DWORD Written;
+
+    if (!GetConsoleScreenBufferInfo(Console, &Info))
+        return;
+
+    FillConsoleOutputCharacterA(Console, ' ', Info.dwSize.X * Info.dwSize.Y, Origin, &Written);
+    SetConsoleCursorPosition(Console, Origin);
+}
+
+static
+VOID
+Usage(VOID)
+{
+    printf("Usage: poolmon [-b] [-i interval] [-n lines] [-o]\n"
+           "  -b           Also show big pool allocations\n"
+           "  -i interval  Refresh interval in milliseconds (default %u)\n"
+           "  -n lines     Number of tags to show (default %u)\n"
+           "  -o           Print one sample and exit\n"
+           "Press q or Esc to quit.\n",
+           DEFAULT_INTERVAL, DEFAULT_LINES);
+}
+
+int
+main(int argc, char *argv[])
+{
+    ULONG BufferSize = 64 * 1024;
+    PSYSTEM_POOLTAG_INFORMATION Previous = NULL, Current;
+    PTAG_STATS Stats;
+    PSYSTEM_POOLTAG Old;
+    DWORD LastTick = 0, Now, Elapsed;
+    ULONG i;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (!strcmp(argv[Arg], "-b"))
+            ShowBigPool = TRUE;
+        else if (!strcmp(argv[Arg], "-o"))
+            Once = TRUE;
+        else if (!strcmp(argv[Arg], "-i") && Arg + 1 < argc)
+            Interval = max(strtoul(argv[++Arg], NULL, 0), 100);
+        else if (!strcmp(argv[Arg], "-n") && Arg + 1 < argc)
+            Lines = max(strtoul(argv[++Arg], NULL, 0), 1);
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+
+    for (;;)
+    {
+        Current = QueryInformation(SystemPoolTagInformation, &BufferSize);
+        if (!Current)
+            return 1;
+        Now = GetTickCount();
+        Elapsed = Previous ? max(Now - LastTick, 1) : 0;
+
+        /* Sort by tag, so that the next sample can find the previous counters */
+        qsort(Current->TagInfo, Current->Count, sizeof(SYSTEM_POOLTAG), CompareTagKey);
+
+        Stats = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, max(Current->Count, 1) * sizeof(*Stats));
+        if (!Stats)
+            return 1;
+
+        /* The kernel only keeps running totals, the rates come from the deltas */
+        for (i = 0; i < Current->Count; i++)
+        {
+            Stats[i].Current = Current->TagInfo[i];
+            if (!Elapsed)
+                continue;
+
+            Old = bsearch(&Current->TagInfo[i], Previous->TagInfo, Previous->Count,
+                          sizeof(SYSTEM_POOLTAG), CompareTagKey);
+            if (!Old)
+                continue;
+
+            Stats[i].AllocRate = (ULONG)((ULONGLONG)(Current->TagInfo[i].PagedAllocs + Current->TagInfo[i].NonPagedAllocs -
+                                                     Old->PagedAllocs - Old->NonPagedAllocs) * 1000 / Elapsed);
+            Stats[i].FreeRate = (ULONG)((ULONGLONG)(Current->TagInfo[i].PagedFrees + Current->TagInfo[i].NonPagedFrees -
+                                                    Old->PagedFrees - Old->NonPagedFrees) * 1000 / Elapsed);
+            Stats[i].UsedDelta = (LONGLONG)(Current->TagInfo[i].PagedUsed + Current->TagInfo[i].NonPagedUsed) -
+                                 (LONGLONG)(Old->PagedUsed + Old->NonPagedUsed);
+        }
+        qsort(Stats, Current->Count, sizeof(*Stats), CompareTagUsage);
+
+        if (!Once)
+            ClearScreen();
+        printf("%lu tags, refreshed every %lu ms\n\n", Current->Count, Interval);
+        printf(" Tag   Paged Bytes NonPaged Bytes  Allocs/s   Frees/s      Diff   Delta Bytes\n");
+        for (i = 0; i < min(Current->Count, Lines); i++)
+        {
+            PSYSTEM_POOLTAG Tag = &Stats[i].Current;
+
+            putchar(' ');
+            PrintTag(Tag->TagUlong);
+            printf(" %13Iu %14Iu %9lu %9lu %9ld %+13I64d\n",
+                   Tag->PagedUsed, Tag->NonPagedUsed,
+                   Stats[i].AllocRate, Stats[i].FreeRate,
+                   (LONG)(Tag->PagedAllocs + Tag->NonPagedAllocs - Tag->PagedFrees - Tag->NonPagedFrees),
+                   Stats[i].UsedDelta);
+        }
+
+        if (ShowBigPool)
+            PrintBigPool();
+
+        HeapFree(GetProcessHeap(), 0, Stats);
+        if (Previous)
+            HeapFree(GetProcessHeap(), 0, Previous);
+        Previous = Current;
+        LastTick = Now;
+
+        if (Once)
+            break;
+
+        /* Wait for the next sample, unless asked to quit */
+        for (Elapsed = 0; Elapsed < Interval; Elapsed += 50)
+        {
+            if (_kbhit())
+            {
+                int Key = _getch();
+                if (Key == 'q' || Key == 'Q' || Key == 27)
+                {
+                    HeapFree(GetProcessHeap(), 0, Previous);
+                    return 0;
+                }
+            }
+            Sleep(50);
+        }
+    }
+
+    HeapFree(GetProcessHeap(), 0, Previous);
+    return 0;
+}
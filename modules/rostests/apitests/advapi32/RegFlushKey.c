@@ -0,0 +1,179 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test and benchmark for RegFlushKey
+ */
+
+#include "precomp.h"
+
+#define STORM_KEYS      64
+#define STORM_VALUES    32
+#define STORM_ROUNDS    8
+
+static const WCHAR StormKeyName[] = L"Software\\ReactOS-RegFlushKey-apitest";
+
+/* Change values all over the hive, then flush: this leaves many small dirty runs */
+static
+BOOL
+MutateHive(
+    _In_ HKEY hKey,
+    _In_ DWORD Round)
+{
+    WCHAR Name[32];
+    BYTE Data[200];
+    HKEY hSubKey;
+    DWORD i, j;
+    LONG Error;
+
+    for (i = 0; i < STORM_KEYS; i++)
+    {
+        StringCbPrintfW(Name, sizeof(Name), L"Key%lu", i);
+        Error = RegCreateKeyExW(hKey, Name, 0, NULL, 0, KEY_SET_VALUE, NULL, &hSubKey, NULL);
+        if (Error != ERROR_SUCCESS)
+        {
+            ok(FALSE, "RegCreateKeyExW failed: %ld\n", Error);
+            return FALSE;
+        }
+
+        for (j = 0; j < STORM_VALUES; j++)
+        {
+            StringCbPrintfW(Name, sizeof(Name), L"Value%lu", j);
+            FillMemory(Data, sizeof(Data), (BYTE)(Round + i + j));
+            /* Vary the size so that cells get reallocated as well */
+            Error = RegSetValueExW(hSubKey, Name, 0, REG_BINARY, Data, 16 + ((Round * 7 + i + j) % 8) * 23);
+            if (Error != ERROR_SUCCESS)
+            {
+                ok(FALSE, "RegSetValueExW failed: %ld\n", Error);
+                RegCloseKey(hSubKey);
+                return FALSE;
+            }
+        }
+
+        RegCloseKey(hSubKey);
+    }
+
+    return TRUE;
+}
+
+/* Everything written before the flush must read back the same after it */
+static
+VOID
+VerifyHive(
+    _In_ HKEY hKey,
+    _In_ DWORD Round)
+{
+    WCHAR Name[32];
+    BYTE Data[200];
+    HKEY hSubKey;
+    DWORD i, j, k, Type, Size, Expected, Wrong = 0;
+    LONG Error;
+
+    for (i = 0; i < STORM_KEYS; i++)
+    {
+        StringCbPrintfW(Name, sizeof(Name), L"Key%lu", i);
+        Error = RegOpenKeyExW(hKey, Name, 0, KEY_QUERY_VALUE, &hSubKey);
+        if (Error != ERROR_SUCCESS)
+        {
+            ok(FALSE, "RegOpenKeyExW(%S) failed: %ld\n", Name, Error);
+            return;
+        }
+
+        for (j = 0; j < STORM_VALUES; j++)
+        {
+            StringCbPrintfW(Name, sizeof(Name), L"Value%lu", j);
+            Expected = 16 + ((Round * 7 + i + j) % 8) * 23;
+            Size = sizeof(Data);
+            Error = RegQueryValueExW(hSubKey, Name, NULL, &Type, Data, &Size);
+            if (Error != ERROR_SUCCESS || Type != REG_BINARY || Size != Expected)
+            {
+                Wrong++;
+                continue;
+            }
+
+            for (k = 0; k < Size; k++)
+            {
+                if (Data[k] != (BYTE)(Round + i + j))
+                {
+                    Wrong++;
+                    break;
+                }
+            }
+        }
+
+        RegCloseKey(hSubKey);
+    }
+
+    ok(Wrong == 0, "Round %lu: %lu values are wrong after the flush\n", Round, Wrong);
+}
+
+START_TEST(RegFlushKey)
+{
+    IO_COUNTERS Before, After;
+    LARGE_INTEGER Frequency, Start, End;
+    ULONGLONG WriteCalls = 0, WriteBytes = 0, FlushTime = 0;
+    HKEY hKey;
+    LONG Error;
+    DWORD Round;
+
+    Error = RegFlushKey(NULL);
+    ok_long(Error, ERROR_INVALID_HANDLE);
+
+    Error = RegCreateKeyExW(HKEY_CURRENT_USER, StormKeyName, 0, NULL, 0, KEY_ALL_ACCESS, NULL, &hKey, NULL);
+    ok_long(Error, ERROR_SUCCESS);
+    if (Error != ERROR_SUCCESS)
+    {
+        skip("Unable to create the test key\n");
+        return;
+    }
+
+    /* Start from a clean hive */
+    Error = RegFlushKey(hKey);
+    ok_long(Error, ERROR_SUCCESS);
+
+    QueryPerformanceFrequency(&Frequency);
+
+    for (Round = 0; Round < STORM_ROUNDS; Round++)
+    {
+        if (!MutateHive(hKey, Round))
+            break;
+
+        ok(GetProcessIoCounters(GetCurrentProcess(), &Before), "GetProcessIoCounters failed\n");
+        QueryPerformanceCounter(&Start);
+        Error = RegFlushKey(hKey);
+        QueryPerformanceCounter(&End);
+        ok(GetProcessIoCounters(GetCurrentProcess(), &After), "GetProcessIoCounters failed\n");
+        ok_long(Error, ERROR_SUCCESS);
+
+        WriteCalls += After.WriteOperationCount - Before.WriteOperationCount;
+        WriteBytes += After.WriteTransferCount - Before.WriteTransferCount;
+        FlushTime += End.QuadPart - Start.QuadPart;
+
+        VerifyHive(hKey, Round);
+
+        /* Nothing changed since, so there is nothing left to write */
+        ok(GetProcessIoCounters(GetCurrentProcess(), &Before), "GetProcessIoCounters failed\n");
+        Error = RegFlushKey(hKey);
+        ok(GetProcessIoCounters(GetCurrentProcess(), &After), "GetProcessIoCounters failed\n");
+        ok_long(Error, ERROR_SUCCESS);
+        ok(After.WriteOperationCount == Before.WriteOperationCount,
+           "Round %lu: flushing a clean hive wrote %I64u times\n",
+           Round, After.WriteOperationCount - Before.WriteOperationCount);
+    }
+    ok(Round == STORM_ROUNDS, "Only %lu rounds done\n", Round);
+
+    trace("%lu flushes: %I64u writes, %I64u bytes, %I64u us\n",
+          Round, WriteCalls, WriteBytes,
+          Frequency.QuadPart ? FlushTime * 1000000 / Frequency.QuadPart : 0);
+
+    for (Round = 0; Round < STORM_KEYS; Round++)
+    {
+        WCHAR Name[32];
+
+        StringCbPrintfW(Name, sizeof(Name), L"Key%lu", Round);
+        Error = RegDeleteKeyW(hKey, Name);
+        ok_long(Error, ERROR_SUCCESS);
+    }
+    RegCloseKey(hKey);
+    Error = RegDeleteKeyW(HKEY_CURRENT_USER, StormKeyName);
+    ok_long(Error, ERROR_SUCCESS);
+}
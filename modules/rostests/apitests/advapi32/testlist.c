@@ -12,6 +12,7 @@ extern void func_LockServiceDatabase(void);
 extern void func_QueryServiceConfig2(void);
 extern void func_RegEnumKey(void);
 extern void func_RegEnumValueW(void);
+extern void func_RegFlushKey(void);
 extern void func_RegOpenKeyExW(void);
 extern void func_RegQueryInfoKey(void);
 extern void func_RegQueryValueExW(void);
@@ -32,6 +33,7 @@ const struct test winetest_testlist[] =
     { "QueryServiceConfig2", func_QueryServiceConfig2 },
     { "RegEnumKey", func_RegEnumKey },
     { "RegEnumValueW", func_RegEnumValueW },
+    { "RegFlushKey", func_RegFlushKey },
     { "RegQueryInfoKey", func_RegQueryInfoKey },
     { "RegOpenKeyExW", func_RegOpenKeyExW },
     { "RegQueryValueExW", func_RegQueryValueExW },
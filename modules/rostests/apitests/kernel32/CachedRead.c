@@ -0,0 +1,243 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Tests and benchmark for repeated reads of a cached file
+ */
+
+#include "precomp.h"
+
+/* Not a page multiple, so that the last page is only partly in the file */
+#define FILE_SIZE               (16 * 1024 * 1024 + 1000)
+#define CHUNK_SIZE              (64 * 1024)
+#define RANDOM_READS            8192
+#define PASSES                  4
+
+static WCHAR g_FileName[MAX_PATH];
+static PUCHAR g_Buffer;
+
+static
+UCHAR
+Pattern(
+    _In_ ULONG Offset)
+{
+    return (UCHAR)(Offset / 512 + Offset % 251);
+}
+
+static
+BOOL
+CreateTestFile(VOID)
+{
+    DWORD Offset, Size, Written, i;
+    HANDLE File;
+
+    /* The driver may have been built or set up without write support */
+    File = CreateFileW(g_FileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        skip("Cannot create %S (%lu)\n", g_FileName, GetLastError());
+        return FALSE;
+    }
+
+    for (Offset = 0; Offset < FILE_SIZE; Offset += Size)
+    {
+        Size = min(CHUNK_SIZE, FILE_SIZE - Offset);
+        for (i = 0; i < Size; i++)
+            g_Buffer[i] = Pattern(Offset + i);
+
+        if (!WriteFile(File, g_Buffer, Size, &Written, NULL) || Written != Size)
+        {
+            ok(0, "WriteFile failed at %lu with %lu\n", Offset, GetLastError());
+            CloseHandle(File);
+            return FALSE;
+        }
+    }
+
+    CloseHandle(File);
+    return TRUE;
+}
+
+static
+VOID
+TestCoherency(VOID)
+{
+    HANDLE Cached, Uncached;
+    DWORD Done, i;
+
+    Cached = CreateFileW(g_FileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                         NULL, OPEN_EXISTING, 0, NULL);
+    ok(Cached != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    Uncached = CreateFileW(g_FileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                           NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
+    ok(Uncached != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (Cached == INVALID_HANDLE_VALUE || Uncached == INVALID_HANDLE_VALUE)
+    {
+        if (Cached != INVALID_HANDLE_VALUE) CloseHandle(Cached);
+        if (Uncached != INVALID_HANDLE_VALUE) CloseHandle(Uncached);
+        return;
+    }
+
+    /* Unaligned cached reads, twice so that the second one comes from the cache */
+    for (i = 0; i < 2; i++)
+    {
+        SetFilePointer(Cached, 4097, NULL, FILE_BEGIN);
+        ok(ReadFile(Cached, g_Buffer, 1000, &Done, NULL), "ReadFile failed with %lu\n", GetLastError());
+        ok(Done == 1000, "Read %lu bytes\n", Done);
+        ok(g_Buffer[0] == Pattern(4097) && g_Buffer[999] == Pattern(4097 + 999),
+           "Wrong data: %u %u\n", g_Buffer[0], g_Buffer[999]);
+    }
+
+    /* Reading across the end only returns what is there */
+    SetFilePointer(Cached, FILE_SIZE - 100, NULL, FILE_BEGIN);
+    ok(ReadFile(Cached, g_Buffer, 1000, &Done, NULL), "ReadFile failed with %lu\n", GetLastError());
+    ok(Done == 100, "Read %lu bytes\n", Done);
+    ok(g_Buffer[0] == Pattern(FILE_SIZE - 100) && g_Buffer[99] == Pattern(FILE_SIZE - 1),
+       "Wrong data: %u %u\n", g_Buffer[0], g_Buffer[99]);
+    ok(ReadFile(Cached, g_Buffer, 1000, &Done, NULL), "ReadFile failed with %lu\n", GetLastError());
+    ok(Done == 0, "Read %lu bytes past the end\n", Done);
+
+    /* A cached write must be seen by a non-cached read */
+    memset(g_Buffer, 0xa5, 4096);
+    SetFilePointer(Cached, 8192, NULL, FILE_BEGIN);
+    ok(WriteFile(Cached, g_Buffer, 4096, &Done, NULL), "WriteFile failed with %lu\n", GetLastError());
+    memset(g_Buffer, 0, 4096);
+    SetFilePointer(Uncached, 8192, NULL, FILE_BEGIN);
+    ok(ReadFile(Uncached, g_Buffer, 4096, &Done, NULL), "ReadFile failed with %lu\n", GetLastError());
+    ok(g_Buffer[0] == 0xa5 && g_Buffer[4095] == 0xa5, "Wrong data: %u %u\n", g_Buffer[0], g_Buffer[4095]);
+
+    /* And the other way around */
+    memset(g_Buffer, 0x3c, 4096);
+    SetFilePointer(Uncached, 8192, NULL, FILE_BEGIN);
+    ok(WriteFile(Uncached, g_Buffer, 4096, &Done, NULL), "WriteFile failed with %lu\n", GetLastError());
+    memset(g_Buffer, 0, 4096);
+    SetFilePointer(Cached, 8192, NULL, FILE_BEGIN);
+    ok(ReadFile(Cached, g_Buffer, 4096, &Done, NULL), "ReadFile failed with %lu\n", GetLastError());
+    ok(g_Buffer[0] == 0x3c && g_Buffer[4095] == 0x3c, "Wrong data: %u %u\n", g_Buffer[0], g_Buffer[4095]);
+
+    /* Put the pattern back for the benchmark */
+    for (i = 0; i < 4096; i++)
+        g_Buffer[i] = Pattern(8192 + i);
+    SetFilePointer(Cached, 8192, NULL, FILE_BEGIN);
+    ok(WriteFile(Cached, g_Buffer, 4096, &Done, NULL), "WriteFile failed with %lu\n", GetLastError());
+
+    CloseHandle(Uncached);
+    CloseHandle(Cached);
+}
+
+static
+VOID
+BenchmarkRead(
+    _In_ BOOL Random,
+    _In_ DWORD Flags)
+{
+    LARGE_INTEGER Frequency, Start, Now;
+    DWORD Offset, Size, Done, Seed, Pass, i;
+    ULONGLONG Bytes;
+    BOOL Match = TRUE;
+    HANDLE File;
+
+    File = CreateFileW(g_FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, Flags, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+        return;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    /* The first pass fills the cache, the next ones should be served from it */
+    for (Pass = 0; Pass < PASSES; Pass++)
+    {
+        QueryPerformanceCounter(&Start);
+        Bytes = 0;
+
+        if (Random)
+        {
+            for (i = 0, Seed = 1; i < RANDOM_READS; i++)
+            {
+                Seed = Seed * 1103515245 + 12345;
+                Offset = (Seed >> 8) % (FILE_SIZE / 4096) * 4096;
+                SetFilePointer(File, Offset, NULL, FILE_BEGIN);
+                if (!ReadFile(File, g_Buffer, 4096, &Done, NULL) || Done != 4096)
+                {
+                    ok(0, "ReadFile failed at %lu with %lu\n", Offset, GetLastError());
+                    break;
+                }
+                Match = Match && g_Buffer[4095] == Pattern(Offset + 4095);
+                Bytes += Done;
+            }
+        }
+        else
+        {
+            SetFilePointer(File, 0, NULL, FILE_BEGIN);
+            for (Offset = 0; Offset < FILE_SIZE; Offset += CHUNK_SIZE)
+            {
+                /* The last read stops at the end of the file, even without buffering */
+                Size = min(CHUNK_SIZE, FILE_SIZE - Offset);
+                if (!ReadFile(File, g_Buffer, CHUNK_SIZE, &Done, NULL) || Done != Size)
+                {
+                    ok(0, "ReadFile failed at %lu with %lu\n", Offset, GetLastError());
+                    break;
+                }
+                Match = Match && g_Buffer[0] == Pattern(Offset) && g_Buffer[Size - 1] == Pattern(Offset + Size - 1);
+                Bytes += Done;
+            }
+        }
+
+        QueryPerformanceCounter(&Now);
+        trace("%s%s reads, pass %lu: %I64u KB/s\n",
+              Random ? "4 KB random" : "64 KB sequential",
+              (Flags & FILE_FLAG_NO_BUFFERING) ? " unbuffered" : "",
+              Pass + 1,
+              Bytes / 1024 * Frequency.QuadPart / max(Now.QuadPart - Start.QuadPart, 1));
+    }
+
+    ok(Match, "Wrong data read\n");
+    CloseHandle(File);
+}
+
+START_TEST(CachedRead)
+{
+    WCHAR TempPath[MAX_PATH], Root[MAX_PATH], FileSystem[MAX_PATH];
+
+    GetTempPathW(_countof(TempPath), TempPath);
+
+    /*
+     * This is about the cached path of the NTFS driver. Test machines
+     * usually have their temporary directory on FAT, so the test is
+     * expected to skip there; point TEMP at an NTFS volume to run it.
+     */
+    if (!GetVolumePathNameW(TempPath, Root, _countof(Root)) ||
+        !GetVolumeInformationW(Root, NULL, 0, NULL, NULL, NULL, FileSystem, _countof(FileSystem)) ||
+        _wcsicmp(FileSystem, L"NTFS"))
+    {
+        skip("%S is not on an NTFS volume\n", TempPath);
+        return;
+    }
+
+    /* Creating it fails too when the driver doesn't write */
+    if (!GetTempFileNameW(TempPath, L"crd", 0, g_FileName))
+    {
+        skip("No temporary file (%lu)\n", GetLastError());
+        return;
+    }
+
+    /* Page aligned, as unbuffered reads need */
+    g_Buffer = VirtualAlloc(NULL, CHUNK_SIZE, MEM_COMMIT, PAGE_READWRITE);
+    if (!g_Buffer)
+    {
+        skip("Out of memory\n");
+        DeleteFileW(g_FileName);
+        return;
+    }
+
+    if (CreateTestFile())
+    {
+        TestCoherency();
+
+        BenchmarkRead(FALSE, 0);
+        BenchmarkRead(TRUE, 0);
+        BenchmarkRead(FALSE, FILE_FLAG_NO_BUFFERING);
+        BenchmarkRead(TRUE, FILE_FLAG_NO_BUFFERING);
+    }
+
+    VirtualFree(g_Buffer, 0, MEM_RELEASE);
+    DeleteFileW(g_FileName);
+}
@@ -0,0 +1,283 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Tests and create/open benchmark for directories with many files
+ */
+
+#include "precomp.h"
+
+#define FILE_COUNT              20000
+#define LARGE_FILE_COUNT        100000
+#define BATCH_COUNT             10000
+
+/* A FAT directory holds at most 65536 entries, so the large run is spread over a few */
+#define DIRECTORY_FILES         50000
+
+static WCHAR g_Directory[MAX_PATH];
+static ULONG g_FileCount;
+
+static
+VOID
+MakePath(
+    _Out_writes_(MAX_PATH) PWSTR Path,
+    _In_ PCWSTR Name)
+{
+    StringCchPrintfW(Path, MAX_PATH, L"%s\\Dir0\\%s", g_Directory, Name);
+}
+
+static
+VOID
+MakeFilePath(
+    _Out_writes_(MAX_PATH) PWSTR Path,
+    _In_ ULONG Number)
+{
+    /* 8.3 names take a single directory entry each, even on FAT */
+    StringCchPrintfW(Path, MAX_PATH, L"%s\\Dir%lu\\P%07lu.JPG", g_Directory, Number / DIRECTORY_FILES, Number);
+}
+
+static
+BOOL
+CreateDirectories(VOID)
+{
+    WCHAR Path[MAX_PATH];
+    ULONG i;
+
+    for (i = 0; i * DIRECTORY_FILES < g_FileCount; i++)
+    {
+        StringCchPrintfW(Path, _countof(Path), L"%s\\Dir%lu", g_Directory, i);
+        if (!CreateDirectoryW(Path, NULL))
+        {
+            skip("Cannot create %S (%lu)\n", Path, GetLastError());
+            while (i--)
+            {
+                StringCchPrintfW(Path, _countof(Path), L"%s\\Dir%lu", g_Directory, i);
+                RemoveDirectoryW(Path);
+            }
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static
+VOID
+RemoveDirectories(VOID)
+{
+    WCHAR Path[MAX_PATH];
+    ULONG i;
+
+    for (i = 0; i * DIRECTORY_FILES < g_FileCount; i++)
+    {
+        StringCchPrintfW(Path, _countof(Path), L"%s\\Dir%lu", g_Directory, i);
+        ok(RemoveDirectoryW(Path), "RemoveDirectoryW(%S) failed with %lu\n", Path, GetLastError());
+    }
+}
+
+static
+BOOL
+OpenPath(
+    _In_ PCWSTR Path)
+{
+    HANDLE File;
+
+    File = CreateFileW(Path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+    if (File == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    CloseHandle(File);
+    return TRUE;
+}
+
+static
+VOID
+TestNames(VOID)
+{
+    WCHAR Path[MAX_PATH], Short[MAX_PATH], Renamed[MAX_PATH], Upper[MAX_PATH];
+    HANDLE File;
+    ULONG i;
+
+    /* Enough entries around to make the lookups go through the index */
+    for (i = 0; i < 200; i++)
+    {
+        MakeFilePath(Path, i);
+        File = CreateFileW(Path, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, NULL);
+        ok(File != INVALID_HANDLE_VALUE, "CreateFileW(%S) failed with %lu\n", Path, GetLastError());
+        CloseHandle(File);
+    }
+
+    /* Long and short names, in any case */
+    MakePath(Path, L"A long name for a file.txt");
+    File = CreateFileW(Path, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    CloseHandle(File);
+
+    ok(GetShortPathNameW(Path, Short, _countof(Short)) != 0, "GetShortPathNameW failed with %lu\n", GetLastError());
+    ok(OpenPath(Short), "Cannot open %S (%lu)\n", Short, GetLastError());
+
+    MakePath(Upper, L"A LONG NAME FOR A FILE.TXT");
+    ok(OpenPath(Upper), "Cannot open %S (%lu)\n", Upper, GetLastError());
+
+    SetLastError(0xdeadbeef);
+    File = CreateFileW(Upper, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, NULL);
+    ok(File == INVALID_HANDLE_VALUE, "Created a second %S\n", Upper);
+    ok_err(ERROR_FILE_EXISTS);
+
+    /* Renaming forgets the old names */
+    MakePath(Renamed, L"Another long name.txt");
+    ok(MoveFileW(Path, Renamed), "MoveFileW failed with %lu\n", GetLastError());
+    ok(OpenPath(Renamed), "Cannot open %S (%lu)\n", Renamed, GetLastError());
+    SetLastError(0xdeadbeef);
+    ok(!OpenPath(Path), "Opened %S after renaming it\n", Path);
+    ok_err(ERROR_FILE_NOT_FOUND);
+    ok(GetShortPathNameW(Renamed, Short, _countof(Short)) != 0, "GetShortPathNameW failed with %lu\n", GetLastError());
+    ok(OpenPath(Short), "Cannot open %S (%lu)\n", Short, GetLastError());
+
+    /* And so does deleting */
+    ok(DeleteFileW(Renamed), "DeleteFileW failed with %lu\n", GetLastError());
+    SetLastError(0xdeadbeef);
+    ok(!OpenPath(Renamed), "Opened %S after deleting it\n", Renamed);
+    ok_err(ERROR_FILE_NOT_FOUND);
+    SetLastError(0xdeadbeef);
+    ok(!OpenPath(Short), "Opened %S after deleting it\n", Short);
+    ok_err(ERROR_FILE_NOT_FOUND);
+
+    /* Freed entries get used again */
+    for (i = 0; i < 200; i += 2)
+    {
+        MakeFilePath(Path, i);
+        ok(DeleteFileW(Path), "DeleteFileW(%S) failed with %lu\n", Path, GetLastError());
+    }
+    for (i = 0; i < 200; i++)
+    {
+        MakeFilePath(Path, i);
+        File = CreateFileW(Path, GENERIC_WRITE, 0, NULL, (i % 2) ? OPEN_EXISTING : CREATE_NEW, 0, NULL);
+        ok(File != INVALID_HANDLE_VALUE, "CreateFileW(%S) failed with %lu\n", Path, GetLastError());
+        CloseHandle(File);
+    }
+    for (i = 0; i < 200; i++)
+    {
+        MakeFilePath(Path, i);
+        ok(DeleteFileW(Path), "DeleteFileW(%S) failed with %lu\n", Path, GetLastError());
+    }
+}
+
+static
+ULONGLONG
+PerSecond(
+    _In_ ULONGLONG Count,
+    _In_ PLARGE_INTEGER Frequency,
+    _In_ PLARGE_INTEGER Start,
+    _In_ PLARGE_INTEGER End)
+{
+    return Count * Frequency->QuadPart / max(End->QuadPart - Start->QuadPart, 1);
+}
+
+static
+VOID
+BenchmarkCreateOpen(VOID)
+{
+    LARGE_INTEGER Frequency, Start, Batch, Now;
+    WCHAR Path[MAX_PATH];
+    HANDLE File;
+    ULONG i, Created, Seed;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    Batch = Start;
+
+    /* Creating must not slow down as the directory fills up */
+    for (Created = 0; Created < g_FileCount; Created++)
+    {
+        MakeFilePath(Path, Created);
+        File = CreateFileW(Path, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, NULL);
+        if (File == INVALID_HANDLE_VALUE)
+        {
+            ok(0, "CreateFileW(%S) failed with %lu\n", Path, GetLastError());
+            break;
+        }
+        CloseHandle(File);
+
+        if ((Created + 1) % BATCH_COUNT == 0)
+        {
+            QueryPerformanceCounter(&Now);
+            trace("Files %lu to %lu: %I64u creates/s\n",
+                  Created + 1 - BATCH_COUNT, Created + 1,
+                  PerSecond(BATCH_COUNT, &Frequency, &Batch, &Now));
+            Batch = Now;
+        }
+    }
+    QueryPerformanceCounter(&Now);
+    trace("%lu files created: %I64u creates/s\n", Created, PerSecond(Created, &Frequency, &Start, &Now));
+
+    /* Opening in random order */
+    QueryPerformanceCounter(&Start);
+    for (i = 0, Seed = 1; i < Created; i++)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        MakeFilePath(Path, (Seed >> 8) % Created);
+        if (!OpenPath(Path))
+        {
+            ok(0, "Cannot open %S (%lu)\n", Path, GetLastError());
+            break;
+        }
+    }
+    QueryPerformanceCounter(&Now);
+    trace("%lu random opens: %I64u opens/s\n", i, PerSecond(i, &Frequency, &Start, &Now));
+
+    /* Names which are not there, in the fullest directory */
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < BATCH_COUNT; i++)
+    {
+        StringCchPrintfW(Path, _countof(Path), L"%s\\Dir0\\Q%07lu.JPG", g_Directory, i);
+        if (OpenPath(Path))
+        {
+            ok(0, "Opened %S\n", Path);
+            break;
+        }
+    }
+    QueryPerformanceCounter(&Now);
+    trace("%lu failed opens: %I64u opens/s\n", i, PerSecond(i, &Frequency, &Start, &Now));
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < Created; i++)
+    {
+        MakeFilePath(Path, i);
+        if (!DeleteFileW(Path))
+        {
+            ok(0, "DeleteFileW(%S) failed with %lu\n", Path, GetLastError());
+        }
+    }
+    QueryPerformanceCounter(&Now);
+    trace("%lu files deleted: %I64u deletes/s\n", Created, PerSecond(Created, &Frequency, &Start, &Now));
+}
+
+START_TEST(LargeDirectory)
+{
+    WCHAR TempPath[MAX_PATH], Root[MAX_PATH], FileSystem[MAX_PATH];
+
+    GetTempPathW(_countof(TempPath), TempPath);
+    StringCchPrintfW(g_Directory, _countof(g_Directory), L"%sldir%lu", TempPath, GetCurrentProcessId());
+    if (!CreateDirectoryW(g_Directory, NULL))
+    {
+        skip("Cannot create %S (%lu)\n", g_Directory, GetLastError());
+        return;
+    }
+
+    if (GetVolumePathNameW(TempPath, Root, _countof(Root)) &&
+        GetVolumeInformationW(Root, NULL, 0, NULL, NULL, NULL, FileSystem, _countof(FileSystem)))
+    {
+        trace("%S is %S\n", Root, FileSystem);
+    }
+
+    /* The large run takes a long time, so it only runs when asked for */
+    g_FileCount = winetest_interactive ? LARGE_FILE_COUNT : FILE_COUNT;
+    if (CreateDirectories())
+    {
+        TestNames();
+        BenchmarkCreateOpen();
+        RemoveDirectories();
+    }
+
+    ok(RemoveDirectoryW(g_Directory), "RemoveDirectoryW failed with %lu\n", GetLastError());
+}
@@ -0,0 +1,236 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Tests and create benchmark for large NTFS directory indexes
+ */
+
+#include "precomp.h"
+
+#define FILE_COUNT              20000
+#define BATCH_COUNT             2000
+
+static WCHAR g_TempPath[MAX_PATH];
+static WCHAR g_Directory[MAX_PATH];
+
+static
+VOID
+MakeFilePath(
+    _Out_writes_(MAX_PATH) PWSTR Path,
+    _In_ ULONG Number)
+{
+    /* Long names, so that the index records fill up and split quickly */
+    StringCchPrintfW(Path, MAX_PATH, L"%s\\Document %06lu with a rather long name to fill the index.txt",
+                     g_Directory, Number);
+}
+
+static
+BOOL
+FindFile(
+    _In_ ULONG Number)
+{
+    WCHAR Path[MAX_PATH];
+    WIN32_FIND_DATAW FindData;
+    HANDLE Find;
+
+    MakeFilePath(Path, Number);
+    Find = FindFirstFileW(Path, &FindData);
+    if (Find == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    FindClose(Find);
+    return TRUE;
+}
+
+static
+ULONG
+CountFiles(VOID)
+{
+    WCHAR Pattern[MAX_PATH];
+    WIN32_FIND_DATAW FindData;
+    HANDLE Find;
+    ULONG Count = 0;
+
+    StringCchPrintfW(Pattern, _countof(Pattern), L"%s\\*", g_Directory);
+    Find = FindFirstFileW(Pattern, &FindData);
+    if (Find == INVALID_HANDLE_VALUE)
+        return 0;
+
+    do
+    {
+        if (!(FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            Count++;
+    } while (FindNextFileW(Find, &FindData));
+
+    FindClose(Find);
+    return Count;
+}
+
+static
+ULONGLONG
+PerSecond(
+    _In_ ULONGLONG Count,
+    _In_ PLARGE_INTEGER Frequency,
+    _In_ PLARGE_INTEGER Start,
+    _In_ PLARGE_INTEGER End)
+{
+    return Count * Frequency->QuadPart / max(End->QuadPart - Start->QuadPart, 1);
+}
+
+static
+ULONG
+BenchmarkCreate(
+    _In_ BOOL Reverse)
+{
+    LARGE_INTEGER Frequency, Start, Batch, Now;
+    WCHAR Path[MAX_PATH];
+    HANDLE File;
+    ULONG Created;
+    ULONGLONG Rate = 0, FirstRate = 0;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    Batch = Start;
+
+    /* Every batch should take about as long as the first one, whatever the size of the index */
+    for (Created = 0; Created < FILE_COUNT; Created++)
+    {
+        MakeFilePath(Path, Reverse ? FILE_COUNT - 1 - Created : Created);
+        File = CreateFileW(Path, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, NULL);
+        if (File == INVALID_HANDLE_VALUE)
+        {
+            ok(0, "CreateFileW(%S) failed with %lu\n", Path, GetLastError());
+            break;
+        }
+        CloseHandle(File);
+
+        if ((Created + 1) % BATCH_COUNT == 0)
+        {
+            QueryPerformanceCounter(&Now);
+            Rate = PerSecond(BATCH_COUNT, &Frequency, &Batch, &Now);
+            trace("%s files %lu to %lu: %I64u creates/s\n",
+                  Reverse ? "Descending" : "Ascending",
+                  Created + 1 - BATCH_COUNT, Created + 1, Rate);
+            Batch = Now;
+
+            if (!FirstRate)
+                FirstRate = Rate;
+        }
+    }
+    QueryPerformanceCounter(&Now);
+    trace("%lu files created: %I64u creates/s\n", Created, PerSecond(Created, &Frequency, &Start, &Now));
+
+    /* Timings are too noisy to assert on, so only trace how much the last batch slowed down */
+    if (Created == FILE_COUNT)
+    {
+        trace("%s creates went from %I64u/s to %I64u/s\n",
+              Reverse ? "Descending" : "Ascending", FirstRate, Rate);
+    }
+
+    ok(Created == FILE_COUNT, "Created %lu files instead of %u\n", Created, FILE_COUNT);
+    return Created;
+}
+
+static
+VOID
+TestIndex(
+    _In_ ULONG First,
+    _In_ ULONG Created)
+{
+    ULONG i, Seed, Count;
+    BOOL Found = TRUE;
+
+    /* The index must still hold every name after all the splits */
+    Count = CountFiles();
+    ok(Count == Created, "Found %lu files instead of %lu\n", Count, Created);
+    for (i = 0, Seed = 1; i < 1000 && Created; i++)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        Found = Found && FindFile(First + (Seed >> 8) % Created);
+    }
+    ok(Found, "A created file was not found\n");
+    ok(!FindFile(FILE_COUNT), "Found a file which was never created\n");
+}
+
+static
+BOOL
+DeleteFiles(
+    _In_ ULONG First,
+    _In_ ULONG Created)
+{
+    WCHAR Path[MAX_PATH];
+    ULONG i, Error, Failed = 0;
+
+    for (i = First; i < First + Created; i++)
+    {
+        MakeFilePath(Path, i);
+        if (DeleteFileW(Path))
+            continue;
+
+        /* The ReactOS driver doesn't implement FileDispositionInformation yet */
+        Error = GetLastError();
+        if (i == First && (Error == ERROR_INVALID_FUNCTION || Error == ERROR_NOT_SUPPORTED))
+        {
+            skip("Cannot delete files (%lu), leaving %S behind\n", Error, g_Directory);
+            return FALSE;
+        }
+
+        if (++Failed <= 10)
+            ok(0, "DeleteFileW(%S) failed with %lu\n", Path, Error);
+    }
+
+    ok(Failed == 0, "%lu files were not deleted\n", Failed);
+    return Failed == 0;
+}
+
+static
+BOOL
+TestPass(
+    _In_ BOOL Reverse)
+{
+    ULONG First, Created, Count;
+
+    /* A fresh directory, so that each pass starts with an empty index */
+    StringCchPrintfW(g_Directory, _countof(g_Directory), L"%sntfsidx%lu%s",
+                     g_TempPath, GetCurrentProcessId(), Reverse ? L"d" : L"a");
+    if (!CreateDirectoryW(g_Directory, NULL))
+    {
+        skip("Cannot create %S (%lu)\n", g_Directory, GetLastError());
+        return FALSE;
+    }
+
+    Created = BenchmarkCreate(Reverse);
+    First = Reverse ? FILE_COUNT - Created : 0;
+    TestIndex(First, Created);
+    if (!DeleteFiles(First, Created))
+        return FALSE;
+
+    /* Removing every entry must leave an index that is empty and still works */
+    Count = CountFiles();
+    ok(Count == 0, "Found %lu files after deleting them all\n", Count);
+    ok(!FindFile(First), "Found a file which was deleted\n");
+
+    ok(RemoveDirectoryW(g_Directory), "RemoveDirectoryW failed with %lu\n", GetLastError());
+    return TRUE;
+}
+
+START_TEST(NtfsIndex)
+{
+    WCHAR Root[MAX_PATH], FileSystem[MAX_PATH];
+
+    /* Only the volume of the temporary directory is ours to fill */
+    GetTempPathW(_countof(g_TempPath), g_TempPath);
+    if (!GetVolumePathNameW(g_TempPath, Root, _countof(Root)) ||
+        !GetVolumeInformationW(Root, NULL, 0, NULL, NULL, NULL, FileSystem, _countof(FileSystem)) ||
+        _wcsicmp(FileSystem, L"NTFS"))
+    {
+        skip("%S is not on an NTFS volume\n", g_TempPath);
+        return;
+    }
+
+    /* In order, so that the new names always go into the last index record */
+    if (!TestPass(FALSE))
+        return;
+
+    /* And the other way around, where they always go into the first one */
+    TestPass(TRUE);
+}
@@ -0,0 +1,142 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test and benchmark for random unbuffered reads of a large file on FAT
+ */
+
+#include "precomp.h"
+
+#define FILE_SIZE               (8 * 1024 * 1024)
+#define WRITE_SIZE              (1024 * 1024)
+#define READ_SIZE               4096
+#define RANDOM_READS            4096
+
+/* Every ULONG of the file holds its own offset, so reads from the wrong cluster show */
+#define PATTERN(Offset)         ((ULONG)(Offset) ^ 0x5a5a5a5a)
+
+static WCHAR g_FileName[MAX_PATH];
+static PULONG g_Buffer;
+
+static
+BOOL
+CreateTestFile(VOID)
+{
+    DWORD Offset, Written, i;
+    HANDLE File;
+    BOOL Ret = TRUE;
+
+    File = CreateFileW(g_FileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    for (Offset = 0; Offset < FILE_SIZE && Ret; Offset += WRITE_SIZE)
+    {
+        for (i = 0; i < WRITE_SIZE / sizeof(ULONG); i++)
+            g_Buffer[i] = PATTERN(Offset + i * sizeof(ULONG));
+
+        Ret = WriteFile(File, g_Buffer, WRITE_SIZE, &Written, NULL) && Written == WRITE_SIZE;
+        ok(Ret, "WriteFile at %lu failed with %lu\n", Offset, GetLastError());
+    }
+
+    CloseHandle(File);
+    return Ret;
+}
+
+START_TEST(RandomRead)
+{
+    WCHAR TempPath[MAX_PATH], Root[MAX_PATH], FileSystem[MAX_PATH];
+    DWORD SectorsPerCluster, BytesPerSector, FreeClusters, TotalClusters;
+    LARGE_INTEGER Frequency, Start, Now;
+    DWORD Offset, Done, Seed, Wrong = 0, i, j;
+    HANDLE File;
+
+    GetTempPathW(_countof(TempPath), TempPath);
+    if (!GetVolumePathNameW(TempPath, Root, _countof(Root)) ||
+        !GetTempFileNameW(TempPath, L"rnd", 0, g_FileName))
+    {
+        skip("No temporary file (%lu)\n", GetLastError());
+        return;
+    }
+
+    /* This is about looking up the cluster runs of a FAT file */
+    if (!GetVolumeInformationW(Root, NULL, 0, NULL, NULL, NULL, FileSystem, _countof(FileSystem)) ||
+        _wcsnicmp(FileSystem, L"FAT", 3))
+    {
+        skip("%S is not a FAT volume\n", Root);
+        DeleteFileW(g_FileName);
+        return;
+    }
+
+    if (!GetDiskFreeSpaceW(Root, &SectorsPerCluster, &BytesPerSector, &FreeClusters, &TotalClusters) ||
+        (ULONGLONG)FreeClusters * SectorsPerCluster * BytesPerSector < 2 * FILE_SIZE)
+    {
+        skip("Not enough free space on %S\n", Root);
+        DeleteFileW(g_FileName);
+        return;
+    }
+
+    /* Page aligned, as unbuffered reads need */
+    g_Buffer = VirtualAlloc(NULL, WRITE_SIZE, MEM_COMMIT, PAGE_READWRITE);
+    if (!g_Buffer)
+    {
+        skip("Out of memory\n");
+        DeleteFileW(g_FileName);
+        return;
+    }
+
+    if (!CreateTestFile())
+    {
+        VirtualFree(g_Buffer, 0, MEM_RELEASE);
+        DeleteFileW(g_FileName);
+        return;
+    }
+
+    /* Bypass the cache so that every read has to map its offset to a cluster */
+    File = CreateFileW(g_FileName, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        VirtualFree(g_Buffer, 0, MEM_RELEASE);
+        DeleteFileW(g_FileName);
+        return;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    for (i = 0, Seed = 1; i < RANDOM_READS; i++)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        Offset = (Seed >> 8) % (FILE_SIZE / READ_SIZE) * READ_SIZE;
+        SetFilePointer(File, Offset, NULL, FILE_BEGIN);
+        if (!ReadFile(File, g_Buffer, READ_SIZE, &Done, NULL) || Done != READ_SIZE)
+        {
+            ok(0, "ReadFile at %lu failed with %lu\n", Offset, GetLastError());
+            break;
+        }
+
+        /* Every read must come from its own place in the file */
+        for (j = 0; j < READ_SIZE / sizeof(ULONG); j++)
+        {
+            if (g_Buffer[j] != PATTERN(Offset + j * sizeof(ULONG)))
+            {
+                if (++Wrong <= 10)
+                    ok(0, "Wrong data at %lu: 0x%08lx\n", (DWORD)(Offset + j * sizeof(ULONG)), g_Buffer[j]);
+                break;
+            }
+        }
+    }
+
+    QueryPerformanceCounter(&Now);
+    CloseHandle(File);
+
+    ok(Wrong == 0, "%lu reads returned wrong data\n", Wrong);
+    trace("%u MB, %u KB random reads: %I64u reads/s\n",
+          FILE_SIZE / (1024 * 1024),
+          READ_SIZE / 1024,
+          (ULONGLONG)i * Frequency.QuadPart / max(Now.QuadPart - Start.QuadPart, 1));
+
+    VirtualFree(g_Buffer, 0, MEM_RELEASE);
+    ok(DeleteFileW(g_FileName), "DeleteFileW failed with %lu\n", GetLastError());
+}
@@ -0,0 +1,198 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Scheduler throughput and wakeup latency benchmark
+ */
+
+#include "precomp.h"
+
+#define RUN_TIME_MS     500
+
+/* Two threads handing a token back and forth through a pair of events */
+typedef struct _PING_PONG
+{
+    HANDLE Event[2];
+    HANDLE Thread[2];
+    LONGLONG SignalTime;
+    ULONGLONG Handoffs;
+    ULONGLONG Latency;
+} PING_PONG, *PPING_PONG;
+
+typedef struct _PING_PONG_SIDE
+{
+    PPING_PONG Pair;
+    ULONG Side;
+} PING_PONG_SIDE, *PPING_PONG_SIDE;
+
+static volatile LONG StopRun;
+
+static
+DWORD
+WINAPI
+PingPongThread(
+    _In_ PVOID Parameter)
+{
+    PPING_PONG_SIDE Context = Parameter;
+    PPING_PONG Pair = Context->Pair;
+    LARGE_INTEGER Now;
+
+    for (;;)
+    {
+        if (WaitForSingleObject(Pair->Event[Context->Side], INFINITE) != WAIT_OBJECT_0)
+            break;
+
+        /* Account for the time it took the wakeup to get us running */
+        QueryPerformanceCounter(&Now);
+        Pair->Latency += Now.QuadPart - Pair->SignalTime;
+        Pair->Handoffs++;
+
+        /* Wake the other side up, even when stopping, so it can exit too */
+        QueryPerformanceCounter(&Now);
+        Pair->SignalTime = Now.QuadPart;
+        SetEvent(Pair->Event[!Context->Side]);
+        if (StopRun)
+            break;
+    }
+
+    return 0;
+}
+
+static
+BOOL
+RunPairs(
+    _In_ ULONG PairCount,
+    _Out_ PULONGLONG Handoffs,
+    _Out_ PULONGLONG Latency)
+{
+    PPING_PONG Pairs;
+    PPING_PONG_SIDE Sides;
+    LARGE_INTEGER Now;
+    ULONG i, j;
+    BOOL Success = TRUE;
+
+    *Handoffs = 0;
+    *Latency = 0;
+
+    Pairs = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, PairCount * sizeof(*Pairs));
+    Sides = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, PairCount * 2 * sizeof(*Sides));
+    if (!Pairs || !Sides)
+    {
+        skip("Out of memory\n");
+        HeapFree(GetProcessHeap(), 0, Pairs);
+        HeapFree(GetProcessHeap(), 0, Sides);
+        return FALSE;
+    }
+
+    StopRun = FALSE;
+    for (i = 0; i < PairCount; i++)
+    {
+        for (j = 0; j < 2; j++)
+        {
+            Pairs[i].Event[j] = CreateEventW(NULL, FALSE, FALSE, NULL);
+            ok(Pairs[i].Event[j] != NULL, "CreateEventW failed: %lu\n", GetLastError());
+        }
+
+        for (j = 0; j < 2; j++)
+        {
+            Sides[i * 2 + j].Pair = &Pairs[i];
+            Sides[i * 2 + j].Side = j;
+            Pairs[i].Thread[j] = CreateThread(NULL, 0, PingPongThread, &Sides[i * 2 + j], 0, NULL);
+            ok(Pairs[i].Thread[j] != NULL, "CreateThread failed: %lu\n", GetLastError());
+            if (!Pairs[i].Thread[j])
+                Success = FALSE;
+        }
+    }
+
+    if (Success)
+    {
+        /* Serve the first ball of every pair and let them play */
+        for (i = 0; i < PairCount; i++)
+        {
+            QueryPerformanceCounter(&Now);
+            Pairs[i].SignalTime = Now.QuadPart;
+            SetEvent(Pairs[i].Event[0]);
+        }
+        Sleep(RUN_TIME_MS);
+    }
+    InterlockedExchange(&StopRun, TRUE);
+
+    for (i = 0; i < PairCount; i++)
+    {
+        for (j = 0; j < 2; j++)
+        {
+            if (!Pairs[i].Thread[j])
+                continue;
+
+            /* A side that never got a ball is still waiting, give it one */
+            if (WaitForSingleObject(Pairs[i].Thread[j], 5000) == WAIT_TIMEOUT)
+            {
+                SetEvent(Pairs[i].Event[j]);
+                ok_long(WaitForSingleObject(Pairs[i].Thread[j], 5000), WAIT_OBJECT_0);
+            }
+            CloseHandle(Pairs[i].Thread[j]);
+        }
+
+        *Handoffs += Pairs[i].Handoffs;
+        *Latency += Pairs[i].Latency;
+        CloseHandle(Pairs[i].Event[0]);
+        CloseHandle(Pairs[i].Event[1]);
+    }
+
+    HeapFree(GetProcessHeap(), 0, Pairs);
+    HeapFree(GetProcessHeap(), 0, Sides);
+    return Success;
+}
+
+/* Split the conversion so that large tick counts don't overflow */
+static
+ULONGLONG
+TicksToNs(ULONGLONG Ticks, ULONGLONG Frequency)
+{
+    return Ticks / Frequency * 1000000000 +
+           Ticks % Frequency * 1000000000 / Frequency;
+}
+
+START_TEST(Scheduler)
+{
+    DWORD_PTR ProcessMask, SystemMask, Mask;
+    LARGE_INTEGER Frequency;
+    ULONGLONG Handoffs, Latency;
+    ULONG CpuCount, MaxCpus, Bit;
+
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &ProcessMask, &SystemMask))
+    {
+        skip("GetProcessAffinityMask failed: %lu\n", GetLastError());
+        return;
+    }
+    QueryPerformanceFrequency(&Frequency);
+
+    for (Mask = ProcessMask, MaxCpus = 0; Mask; Mask &= Mask - 1)
+        MaxCpus++;
+
+    /* Double the number of processors each round, ending with all of them */
+    for (CpuCount = 1; ; CpuCount = min(CpuCount * 2, MaxCpus))
+    {
+        /* Restrict ourselves to the first CpuCount processors we may use */
+        for (Mask = 0, Bit = 0; Bit < CpuCount; Bit++)
+        {
+            /* Add the lowest allowed processor we don't have yet */
+            Mask |= (ProcessMask & ~Mask) & (0 - (ProcessMask & ~Mask));
+        }
+        ok(SetProcessAffinityMask(GetCurrentProcess(), Mask), "SetProcessAffinityMask failed: %lu\n", GetLastError());
+
+        /* One ping-pong pair per processor keeps every one of them busy */
+        if (RunPairs(CpuCount, &Handoffs, &Latency))
+        {
+            ok(Handoffs != 0, "No handoffs with %lu processors\n", CpuCount);
+            trace("%lu processors: %I64u handoffs/s, %I64u ns average wakeup latency\n",
+                  CpuCount,
+                  Handoffs * 1000 / RUN_TIME_MS,
+                  (Handoffs && Frequency.QuadPart) ? TicksToNs(Latency / Handoffs, Frequency.QuadPart) : 0);
+        }
+
+        if (CpuCount >= MaxCpus)
+            break;
+    }
+
+    ok(SetProcessAffinityMask(GetCurrentProcess(), ProcessMask), "SetProcessAffinityMask failed: %lu\n", GetLastError());
+}
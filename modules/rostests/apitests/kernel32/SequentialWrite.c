@@ -0,0 +1,280 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Tests and throughput benchmarks for large sequential files on FAT
+ */
+
+#include "precomp.h"
+
+#include <winioctl.h>
+
+#define FILE_SIZE               (8 * 1024 * 1024)
+#define EXTEND_SIZE             (4 * 1024 * 1024)
+#define TRUNCATE_SIZE           (EXTEND_SIZE / 2 + 1000)
+#define CHUNK_SIZE              (64 * 1024)
+
+/* Every ULONG of the file holds its own offset, so misplaced clusters show */
+#define PATTERN(Offset)         ((ULONG)(Offset) ^ 0x5a5a5a5a)
+
+static WCHAR g_Root[MAX_PATH];
+static WCHAR g_FileName[MAX_PATH];
+static PUCHAR g_Buffer;
+
+static
+BOOL
+GetFreeClusters(
+    _Out_ PDWORD FreeClusters,
+    _Out_ PDWORD BytesPerCluster)
+{
+    DWORD SectorsPerCluster, BytesPerSector, TotalClusters;
+
+    if (!GetDiskFreeSpaceW(g_Root, &SectorsPerCluster, &BytesPerSector, FreeClusters, &TotalClusters))
+        return FALSE;
+
+    *BytesPerCluster = SectorsPerCluster * BytesPerSector;
+    return TRUE;
+}
+
+/* Number of runs of clusters the file is made of */
+static
+BOOL
+GetExtentCount(
+    _In_ HANDLE File,
+    _Out_ PULONG ExtentCount)
+{
+    UCHAR Buffer[FIELD_OFFSET(RETRIEVAL_POINTERS_BUFFER, Extents[64])];
+    PRETRIEVAL_POINTERS_BUFFER Pointers = (PRETRIEVAL_POINTERS_BUFFER)Buffer;
+    STARTING_VCN_INPUT_BUFFER StartingVcn;
+    DWORD Returned;
+
+    StartingVcn.StartingVcn.QuadPart = 0;
+    if (!DeviceIoControl(File, FSCTL_GET_RETRIEVAL_POINTERS, &StartingVcn, sizeof(StartingVcn),
+                         Pointers, sizeof(Buffer), &Returned, NULL) &&
+        GetLastError() != ERROR_MORE_DATA)
+    {
+        return FALSE;
+    }
+
+    *ExtentCount = Pointers->ExtentCount;
+    return TRUE;
+}
+
+static
+BOOL
+WritePattern(
+    _In_ HANDLE File,
+    _In_ DWORD Start,
+    _In_ DWORD End)
+{
+    PULONG Data = (PULONG)g_Buffer;
+    DWORD Offset, Length, Written, i;
+
+    SetFilePointer(File, Start, NULL, FILE_BEGIN);
+    for (Offset = Start; Offset < End; Offset += Length)
+    {
+        Length = min(End - Offset, CHUNK_SIZE);
+        for (i = 0; i < Length / sizeof(ULONG); i++)
+            Data[i] = PATTERN(Offset + i * sizeof(ULONG));
+
+        if (!WriteFile(File, g_Buffer, Length, &Written, NULL) || Written != Length)
+        {
+            ok(0, "WriteFile at %lu failed with %lu\n", Offset, GetLastError());
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Reads the file back from Start to End, which must hold the pattern or zeros */
+static
+VOID
+CheckFile(
+    _In_ HANDLE File,
+    _In_ DWORD Start,
+    _In_ DWORD End,
+    _In_ BOOL Zeroed)
+{
+    PULONG Data = (PULONG)g_Buffer;
+    DWORD Offset, Length, Read, i;
+
+    SetFilePointer(File, Start, NULL, FILE_BEGIN);
+    for (Offset = Start; Offset < End; Offset += Length)
+    {
+        Length = min(End - Offset, CHUNK_SIZE);
+        if (!ReadFile(File, g_Buffer, Length, &Read, NULL) || Read != Length)
+        {
+            ok(0, "ReadFile at %lu failed with %lu, %lu bytes read\n", Offset, GetLastError(), Read);
+            return;
+        }
+
+        for (i = 0; i < Length / sizeof(ULONG); i++)
+        {
+            if (Data[i] != (Zeroed ? 0 : PATTERN(Offset + i * sizeof(ULONG))))
+            {
+                ok(0, "Wrong data at %lu: 0x%08lx\n", (DWORD)(Offset + i * sizeof(ULONG)), Data[i]);
+                return;
+            }
+        }
+    }
+}
+
+static
+VOID
+TestAllocation(VOID)
+{
+    DWORD FreeBefore, FreeExtended, FreeAfter, BytesPerCluster, Read;
+    ULONG Extents = 0;
+    HANDLE File;
+
+    if (!GetFreeClusters(&FreeBefore, &BytesPerCluster))
+    {
+        skip("GetDiskFreeSpaceW failed with %lu\n", GetLastError());
+        return;
+    }
+
+    File = CreateFileW(g_FileName, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+        return;
+
+    /* Growing the file takes all its clusters at once */
+    SetFilePointer(File, EXTEND_SIZE, NULL, FILE_BEGIN);
+    ok(SetEndOfFile(File), "SetEndOfFile failed with %lu\n", GetLastError());
+    ok(GetFreeClusters(&FreeExtended, &BytesPerCluster), "GetDiskFreeSpaceW failed with %lu\n", GetLastError());
+    ok(FreeBefore - FreeExtended >= EXTEND_SIZE / BytesPerCluster,
+       "Free clusters went from %lu to %lu\n", FreeBefore, FreeExtended);
+
+    /* The allocator takes a free run that holds all of it, there is plenty of room */
+    ok(GetExtentCount(File, &Extents), "FSCTL_GET_RETRIEVAL_POINTERS failed with %lu\n", GetLastError());
+    ok(Extents == 1, "Extended file has %lu runs\n", Extents);
+
+    /* Every cluster of the chain must be reachable, and in its place */
+    if (WritePattern(File, 0, EXTEND_SIZE))
+        CheckFile(File, 0, EXTEND_SIZE, FALSE);
+
+    /* Truncating in the middle of a cluster keeps everything before that */
+    SetFilePointer(File, TRUNCATE_SIZE, NULL, FILE_BEGIN);
+    ok(SetEndOfFile(File), "SetEndOfFile failed with %lu\n", GetLastError());
+    ok(GetFileSize(File, NULL) == TRUNCATE_SIZE, "File size is %lu\n", GetFileSize(File, NULL));
+    CheckFile(File, 0, TRUNCATE_SIZE, FALSE);
+    ok(ReadFile(File, g_Buffer, CHUNK_SIZE, &Read, NULL) && Read == 0,
+       "Read %lu bytes past the end\n", Read);
+
+    /* Growing it again must not bring back what was cut off */
+    SetFilePointer(File, EXTEND_SIZE, NULL, FILE_BEGIN);
+    ok(SetEndOfFile(File), "SetEndOfFile failed with %lu\n", GetLastError());
+    CheckFile(File, 0, TRUNCATE_SIZE, FALSE);
+    CheckFile(File, TRUNCATE_SIZE, EXTEND_SIZE, TRUE);
+
+    /* And deleting gives them back */
+    CloseHandle(File);
+    ok(DeleteFileW(g_FileName), "DeleteFileW failed with %lu\n", GetLastError());
+
+    /* Give some slack for whatever else is writing to the volume */
+    ok(GetFreeClusters(&FreeAfter, &BytesPerCluster), "GetDiskFreeSpaceW failed with %lu\n", GetLastError());
+    ok(FreeAfter + 16 >= FreeBefore,
+       "Free clusters went from %lu to %lu\n", FreeBefore, FreeAfter);
+}
+
+static
+VOID
+BenchmarkWrite(
+    _In_ DWORD ChunkSize,
+    _In_ BOOL Preallocate)
+{
+    LARGE_INTEGER Frequency, Start, Now;
+    DWORD Offset, Written;
+    ULONG Extents = 0;
+    HANDLE File;
+
+    File = CreateFileW(g_FileName, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+        return;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    if (Preallocate)
+    {
+        SetFilePointer(File, FILE_SIZE, NULL, FILE_BEGIN);
+        SetEndOfFile(File);
+        SetFilePointer(File, 0, NULL, FILE_BEGIN);
+    }
+
+    for (Offset = 0; Offset < FILE_SIZE; Offset += ChunkSize)
+    {
+        if (!WriteFile(File, g_Buffer, ChunkSize, &Written, NULL) || Written != ChunkSize)
+        {
+            ok(0, "WriteFile failed at %lu with %lu\n", Offset, GetLastError());
+            break;
+        }
+    }
+    FlushFileBuffers(File);
+
+    QueryPerformanceCounter(&Now);
+
+    /* Appending keeps taking the clusters right after the file */
+    ok(GetExtentCount(File, &Extents), "FSCTL_GET_RETRIEVAL_POINTERS failed with %lu\n", GetLastError());
+    ok(Extents == 1, "File written in %lu KB chunks has %lu runs\n", ChunkSize / 1024, Extents);
+
+    CloseHandle(File);
+    DeleteFileW(g_FileName);
+
+    trace("%u MB in %lu KB writes%s: %I64u KB/s\n",
+          FILE_SIZE / (1024 * 1024),
+          ChunkSize / 1024,
+          Preallocate ? " (preallocated)" : "",
+          (ULONGLONG)Offset / 1024 * Frequency.QuadPart / (Now.QuadPart - Start.QuadPart));
+}
+
+START_TEST(SequentialWrite)
+{
+    WCHAR TempPath[MAX_PATH], FileSystem[MAX_PATH];
+    DWORD FreeClusters, BytesPerCluster;
+
+    GetTempPathW(_countof(TempPath), TempPath);
+    if (!GetVolumePathNameW(TempPath, g_Root, _countof(g_Root)) ||
+        !GetTempFileNameW(TempPath, L"seq", 0, g_FileName))
+    {
+        skip("No temporary file (%lu)\n", GetLastError());
+        return;
+    }
+
+    /* This is about the FAT cluster allocator */
+    if (!GetVolumeInformationW(g_Root, NULL, 0, NULL, NULL, NULL, FileSystem, _countof(FileSystem)) ||
+        _wcsnicmp(FileSystem, L"FAT", 3))
+    {
+        skip("%S is not a FAT volume\n", g_Root);
+        DeleteFileW(g_FileName);
+        return;
+    }
+
+    if (!GetFreeClusters(&FreeClusters, &BytesPerCluster) ||
+        (ULONGLONG)FreeClusters * BytesPerCluster < 4 * FILE_SIZE)
+    {
+        skip("Not enough free space on %S\n", g_Root);
+        DeleteFileW(g_FileName);
+        return;
+    }
+    trace("%S is %S with %lu byte clusters\n", g_Root, FileSystem, BytesPerCluster);
+
+    g_Buffer = VirtualAlloc(NULL, 1024 * 1024, MEM_COMMIT, PAGE_READWRITE);
+    if (!g_Buffer)
+    {
+        skip("Out of memory\n");
+        DeleteFileW(g_FileName);
+        return;
+    }
+    memset(g_Buffer, 0x5a, 1024 * 1024);
+
+    TestAllocation();
+
+    BenchmarkWrite(4 * 1024, FALSE);
+    BenchmarkWrite(64 * 1024, FALSE);
+    BenchmarkWrite(1024 * 1024, FALSE);
+    BenchmarkWrite(64 * 1024, TRUE);
+
+    VirtualFree(g_Buffer, 0, MEM_RELEASE);
+    DeleteFileW(g_FileName);
+}
@@ -0,0 +1,364 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Tests and benchmark for the Vista thread pool
+ */
+
+#include "precomp.h"
+
+#define RUN_TIME_MS             500
+#define THROUGHPUT_BATCH        256
+
+/* XP/2003 do not have these functions, ReactOS has them in kernel32_vista */
+static PTP_WORK (WINAPI *pCreateThreadpoolWork)(PTP_WORK_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static VOID (WINAPI *pSubmitThreadpoolWork)(PTP_WORK);
+static VOID (WINAPI *pWaitForThreadpoolWorkCallbacks)(PTP_WORK, BOOL);
+static VOID (WINAPI *pCloseThreadpoolWork)(PTP_WORK);
+static PTP_TIMER (WINAPI *pCreateThreadpoolTimer)(PTP_TIMER_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static VOID (WINAPI *pSetThreadpoolTimer)(PTP_TIMER, PFILETIME, DWORD, DWORD);
+static BOOL (WINAPI *pIsThreadpoolTimerSet)(PTP_TIMER);
+static VOID (WINAPI *pWaitForThreadpoolTimerCallbacks)(PTP_TIMER, BOOL);
+static VOID (WINAPI *pCloseThreadpoolTimer)(PTP_TIMER);
+static PTP_WAIT (WINAPI *pCreateThreadpoolWait)(PTP_WAIT_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static VOID (WINAPI *pSetThreadpoolWait)(PTP_WAIT, HANDLE, PFILETIME);
+static VOID (WINAPI *pWaitForThreadpoolWaitCallbacks)(PTP_WAIT, BOOL);
+static VOID (WINAPI *pCloseThreadpoolWait)(PTP_WAIT);
+static PTP_CLEANUP_GROUP (WINAPI *pCreateThreadpoolCleanupGroup)(VOID);
+static VOID (WINAPI *pCloseThreadpoolCleanupGroupMembers)(PTP_CLEANUP_GROUP, BOOL, PVOID);
+static VOID (WINAPI *pCloseThreadpoolCleanupGroup)(PTP_CLEANUP_GROUP);
+static VOID (WINAPI *pSetEventWhenCallbackReturns)(PTP_CALLBACK_INSTANCE, HANDLE);
+
+static volatile LONG g_WorkCalls;
+static HANDLE g_CallbackEvent;
+static TP_WAIT_RESULT g_WaitResult;
+
+static
+BOOL
+InitFunctionPointers(VOID)
+{
+    HMODULE hDll;
+
+    hDll = GetModuleHandleW(L"kernel32.dll");
+    if (!GetProcAddress(hDll, "CreateThreadpoolWork"))
+        hDll = LoadLibraryW(L"kernel32_vista.dll");
+    if (!hDll)
+        return FALSE;
+
+#define LOAD(Name) \
+    p##Name = (PVOID)GetProcAddress(hDll, #Name); \
+    if (!p##Name) return FALSE;
+
+    LOAD(CreateThreadpoolWork);
+    LOAD(SubmitThreadpoolWork);
+    LOAD(WaitForThreadpoolWorkCallbacks);
+    LOAD(CloseThreadpoolWork);
+    LOAD(CreateThreadpoolTimer);
+    LOAD(SetThreadpoolTimer);
+    LOAD(IsThreadpoolTimerSet);
+    LOAD(WaitForThreadpoolTimerCallbacks);
+    LOAD(CloseThreadpoolTimer);
+    LOAD(CreateThreadpoolWait);
+    LOAD(SetThreadpoolWait);
+    LOAD(WaitForThreadpoolWaitCallbacks);
+    LOAD(CloseThreadpoolWait);
+    LOAD(CreateThreadpoolCleanupGroup);
+    LOAD(CloseThreadpoolCleanupGroupMembers);
+    LOAD(CloseThreadpoolCleanupGroup);
+    LOAD(SetEventWhenCallbackReturns);
+
+#undef LOAD
+
+    return TRUE;
+}
+
+static
+VOID
+RelativeFileTime(OUT PFILETIME FileTime,
+                 IN ULONG Milliseconds)
+{
+    LARGE_INTEGER Time;
+
+    Time.QuadPart = -(LONGLONG)Milliseconds * 10000;
+    FileTime->dwLowDateTime = Time.LowPart;
+    FileTime->dwHighDateTime = Time.HighPart;
+}
+
+static
+VOID
+NTAPI
+WorkCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WORK Work)
+{
+    ok(Context == &g_WorkCalls, "Context is %p\n", Context);
+    InterlockedIncrement(&g_WorkCalls);
+}
+
+static
+VOID
+NTAPI
+SignalWorkCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WORK Work)
+{
+    pSetEventWhenCallbackReturns(Instance, Context);
+}
+
+static
+VOID
+NTAPI
+CountWorkCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WORK Work)
+{
+    InterlockedIncrement(Context);
+}
+
+static
+VOID
+NTAPI
+TimerCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_TIMER Timer)
+{
+    InterlockedIncrement(Context);
+    SetEvent(g_CallbackEvent);
+}
+
+static
+VOID
+NTAPI
+WaitCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WAIT Wait, TP_WAIT_RESULT WaitResult)
+{
+    g_WaitResult = WaitResult;
+    SetEvent(g_CallbackEvent);
+}
+
+static
+VOID
+TestWork(VOID)
+{
+    PTP_WORK Work;
+    ULONG i;
+
+    Work = pCreateThreadpoolWork(WorkCallback, (PVOID)&g_WorkCalls, NULL);
+    ok(Work != NULL, "CreateThreadpoolWork failed with %lu\n", GetLastError());
+    if (!Work)
+        return;
+
+    g_WorkCalls = 0;
+    for (i = 0; i < 10; i++)
+        pSubmitThreadpoolWork(Work);
+    pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+    ok(g_WorkCalls == 10, "Callback ran %ld times\n", g_WorkCalls);
+
+    pCloseThreadpoolWork(Work);
+}
+
+static
+VOID
+TestTimer(VOID)
+{
+    volatile LONG Calls = 0;
+    PTP_TIMER Timer;
+    FILETIME DueTime;
+    DWORD Result;
+
+    Timer = pCreateThreadpoolTimer(TimerCallback, (PVOID)&Calls, NULL);
+    ok(Timer != NULL, "CreateThreadpoolTimer failed with %lu\n", GetLastError());
+    if (!Timer)
+        return;
+
+    ok(!pIsThreadpoolTimerSet(Timer), "Timer is set\n");
+
+    /* One-shot */
+    RelativeFileTime(&DueTime, 50);
+    pSetThreadpoolTimer(Timer, &DueTime, 0, 0);
+    ok(pIsThreadpoolTimerSet(Timer), "Timer is not set\n");
+    Result = WaitForSingleObject(g_CallbackEvent, 5000);
+    ok_hex(Result, WAIT_OBJECT_0);
+    pWaitForThreadpoolTimerCallbacks(Timer, FALSE);
+    ok(Calls == 1, "Callback ran %ld times\n", Calls);
+    ok(!pIsThreadpoolTimerSet(Timer), "Timer is still set\n");
+
+    /* Periodic, with a window to coalesce in */
+    Calls = 0;
+    RelativeFileTime(&DueTime, 10);
+    pSetThreadpoolTimer(Timer, &DueTime, 20, 10);
+    Sleep(200);
+    pSetThreadpoolTimer(Timer, NULL, 0, 0);
+    pWaitForThreadpoolTimerCallbacks(Timer, TRUE);
+    ok(Calls >= 3, "Callback ran %ld times\n", Calls);
+    ok(!pIsThreadpoolTimerSet(Timer), "Timer is still set\n");
+
+    pCloseThreadpoolTimer(Timer);
+    ResetEvent(g_CallbackEvent);
+}
+
+static
+VOID
+TestWait(VOID)
+{
+    PTP_WAIT Wait;
+    FILETIME Timeout;
+    HANDLE Event;
+    DWORD Result;
+
+    Event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Wait = pCreateThreadpoolWait(WaitCallback, NULL, NULL);
+    ok(Wait != NULL, "CreateThreadpoolWait failed with %lu\n", GetLastError());
+    if (!Wait)
+    {
+        CloseHandle(Event);
+        return;
+    }
+
+    /* Signaled */
+    g_WaitResult = 0xdeadbeef;
+    pSetThreadpoolWait(Wait, Event, NULL);
+    SetEvent(Event);
+    Result = WaitForSingleObject(g_CallbackEvent, 5000);
+    ok_hex(Result, WAIT_OBJECT_0);
+    pWaitForThreadpoolWaitCallbacks(Wait, FALSE);
+    ok_hex(g_WaitResult, WAIT_OBJECT_0);
+
+    /* Timed out */
+    g_WaitResult = 0xdeadbeef;
+    RelativeFileTime(&Timeout, 50);
+    pSetThreadpoolWait(Wait, Event, &Timeout);
+    Result = WaitForSingleObject(g_CallbackEvent, 5000);
+    ok_hex(Result, WAIT_OBJECT_0);
+    pWaitForThreadpoolWaitCallbacks(Wait, FALSE);
+    ok_hex(g_WaitResult, WAIT_TIMEOUT);
+
+    /* Canceled, nothing fires */
+    pSetThreadpoolWait(Wait, Event, NULL);
+    pSetThreadpoolWait(Wait, NULL, NULL);
+    SetEvent(Event);
+    Result = WaitForSingleObject(g_CallbackEvent, 100);
+    ok_hex(Result, WAIT_TIMEOUT);
+
+    pCloseThreadpoolWait(Wait);
+    CloseHandle(Event);
+}
+
+static
+VOID
+TestCleanupGroup(VOID)
+{
+    TP_CALLBACK_ENVIRON Environment;
+    volatile LONG Calls = 0;
+    PTP_CLEANUP_GROUP CleanupGroup;
+    PTP_WORK Work;
+    ULONG i;
+
+    CleanupGroup = pCreateThreadpoolCleanupGroup();
+    ok(CleanupGroup != NULL, "CreateThreadpoolCleanupGroup failed with %lu\n", GetLastError());
+    if (!CleanupGroup)
+        return;
+
+    TpInitializeCallbackEnviron(&Environment);
+    TpSetCallbackCleanupGroup(&Environment, CleanupGroup, NULL);
+
+    for (i = 0; i < 4; i++)
+    {
+        Work = pCreateThreadpoolWork(CountWorkCallback, (PVOID)&Calls, &Environment);
+        ok(Work != NULL, "CreateThreadpoolWork failed with %lu\n", GetLastError());
+        if (Work)
+            pSubmitThreadpoolWork(Work);
+    }
+
+    /* Waits for all of them and closes them */
+    pCloseThreadpoolCleanupGroupMembers(CleanupGroup, FALSE, NULL);
+    ok(Calls == 4, "Callbacks ran %ld times\n", Calls);
+
+    pCloseThreadpoolCleanupGroup(CleanupGroup);
+}
+
+static
+VOID
+BenchmarkLatency(VOID)
+{
+    LARGE_INTEGER Frequency, Start, Now, Submit, Total;
+    ULONGLONG Count = 0;
+    PTP_WORK Work;
+    HANDLE Event;
+
+    Event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Work = pCreateThreadpoolWork(SignalWorkCallback, Event, NULL);
+    if (!Work)
+    {
+        CloseHandle(Event);
+        return;
+    }
+
+    /* One at a time, from submission until the callback returned */
+    Total.QuadPart = 0;
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    do
+    {
+        QueryPerformanceCounter(&Submit);
+        pSubmitThreadpoolWork(Work);
+        WaitForSingleObject(Event, INFINITE);
+        QueryPerformanceCounter(&Now);
+
+        Total.QuadPart += Now.QuadPart - Submit.QuadPart;
+        Count++;
+    } while ((Now.QuadPart - Start.QuadPart) * 1000 < (LONGLONG)RUN_TIME_MS * Frequency.QuadPart);
+
+    pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+    pCloseThreadpoolWork(Work);
+    CloseHandle(Event);
+
+    trace("Submit to callback: %I64u round trips, %I64u ns average\n",
+          Count,
+          Total.QuadPart * 1000000000 / Frequency.QuadPart / Count);
+}
+
+static
+VOID
+BenchmarkThroughput(VOID)
+{
+    LARGE_INTEGER Frequency, Start, Now;
+    volatile LONG Calls = 0;
+    ULONGLONG Elapsed;
+    PTP_WORK Work;
+    ULONG i;
+
+    Work = pCreateThreadpoolWork(CountWorkCallback, (PVOID)&Calls, NULL);
+    if (!Work)
+        return;
+
+    /* Keep the pool busy, batch after batch */
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    do
+    {
+        for (i = 0; i < THROUGHPUT_BATCH; i++)
+            pSubmitThreadpoolWork(Work);
+        pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+        QueryPerformanceCounter(&Now);
+    } while ((Now.QuadPart - Start.QuadPart) * 1000 < (LONGLONG)RUN_TIME_MS * Frequency.QuadPart);
+
+    pCloseThreadpoolWork(Work);
+
+    Elapsed = (Now.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart;
+    trace("Throughput: %ld callbacks in %I64u ms, %I64u callbacks/s\n",
+          Calls,
+          Elapsed,
+          (ULONGLONG)Calls * 1000 / max(Elapsed, 1));
+}
+
+START_TEST(ThreadPool)
+{
+    if (!InitFunctionPointers())
+    {
+        skip("Thread pool functions are not available\n");
+        return;
+    }
+
+    g_CallbackEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+    TestWork();
+    TestTimer();
+    TestWait();
+    TestCleanupGroup();
+
+    BenchmarkLatency();
+    BenchmarkThroughput();
+
+    CloseHandle(g_CallbackEvent);
+}
@@ -0,0 +1,258 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Tests and benchmark for coalescable and high resolution waitable timers
+ */
+
+#include "precomp.h"
+
+#define RUN_TIME_MS             1000
+#define TIMER_COUNT             64
+
+#ifndef CREATE_WAITABLE_TIMER_MANUAL_RESET
+#define CREATE_WAITABLE_TIMER_MANUAL_RESET 0x1
+#endif
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x2
+#endif
+
+/* XP/2003 do not have these functions, ReactOS has them in kernel32_vista */
+static HANDLE (WINAPI *pCreateWaitableTimerExW)(LPSECURITY_ATTRIBUTES, LPCWSTR, DWORD, DWORD);
+static BOOL (WINAPI *pSetWaitableTimerEx)(HANDLE, const LARGE_INTEGER*, LONG, PTIMERAPCROUTINE, PVOID, PVOID, ULONG);
+
+static ULONG g_Expirations;
+
+static
+BOOL
+InitFunctionPointers(VOID)
+{
+    HMODULE hDll;
+
+    hDll = GetModuleHandleW(L"kernel32.dll");
+    if (!GetProcAddress(hDll, "SetWaitableTimerEx"))
+        hDll = LoadLibraryW(L"kernel32_vista.dll");
+    if (!hDll)
+        return FALSE;
+
+    pCreateWaitableTimerExW = (PVOID)GetProcAddress(hDll, "CreateWaitableTimerExW");
+    pSetWaitableTimerEx = (PVOID)GetProcAddress(hDll, "SetWaitableTimerEx");
+
+    /* kernel32_vista needs the system call, which ntdll only exports when built for Windows 7 */
+    return (pCreateWaitableTimerExW && pSetWaitableTimerEx &&
+            GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "NtSetTimerEx"));
+}
+
+static
+VOID
+CALLBACK
+TimerApc(
+    _In_opt_ PVOID Context,
+    _In_ DWORD TimerLowValue,
+    _In_ DWORD TimerHighValue)
+{
+    /* Only ever called on the thread that set the timers */
+    g_Expirations++;
+}
+
+static
+VOID
+TestCreate(VOID)
+{
+    LARGE_INTEGER DueTime;
+    HANDLE Timer, Timer2;
+    DWORD Start, Elapsed;
+
+    /* Unknown flags */
+    SetLastError(0xdeadbeef);
+    Timer = pCreateWaitableTimerExW(NULL, NULL, 0x80, TIMER_ALL_ACCESS);
+    ok(Timer == NULL, "Timer created with an invalid flag\n");
+    ok_err(ERROR_INVALID_PARAMETER);
+
+    /* A manual reset timer stays signaled */
+    Timer = pCreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_MANUAL_RESET, TIMER_ALL_ACCESS);
+    ok(Timer != NULL, "CreateWaitableTimerExW failed with %lu\n", GetLastError());
+    if (Timer)
+    {
+        DueTime.QuadPart = -10 * 10000;
+        ok(pSetWaitableTimerEx(Timer, &DueTime, 0, NULL, NULL, NULL, 0),
+           "SetWaitableTimerEx failed with %lu\n", GetLastError());
+        ok_long(WaitForSingleObject(Timer, 1000), WAIT_OBJECT_0);
+        ok_long(WaitForSingleObject(Timer, 0), WAIT_OBJECT_0);
+        CloseHandle(Timer);
+    }
+
+    /* An auto reset one does not, and may expire late by its tolerable delay */
+    Timer = pCreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+    ok(Timer != NULL, "CreateWaitableTimerExW failed with %lu\n", GetLastError());
+    if (Timer)
+    {
+        DueTime.QuadPart = -10 * 10000;
+        Start = GetTickCount();
+        ok(pSetWaitableTimerEx(Timer, &DueTime, 0, NULL, NULL, NULL, 100),
+           "SetWaitableTimerEx failed with %lu\n", GetLastError());
+        ok_long(WaitForSingleObject(Timer, 1000), WAIT_OBJECT_0);
+        Elapsed = GetTickCount() - Start;
+        ok(Elapsed < 10 + 100 + 100, "Timer expired after %lu ms\n", Elapsed);
+        ok_long(WaitForSingleObject(Timer, 0), WAIT_TIMEOUT);
+        CloseHandle(Timer);
+    }
+
+    /* The handle only has the access that was asked for */
+    Timer = pCreateWaitableTimerExW(NULL, NULL, 0, SYNCHRONIZE);
+    ok(Timer != NULL, "CreateWaitableTimerExW failed with %lu\n", GetLastError());
+    if (Timer)
+    {
+        DueTime.QuadPart = -10 * 10000;
+        SetLastError(0xdeadbeef);
+        ok(!pSetWaitableTimerEx(Timer, &DueTime, 0, NULL, NULL, NULL, 0),
+           "SetWaitableTimerEx succeeded without TIMER_MODIFY_STATE\n");
+        ok_err(ERROR_ACCESS_DENIED);
+        CloseHandle(Timer);
+    }
+
+    /* Periodic timers with an APC */
+    Timer = pCreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+    ok(Timer != NULL, "CreateWaitableTimerExW failed with %lu\n", GetLastError());
+    if (Timer)
+    {
+        g_Expirations = 0;
+        DueTime.QuadPart = -10 * 10000;
+        ok(pSetWaitableTimerEx(Timer, &DueTime, 10, TimerApc, NULL, NULL, 20),
+           "SetWaitableTimerEx failed with %lu\n", GetLastError());
+        while (g_Expirations < 3)
+        {
+            if (SleepEx(1000, TRUE) != WAIT_IO_COMPLETION)
+                break;
+        }
+        ok(g_Expirations >= 3, "Timer expired %lu times\n", g_Expirations);
+        CancelWaitableTimer(Timer);
+        CloseHandle(Timer);
+    }
+
+    /* Opening an existing named timer with the high resolution flag leaves it as it was */
+    Timer = pCreateWaitableTimerExW(NULL, L"ReactOS_WaitableTimer", 0, TIMER_ALL_ACCESS);
+    ok(Timer != NULL, "CreateWaitableTimerExW failed with %lu\n", GetLastError());
+    if (Timer)
+    {
+        Timer2 = pCreateWaitableTimerExW(NULL, L"ReactOS_WaitableTimer", CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, SYNCHRONIZE);
+        ok(Timer2 != NULL, "CreateWaitableTimerExW failed with %lu\n", GetLastError());
+        ok(GetLastError() == ERROR_ALREADY_EXISTS, "Last error is %lu\n", GetLastError());
+        if (Timer2)
+            CloseHandle(Timer2);
+        CloseHandle(Timer);
+    }
+}
+
+static
+VOID
+TestHighResolution(VOID)
+{
+    ULONG MinimumResolution, MaximumResolution, Before, Armed;
+    LARGE_INTEGER DueTime;
+    HANDLE Timer;
+
+    Timer = pCreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!Timer)
+    {
+        /* Before Windows 10 1803 */
+        skip("High resolution timers are not supported (%lu)\n", GetLastError());
+        return;
+    }
+
+    /* The minimum is the smallest clock increment, so the highest resolution */
+    NtQueryTimerResolution(&MaximumResolution, &MinimumResolution, &Before);
+
+    /* The clock runs faster while the timer is set */
+    DueTime.QuadPart = -1 * 10000;
+    ok(pSetWaitableTimerEx(Timer, &DueTime, 1, NULL, NULL, NULL, 0),
+       "SetWaitableTimerEx failed with %lu\n", GetLastError());
+    NtQueryTimerResolution(&MaximumResolution, &MinimumResolution, &Armed);
+    if (Before > MinimumResolution)
+        ok(Armed < Before, "Resolution went from %lu to %lu\n", Before, Armed);
+    else
+        ok(Armed == Before, "Resolution went from %lu to %lu\n", Before, Armed);
+    trace("Resolution %lu, %lu with a high resolution timer (minimum %lu)\n",
+          Before, Armed, MinimumResolution);
+
+    ok_long(WaitForSingleObject(Timer, 1000), WAIT_OBJECT_0);
+    ok_long(WaitForSingleObject(Timer, 1000), WAIT_OBJECT_0);
+
+    CancelWaitableTimer(Timer);
+    CloseHandle(Timer);
+}
+
+static
+VOID
+BenchmarkWakeups(
+    _In_ DWORD Flags,
+    _In_ ULONG TolerableDelay)
+{
+    HANDLE Timers[TIMER_COUNT];
+    LARGE_INTEGER DueTime;
+    ULONGLONG Wakeups = 0;
+    DWORD Start, Elapsed;
+    ULONG i;
+
+    /* Periods of 20 to 32 ms, with staggered first expirations */
+    for (i = 0; i < TIMER_COUNT; i++)
+    {
+        Timers[i] = pCreateWaitableTimerExW(NULL, NULL, Flags, TIMER_ALL_ACCESS);
+        if (!Timers[i])
+        {
+            skip("Could not create timer %lu (%lu)\n", i, GetLastError());
+            while (i--) CloseHandle(Timers[i]);
+            return;
+        }
+    }
+
+    g_Expirations = 0;
+    for (i = 0; i < TIMER_COUNT; i++)
+    {
+        DueTime.QuadPart = -(LONGLONG)(10 + i) * 10000;
+        pSetWaitableTimerEx(Timers[i], &DueTime, 20 + (i % 5) * 3, TimerApc, NULL, NULL, TolerableDelay);
+    }
+
+    /* Every return from an alertable sleep is one wakeup, however many APCs it ran */
+    Start = GetTickCount();
+    do
+    {
+        if (SleepEx(100, TRUE) == WAIT_IO_COMPLETION)
+            Wakeups++;
+        Elapsed = GetTickCount() - Start;
+    } while (Elapsed < RUN_TIME_MS);
+
+    for (i = 0; i < TIMER_COUNT; i++)
+    {
+        CancelWaitableTimer(Timers[i]);
+        CloseHandle(Timers[i]);
+    }
+
+    /* Flush the APCs that were already queued */
+    while (SleepEx(0, TRUE) == WAIT_IO_COMPLETION);
+
+    ok(g_Expirations > 0, "No timer expired\n");
+    trace("%u timers%s, %lu ms tolerable delay: %I64u wakeups/s, %I64u expirations/s\n",
+          TIMER_COUNT,
+          (Flags & CREATE_WAITABLE_TIMER_HIGH_RESOLUTION) ? " (high resolution)" : "",
+          TolerableDelay,
+          Wakeups * 1000 / Elapsed,
+          (ULONGLONG)g_Expirations * 1000 / Elapsed);
+}
+
+START_TEST(WaitableTimer)
+{
+    if (!InitFunctionPointers())
+    {
+        skip("SetWaitableTimerEx is not available\n");
+        return;
+    }
+
+    TestCreate();
+    TestHighResolution();
+
+    BenchmarkWakeups(0, 0);
+    BenchmarkWakeups(0, 10);
+    BenchmarkWakeups(0, 50);
+    BenchmarkWakeups(0, 250);
+    BenchmarkWakeups(CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, 0);
+}
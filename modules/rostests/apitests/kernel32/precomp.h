@@ -13,6 +13,7 @@
 #include <ndk/umtypes.h>
 #include <ndk/extypes.h>
 #include <ndk/exfuncs.h>
+#include <ndk/kefuncs.h>
 #include <ndk/rtlfuncs.h>
 
 #endif /* _KERNEL32_APITEST_PRECOMP_H_ */
@@ -0,0 +1,165 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for LdrFindEntryForAddress and loader export lookups
+ */
+
+#include "precomp.h"
+
+#define RUN_TIME_MS             500
+
+static
+VOID
+TestModule(
+    _In_ PCWSTR ModuleName)
+{
+    PLDR_DATA_TABLE_ENTRY LdrEntry;
+    PIMAGE_NT_HEADERS NtHeader;
+    PUCHAR DllBase, DllEnd;
+    PVOID ImageBase;
+    NTSTATUS Status;
+
+    DllBase = (PUCHAR)GetModuleHandleW(ModuleName);
+    ok(DllBase != NULL, "%S is not loaded\n", ModuleName);
+    if (!DllBase)
+        return;
+
+    NtHeader = RtlImageNtHeader(DllBase);
+    DllEnd = DllBase + NtHeader->OptionalHeader.SizeOfImage;
+
+    /* First and last byte of the image */
+    LdrEntry = NULL;
+    Status = LdrFindEntryForAddress(DllBase, &LdrEntry);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok(LdrEntry && LdrEntry->DllBase == DllBase, "Wrong entry %p for %S\n", LdrEntry, ModuleName);
+
+    LdrEntry = NULL;
+    Status = LdrFindEntryForAddress(DllEnd - 1, &LdrEntry);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok(LdrEntry && LdrEntry->DllBase == DllBase, "Wrong entry %p for %S\n", LdrEntry, ModuleName);
+
+    /* Right after it, which is another module at most */
+    LdrEntry = NULL;
+    Status = LdrFindEntryForAddress(DllEnd, &LdrEntry);
+    if (NT_SUCCESS(Status))
+        ok(LdrEntry && LdrEntry->DllBase != DllBase, "Found %S past its end\n", ModuleName);
+    else
+        ok_hex(Status, STATUS_NO_MORE_ENTRIES);
+
+    ImageBase = (PVOID)0xdeadbeef;
+    ok(RtlPcToFileHeader(DllBase + NtHeader->OptionalHeader.AddressOfEntryPoint, &ImageBase) == DllBase,
+       "RtlPcToFileHeader failed for %S\n", ModuleName);
+    ok(ImageBase == DllBase, "ImageBase is %p, expected %p\n", ImageBase, DllBase);
+}
+
+static
+VOID
+BenchmarkAddressLookup(VOID)
+{
+    LARGE_INTEGER Frequency, Start, Now;
+    PLDR_DATA_TABLE_ENTRY LdrEntry;
+    ULONGLONG Lookups = 0;
+    ULONG i;
+
+    /* An address in the test itself, like exception dispatch would look up */
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    do
+    {
+        for (i = 0; i < 1000; i++)
+            LdrFindEntryForAddress((PVOID)BenchmarkAddressLookup, &LdrEntry);
+        Lookups += i;
+        NtQueryPerformanceCounter(&Now, NULL);
+    } while ((Now.QuadPart - Start.QuadPart) * 1000 < (LONGLONG)RUN_TIME_MS * Frequency.QuadPart);
+
+    trace("LdrFindEntryForAddress: %I64u lookups/s\n",
+          Lookups * Frequency.QuadPart / (Now.QuadPart - Start.QuadPart));
+}
+
+static
+VOID
+BenchmarkExportLookup(
+    _In_ PCWSTR ModuleName)
+{
+    LARGE_INTEGER Frequency, Start, Now;
+    PIMAGE_EXPORT_DIRECTORY ExportDirectory;
+    ULONGLONG Lookups = 0;
+    ANSI_STRING Name;
+    PVOID Procedure;
+    NTSTATUS Status;
+    HMODULE Module;
+    PULONG NameTable;
+    ULONG Size, i;
+
+    Module = LoadLibraryW(ModuleName);
+    if (!Module)
+    {
+        skip("%S could not be loaded\n", ModuleName);
+        return;
+    }
+
+    ExportDirectory = RtlImageDirectoryEntryToData(Module, TRUE, IMAGE_DIRECTORY_ENTRY_EXPORT, &Size);
+    ok(ExportDirectory != NULL, "%S has no exports\n", ModuleName);
+    if (!ExportDirectory || !ExportDirectory->NumberOfNames)
+    {
+        FreeLibrary(Module);
+        return;
+    }
+    NameTable = (PULONG)((ULONG_PTR)Module + ExportDirectory->AddressOfNames);
+
+    /* Every name must resolve, and an unknown one must not */
+    for (i = 0; i < ExportDirectory->NumberOfNames; i++)
+    {
+        RtlInitAnsiString(&Name, (PCSZ)((ULONG_PTR)Module + NameTable[i]));
+        Status = LdrGetProcedureAddress(Module, &Name, 0, &Procedure);
+        if (!NT_SUCCESS(Status))
+        {
+            ok_hex(Status, STATUS_SUCCESS);
+            trace("Failed to look up %Z in %S\n", &Name, ModuleName);
+            break;
+        }
+    }
+
+    RtlInitAnsiString(&Name, "ThisFunctionDoesNotExist");
+    Status = LdrGetProcedureAddress(Module, &Name, 0, &Procedure);
+    ok_hex(Status, STATUS_PROCEDURE_NOT_FOUND);
+
+    /* By name, cycling through the whole export table */
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    do
+    {
+        for (i = 0; i < ExportDirectory->NumberOfNames; i++)
+        {
+            RtlInitAnsiString(&Name, (PCSZ)((ULONG_PTR)Module + NameTable[i]));
+            LdrGetProcedureAddress(Module, &Name, 0, &Procedure);
+        }
+        Lookups += i;
+        NtQueryPerformanceCounter(&Now, NULL);
+    } while ((Now.QuadPart - Start.QuadPart) * 1000 < (LONGLONG)RUN_TIME_MS * Frequency.QuadPart);
+
+    trace("LdrGetProcedureAddress: %lu names in %S, %I64u lookups/s\n",
+          ExportDirectory->NumberOfNames,
+          ModuleName,
+          Lookups * Frequency.QuadPart / (Now.QuadPart - Start.QuadPart));
+
+    FreeLibrary(Module);
+}
+
+START_TEST(LdrFindEntryForAddress)
+{
+    PLDR_DATA_TABLE_ENTRY LdrEntry;
+    NTSTATUS Status;
+
+    TestModule(L"ntdll.dll");
+    TestModule(L"kernel32.dll");
+    TestModule(NULL);
+
+    /* Nothing is mapped at the bottom of the address space */
+    LdrEntry = (PVOID)0xdeadbeef;
+    Status = LdrFindEntryForAddress((PVOID)0x1000, &LdrEntry);
+    ok_hex(Status, STATUS_NO_MORE_ENTRIES);
+    ok(LdrEntry == (PVOID)0xdeadbeef, "LdrEntry is %p\n", LdrEntry);
+
+    BenchmarkAddressLookup();
+    BenchmarkExportLookup(L"kernel32.dll");
+    BenchmarkExportLookup(L"shell32.dll");
+}
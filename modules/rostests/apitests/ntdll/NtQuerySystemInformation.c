@@ -7,6 +7,340 @@
 
 #include "precomp.h"
 
+#define SCAN_FILE_SIZE  (1024 * 1024)
+
+/* Fault in a freshly written, uncached file and check the paging counters move */
+static
+void
+Test_PageReadClustering(void)
+{
+    SYSTEM_PERFORMANCE_INFORMATION Before, After;
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    HANDLE hFile, hMapping;
+    PUCHAR Buffer, View;
+    DWORD Written;
+    ULONG i, Faults, Pages, Reads, Sum = 0;
+    NTSTATUS Status;
+
+    GetTempPathW(_countof(TempPath), TempPath);
+    GetTempFileNameW(TempPath, L"pfc", 0, FileName);
+
+    /* Write the file around the cache, so that mapping it has to read from disk */
+    hFile = CreateFileW(FileName, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                        FILE_FLAG_NO_BUFFERING | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    ok(hFile != INVALID_HANDLE_VALUE, "CreateFileW failed: %lu\n", GetLastError());
+    if (hFile == INVALID_HANDLE_VALUE)
+        return;
+
+    Buffer = VirtualAlloc(NULL, SCAN_FILE_SIZE, MEM_COMMIT, PAGE_READWRITE);
+    ok(Buffer != NULL, "VirtualAlloc failed: %lu\n", GetLastError());
+    if (!Buffer)
+    {
+        CloseHandle(hFile);
+        return;
+    }
+    FillMemory(Buffer, SCAN_FILE_SIZE, 0x5A);
+    ok(WriteFile(hFile, Buffer, SCAN_FILE_SIZE, &Written, NULL), "WriteFile failed: %lu\n", GetLastError());
+    VirtualFree(Buffer, 0, MEM_RELEASE);
+
+    hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    ok(hMapping != NULL, "CreateFileMappingW failed: %lu\n", GetLastError());
+    View = hMapping ? MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    ok(View != NULL, "MapViewOfFile failed: %lu\n", GetLastError());
+    if (!View)
+    {
+        if (hMapping)
+            CloseHandle(hMapping);
+        CloseHandle(hFile);
+        return;
+    }
+
+    Status = NtQuerySystemInformation(SystemPerformanceInformation, &Before, sizeof(Before), NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+
+    /* A sequential scan, one touch per page */
+    for (i = 0; i < SCAN_FILE_SIZE; i += PAGE_SIZE)
+        Sum += View[i];
+
+    Status = NtQuerySystemInformation(SystemPerformanceInformation, &After, sizeof(After), NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+
+    Faults = After.PageFaultCount - Before.PageFaultCount;
+    Pages = After.PageReadCount - Before.PageReadCount;
+    Reads = After.PageReadIoCount - Before.PageReadIoCount;
+    ok(Faults != 0, "No page faults counted\n");
+    ok(Reads != 0, "No paging reads counted\n");
+    ok(Sum == 0x5A * (SCAN_FILE_SIZE / PAGE_SIZE), "Wrong data read: %lu\n", Sum);
+
+    /* Each read must bring in a cluster of pages, not just the faulting one */
+    ok(Pages >= 4 * Reads, "Read %lu pages in %lu reads\n", Pages, Reads);
+    trace("%lu pages: %lu faults, %lu pages read in %lu reads\n",
+          (ULONG)(SCAN_FILE_SIZE / PAGE_SIZE), Faults, Pages, Reads);
+
+    UnmapViewOfFile(View);
+    CloseHandle(hMapping);
+    CloseHandle(hFile);
+}
+
+/* Write a file through the cache and flush it, the dirty pages should go out in large writes */
+static
+void
+Test_FlushClustering(void)
+{
+    SYSTEM_PERFORMANCE_INFORMATION Before, After;
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    HANDLE hFile;
+    PUCHAR Buffer;
+    DWORD Written;
+    ULONG Pages, Writes;
+    NTSTATUS Status;
+
+    GetTempPathW(_countof(TempPath), TempPath);
+    GetTempFileNameW(TempPath, L"fwc", 0, FileName);
+
+    hFile = CreateFileW(FileName, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                        FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    ok(hFile != INVALID_HANDLE_VALUE, "CreateFileW failed: %lu\n", GetLastError());
+    if (hFile == INVALID_HANDLE_VALUE)
+        return;
+
+    Buffer = VirtualAlloc(NULL, SCAN_FILE_SIZE, MEM_COMMIT, PAGE_READWRITE);
+    ok(Buffer != NULL, "VirtualAlloc failed: %lu\n", GetLastError());
+    if (!Buffer)
+    {
+        CloseHandle(hFile);
+        return;
+    }
+    FillMemory(Buffer, SCAN_FILE_SIZE, 0xA5);
+
+    Status = NtQuerySystemInformation(SystemPerformanceInformation, &Before, sizeof(Before), NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+
+    ok(WriteFile(hFile, Buffer, SCAN_FILE_SIZE, &Written, NULL), "WriteFile failed: %lu\n", GetLastError());
+    ok(FlushFileBuffers(hFile), "FlushFileBuffers failed: %lu\n", GetLastError());
+
+    Status = NtQuerySystemInformation(SystemPerformanceInformation, &After, sizeof(After), NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+
+    Pages = After.MappedPagesWriteCount - Before.MappedPagesWriteCount;
+    Writes = After.MappedWriteIoCount - Before.MappedWriteIoCount;
+    ok(Writes != 0, "No paging writes counted\n");
+    ok(Pages >= SCAN_FILE_SIZE / PAGE_SIZE, "Only %lu pages written\n", Pages);
+    ok(Pages > Writes, "Wrote %lu pages in %lu writes\n", Pages, Writes);
+    trace("%lu pages written in %lu writes, %lu lazy writes of %lu pages\n",
+          Pages, Writes,
+          After.CcLazyWriteIos - Before.CcLazyWriteIos,
+          After.CcLazyWritePages - Before.CcLazyWritePages);
+
+    VirtualFree(Buffer, 0, MEM_RELEASE);
+    CloseHandle(hFile);
+}
+
+/* The pool tag counters are kept per processor, the query must sum them up */
+static
+void
+Test_PoolTagInformation(void)
+{
+    PSYSTEM_POOLTAG_INFORMATION PoolTags;
+    PSYSTEM_BIGPOOL_INFORMATION BigPool;
+    ULONG Length, i, Tags;
+    NTSTATUS Status;
+
+    Length = 0;
+    Status = NtQuerySystemInformation(SystemPoolTagInformation, NULL, 0, &Length);
+    ok_hex(Status, STATUS_INFO_LENGTH_MISMATCH);
+
+    Length = 256 * 1024;
+    PoolTags = HeapAlloc(GetProcessHeap(), 0, Length);
+    if (!PoolTags)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+    Status = NtQuerySystemInformation(SystemPoolTagInformation, PoolTags, Length, &Length);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+    {
+        ok(PoolTags->Count != 0, "No pool tags\n");
+        ok(Length == FIELD_OFFSET(SYSTEM_POOLTAG_INFORMATION, TagInfo[PoolTags->Count]),
+           "Length %lu for %lu tags\n", Length, PoolTags->Count);
+
+        /* Every tag must only show up once, whatever processor used it */
+        for (i = 0, Tags = 0; i < PoolTags->Count; i++)
+        {
+            ok(PoolTags->TagInfo[i].PagedAllocs >= PoolTags->TagInfo[i].PagedFrees,
+               "Tag %lu: %lu paged allocs, %lu frees\n", i,
+               PoolTags->TagInfo[i].PagedAllocs, PoolTags->TagInfo[i].PagedFrees);
+            ok(PoolTags->TagInfo[i].NonPagedAllocs >= PoolTags->TagInfo[i].NonPagedFrees,
+               "Tag %lu: %lu nonpaged allocs, %lu frees\n", i,
+               PoolTags->TagInfo[i].NonPagedAllocs, PoolTags->TagInfo[i].NonPagedFrees);
+            if (i > 0 && PoolTags->TagInfo[i].TagUlong == PoolTags->TagInfo[0].TagUlong)
+                Tags++;
+        }
+        ok(Tags == 0, "First tag found %lu more times\n", Tags);
+    }
+    HeapFree(GetProcessHeap(), 0, PoolTags);
+
+    Length = 0;
+    Status = NtQuerySystemInformation(SystemBigPoolInformation, NULL, 0, &Length);
+    ok_hex(Status, STATUS_INFO_LENGTH_MISMATCH);
+
+    Length = 256 * 1024;
+    BigPool = HeapAlloc(GetProcessHeap(), 0, Length);
+    if (!BigPool)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+    Status = NtQuerySystemInformation(SystemBigPoolInformation, BigPool, Length, &Length);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+    {
+        ok(BigPool->Count != 0, "No big pool allocations\n");
+        for (i = 0; i < BigPool->Count; i++)
+        {
+            ok(BigPool->AllocatedInfo[i].SizeInBytes != 0, "Entry %lu has no size\n", i);
+            ok(((ULONG_PTR)BigPool->AllocatedInfo[i].VirtualAddress & ~1 & (PAGE_SIZE - 1)) == 0,
+               "Entry %lu at %p is not page aligned\n", i, BigPool->AllocatedInfo[i].VirtualAddress);
+        }
+    }
+    HeapFree(GetProcessHeap(), 0, BigPool);
+}
+
+/* Every node has the three executive work queues, and they keep running */
+static
+void
+Test_WorkQueueInformation(void)
+{
+    PSYSTEM_WORK_QUEUE_INFORMATION Before, After;
+    ULONG Length, i;
+    NTSTATUS Status;
+
+    Length = 0;
+    Status = NtQuerySystemInformation(SystemWorkQueueInformation, NULL, 0, &Length);
+    ok_hex(Status, STATUS_INFO_LENGTH_MISMATCH);
+
+    Length = 64 * 1024;
+    Before = HeapAlloc(GetProcessHeap(), 0, Length);
+    After = HeapAlloc(GetProcessHeap(), 0, Length);
+    if (!Before || !After)
+    {
+        skip("Out of memory\n");
+        HeapFree(GetProcessHeap(), 0, Before);
+        HeapFree(GetProcessHeap(), 0, After);
+        return;
+    }
+
+    Status = NtQuerySystemInformation(SystemWorkQueueInformation, Before, Length, &Length);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+
+    ok(Before->Count != 0 && (Before->Count % 3) == 0, "%lu work queues\n", Before->Count);
+    ok(Length == FIELD_OFFSET(SYSTEM_WORK_QUEUE_INFORMATION, Queue[Before->Count]),
+       "Length %lu for %lu queues\n", Length, Before->Count);
+
+    /* A buffer one entry short must be rejected, and say how much is needed */
+    Status = NtQuerySystemInformation(SystemWorkQueueInformation, After,
+                                      Length - sizeof(SYSTEM_WORK_QUEUE_ENTRY), &i);
+    ok_hex(Status, STATUS_INFO_LENGTH_MISMATCH);
+    ok(i == Length, "Needed %lu, expected %lu\n", i, Length);
+
+    for (i = 0; i < Before->Count; i++)
+    {
+        ok(Before->Queue[i].QueueType == i % 3, "Queue %lu has type %u\n", i, Before->Queue[i].QueueType);
+        ok(Before->Queue[i].WorkerCount != 0, "Queue %lu has no workers\n", i);
+        ok(Before->Queue[i].DynamicThreadCount <= 16, "Queue %lu has %lu dynamic threads\n",
+           i, Before->Queue[i].DynamicThreadCount);
+    }
+
+    /* Closing files and such queues more work, the counters never go back */
+    Sleep(1500);
+    Status = NtQuerySystemInformation(SystemWorkQueueInformation, After, Length, &Length);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status) || After->Count != Before->Count)
+        goto Cleanup;
+
+    for (i = 0; i < After->Count; i++)
+    {
+        ok(After->Queue[i].WorkItemsQueued >= Before->Queue[i].WorkItemsQueued,
+           "Queue %lu: %lu items queued, was %lu\n", i,
+           After->Queue[i].WorkItemsQueued, Before->Queue[i].WorkItemsQueued);
+        ok(After->Queue[i].WorkItemsProcessed >= Before->Queue[i].WorkItemsProcessed,
+           "Queue %lu: %lu items processed, was %lu\n", i,
+           After->Queue[i].WorkItemsProcessed, Before->Queue[i].WorkItemsProcessed);
+        ok(After->Queue[i].WaitTime >= Before->Queue[i].WaitTime,
+           "Queue %lu: wait time went back\n", i);
+    }
+
+Cleanup:
+    HeapFree(GetProcessHeap(), 0, Before);
+    HeapFree(GetProcessHeap(), 0, After);
+}
+
+/* The prefetcher is queried through a PREFETCHER_INFORMATION envelope */
+static
+void
+Test_PrefetcherInformation(void)
+{
+    PREFETCHER_INFORMATION Request;
+    SYSTEM_PREFETCHER_STATISTICS Before, After;
+    NTSTATUS Status;
+    ULONG Length;
+
+    Length = 0;
+    Status = NtQuerySystemInformation(SystemPrefetcherInformation, &Request, sizeof(Request) - 1, &Length);
+    ok_hex(Status, STATUS_INFO_LENGTH_MISMATCH);
+    ok(Length == sizeof(Request), "Length %lu\n", Length);
+
+    /* Anything but the current version and magic is refused */
+    Request.Version = PF_CURRENT_VERSION;
+    Request.Magic = 0;
+    Request.PrefetcherInformationClass = PrefetcherStatistics;
+    Request.PrefetcherInformation = &Before;
+    Request.PrefetcherInformationLength = sizeof(Before);
+    Status = NtQuerySystemInformation(SystemPrefetcherInformation, &Request, sizeof(Request), &Length);
+    ok_hex(Status, STATUS_INVALID_PARAMETER);
+
+    Request.Version = PF_CURRENT_VERSION + 1;
+    Request.Magic = PF_SYSINFO_MAGIC_NUMBER;
+    Status = NtQuerySystemInformation(SystemPrefetcherInformation, &Request, sizeof(Request), &Length);
+    ok_hex(Status, STATUS_INVALID_PARAMETER);
+
+    /* The statistics are a ReactOS extension */
+    Request.Version = PF_CURRENT_VERSION;
+    Request.PrefetcherInformationLength = sizeof(Before) - 1;
+    Status = NtQuerySystemInformation(SystemPrefetcherInformation, &Request, sizeof(Request), &Length);
+    ok_hex(Status, STATUS_INFO_LENGTH_MISMATCH);
+
+    Request.PrefetcherInformation = (PVOID)(ULONG_PTR)0x1;
+    Request.PrefetcherInformationLength = sizeof(Before);
+    Status = NtQuerySystemInformation(SystemPrefetcherInformation, &Request, sizeof(Request), &Length);
+    ok_hex(Status, STATUS_DATATYPE_MISALIGNMENT);
+
+    Request.PrefetcherInformation = &Before;
+    Status = NtQuerySystemInformation(SystemPrefetcherInformation, &Request, sizeof(Request), &Length);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    ok((Before.EnabledFlags & ~3) == 0, "EnabledFlags 0x%lx\n", Before.EnabledFlags);
+    ok(Before.TracesSaved <= Before.TracesCompleted, "%lu traces saved out of %lu\n",
+       Before.TracesSaved, Before.TracesCompleted);
+
+    /* The counters only ever grow */
+    Request.PrefetcherInformation = &After;
+    Status = NtQuerySystemInformation(SystemPrefetcherInformation, &Request, sizeof(Request), &Length);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok(After.TracesCompleted >= Before.TracesCompleted, "TracesCompleted went back\n");
+    ok(After.ScenariosPrefetched >= Before.ScenariosPrefetched, "ScenariosPrefetched went back\n");
+    ok(After.PagesPrefetched >= Before.PagesPrefetched, "PagesPrefetched went back\n");
+    ok(After.PrefetchedHits >= Before.PrefetchedHits, "PrefetchedHits went back\n");
+    ok(After.ColdHits >= Before.ColdHits, "ColdHits went back\n");
+    trace("Prefetched: %lu hits, %lu misses. Cold: %lu hits, %lu misses\n",
+          After.PrefetchedHits, After.PrefetchedMisses, After.ColdHits, After.ColdMisses);
+}
+
 START_TEST(NtQuerySystemInformation)
 {
     NTSTATUS Status;
@@ -16,4 +350,10 @@ START_TEST(NtQuerySystemInformation)
     
     Status = NtQuerySystemInformation(0x80000000, NULL, 0, NULL);
     ok_hex(Status, STATUS_INVALID_INFO_CLASS);
+
+    Test_PageReadClustering();
+    Test_FlushClustering();
+    Test_PoolTagInformation();
+    Test_WorkQueueInformation();
+    Test_PrefetcherInformation();
 }
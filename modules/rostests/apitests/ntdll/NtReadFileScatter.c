@@ -0,0 +1,275 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for NtReadFileScatter and NtWriteFileGather
+ */
+
+#include "precomp.h"
+
+#define FILE_PAGES      256
+#define RUN_TIME_MS     500
+
+static
+VOID
+BuildSegments(
+    _Out_writes_(FILE_PAGES + 1) PFILE_SEGMENT_ELEMENT Segments,
+    _In_ PUCHAR Buffer,
+    _In_ BOOLEAN Reverse)
+{
+    ULONG i;
+
+    for (i = 0; i < FILE_PAGES; i++)
+    {
+        Segments[i].Alignment = (ULONG_PTR)(Buffer + (Reverse ? FILE_PAGES - 1 - i : i) * PAGE_SIZE);
+    }
+    Segments[FILE_PAGES].Alignment = 0;
+}
+
+static
+BOOLEAN
+CheckPages(
+    _In_ PUCHAR Buffer,
+    _In_ BOOLEAN Reverse)
+{
+    ULONG i, j;
+    UCHAR Expected;
+
+    for (i = 0; i < FILE_PAGES; i++)
+    {
+        Expected = (UCHAR)(Reverse ? FILE_PAGES - 1 - i : i);
+        for (j = 0; j < PAGE_SIZE; j++)
+        {
+            if (Buffer[i * PAGE_SIZE + j] != Expected)
+                return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static
+ULONGLONG
+BenchmarkReads(
+    _In_ HANDLE FileHandle,
+    _In_ PUCHAR Buffer,
+    _In_ PFILE_SEGMENT_ELEMENT Segments,
+    _In_ BOOLEAN Scatter,
+    _In_ LONGLONG Frequency)
+{
+    IO_STATUS_BLOCK IoStatus;
+    LARGE_INTEGER ByteOffset, Start, Now;
+    ULONGLONG Pages = 0;
+    NTSTATUS Status;
+    ULONG i;
+
+    NtQueryPerformanceCounter(&Start, NULL);
+    do
+    {
+        ByteOffset.QuadPart = 0;
+        if (Scatter)
+        {
+            /* The whole file in one request */
+            Status = NtReadFileScatter(FileHandle, NULL, NULL, NULL, &IoStatus,
+                                       Segments, FILE_PAGES * PAGE_SIZE, &ByteOffset, NULL);
+            if (!NT_SUCCESS(Status))
+            {
+                ok_hex(Status, STATUS_SUCCESS);
+                return 0;
+            }
+        }
+        else
+        {
+            /* The same pages, one request each */
+            for (i = 0; i < FILE_PAGES; i++)
+            {
+                ByteOffset.QuadPart = i * PAGE_SIZE;
+                Status = NtReadFile(FileHandle, NULL, NULL, NULL, &IoStatus,
+                                    Buffer + (FILE_PAGES - 1 - i) * PAGE_SIZE, PAGE_SIZE, &ByteOffset, NULL);
+                if (!NT_SUCCESS(Status))
+                {
+                    ok_hex(Status, STATUS_SUCCESS);
+                    return 0;
+                }
+            }
+        }
+        Pages += FILE_PAGES;
+
+        NtQueryPerformanceCounter(&Now, NULL);
+    } while ((Now.QuadPart - Start.QuadPart) * 1000 < (LONGLONG)RUN_TIME_MS * Frequency);
+
+    return Pages * Frequency / (Now.QuadPart - Start.QuadPart);
+}
+
+static
+VOID
+TestOverlapped(
+    _In_ PUNICODE_STRING FileName,
+    _In_ PUCHAR Buffer,
+    _In_ PFILE_SEGMENT_ELEMENT Segments)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatus;
+    LARGE_INTEGER ByteOffset;
+    HANDLE FileHandle, Event;
+    NTSTATUS Status;
+
+    InitializeObjectAttributes(&ObjectAttributes, FileName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtOpenFile(&FileHandle,
+                        FILE_READ_DATA,
+                        &ObjectAttributes,
+                        &IoStatus,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                        FILE_NON_DIRECTORY_FILE | FILE_NO_INTERMEDIATE_BUFFERING);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    Status = NtCreateEvent(&Event, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        NtClose(FileHandle);
+        return;
+    }
+
+    /* Asynchronous handles need an offset */
+    Status = NtReadFileScatter(FileHandle, Event, NULL, NULL, &IoStatus,
+                               Segments, FILE_PAGES * PAGE_SIZE, NULL, NULL);
+    ok_hex(Status, STATUS_INVALID_PARAMETER);
+
+    RtlFillMemory(Buffer, FILE_PAGES * PAGE_SIZE, 0xFF);
+    ByteOffset.QuadPart = 0;
+    IoStatus.Status = -1;
+    IoStatus.Information = -1;
+    Status = NtReadFileScatter(FileHandle, Event, NULL, NULL, &IoStatus,
+                               Segments, FILE_PAGES * PAGE_SIZE, &ByteOffset, NULL);
+    ok(Status == STATUS_SUCCESS || Status == STATUS_PENDING, "Status = 0x%08lx\n", Status);
+    if (Status == STATUS_PENDING)
+    {
+        Status = NtWaitForSingleObject(Event, FALSE, NULL);
+        ok_hex(Status, STATUS_WAIT_0);
+    }
+    ok_hex(IoStatus.Status, STATUS_SUCCESS);
+    ok_size_t(IoStatus.Information, FILE_PAGES * PAGE_SIZE);
+    ok(CheckPages(Buffer, FALSE), "Wrong data read asynchronously\n");
+
+    NtClose(Event);
+    NtClose(FileHandle);
+}
+
+START_TEST(NtReadFileScatter)
+{
+    UNICODE_STRING FileName = RTL_CONSTANT_STRING(L"\\SystemRoot\\ntdll-apitest-NtReadFileScatter-test.bin");
+    PFILE_SEGMENT_ELEMENT Segments;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatus;
+    LARGE_INTEGER ByteOffset, Counter, Frequency;
+    HANDLE FileHandle;
+    PUCHAR Buffer;
+    SIZE_T BufferSize;
+    ULONGLONG ScatterRate, LoopRate;
+    NTSTATUS Status;
+    ULONG i;
+
+    Buffer = NULL;
+    BufferSize = FILE_PAGES * PAGE_SIZE + (FILE_PAGES + 1) * sizeof(FILE_SEGMENT_ELEMENT);
+    Status = NtAllocateVirtualMemory(NtCurrentProcess(),
+                                     (PVOID*)&Buffer,
+                                     0,
+                                     &BufferSize,
+                                     MEM_RESERVE | MEM_COMMIT,
+                                     PAGE_READWRITE);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("Failed to allocate memory, status %lx\n", Status);
+        return;
+    }
+    Segments = (PFILE_SEGMENT_ELEMENT)(Buffer + FILE_PAGES * PAGE_SIZE);
+
+    InitializeObjectAttributes(&ObjectAttributes, &FileName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtCreateFile(&FileHandle,
+                          FILE_READ_DATA | FILE_WRITE_DATA | DELETE | SYNCHRONIZE,
+                          &ObjectAttributes,
+                          &IoStatus,
+                          NULL,
+                          0,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                          FILE_SUPERSEDE,
+                          FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT |
+                                                    FILE_NO_INTERMEDIATE_BUFFERING |
+                                                    FILE_DELETE_ON_CLOSE,
+                          NULL,
+                          0);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        BufferSize = 0;
+        NtFreeVirtualMemory(NtCurrentProcess(), (PVOID*)&Buffer, &BufferSize, MEM_RELEASE);
+        return;
+    }
+
+    /* Gather the pages in reverse, so that the file holds them backwards */
+    for (i = 0; i < FILE_PAGES; i++)
+        RtlFillMemory(Buffer + i * PAGE_SIZE, PAGE_SIZE, (UCHAR)i);
+    BuildSegments(Segments, Buffer, TRUE);
+    ByteOffset.QuadPart = 0;
+    Status = NtWriteFileGather(FileHandle, NULL, NULL, NULL, &IoStatus,
+                               Segments, FILE_PAGES * PAGE_SIZE, &ByteOffset, NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_size_t(IoStatus.Information, FILE_PAGES * PAGE_SIZE);
+
+    /* A plain read must see them backwards */
+    RtlZeroMemory(Buffer, FILE_PAGES * PAGE_SIZE);
+    Status = NtReadFile(FileHandle, NULL, NULL, NULL, &IoStatus,
+                        Buffer, FILE_PAGES * PAGE_SIZE, &ByteOffset, NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok(CheckPages(Buffer, TRUE), "Wrong data gathered\n");
+
+    /* And scattering them in reverse puts them back in order */
+    RtlZeroMemory(Buffer, FILE_PAGES * PAGE_SIZE);
+    Status = NtReadFileScatter(FileHandle, NULL, NULL, NULL, &IoStatus,
+                               Segments, FILE_PAGES * PAGE_SIZE, &ByteOffset, NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_size_t(IoStatus.Information, FILE_PAGES * PAGE_SIZE);
+    ok(CheckPages(Buffer, FALSE), "Wrong data scattered\n");
+
+    /* Only whole pages */
+    Status = NtReadFileScatter(FileHandle, NULL, NULL, NULL, &IoStatus,
+                               Segments, PAGE_SIZE / 2, &ByteOffset, NULL);
+    ok_hex(Status, STATUS_INVALID_PARAMETER);
+    Status = NtReadFileScatter(FileHandle, NULL, NULL, NULL, &IoStatus,
+                               Segments, 0, &ByteOffset, NULL);
+    ok_hex(Status, STATUS_INVALID_PARAMETER);
+
+    /* Every segment has to be page aligned */
+    Segments[1].Alignment += 512;
+    Status = NtReadFileScatter(FileHandle, NULL, NULL, NULL, &IoStatus,
+                               Segments, 2 * PAGE_SIZE, &ByteOffset, NULL);
+    ok_hex(Status, STATUS_INVALID_PARAMETER);
+    Segments[1].Alignment -= 512;
+
+    /* A bad segment array */
+    Status = NtReadFileScatter(FileHandle, NULL, NULL, NULL, &IoStatus,
+                               (PFILE_SEGMENT_ELEMENT)(ULONG_PTR)0x8, PAGE_SIZE, &ByteOffset, NULL);
+    ok_hex(Status, STATUS_ACCESS_VIOLATION);
+
+    TestOverlapped(&FileName, Buffer, Segments);
+
+    /* Compare one scatter request with a loop of single page reads */
+    NtQueryPerformanceCounter(&Counter, &Frequency);
+    if (!Frequency.QuadPart)
+    {
+        skip("No performance counter\n");
+    }
+    else
+    {
+        ScatterRate = BenchmarkReads(FileHandle, Buffer, Segments, TRUE, Frequency.QuadPart);
+        LoopRate = BenchmarkReads(FileHandle, Buffer, Segments, FALSE, Frequency.QuadPart);
+        ok(ScatterRate != 0, "Scatter reads failed\n");
+        ok(LoopRate != 0, "Page reads failed\n");
+        trace("%I64u pages/s with NtReadFileScatter, %I64u pages/s with NtReadFile\n", ScatterRate, LoopRate);
+    }
+
+    NtClose(FileHandle);
+    BufferSize = 0;
+    NtFreeVirtualMemory(NtCurrentProcess(), (PVOID*)&Buffer, &BufferSize, MEM_RELEASE);
+}
@@ -0,0 +1,265 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Tests and benchmark for registry path lookups in wide keys and large key caches
+ */
+
+#include "precomp.h"
+
+#define RUN_TIME_MS     500
+/* Keeping this many keys open goes past two KCBs per cache chain, so the cache gets resized */
+#define WIDE_KEY_COUNT  5000
+
+#define TEST_KEY        L"\\Registry\\Machine\\SOFTWARE\\ReactOS_RegistryLookup"
+
+static
+ULONGLONG
+BenchmarkOpen(
+    _In_ PCWSTR Path,
+    _In_ LONGLONG Frequency)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    UNICODE_STRING Name;
+    LARGE_INTEGER Start, Now;
+    ULONGLONG Opens = 0;
+    HANDLE KeyHandle;
+    NTSTATUS Status;
+
+    RtlInitUnicodeString(&Name, Path);
+    InitializeObjectAttributes(&ObjectAttributes, &Name, OBJ_CASE_INSENSITIVE, NULL, NULL);
+
+    NtQueryPerformanceCounter(&Start, NULL);
+    do
+    {
+        Status = NtOpenKey(&KeyHandle, KEY_QUERY_VALUE, &ObjectAttributes);
+        if (!NT_SUCCESS(Status))
+        {
+            ok_ntstatus(Status, STATUS_SUCCESS);
+            return 0;
+        }
+        NtClose(KeyHandle);
+        Opens++;
+
+        NtQueryPerformanceCounter(&Now, NULL);
+    } while ((Now.QuadPart - Start.QuadPart) * 1000 < (LONGLONG)RUN_TIME_MS * Frequency);
+
+    return Opens * Frequency / (Now.QuadPart - Start.QuadPart);
+}
+
+static
+NTSTATUS
+CreateKey(
+    _Out_ PHANDLE KeyHandle,
+    _In_opt_ HANDLE RootDirectory,
+    _In_ PCWSTR Path)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    UNICODE_STRING Name;
+
+    RtlInitUnicodeString(&Name, Path);
+    InitializeObjectAttributes(&ObjectAttributes, &Name, OBJ_CASE_INSENSITIVE, RootDirectory, NULL);
+    return NtCreateKey(KeyHandle, KEY_ALL_ACCESS, &ObjectAttributes, 0, NULL, REG_OPTION_VOLATILE, NULL);
+}
+
+static
+NTSTATUS
+OpenKey(
+    _Out_ PHANDLE KeyHandle,
+    _In_opt_ HANDLE RootDirectory,
+    _In_ PCWSTR Path)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    UNICODE_STRING Name;
+
+    RtlInitUnicodeString(&Name, Path);
+    InitializeObjectAttributes(&ObjectAttributes, &Name, OBJ_CASE_INSENSITIVE, RootDirectory, NULL);
+    return NtOpenKey(KeyHandle, KEY_QUERY_VALUE, &ObjectAttributes);
+}
+
+/* Opens a child of the test key and checks that it is the one which was asked for */
+static
+BOOLEAN
+OpenChild(
+    _In_ HANDLE TestKey,
+    _In_ PCWSTR Path,
+    _In_ PCWSTR Expected)
+{
+    UCHAR Buffer[sizeof(KEY_BASIC_INFORMATION) + 64 * sizeof(WCHAR)];
+    PKEY_BASIC_INFORMATION Info = (PKEY_BASIC_INFORMATION)Buffer;
+    HANDLE KeyHandle;
+    NTSTATUS Status;
+    ULONG Length;
+    BOOLEAN Match;
+
+    Status = OpenKey(&KeyHandle, TestKey, Path);
+    if (!NT_SUCCESS(Status))
+    {
+        ok(0, "Could not open %ls: 0x%08lx\n", Path, Status);
+        return FALSE;
+    }
+
+    Status = NtQueryKey(KeyHandle, KeyBasicInformation, Info, sizeof(Buffer), &Length);
+    NtClose(KeyHandle);
+    if (!NT_SUCCESS(Status))
+    {
+        ok(0, "Could not query %ls: 0x%08lx\n", Path, Status);
+        return FALSE;
+    }
+
+    Match = (Info->NameLength == wcslen(Expected) * sizeof(WCHAR)) &&
+            !memcmp(Info->Name, Expected, Info->NameLength);
+    ok(Match, "Opened %.*ls for %ls\n", (int)(Info->NameLength / sizeof(WCHAR)), Info->Name, Path);
+    return Match;
+}
+
+static
+VOID
+TestLookups(
+    _In_ HANDLE TestKey,
+    _In_ PCSTR When)
+{
+    static const PCWSTR Misses[] =
+    {
+        L"Child05000",
+        L"Child0000",
+        L"Child000000",
+        L"Child0000x",
+        L"xChild00000",
+        L"Child00001\\Grandchild",
+    };
+    WCHAR Path[32], Expected[32];
+    HANDLE KeyHandle;
+    NTSTATUS Status;
+    ULONG i, Wrong = 0;
+
+    trace("Lookups %s\n", When);
+
+    /* Every child, by its exact name */
+    for (i = 0; i < WIDE_KEY_COUNT; i++)
+    {
+        StringCbPrintfW(Expected, sizeof(Expected), L"Child%05lu", i);
+        if (!OpenChild(TestKey, Expected, Expected) && ++Wrong > 10)
+            break;
+    }
+    ok(Wrong == 0, "%lu children were not found %s\n", Wrong, When);
+
+    /* Key names are never case sensitive, so this must hash the same */
+    for (i = 0; i < WIDE_KEY_COUNT; i += 499)
+    {
+        StringCbPrintfW(Path, sizeof(Path), L"CHILD%05lu", i);
+        StringCbPrintfW(Expected, sizeof(Expected), L"Child%05lu", i);
+        OpenChild(TestKey, Path, Expected);
+    }
+
+    /* Names which are not there, some sharing a prefix with names which are */
+    for (i = 0; i < _countof(Misses); i++)
+    {
+        Status = OpenKey(&KeyHandle, TestKey, Misses[i]);
+        ok(Status == STATUS_OBJECT_NAME_NOT_FOUND, "Opening %ls gave 0x%08lx %s\n", Misses[i], Status, When);
+        if (NT_SUCCESS(Status)) NtClose(KeyHandle);
+    }
+
+    /* Full paths from the root go through the KCB cache */
+    Status = OpenKey(&KeyHandle, NULL, TEST_KEY L"\\Child04999");
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status)) NtClose(KeyHandle);
+    Status = OpenKey(&KeyHandle, NULL, TEST_KEY L"\\Child05000");
+    ok_ntstatus(Status, STATUS_OBJECT_NAME_NOT_FOUND);
+    if (NT_SUCCESS(Status)) NtClose(KeyHandle);
+}
+
+START_TEST(RegistryLookup)
+{
+    static const PCWSTR DeepPaths[] =
+    {
+        L"\\Registry\\Machine\\SYSTEM",
+        L"\\Registry\\Machine\\SYSTEM\\CurrentControlSet\\Control",
+        L"\\Registry\\Machine\\SYSTEM\\CurrentControlSet\\Control\\Session Manager\\Environment",
+        L"\\Registry\\Machine\\SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion\\Winlogon",
+    };
+    static const ULONG Children[] = { 0, WIDE_KEY_COUNT / 2, WIDE_KEY_COUNT - 1 };
+    static HANDLE SubKeys[WIDE_KEY_COUNT];
+    LARGE_INTEGER Counter, Frequency;
+    HANDLE TestKey, KeyHandle;
+    WCHAR Path[MAX_PATH];
+    ULONGLONG Rate;
+    NTSTATUS Status;
+    ULONG i, Created;
+
+    NtQueryPerformanceCounter(&Counter, &Frequency);
+    if (!Frequency.QuadPart)
+    {
+        skip("No performance counter, not timing the lookups\n");
+    }
+    else
+    {
+        /* Deep paths through the system hives, mostly hits in the KCB cache */
+        for (i = 0; i < _countof(DeepPaths); i++)
+        {
+            Rate = BenchmarkOpen(DeepPaths[i], Frequency.QuadPart);
+            ok(Rate != 0, "Could not open %ls\n", DeepPaths[i]);
+            trace("%I64u opens/s: %ls\n", Rate, DeepPaths[i]);
+        }
+    }
+
+    Status = CreateKey(&TestKey, NULL, TEST_KEY);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("Could not create the test key: 0x%08lx\n", Status);
+        return;
+    }
+
+    /* A parent with thousands of children, like Enum or HKCR. Keep them all open. */
+    for (Created = 0; Created < WIDE_KEY_COUNT; Created++)
+    {
+        StringCbPrintfW(Path, sizeof(Path), L"Child%05lu", Created);
+        Status = CreateKey(&SubKeys[Created], TestKey, Path);
+        if (!NT_SUCCESS(Status))
+        {
+            ok_ntstatus(Status, STATUS_SUCCESS);
+            break;
+        }
+    }
+
+    if (Created == WIDE_KEY_COUNT)
+    {
+        /* The resize runs in a work item */
+        Sleep(500);
+        TestLookups(TestKey, "with all the keys open");
+
+        /* The first, middle and last children, with a large KCB cache */
+        for (i = 0; Frequency.QuadPart && i < _countof(Children); i++)
+        {
+            StringCbPrintfW(Path, sizeof(Path), TEST_KEY L"\\Child%05lu", Children[i]);
+            Rate = BenchmarkOpen(Path, Frequency.QuadPart);
+            ok(Rate != 0, "Could not open %ls\n", Path);
+            trace("%I64u opens/s: child %lu of %u\n", Rate, Children[i], WIDE_KEY_COUNT);
+        }
+
+        /* And again once they are closed, with fewer KCBs in the cache */
+        for (i = 0; i < WIDE_KEY_COUNT; i++)
+        {
+            NtClose(SubKeys[i]);
+            SubKeys[i] = NULL;
+        }
+        Sleep(500);
+        TestLookups(TestKey, "after closing them");
+    }
+
+    /* Clean up */
+    for (i = 0; i < WIDE_KEY_COUNT; i++)
+    {
+        if (SubKeys[i])
+            NtClose(SubKeys[i]);
+
+        StringCbPrintfW(Path, sizeof(Path), L"Child%05lu", i);
+        if (NT_SUCCESS(CreateKey(&KeyHandle, TestKey, Path)))
+        {
+            NtDeleteKey(KeyHandle);
+            NtClose(KeyHandle);
+        }
+    }
+    Status = NtDeleteKey(TestKey);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    NtClose(TestKey);
+}
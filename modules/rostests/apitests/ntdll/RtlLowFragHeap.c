@@ -0,0 +1,337 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for the low fragmentation heap front end
+ */
+
+#include "precomp.h"
+
+#define HEAP_FRONT_LOWFRAGHEAP  2
+#define MAX_THREADS             8
+#define BLOCKS_PER_THREAD       512
+#define MAX_BLOCK_SIZE          512
+#define RUN_TIME_MS             500
+
+typedef struct _BENCH_THREAD
+{
+    HANDLE Heap;
+    LONGLONG Frequency;
+    ULONG Seed;
+    ULONGLONG Operations;
+    SIZE_T LiveBytes;
+    PVOID Blocks[BLOCKS_PER_THREAD];
+    SIZE_T Sizes[BLOCKS_PER_THREAD];
+} BENCH_THREAD, *PBENCH_THREAD;
+
+static
+ULONG
+QueryFrontEnd(
+    _In_ HANDLE Heap)
+{
+    ULONG FrontEnd = 0xdeadbeef;
+    NTSTATUS Status;
+
+    Status = RtlQueryHeapInformation(Heap, HeapCompatibilityInformation, &FrontEnd, sizeof(FrontEnd), NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+    return FrontEnd;
+}
+
+static
+NTSTATUS
+EnableFrontEnd(
+    _In_ HANDLE Heap)
+{
+    ULONG FrontEnd = HEAP_FRONT_LOWFRAGHEAP;
+
+    return RtlSetHeapInformation(Heap, HeapCompatibilityInformation, &FrontEnd, sizeof(FrontEnd));
+}
+
+static
+ULONG
+NextRandom(
+    _Inout_ PULONG Seed)
+{
+    /* xorshift, cheap enough not to show up in the numbers */
+    *Seed ^= *Seed << 13;
+    *Seed ^= *Seed >> 17;
+    *Seed ^= *Seed << 5;
+    return *Seed;
+}
+
+static
+VOID
+TestBlocks(
+    _In_ HANDLE Heap)
+{
+    PUCHAR Blocks[64], NewBlock;
+    ULONG i, j;
+    BOOLEAN Zeroed;
+
+    for (i = 0; i < RTL_NUMBER_OF(Blocks); i++)
+    {
+        Blocks[i] = RtlAllocateHeap(Heap, HEAP_ZERO_MEMORY, 24);
+        ok(Blocks[i] != NULL, "Allocation %lu failed\n", i);
+        if (!Blocks[i])
+            return;
+
+        Zeroed = TRUE;
+        for (j = 0; j < 24; j++)
+        {
+            if (Blocks[i][j] != 0)
+                Zeroed = FALSE;
+        }
+        ok(Zeroed, "Block %lu is not zeroed\n", i);
+        ok_size_t(RtlSizeHeap(Heap, 0, Blocks[i]), 24);
+        RtlFillMemory(Blocks[i], 24, (UCHAR)i);
+    }
+    ok(RtlValidateHeap(Heap, 0, NULL), "Heap is not valid\n");
+    ok(RtlValidateHeap(Heap, 0, Blocks[0]), "Block is not valid\n");
+
+    /* Shrinking stays in the same block */
+    NewBlock = RtlReAllocateHeap(Heap, 0, Blocks[1], 16);
+    ok(NewBlock == Blocks[1], "Expected %p, got %p\n", Blocks[1], NewBlock);
+    ok_size_t(RtlSizeHeap(Heap, 0, Blocks[1]), 16);
+    ok(Blocks[1][15] == 1, "Contents lost on shrink\n");
+
+    /* Growing past the bucket can't be done in place */
+    NewBlock = RtlReAllocateHeap(Heap, HEAP_REALLOC_IN_PLACE_ONLY, Blocks[2], 1000);
+    ok(NewBlock == NULL, "Expected NULL, got %p\n", NewBlock);
+    NewBlock = RtlReAllocateHeap(Heap, 0, Blocks[2], 1000);
+    ok(NewBlock != NULL, "Reallocation failed\n");
+    if (NewBlock)
+    {
+        ok(NewBlock[0] == 2 && NewBlock[23] == 2, "Contents lost on grow\n");
+        ok_size_t(RtlSizeHeap(Heap, 0, NewBlock), 1000);
+        Blocks[2] = NewBlock;
+    }
+
+    for (i = 0; i < RTL_NUMBER_OF(Blocks); i++)
+    {
+        ok(RtlFreeHeap(Heap, 0, Blocks[i]), "Free %lu failed\n", i);
+    }
+    ok(RtlValidateHeap(Heap, 0, NULL), "Heap is not valid\n");
+
+    /* Large blocks keep going to the back end */
+    NewBlock = RtlAllocateHeap(Heap, 0, 64 * 1024);
+    ok(NewBlock != NULL, "Large allocation failed\n");
+    ok(RtlFreeHeap(Heap, 0, NewBlock), "Large free failed\n");
+}
+
+static
+VOID
+TestActivation(VOID)
+{
+    PVOID Blocks[512];
+    HANDLE Heap;
+    NTSTATUS Status;
+    ULONG FrontEnd, i;
+
+    /* Explicit activation */
+    Heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    ok(Heap != NULL, "Failed to create heap\n");
+    if (!Heap)
+        return;
+    ok_hex(QueryFrontEnd(Heap), 0);
+
+    FrontEnd = 3;
+    Status = RtlSetHeapInformation(Heap, HeapCompatibilityInformation, &FrontEnd, sizeof(FrontEnd));
+    ok_hex(Status, STATUS_UNSUCCESSFUL);
+    Status = RtlSetHeapInformation(Heap, HeapCompatibilityInformation, &FrontEnd, sizeof(USHORT));
+    ok_hex(Status, STATUS_BUFFER_TOO_SMALL);
+
+    Status = EnableFrontEnd(Heap);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_hex(QueryFrontEnd(Heap), HEAP_FRONT_LOWFRAGHEAP);
+
+    /* Enabling it twice is fine */
+    Status = EnableFrontEnd(Heap);
+    ok_hex(Status, STATUS_SUCCESS);
+
+    TestBlocks(Heap);
+    RtlDestroyHeap(Heap);
+
+    /* Heaps without a lock can't have it */
+    Heap = RtlCreateHeap(HEAP_GROWABLE | HEAP_NO_SERIALIZE, NULL, 0, 0, NULL, NULL);
+    ok(Heap != NULL, "Failed to create heap\n");
+    if (Heap)
+    {
+        Status = EnableFrontEnd(Heap);
+        ok_hex(Status, STATUS_UNSUCCESSFUL);
+        ok_hex(QueryFrontEnd(Heap), 0);
+        RtlDestroyHeap(Heap);
+    }
+
+    /* Enough live blocks of one size to fill a user block turn it on by themselves */
+    Heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    ok(Heap != NULL, "Failed to create heap\n");
+    if (!Heap)
+        return;
+
+    for (i = 0; i < RTL_NUMBER_OF(Blocks); i++)
+    {
+        /* A few dozen aren't enough yet */
+        if (i == 64)
+            ok_hex(QueryFrontEnd(Heap), 0);
+
+        Blocks[i] = RtlAllocateHeap(Heap, 0, 40);
+        ok(Blocks[i] != NULL, "Allocation %lu failed\n", i);
+    }
+    ok_hex(QueryFrontEnd(Heap), HEAP_FRONT_LOWFRAGHEAP);
+
+    /* Blocks from before and after the switch free the same way */
+    for (i = 0; i < RTL_NUMBER_OF(Blocks); i++)
+    {
+        if (Blocks[i])
+            ok(RtlFreeHeap(Heap, 0, Blocks[i]), "Free %lu failed\n", i);
+    }
+    ok(RtlValidateHeap(Heap, 0, NULL), "Heap is not valid\n");
+    RtlDestroyHeap(Heap);
+}
+
+static
+DWORD
+WINAPI
+BenchmarkThread(
+    _In_ LPVOID Parameter)
+{
+    PBENCH_THREAD Context = Parameter;
+    LARGE_INTEGER Start, Now;
+    ULONG Index;
+    SIZE_T Size;
+
+    NtQueryPerformanceCounter(&Start, NULL);
+    do
+    {
+        /* Replace a random block with one of a random size */
+        Index = NextRandom(&Context->Seed) % BLOCKS_PER_THREAD;
+        if (Context->Blocks[Index])
+        {
+            RtlFreeHeap(Context->Heap, 0, Context->Blocks[Index]);
+            Context->LiveBytes -= Context->Sizes[Index];
+            Context->Operations++;
+        }
+
+        Size = NextRandom(&Context->Seed) % MAX_BLOCK_SIZE + 1;
+        Context->Blocks[Index] = RtlAllocateHeap(Context->Heap, 0, Size);
+        if (!Context->Blocks[Index])
+            break;
+        Context->Sizes[Index] = Size;
+        Context->LiveBytes += Size;
+        Context->Operations++;
+
+        NtQueryPerformanceCounter(&Now, NULL);
+    } while ((Now.QuadPart - Start.QuadPart) * 1000 < (LONGLONG)RUN_TIME_MS * Context->Frequency);
+
+    return 0;
+}
+
+static
+SIZE_T
+QueryPrivateBytes(VOID)
+{
+    VM_COUNTERS Counters;
+    NTSTATUS Status;
+
+    Status = NtQueryInformationProcess(NtCurrentProcess(), ProcessVmCounters, &Counters, sizeof(Counters), NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+    return NT_SUCCESS(Status) ? Counters.PagefileUsage : 0;
+}
+
+static
+VOID
+BenchmarkHeap(
+    _In_ PBENCH_THREAD Threads,
+    _In_ ULONG ThreadCount,
+    _In_ BOOLEAN FrontEnd,
+    _In_ LONGLONG Frequency)
+{
+    HANDLE Handles[MAX_THREADS];
+    ULONGLONG Operations = 0;
+    SIZE_T LiveBytes = 0, BaseBytes, UsedBytes;
+    HANDLE Heap;
+    ULONG i, j;
+
+    /* The front end ignores 16 byte aligned heaps, which makes them a fair baseline */
+    BaseBytes = QueryPrivateBytes();
+    Heap = RtlCreateHeap(HEAP_GROWABLE | (FrontEnd ? 0 : HEAP_CREATE_ALIGN_16), NULL, 0, 0, NULL, NULL);
+    ok(Heap != NULL, "Failed to create heap\n");
+    if (!Heap)
+        return;
+    if (FrontEnd)
+        ok_hex(EnableFrontEnd(Heap), STATUS_SUCCESS);
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        RtlZeroMemory(&Threads[i], sizeof(Threads[i]));
+        Threads[i].Heap = Heap;
+        Threads[i].Frequency = Frequency;
+        Threads[i].Seed = 0x9E3779B9 * (i + 1);
+        Handles[i] = CreateThread(NULL, 0, BenchmarkThread, &Threads[i], 0, NULL);
+        ok(Handles[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+        if (!Handles[i])
+        {
+            ThreadCount = i;
+            break;
+        }
+    }
+    WaitForMultipleObjects(ThreadCount, Handles, TRUE, INFINITE);
+
+    /* Everything the threads left behind is still live */
+    UsedBytes = QueryPrivateBytes() - BaseBytes;
+    for (i = 0; i < ThreadCount; i++)
+    {
+        CloseHandle(Handles[i]);
+        Operations += Threads[i].Operations;
+        LiveBytes += Threads[i].LiveBytes;
+        for (j = 0; j < BLOCKS_PER_THREAD; j++)
+        {
+            if (Threads[i].Blocks[j])
+                RtlFreeHeap(Heap, 0, Threads[i].Blocks[j]);
+        }
+    }
+    ok(RtlValidateHeap(Heap, 0, NULL), "Heap is not valid\n");
+    RtlDestroyHeap(Heap);
+
+    ok(Operations != 0, "No operations done\n");
+    trace("%s: %lu threads, %I64u ops/s, %Iu KB committed for %Iu KB live\n",
+          FrontEnd ? "Low fragmentation heap" : "Back end heap",
+          ThreadCount,
+          Operations * 1000 / RUN_TIME_MS,
+          UsedBytes / 1024,
+          LiveBytes / 1024);
+}
+
+START_TEST(RtlLowFragHeap)
+{
+    PBENCH_THREAD Threads;
+    LARGE_INTEGER Counter, Frequency;
+    SYSTEM_INFO SystemInfo;
+    ULONG ThreadCount;
+
+    TestActivation();
+
+    NtQueryPerformanceCounter(&Counter, &Frequency);
+    if (!Frequency.QuadPart)
+    {
+        skip("No performance counter\n");
+        return;
+    }
+
+    /* Twice as many threads as processors, to have some contention */
+    GetSystemInfo(&SystemInfo);
+    ThreadCount = SystemInfo.dwNumberOfProcessors * 2;
+    if (ThreadCount > MAX_THREADS)
+        ThreadCount = MAX_THREADS;
+
+    Threads = RtlAllocateHeap(RtlGetProcessHeap(), 0, MAX_THREADS * sizeof(BENCH_THREAD));
+    if (!Threads)
+    {
+        skip("Failed to allocate memory\n");
+        return;
+    }
+
+    BenchmarkHeap(Threads, ThreadCount, FALSE, Frequency.QuadPart);
+    BenchmarkHeap(Threads, ThreadCount, TRUE, Frequency.QuadPart);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Threads);
+}
@@ -0,0 +1,505 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for batched completion port dequeue and skip notification modes on sockets
+ */
+
+#include "ws2_32.h"
+
+#include <ndk/kefuncs.h>
+
+#define PIPELINE        16
+#define MESSAGE_SIZE    64
+#define BATCH_SIZE      32
+#define RUN_TIME_MS     500
+
+/* The test is built for 2003, where winbase.h does not have this */
+#ifndef FILE_SKIP_COMPLETION_PORT_ON_SUCCESS
+#define FILE_SKIP_COMPLETION_PORT_ON_SUCCESS 0x1
+#endif
+
+typedef enum _ECHO_OP_TYPE
+{
+    EchoRecv,
+    EchoSend
+} ECHO_OP_TYPE;
+
+typedef struct _ECHO_OP
+{
+    OVERLAPPED Overlapped;
+    SOCKET Socket;
+    ECHO_OP_TYPE Type;
+    CHAR Buffer[MESSAGE_SIZE];
+} ECHO_OP, *PECHO_OP;
+
+/* 2003 does not have GetQueuedCompletionStatusEx, ReactOS has it in kernel32_vista */
+static BOOL (WINAPI *pGetQueuedCompletionStatusEx)(HANDLE, LPOVERLAPPED_ENTRY, ULONG, PULONG, DWORD, BOOL);
+static BOOL (WINAPI *pSetFileCompletionNotificationModes)(HANDLE, UCHAR);
+
+static
+BOOLEAN
+CreateConnectedPair(
+    _Out_ SOCKET *Server,
+    _Out_ SOCKET *Client)
+{
+    struct sockaddr_in addr;
+    int addrlen = sizeof(addr);
+    SOCKET Listener;
+
+    *Server = *Client = INVALID_SOCKET;
+
+    Listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (Listener == INVALID_SOCKET)
+        return FALSE;
+
+    ZeroMemory(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (bind(Listener, (struct sockaddr*)&addr, sizeof(addr)) ||
+        listen(Listener, 1) ||
+        getsockname(Listener, (struct sockaddr*)&addr, &addrlen))
+    {
+        closesocket(Listener);
+        return FALSE;
+    }
+
+    *Client = WSASocketW(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+    if (*Client != INVALID_SOCKET &&
+        connect(*Client, (struct sockaddr*)&addr, sizeof(addr)) == 0)
+    {
+        *Server = accept(Listener, NULL, NULL);
+    }
+    closesocket(Listener);
+
+    if (*Server == INVALID_SOCKET)
+    {
+        if (*Client != INVALID_SOCKET)
+            closesocket(*Client);
+        *Client = INVALID_SOCKET;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static
+HANDLE
+CreateEchoPort(
+    _In_ SOCKET Server,
+    _In_ SOCKET Client,
+    _In_ BOOLEAN Skip)
+{
+    HANDLE Port;
+
+    Port = CreateIoCompletionPort((HANDLE)Server, NULL, 0, 1);
+    if (!Port)
+        return NULL;
+    if (!CreateIoCompletionPort((HANDLE)Client, Port, 0, 1))
+    {
+        CloseHandle(Port);
+        return NULL;
+    }
+
+    if (Skip &&
+        (!pSetFileCompletionNotificationModes((HANDLE)Server, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS) ||
+         !pSetFileCompletionNotificationModes((HANDLE)Client, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS)))
+    {
+        CloseHandle(Port);
+        return NULL;
+    }
+    return Port;
+}
+
+static
+VOID
+DrainPort(
+    _In_ HANDLE Port)
+{
+    LPOVERLAPPED Overlapped;
+    ULONG_PTR Key;
+    DWORD Bytes;
+
+    /* Wait for the aborted operations, so that nothing refers to the stack any more */
+    while (GetQueuedCompletionStatus(Port, &Bytes, &Key, &Overlapped, 500) || Overlapped)
+        ;
+}
+
+/* Starts the next operation of an echo op, returns TRUE and the byte count if it completed inline */
+static
+BOOLEAN
+StartEchoOp(
+    _Inout_ PECHO_OP Op,
+    _In_ DWORD Length,
+    _Out_ PDWORD Bytes,
+    _Out_ PBOOLEAN Failed)
+{
+    WSABUF Buffer;
+    DWORD Flags = 0;
+    int iResult;
+
+    *Failed = FALSE;
+    ZeroMemory(&Op->Overlapped, sizeof(Op->Overlapped));
+    Buffer.buf = Op->Buffer;
+    Buffer.len = Length;
+    if (Op->Type == EchoRecv)
+        iResult = WSARecv(Op->Socket, &Buffer, 1, Bytes, &Flags, &Op->Overlapped, NULL);
+    else
+        iResult = WSASend(Op->Socket, &Buffer, 1, Bytes, 0, &Op->Overlapped, NULL);
+
+    if (iResult == SOCKET_ERROR)
+    {
+        *Failed = (WSAGetLastError() != WSA_IO_PENDING);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Both ends echo: whatever is received is sent back, and every send is followed by a receive */
+static
+BOOLEAN
+ContinueEchoOp(
+    _Inout_ PECHO_OP Op,
+    _In_ DWORD Bytes,
+    _In_ BOOLEAN Skip,
+    _Inout_ PULONGLONG Completions)
+{
+    BOOLEAN Failed;
+
+    for (;;)
+    {
+        if (Op->Type == EchoRecv)
+        {
+            if (!Bytes)
+                return FALSE;
+            Op->Type = EchoSend;
+        }
+        else
+        {
+            Bytes = MESSAGE_SIZE;
+            Op->Type = EchoRecv;
+        }
+
+        /* Without the skip mode, inline completions are still queued to the port */
+        if (!StartEchoOp(Op, Bytes, &Bytes, &Failed) || !Skip)
+            return !Failed;
+
+        (*Completions)++;
+    }
+}
+
+static
+ULONGLONG
+BenchmarkEcho(
+    _In_ BOOLEAN Batch,
+    _In_ BOOLEAN Skip,
+    _In_ LONGLONG Frequency)
+{
+    ECHO_OP Ops[2 * PIPELINE];
+    OVERLAPPED_ENTRY Entries[BATCH_SIZE];
+    LARGE_INTEGER Start, Now;
+    ULONGLONG Completions = 0;
+    LPOVERLAPPED Overlapped;
+    SOCKET Server, Client;
+    ULONG_PTR Key;
+    HANDLE Port;
+    ULONG i, Removed;
+    DWORD Bytes;
+
+    if (!CreateConnectedPair(&Server, &Client))
+    {
+        skip("Failed to connect over loopback, error %d\n", WSAGetLastError());
+        return 0;
+    }
+    Port = CreateEchoPort(Server, Client, Skip);
+    if (!Port)
+    {
+        skip("Failed to create the completion port, error %lu\n", GetLastError());
+        closesocket(Server);
+        closesocket(Client);
+        return 0;
+    }
+
+    /* The server waits for data, the client starts with the messages that get echoed */
+    for (i = 0; i < PIPELINE; i++)
+    {
+        Ops[i].Socket = Server;
+        Ops[i].Type = EchoSend;
+        Ops[PIPELINE + i].Socket = Client;
+        Ops[PIPELINE + i].Type = EchoRecv;
+        FillMemory(Ops[PIPELINE + i].Buffer, MESSAGE_SIZE, (CHAR)i);
+    }
+    for (i = 0; i < 2 * PIPELINE; i++)
+    {
+        if (!ContinueEchoOp(&Ops[i], MESSAGE_SIZE, Skip, &Completions))
+        {
+            ok(0, "Failed to start echo op %lu, error %d\n", i, WSAGetLastError());
+            Completions = 0;
+            goto Cleanup;
+        }
+    }
+
+    Completions = 0;
+    NtQueryPerformanceCounter(&Start, NULL);
+    do
+    {
+        if (Batch)
+        {
+            if (!pGetQueuedCompletionStatusEx(Port, Entries, BATCH_SIZE, &Removed, 1000, FALSE))
+            {
+                ok(0, "GetQueuedCompletionStatusEx failed, error %lu\n", GetLastError());
+                Completions = 0;
+                goto Cleanup;
+            }
+        }
+        else
+        {
+            if (!GetQueuedCompletionStatus(Port, &Bytes, &Key, &Overlapped, 1000))
+            {
+                ok(0, "GetQueuedCompletionStatus failed, error %lu\n", GetLastError());
+                Completions = 0;
+                goto Cleanup;
+            }
+            Entries[0].lpOverlapped = Overlapped;
+            Entries[0].dwNumberOfBytesTransferred = Bytes;
+            Removed = 1;
+        }
+
+        for (i = 0; i < Removed; i++)
+        {
+            Completions++;
+            if (!ContinueEchoOp(CONTAINING_RECORD(Entries[i].lpOverlapped, ECHO_OP, Overlapped),
+                                Entries[i].dwNumberOfBytesTransferred,
+                                Skip,
+                                &Completions))
+            {
+                ok(0, "Echo failed, error %d\n", WSAGetLastError());
+                Completions = 0;
+                goto Cleanup;
+            }
+        }
+
+        NtQueryPerformanceCounter(&Now, NULL);
+    } while ((Now.QuadPart - Start.QuadPart) * 1000 < (LONGLONG)RUN_TIME_MS * Frequency);
+
+    Completions = Completions * Frequency / (Now.QuadPart - Start.QuadPart);
+
+Cleanup:
+    closesocket(Client);
+    closesocket(Server);
+    DrainPort(Port);
+    CloseHandle(Port);
+    return Completions;
+}
+
+static
+VOID
+TestBatchDequeue(VOID)
+{
+    OVERLAPPED_ENTRY Entries[16];
+    HANDLE Port;
+    ULONG i, Removed;
+    BOOL Ret;
+
+    Port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    ok(Port != NULL, "CreateIoCompletionPort failed, error %lu\n", GetLastError());
+    if (!Port)
+        return;
+
+    /* Nothing to dequeue */
+    Removed = 0xdeadbeef;
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 16, &Removed, 0, FALSE);
+    ok(!Ret, "Ret = %d\n", Ret);
+    ok_hex(GetLastError(), WAIT_TIMEOUT);
+    ok_hex(Removed, 0);
+
+    /* An empty array is invalid */
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 0, &Removed, 0, FALSE);
+    ok(!Ret, "Ret = %d\n", Ret);
+    ok_hex(GetLastError(), ERROR_INVALID_PARAMETER);
+
+    /* All the packets come back in one call, in order */
+    for (i = 0; i < 10; i++)
+    {
+        Ret = PostQueuedCompletionStatus(Port, i * 2, i, (LPOVERLAPPED)(ULONG_PTR)(i + 1));
+        ok(Ret, "PostQueuedCompletionStatus failed, error %lu\n", GetLastError());
+    }
+    Removed = 0;
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 16, &Removed, 0, FALSE);
+    ok(Ret, "GetQueuedCompletionStatusEx failed, error %lu\n", GetLastError());
+    ok_hex(Removed, 10);
+    for (i = 0; i < Removed; i++)
+    {
+        ok(Entries[i].lpCompletionKey == i, "Entry %lu: key %Iu\n", i, Entries[i].lpCompletionKey);
+        ok(Entries[i].lpOverlapped == (LPOVERLAPPED)(ULONG_PTR)(i + 1), "Entry %lu: overlapped %p\n", i, Entries[i].lpOverlapped);
+        ok(Entries[i].dwNumberOfBytesTransferred == i * 2, "Entry %lu: bytes %lu\n", i, Entries[i].dwNumberOfBytesTransferred);
+    }
+
+    /* A short array leaves the rest queued */
+    for (i = 0; i < 3; i++)
+        PostQueuedCompletionStatus(Port, 0, i, NULL);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 2, &Removed, 0, FALSE);
+    ok(Ret, "GetQueuedCompletionStatusEx failed, error %lu\n", GetLastError());
+    ok_hex(Removed, 2);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 2, &Removed, 0, FALSE);
+    ok(Ret, "GetQueuedCompletionStatusEx failed, error %lu\n", GetLastError());
+    ok_hex(Removed, 1);
+    ok(Entries[0].lpCompletionKey == 2, "Key %Iu\n", Entries[0].lpCompletionKey);
+
+    CloseHandle(Port);
+}
+
+static
+VOID
+TestSkipOnSuccess(VOID)
+{
+    OVERLAPPED Overlapped;
+    LPOVERLAPPED Result;
+    SOCKET Server, Client;
+    ULONG_PTR Key;
+    HANDLE Port;
+    WSABUF Buffer;
+    CHAR Data[MESSAGE_SIZE];
+    DWORD Bytes, Flags;
+    int iResult;
+    BOOL Ret;
+
+    if (!CreateConnectedPair(&Server, &Client))
+    {
+        skip("Failed to connect over loopback, error %d\n", WSAGetLastError());
+        return;
+    }
+    Port = CreateEchoPort(Server, Client, TRUE);
+    ok(Port != NULL, "Failed to set up the port, error %lu\n", GetLastError());
+    if (!Port)
+    {
+        closesocket(Server);
+        closesocket(Client);
+        return;
+    }
+
+    /* Only the skip modes are known */
+    SetLastError(0xdeadbeef);
+    Ret = pSetFileCompletionNotificationModes((HANDLE)Client, 0x80);
+    ok(!Ret, "Ret = %d\n", Ret);
+    ok_hex(GetLastError(), ERROR_INVALID_PARAMETER);
+
+    /* A send that completes inline doesn't queue a packet, a pending one still does */
+    FillMemory(Data, sizeof(Data), 0x55);
+    Buffer.buf = Data;
+    Buffer.len = sizeof(Data);
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    iResult = WSASend(Client, &Buffer, 1, &Bytes, 0, &Overlapped, NULL);
+    ok(iResult == 0 || WSAGetLastError() == WSA_IO_PENDING, "WSASend failed, error %d\n", WSAGetLastError());
+    Ret = GetQueuedCompletionStatus(Port, &Bytes, &Key, &Result, iResult ? 1000 : 100);
+    if (iResult == 0)
+    {
+        ok(!Ret, "Got a packet for an inline completion\n");
+        ok(Result == NULL, "Result = %p\n", Result);
+        ok_hex(GetLastError(), WAIT_TIMEOUT);
+    }
+    else
+    {
+        ok(Ret, "No packet for a pending send, error %lu\n", GetLastError());
+        ok(Result == &Overlapped, "Result = %p\n", Result);
+    }
+
+    /* The data is there by now, so the receive should complete inline as well */
+    Sleep(100);
+    ZeroMemory(Data, sizeof(Data));
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    Bytes = 0;
+    Flags = 0;
+    iResult = WSARecv(Server, &Buffer, 1, &Bytes, &Flags, &Overlapped, NULL);
+    ok(iResult == 0 || WSAGetLastError() == WSA_IO_PENDING, "WSARecv failed, error %d\n", WSAGetLastError());
+    Ret = GetQueuedCompletionStatus(Port, &Bytes, &Key, &Result, iResult ? 1000 : 100);
+    if (iResult == 0)
+    {
+        ok(!Ret, "Got a packet for an inline completion\n");
+        ok(Result == NULL, "Result = %p\n", Result);
+    }
+    else
+    {
+        ok(Ret, "No packet for a pending receive, error %lu\n", GetLastError());
+        ok(Result == &Overlapped, "Result = %p\n", Result);
+    }
+    ok_hex(Bytes, sizeof(Data));
+    ok(Data[0] == 0x55 && Data[sizeof(Data) - 1] == 0x55, "Wrong data received\n");
+
+    closesocket(Client);
+    closesocket(Server);
+    DrainPort(Port);
+    CloseHandle(Port);
+}
+
+static
+BOOL
+InitFunctionPointers(VOID)
+{
+    OVERLAPPED_ENTRY Entry;
+    HMODULE hKernel32, hDll;
+    HANDLE Port;
+    ULONG Removed;
+    BOOL Ret;
+
+    hKernel32 = GetModuleHandleW(L"kernel32.dll");
+    pSetFileCompletionNotificationModes = (PVOID)GetProcAddress(hKernel32, "SetFileCompletionNotificationModes");
+
+    hDll = hKernel32;
+    if (!GetProcAddress(hDll, "GetQueuedCompletionStatusEx"))
+        hDll = LoadLibraryW(L"kernel32_vista.dll");
+    if (hDll)
+        pGetQueuedCompletionStatusEx = (PVOID)GetProcAddress(hDll, "GetQueuedCompletionStatusEx");
+
+    if (!pGetQueuedCompletionStatusEx || !pSetFileCompletionNotificationModes)
+        return FALSE;
+
+    /* kernel32_vista fails the call when ntdll does not export the system call */
+    Port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    if (!Port)
+        return FALSE;
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, &Entry, 1, &Removed, 0, FALSE);
+    Ret = Ret || GetLastError() != ERROR_CALL_NOT_IMPLEMENTED;
+    CloseHandle(Port);
+    return Ret;
+}
+
+START_TEST(iocp)
+{
+    LARGE_INTEGER Counter, Frequency;
+    ULONGLONG SingleRate, BatchRate, SkipRate;
+    WSADATA wdata;
+    int iResult;
+
+    if (!InitFunctionPointers())
+    {
+        skip("GetQueuedCompletionStatusEx or SetFileCompletionNotificationModes not available\n");
+        return;
+    }
+
+    iResult = WSAStartup(MAKEWORD(2, 2), &wdata);
+    ok(iResult == 0, "WSAStartup failed, iResult == %d\n", iResult);
+    if (iResult)
+        return;
+
+    TestBatchDequeue();
+    TestSkipOnSuccess();
+
+    /* Echo over loopback: one packet per call, batches, and batches without packets for inline completions */
+    NtQueryPerformanceCounter(&Counter, &Frequency);
+    if (!Frequency.QuadPart)
+    {
+        skip("No performance counter\n");
+    }
+    else
+    {
+        SingleRate = BenchmarkEcho(FALSE, FALSE, Frequency.QuadPart);
+        BatchRate = BenchmarkEcho(TRUE, FALSE, Frequency.QuadPart);
+        SkipRate = BenchmarkEcho(TRUE, TRUE, Frequency.QuadPart);
+        trace("%I64u completions/s with GetQueuedCompletionStatus, %I64u with GetQueuedCompletionStatusEx, "
+              "%I64u with FILE_SKIP_COMPLETION_PORT_ON_SUCCESS\n", SingleRate, BatchRate, SkipRate);
+    }
+
+    WSACleanup();
+}
@@ -9,6 +9,7 @@
 KMT_TESTFUNC Test_CcCopyRead;
 KMT_TESTFUNC Test_CcCopyWrite;
 KMT_TESTFUNC Test_CcMapData;
+KMT_TESTFUNC Test_CcMdl;
 KMT_TESTFUNC Test_CcPinMappedData;
 KMT_TESTFUNC Test_CcPinRead;
 KMT_TESTFUNC Test_CcSetFileSizes;
@@ -43,6 +44,7 @@ const KMT_TEST TestList[] =
     { "CcCopyRead",                   Test_CcCopyRead },
     { "CcCopyWrite",                  Test_CcCopyWrite },
     { "CcMapData",                    Test_CcMapData },
+    { "CcMdl",                        Test_CcMdl },
     { "CcPinMappedData",              Test_CcPinMappedData },
     { "CcPinRead",                    Test_CcPinRead },
     { "CcSetFileSizes",               Test_CcSetFileSizes },
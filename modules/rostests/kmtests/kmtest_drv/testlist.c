@@ -54,6 +54,7 @@ KMT_TESTFUNC Test_NpfsCreate;
 KMT_TESTFUNC Test_NpfsFileInfo;
 KMT_TESTFUNC Test_NpfsReadWrite;
 KMT_TESTFUNC Test_NpfsVolumeInfo;
+KMT_TESTFUNC Test_ObDirectory;
 KMT_TESTFUNC Test_ObHandle;
 KMT_TESTFUNC Test_ObReference;
 KMT_TESTFUNC Test_ObSecurity;
@@ -131,6 +132,7 @@ const KMT_TEST TestList[] =
     { "NpfsFileInfo",                       Test_NpfsFileInfo },
     { "NpfsReadWrite",                      Test_NpfsReadWrite },
     { "NpfsVolumeInfo",                     Test_NpfsVolumeInfo },
+    { "ObDirectory",                        Test_ObDirectory },
     { "ObHandle",                           Test_ObHandle },
     { "ObReference",                        Test_ObReference },
     { "ObSecurity",                         Test_ObSecurity },
@@ -7,6 +7,65 @@
 
 #include <kmt_test.h>
 
+/* Views spread over a 4GB file, enough to make a linear VACB walk show */
+#define THROUGHPUT_VIEWS 256
+#define THROUGHPUT_STRIDE (4294967296LL / THROUGHPUT_VIEWS)
+#define THROUGHPUT_READS 100000
+
+static
+VOID
+TestRandomReadThroughput(
+    _In_ PUNICODE_STRING FileName,
+    _In_ PVOID Buffer)
+{
+    HANDLE Handle;
+    NTSTATUS Status;
+    ULONG i, Seed;
+    LARGE_INTEGER ByteOffset, Start, End, Frequency;
+    IO_STATUS_BLOCK IoStatusBlock;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    ULONGLONG Elapsed;
+
+    InitializeObjectAttributes(&ObjectAttributes, FileName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtOpenFile(&Handle, FILE_ALL_ACCESS, &ObjectAttributes, &IoStatusBlock, 0, FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    /* Bring the first page of every view in, so that we only time the cached path */
+    for (i = 0; i < THROUGHPUT_VIEWS; i++)
+    {
+        ByteOffset.QuadPart = i * THROUGHPUT_STRIDE;
+        Status = NtReadFile(Handle, NULL, NULL, NULL, &IoStatusBlock, Buffer, 512, &ByteOffset, NULL);
+        ok_eq_hex(Status, STATUS_SUCCESS);
+    }
+
+    Seed = 0x12345678;
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    for (i = 0; i < THROUGHPUT_READS; i++)
+    {
+        ByteOffset.QuadPart = (RtlRandom(&Seed) % THROUGHPUT_VIEWS) * THROUGHPUT_STRIDE +
+                              (RtlRandom(&Seed) % (PAGE_SIZE - 512));
+        Status = NtReadFile(Handle, NULL, NULL, NULL, &IoStatusBlock, Buffer, 512, &ByteOffset, NULL);
+        if (!NT_SUCCESS(Status))
+        {
+            ok_eq_hex(Status, STATUS_SUCCESS);
+            break;
+        }
+    }
+    NtQueryPerformanceCounter(&End, NULL);
+
+    Elapsed = End.QuadPart - Start.QuadPart;
+    if (Elapsed != 0 && Frequency.QuadPart != 0)
+    {
+        trace("CcCopyRead: %lu random reads over %u views in %I64u ms (%I64u reads/s)\n",
+              i, THROUGHPUT_VIEWS, Elapsed * 1000 / Frequency.QuadPart,
+              i * Frequency.QuadPart / Elapsed);
+    }
+
+    NtClose(Handle);
+}
+
 START_TEST(CcCopyRead)
 {
     HANDLE Handle;
@@ -20,6 +79,8 @@ START_TEST(CcCopyRead)
     UNICODE_STRING ReallySmallAlignmentTest = RTL_CONSTANT_STRING(L"\\Device\\Kmtest-CcCopyRead\\ReallySmallAlignmentTest");
     UNICODE_STRING FileBig = RTL_CONSTANT_STRING(L"\\Device\\Kmtest-CcCopyRead\\FileBig");
     UNICODE_STRING BehaviourTestFile = RTL_CONSTANT_STRING(L"\\Device\\Kmtest-CcCopyRead\\BehaviourTestFile");
+    /* Same 4GB file as FileBig, the driver only looks at the first letter */
+    UNICODE_STRING ThroughputTest = RTL_CONSTANT_STRING(L"\\Device\\Kmtest-CcCopyRead\\FileThroughputTest");
 
     KmtLoadDriver(L"CcCopyRead", FALSE);
     KmtOpenDriver();
@@ -111,6 +172,8 @@ START_TEST(CcCopyRead)
 
     NtClose(Handle);
 
+    TestRandomReadThroughput(&ThroughputTest, Buffer);
+
     RtlFreeHeap(RtlGetProcessHeap(), 0, Buffer);
     KmtCloseDriver();
     KmtUnloadDriver();
@@ -0,0 +1,424 @@
+/*
+ * PROJECT:     ReactOS kernel-mode tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     Test driver for the cache manager MDL interface
+ */
+
+#include <kmt_test.h>
+
+#define NDEBUG
+#include <debug.h>
+
+#define TEST_FILE_SIZE 1000000
+
+typedef struct _TEST_FCB
+{
+    FSRTL_ADVANCED_FCB_HEADER Header;
+    SECTION_OBJECT_POINTERS SectionObjectPointers;
+    FAST_MUTEX HeaderMutex;
+} TEST_FCB, *PTEST_FCB;
+
+static PFILE_OBJECT TestFileObject;
+static PDEVICE_OBJECT TestDeviceObject;
+static KMT_IRP_HANDLER TestIrpHandler;
+static FAST_IO_DISPATCH TestFastIoDispatch;
+
+static BOOLEAN WriteCalled;
+static UCHAR WrittenByte;
+
+/* What the disk holds at every offset of the file */
+#define PATTERN(Offset) ((UCHAR)((Offset) ^ ((Offset) >> 8)))
+
+static
+BOOLEAN
+NTAPI
+FastIoRead(
+    _In_ PFILE_OBJECT FileObject,
+    _In_ PLARGE_INTEGER FileOffset,
+    _In_ ULONG Length,
+    _In_ BOOLEAN Wait,
+    _In_ ULONG LockKey,
+    _Out_ PVOID Buffer,
+    _Out_ PIO_STATUS_BLOCK IoStatus,
+    _In_ PDEVICE_OBJECT DeviceObject)
+{
+    IoStatus->Status = STATUS_NOT_SUPPORTED;
+    return FALSE;
+}
+
+NTSTATUS
+TestEntry(
+    _In_ PDRIVER_OBJECT DriverObject,
+    _In_ PCUNICODE_STRING RegistryPath,
+    _Out_ PCWSTR *DeviceName,
+    _Inout_ INT *Flags)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    PAGED_CODE();
+
+    UNREFERENCED_PARAMETER(RegistryPath);
+
+    *DeviceName = L"CcMdl";
+    *Flags = TESTENTRY_NO_EXCLUSIVE_DEVICE |
+             TESTENTRY_BUFFERED_IO_DEVICE |
+             TESTENTRY_NO_READONLY_DEVICE;
+
+    KmtRegisterIrpHandler(IRP_MJ_CLEANUP, NULL, TestIrpHandler);
+    KmtRegisterIrpHandler(IRP_MJ_CREATE, NULL, TestIrpHandler);
+    KmtRegisterIrpHandler(IRP_MJ_READ, NULL, TestIrpHandler);
+    KmtRegisterIrpHandler(IRP_MJ_WRITE, NULL, TestIrpHandler);
+
+    TestFastIoDispatch.FastIoRead = FastIoRead;
+    DriverObject->FastIoDispatch = &TestFastIoDispatch;
+
+    return Status;
+}
+
+VOID
+TestUnload(
+    _In_ PDRIVER_OBJECT DriverObject)
+{
+    PAGED_CODE();
+}
+
+BOOLEAN
+NTAPI
+AcquireForLazyWrite(
+    _In_ PVOID Context,
+    _In_ BOOLEAN Wait)
+{
+    return TRUE;
+}
+
+VOID
+NTAPI
+ReleaseFromLazyWrite(
+    _In_ PVOID Context)
+{
+    return;
+}
+
+BOOLEAN
+NTAPI
+AcquireForReadAhead(
+    _In_ PVOID Context,
+    _In_ BOOLEAN Wait)
+{
+    return TRUE;
+}
+
+VOID
+NTAPI
+ReleaseFromReadAhead(
+    _In_ PVOID Context)
+{
+    return;
+}
+
+static CACHE_MANAGER_CALLBACKS Callbacks = {
+    AcquireForLazyWrite,
+    ReleaseFromLazyWrite,
+    AcquireForReadAhead,
+    ReleaseFromReadAhead,
+};
+
+static
+PVOID
+MapAndLockUserBuffer(
+    _In_ _Out_ PIRP Irp,
+    _In_ ULONG BufferLength)
+{
+    PMDL Mdl;
+
+    if (Irp->MdlAddress == NULL)
+    {
+        Mdl = IoAllocateMdl(Irp->UserBuffer, BufferLength, FALSE, FALSE, Irp);
+        if (Mdl == NULL)
+        {
+            return NULL;
+        }
+
+        _SEH2_TRY
+        {
+            MmProbeAndLockPages(Mdl, Irp->RequestorMode, IoWriteAccess);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            IoFreeMdl(Mdl);
+            Irp->MdlAddress = NULL;
+            _SEH2_YIELD(return NULL);
+        }
+        _SEH2_END;
+    }
+
+    return MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority);
+}
+
+/* Checks that the chain describes [Offset, Offset + Length) of the file, one MDL per view */
+static
+VOID
+CheckMdlChain(
+    _In_ PMDL MdlChain,
+    _In_ LONGLONG Offset,
+    _In_ ULONG Length,
+    _In_ ULONG ExpectedCount)
+{
+    PMDL Mdl;
+    PUCHAR Buffer;
+    ULONG Count = 0, Total = 0, MdlLength, i;
+    BOOLEAN Match = TRUE;
+
+    for (Mdl = MdlChain; Mdl != NULL; Mdl = Mdl->Next)
+    {
+        MdlLength = MmGetMdlByteCount(Mdl);
+        ok((Mdl->MdlFlags & MDL_PAGES_LOCKED) != 0, "MDL %lu not locked\n", Count);
+        ok((Offset + Total) / VACB_MAPPING_GRANULARITY == (Offset + Total + MdlLength - 1) / VACB_MAPPING_GRANULARITY,
+           "MDL %lu crosses a view\n", Count);
+
+        Buffer = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority);
+        ok(Buffer != NULL, "Null pointer!\n");
+        if (Buffer != NULL)
+        {
+            for (i = 0; i < MdlLength && Match; i++)
+            {
+                Match = (Buffer[i] == PATTERN(Offset + Total + i));
+            }
+        }
+
+        Count++;
+        Total += MdlLength;
+    }
+
+    ok_eq_ulong(Count, ExpectedCount);
+    ok_eq_ulong(Total, Length);
+    ok(Match, "The pages don't hold the file data\n");
+}
+
+static
+VOID
+Test_CcMdl(PFILE_OBJECT FileObject)
+{
+    PMDL MdlChain, Mdl;
+    PUCHAR Buffer;
+    LARGE_INTEGER Offset, SecondOffset;
+    IO_STATUS_BLOCK IoStatus;
+    UCHAR Data[16];
+    ULONG Count;
+
+    /* Across the first two views */
+    MdlChain = NULL;
+    Offset.QuadPart = 1000;
+    RtlFillMemory(&IoStatus, sizeof(IoStatus), 0x55);
+    KmtStartSeh()
+        CcMdlRead(FileObject, &Offset, VACB_MAPPING_GRANULARITY + 5000, &MdlChain, &IoStatus);
+    KmtEndSeh(STATUS_SUCCESS);
+    ok_eq_hex(IoStatus.Status, STATUS_SUCCESS);
+    ok_eq_ulongptr(IoStatus.Information, VACB_MAPPING_GRANULARITY + 5000);
+    ok(MdlChain != NULL, "No MDL returned\n");
+    if (MdlChain != NULL)
+    {
+        CheckMdlChain(MdlChain, Offset.QuadPart, VACB_MAPPING_GRANULARITY + 5000, 2);
+
+        /* A second read is appended to the chain the caller already has */
+        SecondOffset.QuadPart = 3 * VACB_MAPPING_GRANULARITY;
+        KmtStartSeh()
+            CcMdlRead(FileObject, &SecondOffset, 100, &MdlChain, &IoStatus);
+        KmtEndSeh(STATUS_SUCCESS);
+        ok_eq_hex(IoStatus.Status, STATUS_SUCCESS);
+        ok_eq_ulongptr(IoStatus.Information, 100);
+        for (Count = 0, Mdl = MdlChain; Mdl->Next != NULL; Mdl = Mdl->Next)
+        {
+            Count++;
+        }
+        ok_eq_ulong(Count, 2);
+        CheckMdlChain(Mdl, SecondOffset.QuadPart, 100, 1);
+
+        CcMdlReadComplete(FileObject, MdlChain);
+    }
+
+    /* Writing in place, the data must show up in the cache and then on the disk */
+    MdlChain = NULL;
+    Offset.QuadPart = PAGE_SIZE + 10;
+    KmtStartSeh()
+        CcPrepareMdlWrite(FileObject, &Offset, sizeof(Data), &MdlChain, &IoStatus);
+    KmtEndSeh(STATUS_SUCCESS);
+    ok_eq_hex(IoStatus.Status, STATUS_SUCCESS);
+    ok_eq_ulongptr(IoStatus.Information, sizeof(Data));
+    ok(MdlChain != NULL, "No MDL returned\n");
+    if (MdlChain != NULL)
+    {
+        ok(MdlChain->Next == NULL, "Expected a single MDL\n");
+        ok_eq_ulong(MmGetMdlByteCount(MdlChain), sizeof(Data));
+        Buffer = MmGetSystemAddressForMdlSafe(MdlChain, NormalPagePriority);
+        ok(Buffer != NULL, "Null pointer!\n");
+        if (Buffer != NULL)
+        {
+            RtlFillMemory(Buffer, sizeof(Data), 0x42);
+        }
+        CcMdlWriteComplete(FileObject, &Offset, MdlChain);
+
+        RtlZeroMemory(Data, sizeof(Data));
+        KmtStartSeh()
+            ok_bool_true(CcCopyRead(FileObject, &Offset, sizeof(Data), TRUE, Data, &IoStatus), "CcCopyRead");
+        KmtEndSeh(STATUS_SUCCESS);
+        ok(Data[0] == 0x42 && Data[sizeof(Data) - 1] == 0x42, "Wrong data: %x %x\n", Data[0], Data[sizeof(Data) - 1]);
+
+        /* The write completion marked the page dirty */
+        WriteCalled = FALSE;
+        WrittenByte = 0;
+        CcFlushCache(FileObject->SectionObjectPointer, &Offset, sizeof(Data), &IoStatus);
+        ok_eq_hex(IoStatus.Status, STATUS_SUCCESS);
+        ok_bool_true(WriteCalled, "Flushing didn't write");
+        ok_eq_uint(WrittenByte, 0x42);
+    }
+
+    /* An aborted write leaves nothing to flush */
+    MdlChain = NULL;
+    Offset.QuadPart = 2 * PAGE_SIZE;
+    KmtStartSeh()
+        CcPrepareMdlWrite(FileObject, &Offset, sizeof(Data), &MdlChain, &IoStatus);
+    KmtEndSeh(STATUS_SUCCESS);
+    ok_eq_hex(IoStatus.Status, STATUS_SUCCESS);
+    ok(MdlChain != NULL, "No MDL returned\n");
+    if (MdlChain != NULL)
+    {
+        CcMdlWriteAbort(FileObject, MdlChain);
+
+        WriteCalled = FALSE;
+        CcFlushCache(FileObject->SectionObjectPointer, &Offset, sizeof(Data), &IoStatus);
+        ok_eq_hex(IoStatus.Status, STATUS_SUCCESS);
+        ok_bool_false(WriteCalled, "Flushing an aborted write wrote");
+    }
+}
+
+static
+NTSTATUS
+TestIrpHandler(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp,
+    _In_ PIO_STACK_LOCATION IoStack)
+{
+    LARGE_INTEGER Zero = RTL_CONSTANT_LARGE_INTEGER(0LL);
+    NTSTATUS Status;
+    PTEST_FCB Fcb;
+    CACHE_UNINITIALIZE_EVENT CacheUninitEvent;
+
+    PAGED_CODE();
+
+    DPRINT("IRP %x/%x\n", IoStack->MajorFunction, IoStack->MinorFunction);
+    ASSERT(IoStack->MajorFunction == IRP_MJ_CLEANUP ||
+           IoStack->MajorFunction == IRP_MJ_CREATE ||
+           IoStack->MajorFunction == IRP_MJ_READ ||
+           IoStack->MajorFunction == IRP_MJ_WRITE);
+
+    Status = STATUS_NOT_SUPPORTED;
+    Irp->IoStatus.Information = 0;
+
+    if (IoStack->MajorFunction == IRP_MJ_CREATE)
+    {
+        ok_irql(PASSIVE_LEVEL);
+
+        if (IoStack->FileObject->FileName.Length >= 2 * sizeof(WCHAR))
+        {
+            TestDeviceObject = DeviceObject;
+            TestFileObject = IoStack->FileObject;
+        }
+        Fcb = ExAllocatePoolWithTag(NonPagedPool, sizeof(*Fcb), 'FwrI');
+        RtlZeroMemory(Fcb, sizeof(*Fcb));
+        ExInitializeFastMutex(&Fcb->HeaderMutex);
+        FsRtlSetupAdvancedHeader(&Fcb->Header, &Fcb->HeaderMutex);
+        Fcb->Header.AllocationSize.QuadPart = TEST_FILE_SIZE;
+        Fcb->Header.FileSize.QuadPart = TEST_FILE_SIZE;
+        Fcb->Header.ValidDataLength.QuadPart = TEST_FILE_SIZE;
+        Fcb->Header.IsFastIoPossible = FastIoIsNotPossible;
+        IoStack->FileObject->FsContext = Fcb;
+        IoStack->FileObject->SectionObjectPointer = &Fcb->SectionObjectPointers;
+
+        CcInitializeCacheMap(IoStack->FileObject,
+                             (PCC_FILE_SIZES)&Fcb->Header.AllocationSize,
+                             FALSE, &Callbacks, NULL);
+
+        Irp->IoStatus.Information = FILE_OPENED;
+        Status = STATUS_SUCCESS;
+    }
+    else if (IoStack->MajorFunction == IRP_MJ_READ)
+    {
+        ULONG Length, i;
+        PUCHAR Buffer;
+        LARGE_INTEGER Offset;
+
+        Offset = IoStack->Parameters.Read.ByteOffset;
+        Length = IoStack->Parameters.Read.Length;
+
+        ok_eq_pointer(DeviceObject, TestDeviceObject);
+        ok_eq_pointer(IoStack->FileObject, TestFileObject);
+
+        if (!FlagOn(Irp->Flags, IRP_NOCACHE))
+        {
+            ok_irql(PASSIVE_LEVEL);
+
+            Test_CcMdl(IoStack->FileObject);
+            Status = STATUS_SUCCESS;
+        }
+        else
+        {
+            /* Cc bringing the pages in */
+            ok((Irp->Flags & IRP_PAGING_IO) != 0, "Non paging IO\n");
+            ok(Length % PAGE_SIZE == 0, "Length is not aligned: %lu\n", Length);
+
+            Buffer = MapAndLockUserBuffer(Irp, Length);
+            ok(Buffer != NULL, "Null pointer!\n");
+            if (Buffer != NULL)
+            {
+                for (i = 0; i < Length; i++)
+                {
+                    Buffer[i] = PATTERN(Offset.QuadPart + i);
+                }
+            }
+
+            Status = STATUS_SUCCESS;
+            Irp->IoStatus.Information = Length;
+        }
+    }
+    else if (IoStack->MajorFunction == IRP_MJ_WRITE)
+    {
+        ULONG Length;
+        PUCHAR Buffer;
+        LARGE_INTEGER Offset;
+
+        Offset = IoStack->Parameters.Write.ByteOffset;
+        Length = IoStack->Parameters.Write.Length;
+
+        /* Only Cc writes back here */
+        ok(BooleanFlagOn(Irp->Flags, IRP_NOCACHE), "IRP not coming from Cc!\n");
+        ok((Irp->Flags & IRP_PAGING_IO) != 0, "Non paging IO\n");
+
+        Buffer = MapAndLockUserBuffer(Irp, Length);
+        ok(Buffer != NULL, "Null pointer!\n");
+        if (Buffer != NULL && Offset.QuadPart <= PAGE_SIZE + 10 && Offset.QuadPart + Length > PAGE_SIZE + 10)
+        {
+            WrittenByte = Buffer[PAGE_SIZE + 10 - Offset.QuadPart];
+        }
+        WriteCalled = TRUE;
+
+        Status = STATUS_SUCCESS;
+        Irp->IoStatus.Information = Length;
+    }
+    else if (IoStack->MajorFunction == IRP_MJ_CLEANUP)
+    {
+        ok_irql(PASSIVE_LEVEL);
+        KeInitializeEvent(&CacheUninitEvent.Event, NotificationEvent, FALSE);
+        CcUninitializeCacheMap(IoStack->FileObject, &Zero, &CacheUninitEvent);
+        KeWaitForSingleObject(&CacheUninitEvent.Event, Executive, KernelMode, FALSE, NULL);
+        Fcb = IoStack->FileObject->FsContext;
+        ExFreePoolWithTag(Fcb, 'FwrI');
+        IoStack->FileObject->FsContext = NULL;
+        Status = STATUS_SUCCESS;
+    }
+
+    Irp->IoStatus.Status = Status;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return Status;
+}
@@ -0,0 +1,37 @@
+/*
+ * PROJECT:     ReactOS kernel-mode tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     Kernel-Mode Test Suite cache manager MDL interface test user-mode part
+ */
+
+#include <kmt_test.h>
+
+START_TEST(CcMdl)
+{
+    HANDLE Handle;
+    NTSTATUS Status;
+    LARGE_INTEGER ByteOffset;
+    IO_STATUS_BLOCK IoStatusBlock;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    UCHAR Buffer[16];
+    UNICODE_STRING BehaviourTestFile = RTL_CONSTANT_STRING(L"\\Device\\Kmtest-CcMdl\\BehaviourTestFile");
+
+    KmtLoadDriver(L"CcMdl", FALSE);
+    KmtOpenDriver();
+
+    /* The tests run in the driver, from the cached read */
+    InitializeObjectAttributes(&ObjectAttributes, &BehaviourTestFile, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtOpenFile(&Handle, FILE_ALL_ACCESS, &ObjectAttributes, &IoStatusBlock, 0, FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+    {
+        ByteOffset.QuadPart = 0;
+        Status = NtReadFile(Handle, NULL, NULL, NULL, &IoStatusBlock, Buffer, sizeof(Buffer), &ByteOffset, NULL);
+        ok_eq_hex(Status, STATUS_SUCCESS);
+
+        NtClose(Handle);
+    }
+
+    KmtCloseDriver();
+    KmtUnloadDriver();
+}
@@ -2474,6 +2474,107 @@ end_test:
     FsRtlUninitializeLargeMcb(&Mcb);
 }
 
+/* Without an index, mapped runs are looked up in the tree instead of being enumerated */
+static VOID FsRtlLargeMcbTestsTree(VOID)
+{
+#define TREE_RUNS 64
+    LARGE_MCB LargeMcb;
+    ULONG i, NbRuns, Index;
+    LONGLONG Vbn, Lbn, SectorCount, StartingLbn, CountFromStartingLbn;
+    LONGLONG Lbn2, SectorCount2, StartingLbn2, CountFromStartingLbn2;
+    BOOLEAN Result, Result2;
+
+    FsRtlInitializeLargeMcb(&LargeMcb, PagedPool);
+
+    /* Runs of 8 sectors every 16 sectors, with holes between them */
+    for (i = 0; i < TREE_RUNS; i++)
+    {
+        ok(FsRtlAddLargeMcbEntry(&LargeMcb, i * 16, 1000 + i * 32, 8) == TRUE, "Run %lu: expected TRUE, got FALSE\n", i);
+    }
+    NbRuns = FsRtlNumberOfRunsInLargeMcb(&LargeMcb);
+    ok(NbRuns == 2 * TREE_RUNS - 1, "Expected %d runs, got: %lu\n", 2 * TREE_RUNS - 1, NbRuns);
+
+    /* In a run: at its start, in the middle and on its last sector */
+    for (i = 0; i < TREE_RUNS; i++)
+    {
+        ok(FsRtlLookupLargeMcbEntry(&LargeMcb, i * 16 + 3, &Lbn, &SectorCount, &StartingLbn, &CountFromStartingLbn, NULL) == TRUE, "Run %lu: expected TRUE, got FALSE\n", i);
+        ok(Lbn == 1000 + i * 32 + 3, "Run %lu: Expected Lbn %lu, got: %I64d\n", i, 1000 + i * 32 + 3, Lbn);
+        ok(SectorCount == 5, "Run %lu: Expected SectorCount 5, got: %I64d\n", i, SectorCount);
+        ok(StartingLbn == 1000 + i * 32, "Run %lu: Expected StartingLbn %lu, got: %I64d\n", i, 1000 + i * 32, StartingLbn);
+        ok(CountFromStartingLbn == 8, "Run %lu: Expected CountFromStartingLbn 8, got: %I64d\n", i, CountFromStartingLbn);
+
+        ok(FsRtlLookupLargeMcbEntry(&LargeMcb, i * 16, &Lbn, &SectorCount, NULL, NULL, NULL) == TRUE, "Run %lu: expected TRUE, got FALSE\n", i);
+        ok(Lbn == 1000 + i * 32, "Run %lu: Expected Lbn %lu, got: %I64d\n", i, 1000 + i * 32, Lbn);
+        ok(SectorCount == 8, "Run %lu: Expected SectorCount 8, got: %I64d\n", i, SectorCount);
+
+        ok(FsRtlLookupLargeMcbEntry(&LargeMcb, i * 16 + 7, &Lbn, &SectorCount, NULL, NULL, NULL) == TRUE, "Run %lu: expected TRUE, got FALSE\n", i);
+        ok(Lbn == 1000 + i * 32 + 7, "Run %lu: Expected Lbn %lu, got: %I64d\n", i, 1000 + i * 32 + 7, Lbn);
+        ok(SectorCount == 1, "Run %lu: Expected SectorCount 1, got: %I64d\n", i, SectorCount);
+    }
+
+    /* In a hole, which is only known by going through the runs */
+    ok(FsRtlLookupLargeMcbEntry(&LargeMcb, 16 * 10 + 10, &Lbn, &SectorCount, &StartingLbn, &CountFromStartingLbn, NULL) == TRUE, "expected TRUE, got FALSE\n");
+    ok(Lbn == -1, "Expected Lbn -1, got: %I64d\n", Lbn);
+    ok(SectorCount == 6, "Expected SectorCount 6, got: %I64d\n", SectorCount);
+    ok(StartingLbn == -1, "Expected StartingLbn -1, got: %I64d\n", StartingLbn);
+    ok(CountFromStartingLbn == 8, "Expected CountFromStartingLbn 8, got: %I64d\n", CountFromStartingLbn);
+
+    /* Past the end */
+    ok(FsRtlLookupLargeMcbEntry(&LargeMcb, (TREE_RUNS - 1) * 16 + 8, &Lbn, &SectorCount, NULL, NULL, NULL) == FALSE, "expected FALSE, got TRUE\n");
+
+    /* The tree lookup must give the same answers as the traversal, which counts the index */
+    for (Vbn = 0; Vbn < TREE_RUNS * 16 + 2; Vbn++)
+    {
+        Result = FsRtlLookupLargeMcbEntry(&LargeMcb, Vbn, &Lbn, &SectorCount, &StartingLbn, &CountFromStartingLbn, NULL);
+        Result2 = FsRtlLookupLargeMcbEntry(&LargeMcb, Vbn, &Lbn2, &SectorCount2, &StartingLbn2, &CountFromStartingLbn2, &Index);
+        ok(Result == Result2, "Vbn %I64d: Expected %d, got: %d\n", Vbn, Result2, Result);
+        if (!Result || !Result2)
+            continue;
+
+        ok(Lbn == Lbn2, "Vbn %I64d: Expected Lbn %I64d, got: %I64d\n", Vbn, Lbn2, Lbn);
+        ok(SectorCount == SectorCount2, "Vbn %I64d: Expected SectorCount %I64d, got: %I64d\n", Vbn, SectorCount2, SectorCount);
+        ok(StartingLbn == StartingLbn2, "Vbn %I64d: Expected StartingLbn %I64d, got: %I64d\n", Vbn, StartingLbn2, StartingLbn);
+        ok(CountFromStartingLbn == CountFromStartingLbn2, "Vbn %I64d: Expected CountFromStartingLbn %I64d, got: %I64d\n", Vbn, CountFromStartingLbn2, CountFromStartingLbn);
+        ok(Index == (ULONG)(Vbn / 8), "Vbn %I64d: Expected Index %lu, got: %lu\n", Vbn, (ULONG)(Vbn / 8), Index);
+    }
+
+    /* Adding what is already mapped is a no-op, mapping it elsewhere fails */
+    ok(FsRtlAddLargeMcbEntry(&LargeMcb, 16 * 20 + 2, 1000 + 32 * 20 + 2, 4) == TRUE, "expected TRUE, got FALSE\n");
+    ok(FsRtlAddLargeMcbEntry(&LargeMcb, 16 * 20 + 2, 5000, 4) == FALSE, "expected FALSE, got TRUE\n");
+    NbRuns = FsRtlNumberOfRunsInLargeMcb(&LargeMcb);
+    ok(NbRuns == 2 * TREE_RUNS - 1, "Expected %d runs, got: %lu\n", 2 * TREE_RUNS - 1, NbRuns);
+    ok(FsRtlLookupLargeMcbEntry(&LargeMcb, 16 * 20 + 2, &Lbn, &SectorCount, NULL, NULL, NULL) == TRUE, "expected TRUE, got FALSE\n");
+    ok(Lbn == 1000 + 32 * 20 + 2, "Expected Lbn %d, got: %I64d\n", 1000 + 32 * 20 + 2, Lbn);
+    ok(SectorCount == 6, "Expected SectorCount 6, got: %I64d\n", SectorCount);
+
+    /* Extending the last run merges with it */
+    ok(FsRtlAddLargeMcbEntry(&LargeMcb, (TREE_RUNS - 1) * 16 + 8, 1000 + (TREE_RUNS - 1) * 32 + 8, 8) == TRUE, "expected TRUE, got FALSE\n");
+    NbRuns = FsRtlNumberOfRunsInLargeMcb(&LargeMcb);
+    ok(NbRuns == 2 * TREE_RUNS - 1, "Expected %d runs, got: %lu\n", 2 * TREE_RUNS - 1, NbRuns);
+    ok(FsRtlLookupLargeMcbEntry(&LargeMcb, (TREE_RUNS - 1) * 16 + 12, &Lbn, &SectorCount, &StartingLbn, &CountFromStartingLbn, NULL) == TRUE, "expected TRUE, got FALSE\n");
+    ok(Lbn == 1000 + (TREE_RUNS - 1) * 32 + 12, "Expected Lbn %d, got: %I64d\n", 1000 + (TREE_RUNS - 1) * 32 + 12, Lbn);
+    ok(SectorCount == 4, "Expected SectorCount 4, got: %I64d\n", SectorCount);
+    ok(StartingLbn == 1000 + (TREE_RUNS - 1) * 32, "Expected StartingLbn %d, got: %I64d\n", 1000 + (TREE_RUNS - 1) * 32, StartingLbn);
+    ok(CountFromStartingLbn == 16, "Expected CountFromStartingLbn 16, got: %I64d\n", CountFromStartingLbn);
+
+    /* Filling the first hole so that it ends where the next run starts merges with that one */
+    ok(FsRtlAddLargeMcbEntry(&LargeMcb, 8, 1000 + 32 - 8, 8) == TRUE, "expected TRUE, got FALSE\n");
+    NbRuns = FsRtlNumberOfRunsInLargeMcb(&LargeMcb);
+    ok(NbRuns == 2 * TREE_RUNS - 2, "Expected %d runs, got: %lu\n", 2 * TREE_RUNS - 2, NbRuns);
+    ok(FsRtlLookupLargeMcbEntry(&LargeMcb, 8, &Lbn, &SectorCount, &StartingLbn, &CountFromStartingLbn, NULL) == TRUE, "expected TRUE, got FALSE\n");
+    ok(Lbn == 1000 + 32 - 8, "Expected Lbn %d, got: %I64d\n", 1000 + 32 - 8, Lbn);
+    ok(SectorCount == 16, "Expected SectorCount 16, got: %I64d\n", SectorCount);
+    ok(StartingLbn == 1000 + 32 - 8, "Expected StartingLbn %d, got: %I64d\n", 1000 + 32 - 8, StartingLbn);
+    ok(CountFromStartingLbn == 16, "Expected CountFromStartingLbn 16, got: %I64d\n", CountFromStartingLbn);
+    ok(FsRtlLookupLargeMcbEntry(&LargeMcb, 16 + 4, &Lbn, &SectorCount, NULL, NULL, &Index) == TRUE, "expected TRUE, got FALSE\n");
+    ok(Lbn == 1000 + 32 + 4, "Expected Lbn %d, got: %I64d\n", 1000 + 32 + 4, Lbn);
+    ok(SectorCount == 4, "Expected SectorCount 4, got: %I64d\n", SectorCount);
+    ok(Index == 1, "Expected Index 1, got: %lu\n", Index);
+
+    FsRtlUninitializeLargeMcb(&LargeMcb);
+#undef TREE_RUNS
+}
+
 START_TEST(FsRtlMcb)
 {
     FsRtlMcbTest();
@@ -2482,4 +2583,5 @@ START_TEST(FsRtlMcb)
     FsRtlLargeMcbTestsFastFat();
     FsRtlLargeMcbTestsFastFat_2();
     FsRtlLargeMcbTestsFastFat_3();
+    FsRtlLargeMcbTestsTree();
 }
@@ -0,0 +1,131 @@
+/*
+ * PROJECT:     ReactOS kernel-mode tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Kernel-Mode Test for object directory lookups
+ */
+
+#include <kmt_test.h>
+
+#define NDEBUG
+#include <debug.h>
+
+#define TAG_OB_DIRECTORY_TEST   'DOmK'
+#define MAX_OBJECTS             4096
+#define OPENS_PER_ROUND         1024
+
+static
+NTSTATUS
+OpenNamedEvent(
+    _In_ HANDLE DirectoryHandle,
+    _In_ ULONG Index,
+    _Out_ PHANDLE EventHandle)
+{
+    NTSTATUS Status;
+    WCHAR NameBuffer[32];
+    UNICODE_STRING Name;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+
+    Status = RtlStringCbPrintfW(NameBuffer, sizeof(NameBuffer), L"Event%lu", Index);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    RtlInitUnicodeString(&Name, NameBuffer);
+    InitializeObjectAttributes(&ObjectAttributes, &Name, OBJ_KERNEL_HANDLE, DirectoryHandle, NULL);
+    return ZwOpenEvent(EventHandle, EVENT_ALL_ACCESS, &ObjectAttributes);
+}
+
+static
+VOID
+TestDirectoryGrowth(
+    _In_ HANDLE DirectoryHandle,
+    _Inout_updates_(MAX_OBJECTS) PHANDLE Events)
+{
+    NTSTATUS Status;
+    WCHAR NameBuffer[32];
+    UNICODE_STRING Name;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    LARGE_INTEGER Frequency, Start, End;
+    HANDLE Handle;
+    ULONG Count, Created, i;
+
+    KeQueryPerformanceCounter(&Frequency);
+
+    /* Grow the directory in steps and see how opening names scales */
+    for (Count = 64, Created = 0; Count <= MAX_OBJECTS; Count *= 4)
+    {
+        for (; Created < Count; Created++)
+        {
+            Status = RtlStringCbPrintfW(NameBuffer, sizeof(NameBuffer), L"Event%lu", Created);
+            ok_eq_hex(Status, STATUS_SUCCESS);
+            RtlInitUnicodeString(&Name, NameBuffer);
+            InitializeObjectAttributes(&ObjectAttributes, &Name, OBJ_KERNEL_HANDLE, DirectoryHandle, NULL);
+            Status = ZwCreateEvent(&Events[Created], EVENT_ALL_ACCESS, &ObjectAttributes, NotificationEvent, FALSE);
+            ok_eq_hex(Status, STATUS_SUCCESS);
+            if (!NT_SUCCESS(Status))
+            {
+                Events[Created] = NULL;
+                return;
+            }
+        }
+
+        Start = KeQueryPerformanceCounter(NULL);
+        for (i = 0; i < OPENS_PER_ROUND; i++)
+        {
+            Status = OpenNamedEvent(DirectoryHandle, (i * 7919) % Count, &Handle);
+            ok_eq_hex(Status, STATUS_SUCCESS);
+            if (NT_SUCCESS(Status))
+                ZwClose(Handle);
+        }
+        End = KeQueryPerformanceCounter(NULL);
+
+        trace("%lu objects: %I64u ns per open\n",
+              Count,
+              Frequency.QuadPart ? (End.QuadPart - Start.QuadPart) * 1000000000 / Frequency.QuadPart / OPENS_PER_ROUND : 0);
+    }
+
+    /* Names must still resolve correctly after deleting every other one */
+    for (i = 0; i < Created; i += 2)
+    {
+        ZwClose(Events[i]);
+        Events[i] = NULL;
+    }
+    for (i = 0; i < Created; i++)
+    {
+        Status = OpenNamedEvent(DirectoryHandle, i, &Handle);
+        ok_eq_hex(Status, (i % 2) ? STATUS_SUCCESS : STATUS_OBJECT_NAME_NOT_FOUND);
+        if (NT_SUCCESS(Status))
+            ZwClose(Handle);
+    }
+}
+
+START_TEST(ObDirectory)
+{
+    NTSTATUS Status;
+    UNICODE_STRING Name = RTL_CONSTANT_STRING(L"\\KmtestObDirectory");
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    HANDLE DirectoryHandle;
+    PHANDLE Events;
+    ULONG i;
+
+    Events = ExAllocatePoolWithTag(PagedPool, MAX_OBJECTS * sizeof(HANDLE), TAG_OB_DIRECTORY_TEST);
+    if (skip(Events != NULL, "Out of memory\n"))
+        return;
+    RtlZeroMemory(Events, MAX_OBJECTS * sizeof(HANDLE));
+
+    /* A temporary directory, which goes away with its last handle */
+    InitializeObjectAttributes(&ObjectAttributes, &Name, OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE, NULL, NULL);
+    Status = ZwCreateDirectoryObject(&DirectoryHandle, DIRECTORY_ALL_ACCESS, &ObjectAttributes);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    if (!skip(NT_SUCCESS(Status), "No directory\n"))
+    {
+        TestDirectoryGrowth(DirectoryHandle, Events);
+
+        for (i = 0; i < MAX_OBJECTS; i++)
+        {
+            if (Events[i])
+                ZwClose(Events[i]);
+        }
+        Status = ZwClose(DirectoryHandle);
+        ok_eq_hex(Status, STATUS_SUCCESS);
+    }
+
+    ExFreePoolWithTag(Events, TAG_OB_DIRECTORY_TEST);
+}
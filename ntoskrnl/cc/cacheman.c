@@ -15,6 +15,7 @@
 #include <debug.h>
 
 BOOLEAN CcPfEnablePrefetcher;
+ULONG CcPfEnablePrefetcherFlags;
 PFSN_PREFETCHER_GLOBALS CcPfGlobals;
 MM_SYSTEMSIZE CcCapturedSystemSize;
 
@@ -36,8 +37,11 @@ CcPfInitializePrefetcher(VOID)
     InitializeListHead(&CcPfGlobals.ActiveTraces);
     InitializeListHead(&CcPfGlobals.CompletedTraces);
     ExInitializeFastMutex(&CcPfGlobals.CompletedTracesLock);
+    KeInitializeSpinLock(&CcPfGlobals.ActiveTracesLock);
 
-    /* FIXME: Setup the rest of the prefetecher */
+    /* The prefetcher is only enabled on request, see EnablePrefetcher in the registry */
+    CcPfEnablePrefetcherFlags &= (PF_ENABLE_APP_LAUNCH | PF_ENABLE_BOOT);
+    CcPfEnablePrefetcher = (CcPfEnablePrefetcherFlags != 0);
 }
 
 CODE_SEG("INIT")
@@ -290,6 +290,61 @@ Clear:
     return;
 }
 
+/*
+ * Slows down a writer when the dirty pages are getting close to the threshold,
+ * the closer the longer, so that the lazy writer can catch up before writes
+ * have to be deferred. Only the files dirtying a large share of the pages are
+ * slowed down.
+ */
+static
+VOID
+CcThrottleWrite (
+    IN PFILE_OBJECT FileObject,
+    IN ULONG Pages)
+{
+    KIRQL OldIrql;
+    ULONG Dirty, Start, Rate, Delay;
+    LARGE_INTEGER Interval;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+
+    /* Past the threshold, the write is deferred instead */
+    Dirty = CcTotalDirtyPages + Pages;
+    Start = CC_THROTTLE_START(CcDirtyPageThreshold);
+    if (Dirty <= Start || Dirty >= CcDirtyPageThreshold)
+    {
+        return;
+    }
+
+    Rate = 0;
+    OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
+    if (FileObject->SectionObjectPointer != NULL &&
+        FileObject->SectionObjectPointer->SharedCacheMap != NULL)
+    {
+        SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+        Rate = SharedCacheMap->DirtyRate;
+    }
+
+    /* Leave the files that don't dirty much alone */
+    if (Rate == 0 || Rate * 2 < CcDirtyPageRate)
+    {
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
+        return;
+    }
+
+    /* Make sure the lazy writer is at it */
+    if (!LazyWriter.ScanActive)
+    {
+        CcScheduleLazyWriteScan(TRUE);
+    }
+    KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
+
+    /* And give it some time, depending on how close to the threshold we are */
+    Delay = CC_THROTTLE_MAX_DELAY * (Dirty - Start) / (CcDirtyPageThreshold - Start);
+    Interval.QuadPart = -10000LL * max(Delay, 1);
+    InterlockedIncrement((PLONG)&CcThrottledWrites);
+    KeDelayExecutionThread(KernelMode, FALSE, &Interval);
+}
+
 /*
  * @unimplemented
  */
@@ -372,6 +427,12 @@ CcCanIWrite (
         }
     }
 
+    /* Slow down heavy writers smoothly before they hit the threshold */
+    if (Wait && TryContext == FirstTry && !PerFileDefer)
+    {
+        CcThrottleWrite(FileObject, Pages);
+    }
+
     /* So, now allow write if:
      * - Not the first try or we have no throttling yet
      * AND:
@@ -436,6 +497,7 @@ CcCanIWrite (
     }
 
     DPRINT1("Actively deferring write for: %p\n", FileObject);
+    InterlockedIncrement((PLONG)&CcThrottledWrites);
     /* Now, we'll loop until our event is set. When it is set, it means that caller
      * can immediately write, and has to
      */
@@ -15,10 +15,16 @@
 
 /* Counters:
  * - Amount of pages flushed by lazy writer
- * - Number of times lazy writer ran
+ * - Number of writes issued by lazy writer
+ * - Largest of these writes, in pages
+ * - Number of times a writer was slowed down or deferred
+ * - Pages dirtied per lazy writer scan, smoothed
  */
 ULONG CcLazyWritePages = 0;
 ULONG CcLazyWriteIos = 0;
+ULONG CcLazyWriteMaxPages = 0;
+ULONG CcThrottledWrites = 0;
+ULONG CcDirtyPageRate = 0;
 
 /* Internal vars (MS):
  * - Lazy writer status structure
@@ -113,12 +119,54 @@ CcScanDpc(
     CcPostWorkQueue(WorkItem, &CcRegularWorkQueue);
 }
 
+/* Must be called with the master lock held */
+static
+VOID
+CcUpdateDirtyPageRates(VOID)
+{
+    PLIST_ENTRY ListEntry;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+
+    /* Average out the pages each file dirtied since the last scan */
+    CcDirtyPageRate = 0;
+    for (ListEntry = CcCleanSharedCacheMapList.Flink;
+         ListEntry != &CcCleanSharedCacheMapList;
+         ListEntry = ListEntry->Flink)
+    {
+        SharedCacheMap = CONTAINING_RECORD(ListEntry, ROS_SHARED_CACHE_MAP, SharedCacheMapLinks);
+
+        SharedCacheMap->DirtyRate = (SharedCacheMap->DirtyRate * 3 + SharedCacheMap->DirtiedPages) / 4;
+        SharedCacheMap->DirtiedPages = 0;
+        CcDirtyPageRate += SharedCacheMap->DirtyRate;
+    }
+}
+
+static
+ULONG
+CcGetLazyWriteTarget(VOID)
+{
+    ULONG Target, Dirty = CcTotalDirtyPages;
+
+    /* Write one-eighth of the dirty pages, but at least as much as gets
+     * dirtied in between two scans, so that we keep up with the writers
+     */
+    Target = max(Dirty / 8, CcDirtyPageRate);
+
+    /* Past the throttling point, bring the dirty pages back below it */
+    if (Dirty > CC_THROTTLE_START(CcDirtyPageThreshold))
+    {
+        Target = max(Target, Dirty - CC_THROTTLE_START(CcDirtyPageThreshold));
+    }
+
+    return min(Target, Dirty);
+}
+
 VOID
 CcWriteBehind(VOID)
 {
     ULONG Target, Count;
 
-    Target = CcTotalDirtyPages / 8;
+    Target = CcGetLazyWriteTarget();
     if (Target != 0)
     {
         /* Flush! */
@@ -127,7 +175,6 @@ CcWriteBehind(VOID)
 
         /* And update stats */
         CcLazyWritePages += Count;
-        ++CcLazyWriteIos;
         DPRINT("Lazy writer done (%d)\n", Count);
     }
 }
@@ -154,10 +201,13 @@ CcLazyWriteScan(VOID)
         }
         LazyWriter.OtherWork = FALSE;
     }
+
+    /* See how fast pages are getting dirty */
+    CcUpdateDirtyPageRates();
     KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
 
-    /* Our target is one-eighth of the dirty pages */
-    Target = CcTotalDirtyPages / 8;
+    /* Our target depends on how many pages are dirty and how fast they get dirty */
+    Target = CcGetLazyWriteTarget();
     if (Target != 0)
     {
         /* There is stuff to flush, schedule a write-behind operation */
@@ -188,6 +238,13 @@ CcLazyWriteScan(VOID)
          */
         CcScheduleLazyWriteScan(FALSE);
     }
+    else if (Target != 0)
+    {
+        /* Dirty pages are written a bit at a time, keep scanning every second */
+        OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
+        CcScheduleLazyWriteScan(FALSE);
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
+    }
     else
     {
         /* We're no longer active */
@@ -15,6 +15,100 @@
 
 /* FUNCTIONS *****************************************************************/
 
+static
+VOID
+CcpBuildMdlChain (
+    IN PFILE_OBJECT FileObject,
+    IN PLARGE_INTEGER FileOffset,
+    IN ULONG Length,
+    IN LOCK_OPERATION Operation,
+    OUT PMDL * MdlChain,
+    OUT PIO_STATUS_BLOCK IoStatus)
+{
+    PROS_VACB Vacb;
+    PROS_SHARED_CACHE_MAP SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    NTSTATUS Status;
+    LONGLONG CurrentOffset;
+    LONGLONG End;
+    PMDL *Tail;
+    PMDL FirstMdl = NULL;
+    ULONG_PTR Information = 0;
+
+    Status = RtlLongLongAdd(FileOffset->QuadPart, Length, &End);
+    if (!NT_SUCCESS(Status))
+        ExRaiseStatus(Status);
+
+    /* The caller may hand us an existing chain, we append to it */
+    Tail = MdlChain;
+    while (*Tail != NULL)
+    {
+        Tail = &(*Tail)->Next;
+    }
+
+    _SEH2_TRY
+    {
+        CurrentOffset = FileOffset->QuadPart;
+        while (CurrentOffset < End)
+        {
+            ULONG VacbOffset = CurrentOffset % VACB_MAPPING_GRANULARITY;
+            ULONG VacbLength = min(End - CurrentOffset, VACB_MAPPING_GRANULARITY - VacbOffset);
+            PMDL Mdl = NULL;
+
+            Status = CcRosGetVacb(SharedCacheMap, CurrentOffset, &Vacb);
+            if (!NT_SUCCESS(Status))
+                ExRaiseStatus(Status);
+
+            _SEH2_TRY
+            {
+                CcRosEnsureVacbResident(Vacb, TRUE, FALSE, VacbOffset, VacbLength);
+
+                Mdl = IoAllocateMdl(Add2Ptr(Vacb->BaseAddress, VacbOffset), VacbLength, FALSE, FALSE, NULL);
+                if (Mdl == NULL)
+                    ExRaiseStatus(STATUS_INSUFFICIENT_RESOURCES);
+
+                /* Once locked, the pages stay around even if the view goes away */
+                _SEH2_TRY
+                {
+                    MmProbeAndLockPages(Mdl, KernelMode, Operation);
+                }
+                _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+                {
+                    IoFreeMdl(Mdl);
+                    ExRaiseStatus(_SEH2_GetExceptionCode());
+                }
+                _SEH2_END;
+            }
+            _SEH2_FINALLY
+            {
+                CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE);
+            }
+            _SEH2_END;
+
+            if (FirstMdl == NULL)
+                FirstMdl = Mdl;
+            *Tail = Mdl;
+            Tail = &Mdl->Next;
+
+            Information += VacbLength;
+            CurrentOffset += VacbLength;
+        }
+    }
+    _SEH2_FINALLY
+    {
+        if (_SEH2_AbnormalTermination() && FirstMdl != NULL)
+        {
+            /* Unlink and release what we added to the chain */
+            for (Tail = MdlChain; *Tail != FirstMdl; Tail = &(*Tail)->Next);
+            *Tail = NULL;
+            CcMdlReadComplete2(FileObject, FirstMdl);
+        }
+    }
+    _SEH2_END;
+
+    IoStatus->Status = STATUS_SUCCESS;
+    IoStatus->Information = Information;
+}
+
 /*
  * @implemented
  */
@@ -31,7 +125,7 @@ CcMdlRead (
     CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d Length=%lu\n",
         FileObject, FileOffset->QuadPart, Length);
 
-    UNIMPLEMENTED;
+    CcpBuildMdlChain(FileObject, FileOffset, Length, IoReadAccess, MdlChain, IoStatus);
 }
 
 /*
@@ -157,11 +251,54 @@ CcMdlWriteComplete2 (
     IN PLARGE_INTEGER FileOffset,
     IN PMDL MdlChain)
 {
-    UNIMPLEMENTED;
+    PMDL Mdl;
+    PROS_VACB Vacb;
+    PROS_SHARED_CACHE_MAP SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    NTSTATUS Status;
+    LONGLONG CurrentOffset;
+    ULONG Length = 0;
+
+    CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d MdlChain=%p\n",
+        FileObject, FileOffset->QuadPart, MdlChain);
+
+    /* The MDLs describe contiguous chunks of the file, starting at FileOffset.
+     * Data was written to the pages directly, so tell Mm and mark the views
+     * dirty before letting go of the pages.
+     */
+    CurrentOffset = FileOffset->QuadPart;
+    for (Mdl = MdlChain; Mdl != NULL; Mdl = Mdl->Next)
+    {
+        ULONG VacbOffset = CurrentOffset % VACB_MAPPING_GRANULARITY;
+        ULONG MdlLength = MmGetMdlByteCount(Mdl);
+
+        ASSERT(VacbOffset + MdlLength <= VACB_MAPPING_GRANULARITY);
+
+        Status = CcRosGetVacb(SharedCacheMap, CurrentOffset, &Vacb);
+        if (NT_SUCCESS(Status))
+        {
+            Status = MmMakePagesDirty(NULL, Add2Ptr(Vacb->BaseAddress, VacbOffset), MdlLength);
+            CcRosReleaseVacb(SharedCacheMap, Vacb, NT_SUCCESS(Status), FALSE);
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Failed to dirty MDL write at %I64x: %lx\n", CurrentOffset, Status);
+        }
+
+        CurrentOffset += MdlLength;
+        Length += MdlLength;
+    }
+
+    /* Release the pages */
+    CcMdlReadComplete2(FileObject, MdlChain);
+
+    /* Flush if needed */
+    if (FileObject->Flags & FO_WRITE_THROUGH)
+        CcFlushCache(FileObject->SectionObjectPointer, FileOffset, Length, NULL);
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -169,11 +306,14 @@ CcMdlWriteAbort (
     IN PFILE_OBJECT FileObject,
     IN PMDL MdlChain)
 {
-    UNIMPLEMENTED;
+    CCTRACE(CC_API_DEBUG, "FileObject=%p MdlChain=%p\n", FileObject, MdlChain);
+
+    /* Nothing was written, just release the pages */
+    CcMdlReadComplete2(FileObject, MdlChain);
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -187,5 +327,8 @@ CcPrepareMdlWrite (
     CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d Length=%lu\n",
         FileObject, FileOffset->QuadPart, Length);
 
-    UNIMPLEMENTED;
+    ASSERT(FileOffset->QuadPart + Length <=
+           ((PROS_SHARED_CACHE_MAP)FileObject->SectionObjectPointer->SharedCacheMap)->SectionSize.QuadPart);
+
+    CcpBuildMdlChain(FileObject, FileOffset, Length, IoWriteAccess, MdlChain, IoStatus);
 }
@@ -0,0 +1,1258 @@
+/*
+ * PROJECT:         ReactOS Kernel
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * FILE:            ntoskrnl/cc/prefetch.c
+ * PURPOSE:         Logical boot and application launch prefetcher
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <ntoskrnl.h>
+#define NDEBUG
+#include <debug.h>
+
+/* GLOBALS ******************************************************************/
+
+/*
+ * The prefetcher records the page faults taken on file backed sections
+ * during the boot and during the first seconds of each process launch.
+ * When the trace ends, the faulted pages are sorted, merged into ranges and
+ * saved as a scenario file in %SystemRoot%\Prefetch. The next time the same
+ * scenario starts, these ranges are read in large chunks before the faults
+ * happen.
+ */
+
+#define PFSN_TRACE_MAGIC 'nsfP'
+
+#define PFSN_NUM_PERIODS RTL_NUMBER_OF_FIELD(PFSN_TRACE_HEADER, FaultsPerPeriod)
+
+/* Application launch: 10 periods of 1s */
+#define PFSN_APP_PERIOD (-1000LL * 1000 * 10)
+#define PFSN_APP_MAX_FAULTS 32768
+#define PFSN_APP_MAX_SECTIONS 1024
+
+/* Boot: up to 10 periods of 6s, the trace ends once the system calmed down */
+#define PFSN_BOOT_PERIOD (-6000LL * 1000 * 10)
+#define PFSN_BOOT_MAX_FAULTS 131072
+#define PFSN_BOOT_MAX_SECTIONS 4096
+#define PFSN_BOOT_MIN_PERIODS 4
+#define PFSN_BOOT_IDLE_FAULTS 64
+
+#define PFSN_ENTRIES_PER_BUFFER 4096
+
+/* Pages between two faults which are read anyway to merge their ranges */
+#define PFSN_MAX_RANGE_GAP 4
+/* Don't bother saving tiny traces */
+#define PFSN_MIN_FAULTS 16
+#define PFSN_MAX_SCENARIO_SIZE (4 * 1024 * 1024)
+
+#define PFSN_BOOT_SCENARIO_NAME L"NTOSBOOT"
+#define PFSN_BOOT_SCENARIO_HASH 0xB00DFAAD
+
+static UNICODE_STRING CcPfPrefetchDirectory = RTL_CONSTANT_STRING(L"\\SystemRoot\\Prefetch");
+
+SYSTEM_PREFETCHER_STATISTICS CcPfStatistics;
+
+typedef struct _PFSN_SORT_ENTRY
+{
+    ULONG Section;
+    ULONG Page;
+} PFSN_SORT_ENTRY, *PPFSN_SORT_ENTRY;
+
+typedef struct _PFSN_BOOT_PREFETCH_CONTEXT
+{
+    WORK_QUEUE_ITEM WorkItem;
+    PPFSN_TRACE_HEADER Trace;
+} PFSN_BOOT_PREFETCH_CONTEXT, *PPFSN_BOOT_PREFETCH_CONTEXT;
+
+/* FUNCTIONS *****************************************************************/
+
+static
+VOID
+CcPfRequestEndTrace(
+    IN PPFSN_TRACE_HEADER Trace)
+{
+    /* Only the first caller queues the work item */
+    if (InterlockedExchange(&Trace->EndTraceCalled, 1) == 0)
+    {
+        ExQueueWorkItem(&Trace->EndTraceWorkItem, DelayedWorkQueue);
+    }
+}
+
+static
+VOID
+NTAPI
+CcPfTraceTimerRoutine(
+    IN PKDPC Dpc,
+    IN PVOID DeferredContext,
+    IN PVOID SystemArgument1,
+    IN PVOID SystemArgument2)
+{
+    PPFSN_TRACE_HEADER Trace = DeferredContext;
+    LONG NumFaults, PeriodFaults;
+    BOOLEAN EndTrace;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    KeAcquireSpinLockAtDpcLevel(&Trace->TraceTimerSpinLock);
+
+    if (Trace->EndTraceCalled)
+    {
+        KeReleaseSpinLockFromDpcLevel(&Trace->TraceTimerSpinLock);
+        return;
+    }
+
+    /* Account the faults of the elapsed period */
+    NumFaults = Trace->NumFaults;
+    PeriodFaults = NumFaults - Trace->LastNumFaults;
+    Trace->FaultsPerPeriod[Trace->CurPeriod] = PeriodFaults;
+    Trace->LastNumFaults = NumFaults;
+    Trace->CurPeriod++;
+
+    EndTrace = (Trace->CurPeriod >= PFSN_NUM_PERIODS || NumFaults >= Trace->MaxFaults);
+
+    /* The boot is over once the faults dropped off */
+    if (Trace->ScenarioType == PfSystemBootScenarioType &&
+        Trace->CurPeriod >= PFSN_BOOT_MIN_PERIODS &&
+        PeriodFaults < PFSN_BOOT_IDLE_FAULTS)
+    {
+        EndTrace = TRUE;
+    }
+
+    if (!EndTrace)
+    {
+        KeSetTimer(&Trace->TraceTimer, Trace->TraceTimerPeriod, &Trace->TraceTimerDpc);
+    }
+
+    KeReleaseSpinLockFromDpcLevel(&Trace->TraceTimerSpinLock);
+
+    if (EndTrace)
+    {
+        CcPfRequestEndTrace(Trace);
+    }
+}
+
+static
+PPFSN_LOG_ENTRIES
+CcPfAllocateTraceBuffer(VOID)
+{
+    PPFSN_LOG_ENTRIES TraceBuffer;
+
+    TraceBuffer = ExAllocatePoolWithTag(NonPagedPool,
+                                        FIELD_OFFSET(PFSN_LOG_ENTRIES, Entries[PFSN_ENTRIES_PER_BUFFER]),
+                                        TAG_PF_TRACE);
+    if (TraceBuffer == NULL)
+    {
+        return NULL;
+    }
+
+    TraceBuffer->NumEntries = 0;
+    TraceBuffer->MaxEntries = PFSN_ENTRIES_PER_BUFFER;
+    return TraceBuffer;
+}
+
+static
+VOID
+CcPfFreeTrace(
+    IN PPFSN_TRACE_HEADER Trace)
+{
+    ULONG i;
+    PLIST_ENTRY ListEntry;
+
+    /* Release the files we logged faults for */
+    if (Trace->SectionInfo != NULL)
+    {
+        for (i = 0; i < Trace->SectionInfoMax; i++)
+        {
+            if (Trace->SectionInfo[i].FileObject != NULL)
+            {
+                ObDereferenceObject(Trace->SectionInfo[i].FileObject);
+            }
+        }
+        ExFreePoolWithTag(Trace->SectionInfo, TAG_PF_TRACE);
+    }
+
+    /* Release the sections we prefetched */
+    if (Trace->PrefetchSections != NULL)
+    {
+        for (i = 0; i < Trace->NumPrefetchSections; i++)
+        {
+            ObDereferenceObject(Trace->PrefetchSections[i]);
+        }
+        ExFreePoolWithTag(Trace->PrefetchSections, TAG_PF_TRACE);
+    }
+
+    while (!IsListEmpty(&Trace->TraceBuffersList))
+    {
+        ListEntry = RemoveHeadList(&Trace->TraceBuffersList);
+        ExFreePoolWithTag(CONTAINING_RECORD(ListEntry, PFSN_LOG_ENTRIES, TraceBuffersLink), TAG_PF_TRACE);
+    }
+
+    if (Trace->Process != NULL)
+    {
+        ObDereferenceObject(Trace->Process);
+    }
+
+    ExFreePoolWithTag(Trace, TAG_PF_TRACE);
+}
+
+static
+int
+__cdecl
+CcPfCompareSortEntries(
+    const void *First,
+    const void *Second)
+{
+    const PFSN_SORT_ENTRY *Entry1 = First, *Entry2 = Second;
+
+    if (Entry1->Section != Entry2->Section)
+        return (Entry1->Section < Entry2->Section) ? -1 : 1;
+    if (Entry1->Page != Entry2->Page)
+        return (Entry1->Page < Entry2->Page) ? -1 : 1;
+    return 0;
+}
+
+static
+NTSTATUS
+CcPfBuildScenarioFileName(
+    IN PPF_SCENARIO_ID ScenarioId,
+    OUT PWCHAR Buffer,
+    IN SIZE_T BufferSize,
+    OUT PUNICODE_STRING FileName)
+{
+    NTSTATUS Status;
+
+    Status = RtlStringCbPrintfW(Buffer, BufferSize, L"%wZ\\%s-%08lX.pf",
+                                &CcPfPrefetchDirectory,
+                                ScenarioId->ScenName,
+                                ScenarioId->HashId);
+    if (NT_SUCCESS(Status))
+    {
+        RtlInitUnicodeString(FileName, Buffer);
+    }
+
+    return Status;
+}
+
+static
+NTSTATUS
+CcPfWriteScenario(
+    IN PPF_SCENARIO_ID ScenarioId,
+    IN PPF_SCENARIO_HEADER Scenario)
+{
+    NTSTATUS Status;
+    HANDLE Handle;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    UNICODE_STRING FileName;
+    WCHAR FileNameBuffer[PF_MAX_SCENARIO_PATH];
+
+    PAGED_CODE();
+
+    /* Create the prefetch directory if needed */
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &CcPfPrefetchDirectory,
+                               OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+                               NULL,
+                               NULL);
+    Status = ZwCreateFile(&Handle,
+                          FILE_LIST_DIRECTORY | SYNCHRONIZE,
+                          &ObjectAttributes,
+                          &IoStatusBlock,
+                          NULL,
+                          FILE_ATTRIBUTE_DIRECTORY,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE,
+                          FILE_OPEN_IF,
+                          FILE_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT,
+                          NULL,
+                          0);
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+    ZwClose(Handle);
+
+    Status = CcPfBuildScenarioFileName(ScenarioId, FileNameBuffer, sizeof(FileNameBuffer), &FileName);
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &FileName,
+                               OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+                               NULL,
+                               NULL);
+    Status = ZwCreateFile(&Handle,
+                          FILE_WRITE_DATA | SYNCHRONIZE,
+                          &ObjectAttributes,
+                          &IoStatusBlock,
+                          NULL,
+                          FILE_ATTRIBUTE_NORMAL,
+                          0,
+                          FILE_OVERWRITE_IF,
+                          FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT,
+                          NULL,
+                          0);
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    Status = ZwWriteFile(Handle, NULL, NULL, NULL, &IoStatusBlock,
+                         Scenario, Scenario->Size, NULL, NULL);
+    ZwClose(Handle);
+
+    return Status;
+}
+
+static
+NTSTATUS
+CcPfSaveTrace(
+    IN PPFSN_TRACE_HEADER Trace)
+{
+    NTSTATUS Status;
+    PLIST_ENTRY ListEntry;
+    PPFSN_LOG_ENTRIES TraceBuffer;
+    PPFSN_SORT_ENTRY SortEntries;
+    ULONG NumEntries, NumRanges, NumSections, NameInfoSize, Size, i, j;
+    PULONG SectionMap;
+    POBJECT_NAME_INFORMATION *SectionNames;
+    PPF_SCENARIO_HEADER Scenario = NULL;
+    PPF_SCENARIO_SECTION ScenarioSection;
+    PPF_SCENARIO_RANGE ScenarioRange;
+    PUCHAR NameInfo;
+
+    PAGED_CODE();
+
+    if (Trace->NumFaults < PFSN_MIN_FAULTS)
+    {
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    /* Gather all the entries, so that we can sort them per section and page */
+    SortEntries = ExAllocatePoolWithTag(PagedPool, Trace->NumFaults * sizeof(PFSN_SORT_ENTRY), TAG_PF_TRACE);
+    if (SortEntries == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    NumEntries = 0;
+    for (ListEntry = Trace->TraceBuffersList.Flink;
+         ListEntry != &Trace->TraceBuffersList;
+         ListEntry = ListEntry->Flink)
+    {
+        TraceBuffer = CONTAINING_RECORD(ListEntry, PFSN_LOG_ENTRIES, TraceBuffersLink);
+        for (i = 0; i < (ULONG)TraceBuffer->NumEntries && NumEntries < (ULONG)Trace->NumFaults; i++)
+        {
+            SortEntries[NumEntries].Section = TraceBuffer->Entries[i].FileKey;
+            SortEntries[NumEntries].Page = TraceBuffer->Entries[i].FileOffset;
+            NumEntries++;
+        }
+    }
+
+    qsort(SortEntries, NumEntries, sizeof(PFSN_SORT_ENTRY), CcPfCompareSortEntries);
+
+    /* Query the section names and map the hash table slots to the scenario sections */
+    SectionMap = ExAllocatePoolZero(PagedPool,
+                                    Trace->SectionInfoMax * (sizeof(ULONG) + sizeof(POBJECT_NAME_INFORMATION)),
+                                    TAG_PF_TRACE);
+    if (SectionMap == NULL)
+    {
+        ExFreePoolWithTag(SortEntries, TAG_PF_TRACE);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    SectionNames = (POBJECT_NAME_INFORMATION *)(SectionMap + Trace->SectionInfoMax);
+
+    NumSections = 0;
+    NameInfoSize = 0;
+    for (i = 0; i < Trace->SectionInfoMax; i++)
+    {
+        PFILE_OBJECT FileObject = Trace->SectionInfo[i].FileObject;
+        ULONG ReturnLength;
+
+        SectionMap[i] = MAXULONG;
+        if (FileObject == NULL)
+        {
+            continue;
+        }
+
+        Status = ObQueryNameString(FileObject, NULL, 0, &ReturnLength);
+        if (Status != STATUS_INFO_LENGTH_MISMATCH)
+        {
+            continue;
+        }
+
+        SectionNames[i] = ExAllocatePoolWithTag(PagedPool, ReturnLength, TAG_PF_TRACE);
+        if (SectionNames[i] == NULL)
+        {
+            continue;
+        }
+
+        Status = ObQueryNameString(FileObject, SectionNames[i], ReturnLength, &ReturnLength);
+        if (!NT_SUCCESS(Status) || SectionNames[i]->Name.Length == 0)
+        {
+            ExFreePoolWithTag(SectionNames[i], TAG_PF_TRACE);
+            SectionNames[i] = NULL;
+            continue;
+        }
+
+        SectionMap[i] = NumSections++;
+        NameInfoSize += SectionNames[i]->Name.Length;
+    }
+
+    if (NumSections == 0)
+    {
+        Status = STATUS_UNSUCCESSFUL;
+        goto Cleanup;
+    }
+
+    /* Merge the pages into ranges, reading small holes along */
+    NumRanges = 0;
+    for (i = 0; i < NumEntries; i++)
+    {
+        if (SectionMap[SortEntries[i].Section] == MAXULONG)
+            continue;
+
+        if (i != 0 &&
+            SortEntries[i].Section == SortEntries[i - 1].Section &&
+            SortEntries[i].Page <= SortEntries[i - 1].Page + PFSN_MAX_RANGE_GAP)
+        {
+            continue;
+        }
+        NumRanges++;
+    }
+
+    /* Build the scenario */
+    Size = sizeof(PF_SCENARIO_HEADER) +
+           NumSections * sizeof(PF_SCENARIO_SECTION) +
+           NumRanges * sizeof(PF_SCENARIO_RANGE) +
+           NameInfoSize;
+    Scenario = ExAllocatePoolZero(PagedPool, Size, TAG_PF_SCENARIO);
+    if (Scenario == NULL)
+    {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Cleanup;
+    }
+
+    Scenario->Version = PF_SCENARIO_VERSION;
+    Scenario->MagicNumber = PF_SCENARIO_MAGIC;
+    Scenario->Size = Size;
+    Scenario->ScenarioId = Trace->ScenarioId;
+    Scenario->ScenarioType = Trace->ScenarioType;
+    Scenario->SectionInfoOffset = sizeof(PF_SCENARIO_HEADER);
+    Scenario->NumSections = NumSections;
+    Scenario->RangeInfoOffset = Scenario->SectionInfoOffset + NumSections * sizeof(PF_SCENARIO_SECTION);
+    Scenario->FileNameInfoOffset = Scenario->RangeInfoOffset + NumRanges * sizeof(PF_SCENARIO_RANGE);
+    Scenario->FileNameInfoSize = NameInfoSize;
+
+    ScenarioSection = (PPF_SCENARIO_SECTION)((ULONG_PTR)Scenario + Scenario->SectionInfoOffset);
+    ScenarioRange = (PPF_SCENARIO_RANGE)((ULONG_PTR)Scenario + Scenario->RangeInfoOffset);
+    NameInfo = (PUCHAR)Scenario + Scenario->FileNameInfoOffset;
+
+    NameInfoSize = 0;
+    for (i = 0; i < Trace->SectionInfoMax; i++)
+    {
+        if (SectionMap[i] == MAXULONG)
+            continue;
+
+        j = SectionMap[i];
+        ScenarioSection[j].FileNameOffset = NameInfoSize;
+        ScenarioSection[j].FileNameLength = SectionNames[i]->Name.Length;
+        ScenarioSection[j].Flags = (USHORT)Trace->SectionInfo[i].Flags;
+        RtlCopyMemory(NameInfo + NameInfoSize, SectionNames[i]->Name.Buffer, SectionNames[i]->Name.Length);
+        NameInfoSize += SectionNames[i]->Name.Length;
+    }
+
+    /* Entries are sorted by hash table slot, so ranges of a section are contiguous */
+    NumRanges = 0;
+    for (i = 0; i < NumEntries; i++)
+    {
+        ULONG Section = SectionMap[SortEntries[i].Section];
+
+        if (Section == MAXULONG)
+            continue;
+
+        if (i != 0 &&
+            SortEntries[i].Section == SortEntries[i - 1].Section &&
+            SortEntries[i].Page <= SortEntries[i - 1].Page + PFSN_MAX_RANGE_GAP)
+        {
+            /* Duplicates and pages close enough extend the current range */
+            PPF_SCENARIO_RANGE Range = &ScenarioRange[NumRanges - 1];
+
+            Range->PageCount = SortEntries[i].Page - Range->StartPage + 1;
+            continue;
+        }
+
+        if (ScenarioSection[Section].NumRanges == 0)
+            ScenarioSection[Section].FirstRange = NumRanges;
+        ScenarioSection[Section].NumRanges++;
+
+        ScenarioRange[NumRanges].StartPage = SortEntries[i].Page;
+        ScenarioRange[NumRanges].PageCount = 1;
+        NumRanges++;
+    }
+    Scenario->NumRanges = NumRanges;
+
+    Status = CcPfWriteScenario(&Trace->ScenarioId, Scenario);
+
+    DbgPrintEx(DPFLTR_PREFETCHER_ID,
+               DPFLTR_TRACE_LEVEL,
+               "CCPF: Saved %S-%08lX: %lu sections, %lu ranges, %lu faults (0x%08lx)\n",
+               Trace->ScenarioId.ScenName, Trace->ScenarioId.HashId,
+               NumSections, NumRanges, NumEntries, Status);
+
+Cleanup:
+    if (Scenario != NULL)
+    {
+        ExFreePoolWithTag(Scenario, TAG_PF_SCENARIO);
+    }
+
+    for (i = 0; i < Trace->SectionInfoMax; i++)
+    {
+        if (SectionNames[i] != NULL)
+            ExFreePoolWithTag(SectionNames[i], TAG_PF_TRACE);
+    }
+    ExFreePoolWithTag(SectionMap, TAG_PF_TRACE);
+    ExFreePoolWithTag(SortEntries, TAG_PF_TRACE);
+
+    return Status;
+}
+
+static
+VOID
+NTAPI
+CcPfEndTraceWorker(
+    IN PVOID Context)
+{
+    PPFSN_TRACE_HEADER Trace = Context;
+    KIRQL OldIrql;
+    LONG HardFaults, Hits;
+
+    PAGED_CODE();
+
+    /* Stop the timer and make sure its DPC is gone */
+    KeAcquireSpinLock(&Trace->TraceTimerSpinLock, &OldIrql);
+    KeCancelTimer(&Trace->TraceTimer);
+    KeReleaseSpinLock(&Trace->TraceTimerSpinLock, OldIrql);
+    KeFlushQueuedDpcs();
+
+    /* Stop logging to this trace */
+    KeAcquireSpinLock(&CcPfGlobals.ActiveTracesLock, &OldIrql);
+    RemoveEntryList(&Trace->ActiveTracesLink);
+    if (CcPfGlobals.SystemWideTrace == Trace)
+    {
+        CcPfGlobals.SystemWideTrace = NULL;
+    }
+    KeReleaseSpinLock(&CcPfGlobals.ActiveTracesLock, OldIrql);
+
+    ExWaitForRundownProtectionRelease(&Trace->RefCount);
+
+    InterlockedDecrement((PLONG)&CcPfStatistics.ActiveTraces);
+    InterlockedIncrement((PLONG)&CcPfStatistics.TracesCompleted);
+
+    /* A hard fault is always followed by a soft one when the faulting access is restarted */
+    HardFaults = Trace->HardFaults;
+    Hits = max(Trace->SoftFaults - HardFaults, 0);
+    if (Trace->Prefetched)
+    {
+        InterlockedExchangeAdd((PLONG)&CcPfStatistics.PrefetchedHits, Hits);
+        InterlockedExchangeAdd((PLONG)&CcPfStatistics.PrefetchedMisses, HardFaults);
+    }
+    else
+    {
+        InterlockedExchangeAdd((PLONG)&CcPfStatistics.ColdHits, Hits);
+        InterlockedExchangeAdd((PLONG)&CcPfStatistics.ColdMisses, HardFaults);
+    }
+
+    if (NT_SUCCESS(CcPfSaveTrace(Trace)))
+    {
+        InterlockedIncrement((PLONG)&CcPfStatistics.TracesSaved);
+    }
+
+    CcPfFreeTrace(Trace);
+}
+
+static
+PPFSN_TRACE_HEADER
+CcPfCreateTrace(
+    IN PPF_SCENARIO_ID ScenarioId,
+    IN PF_SCENARIO_TYPE ScenarioType,
+    IN PEPROCESS Process OPTIONAL)
+{
+    PPFSN_TRACE_HEADER Trace;
+
+    Trace = ExAllocatePoolZero(NonPagedPool, sizeof(PFSN_TRACE_HEADER), TAG_PF_TRACE);
+    if (Trace == NULL)
+    {
+        return NULL;
+    }
+
+    Trace->Magic = PFSN_TRACE_MAGIC;
+    Trace->ScenarioId = *ScenarioId;
+    Trace->ScenarioType = ScenarioType;
+    InitializeListHead(&Trace->TraceBuffersList);
+    KeInitializeSpinLock(&Trace->TraceBufferSpinLock);
+    KeInitializeSpinLock(&Trace->TraceTimerSpinLock);
+    KeInitializeTimer(&Trace->TraceTimer);
+    KeInitializeDpc(&Trace->TraceTimerDpc, CcPfTraceTimerRoutine, Trace);
+    ExInitializeRundownProtection(&Trace->RefCount);
+    ExInitializeWorkItem(&Trace->EndTraceWorkItem, CcPfEndTraceWorker, Trace);
+    KeQuerySystemTime(&Trace->LaunchTime);
+
+    if (ScenarioType == PfSystemBootScenarioType)
+    {
+        Trace->TraceTimerPeriod.QuadPart = PFSN_BOOT_PERIOD;
+        Trace->MaxFaults = PFSN_BOOT_MAX_FAULTS;
+        Trace->SectionInfoMax = PFSN_BOOT_MAX_SECTIONS;
+    }
+    else
+    {
+        Trace->TraceTimerPeriod.QuadPart = PFSN_APP_PERIOD;
+        Trace->MaxFaults = PFSN_APP_MAX_FAULTS;
+        Trace->SectionInfoMax = PFSN_APP_MAX_SECTIONS;
+    }
+
+    Trace->SectionInfo = ExAllocatePoolZero(NonPagedPool,
+                                            Trace->SectionInfoMax * sizeof(PFSN_SECTION_INFO),
+                                            TAG_PF_TRACE);
+    Trace->CurrentTraceBuffer = CcPfAllocateTraceBuffer();
+    if (Trace->SectionInfo == NULL || Trace->CurrentTraceBuffer == NULL)
+    {
+        if (Trace->CurrentTraceBuffer != NULL)
+            ExFreePoolWithTag(Trace->CurrentTraceBuffer, TAG_PF_TRACE);
+        if (Trace->SectionInfo != NULL)
+            ExFreePoolWithTag(Trace->SectionInfo, TAG_PF_TRACE);
+        ExFreePoolWithTag(Trace, TAG_PF_TRACE);
+        return NULL;
+    }
+    InsertTailList(&Trace->TraceBuffersList, &Trace->CurrentTraceBuffer->TraceBuffersLink);
+    Trace->NumTraceBuffers = 1;
+
+    if (Process != NULL)
+    {
+        ObReferenceObject(Process);
+        Trace->Process = Process;
+    }
+
+    return Trace;
+}
+
+static
+VOID
+CcPfStartTrace(
+    IN PPFSN_TRACE_HEADER Trace)
+{
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&CcPfGlobals.ActiveTracesLock, &OldIrql);
+    InsertTailList(&CcPfGlobals.ActiveTraces, &Trace->ActiveTracesLink);
+    if (Trace->ScenarioType == PfSystemBootScenarioType)
+    {
+        CcPfGlobals.SystemWideTrace = Trace;
+    }
+    KeReleaseSpinLock(&CcPfGlobals.ActiveTracesLock, OldIrql);
+
+    InterlockedIncrement((PLONG)&CcPfStatistics.ActiveTraces);
+
+    KeSetTimer(&Trace->TraceTimer, Trace->TraceTimerPeriod, &Trace->TraceTimerDpc);
+}
+
+static
+PPF_SCENARIO_HEADER
+CcPfLoadScenario(
+    IN PPF_SCENARIO_ID ScenarioId,
+    IN PF_SCENARIO_TYPE ScenarioType)
+{
+    NTSTATUS Status;
+    HANDLE Handle;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    FILE_STANDARD_INFORMATION FileInfo;
+    UNICODE_STRING FileName;
+    WCHAR FileNameBuffer[PF_MAX_SCENARIO_PATH];
+    PPF_SCENARIO_HEADER Scenario;
+    PPF_SCENARIO_SECTION ScenarioSection;
+    ULONG i;
+
+    PAGED_CODE();
+
+    Status = CcPfBuildScenarioFileName(ScenarioId, FileNameBuffer, sizeof(FileNameBuffer), &FileName);
+    if (!NT_SUCCESS(Status))
+    {
+        return NULL;
+    }
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &FileName,
+                               OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+                               NULL,
+                               NULL);
+    Status = ZwOpenFile(&Handle,
+                        FILE_READ_DATA | SYNCHRONIZE,
+                        &ObjectAttributes,
+                        &IoStatusBlock,
+                        FILE_SHARE_READ,
+                        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT);
+    if (!NT_SUCCESS(Status))
+    {
+        return NULL;
+    }
+
+    Status = ZwQueryInformationFile(Handle, &IoStatusBlock, &FileInfo, sizeof(FileInfo), FileStandardInformation);
+    if (!NT_SUCCESS(Status) ||
+        FileInfo.EndOfFile.QuadPart < sizeof(PF_SCENARIO_HEADER) ||
+        FileInfo.EndOfFile.QuadPart > PFSN_MAX_SCENARIO_SIZE)
+    {
+        ZwClose(Handle);
+        return NULL;
+    }
+
+    Scenario = ExAllocatePoolWithTag(PagedPool, FileInfo.EndOfFile.LowPart, TAG_PF_SCENARIO);
+    if (Scenario == NULL)
+    {
+        ZwClose(Handle);
+        return NULL;
+    }
+
+    Status = ZwReadFile(Handle, NULL, NULL, NULL, &IoStatusBlock,
+                        Scenario, FileInfo.EndOfFile.LowPart, NULL, NULL);
+    ZwClose(Handle);
+    if (!NT_SUCCESS(Status) || IoStatusBlock.Information != FileInfo.EndOfFile.LowPart)
+    {
+        goto Invalid;
+    }
+
+    /* Don't trust anything from the disk */
+    if (Scenario->Version != PF_SCENARIO_VERSION ||
+        Scenario->MagicNumber != PF_SCENARIO_MAGIC ||
+        Scenario->Size != FileInfo.EndOfFile.LowPart ||
+        Scenario->ScenarioType != ScenarioType ||
+        Scenario->ScenarioId.HashId != ScenarioId->HashId ||
+        Scenario->SectionInfoOffset < sizeof(PF_SCENARIO_HEADER) ||
+        Scenario->SectionInfoOffset + (ULONGLONG)Scenario->NumSections * sizeof(PF_SCENARIO_SECTION) > Scenario->Size ||
+        Scenario->RangeInfoOffset + (ULONGLONG)Scenario->NumRanges * sizeof(PF_SCENARIO_RANGE) > Scenario->Size ||
+        (ULONGLONG)Scenario->FileNameInfoOffset + Scenario->FileNameInfoSize > Scenario->Size ||
+        (Scenario->SectionInfoOffset % sizeof(ULONG)) != 0 ||
+        (Scenario->RangeInfoOffset % sizeof(ULONG)) != 0 ||
+        (Scenario->FileNameInfoOffset % sizeof(WCHAR)) != 0)
+    {
+        goto Invalid;
+    }
+
+    ScenarioSection = (PPF_SCENARIO_SECTION)((ULONG_PTR)Scenario + Scenario->SectionInfoOffset);
+    for (i = 0; i < Scenario->NumSections; i++)
+    {
+        if ((ULONGLONG)ScenarioSection[i].FirstRange + ScenarioSection[i].NumRanges > Scenario->NumRanges ||
+            (ULONGLONG)ScenarioSection[i].FileNameOffset + ScenarioSection[i].FileNameLength > Scenario->FileNameInfoSize ||
+            (ScenarioSection[i].FileNameOffset % sizeof(WCHAR)) != 0 ||
+            (ScenarioSection[i].FileNameLength % sizeof(WCHAR)) != 0 ||
+            ScenarioSection[i].FileNameLength == 0)
+        {
+            goto Invalid;
+        }
+    }
+
+    return Scenario;
+
+Invalid:
+    DPRINT1("Discarding invalid scenario %S-%08lX\n", ScenarioId->ScenName, ScenarioId->HashId);
+    ExFreePoolWithTag(Scenario, TAG_PF_SCENARIO);
+    return NULL;
+}
+
+static
+PVOID
+CcPfOpenSection(
+    IN PUNICODE_STRING FileName,
+    IN BOOLEAN Image)
+{
+    NTSTATUS Status;
+    HANDLE FileHandle, SectionHandle;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    PVOID Section;
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               FileName,
+                               OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+                               NULL,
+                               NULL);
+    Status = ZwOpenFile(&FileHandle,
+                        FILE_READ_DATA | FILE_EXECUTE | SYNCHRONIZE,
+                        &ObjectAttributes,
+                        &IoStatusBlock,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT);
+    if (!NT_SUCCESS(Status))
+    {
+        return NULL;
+    }
+
+    Status = ZwCreateSection(&SectionHandle,
+                             SECTION_MAP_READ | SECTION_QUERY,
+                             NULL,
+                             NULL,
+                             Image ? PAGE_EXECUTE : PAGE_READONLY,
+                             Image ? SEC_IMAGE : SEC_COMMIT,
+                             FileHandle);
+    ZwClose(FileHandle);
+    if (!NT_SUCCESS(Status))
+    {
+        return NULL;
+    }
+
+    Status = ObReferenceObjectByHandle(SectionHandle,
+                                       SECTION_MAP_READ,
+                                       MmSectionObjectType,
+                                       KernelMode,
+                                       &Section,
+                                       NULL);
+    ZwClose(SectionHandle);
+
+    return NT_SUCCESS(Status) ? Section : NULL;
+}
+
+static
+VOID
+CcPfPrefetchScenario(
+    IN PPFSN_TRACE_HEADER Trace,
+    IN PPF_SCENARIO_HEADER Scenario)
+{
+    PPF_SCENARIO_SECTION ScenarioSection;
+    PPF_SCENARIO_RANGE ScenarioRange;
+    UNICODE_STRING FileName;
+    PVOID Section;
+    ULONG i, j, PagesPrefetched = 0;
+
+    PAGED_CODE();
+
+    if (Scenario->NumSections == 0)
+    {
+        return;
+    }
+
+    Trace->PrefetchSections = ExAllocatePoolWithTag(NonPagedPool,
+                                                    Scenario->NumSections * sizeof(PVOID),
+                                                    TAG_PF_TRACE);
+    if (Trace->PrefetchSections == NULL)
+    {
+        return;
+    }
+
+    InterlockedIncrement(&CcPfGlobals.ActivePrefetches);
+
+    ScenarioSection = (PPF_SCENARIO_SECTION)((ULONG_PTR)Scenario + Scenario->SectionInfoOffset);
+    ScenarioRange = (PPF_SCENARIO_RANGE)((ULONG_PTR)Scenario + Scenario->RangeInfoOffset);
+
+    for (i = 0; i < Scenario->NumSections; i++)
+    {
+        FileName.Buffer = (PWCHAR)((ULONG_PTR)Scenario + Scenario->FileNameInfoOffset + ScenarioSection[i].FileNameOffset);
+        FileName.Length = FileName.MaximumLength = ScenarioSection[i].FileNameLength;
+
+        Section = CcPfOpenSection(&FileName, BooleanFlagOn(ScenarioSection[i].Flags, PF_FAULT_IMAGE));
+        if (Section == NULL)
+        {
+            continue;
+        }
+
+        /* Ranges are sorted, so this turns into large sequential reads */
+        for (j = ScenarioSection[i].FirstRange;
+             j < ScenarioSection[i].FirstRange + ScenarioSection[i].NumRanges;
+             j++)
+        {
+            if (ScenarioRange[j].PageCount == 0 || ScenarioRange[j].PageCount > MAXULONG >> PAGE_SHIFT)
+                continue;
+
+            if (NT_SUCCESS(MmPrefetchSectionRange(Section,
+                                                  (LONGLONG)ScenarioRange[j].StartPage << PAGE_SHIFT,
+                                                  ScenarioRange[j].PageCount << PAGE_SHIFT)))
+            {
+                PagesPrefetched += ScenarioRange[j].PageCount;
+            }
+        }
+
+        /* Keep the section around, or its pages go away with it */
+        Trace->PrefetchSections[Trace->NumPrefetchSections++] = Section;
+    }
+
+    InterlockedDecrement(&CcPfGlobals.ActivePrefetches);
+
+    Trace->Prefetched = TRUE;
+    InterlockedIncrement((PLONG)&CcPfStatistics.ScenariosPrefetched);
+    InterlockedExchangeAdd((PLONG)&CcPfStatistics.PagesPrefetched, PagesPrefetched);
+
+    DbgPrintEx(DPFLTR_PREFETCHER_ID,
+               DPFLTR_TRACE_LEVEL,
+               "CCPF: Prefetched %S-%08lX: %lu sections, %lu pages\n",
+               Scenario->ScenarioId.ScenName, Scenario->ScenarioId.HashId,
+               Trace->NumPrefetchSections, PagesPrefetched);
+}
+
+static
+VOID
+NTAPI
+CcPfBootPrefetchWorker(
+    IN PVOID Context)
+{
+    PPFSN_BOOT_PREFETCH_CONTEXT BootContext = Context;
+    PPFSN_TRACE_HEADER Trace = BootContext->Trace;
+    PPF_SCENARIO_HEADER Scenario;
+
+    PAGED_CODE();
+
+    Scenario = CcPfLoadScenario(&Trace->ScenarioId, PfSystemBootScenarioType);
+    if (Scenario != NULL)
+    {
+        CcPfPrefetchScenario(Trace, Scenario);
+        ExFreePoolWithTag(Scenario, TAG_PF_SCENARIO);
+    }
+
+    ExReleaseRundownProtection(&Trace->RefCount);
+    ExFreePoolWithTag(BootContext, TAG_PF_TRACE);
+}
+
+NTSTATUS
+NTAPI
+CcPfBeginBootPhase(
+    IN PF_BOOT_PHASE_ID Phase)
+{
+    PF_SCENARIO_ID ScenarioId;
+    PPFSN_TRACE_HEADER Trace;
+    PPFSN_BOOT_PREFETCH_CONTEXT BootContext;
+
+    PAGED_CODE();
+
+    /* We only trace from the session manager start onwards, once the file systems are available */
+    if (Phase != PfSessionManagerInitPhase)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    if (!BooleanFlagOn(CcPfEnablePrefetcherFlags, PF_ENABLE_BOOT))
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    RtlZeroMemory(&ScenarioId, sizeof(ScenarioId));
+    RtlCopyMemory(ScenarioId.ScenName, PFSN_BOOT_SCENARIO_NAME, sizeof(PFSN_BOOT_SCENARIO_NAME));
+    ScenarioId.HashId = PFSN_BOOT_SCENARIO_HASH;
+
+    Trace = CcPfCreateTrace(&ScenarioId, PfSystemBootScenarioType, NULL);
+    if (Trace == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    CcPfStartTrace(Trace);
+
+    /* Don't hold the boot: prefetch while it keeps going */
+    BootContext = ExAllocatePoolWithTag(NonPagedPool, sizeof(*BootContext), TAG_PF_TRACE);
+    if (BootContext != NULL)
+    {
+        if (ExAcquireRundownProtection(&Trace->RefCount))
+        {
+            BootContext->Trace = Trace;
+            ExInitializeWorkItem(&BootContext->WorkItem, CcPfBootPrefetchWorker, BootContext);
+            ExQueueWorkItem(&BootContext->WorkItem, DelayedWorkQueue);
+        }
+        else
+        {
+            ExFreePoolWithTag(BootContext, TAG_PF_TRACE);
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+CcPfBeginAppLaunch(
+    IN PEPROCESS Process)
+{
+    PF_SCENARIO_ID ScenarioId;
+    PPFSN_TRACE_HEADER Trace;
+    PPF_SCENARIO_HEADER Scenario;
+    POBJECT_NAME_INFORMATION ImageName;
+    UNICODE_STRING BaseName;
+    USHORT i;
+
+    PAGED_CODE();
+
+    if (!BooleanFlagOn(CcPfEnablePrefetcherFlags, PF_ENABLE_APP_LAUNCH))
+    {
+        return;
+    }
+
+    ImageName = Process->SeAuditProcessCreationInfo.ImageFileName;
+    if (ImageName == NULL || ImageName->Name.Length == 0)
+    {
+        return;
+    }
+
+    /* The scenario is named after the image, and identified by the hash of its full path */
+    BaseName = ImageName->Name;
+    for (i = BaseName.Length / sizeof(WCHAR); i > 0; i--)
+    {
+        if (ImageName->Name.Buffer[i - 1] == L'\\')
+        {
+            BaseName.Buffer = &ImageName->Name.Buffer[i];
+            BaseName.Length = ImageName->Name.Length - i * sizeof(WCHAR);
+            break;
+        }
+    }
+
+    RtlZeroMemory(&ScenarioId, sizeof(ScenarioId));
+    for (i = 0; i < BaseName.Length / sizeof(WCHAR) && i < RTL_NUMBER_OF(ScenarioId.ScenName) - 1; i++)
+    {
+        ScenarioId.ScenName[i] = RtlUpcaseUnicodeChar(BaseName.Buffer[i]);
+    }
+    if (!NT_SUCCESS(RtlHashUnicodeString(&ImageName->Name, TRUE, HASH_STRING_ALGORITHM_DEFAULT, &ScenarioId.HashId)))
+    {
+        return;
+    }
+
+    Trace = CcPfCreateTrace(&ScenarioId, PfApplicationLaunchScenarioType, Process);
+    if (Trace == NULL)
+    {
+        return;
+    }
+
+    /* Start tracing first, the prefetch doesn't take faults */
+    CcPfStartTrace(Trace);
+
+    if (ExAcquireRundownProtection(&Trace->RefCount))
+    {
+        /* We run in the first thread of the process: it can't fault before we're done */
+        Scenario = CcPfLoadScenario(&ScenarioId, PfApplicationLaunchScenarioType);
+        if (Scenario != NULL)
+        {
+            CcPfPrefetchScenario(Trace, Scenario);
+            ExFreePoolWithTag(Scenario, TAG_PF_SCENARIO);
+        }
+
+        ExReleaseRundownProtection(&Trace->RefCount);
+    }
+}
+
+VOID
+NTAPI
+CcPfProcessExitNotification(
+    IN PEPROCESS Process)
+{
+    PLIST_ENTRY ListEntry;
+    PPFSN_TRACE_HEADER Trace;
+    KIRQL OldIrql;
+
+    if (IsListEmpty(&CcPfGlobals.ActiveTraces))
+    {
+        return;
+    }
+
+    /* The launch is over, save what we got */
+    KeAcquireSpinLock(&CcPfGlobals.ActiveTracesLock, &OldIrql);
+    for (ListEntry = CcPfGlobals.ActiveTraces.Flink;
+         ListEntry != &CcPfGlobals.ActiveTraces;
+         ListEntry = ListEntry->Flink)
+    {
+        Trace = CONTAINING_RECORD(ListEntry, PFSN_TRACE_HEADER, ActiveTracesLink);
+        if (Trace->Process == Process)
+        {
+            CcPfRequestEndTrace(Trace);
+            break;
+        }
+    }
+    KeReleaseSpinLock(&CcPfGlobals.ActiveTracesLock, OldIrql);
+}
+
+static
+VOID
+CcPfLogEntry(
+    IN PPFSN_TRACE_HEADER Trace,
+    IN PFILE_OBJECT FileObject,
+    IN ULONG Page,
+    IN ULONG Flags)
+{
+    KIRQL OldIrql;
+    ULONG Slot, Probe;
+    PPFSN_LOG_ENTRIES TraceBuffer;
+
+    KeAcquireSpinLock(&Trace->TraceBufferSpinLock, &OldIrql);
+
+    if (Trace->NumFaults >= Trace->MaxFaults)
+    {
+        goto Quit;
+    }
+
+    /* Find the section in the hash table, open addressing */
+    Slot = (ULONG)(((ULONG_PTR)FileObject >> 3) * 0x9E3779B1) & (Trace->SectionInfoMax - 1);
+    for (Probe = 0; Probe < Trace->SectionInfoMax; Probe++)
+    {
+        if (Trace->SectionInfo[Slot].FileObject == FileObject ||
+            Trace->SectionInfo[Slot].FileObject == NULL)
+        {
+            break;
+        }
+        Slot = (Slot + 1) & (Trace->SectionInfoMax - 1);
+    }
+
+    if (Probe == Trace->SectionInfoMax)
+    {
+        /* Full */
+        goto Quit;
+    }
+
+    if (Trace->SectionInfo[Slot].FileObject == NULL)
+    {
+        ObReferenceObject(FileObject);
+        Trace->SectionInfo[Slot].FileObject = FileObject;
+        Trace->SectionInfo[Slot].Flags = Flags & PF_FAULT_IMAGE;
+        Trace->SectionInfoCount++;
+    }
+
+    TraceBuffer = Trace->CurrentTraceBuffer;
+    if (TraceBuffer->NumEntries == TraceBuffer->MaxEntries)
+    {
+        TraceBuffer = CcPfAllocateTraceBuffer();
+        if (TraceBuffer == NULL)
+        {
+            goto Quit;
+        }
+
+        InsertTailList(&Trace->TraceBuffersList, &TraceBuffer->TraceBuffersLink);
+        Trace->CurrentTraceBuffer = TraceBuffer;
+        Trace->NumTraceBuffers++;
+    }
+
+    TraceBuffer->Entries[TraceBuffer->NumEntries].FileOffset = Page;
+    TraceBuffer->Entries[TraceBuffer->NumEntries].Type = 0;
+    TraceBuffer->Entries[TraceBuffer->NumEntries].FileKey = Slot;
+    TraceBuffer->NumEntries++;
+    Trace->NumFaults++;
+
+Quit:
+    KeReleaseSpinLock(&Trace->TraceBufferSpinLock, OldIrql);
+}
+
+VOID
+NTAPI
+CcPfLogPageFault(
+    IN PFILE_OBJECT FileObject,
+    IN LONGLONG Offset,
+    IN ULONG Flags)
+{
+    PPFSN_TRACE_HEADER Traces[2];
+    PPFSN_TRACE_HEADER Trace;
+    PEPROCESS Process = PsGetCurrentProcess();
+    PLIST_ENTRY ListEntry;
+    ULONG NumTraces = 0, i;
+    ULONGLONG Page;
+    KIRQL OldIrql;
+
+    /* Fast path: nothing is being traced */
+    if (IsListEmpty(&CcPfGlobals.ActiveTraces))
+    {
+        return;
+    }
+
+    /* The fault is logged in the trace of the process, and in the boot trace */
+    KeAcquireSpinLock(&CcPfGlobals.ActiveTracesLock, &OldIrql);
+    for (ListEntry = CcPfGlobals.ActiveTraces.Flink;
+         ListEntry != &CcPfGlobals.ActiveTraces;
+         ListEntry = ListEntry->Flink)
+    {
+        Trace = CONTAINING_RECORD(ListEntry, PFSN_TRACE_HEADER, ActiveTracesLink);
+        if (Trace == CcPfGlobals.SystemWideTrace ||
+            (Trace->Process == Process && Process != NULL))
+        {
+            if (ExAcquireRundownProtection(&Trace->RefCount))
+            {
+                Traces[NumTraces++] = Trace;
+                if (NumTraces == RTL_NUMBER_OF(Traces))
+                    break;
+            }
+        }
+    }
+    KeReleaseSpinLock(&CcPfGlobals.ActiveTracesLock, OldIrql);
+
+    Page = (ULONGLONG)Offset >> PAGE_SHIFT;
+
+    for (i = 0; i < NumTraces; i++)
+    {
+        Trace = Traces[i];
+
+        if (BooleanFlagOn(Flags, PF_FAULT_HARD))
+        {
+            /* Hard faults are restarted once the page is in, they're logged then */
+            InterlockedIncrement(&Trace->HardFaults);
+        }
+        else
+        {
+            InterlockedIncrement(&Trace->SoftFaults);
+
+            /* Log entries only hold 30 bits of page number */
+            if (Page < (1UL << 30))
+            {
+                CcPfLogEntry(Trace, FileObject, (ULONG)Page, Flags);
+            }
+        }
+
+        ExReleaseRundownProtection(&Trace->RefCount);
+    }
+}
+
+/* Called by NtQuerySystemInformation from within SEH, the envelope is already probed */
+NTSTATUS
+NTAPI
+CcPfQueryPrefetcherInformation(
+    IN OUT PVOID Buffer,
+    IN ULONG Length,
+    OUT PULONG ReturnLength)
+{
+    PREFETCHER_INFORMATION Request;
+
+    *ReturnLength = sizeof(PREFETCHER_INFORMATION);
+
+    if (Length != sizeof(PREFETCHER_INFORMATION))
+    {
+        return STATUS_INFO_LENGTH_MISMATCH;
+    }
+
+    /* Capture it, the caller can change it under us */
+    Request = *(PPREFETCHER_INFORMATION)Buffer;
+    if (Request.Version != PF_CURRENT_VERSION || Request.Magic != PF_SYSINFO_MAGIC_NUMBER)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    switch (Request.PrefetcherInformationClass)
+    {
+        case PrefetcherStatistics:
+            if (Request.PrefetcherInformationLength != sizeof(SYSTEM_PREFETCHER_STATISTICS))
+            {
+                return STATUS_INFO_LENGTH_MISMATCH;
+            }
+
+            if (ExGetPreviousMode() != KernelMode)
+            {
+                ProbeForWrite(Request.PrefetcherInformation,
+                              sizeof(SYSTEM_PREFETCHER_STATISTICS),
+                              sizeof(ULONG));
+            }
+
+            CcPfStatistics.EnabledFlags = CcPfEnablePrefetcherFlags;
+            RtlCopyMemory(Request.PrefetcherInformation, &CcPfStatistics, sizeof(SYSTEM_PREFETCHER_STATISTICS));
+            return STATUS_SUCCESS;
+
+        case PrefetcherRetrieveTrace:
+        case PrefetcherSystemParameters:
+        case PrefetcherBootPhase:
+            /* Our traces are kept and replayed in the kernel, nothing to hand out */
+            return STATUS_NOT_IMPLEMENTED;
+
+        default:
+            return STATUS_INVALID_INFO_CLASS;
+    }
+}
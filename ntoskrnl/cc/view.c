@@ -58,6 +58,18 @@ LIST_ENTRY CcDeferredWrites;
 KSPIN_LOCK CcDeferredWriteSpinLock;
 LIST_ENTRY CcCleanSharedCacheMapList;
 
+static
+PROS_VACB
+CcRosGetVacbFromIndex (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset);
+
+static
+VOID
+CcRosFreeVacbLevel (
+    PVOID *Level,
+    ULONG Depth);
+
 #if DBG
 ULONG CcRosVacbIncRefCount_(PROS_VACB vacb, PCSTR file, INT line)
 {
@@ -200,6 +212,107 @@ quit:
     return Status;
 }
 
+/*
+ * Flushes a dirty VACB together with the dirty VACBs around it in the file,
+ * with a single MmFlushSegment call over the whole run.
+ */
+static
+NTSTATUS
+CcRosFlushVacbCluster (
+    _In_ PROS_VACB Vacb,
+    _Out_ PIO_STATUS_BLOCK Iosb)
+{
+    PROS_SHARED_CACHE_MAP SharedCacheMap = Vacb->SharedCacheMap;
+    PROS_VACB Cluster[VACB_WRITE_CLUSTER_MAX];
+    PROS_VACB Neighbour;
+    LARGE_INTEGER FlushStart;
+    LONGLONG FlushEnd;
+    BOOLEAN HaveLock = FALSE;
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG Count, i;
+    KIRQL OldIrql;
+
+    Iosb->Status = STATUS_SUCCESS;
+    Iosb->Information = 0;
+
+    OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
+    KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
+
+    /* Go back to the start of the run, so that the file is written in order */
+    FlushStart = Vacb->FileOffset;
+    for (Count = 1; Count < VACB_WRITE_CLUSTER_MAX / 2; Count++)
+    {
+        if (FlushStart.QuadPart < VACB_MAPPING_GRANULARITY)
+            break;
+
+        Neighbour = CcRosGetVacbFromIndex(SharedCacheMap, FlushStart.QuadPart - VACB_MAPPING_GRANULARITY);
+        if (Neighbour == NULL || !Neighbour->Dirty)
+            break;
+
+        FlushStart.QuadPart -= VACB_MAPPING_GRANULARITY;
+    }
+
+    /* And take the VACBs of the run, they are clean as of now */
+    for (Count = 0; Count < VACB_WRITE_CLUSTER_MAX; Count++)
+    {
+        Neighbour = CcRosGetVacbFromIndex(SharedCacheMap, FlushStart.QuadPart + Count * VACB_MAPPING_GRANULARITY);
+        if (Neighbour == NULL || !Neighbour->Dirty)
+            break;
+
+        CcRosVacbIncRefCount(Neighbour);
+        CcRosUnmarkDirtyVacb(Neighbour, FALSE);
+        Cluster[Count] = Neighbour;
+    }
+
+    KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+    KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
+
+    /* Someone else flushed it meanwhile */
+    if (Count == 0)
+        return STATUS_SUCCESS;
+
+    /* Lock for flush, if we are not already the top-level */
+    if (IoGetTopLevelIrp() != (PIRP)FSRTL_CACHE_TOP_LEVEL_IRP)
+    {
+        Status = FsRtlAcquireFileForCcFlushEx(SharedCacheMap->FileObject);
+        if (!NT_SUCCESS(Status))
+            goto quit;
+        HaveLock = TRUE;
+    }
+
+    Status = MmFlushSegment(SharedCacheMap->FileObject->SectionObjectPointer,
+                            &FlushStart,
+                            Count * VACB_MAPPING_GRANULARITY,
+                            Iosb);
+
+    if (HaveLock)
+    {
+        FsRtlReleaseFileForCcFlush(SharedCacheMap->FileObject);
+    }
+
+    if (NT_SUCCESS(Status))
+    {
+        /* Update VDL */
+        FlushEnd = FlushStart.QuadPart + Count * VACB_MAPPING_GRANULARITY;
+        if (SharedCacheMap->ValidDataLength.QuadPart < FlushEnd)
+        {
+            SharedCacheMap->ValidDataLength.QuadPart = FlushEnd;
+        }
+    }
+
+quit:
+    for (i = 0; i < Count; i++)
+    {
+        /* On failure, the data still has to be written, unless it was dirtied again */
+        if (!NT_SUCCESS(Status) && !Cluster[i]->Dirty)
+            CcRosMarkDirtyVacb(Cluster[i]);
+
+        CcRosVacbDecRefCount(Cluster[i]);
+    }
+
+    return Status;
+}
+
 static
 NTSTATUS
 CcRosDeleteFileCache (
@@ -288,6 +401,11 @@ CcRosDeleteFileCache (
 #endif
     }
 
+    if (SharedCacheMap->VacbIndex != NULL)
+    {
+        CcRosFreeVacbLevel(SharedCacheMap->VacbIndex, SharedCacheMap->VacbIndexLevels);
+    }
+
     /* Release the references we own */
     if(SharedCacheMap->Section)
         ObDereferenceObject(SharedCacheMap->Section);
@@ -395,7 +513,7 @@ CcRosFlushDirtyPages (
         }
 
         IO_STATUS_BLOCK Iosb;
-        Status = CcRosFlushVacb(current, &Iosb);
+        Status = CcRosFlushVacbCluster(current, &Iosb);
 
         SharedCacheMap->Callbacks->ReleaseFromLazyWrite(SharedCacheMap->LazyWriteContext);
 
@@ -424,6 +542,13 @@ CcRosFlushDirtyPages (
             PagesFreed = Iosb.Information / PAGE_SIZE;
             (*Count) += PagesFreed;
 
+            /* Account for the write */
+            if (CalledFromLazy && PagesFreed != 0)
+            {
+                ++CcLazyWriteIos;
+                CcLazyWriteMaxPages = max(CcLazyWriteMaxPages, PagesFreed);
+            }
+
             if (!Wait)
             {
                 /* Make sure we don't overflow target! */
@@ -480,13 +605,189 @@ CcRosReleaseVacb (
     return STATUS_SUCCESS;
 }
 
-/* Returns with VACB Lock Held! */
+static
+PVOID *
+CcRosAllocateVacbLevel (VOID)
+{
+    PVOID *Level;
+
+    Level = ExAllocatePoolWithTag(NonPagedPool,
+                                  VACB_LEVEL_BLOCK_SIZE * sizeof(PVOID),
+                                  TAG_VACB_INDEX);
+    if (Level != NULL)
+    {
+        RtlZeroMemory(Level, VACB_LEVEL_BLOCK_SIZE * sizeof(PVOID));
+    }
+
+    return Level;
+}
+
+static
+VOID
+CcRosFreeVacbLevel (
+    PVOID *Level,
+    ULONG Depth)
+{
+    ULONG i;
+
+    if (Depth > 1)
+    {
+        for (i = 0; i < VACB_LEVEL_BLOCK_SIZE; i++)
+        {
+            if (Level[i] != NULL)
+                CcRosFreeVacbLevel(Level[i], Depth - 1);
+        }
+    }
+
+    ExFreePoolWithTag(Level, TAG_VACB_INDEX);
+}
+
+/* Must be called with the CacheMapLock held */
+static
+PROS_VACB
+CcRosGetVacbFromIndex (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset)
+{
+    ULONGLONG Index = (ULONGLONG)FileOffset >> VACB_OFFSET_SHIFT;
+    PVOID *Level = SharedCacheMap->VacbIndex;
+    ULONG Depth = SharedCacheMap->VacbIndexLevels;
+
+    /* Nothing was ever mapped that far */
+    if (Level == NULL || (Index >> (Depth * VACB_LEVEL_SHIFT)) != 0)
+        return NULL;
+
+    while (Depth-- > 1)
+    {
+        Level = Level[(Index >> (Depth * VACB_LEVEL_SHIFT)) & VACB_LEVEL_MASK];
+        if (Level == NULL)
+            return NULL;
+    }
+
+    return Level[Index & VACB_LEVEL_MASK];
+}
+
+/* Must be called with the CacheMapLock held */
+static
+NTSTATUS
+CcRosInsertVacbInIndex (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    PROS_VACB Vacb)
+{
+    ULONGLONG Index = (ULONGLONG)Vacb->FileOffset.QuadPart >> VACB_OFFSET_SHIFT;
+    PVOID *Level;
+    ULONG Depth;
+
+    /* Add levels on top of the tree until it reaches our index */
+    while (SharedCacheMap->VacbIndex == NULL ||
+           (Index >> (SharedCacheMap->VacbIndexLevels * VACB_LEVEL_SHIFT)) != 0)
+    {
+        ASSERT(SharedCacheMap->VacbIndexLevels < VACB_LEVEL_MAX);
+
+        Level = CcRosAllocateVacbLevel();
+        if (Level == NULL)
+            return STATUS_INSUFFICIENT_RESOURCES;
+
+        Level[0] = SharedCacheMap->VacbIndex;
+        SharedCacheMap->VacbIndex = Level;
+        SharedCacheMap->VacbIndexLevels++;
+    }
+
+    Level = SharedCacheMap->VacbIndex;
+    Depth = SharedCacheMap->VacbIndexLevels;
+    while (Depth-- > 1)
+    {
+        PVOID *Slot = &Level[(Index >> (Depth * VACB_LEVEL_SHIFT)) & VACB_LEVEL_MASK];
+
+        if (*Slot == NULL)
+        {
+            *Slot = CcRosAllocateVacbLevel();
+            if (*Slot == NULL)
+                return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        Level = *Slot;
+    }
+
+    ASSERT(Level[Index & VACB_LEVEL_MASK] == NULL);
+    Level[Index & VACB_LEVEL_MASK] = Vacb;
+
+    return STATUS_SUCCESS;
+}
+
+/* Must be called with the CacheMapLock held.
+ * Empty levels are kept until the shared cache map goes away. */
+VOID
+CcRosRemoveVacbFromIndex (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    PROS_VACB Vacb)
+{
+    ULONGLONG Index = (ULONGLONG)Vacb->FileOffset.QuadPart >> VACB_OFFSET_SHIFT;
+    PVOID *Level = SharedCacheMap->VacbIndex;
+    ULONG Depth = SharedCacheMap->VacbIndexLevels;
+
+    ASSERT(CcRosGetVacbFromIndex(SharedCacheMap, Vacb->FileOffset.QuadPart) == Vacb);
+
+    while (Depth-- > 1)
+    {
+        Level = Level[(Index >> (Depth * VACB_LEVEL_SHIFT)) & VACB_LEVEL_MASK];
+    }
+
+    Level[Index & VACB_LEVEL_MASK] = NULL;
+}
+
+/* Returns the VACB with the highest index strictly below Index in the
+ * given subtree, or NULL if there is none. Index can be the subtree span. */
+static
+PROS_VACB
+CcRosFindPreviousVacbInIndex (
+    PVOID *Level,
+    ULONG Depth,
+    ULONGLONG Index)
+{
+    ULONG Shift = (Depth - 1) * VACB_LEVEL_SHIFT;
+    ULONG Slot = (ULONG)(Index >> Shift);
+    ULONGLONG SubIndex = Index & ((1ULL << Shift) - 1);
+    PROS_VACB Vacb;
+
+    if (Depth == 1)
+    {
+        while (Slot-- > 0)
+        {
+            if (Level[Slot] != NULL)
+                return Level[Slot];
+        }
+        return NULL;
+    }
+
+    /* First look in the subtree containing Index itself */
+    if (Slot < VACB_LEVEL_BLOCK_SIZE && Level[Slot] != NULL && SubIndex != 0)
+    {
+        Vacb = CcRosFindPreviousVacbInIndex(Level[Slot], Depth - 1, SubIndex);
+        if (Vacb != NULL)
+            return Vacb;
+    }
+
+    /* Then in the whole preceding ones */
+    while (Slot-- > 0)
+    {
+        if (Level[Slot] != NULL)
+        {
+            Vacb = CcRosFindPreviousVacbInIndex(Level[Slot], Depth - 1, 1ULL << Shift);
+            if (Vacb != NULL)
+                return Vacb;
+        }
+    }
+
+    return NULL;
+}
+
+/* Returns with a reference on the VACB, if found */
 PROS_VACB
 CcRosLookupVacb (
     PROS_SHARED_CACHE_MAP SharedCacheMap,
     LONGLONG FileOffset)
 {
-    PLIST_ENTRY current_entry;
     PROS_VACB current;
     KIRQL oldIrql;
 
@@ -495,33 +796,22 @@ CcRosLookupVacb (
     DPRINT("CcRosLookupVacb(SharedCacheMap 0x%p, FileOffset %I64u)\n",
            SharedCacheMap, FileOffset);
 
-    oldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
-    KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
+    /* VACBs are only ever unlinked from the index with the CacheMapLock
+     * held, so there is no need for the master lock here */
+    KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
 
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    current = CcRosGetVacbFromIndex(SharedCacheMap, FileOffset);
+    if (current != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
-            KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
-            return current;
-        }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+        ASSERT(IsPointInRange(current->FileOffset.QuadPart,
+                              VACB_MAPPING_GRANULARITY,
+                              FileOffset));
+        CcRosVacbIncRefCount(current);
     }
 
-    KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
-    KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+    KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
 
-    return NULL;
+    return current;
 }
 
 VOID
@@ -542,6 +832,7 @@ CcRosMarkDirtyVacb (
     /* FIXME: There is no reason to account for the whole VACB. */
     CcTotalDirtyPages += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
     Vacb->SharedCacheMap->DirtyPages += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+    Vacb->SharedCacheMap->DirtiedPages += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
     CcRosVacbIncRefCount(Vacb);
 
     /* Move to the tail of the LRU list */
@@ -635,6 +926,7 @@ CcRosFreeUnusedVacb (
             ASSERT(Refs == 1);
 
             /* Reset and move to free list */
+            CcRosRemoveVacbFromIndex(current->SharedCacheMap, current);
             RemoveEntryList(&current->CacheMapVacbListEntry);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
@@ -686,7 +978,6 @@ CcRosCreateVacb (
 {
     PROS_VACB current;
     PROS_VACB previous;
-    PLIST_ENTRY current_entry;
     NTSTATUS Status;
     KIRQL oldIrql;
     ULONG Refs;
@@ -752,48 +1043,47 @@ Retry:
      * our newly created VACB and return the existing one.
      */
     KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    previous = NULL;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    current = CcRosGetVacbFromIndex(SharedCacheMap, FileOffset);
+    if (current != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+        CcRosVacbIncRefCount(current);
+        KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 #if DBG
-            if (SharedCacheMap->Trace)
-            {
-                DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
-                        SharedCacheMap,
-                        (*Vacb),
-                        current);
-            }
+        if (SharedCacheMap->Trace)
+        {
+            DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
+                    SharedCacheMap,
+                    (*Vacb),
+                    current);
+        }
 #endif
-            KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
 
-            Refs = CcRosVacbDecRefCount(*Vacb);
-            ASSERT(Refs == 0);
+        Refs = CcRosVacbDecRefCount(*Vacb);
+        ASSERT(Refs == 0);
 
-            *Vacb = current;
-            return STATUS_SUCCESS;
-        }
-        if (current->FileOffset.QuadPart < FileOffset)
-        {
-            ASSERT(previous == NULL ||
-                   previous->FileOffset.QuadPart < current->FileOffset.QuadPart);
-            previous = current;
-        }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+        *Vacb = current;
+        return STATUS_SUCCESS;
     }
+
     /* There was no existing VACB. */
     current = *Vacb;
+    Status = CcRosInsertVacbInIndex(SharedCacheMap, current);
+    if (!NT_SUCCESS(Status))
+    {
+        KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+
+        Refs = CcRosVacbDecRefCount(current);
+        ASSERT(Refs == 0);
+
+        return Status;
+    }
+
+    /* Keep the list sorted by file offset */
+    previous = CcRosFindPreviousVacbInIndex(SharedCacheMap->VacbIndex,
+                                            SharedCacheMap->VacbIndexLevels,
+                                            (ULONGLONG)current->FileOffset.QuadPart >> VACB_OFFSET_SHIFT);
     if (previous)
     {
         InsertHeadList(&previous->CacheMapVacbListEntry, &current->CacheMapVacbListEntry);
@@ -1414,14 +1704,14 @@ ExpKdbgExtFileCache(ULONG Argc, PCHAR Argv[])
     UNICODE_STRING NoName = RTL_CONSTANT_STRING(L"No name for File");
 
     KdbpPrint("  Usage Summary (in kb)\n");
-    KdbpPrint("Shared\t\tMapped\tDirty\tName\n");
+    KdbpPrint("Shared\t\tMapped\tDirty\tRate\tName\n");
     /* No need to lock the spin lock here, we're in DBG */
     for (ListEntry = CcCleanSharedCacheMapList.Flink;
          ListEntry != &CcCleanSharedCacheMapList;
          ListEntry = ListEntry->Flink)
     {
         PLIST_ENTRY Vacbs;
-        ULONG Mapped = 0, Dirty = 0;
+        ULONG Mapped = 0, Dirty = 0, Rate;
         PROS_SHARED_CACHE_MAP SharedCacheMap;
         PUNICODE_STRING FileName;
         PWSTR Extra = L"";
@@ -1431,6 +1721,9 @@ ExpKdbgExtFileCache(ULONG Argc, PCHAR Argv[])
         /* Dirty size */
         Dirty = (SharedCacheMap->DirtyPages * PAGE_SIZE) / 1024;
 
+        /* Dirtying rate, per lazy writer scan */
+        Rate = (SharedCacheMap->DirtyRate * PAGE_SIZE) / 1024;
+
         /* First, count for all the associated VACB */
         for (Vacbs = SharedCacheMap->CacheMapVacbListHead.Flink;
              Vacbs != &SharedCacheMap->CacheMapVacbListHead;
@@ -1460,7 +1753,7 @@ ExpKdbgExtFileCache(ULONG Argc, PCHAR Argv[])
         }
 
         /* And print */
-        KdbpPrint("%p\t%d\t%d\t%wZ%S\n", SharedCacheMap, Mapped, Dirty, FileName, Extra);
+        KdbpPrint("%p\t%d\t%d\t%d\t%wZ%S\n", SharedCacheMap, Mapped, Dirty, Rate, FileName, Extra);
     }
 
     return TRUE;
@@ -1481,6 +1774,11 @@ ExpKdbgExtDefWrites(ULONG Argc, PCHAR Argv[])
               (MmThrottleBottom * PAGE_SIZE) / 1024);
     KdbpPrint("MmModifiedPageListHead.Total:\t%lu (%lu Kb)\n", MmModifiedPageListHead.Total,
               (MmModifiedPageListHead.Total * PAGE_SIZE) / 1024);
+    KdbpPrint("CcDirtyPageRate:\t%lu (%lu Kb) per scan\n", CcDirtyPageRate,
+              (CcDirtyPageRate * PAGE_SIZE) / 1024);
+    KdbpPrint("CcLazyWritePages:\t%lu in %lu writes, largest %lu\n", CcLazyWritePages,
+              CcLazyWriteIos, CcLazyWriteMaxPages);
+    KdbpPrint("CcThrottledWrites:\t%lu\n", CcThrottledWrites);
 
     if (CcTotalDirtyPages >= CcDirtyPageThreshold)
     {
@@ -2347,10 +2347,10 @@ CmpEnumerateOpenSubKeys(
     }
 
     /* Enumerate all hash lists */
-    for (i = 0; i < CmpHashTableSize; i++)
+    for (i = 0; i < CmpCacheChains->Size; i++)
     {
         /* Get the first cache entry */
-        Entry = CmpCacheTable[i].Entry;
+        Entry = CmpCacheChains->Entry[i];
 
         /* Enumerate all cache entries */
         while (Entry)
@@ -2423,7 +2423,7 @@ CmpEnumerateOpenSubKeys(
                         CmpCleanUpKcbCacheWithLock(CachedKcb, TRUE);
 
                         /* Restart, because the hash list has changed */
-                        Entry = CmpCacheTable[i].Entry;
+                        Entry = CmpCacheChains->Entry[i];
                         continue;
                     }
                 }
@@ -481,6 +481,13 @@ DATA_SEG("INIT") CM_SYSTEM_CONTROL_VECTOR CmControlVector[] =
         NULL,
         NULL
     },
+    {
+        L"Session Manager\\Memory Management\\PrefetchParameters",
+        L"EnablePrefetcher",
+        &CcPfEnablePrefetcherFlags,
+        NULL,
+        NULL
+    },
     {
         L"Session Manager\\Executive",
         L"AdditionalCriticalWorkerThreads",
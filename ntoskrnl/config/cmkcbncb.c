@@ -17,9 +17,169 @@
 ULONG CmpHashTableSize = 2048;
 PCM_KEY_HASH_TABLE_ENTRY CmpCacheTable;
 PCM_NAME_HASH_TABLE_ENTRY CmpNameCacheTable;
+PCM_KEY_HASH_CHAINS CmpCacheChains;
+PCM_NAME_HASH_CHAINS CmpNameCacheChains;
+LONG CmpCacheEntryCount, CmpNameCacheEntryCount;
+
+/* Average chain length above which the caches grow, and below which they shrink */
+#define CMP_CACHE_GROW_LOAD     2
+#define CMP_CACHE_SHRINK_LOAD   8
+
+WORK_QUEUE_ITEM CmpCacheResizeWorkItem;
+LONG CmpCacheResizePending;
 
 /* FUNCTIONS *****************************************************************/
 
+static
+PVOID
+CmpAllocateHashChains(IN ULONG Size)
+{
+    PCM_KEY_HASH_CHAINS Chains;
+    ULONG Length;
+
+    /* Both kinds of chains have the same layout */
+    C_ASSERT(FIELD_OFFSET(CM_KEY_HASH_CHAINS, Entry) ==
+             FIELD_OFFSET(CM_NAME_HASH_CHAINS, Entry));
+    Length = FIELD_OFFSET(CM_KEY_HASH_CHAINS, Entry[Size]);
+
+    /* Allocate them empty */
+    Chains = CmpAllocate(Length, TRUE, TAG_CM);
+    if (!Chains) return NULL;
+    RtlZeroMemory(Chains, Length);
+    Chains->Size = Size;
+    return Chains;
+}
+
+static
+ULONG
+CmpGetHashChainsTarget(IN ULONG Size,
+                       IN LONG Count)
+{
+    ULONG Target = Size;
+
+    /* Double the chains while they are too long on average */
+    while ((Count > 0) && ((ULONG)Count > Target * CMP_CACHE_GROW_LOAD))
+    {
+        if (Target >= (MAXULONG / 2) / sizeof(PVOID)) break;
+        Target *= 2;
+    }
+
+    /* Halve them while they are mostly empty, but never below the lock count */
+    while ((Target > CmpHashTableSize) &&
+           ((ULONG)max(Count, 0) < Target / CMP_CACHE_SHRINK_LOAD))
+    {
+        Target /= 2;
+    }
+
+    return Target;
+}
+
+static
+VOID
+NTAPI
+CmpResizeCacheWorker(IN PVOID Parameter)
+{
+    PCM_KEY_HASH_CHAINS NewChains, OldChains;
+    PCM_NAME_HASH_CHAINS NewNameChains, OldNameChains;
+    PCM_KEY_HASH KeyHash, *KeyChain;
+    PCM_NAME_HASH NameHash, *NameChain;
+    ULONG i, Target;
+    UNREFERENCED_PARAMETER(Parameter);
+
+    /* Allow a new resize to be queued from now on */
+    InterlockedExchange(&CmpCacheResizePending, 0);
+
+    /*
+     * Lock out everyone that could be walking the chains: those holding the
+     * registry lock exclusively, and those holding a KCB or NCB lock. KCB
+     * locks are always acquired by increasing index, and before NCB locks,
+     * so doing the same here can't deadlock.
+     */
+    CmpLockRegistryExclusive();
+    for (i = 0; i < CmpHashTableSize; i++)
+    {
+        CmpAcquireKcbLockExclusiveByIndex(i);
+    }
+    for (i = 0; i < CmpHashTableSize; i++)
+    {
+        ExAcquirePushLockExclusive(&CmpNameCacheTable[i].Lock);
+    }
+
+    /* Rehash the KCBs if they went out of bounds */
+    OldChains = CmpCacheChains;
+    Target = CmpGetHashChainsTarget(OldChains->Size, CmpCacheEntryCount);
+    NewChains = (Target != OldChains->Size) ? CmpAllocateHashChains(Target) : NULL;
+    if (NewChains)
+    {
+        for (i = 0; i < OldChains->Size; i++)
+        {
+            while ((KeyHash = OldChains->Entry[i]))
+            {
+                OldChains->Entry[i] = KeyHash->NextHash;
+                KeyChain = GET_HASH_CHAIN(NewChains, KeyHash->ConvKey);
+                KeyHash->NextHash = *KeyChain;
+                *KeyChain = KeyHash;
+            }
+        }
+        CmpCacheChains = NewChains;
+        DPRINT("KCB cache: %ld entries in %lu chains (was %lu)\n",
+               CmpCacheEntryCount, NewChains->Size, OldChains->Size);
+    }
+
+    /* Same thing for the NCBs */
+    OldNameChains = CmpNameCacheChains;
+    Target = CmpGetHashChainsTarget(OldNameChains->Size, CmpNameCacheEntryCount);
+    NewNameChains = (Target != OldNameChains->Size) ? CmpAllocateHashChains(Target) : NULL;
+    if (NewNameChains)
+    {
+        for (i = 0; i < OldNameChains->Size; i++)
+        {
+            while ((NameHash = OldNameChains->Entry[i]))
+            {
+                OldNameChains->Entry[i] = NameHash->NextHash;
+                NameChain = GET_HASH_CHAIN(NewNameChains, NameHash->ConvKey);
+                NameHash->NextHash = *NameChain;
+                *NameChain = NameHash;
+            }
+        }
+        CmpNameCacheChains = NewNameChains;
+        DPRINT("NCB cache: %ld entries in %lu chains (was %lu)\n",
+               CmpNameCacheEntryCount, NewNameChains->Size, OldNameChains->Size);
+    }
+
+    /* Let everyone back in */
+    for (i = 0; i < CmpHashTableSize; i++)
+    {
+        ExReleasePushLock(&CmpNameCacheTable[i].Lock);
+    }
+    for (i = 0; i < CmpHashTableSize; i++)
+    {
+        CmpReleaseKcbLockByIndex(i);
+    }
+    CmpUnlockRegistry();
+
+    /* Nobody can see the old chains anymore */
+    if (NewChains) CmpFree(OldChains, 0);
+    if (NewNameChains) CmpFree(OldNameChains, 0);
+}
+
+static
+VOID
+CmpCheckCacheLoad(IN PVOID Chains,
+                  IN LONG Count)
+{
+    ULONG Size = ((PCM_KEY_HASH_CHAINS)Chains)->Size;
+
+    /* Nothing to do as long as the chains are neither too long nor too empty */
+    if (CmpGetHashChainsTarget(Size, Count) == Size) return;
+
+    /* Otherwise get the chains resized, unless this is already on its way */
+    if (!InterlockedCompareExchange(&CmpCacheResizePending, 1, 0))
+    {
+        ExQueueWorkItem(&CmpCacheResizeWorkItem, DelayedWorkQueue);
+    }
+}
+
 CODE_SEG("INIT")
 VOID
 NTAPI
@@ -48,6 +208,14 @@ CmpInitializeCache(VOID)
         ExInitializePushLock(&CmpCacheTable[i].Lock);
     }
 
+    /* Start with one chain per lock */
+    CmpCacheChains = CmpAllocateHashChains(CmpHashTableSize);
+    if (!CmpCacheChains)
+    {
+        /* Take the system down */
+        KeBugCheckEx(CONFIG_INITIALIZATION_FAILED, 3, 1, 0, 0);
+    }
+
     /* Calculate length for the name cache */
     Length = CmpHashTableSize * sizeof(CM_NAME_HASH_TABLE_ENTRY);
 
@@ -69,6 +237,17 @@ CmpInitializeCache(VOID)
         ExInitializePushLock(&CmpNameCacheTable[i].Lock);
     }
 
+    /* And its chains */
+    CmpNameCacheChains = CmpAllocateHashChains(CmpHashTableSize);
+    if (!CmpNameCacheChains)
+    {
+        /* Take the system down */
+        KeBugCheckEx(CONFIG_INITIALIZATION_FAILED, 3, 3, 0, 0);
+    }
+
+    /* Setup the work item which resizes the chains with the load */
+    ExInitializeWorkItem(&CmpCacheResizeWorkItem, CmpResizeCacheWorker, NULL);
+
     /* Setup the delayed close table */
     CmpInitializeDelayedCloseTable();
 }
@@ -82,7 +261,7 @@ CmpRemoveKeyHash(IN PCM_KEY_HASH KeyHash)
     ASSERT_VALID_HASH(KeyHash);
 
     /* Lookup all the keys in this index entry */
-    Prev = &GET_HASH_ENTRY(CmpCacheTable, KeyHash->ConvKey)->Entry;
+    Prev = GET_HASH_CHAIN(CmpCacheChains, KeyHash->ConvKey);
     while (TRUE)
     {
         /* Save the current one and make sure it's valid */
@@ -102,6 +281,9 @@ CmpRemoveKeyHash(IN PCM_KEY_HASH KeyHash)
         /* Otherwise, keep going */
         Prev = &Current->NextHash;
     }
+
+    /* One less KCB in the cache, see if it got too empty */
+    CmpCheckCacheLoad(CmpCacheChains, InterlockedDecrement(&CmpCacheEntryCount));
 }
 
 PCM_KEY_CONTROL_BLOCK
@@ -109,18 +291,18 @@ NTAPI
 CmpInsertKeyHash(IN PCM_KEY_HASH KeyHash,
                  IN BOOLEAN IsFake)
 {
-    ULONG i;
+    PCM_KEY_HASH *Chain;
     PCM_KEY_HASH Entry;
     ASSERT_VALID_HASH(KeyHash);
 
-    /* Get the hash index */
-    i = GET_HASH_INDEX(KeyHash->ConvKey);
+    /* Get the hash chain */
+    Chain = GET_HASH_CHAIN(CmpCacheChains, KeyHash->ConvKey);
 
     /* If this is a fake key, increase the key cell to use the parent data */
     if (IsFake) KeyHash->KeyCell++;
 
     /* Loop the hash table */
-    Entry = CmpCacheTable[i].Entry;
+    Entry = *Chain;
     while (Entry)
     {
         /* Check if this matches */
@@ -138,8 +320,11 @@ CmpInsertKeyHash(IN PCM_KEY_HASH KeyHash,
     }
 
     /* No entry found, add this one and return NULL since none existed */
-    KeyHash->NextHash = CmpCacheTable[i].Entry;
-    CmpCacheTable[i].Entry = KeyHash;
+    KeyHash->NextHash = *Chain;
+    *Chain = KeyHash;
+
+    /* One more KCB in the cache, see if the chains got too long */
+    CmpCheckCacheLoad(CmpCacheChains, InterlockedIncrement(&CmpCacheEntryCount));
     return NULL;
 }
 
@@ -189,7 +374,7 @@ CmpGetNameControlBlock(IN PUNICODE_STRING NodeName)
     CmpAcquireNcbLockExclusiveByKey(ConvKey);
 
     /* Get the hash entry */
-    HashEntry = GET_HASH_ENTRY(CmpNameCacheTable, ConvKey)->Entry;
+    HashEntry = *GET_HASH_CHAIN(CmpNameCacheChains, ConvKey);
     while (HashEntry)
     {
         /* Get the current NCB */
@@ -290,8 +475,12 @@ CmpGetNameControlBlock(IN PUNICODE_STRING NodeName)
 
         /* Insert the name in the hash table */
         HashEntry = &Ncb->NameHash;
-        HashEntry->NextHash = GET_HASH_ENTRY(CmpNameCacheTable, ConvKey)->Entry;
-        GET_HASH_ENTRY(CmpNameCacheTable, ConvKey)->Entry = HashEntry;
+        HashEntry->NextHash = *GET_HASH_CHAIN(CmpNameCacheChains, ConvKey);
+        *GET_HASH_CHAIN(CmpNameCacheChains, ConvKey) = HashEntry;
+
+        /* See if the chains got too long */
+        CmpCheckCacheLoad(CmpNameCacheChains,
+                          InterlockedIncrement(&CmpNameCacheEntryCount));
     }
 
     /* Release NCB lock */
@@ -327,7 +516,7 @@ CmpDereferenceNameControlBlockWithLock(IN PCM_NAME_CONTROL_BLOCK Ncb)
     if (!(--Ncb->RefCount))
     {
         /* Find the NCB in the table */
-        Next = &GET_HASH_ENTRY(CmpNameCacheTable, Ncb->ConvKey)->Entry;
+        Next = GET_HASH_CHAIN(CmpNameCacheChains, Ncb->ConvKey);
         while (TRUE)
         {
             /* Check the current entry */
@@ -346,6 +535,10 @@ CmpDereferenceNameControlBlockWithLock(IN PCM_NAME_CONTROL_BLOCK Ncb)
 
         /* Found it, now free it */
         CmpFree(Ncb, 0);
+
+        /* See if the chains got too empty */
+        CmpCheckCacheLoad(CmpNameCacheChains,
+                          InterlockedDecrement(&CmpNameCacheEntryCount));
     }
 
     /* Release the lock */
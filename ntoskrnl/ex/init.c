@@ -548,7 +548,7 @@ ExpLoadInitialProcess(IN PINIT_BUFFER InitBuffer,
     RtlAppendUnicodeStringToString(&Environment, &NullString);
 
     /* Prepare the prefetcher */
-    //CcPfBeginBootPhase(150);
+    CcPfBeginBootPhase(PfSessionManagerInitPhase);
 
     /* Create SMSS process */
     SmssName = ProcessParams->ImagePathName;
@@ -1094,6 +1094,9 @@ ExpInitializeExecutive(IN ULONG Cpu,
     /* Add loaded CmNtGlobalFlag value */
     NtGlobalFlag |= CmNtGlobalFlag;
 
+    /* Pick up the NUMA topology from the HAL before Mm lays out its colors */
+    KeNumaInitialize();
+
     /* Initialize the executive at phase 0 */
     if (!ExInitSystem()) KeBugCheck(PHASE0_INITIALIZATION_FAILED);
 
@@ -1560,6 +1563,9 @@ Phase1InitializationDiscard(IN PVOID Context)
     /* Initialize all processors */
     if (!HalAllProcessorsStarted()) KeBugCheck(HAL1_INITIALIZATION_FAILED);
 
+    /* Now that they are running, give them their own pool tag tables */
+    ExpInitializePoolTagTables();
+
 #ifdef CONFIG_SMP
     /* HACK: We should use RtlFindMessage and not only fallback to this */
     MpString = "MultiProcessor Kernel\r\n";
@@ -729,19 +729,35 @@ QSI_DEF(SystemPerformanceInformation)
     Spi->CommitLimit = MmNumberOfPhysicalPages + MiFreeSwapPages + MiUsedSwapPages;
 
     Spi->PeakCommitment = 0; /* FIXME */
-    Spi->PageFaultCount = 0; /* FIXME */
-    Spi->CopyOnWriteCount = 0; /* FIXME */
-    Spi->TransitionCount = 0; /* FIXME */
-    Spi->CacheTransitionCount = 0; /* FIXME */
-    Spi->DemandZeroCount = 0; /* FIXME */
-    Spi->PageReadCount = 0; /* FIXME */
-    Spi->PageReadIoCount = 0; /* FIXME */
+    Spi->PageFaultCount = 0;
+    Spi->CopyOnWriteCount = 0;
+    Spi->TransitionCount = 0;
+    Spi->CacheTransitionCount = 0;
+    Spi->DemandZeroCount = 0;
+    Spi->PageReadCount = 0;
+    Spi->PageReadIoCount = 0;
+    Spi->MappedPagesWriteCount = 0;
+    Spi->MappedWriteIoCount = 0;
+    for (i = 0; i < KeNumberProcessors; i ++)
+    {
+        Prcb = KiProcessorBlock[i];
+        if (Prcb)
+        {
+            Spi->PageFaultCount += Prcb->MmPageFaultCount;
+            Spi->CopyOnWriteCount += Prcb->MmCopyOnWriteCount;
+            Spi->TransitionCount += Prcb->MmTransitionCount;
+            Spi->CacheTransitionCount += Prcb->MmCacheTransitionCount;
+            Spi->DemandZeroCount += Prcb->MmDemandZeroCount;
+            Spi->PageReadCount += Prcb->MmPageReadCount;
+            Spi->PageReadIoCount += Prcb->MmPageReadIoCount;
+            Spi->MappedPagesWriteCount += Prcb->MmMappedPagesWriteCount;
+            Spi->MappedWriteIoCount += Prcb->MmMappedWriteIoCount;
+        }
+    }
     Spi->CacheReadCount = 0; /* FIXME */
     Spi->CacheIoCount = 0; /* FIXME */
     Spi->DirtyPagesWriteCount = 0; /* FIXME */
     Spi->DirtyWriteIoCount = 0; /* FIXME */
-    Spi->MappedPagesWriteCount = 0; /* FIXME */
-    Spi->MappedWriteIoCount = 0; /* FIXME */
 
     Spi->PagedPoolPages = 0;
     Spi->NonPagedPoolPages = 0;
@@ -2406,9 +2422,7 @@ QSI_DEF(SystemNumaProcessorMap)
 /* Class 56 - Prefetcher information  */
 QSI_DEF(SystemPrefetcherInformation)
 {
-    /* FIXME */
-    DPRINT1("NtQuerySystemInformation - SystemPrefetcherInformation not implemented\n");
-    return STATUS_NOT_IMPLEMENTED;
+    return CcPfQueryPrefetcherInformation(Buffer, Size, ReqSize);
 }
 
 
@@ -2615,6 +2629,18 @@ QSI_DEF(SystemExtendedHandleInformation)
     return Status;
 }
 
+/* Class 66 - Big pool allocations information  */
+QSI_DEF(SystemBigPoolInformation)
+{
+    /* We need room for the count at least, the entries are counted later */
+    if (Size < sizeof(SYSTEM_BIGPOOL_INFORMATION))
+    {
+        *ReqSize = sizeof(SYSTEM_BIGPOOL_INFORMATION);
+        return STATUS_INFO_LENGTH_MISMATCH;
+    }
+    return ExGetBigPoolInfo(Buffer, Size, ReqSize);
+}
+
 /* Class 70 - System object security mode information  */
 QSI_DEF(SystemObjectSecurityMode)
 {
@@ -2701,7 +2727,7 @@ QSI_DEF(SystemLogicalProcessorInformation)
         {
             /* Zero output and return */
             RtlZeroMemory(CurrentInfo, sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
-            CurrentInfo->ProcessorMask = KeActiveProcessors;
+            CurrentInfo->ProcessorMask = KeNodeBlock[i]->ProcessorMask;
 
             /* NUMA node needs its ID */
             CurrentInfo->Relationship = RelationNumaNode;
@@ -2815,6 +2841,13 @@ QSI_DEF(SystemFirmwareTableInformation)
     return Status;
 }
 
+/* Class 0x100 - Executive work queue information (ReactOS extension) */
+QSI_DEF(SystemWorkQueueInformation)
+{
+    if (Size < sizeof(SYSTEM_WORK_QUEUE_INFORMATION)) return STATUS_INFO_LENGTH_MISMATCH;
+    return ExGetWorkQueueInfo(Buffer, Size, ReqSize);
+}
+
 /* Query/Set Calls Table */
 typedef
 struct _QSSI_CALLS
@@ -2903,7 +2936,7 @@ CallQS [] =
     SI_XX(SystemEmulationProcessorInformation), /* FIXME: not implemented */
     SI_QX(SystemExtendedHandleInformation),
     SI_XX(SystemLostDelayedWriteInformation), /* FIXME: not implemented */
-    SI_XX(SystemBigPoolInformation), /* FIXME: not implemented */
+    SI_QX(SystemBigPoolInformation),
     SI_XX(SystemSessionPoolTagInformation), /* FIXME: not implemented */
     SI_XX(SystemSessionMappedViewInformation), /* FIXME: not implemented */
     SI_XX(SystemHotpatchInformation), /* FIXME: not implemented */
@@ -2936,6 +2969,7 @@ NtQuerySystemInformation(
     ULONG ResultLength = 0;
     ULONG Alignment = TYPE_ALIGNMENT(ULONG);
     NTSTATUS FStatus = STATUS_NOT_IMPLEMENTED;
+    NTSTATUS (*Query)(PVOID, ULONG, PULONG);
 
     PAGED_CODE();
 
@@ -2947,8 +2981,9 @@ NtQuerySystemInformation(
         /*
          * Check if the request is valid.
          */
-        if (SystemInformationClass < MIN_SYSTEM_INFO_CLASS ||
-            SystemInformationClass >= MAX_SYSTEM_INFO_CLASS)
+        if ((SystemInformationClass < MIN_SYSTEM_INFO_CLASS ||
+             SystemInformationClass >= MAX_SYSTEM_INFO_CLASS) &&
+            SystemInformationClass != SystemWorkQueueInformation)
         {
             _SEH2_YIELD(return STATUS_INVALID_INFO_CLASS);
         }
@@ -2972,21 +3007,28 @@ NtQuerySystemInformation(
         /*
          * Check if the request is valid.
          */
-        if (SystemInformationClass < MIN_SYSTEM_INFO_CLASS ||
-            SystemInformationClass >= MAX_SYSTEM_INFO_CLASS)
+        if ((SystemInformationClass < MIN_SYSTEM_INFO_CLASS ||
+             SystemInformationClass >= MAX_SYSTEM_INFO_CLASS) &&
+            SystemInformationClass != SystemWorkQueueInformation)
         {
             _SEH2_YIELD(return STATUS_INVALID_INFO_CLASS);
         }
 #endif
 
-        if (NULL != CallQS [SystemInformationClass].Query)
+        /* The ReactOS extension is out of the range of the table */
+        if (SystemInformationClass == SystemWorkQueueInformation)
+            Query = QSI_USE(SystemWorkQueueInformation);
+        else
+            Query = CallQS [SystemInformationClass].Query;
+
+        if (NULL != Query)
         {
             /*
              * Hand the request to a subhandler.
              */
-            FStatus = CallQS [SystemInformationClass].Query(SystemInformation,
-                                                            Length,
-                                                            &ResultLength);
+            FStatus = Query(SystemInformation,
+                            Length,
+                            &ResultLength);
 
             /* Save the result length to the caller */
             if (UnsafeResultLength)
@@ -20,6 +20,13 @@ POBJECT_TYPE ExTimerType = NULL;
 KSPIN_LOCK ExpWakeListLock;
 LIST_ENTRY ExpWakeList;
 
+/* High Resolution Timers */
+LONG ExpHighResolutionTimerCount;
+BOOLEAN ExpTimerResolutionRaised;
+KGUARDED_MUTEX ExpTimerResolutionLock;
+WORK_QUEUE_ITEM ExpTimerResolutionWorkItem;
+LONG ExpTimerResolutionWorkQueued;
+
 /* Timer Mapping */
 static GENERIC_MAPPING ExpTimerMapping =
 {
@@ -38,6 +45,65 @@ static const INFORMATION_CLASS_INFO ExTimerInfoClass[] =
 
 /* PRIVATE FUNCTIONS *********************************************************/
 
+VOID
+NTAPI
+ExpUpdateTimerResolution(VOID)
+{
+    BOOLEAN Raise;
+    PAGED_CODE();
+
+    /* Run the clock at its highest rate only while a high resolution timer is armed */
+    KeAcquireGuardedMutex(&ExpTimerResolutionLock);
+    Raise = (ExpHighResolutionTimerCount != 0);
+    if (Raise != ExpTimerResolutionRaised)
+    {
+        /* Request or release the minimum increment */
+        ExSetTimerResolution(KeMinimumIncrement, Raise);
+        ExpTimerResolutionRaised = Raise;
+    }
+    KeReleaseGuardedMutex(&ExpTimerResolutionLock);
+}
+
+VOID
+NTAPI
+ExpTimerResolutionWorker(IN PVOID Context)
+{
+    /* Allow another update to be queued, then do this one */
+    InterlockedExchange(&ExpTimerResolutionWorkQueued, FALSE);
+    ExpUpdateTimerResolution();
+}
+
+BOOLEAN
+NTAPI
+ExpActivateHighResolution(IN PETIMER Timer)
+{
+    /* Nothing to do if the timer is not high resolution, or already counted */
+    if (!(Timer->HighResolution) || (Timer->HighResolutionActive)) return FALSE;
+
+    /* Count it, and tell the caller if the clock rate must now be raised */
+    Timer->HighResolutionActive = TRUE;
+    return (InterlockedIncrement(&ExpHighResolutionTimerCount) == 1);
+}
+
+VOID
+NTAPI
+ExpDeactivateHighResolution(IN PETIMER Timer)
+{
+    /* Nothing to do if the timer is not holding the clock rate */
+    if (!Timer->HighResolutionActive) return;
+    Timer->HighResolutionActive = FALSE;
+
+    /*
+     * The last timer is gone. We may be at DISPATCH_LEVEL here, so leave
+     * restoring the clock rate to a worker thread.
+     */
+    if (!(InterlockedDecrement(&ExpHighResolutionTimerCount)) &&
+        !(InterlockedExchange(&ExpTimerResolutionWorkQueued, TRUE)))
+    {
+        ExQueueWorkItem(&ExpTimerResolutionWorkItem, DelayedWorkQueue);
+    }
+}
+
 VOID
 NTAPI
 ExTimerRundown(VOID)
@@ -80,6 +146,7 @@ ExTimerRundown(VOID)
             KeCancelTimer(&Timer->KeTimer);
             KeRemoveQueueDpc(&Timer->TimerDpc);
             if (KeRemoveQueueApc(&Timer->TimerApc)) DerefsToDo++;
+            ExpDeactivateHighResolution(Timer);
 
             /* Add another dereference to do */
             DerefsToDo++;
@@ -131,6 +198,9 @@ ExpDeleteTimer(IN PVOID ObjectBody)
     /* Tell the Kernel to cancel the Timer and flush all queued DPCs */
     KeCancelTimer(&Timer->KeTimer);
     KeFlushQueuedDpcs();
+
+    /* Stop holding the clock rate if this was an armed high resolution timer */
+    ExpDeactivateHighResolution(Timer);
 }
 
 _Function_class_(KDEFERRED_ROUTINE)
@@ -160,6 +230,15 @@ ExpTimerDpcRoutine(IN PKDPC Dpc,
                                     IO_NO_INCREMENT);
     }
 
+    /*
+     * A one-shot high resolution timer no longer needs the faster clock,
+     * unless it was set again while this DPC was waiting for the lock
+     */
+    if (!(Timer->Period) && !(Timer->KeTimer.Header.Inserted))
+    {
+        ExpDeactivateHighResolution(Timer);
+    }
+
     /* Release the Timer */
     KeReleaseSpinLockFromDpcLevel(&Timer->Lock);
 
@@ -217,6 +296,175 @@ ExpTimerApcKernelRoutine(IN PKAPC Apc,
     ObDereferenceObjectEx(Timer, DerefsToDo);
 }
 
+NTSTATUS
+NTAPI
+ExpSetTimer(IN HANDLE TimerHandle,
+            IN LARGE_INTEGER TimerDueTime,
+            IN PTIMER_APC_ROUTINE TimerApcRoutine OPTIONAL,
+            IN PVOID TimerContext OPTIONAL,
+            IN BOOLEAN WakeTimer,
+            IN LONG Period,
+            IN ULONG TolerableDelay,
+            OUT PBOOLEAN PreviousState OPTIONAL,
+            IN KPROCESSOR_MODE PreviousMode)
+{
+    PETIMER Timer;
+    KIRQL OldIrql;
+    BOOLEAN State, RaiseResolution;
+    PETHREAD Thread = PsGetCurrentThread();
+    PETHREAD TimerThread;
+    ULONG DerefsToDo = 1;
+    NTSTATUS Status;
+    PAGED_CODE();
+
+    /* Get the Timer Object */
+    Status = ObReferenceObjectByHandle(TimerHandle,
+                                       TIMER_MODIFY_STATE,
+                                       ExTimerType,
+                                       PreviousMode,
+                                       (PVOID*)&Timer,
+                                       NULL);
+
+    /*
+     * Tell the user we don't support Wake Timers...
+     * when we have the ability to use/detect the Power Management
+     * functionality required to support them, make this check dependent
+     * on the actual PM capabilities
+     */
+    if (WakeTimer) Status = STATUS_TIMER_RESUME_IGNORED;
+
+    /* Check status */
+    if (NT_SUCCESS(Status))
+    {
+        /* Lock the Timer */
+        KeAcquireSpinLock(&Timer->Lock, &OldIrql);
+
+        /* Cancel Running Timer */
+        if (Timer->ApcAssociated)
+        {
+            /* Get the Thread. */
+            TimerThread = CONTAINING_RECORD(Timer->TimerApc.Thread,
+                                            ETHREAD,
+                                            Tcb);
+
+            /* Lock its active list */
+            KeAcquireSpinLockAtDpcLevel(&TimerThread->ActiveTimerListLock);
+
+            /* Remove it */
+            RemoveEntryList(&Timer->ActiveTimerListEntry);
+            Timer->ApcAssociated = FALSE;
+
+            /* Unlock the list */
+            KeReleaseSpinLockFromDpcLevel(&TimerThread->ActiveTimerListLock);
+
+            /* Cancel the Timer */
+            KeCancelTimer(&Timer->KeTimer);
+            KeRemoveQueueDpc(&Timer->TimerDpc);
+            if (KeRemoveQueueApc(&Timer->TimerApc)) DerefsToDo++;
+            DerefsToDo++;
+        }
+        else
+        {
+            /*
+             * If timer was disabled, we still need to cancel it. A high
+             * resolution timer may still have its DPC queued, which would
+             * let go of the clock rate for the new due time.
+             */
+            KeCancelTimer(&Timer->KeTimer);
+            KeRemoveQueueDpc(&Timer->TimerDpc);
+        }
+
+        /* Read the State */
+        State = KeReadStateTimer(&Timer->KeTimer);
+
+        /* Handle Wake Timers */
+        Timer->WakeTimer = WakeTimer;
+        KeAcquireSpinLockAtDpcLevel(&ExpWakeListLock);
+        if ((WakeTimer) && !(Timer->WakeTimerListEntry.Flink))
+        {
+            /* Insert it into the list */
+            InsertTailList(&ExpWakeList, &Timer->WakeTimerListEntry);
+        }
+        else if (!(WakeTimer) && (Timer->WakeTimerListEntry.Flink))
+        {
+            /* Remove it from the list */
+            RemoveEntryList(&Timer->WakeTimerListEntry);
+            Timer->WakeTimerListEntry.Flink = NULL;
+        }
+        KeReleaseSpinLockFromDpcLevel(&ExpWakeListLock);
+
+        /* Set up the APC Routine if specified */
+        Timer->Period = Period;
+        if (TimerApcRoutine)
+        {
+            /* Initialize the APC */
+            KeInitializeApc(&Timer->TimerApc,
+                            &Thread->Tcb,
+                            CurrentApcEnvironment,
+                            ExpTimerApcKernelRoutine,
+                            (PKRUNDOWN_ROUTINE)NULL,
+                            (PKNORMAL_ROUTINE)TimerApcRoutine,
+                            PreviousMode,
+                            TimerContext);
+
+            /* Lock the Thread's Active List and Insert */
+            KeAcquireSpinLockAtDpcLevel(&Thread->ActiveTimerListLock);
+            InsertTailList(&Thread->ActiveTimerListHead,
+                           &Timer->ActiveTimerListEntry);
+            Timer->ApcAssociated = TRUE;
+            KeReleaseSpinLockFromDpcLevel(&Thread->ActiveTimerListLock);
+
+            /* One less dereference to do */
+            DerefsToDo--;
+         }
+
+        /*
+         * A high resolution timer holds the clock at its fastest rate while
+         * it is armed, and is never coalesced. Its DPC is always queued, so
+         * that it can let go of the clock rate once it expired.
+         */
+        RaiseResolution = ExpActivateHighResolution(Timer);
+        if (Timer->HighResolution) TolerableDelay = 0;
+
+        /* Enable and Set the Timer */
+        KeSetCoalescableTimer(&Timer->KeTimer,
+                              TimerDueTime,
+                              Period,
+                              TolerableDelay,
+                              (TimerApcRoutine || Timer->HighResolutionActive) ?
+                              &Timer->TimerDpc : NULL);
+
+        /* Unlock the Timer */
+        KeReleaseSpinLock(&Timer->Lock, OldIrql);
+
+        /* Raise the clock rate now if this is the first armed timer */
+        if (RaiseResolution) ExpUpdateTimerResolution();
+
+        /* Dereference if it was previously enabled */
+        if (DerefsToDo) ObDereferenceObjectEx(Timer, DerefsToDo);
+
+        /* Check if we need to return the State */
+        if (PreviousState)
+        {
+            /* Enter SEH */
+            _SEH2_TRY
+            {
+                /* Return the Timer State */
+                *PreviousState = State;
+            }
+            _SEH2_EXCEPT(ExSystemExceptionFilter())
+            {
+                /* Do nothing */
+                (void)0;
+            }
+            _SEH2_END;
+        }
+    }
+
+    /* Return to Caller */
+    return Status;
+}
+
 CODE_SEG("INIT")
 BOOLEAN
 NTAPI
@@ -242,6 +490,10 @@ ExpInitializeTimerImplementation(VOID)
     /* Initialize the Wait List and Lock */
     KeInitializeSpinLock(&ExpWakeListLock);
     InitializeListHead(&ExpWakeList);
+
+    /* Initialize the high resolution timer tracking */
+    KeInitializeGuardedMutex(&ExpTimerResolutionLock);
+    ExInitializeWorkItem(&ExpTimerResolutionWorkItem, ExpTimerResolutionWorker, NULL);
     return TRUE;
 }
 
@@ -319,6 +571,9 @@ NtCancelTimer(IN HANDLE TimerHandle,
             KeCancelTimer(&Timer->KeTimer);
         }
 
+        /* Stop holding the clock rate for it */
+        ExpDeactivateHighResolution(Timer);
+
         /* Handle a Wake Timer */
         if (Timer->WakeTimerListEntry.Flink)
         {
@@ -427,6 +682,8 @@ NtCreateTimer(OUT PHANDLE TimerHandle,
         Timer->ApcAssociated = FALSE;
         Timer->WakeTimer = FALSE;
         Timer->WakeTimerListEntry.Flink = NULL;
+        Timer->HighResolution = FALSE;
+        Timer->HighResolutionActive = FALSE;
 
         /* Insert the Timer */
         Status = ObInsertObject((PVOID)Timer,
@@ -587,15 +844,8 @@ NtSetTimer(IN HANDLE TimerHandle,
            IN LONG Period OPTIONAL,
            OUT PBOOLEAN PreviousState OPTIONAL)
 {
-    PETIMER Timer;
-    KIRQL OldIrql;
-    BOOLEAN State;
     KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
-    PETHREAD Thread = PsGetCurrentThread();
     LARGE_INTEGER TimerDueTime;
-    PETHREAD TimerThread;
-    ULONG DerefsToDo = 1;
-    NTSTATUS Status = STATUS_SUCCESS;
     PAGED_CODE();
 
     /* Check for a valid Period */
@@ -625,132 +875,129 @@ NtSetTimer(IN HANDLE TimerHandle,
         TimerDueTime = *DueTime;
     }
 
-    /* Get the Timer Object */
-    Status = ObReferenceObjectByHandle(TimerHandle,
-                                       TIMER_MODIFY_STATE,
-                                       ExTimerType,
-                                       PreviousMode,
-                                       (PVOID*)&Timer,
-                                       NULL);
+    /* Set the timer, without any tolerable delay */
+    return ExpSetTimer(TimerHandle,
+                       TimerDueTime,
+                       TimerApcRoutine,
+                       TimerContext,
+                       WakeTimer,
+                       Period,
+                       0,
+                       PreviousState,
+                       PreviousMode);
+}
 
-    /*
-     * Tell the user we don't support Wake Timers...
-     * when we have the ability to use/detect the Power Management
-     * functionality required to support them, make this check dependent
-     * on the actual PM capabilities
-     */
-    if (WakeTimer) Status = STATUS_TIMER_RESUME_IGNORED;
+NTSTATUS
+NTAPI
+NtSetTimerEx(IN HANDLE TimerHandle,
+             IN TIMER_SET_INFORMATION_CLASS TimerSetInformationClass,
+             IN OUT PVOID TimerSetInformation OPTIONAL,
+             IN ULONG TimerSetInformationLength)
+{
+    TIMER_SET_COALESCABLE_TIMER_INFO TimerInfo;
+    KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
+    BOOLEAN HighResolution;
+    PETIMER Timer;
+    KIRQL OldIrql;
+    NTSTATUS Status;
+    PAGED_CODE();
 
-    /* Check status */
-    if (NT_SUCCESS(Status))
+    switch (TimerSetInformationClass)
     {
-        /* Lock the Timer */
-        KeAcquireSpinLock(&Timer->Lock, &OldIrql);
+        case TimerSetCoalescableTimer:
 
-        /* Cancel Running Timer */
-        if (Timer->ApcAssociated)
-        {
-            /* Get the Thread. */
-            TimerThread = CONTAINING_RECORD(Timer->TimerApc.Thread,
-                                            ETHREAD,
-                                            Tcb);
-
-            /* Lock its active list */
-            KeAcquireSpinLockAtDpcLevel(&TimerThread->ActiveTimerListLock);
-
-            /* Remove it */
-            RemoveEntryList(&Timer->ActiveTimerListEntry);
-            Timer->ApcAssociated = FALSE;
-
-            /* Unlock the list */
-            KeReleaseSpinLockFromDpcLevel(&TimerThread->ActiveTimerListLock);
-
-            /* Cancel the Timer */
-            KeCancelTimer(&Timer->KeTimer);
-            KeRemoveQueueDpc(&Timer->TimerDpc);
-            if (KeRemoveQueueApc(&Timer->TimerApc)) DerefsToDo++;
-            DerefsToDo++;
-        }
-        else
-        {
-            /* If timer was disabled, we still need to cancel it */
-            KeCancelTimer(&Timer->KeTimer);
-        }
-
-        /* Read the State */
-        State = KeReadStateTimer(&Timer->KeTimer);
-
-        /* Handle Wake Timers */
-        Timer->WakeTimer = WakeTimer;
-        KeAcquireSpinLockAtDpcLevel(&ExpWakeListLock);
-        if ((WakeTimer) && !(Timer->WakeTimerListEntry.Flink))
-        {
-            /* Insert it into the list */
-            InsertTailList(&ExpWakeList, &Timer->WakeTimerListEntry);
-        }
-        else if (!(WakeTimer) && (Timer->WakeTimerListEntry.Flink))
-        {
-            /* Remove it from the list */
-            RemoveEntryList(&Timer->WakeTimerListEntry);
-            Timer->WakeTimerListEntry.Flink = NULL;
-        }
-        KeReleaseSpinLockFromDpcLevel(&ExpWakeListLock);
-
-        /* Set up the APC Routine if specified */
-        Timer->Period = Period;
-        if (TimerApcRoutine)
-        {
-            /* Initialize the APC */
-            KeInitializeApc(&Timer->TimerApc,
-                            &Thread->Tcb,
-                            CurrentApcEnvironment,
-                            ExpTimerApcKernelRoutine,
-                            (PKRUNDOWN_ROUTINE)NULL,
-                            (PKNORMAL_ROUTINE)TimerApcRoutine,
-                            PreviousMode,
-                            TimerContext);
+            /* Check the buffer size */
+            if (TimerSetInformationLength != sizeof(TIMER_SET_COALESCABLE_TIMER_INFO))
+            {
+                return STATUS_INFO_LENGTH_MISMATCH;
+            }
 
-            /* Lock the Thread's Active List and Insert */
-            KeAcquireSpinLockAtDpcLevel(&Thread->ActiveTimerListLock);
-            InsertTailList(&Thread->ActiveTimerListHead,
-                           &Timer->ActiveTimerListEntry);
-            Timer->ApcAssociated = TRUE;
-            KeReleaseSpinLockFromDpcLevel(&Thread->ActiveTimerListLock);
+            /* Capture the information, probing it if needed */
+            _SEH2_TRY
+            {
+                if (PreviousMode != KernelMode)
+                {
+                    ProbeForRead(TimerSetInformation,
+                                 sizeof(TIMER_SET_COALESCABLE_TIMER_INFO),
+                                 sizeof(ULONG));
+                }
+                TimerInfo = *(PTIMER_SET_COALESCABLE_TIMER_INFO)TimerSetInformation;
+                if ((PreviousMode != KernelMode) && (TimerInfo.PreviousState))
+                {
+                    ProbeForWriteBoolean(TimerInfo.PreviousState);
+                }
+            }
+            _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+            {
+                /* Return the exception code */
+                _SEH2_YIELD(return _SEH2_GetExceptionCode());
+            }
+            _SEH2_END;
 
-            /* One less dereference to do */
-            DerefsToDo--;
-         }
+            /* The period has the same limit as for NtSetTimer */
+            if ((LONG)TimerInfo.Period < 0) return STATUS_INVALID_PARAMETER;
 
-        /* Enable and Set the Timer */
-        KeSetTimerEx(&Timer->KeTimer,
-                     TimerDueTime,
-                     Period,
-                     TimerApcRoutine ? &Timer->TimerDpc : NULL);
+            /* Set the timer, a wake context making it a wake timer */
+            return ExpSetTimer(TimerHandle,
+                               TimerInfo.DueTime,
+                               TimerInfo.TimerApcRoutine,
+                               TimerInfo.TimerContext,
+                               TimerInfo.WakeContext != NULL,
+                               TimerInfo.Period,
+                               TimerInfo.TolerableDelay,
+                               TimerInfo.PreviousState,
+                               PreviousMode);
 
-        /* Unlock the Timer */
-        KeReleaseSpinLock(&Timer->Lock, OldIrql);
+        case TimerSetHighResolution:
 
-        /* Dereference if it was previously enabled */
-        if (DerefsToDo) ObDereferenceObjectEx(Timer, DerefsToDo);
+            /* Check the buffer size */
+            if (TimerSetInformationLength != sizeof(BOOLEAN))
+            {
+                return STATUS_INFO_LENGTH_MISMATCH;
+            }
 
-        /* Check if we need to return the State */
-        if (PreviousState)
-        {
-            /* Enter SEH */
+            /* Capture the setting, probing it if needed */
             _SEH2_TRY
             {
-                /* Return the Timer State */
-                *PreviousState = State;
+                if (PreviousMode != KernelMode)
+                {
+                    ProbeForRead(TimerSetInformation, sizeof(BOOLEAN), sizeof(BOOLEAN));
+                }
+                HighResolution = *(PBOOLEAN)TimerSetInformation;
             }
-            _SEH2_EXCEPT(ExSystemExceptionFilter())
+            _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
             {
-                /* Do nothing */
-                (void)0;
+                /* Return the exception code */
+                _SEH2_YIELD(return _SEH2_GetExceptionCode());
             }
             _SEH2_END;
-        }
-    }
 
-    /* Return to Caller */
-    return Status;
+            /* Get the Timer Object */
+            Status = ObReferenceObjectByHandle(TimerHandle,
+                                               TIMER_MODIFY_STATE,
+                                               ExTimerType,
+                                               PreviousMode,
+                                               (PVOID*)&Timer,
+                                               NULL);
+            if (!NT_SUCCESS(Status)) return Status;
+
+            /*
+             * Change the setting. It applies the next time the timer is set,
+             * but a timer that is no longer high resolution lets go of the
+             * clock rate right away.
+             */
+            KeAcquireSpinLock(&Timer->Lock, &OldIrql);
+            Timer->HighResolution = (HighResolution != FALSE);
+            if (!HighResolution) ExpDeactivateHighResolution(Timer);
+            KeReleaseSpinLock(&Timer->Lock, OldIrql);
+
+            /* Dereference the Object */
+            ObDereferenceObject(Timer);
+            return STATUS_SUCCESS;
+
+        default:
+
+            /* Unsupported class */
+            return STATUS_INVALID_INFO_CLASS;
+    }
 }
@@ -19,17 +19,48 @@
 #define EX_DELAYED_WORK_THREADS                     3
 #define EX_CRITICAL_WORK_THREADS                    5
 
-/* Magic flag for dynamic worker threads */
+/* Magic flag for dynamic worker threads, and where the node is in the context */
 #define EX_DYNAMIC_WORK_THREAD                      0x80000000
+#define EX_WORK_THREAD_NODE_SHIFT                   8
+#define EX_WORK_THREAD_QUEUE_MASK                   0xFF
+
+/* Most dynamic threads a queue can have */
+#define EX_MAXIMUM_DYNAMIC_THREADS                  16
+
+/* Dynamic threads check every 30 seconds whether they are still needed */
+#define EX_DYNAMIC_THREAD_TIMEOUT                   30
+
+/* Balance manager passes with work pending before adding a thread */
+#define EX_WORK_QUEUE_GROW_PASSES                   2
+
+/* Balance manager passes without work pending before retiring threads */
+#define EX_WORK_QUEUE_SHRINK_PASSES                 30
 
 /* Worker thread priority increments (added to base priority) */
 #define EX_HYPERCRITICAL_QUEUE_PRIORITY_INCREMENT   7
 #define EX_CRITICAL_QUEUE_PRIORITY_INCREMENT        5
 #define EX_DELAYED_QUEUE_PRIORITY_INCREMENT         4
 
-/* The actual worker queue array */
+/* The actual worker queue array, for the first node */
 EX_WORK_QUEUE ExWorkerQueue[MaximumWorkQueue];
 
+/* Worker queues of the other nodes, and the queues each node uses */
+EX_WORK_QUEUE ExpNodeWorkerQueue[MAXIMUM_NUMA_NODES - 1][MaximumWorkQueue];
+PEX_WORK_QUEUE ExpWorkerQueueByNode[MAXIMUM_NUMA_NODES] = { ExWorkerQueue };
+ULONG ExpNumberOfWorkerNodes;
+
+/* Counters kept by the balance manager for each queue */
+typedef struct _EX_WORK_QUEUE_STATISTICS
+{
+    ULONG WorkItemsQueued;
+    ULONG WorkItemsStolen;
+    ULONG BusyPasses;
+    ULONG IdlePasses;
+    ULONGLONG WaitTime;
+} EX_WORK_QUEUE_STATISTICS, *PEX_WORK_QUEUE_STATISTICS;
+
+EX_WORK_QUEUE_STATISTICS ExpWorkQueueStatistics[MAXIMUM_NUMA_NODES][MaximumWorkQueue];
+
 /* Accounting of the total threads and registry hacked threads */
 ULONG ExCriticalWorkerThreads;
 ULONG ExDelayedWorkerThreads;
@@ -51,6 +82,67 @@ PETHREAD ExpLastWorkerThread;
 
 /* PRIVATE FUNCTIONS *********************************************************/
 
+/*++
+ * @name ExpStealWorkItem
+ *
+ *     The ExpStealWorkItem routine takes a work item from the queue of the
+ *     same type on another node, when that node is falling behind.
+ *
+ * @param WorkQueueType
+ *        Type of the queue to steal from.
+ *
+ * @param Node
+ *        Node of the calling worker thread, whose own queue is empty.
+ *
+ * @param WaitMode
+ *        Wait mode of the calling worker thread.
+ *
+ * @param ItemNode
+ *        Receives the node the work item was taken from.
+ *
+ * @return The work item list entry, or NULL if no other node had work.
+ *
+ * @remarks Items are only left on a queue when none of its threads can take
+ *          them, so anything found here is work that node is not keeping up
+ *          with. The remote queue is only probed, never waited on.
+ *
+ *--*/
+PLIST_ENTRY
+NTAPI
+ExpStealWorkItem(IN WORK_QUEUE_TYPE WorkQueueType,
+                 IN ULONG Node,
+                 IN KPROCESSOR_MODE WaitMode,
+                 OUT PULONG ItemNode)
+{
+    PEX_WORK_QUEUE WorkQueue;
+    PLIST_ENTRY QueueEntry;
+    LARGE_INTEGER Timeout;
+    ULONG i, Victim;
+
+    /* Try the other nodes, starting with the next one */
+    Timeout.QuadPart = 0;
+    for (i = 1; i < KeNumberNodes; i++)
+    {
+        /* Skip nodes without their own queues, and empty queues */
+        Victim = (Node + i) % KeNumberNodes;
+        if ((Victim > 0) && (ExpWorkerQueueByNode[Victim] == ExWorkerQueue)) continue;
+        WorkQueue = &ExpWorkerQueueByNode[Victim][WorkQueueType];
+        if (!KeReadStateQueue(&WorkQueue->WorkerQueue)) continue;
+
+        /* Try to grab an item, someone else might have been faster */
+        QueueEntry = KeRemoveQueue(&WorkQueue->WorkerQueue, WaitMode, &Timeout);
+        if ((NTSTATUS)(ULONG_PTR)QueueEntry == STATUS_TIMEOUT) continue;
+
+        /* Got one */
+        InterlockedIncrement((PLONG)&ExpWorkQueueStatistics[Victim][WorkQueueType].WorkItemsStolen);
+        *ItemNode = Victim;
+        return QueueEntry;
+    }
+
+    /* Everyone is keeping up */
+    return NULL;
+}
+
 /*++
  * @name ExpWorkerThreadEntryPoint
  *
@@ -58,13 +150,17 @@ PETHREAD ExpLastWorkerThread;
  *     worker thread created by teh system.
  *
  * @param Context
- *        Contains the work queue type masked with a flag specifing whether the
- *        thread is dynamic or not.
+ *        Contains the work queue type and node masked with a flag specifing
+ *        whether the thread is dynamic or not.
  *
  * @return None.
  *
- * @remarks A dynamic thread can timeout after 10 minutes of waiting on a queue
- *          while a static thread will never timeout.
+ * @remarks A dynamic thread exits once it has been waiting for work while the
+ *          balance manager saw its queue empty for a while, a static thread
+ *          never does.
+ *
+ *          When its own queue is empty, a worker first helps the other nodes
+ *          with their backlog before waiting.
  *
  *          Worker threads must return at IRQL == PASSIVE_LEVEL, must not have
  *          active impersonation info, and must not have disabled APCs.
@@ -86,19 +182,22 @@ ExpWorkerThreadEntryPoint(IN PVOID Context)
     PETHREAD Thread = PsGetCurrentThread();
     KPROCESSOR_MODE WaitMode;
     EX_QUEUE_WORKER_INFO OldValue, NewValue;
+    ULONG Node, ItemNode;
 
     /* Check if this is a dyamic thread */
     if ((ULONG_PTR)Context & EX_DYNAMIC_WORK_THREAD)
     {
-        /* It is, which means we will eventually time out after 10 minutes */
-        Timeout.QuadPart = Int32x32To64(10, -10000000 * 60);
+        /* It is, which means we will periodically check if we're needed */
+        Timeout.QuadPart = Int32x32To64(EX_DYNAMIC_THREAD_TIMEOUT, -10000000);
         TimeoutPointer = &Timeout;
     }
 
-    /* Get Queue Type and Worker Queue */
+    /* Get Queue Type, Node and Worker Queue */
     WorkQueueType = (WORK_QUEUE_TYPE)((ULONG_PTR)Context &
-                                      ~EX_DYNAMIC_WORK_THREAD);
-    WorkQueue = &ExWorkerQueue[WorkQueueType];
+                                      EX_WORK_THREAD_QUEUE_MASK);
+    Node = ((ULONG_PTR)Context & ~EX_DYNAMIC_WORK_THREAD) >>
+           EX_WORK_THREAD_NODE_SHIFT;
+    WorkQueue = &ExpWorkerQueueByNode[Node][WorkQueueType];
 
     /* Select the wait mode */
     WaitMode = (UCHAR)WorkQueue->Info.WaitMode;
@@ -137,16 +236,39 @@ ExpWorkerThreadEntryPoint(IN PVOID Context)
 ProcessLoop:
     for (;;)
     {
-        /* Wait for something to happen on the queue */
-        QueueEntry = KeRemoveQueue(&WorkQueue->WorkerQueue,
-                                   WaitMode,
-                                   TimeoutPointer);
+        /* If there's nothing to do here, help the other nodes first */
+        QueueEntry = NULL;
+        ItemNode = Node;
+        if ((ExpNumberOfWorkerNodes > 1) &&
+            !(KeReadStateQueue(&WorkQueue->WorkerQueue)))
+        {
+            QueueEntry = ExpStealWorkItem(WorkQueueType, Node, WaitMode, &ItemNode);
+        }
 
-        /* Check if we timed out and quit this loop in that case */
-        if ((NTSTATUS)(ULONG_PTR)QueueEntry == STATUS_TIMEOUT) break;
+        if (!QueueEntry)
+        {
+            /* Wait for something to happen on the queue */
+            QueueEntry = KeRemoveQueue(&WorkQueue->WorkerQueue,
+                                       WaitMode,
+                                       TimeoutPointer);
+
+            /* Check if we timed out */
+            if ((NTSTATUS)(ULONG_PTR)QueueEntry == STATUS_TIMEOUT)
+            {
+                /* Quit this loop if the queue has been idle for a while */
+                if (ExpWorkQueueStatistics[Node][WorkQueueType].IdlePasses >=
+                    EX_WORK_QUEUE_SHRINK_PASSES)
+                {
+                    break;
+                }
+
+                /* Otherwise there's still enough work around, keep waiting */
+                continue;
+            }
+        }
 
         /* Increment Processed Work Items */
-        InterlockedIncrement((PLONG)&WorkQueue->WorkItemsProcessed);
+        InterlockedIncrement((PLONG)&ExpWorkerQueueByNode[ItemNode][WorkQueueType].WorkItemsProcessed);
 
         /* Get the Work Item */
         WorkItem = CONTAINING_RECORD(QueueEntry, WORK_QUEUE_ITEM, List);
@@ -234,6 +356,10 @@ ProcessLoop:
  *          - CriticalWorkQueue
  *          - HyperCriticalWorkQueue
  *
+ * @param Node
+ *        Node whose queue the thread serves. The thread only runs on the
+ *        processors of that node.
+ *
  * @param Dynamic
  *        Specifies whether or not this thread is a dynamic thread.
  *
@@ -248,6 +374,7 @@ ProcessLoop:
 VOID
 NTAPI
 ExpCreateWorkerThread(WORK_QUEUE_TYPE WorkQueueType,
+                      IN ULONG Node,
                       IN BOOLEAN Dynamic)
 {
     PETHREAD Thread;
@@ -256,7 +383,7 @@ ExpCreateWorkerThread(WORK_QUEUE_TYPE WorkQueueType,
     KPRIORITY Priority;
 
     /* Check if this is going to be a dynamic thread */
-    Context = WorkQueueType;
+    Context = WorkQueueType | (Node << EX_WORK_THREAD_NODE_SHIFT);
 
     /* Add the dynamic mask */
     if (Dynamic) Context |= EX_DYNAMIC_WORK_THREAD;
@@ -274,7 +401,7 @@ ExpCreateWorkerThread(WORK_QUEUE_TYPE WorkQueueType,
     if (Dynamic)
     {
         /* Increase the count */
-        InterlockedIncrement(&ExWorkerQueue[WorkQueueType].DynamicThreadCount);
+        InterlockedIncrement(&ExpWorkerQueueByNode[Node][WorkQueueType].DynamicThreadCount);
     }
 
     /* Set the priority */
@@ -305,6 +432,12 @@ ExpCreateWorkerThread(WORK_QUEUE_TYPE WorkQueueType,
     /* Set the Priority */
     KeSetBasePriorityThread(&Thread->Tcb, Priority);
 
+    /* Keep the thread on its node, close to the work it gets queued */
+    if (ExpNumberOfWorkerNodes > 1)
+    {
+        KeSetAffinityThread(&Thread->Tcb, KeNodeBlock[Node]->ProcessorMask);
+    }
+
     /* Dereference and close handle */
     ObDereferenceObject(Thread);
     ObCloseHandle(hThread, KernelMode);
@@ -314,7 +447,8 @@ ExpCreateWorkerThread(WORK_QUEUE_TYPE WorkQueueType,
  * @name ExpDetectWorkerThreadDeadlock
  *
  *     The ExpDetectWorkerThreadDeadlock routine checks every queue and creates
- *     a dynamic thread if the queue seems to be deadlocked.
+ *     a dynamic thread if the queue seems to be deadlocked, or if it does not
+ *     keep up with the work it gets.
  *
  * @param None
  *
@@ -324,35 +458,79 @@ ExpCreateWorkerThread(WORK_QUEUE_TYPE WorkQueueType,
  *          on whether the queue has processed no new items in the last second,
  *          and new items are still enqueued.
  *
+ *          The queue depth is also sampled on every pass. A queue that still
+ *          has work pending after several passes gets another dynamic thread,
+ *          and one that stayed empty lets its dynamic threads exit. The depth
+ *          samples also give the wait time counter, since the work pending at
+ *          each pass has waited for (about) one more pass.
+ *
  *--*/
 VOID
 NTAPI
 ExpDetectWorkerThreadDeadlock(VOID)
 {
-    ULONG i;
+    ULONG i, Node;
     PEX_WORK_QUEUE Queue;
+    PEX_WORK_QUEUE_STATISTICS Statistics;
+    ULONG QueueDepth;
 
-    /* Loop the 3 queues */
-    for (i = 0; i < MaximumWorkQueue; i++)
+    /* Loop the queues of every node */
+    for (Node = 0; Node < KeNumberNodes; Node++)
     {
-        /* Get the queue */
-        Queue = &ExWorkerQueue[i];
-        ASSERT(Queue->DynamicThreadCount <= 16);
-
-        /* Check if stuff is on the queue that still is unprocessed */
-        if ((Queue->QueueDepthLastPass) &&
-            (Queue->WorkItemsProcessed == Queue->WorkItemsProcessedLastPass) &&
-            (Queue->DynamicThreadCount < 16))
+        /* Nodes without processors share the queues of the first one */
+        if ((Node > 0) && (ExpWorkerQueueByNode[Node] == ExWorkerQueue)) continue;
+
+        /* Loop the 3 queues */
+        for (i = 0; i < MaximumWorkQueue; i++)
         {
-            /* Stuff is still on the queue and nobody did anything about it */
-            DPRINT1("EX: Work Queue Deadlock detected: %lu\n", i);
-            ExpCreateWorkerThread(i, TRUE);
-            DPRINT1("Dynamic threads queued %d\n", Queue->DynamicThreadCount);
-        }
+            /* Get the queue */
+            Queue = &ExpWorkerQueueByNode[Node][i];
+            Statistics = &ExpWorkQueueStatistics[Node][i];
+            ASSERT(Queue->DynamicThreadCount <= EX_MAXIMUM_DYNAMIC_THREADS);
+
+            /* Check if stuff is on the queue that still is unprocessed */
+            if ((Queue->QueueDepthLastPass) &&
+                (Queue->WorkItemsProcessed == Queue->WorkItemsProcessedLastPass) &&
+                (Queue->DynamicThreadCount < EX_MAXIMUM_DYNAMIC_THREADS))
+            {
+                /* Stuff is still on the queue and nobody did anything about it */
+                DPRINT1("EX: Work Queue Deadlock detected: %lu\n", i);
+                ExpCreateWorkerThread(i, Node, TRUE);
+                DPRINT1("Dynamic threads queued %d\n", Queue->DynamicThreadCount);
+            }
 
-        /* Update our data */
-        Queue->WorkItemsProcessedLastPass = Queue->WorkItemsProcessed;
-        Queue->QueueDepthLastPass = KeReadStateQueue(&Queue->WorkerQueue);
+            /* Sample the queue depth and account for the time spent waiting */
+            QueueDepth = KeReadStateQueue(&Queue->WorkerQueue);
+            Statistics->WaitTime += (ULONGLONG)QueueDepth * 10000000;
+            if (QueueDepth)
+            {
+                /* Work was pending */
+                Statistics->IdlePasses = 0;
+                Statistics->BusyPasses++;
+
+                /* Check if the queue keeps falling behind though it's moving */
+                if ((Queue->Info.MakeThreadsAsNecessary) &&
+                    (Statistics->BusyPasses >= EX_WORK_QUEUE_GROW_PASSES) &&
+                    (Queue->WorkItemsProcessed != Queue->WorkItemsProcessedLastPass) &&
+                    (Queue->DynamicThreadCount < EX_MAXIMUM_DYNAMIC_THREADS))
+                {
+                    /* Give it another thread, and see how it goes */
+                    DPRINT("EX: Growing work queue %lu on node %lu\n", i, Node);
+                    ExpCreateWorkerThread(i, Node, TRUE);
+                    Statistics->BusyPasses = 0;
+                }
+            }
+            else
+            {
+                /* Nothing pending, the dynamic threads will notice */
+                Statistics->BusyPasses = 0;
+                if (Statistics->IdlePasses < MAXULONG) Statistics->IdlePasses++;
+            }
+
+            /* Update our data */
+            Queue->WorkItemsProcessedLastPass = Queue->WorkItemsProcessed;
+            Queue->QueueDepthLastPass = QueueDepth;
+        }
     }
 }
 
@@ -374,25 +552,32 @@ VOID
 NTAPI
 ExpCheckDynamicThreadCount(VOID)
 {
-    ULONG i;
+    ULONG i, Node;
     PEX_WORK_QUEUE Queue;
 
-    /* Loop the 3 queues */
-    for (i = 0; i < MaximumWorkQueue; i++)
+    /* Loop the queues of every node */
+    for (Node = 0; Node < KeNumberNodes; Node++)
     {
-        /* Get the queue */
-        Queue = &ExWorkerQueue[i];
-
-        /* Check if still need a new thread. See ExQueueWorkItem */
-        if ((Queue->Info.MakeThreadsAsNecessary) &&
-            (!IsListEmpty(&Queue->WorkerQueue.EntryListHead)) &&
-            (Queue->WorkerQueue.CurrentCount <
-             Queue->WorkerQueue.MaximumCount) &&
-            (Queue->DynamicThreadCount < 16))
+        /* Nodes without processors share the queues of the first one */
+        if ((Node > 0) && (ExpWorkerQueueByNode[Node] == ExWorkerQueue)) continue;
+
+        /* Loop the 3 queues */
+        for (i = 0; i < MaximumWorkQueue; i++)
         {
-            /* Create a new thread */
-            DPRINT1("EX: Creating new dynamic thread as requested\n");
-            ExpCreateWorkerThread(i, TRUE);
+            /* Get the queue */
+            Queue = &ExpWorkerQueueByNode[Node][i];
+
+            /* Check if still need a new thread. See ExQueueWorkItem */
+            if ((Queue->Info.MakeThreadsAsNecessary) &&
+                (!IsListEmpty(&Queue->WorkerQueue.EntryListHead)) &&
+                (Queue->WorkerQueue.CurrentCount <
+                 Queue->WorkerQueue.MaximumCount) &&
+                (Queue->DynamicThreadCount < EX_MAXIMUM_DYNAMIC_THREADS))
+            {
+                /* Create a new thread */
+                DPRINT1("EX: Creating new dynamic thread as requested\n");
+                ExpCreateWorkerThread(i, Node, TRUE);
+            }
         }
     }
 }
@@ -508,6 +693,10 @@ ExpWorkerThreadBalanceManager(IN PVOID Context)
  *
  * @remarks This routine is only called once during system initialization.
  *
+ *          On NUMA systems, every node that has processors gets its own set
+ *          of queues and worker threads, so that work is queued and run on
+ *          the node it came from.
+ *
  *--*/
 CODE_SEG("INIT")
 VOID
@@ -518,7 +707,8 @@ ExpInitializeWorkerThreads(VOID)
     ULONG CriticalThreads, DelayedThreads;
     HANDLE ThreadHandle;
     PETHREAD Thread;
-    ULONG i;
+    PEX_WORK_QUEUE WorkQueue;
+    ULONG i, Node;
 
     /* Setup the stack swap support */
     ExInitializeFastMutex(&ExpWorkerSwapinMutex);
@@ -539,16 +729,39 @@ ExpInitializeWorkerThreads(VOID)
     DelayedThreads += ExpAdditionalDelayedWorkerThreads;
     CriticalThreads += ExpAdditionalCriticalWorkerThreads;
 
-    /* Initialize the Array */
-    for (WorkQueueType = 0; WorkQueueType < MaximumWorkQueue; WorkQueueType++)
+    /* Give every node with processors its own queues */
+    for (Node = 0; Node < KeNumberNodes; Node++)
     {
-        /* Clear the structure and initialize the queue */
-        RtlZeroMemory(&ExWorkerQueue[WorkQueueType], sizeof(EX_WORK_QUEUE));
-        KeInitializeQueue(&ExWorkerQueue[WorkQueueType].WorkerQueue, 0);
-    }
+        /* The first node uses the well-known array */
+        if (Node == 0)
+        {
+            WorkQueue = ExWorkerQueue;
+        }
+        else if (KeNodeBlock[Node]->ProcessorMask)
+        {
+            WorkQueue = ExpNodeWorkerQueue[Node - 1];
+        }
+        else
+        {
+            /* Nobody can queue work from here, share the first node's */
+            ExpWorkerQueueByNode[Node] = ExWorkerQueue;
+            continue;
+        }
+        ExpWorkerQueueByNode[Node] = WorkQueue;
+        ExpNumberOfWorkerNodes++;
+
+        /* Initialize the Array */
+        for (WorkQueueType = 0; WorkQueueType < MaximumWorkQueue; WorkQueueType++)
+        {
+            /* Clear the structure and initialize the queue */
+            RtlZeroMemory(&WorkQueue[WorkQueueType], sizeof(EX_WORK_QUEUE));
+            KeInitializeQueue(&WorkQueue[WorkQueueType].WorkerQueue, 0);
+        }
 
-    /* Dynamic threads are only used for the critical queue */
-    ExWorkerQueue[CriticalWorkQueue].Info.MakeThreadsAsNecessary = TRUE;
+        /* Dynamic threads are used for the critical and delayed queues */
+        WorkQueue[CriticalWorkQueue].Info.MakeThreadsAsNecessary = TRUE;
+        WorkQueue[DelayedWorkQueue].Info.MakeThreadsAsNecessary = TRUE;
+    }
 
     /* Initialize the balance set manager events */
     KeInitializeEvent(&ExpThreadSetManagerEvent, SynchronizationEvent, FALSE);
@@ -556,24 +769,31 @@ ExpInitializeWorkerThreads(VOID)
                       NotificationEvent,
                       FALSE);
 
-    /* Create the built-in worker threads for the critical queue */
-    for (i = 0; i < CriticalThreads; i++)
+    /* Create the built-in worker threads of every node */
+    for (Node = 0; Node < KeNumberNodes; Node++)
     {
-        /* Create the thread */
-        ExpCreateWorkerThread(CriticalWorkQueue, FALSE);
-        ExCriticalWorkerThreads++;
-    }
+        /* Skip nodes sharing the queues of the first one */
+        if ((Node > 0) && (ExpWorkerQueueByNode[Node] == ExWorkerQueue)) continue;
 
-    /* Create the built-in worker threads for the delayed queue */
-    for (i = 0; i < DelayedThreads; i++)
-    {
-        /* Create the thread */
-        ExpCreateWorkerThread(DelayedWorkQueue, FALSE);
-        ExDelayedWorkerThreads++;
-    }
+        /* Create the built-in worker threads for the critical queue */
+        for (i = 0; i < CriticalThreads; i++)
+        {
+            /* Create the thread */
+            ExpCreateWorkerThread(CriticalWorkQueue, Node, FALSE);
+            ExCriticalWorkerThreads++;
+        }
+
+        /* Create the built-in worker threads for the delayed queue */
+        for (i = 0; i < DelayedThreads; i++)
+        {
+            /* Create the thread */
+            ExpCreateWorkerThread(DelayedWorkQueue, Node, FALSE);
+            ExDelayedWorkerThreads++;
+        }
 
-    /* Create the built-in worker thread for the hypercritical queue */
-    ExpCreateWorkerThread(HyperCriticalWorkQueue, FALSE);
+        /* Create the built-in worker thread for the hypercritical queue */
+        ExpCreateWorkerThread(HyperCriticalWorkQueue, Node, FALSE);
+    }
 
     /* Create the balance set manager thread */
     PsCreateSystemThread(&ThreadHandle,
@@ -680,6 +900,80 @@ Next:
     ExReleaseFastMutex(&ExpWorkerSwapinMutex);
 }
 
+/*++
+ * @name ExGetWorkQueueInfo
+ *
+ *     The ExGetWorkQueueInfo routine returns the counters of every work queue,
+ *     for SystemWorkQueueInformation.
+ *
+ * @param SystemInformation
+ *        Buffer receiving the counters.
+ *
+ * @param SystemInformationLength
+ *        Size of the buffer.
+ *
+ * @param ReturnLength
+ *        Optionally receives the size needed for all the queues.
+ *
+ * @return STATUS_SUCCESS, or STATUS_INFO_LENGTH_MISMATCH if the buffer is too
+ *         small for all the queues.
+ *
+ * @remarks WaitTime is the total time, in 100ns units, work items spent on the
+ *          queue as sampled by the balance manager every second. Divide it by
+ *          WorkItemsProcessed for the average wait.
+ *
+ *--*/
+NTSTATUS
+NTAPI
+ExGetWorkQueueInfo(IN PSYSTEM_WORK_QUEUE_INFORMATION SystemInformation,
+                   IN ULONG SystemInformationLength,
+                   IN OUT PULONG ReturnLength OPTIONAL)
+{
+    PSYSTEM_WORK_QUEUE_ENTRY Entry;
+    PEX_WORK_QUEUE Queue;
+    PEX_WORK_QUEUE_STATISTICS Statistics;
+    ULONG Node, i, Count, Length;
+
+    /* Count the queues, nodes without processors share the first node's */
+    for (Node = 0, Count = 0; Node < KeNumberNodes; Node++)
+    {
+        if ((Node > 0) && (ExpWorkerQueueByNode[Node] == ExWorkerQueue)) continue;
+        Count += MaximumWorkQueue;
+    }
+
+    /* Make sure they all fit */
+    Length = FIELD_OFFSET(SYSTEM_WORK_QUEUE_INFORMATION, Queue[Count]);
+    if (ReturnLength) *ReturnLength = Length;
+    if (SystemInformationLength < Length) return STATUS_INFO_LENGTH_MISMATCH;
+
+    /* Copy the counters of every queue */
+    SystemInformation->Count = Count;
+    Entry = SystemInformation->Queue;
+    for (Node = 0; Node < KeNumberNodes; Node++)
+    {
+        if ((Node > 0) && (ExpWorkerQueueByNode[Node] == ExWorkerQueue)) continue;
+
+        for (i = 0; i < MaximumWorkQueue; i++, Entry++)
+        {
+            Queue = &ExpWorkerQueueByNode[Node][i];
+            Statistics = &ExpWorkQueueStatistics[Node][i];
+
+            Entry->NodeNumber = (UCHAR)Node;
+            Entry->QueueType = (UCHAR)i;
+            Entry->Reserved = 0;
+            Entry->WorkerCount = Queue->Info.WorkerCount;
+            Entry->DynamicThreadCount = Queue->DynamicThreadCount;
+            Entry->QueueDepth = KeReadStateQueue(&Queue->WorkerQueue);
+            Entry->WorkItemsQueued = Statistics->WorkItemsQueued;
+            Entry->WorkItemsProcessed = Queue->WorkItemsProcessed;
+            Entry->WorkItemsStolen = Statistics->WorkItemsStolen;
+            Entry->WaitTime = Statistics->WaitTime;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*++
@@ -711,10 +1005,15 @@ NTAPI
 ExQueueWorkItem(IN PWORK_QUEUE_ITEM WorkItem,
                 IN WORK_QUEUE_TYPE QueueType)
 {
-    PEX_WORK_QUEUE WorkQueue = &ExWorkerQueue[QueueType];
+    PEX_WORK_QUEUE WorkQueue;
+    ULONG Node;
     ASSERT(QueueType < MaximumWorkQueue);
     ASSERT(WorkItem->List.Flink == NULL);
 
+    /* Use the queue of the node we're running on */
+    Node = KeGetCurrentPrcb()->ParentNode->NodeNumber;
+    WorkQueue = &ExpWorkerQueueByNode[Node][QueueType];
+
     /* Don't try to trick us */
     if ((ULONG_PTR)WorkItem->WorkerRoutine < MmUserProbeAddress)
     {
@@ -729,6 +1028,7 @@ ExQueueWorkItem(IN PWORK_QUEUE_ITEM WorkItem,
     /* Insert the Queue */
     KeInsertQueue(&WorkQueue->WorkerQueue, &WorkItem->List);
     ASSERT(!WorkQueue->Info.QueueDisabled);
+    InterlockedIncrement((PLONG)&ExpWorkQueueStatistics[Node][QueueType].WorkItemsQueued);
 
     /*
      * Check if we need a new thread. Our decision is as follows:
@@ -741,7 +1041,7 @@ ExQueueWorkItem(IN PWORK_QUEUE_ITEM WorkItem,
         (!IsListEmpty(&WorkQueue->WorkerQueue.EntryListHead)) &&
         (WorkQueue->WorkerQueue.CurrentCount <
          WorkQueue->WorkerQueue.MaximumCount) &&
-        (WorkQueue->DynamicThreadCount < 16))
+        (WorkQueue->DynamicThreadCount < EX_MAXIMUM_DYNAMIC_THREADS))
     {
         /* Let the balance manager know about it */
         DPRINT1("Requesting a new thread. CurrentCount: %lu. MaxCount: %lu\n",
@@ -114,6 +114,26 @@ static RTL_GENERIC_COMPARE_RESULTS NTAPI McbMappingIntersectCompare(PRTL_GENERIC
 }
 
 
+/* Finds the run holding Vbn straight from the tree, NULL for a hole or past the end */
+static
+PLARGE_MCB_MAPPING_ENTRY
+McbLookupMappedRun(PBASE_MCB_INTERNAL Mcb,
+                   LONGLONG Vbn)
+{
+    PLARGE_MCB_MAPPING_ENTRY Run;
+    LARGE_MCB_MAPPING_ENTRY NeedleRun;
+
+    NeedleRun.RunStartVbn.QuadPart = Vbn;
+    NeedleRun.RunEndVbn.QuadPart = Vbn + 1;
+    NeedleRun.StartingLbn.QuadPart = ~0ULL;
+    Mcb->Mapping->Table.CompareRoutine = McbMappingIntersectCompare;
+    Run = RtlLookupElementGenericTable(&Mcb->Mapping->Table, &NeedleRun);
+    Mcb->Mapping->Table.CompareRoutine = McbMappingCompare;
+
+    return Run;
+}
+
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
@@ -138,12 +158,11 @@ FsRtlAddBaseMcbEntry(IN PBASE_MCB OpaqueMcb,
                      IN LONGLONG SectorCount)
 {
     BOOLEAN Result = TRUE;
-    BOOLEAN IntResult;
     PBASE_MCB_INTERNAL Mcb = (PBASE_MCB_INTERNAL)OpaqueMcb;
     LARGE_MCB_MAPPING_ENTRY Node, NeedleRun;
-    PLARGE_MCB_MAPPING_ENTRY LowerRun, HigherRun;
+    PLARGE_MCB_MAPPING_ENTRY LowerRun, HigherRun, ExistingRun;
     BOOLEAN NewElement;
-    LONGLONG IntLbn, IntSectorCount;
+    LONGLONG IntLbn;
 
     DPRINT("FsRtlAddBaseMcbEntry(%p, %I64d, %I64d, %I64d)\n", OpaqueMcb, Vbn, Lbn, SectorCount);
 
@@ -159,16 +178,18 @@ FsRtlAddBaseMcbEntry(IN PBASE_MCB OpaqueMcb,
         goto quit;
     }
 
-    IntResult = FsRtlLookupBaseMcbEntry(OpaqueMcb, Vbn, &IntLbn, &IntSectorCount, NULL, NULL, NULL);
-    if (IntResult)
+    /* Only a mapped run matters here, holes and the end are free to take */
+    ExistingRun = McbLookupMappedRun(Mcb, Vbn);
+    if (ExistingRun)
     {
-        if (IntLbn != -1 && IntLbn != Lbn)
+        IntLbn = ExistingRun->StartingLbn.QuadPart + (Vbn - ExistingRun->RunStartVbn.QuadPart);
+        if (IntLbn != Lbn)
         {
             Result = FALSE;
             goto quit;
         }
 
-        if ((IntLbn != -1) && (IntSectorCount >= SectorCount))
+        if (ExistingRun->RunEndVbn.QuadPart - Vbn >= SectorCount)
         {
             /* This is a no-op */
             goto quit;
@@ -511,38 +532,73 @@ FsRtlLookupBaseMcbEntry(IN PBASE_MCB OpaqueMcb,
     OUT PULONG Index OPTIONAL)
 {
     BOOLEAN Result = FALSE;
-    ULONG i;
-    LONGLONG LastVbn = 0, LastLbn = 0, Count = 0;   // the last values we've found during traversal
+    PBASE_MCB_INTERNAL Mcb = (PBASE_MCB_INTERNAL)OpaqueMcb;
+    PLARGE_MCB_MAPPING_ENTRY Run;
+    ULONG i = 0;
+    LONGLONG LastVbn = 0;   // end of the last run we've found during traversal
 
     DPRINT("FsRtlLookupBaseMcbEntry(%p, %I64d, %p, %p, %p, %p, %p)\n", OpaqueMcb, Vbn, Lbn, SectorCountFromLbn, StartingLbn, SectorCountFromStartingLbn, Index);
 
-    for (i = 0; FsRtlGetNextBaseMcbEntry(OpaqueMcb, i, &LastVbn, &LastLbn, &Count); i++)
+    /* A mapped Vbn doesn't need the run index, which only a traversal gives */
+    if (!Index && (Run = McbLookupMappedRun(Mcb, Vbn)))
     {
-        // have we reached the target mapping?
-        if (Vbn < LastVbn + Count)
+        goto found;
+    }
+
+    /* Holes aren't stored, so count them in while going through the runs once */
+    for (Run = (PLARGE_MCB_MAPPING_ENTRY)RtlEnumerateGenericTable(&Mcb->Mapping->Table, TRUE);
+         Run;
+         Run = (PLARGE_MCB_MAPPING_ENTRY)RtlEnumerateGenericTable(&Mcb->Mapping->Table, FALSE))
+    {
+        // is there a hole before this run?
+        if (Run->RunStartVbn.QuadPart > LastVbn)
         {
-            if (Lbn)
+            if (Vbn < Run->RunStartVbn.QuadPart)
             {
-                if (LastLbn == -1)
+                if (Lbn)
                     *Lbn = -1;
-                else
-                    *Lbn = LastLbn + (Vbn - LastVbn);
+                if (SectorCountFromLbn)
+                    *SectorCountFromLbn = Run->RunStartVbn.QuadPart - Vbn;
+                if (StartingLbn)
+                    *StartingLbn = -1;
+                if (SectorCountFromStartingLbn)
+                    *SectorCountFromStartingLbn = Run->RunStartVbn.QuadPart - LastVbn;
+                if (Index)
+                    *Index = i;
+
+                Result = TRUE;
+                goto quit;
             }
 
-            if (SectorCountFromLbn)
-                *SectorCountFromLbn = LastVbn + Count - Vbn;
-            if (StartingLbn)
-                *StartingLbn = LastLbn;
-            if (SectorCountFromStartingLbn)
-                *SectorCountFromStartingLbn = LastVbn + Count - LastVbn;
-            if (Index)
-                *Index = i;
+            i++;
+        }
 
-            Result = TRUE;
-            goto quit;
+        // have we reached the target mapping?
+        if (Vbn < Run->RunEndVbn.QuadPart)
+        {
+            goto found;
         }
+
+        i++;
+        LastVbn = Run->RunEndVbn.QuadPart;
     }
 
+    goto quit;
+
+found:
+    if (Lbn)
+        *Lbn = Run->StartingLbn.QuadPart + (Vbn - Run->RunStartVbn.QuadPart);
+    if (SectorCountFromLbn)
+        *SectorCountFromLbn = Run->RunEndVbn.QuadPart - Vbn;
+    if (StartingLbn)
+        *StartingLbn = Run->StartingLbn.QuadPart;
+    if (SectorCountFromStartingLbn)
+        *SectorCountFromStartingLbn = Run->RunEndVbn.QuadPart - Run->RunStartVbn.QuadPart;
+    if (Index)
+        *Index = i;
+
+    Result = TRUE;
+
 quit:
     DPRINT("FsRtlLookupBaseMcbEntry(%p, %I64d, %p, %p, %p, %p, %p) = %d (%I64d, %I64d, %I64d, %I64d, %d)\n",
            OpaqueMcb, Vbn, Lbn, SectorCountFromLbn, StartingLbn, SectorCountFromStartingLbn, Index, Result,
@@ -45,6 +45,7 @@ extern ULONG CcDirtyPageThreshold;
 extern ULONG CcTotalDirtyPages;
 extern LIST_ENTRY CcDeferredWrites;
 extern KSPIN_LOCK CcDeferredWriteSpinLock;
+extern LIST_ENTRY CcCleanSharedCacheMapList;
 extern ULONG CcNumberWorkerThreads;
 extern LIST_ENTRY CcIdleWorkerThreadList;
 extern LIST_ENTRY CcExpressWorkQueue;
@@ -58,6 +59,9 @@ extern LARGE_INTEGER CcIdleDelay;
 //
 extern ULONG CcLazyWritePages;
 extern ULONG CcLazyWriteIos;
+extern ULONG CcLazyWriteMaxPages;
+extern ULONG CcThrottledWrites;
+extern ULONG CcDirtyPageRate;
 extern ULONG CcMapDataWait;
 extern ULONG CcMapDataNoWait;
 extern ULONG CcPinReadWait;
@@ -66,6 +70,38 @@ extern ULONG CcPinMappedDataCount;
 extern ULONG CcDataPages;
 extern ULONG CcDataFlushes;
 
+extern BOOLEAN CcPfEnablePrefetcher;
+extern ULONG CcPfEnablePrefetcherFlags;
+
+typedef enum _PF_SCENARIO_TYPE
+{
+    PfApplicationLaunchScenarioType = 0,
+    PfSystemBootScenarioType,
+    PfMaxScenarioType
+} PF_SCENARIO_TYPE;
+
+typedef enum _PF_BOOT_PHASE_ID
+{
+    PfKernelInitPhase = 0,
+    PfBootDriverInitPhase = 90,
+    PfSystemDriverInitPhase = 120,
+    PfSessionManagerInitPhase = 150,
+    PfSMRegistryInitPhase = 180,
+    PfVideoInitPhase = 210,
+    PfPostVideoInitPhase = 240,
+    PfBootAcceptedRegistryInitPhase = 270,
+    PfUserShellReadyPhase = 300,
+    PfMaxBootPhaseId = 900
+} PF_BOOT_PHASE_ID;
+
+/* EnablePrefetcher registry value */
+#define PF_ENABLE_APP_LAUNCH 0x1
+#define PF_ENABLE_BOOT 0x2
+
+/* Flags for CcPfLogPageFault */
+#define PF_FAULT_HARD 0x1
+#define PF_FAULT_IMAGE 0x2
+
 typedef struct _PF_SCENARIO_ID
 {
     WCHAR ScenName[30];
@@ -99,6 +135,12 @@ typedef struct _PF_SECTION_INFO
     ULONG FileIdHigh;
 } PF_SECTION_INFO, *PPF_SECTION_INFO;
 
+typedef struct _PFSN_SECTION_INFO
+{
+    PFILE_OBJECT FileObject;
+    ULONG Flags; // PF_FAULT_IMAGE
+} PFSN_SECTION_INFO, *PPFSN_SECTION_INFO;
+
 typedef struct _PF_TRACE_HEADER
 {
     ULONG Version;
@@ -151,10 +193,57 @@ typedef struct _PFSN_TRACE_HEADER
     PPFSN_TRACE_DUMP TraceDump;
     NTSTATUS TraceDumpStatus;
     LARGE_INTEGER LaunchTime;
-    PPF_SECTION_INFO SectionInfo;
+    PPFSN_SECTION_INFO SectionInfo; /* Hash table, protected by TraceBufferSpinLock */
     ULONG SectionInfoCount;
+
+    /* ROS specific */
+    ULONG SectionInfoMax;
+    LONG SoftFaults;
+    LONG HardFaults;
+    BOOLEAN Prefetched;
+    PVOID *PrefetchSections; /* Kept referenced until the end of the trace */
+    ULONG NumPrefetchSections;
 } PFSN_TRACE_HEADER, *PPFSN_TRACE_HEADER;
 
+/* On-disk scenario file, stored in %SystemRoot%\Prefetch.
+ * The pages to prefetch of each section are stored as sorted ranges:
+ * file offsets for data sections, RVAs for image sections. */
+#define PF_SCENARIO_VERSION 1
+#define PF_SCENARIO_MAGIC 'ACCS'
+
+/* Length in characters of the full path of a scenario file */
+#define PF_MAX_SCENARIO_PATH 260
+
+typedef struct _PF_SCENARIO_HEADER
+{
+    ULONG Version;
+    ULONG MagicNumber;
+    ULONG Size;
+    PF_SCENARIO_ID ScenarioId;
+    ULONG ScenarioType; // PF_SCENARIO_TYPE
+    ULONG SectionInfoOffset;
+    ULONG NumSections;
+    ULONG RangeInfoOffset;
+    ULONG NumRanges;
+    ULONG FileNameInfoOffset;
+    ULONG FileNameInfoSize;
+} PF_SCENARIO_HEADER, *PPF_SCENARIO_HEADER;
+
+typedef struct _PF_SCENARIO_SECTION
+{
+    ULONG FirstRange;
+    ULONG NumRanges;
+    ULONG FileNameOffset; /* Relative to FileNameInfoOffset */
+    USHORT FileNameLength; /* In bytes */
+    USHORT Flags; // PF_FAULT_IMAGE
+} PF_SCENARIO_SECTION, *PPF_SCENARIO_SECTION;
+
+typedef struct _PF_SCENARIO_RANGE
+{
+    ULONG StartPage;
+    ULONG PageCount;
+} PF_SCENARIO_RANGE, *PPF_SCENARIO_RANGE;
+
 typedef struct _PFSN_PREFETCHER_GLOBALS
 {
     LIST_ENTRY ActiveTraces;
@@ -167,6 +256,25 @@ typedef struct _PFSN_PREFETCHER_GLOBALS
     LONG ActivePrefetches;
 } PFSN_PREFETCHER_GLOBALS, *PPFSN_PREFETCHER_GLOBALS;
 
+extern PFSN_PREFETCHER_GLOBALS CcPfGlobals;
+
+/* The VACBs of a shared cache map are indexed by a sparse radix tree keyed by
+ * FileOffset >> VACB_OFFSET_SHIFT. Every level of the tree is an array of
+ * VACB_LEVEL_BLOCK_SIZE pointers, the last level pointing to the VACBs.
+ * The tree grows in height when the file is extended past its reach. */
+#define VACB_LEVEL_SHIFT 7
+#define VACB_LEVEL_BLOCK_SIZE (1 << VACB_LEVEL_SHIFT)
+#define VACB_LEVEL_MASK (VACB_LEVEL_BLOCK_SIZE - 1)
+#define VACB_LEVEL_MAX ((64 - VACB_OFFSET_SHIFT + VACB_LEVEL_SHIFT - 1) / VACB_LEVEL_SHIFT)
+
+/* The lazy writer flushes runs of up to that many adjacent dirty VACBs at once */
+#define VACB_WRITE_CLUSTER_MAX 16
+
+/* Past three quarters of the dirty page threshold, CcCanIWrite slows down the
+ * heaviest writers, for up to CC_THROTTLE_MAX_DELAY ms per write */
+#define CC_THROTTLE_START(Threshold) ((Threshold) / 4 * 3)
+#define CC_THROTTLE_MAX_DELAY 20
+
 typedef struct _ROS_SHARED_CACHE_MAP
 {
     CSHORT NodeTypeCode;
@@ -191,8 +299,12 @@ typedef struct _ROS_SHARED_CACHE_MAP
 
     /* ROS specific */
     LIST_ENTRY CacheMapVacbListHead;
+    PVOID *VacbIndex; /* Protected by CacheMapLock */
+    ULONG VacbIndexLevels;
     BOOLEAN PinAccess;
     KSPIN_LOCK CacheMapLock;
+    ULONG DirtiedPages; /* Since the last lazy writer scan, protected by the master lock */
+    ULONG DirtyRate; /* Pages dirtied per lazy writer scan, smoothed */
 #if DBG
     BOOLEAN Trace; /* enable extra trace output for this cache map and it's VACBs */
 #endif
@@ -293,6 +405,40 @@ CcPfInitializePrefetcher(
     VOID
 );
 
+NTSTATUS
+NTAPI
+CcPfBeginBootPhase(
+    IN PF_BOOT_PHASE_ID Phase
+);
+
+VOID
+NTAPI
+CcPfBeginAppLaunch(
+    IN PEPROCESS Process
+);
+
+VOID
+NTAPI
+CcPfProcessExitNotification(
+    IN PEPROCESS Process
+);
+
+VOID
+NTAPI
+CcPfLogPageFault(
+    IN PFILE_OBJECT FileObject,
+    IN LONGLONG Offset,
+    IN ULONG Flags
+);
+
+NTSTATUS
+NTAPI
+CcPfQueryPrefetcherInformation(
+    IN OUT PVOID Buffer,
+    IN ULONG Length,
+    OUT PULONG ReturnLength
+);
+
 VOID
 NTAPI
 CcMdlReadComplete2(
@@ -344,6 +490,12 @@ CcRosLookupVacb(
     LONGLONG FileOffset
 );
 
+VOID
+CcRosRemoveVacbFromIndex(
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    PROS_VACB Vacb
+);
+
 VOID
 NTAPI
 CcInitCacheZeroPage(VOID);
@@ -155,9 +155,19 @@ typedef struct _CM_KEY_HASH_TABLE_ENTRY
 {
     EX_PUSH_LOCK Lock;
     PKTHREAD Owner;
-    PCM_KEY_HASH Entry;
 } CM_KEY_HASH_TABLE_ENTRY, *PCM_KEY_HASH_TABLE_ENTRY;
 
+//
+// Key Hash Chains, grown and shrunk with the number of KCBs. There is always
+// a multiple of CmpHashTableSize chains, so that each of them is covered by
+// exactly one lock of the hash table above.
+//
+typedef struct _CM_KEY_HASH_CHAINS
+{
+    ULONG Size;
+    PCM_KEY_HASH Entry[ANYSIZE_ARRAY];
+} CM_KEY_HASH_CHAINS, *PCM_KEY_HASH_CHAINS;
+
 //
 // Name Hash
 //
@@ -175,9 +185,17 @@ typedef struct _CM_NAME_HASH
 typedef struct _CM_NAME_HASH_TABLE_ENTRY
 {
     EX_PUSH_LOCK Lock;
-    PCM_NAME_HASH Entry;
 } CM_NAME_HASH_TABLE_ENTRY, *PCM_NAME_HASH_TABLE_ENTRY;
 
+//
+// Name Hash Chains, which work like the Key Hash Chains
+//
+typedef struct _CM_NAME_HASH_CHAINS
+{
+    ULONG Size;
+    PCM_NAME_HASH Entry[ANYSIZE_ARRAY];
+} CM_NAME_HASH_CHAINS, *PCM_NAME_HASH_CHAINS;
+
 //
 // Key Security Cache
 //
@@ -1487,6 +1505,9 @@ extern POBJECT_TYPE CmpKeyObjectType;
 extern ERESOURCE CmpRegistryLock;
 extern PCM_KEY_HASH_TABLE_ENTRY CmpCacheTable;
 extern PCM_NAME_HASH_TABLE_ENTRY CmpNameCacheTable;
+extern PCM_KEY_HASH_CHAINS CmpCacheChains;
+extern PCM_NAME_HASH_CHAINS CmpNameCacheChains;
+extern LONG CmpCacheEntryCount, CmpNameCacheEntryCount;
 extern KGUARDED_MUTEX CmpDelayedCloseTableLock;
 extern CMHIVE CmControlHive;
 extern WCHAR CmDefaultLanguageId[];
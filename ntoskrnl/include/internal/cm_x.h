@@ -13,12 +13,15 @@
     ((CMP_HASH_IRRATIONAL * (ConvKey)) % CMP_HASH_PRIME)
 
 //
-// Returns the index into the hash table, or the entry itself
+// Returns the index into the hash table, the entry itself, or the chain of
+// cached blocks it covers
 //
 #define GET_HASH_INDEX(ConvKey)                                     \
     GET_HASH_KEY(ConvKey) % CmpHashTableSize
 #define GET_HASH_ENTRY(Table, ConvKey)                              \
     (&Table[GET_HASH_INDEX(ConvKey)])
+#define GET_HASH_CHAIN(Chains, ConvKey)                             \
+    (&(Chains)->Entry[GET_HASH_KEY(ConvKey) % (Chains)->Size])
 #define ASSERT_VALID_HASH(h)                                        \
     ASSERT_KCB_VALID(CONTAINING_RECORD((h), CM_KEY_CONTROL_BLOCK, KeyHash))
 
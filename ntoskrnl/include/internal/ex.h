@@ -108,8 +108,27 @@ typedef struct _ETIMER
     BOOLEAN ApcAssociated;
     BOOLEAN WakeTimer;
     LIST_ENTRY WakeTimerListEntry;
+    BOOLEAN HighResolution;
+    BOOLEAN HighResolutionActive;
 } ETIMER, *PETIMER;
 
+//
+// NtSetTimerEx came with Windows 7, and the headers only have its
+// information structure for that version
+//
+#if (NTDDI_VERSION < NTDDI_WIN7)
+typedef struct _TIMER_SET_COALESCABLE_TIMER_INFO
+{
+    LARGE_INTEGER DueTime;
+    PTIMER_APC_ROUTINE TimerApcRoutine;
+    PVOID TimerContext;
+    struct _COUNTED_REASON_CONTEXT *WakeContext;
+    ULONG Period;
+    ULONG TolerableDelay;
+    PBOOLEAN PreviousState;
+} TIMER_SET_COALESCABLE_TIMER_INFO, *PTIMER_SET_COALESCABLE_TIMER_INFO;
+#endif
+
 typedef struct
 {
     PCALLBACK_OBJECT *CallbackObject;
@@ -165,6 +184,26 @@ ExGetPoolTagInfo(
     IN OUT PULONG ReturnLength OPTIONAL
 );
 
+NTSTATUS
+NTAPI
+ExGetBigPoolInfo(
+    IN PSYSTEM_BIGPOOL_INFORMATION SystemInformation,
+    IN ULONG SystemInformationLength,
+    IN OUT PULONG ReturnLength OPTIONAL
+);
+
+VOID
+NTAPI
+ExpInitializePoolTagTables(VOID);
+
+NTSTATUS
+NTAPI
+ExGetWorkQueueInfo(
+    IN PSYSTEM_WORK_QUEUE_INFORMATION SystemInformation,
+    IN ULONG SystemInformationLength,
+    IN OUT PULONG ReturnLength OPTIONAL
+);
+
 typedef struct _UUID_CACHED_VALUES_STRUCT
 {
     ULONGLONG Time;
@@ -92,6 +92,20 @@
 #define IOP_USE_TOP_LEVEL_DEVICE_HINT       0x01
 #define IOP_CREATE_FILE_OBJECT_EXTENSION    0x02
 
+//
+// The completion notification class was added in 2003 SP2, but the
+// headers only have it for Vista. It comes right after the last class.
+//
+#if (NTDDI_VERSION < NTDDI_VISTA)
+#define FileIoCompletionNotificationInformation \
+    ((FILE_INFORMATION_CLASS)(FileShortNameInformation + 1))
+#endif
+
+//
+// Most completion packets dequeued by one NtRemoveIoCompletionEx call
+//
+#define IOP_MAX_COMPLETION_BATCH            64
+
 
 typedef struct _FILE_OBJECT_EXTENSION
 {
@@ -100,9 +100,11 @@ extern USHORT KeProcessorLevel;
 extern USHORT KeProcessorRevision;
 extern ULONG KeFeatureBits;
 extern KNODE KiNode0;
-extern PKNODE KeNodeBlock[1];
+extern PKNODE KeNodeBlock[MAXIMUM_NUMA_NODES];
 extern UCHAR KeNumberNodes;
 extern UCHAR KeProcessNodeSeed;
+extern HAL_NUMA_TOPOLOGY_INTERFACE KiNumaTopology;
+extern HAL_DYNAMIC_TICK_INTERFACE KiDynamicTick;
 extern ETHREAD KiInitialThread;
 extern EPROCESS KiInitialProcess;
 extern PULONG KiInterruptTemplateObject;
@@ -293,6 +295,22 @@ KiInsertTreeTimer(
     IN LARGE_INTEGER Interval
 );
 
+//
+// Coalescable timers are a Windows 7 export, which the headers only
+// declare for that version
+//
+#if (NTDDI_VERSION < NTDDI_WIN7)
+BOOLEAN
+NTAPI
+KeSetCoalescableTimer(
+    IN OUT PKTIMER Timer,
+    IN LARGE_INTEGER DueTime,
+    IN ULONG Period,
+    IN ULONG TolerableDelay,
+    IN PKDPC Dpc OPTIONAL
+);
+#endif
+
 VOID
 FASTCALL
 KiCompleteTimer(
@@ -712,6 +730,15 @@ VOID
 FASTCALL
 KiActivateWaiterQueue(IN PKQUEUE Queue);
 
+ULONG
+NTAPI
+KeRemoveQueueEx(IN PKQUEUE Queue,
+                IN KPROCESSOR_MODE WaitMode,
+                IN BOOLEAN Alertable,
+                IN PLARGE_INTEGER Timeout OPTIONAL,
+                OUT PLIST_ENTRY *EntryArray,
+                IN ULONG Count);
+
 ULONG
 NTAPI
 KeQueryRuntimeProcess(IN PKPROCESS Process,
@@ -937,6 +964,30 @@ KiInitSystem(
     VOID
 );
 
+VOID
+NTAPI
+KiSetProcessorNode(
+    IN PKPRCB Prcb
+);
+
+VOID
+NTAPI
+KeNumaInitialize(
+    VOID
+);
+
+VOID
+NTAPI
+KiInitializeDynamicTick(
+    VOID
+);
+
+BOOLEAN
+FASTCALL
+KiStopClockTick(
+    VOID
+);
+
 VOID
 FASTCALL
 KiInsertQueueApc(
@@ -939,7 +939,33 @@ KxInsertTimer(IN PKTIMER Timer,
 }
 
 //
-// Called by KeSetTimerEx and KiInsertTreeTimer to calculate Due Time
+// Called by KeSetCoalescableTimer to record how late the timer may expire.
+// The delay is kept as the log2 of the number of clock ticks it spans, which
+// selects the boundary that KiComputeDueTime aligns the due time on
+//
+FORCEINLINE
+VOID
+KiSetTimerTolerableDelay(IN PKTIMER Timer,
+                         IN ULONG TolerableDelay)
+{
+    ULONG Ticks, Shift;
+
+    /* Convert the delay from milliseconds to clock ticks */
+    Ticks = (ULONG)(UInt32x32To64(TolerableDelay, 10000) / KeMaximumIncrement);
+
+    /* A delay under one tick cannot be coalesced */
+    Timer->Header.Coalescable = FALSE;
+    Timer->Header.EncodedTolerableDelay = 0;
+    if (!Ticks) return;
+
+    /* Use the largest power of two number of ticks within the delay */
+    BitScanReverse(&Shift, Ticks);
+    Timer->Header.Coalescable = TRUE;
+    Timer->Header.EncodedTolerableDelay = Shift;
+}
+
+//
+// Called by KeSetCoalescableTimer and KiInsertTreeTimer to calculate Due Time
 // See the Windows HPI Blog for more information
 //
 FORCEINLINE
@@ -949,6 +975,7 @@ KiComputeDueTime(IN PKTIMER Timer,
                  OUT PULONG Hand)
 {
     LARGE_INTEGER InterruptTime, SystemTime, DifferenceTime;
+    ULONGLONG Granularity;
 
     /* Convert to relative time if needed */
     Timer->Header.Absolute = FALSE;
@@ -982,6 +1009,19 @@ KiComputeDueTime(IN PKTIMER Timer,
     /* Recalculate due time */
     Timer->DueTime.QuadPart = InterruptTime.QuadPart - DueTime.QuadPart;
 
+    /*
+     * Push a coalescable timer out to the next multiple of its granularity.
+     * The granularities are nested powers of two, so timers with different
+     * delays still land on the same ticks and expire together
+     */
+    if (Timer->Header.Coalescable)
+    {
+        Granularity = (ULONGLONG)KeMaximumIncrement <<
+                      Timer->Header.EncodedTolerableDelay;
+        Timer->DueTime.QuadPart += Granularity - 1;
+        Timer->DueTime.QuadPart -= Timer->DueTime.QuadPart % Granularity;
+    }
+
     /* Get the handle */
     *Hand = KiComputeTimerTableIndex(Timer->DueTime.QuadPart);
     Timer->Header.Hand = (UCHAR)*Hand;
@@ -1235,7 +1275,7 @@ KxSetTimerForThreadWait(IN PKTIMER Timer,
     }                                                                       \
                                                                             \
     /* Set wait settings */                                                 \
-    Thread->Alertable = FALSE;                                              \
+    Thread->Alertable = Alertable;                                          \
     Thread->WaitMode = WaitMode;                                            \
     Thread->WaitReason = WrQueue;                                           \
                                                                             \
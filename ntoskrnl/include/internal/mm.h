@@ -227,6 +227,8 @@ typedef struct _MEMORY_AREA
         LONGLONG ViewOffset;
         PMM_SECTION_SEGMENT Segment;
         LIST_ENTRY RegionListHead;
+        LONGLONG NextFaultOffset;   /* where the next fault of a sequential scan lands */
+        ULONG ReadCluster;          /* current fault read-ahead window, in bytes */
     } SectionData;
 } MEMORY_AREA, *PMEMORY_AREA;
 
@@ -1392,6 +1394,13 @@ MmMakeDataSectionResident(
     _In_ ULONG Length,
     _In_ PLARGE_INTEGER ValidDataLength);
 
+NTSTATUS
+NTAPI
+MmPrefetchSectionRange(
+    _In_ PVOID SectionObject,
+    _In_ LONGLONG Offset,
+    _In_ ULONG Length);
+
 BOOLEAN
 NTAPI
 MmPurgeSegment(
@@ -144,6 +144,51 @@ typedef union
     ULARGE_INTEGER Alignment;
 } ALIGNEDNAME;
 
+//
+// Directory hash table. Directories start out with the NUMBER_HASH_BUCKETS
+// buckets embedded in OBJECT_DIRECTORY and move to a larger table once they
+// fill up.
+//
+#define OBP_DIRECTORY_LOAD_FACTOR                       2
+#define OBP_DIRECTORY_MAX_BUCKETS                       MAXUSHORT
+
+typedef struct _OBP_DIRECTORY_TABLE
+{
+    struct _OBP_DIRECTORY_TABLE *NextDeleted;
+    ULONG BucketCount;
+    POBJECT_DIRECTORY_ENTRY HashBuckets[ANYSIZE_ARRAY];
+} OBP_DIRECTORY_TABLE, *POBP_DIRECTORY_TABLE;
+
+//
+// Directory entries as they are allocated, with the link that keeps them on
+// the deleted list of their read epoch once they are unlinked.
+//
+typedef struct _OBP_DIRECTORY_ENTRY
+{
+    OBJECT_DIRECTORY_ENTRY Entry;
+    struct _OBP_DIRECTORY_ENTRY *NextDeleted;
+} OBP_DIRECTORY_ENTRY, *POBP_DIRECTORY_ENTRY;
+
+//
+// Private directory state, which follows OBJECT_DIRECTORY in the object body.
+// Lookups walk the hash chains without the directory lock; they enter a read
+// epoch instead. Writers don't wait for lookups: what they unlink is kept on
+// the deleted lists of the current epoch, and freed once the epoch has moved
+// on and the lookups which were counted in it are gone.
+//
+typedef struct _OBP_DIRECTORY_EXTENSION
+{
+    POBP_DIRECTORY_TABLE Table;
+    ULONG EntryCount;
+    LONG ReaderEpoch;
+    LONG ReaderCount[2];
+    POBP_DIRECTORY_ENTRY DeletedEntries[2];
+    POBP_DIRECTORY_TABLE DeletedTables[2];
+} OBP_DIRECTORY_EXTENSION, *POBP_DIRECTORY_EXTENSION;
+
+#define OBP_DIRECTORY_TO_EXTENSION(d)                   \
+    ((POBP_DIRECTORY_EXTENSION)((POBJECT_DIRECTORY)(d) + 1))
+
 //
 // Private Temporary Buffer for Lookup Routines
 //
@@ -198,6 +243,12 @@ ObpLookupEntryDirectory(
     IN POBP_LOOKUP_CONTEXT Context
 );
 
+VOID
+NTAPI
+ObpDeleteDirectory(
+    IN PVOID ObjectBody
+);
+
 //
 // Symbolic Link Functions
 //
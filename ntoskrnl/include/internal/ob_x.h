@@ -216,6 +216,58 @@ ObpReleaseDirectoryLock(IN POBJECT_DIRECTORY Directory,
     KeLeaveCriticalRegion();
 }
 
+FORCEINLINE
+POBJECT_DIRECTORY_ENTRY*
+ObpGetDirectoryBuckets(IN POBJECT_DIRECTORY Directory,
+                       OUT PULONG BucketCount)
+{
+    POBP_DIRECTORY_TABLE Table;
+
+    /* Use the expanded table if the directory has one */
+    Table = *(POBP_DIRECTORY_TABLE volatile *)&OBP_DIRECTORY_TO_EXTENSION(Directory)->Table;
+    if (Table)
+    {
+        *BucketCount = Table->BucketCount;
+        return Table->HashBuckets;
+    }
+
+    /* Otherwise use the buckets embedded in the directory */
+    *BucketCount = NUMBER_HASH_BUCKETS;
+    return Directory->HashBuckets;
+}
+
+FORCEINLINE
+LONG
+ObpEnterDirectoryRead(IN POBJECT_DIRECTORY Directory)
+{
+    POBP_DIRECTORY_EXTENSION Extension = OBP_DIRECTORY_TO_EXTENSION(Directory);
+    LONG Epoch;
+
+    /* Don't let us get suspended while we hold back freeing deleted entries */
+    KeEnterCriticalRegion();
+
+    for (;;)
+    {
+        /* Join the current epoch */
+        Epoch = *(volatile LONG *)&Extension->ReaderEpoch;
+        InterlockedIncrement(&Extension->ReaderCount[Epoch]);
+
+        /* Make sure a writer didn't move on to the other one meanwhile */
+        if (*(volatile LONG *)&Extension->ReaderEpoch == Epoch) return Epoch;
+        InterlockedDecrement(&Extension->ReaderCount[Epoch]);
+    }
+}
+
+FORCEINLINE
+VOID
+ObpLeaveDirectoryRead(IN POBJECT_DIRECTORY Directory,
+                      IN LONG Epoch)
+{
+    /* Leave the epoch */
+    InterlockedDecrement(&OBP_DIRECTORY_TO_EXTENSION(Directory)->ReaderCount[Epoch]);
+    KeLeaveCriticalRegion();
+}
+
 FORCEINLINE
 VOID
 ObpInitializeLookupContext(IN POBP_LOOKUP_CONTEXT Context)
@@ -3,9 +3,12 @@
 /* Cache Manager Tags */
 #define TAG_CC                  '  cC'
 #define TAG_VACB                'aVcC'
+#define TAG_VACB_INDEX          'iVcC'
 #define TAG_SHARED_CACHE_MAP    'cScC'
 #define TAG_PRIVATE_CACHE_MAP   'cPcC'
 #define TAG_BCB                 'cBcC'
+#define TAG_PF_TRACE            'tPcC'
+#define TAG_PF_SCENARIO         'sPcC'
 
 /* Executive Callbacks */
 #define TAG_CALLBACK_ROUTINE_BLOCK 'brbC'
@@ -431,10 +431,11 @@ IopDeviceFsIoControl(IN HANDLE DeviceHandle,
                     CompletionInfo = *(FileObject->CompletionContext);
                 }
 
-                /* If we had an event, signal it */
+                /* If we had an event, signal it, unless the caller doesn't want it for fast I/O */
                 if (Event)
                 {
-                    KeSetEvent(EventObject, IO_NO_INCREMENT, FALSE);
+                    if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                        KeSetEvent(EventObject, IO_NO_INCREMENT, FALSE);
                     ObDereferenceObject(EventObject);
                 }
 
@@ -444,8 +445,13 @@ IopDeviceFsIoControl(IN HANDLE DeviceHandle,
                     IopUnlockFileObject(FileObject);
                 }
 
-                /* Set completion if required */
-                if (CompletionInfo.Port != NULL && UserApcContext != NULL)
+                /*
+                 * Set completion if required. Fast I/O never pends, so a success
+                 * doesn't get a packet if the caller asked to skip the port.
+                 */
+                if (CompletionInfo.Port != NULL && UserApcContext != NULL &&
+                    (!NT_SUCCESS(KernelIosb.Status) ||
+                     !(FileObject->Flags & FO_SKIP_COMPLETION_PORT)))
                 {
                     if (!NT_SUCCESS(IoSetIoCompletion(CompletionInfo.Port,
                                                       CompletionInfo.Key,
@@ -1134,6 +1140,365 @@ IopGetDriverPathInformation(IN PFILE_OBJECT FileObject,
     return STATUS_SUCCESS;
 }
 
+static
+NTSTATUS
+IopSetCompletionNotificationModes(IN HANDLE FileHandle,
+                                  OUT PIO_STATUS_BLOCK IoStatusBlock,
+                                  IN PVOID FileInformation,
+                                  IN ULONG Length,
+                                  IN KPROCESSOR_MODE PreviousMode)
+{
+    PFILE_OBJECT FileObject;
+    ULONG Flags, FileFlags = 0;
+    NTSTATUS Status;
+    PAGED_CODE();
+
+    /* Validate the length */
+    if (Length < sizeof(FILE_IO_COMPLETION_NOTIFICATION_INFORMATION))
+    {
+        return STATUS_INFO_LENGTH_MISMATCH;
+    }
+
+    /* Capture the modes */
+    _SEH2_TRY
+    {
+        if (PreviousMode != KernelMode)
+        {
+            ProbeForWriteIoStatusBlock(IoStatusBlock);
+            ProbeForRead(FileInformation, Length, sizeof(ULONG));
+        }
+        Flags = ((PFILE_IO_COMPLETION_NOTIFICATION_INFORMATION)FileInformation)->Flags;
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Return the exception code */
+        _SEH2_YIELD(return _SEH2_GetExceptionCode());
+    }
+    _SEH2_END;
+
+    /* Only the skip modes exist */
+    if (Flags & ~(FILE_SKIP_COMPLETION_PORT_ON_SUCCESS |
+                  FILE_SKIP_SET_EVENT_ON_HANDLE |
+                  FILE_SKIP_SET_USER_EVENT_ON_FAST_IO))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Reference the file object, the modes don't need any access */
+    Status = ObReferenceObjectByHandle(FileHandle,
+                                       0,
+                                       IoFileObjectType,
+                                       PreviousMode,
+                                       (PVOID*)&FileObject,
+                                       NULL);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* The modes are kept in the file object, they can't be turned off again */
+    if (Flags & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS) FileFlags |= FO_SKIP_COMPLETION_PORT;
+    if (Flags & FILE_SKIP_SET_EVENT_ON_HANDLE) FileFlags |= FO_SKIP_SET_EVENT;
+    if (Flags & FILE_SKIP_SET_USER_EVENT_ON_FAST_IO) FileFlags |= FO_SKIP_SET_FAST_IO;
+    InterlockedOr((PLONG)&FileObject->Flags, FileFlags);
+    ObDereferenceObject(FileObject);
+
+    /* Return the status to the caller */
+    _SEH2_TRY
+    {
+        IoStatusBlock->Status = STATUS_SUCCESS;
+        IoStatusBlock->Information = 0;
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Ignore, like for the other classes */
+    }
+    _SEH2_END;
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+IopScatterGatherFile(IN HANDLE FileHandle,
+                     IN HANDLE Event OPTIONAL,
+                     IN PIO_APC_ROUTINE ApcRoutine OPTIONAL,
+                     IN PVOID ApcContext OPTIONAL,
+                     OUT PIO_STATUS_BLOCK IoStatusBlock,
+                     IN FILE_SEGMENT_ELEMENT SegmentArray[],
+                     IN ULONG Length,
+                     IN PLARGE_INTEGER ByteOffset OPTIONAL,
+                     IN PULONG Key OPTIONAL,
+                     IN BOOLEAN Write)
+{
+    NTSTATUS Status;
+    PFILE_OBJECT FileObject;
+    PIRP Irp;
+    PDEVICE_OBJECT DeviceObject;
+    PIO_STACK_LOCATION StackPtr;
+    KPROCESSOR_MODE PreviousMode = KeGetPreviousMode();
+    PKEVENT EventObject = NULL;
+    LARGE_INTEGER CapturedByteOffset;
+    ULONG CapturedKey = 0;
+    BOOLEAN Synchronous = FALSE;
+    OBJECT_HANDLE_INFORMATION ObjectHandleInfo;
+    PMDL Mdl = NULL;
+    PPFN_NUMBER MdlPages;
+    UCHAR PageMdlBase[sizeof(MDL) + sizeof(PFN_NUMBER)];
+    PMDL PageMdl = (PMDL)PageMdlBase;
+    PVOID PageAddress;
+    ULONG PageCount, Locked = 0, i;
+
+    PAGED_CODE();
+    CapturedByteOffset.QuadPart = 0;
+    IOTRACE(IO_API_DEBUG, "FileHandle: %p\n", FileHandle);
+
+    /* Get the File Object */
+    if (Write)
+    {
+        Status = ObReferenceFileObjectForWrite(FileHandle,
+                                               PreviousMode,
+                                               &FileObject,
+                                               &ObjectHandleInfo);
+    }
+    else
+    {
+        Status = ObReferenceObjectByHandle(FileHandle,
+                                           FILE_READ_DATA,
+                                           IoFileObjectType,
+                                           PreviousMode,
+                                           (PVOID*)&FileObject,
+                                           NULL);
+    }
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Get the device object */
+    DeviceObject = IoGetRelatedDeviceObject(FileObject);
+
+    /*
+     * The segments are handed to the driver as one MDL, so this only works
+     * for non-cached access on a driver which doesn't need a system buffer,
+     * and every segment has to be exactly one page.
+     */
+    if (!(FileObject->Flags & FO_NO_INTERMEDIATE_BUFFERING) ||
+        (DeviceObject->Flags & DO_BUFFERED_IO) ||
+        (Length == 0) ||
+        (BYTE_OFFSET(Length) != 0) ||
+        ((DeviceObject->SectorSize != 0) && (Length % DeviceObject->SectorSize != 0)))
+    {
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+    PageCount = Length >> PAGE_SHIFT;
+
+    /* Validate User-Mode Buffers */
+    if (PreviousMode != KernelMode)
+    {
+        _SEH2_TRY
+        {
+            /* Probe the status block */
+            ProbeForWriteIoStatusBlock(IoStatusBlock);
+
+            /* Probe the segment array, the pages themselves get probed when locking them */
+            ProbeForRead(SegmentArray,
+                         PageCount * sizeof(FILE_SEGMENT_ELEMENT),
+                         sizeof(ULONGLONG));
+
+            /* Check if we got a byte offset */
+            if (ByteOffset)
+            {
+                /* Capture and probe it */
+                CapturedByteOffset = ProbeForReadLargeInteger(ByteOffset);
+            }
+
+            /* Capture and probe the key */
+            if (Key) CapturedKey = ProbeForReadUlong(Key);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* Release the file object and return the exception code */
+            ObDereferenceObject(FileObject);
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+    }
+    else
+    {
+        /* Kernel mode: capture directly */
+        if (ByteOffset) CapturedByteOffset = *ByteOffset;
+        if (Key) CapturedKey = *Key;
+    }
+
+    /* Check for invalid offset, -1 is FILE_WRITE_TO_END_OF_FILE and -2 is FILE_USE_FILE_POINTER_POSITION */
+    if ((CapturedByteOffset.QuadPart < -2) ||
+        ((CapturedByteOffset.QuadPart == -1) && !Write) ||
+        ((CapturedByteOffset.QuadPart >= 0) &&
+         (DeviceObject->SectorSize != 0) &&
+         (CapturedByteOffset.QuadPart % DeviceObject->SectorSize != 0)))
+    {
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Check if this is an append operation */
+    if ((Write) &&
+        ((ObjectHandleInfo.GrantedAccess &
+          (FILE_APPEND_DATA | FILE_WRITE_DATA)) == FILE_APPEND_DATA))
+    {
+        /* Give the drivers something to understand */
+        CapturedByteOffset.u.LowPart = FILE_WRITE_TO_END_OF_FILE;
+        CapturedByteOffset.u.HighPart = -1;
+    }
+
+    /* Check for event */
+    if (Event)
+    {
+        /* Reference it */
+        Status = ObReferenceObjectByHandle(Event,
+                                           EVENT_MODIFY_STATE,
+                                           ExEventObjectType,
+                                           PreviousMode,
+                                           (PVOID*)&EventObject,
+                                           NULL);
+        if (!NT_SUCCESS(Status))
+        {
+            /* Fail */
+            ObDereferenceObject(FileObject);
+            return Status;
+        }
+
+        /* Otherwise reset the event */
+        KeClearEvent(EventObject);
+    }
+
+    /* Check if we should use Sync IO or not */
+    if (FileObject->Flags & FO_SYNCHRONOUS_IO)
+    {
+        /* Lock the file object */
+        Status = IopLockFileObject(FileObject, PreviousMode);
+        if (Status != STATUS_SUCCESS)
+        {
+            if (EventObject) ObDereferenceObject(EventObject);
+            ObDereferenceObject(FileObject);
+            return Status;
+        }
+
+        /* Check if we don't have a byte offset available */
+        if (!(ByteOffset) ||
+            ((CapturedByteOffset.u.LowPart == FILE_USE_FILE_POINTER_POSITION) &&
+             (CapturedByteOffset.u.HighPart == -1)))
+        {
+            /* Use the Current Byte Offset instead */
+            CapturedByteOffset = FileObject->CurrentByteOffset;
+        }
+
+        /* Remember we are sync */
+        Synchronous = TRUE;
+    }
+    else if (!(ByteOffset) || (CapturedByteOffset.QuadPart == -2))
+    {
+        /* Otherwise, this was async I/O without a byte offset, so fail */
+        if (EventObject) ObDereferenceObject(EventObject);
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Clear the File Object's event */
+    KeClearEvent(&FileObject->Event);
+
+    /* Allocate the IRP */
+    Irp = IoAllocateIrp(DeviceObject->StackSize, FALSE);
+    if (!Irp) return IopCleanupFailedIrp(FileObject, EventObject, NULL);
+
+    /* Set the IRP */
+    Irp->Tail.Overlay.OriginalFileObject = FileObject;
+    Irp->Tail.Overlay.Thread = PsGetCurrentThread();
+    Irp->RequestorMode = PreviousMode;
+    Irp->Overlay.AsynchronousParameters.UserApcRoutine = ApcRoutine;
+    Irp->Overlay.AsynchronousParameters.UserApcContext = ApcContext;
+    Irp->UserIosb = IoStatusBlock;
+    Irp->UserEvent = EventObject;
+    Irp->PendingReturned = FALSE;
+    Irp->Cancel = FALSE;
+    Irp->CancelRoutine = NULL;
+    Irp->AssociatedIrp.SystemBuffer = NULL;
+    Irp->MdlAddress = NULL;
+    Irp->UserBuffer = NULL;
+
+    /* Set the Stack Data */
+    StackPtr = IoGetNextIrpStackLocation(Irp);
+    StackPtr->FileObject = FileObject;
+    if (Write)
+    {
+        StackPtr->MajorFunction = IRP_MJ_WRITE;
+        StackPtr->Flags = FileObject->Flags & FO_WRITE_THROUGH ?
+                          SL_WRITE_THROUGH : 0;
+        StackPtr->Parameters.Write.Key = CapturedKey;
+        StackPtr->Parameters.Write.Length = Length;
+        StackPtr->Parameters.Write.ByteOffset = CapturedByteOffset;
+    }
+    else
+    {
+        StackPtr->MajorFunction = IRP_MJ_READ;
+        StackPtr->Parameters.Read.Key = CapturedKey;
+        StackPtr->Parameters.Read.Length = Length;
+        StackPtr->Parameters.Read.ByteOffset = CapturedByteOffset;
+    }
+
+    /* Build one MDL for the whole transfer, locking the segments one page at a time */
+    _SEH2_TRY
+    {
+        PageAddress = (PVOID)(ULONG_PTR)SegmentArray[0].Alignment;
+        Mdl = IoAllocateMdl(PAGE_ALIGN(PageAddress), Length, FALSE, TRUE, Irp);
+        if (!Mdl)
+            ExRaiseStatus(STATUS_INSUFFICIENT_RESOURCES);
+        MdlPages = MmGetMdlPfnArray(Mdl);
+
+        for (i = 0; i < PageCount; i++)
+        {
+            /* Each segment must be a whole, page aligned page */
+            PageAddress = (PVOID)(ULONG_PTR)SegmentArray[i].Alignment;
+            if (BYTE_OFFSET(PageAddress) != 0)
+                ExRaiseStatus(STATUS_INVALID_PARAMETER);
+
+            /* Lock it and move its page over, the MDL now owns the lock */
+            MmInitializeMdl(PageMdl, PageAddress, PAGE_SIZE);
+            MmProbeAndLockPages(PageMdl,
+                                PreviousMode,
+                                Write ? IoReadAccess : IoWriteAccess);
+            MdlPages[i] = *MmGetMdlPfnArray(PageMdl);
+            Mdl->Process = PageMdl->Process;
+            Mdl->MdlFlags |= PageMdl->MdlFlags & (MDL_PAGES_LOCKED | MDL_WRITE_OPERATION);
+            Locked++;
+        }
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Unlock whatever made it in before the failing segment */
+        if (Locked)
+        {
+            Mdl->ByteCount = Locked << PAGE_SHIFT;
+            MmUnlockPages(Mdl);
+        }
+
+        /* Clean up and return the exception code */
+        IopCleanupAfterException(FileObject, Irp, EventObject, NULL);
+        _SEH2_YIELD(return _SEH2_GetExceptionCode());
+    }
+    _SEH2_END;
+
+    /* Set the deferred I/O flags, this is always non-cached */
+    Irp->Flags = (Write ? IRP_WRITE_OPERATION : IRP_READ_OPERATION) |
+                 IRP_DEFER_IO_COMPLETION |
+                 IRP_NOCACHE;
+
+    /* Perform the call */
+    return IopPerformSynchronousRequest(DeviceObject,
+                                        Irp,
+                                        FileObject,
+                                        TRUE,
+                                        PreviousMode,
+                                        Synchronous,
+                                        Write ? IopWriteTransfer : IopReadTransfer);
+}
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
@@ -2889,10 +3254,11 @@ NtReadFile(IN HANDLE FileHandle,
                 }
                 _SEH2_END;
 
-                /* Signal the completion event */
+                /* Signal the completion event, unless the caller doesn't want it for fast I/O */
                 if (EventObject)
                 {
-                    KeSetEvent(EventObject, 0, FALSE);
+                    if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                        KeSetEvent(EventObject, 0, FALSE);
                     ObDereferenceObject(EventObject);
                 }
 
@@ -3028,7 +3394,7 @@ NtReadFile(IN HANDLE FileHandle,
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 NTSTATUS
 NTAPI
@@ -3042,8 +3408,17 @@ NtReadFileScatter(IN HANDLE FileHandle,
                   IN PLARGE_INTEGER  ByteOffset,
                   IN PULONG Key OPTIONAL)
 {
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
+    /* Build the IRP for the whole page list */
+    return IopScatterGatherFile(FileHandle,
+                                Event,
+                                UserApcRoutine,
+                                UserApcContext,
+                                UserIoStatusBlock,
+                                BufferDescription,
+                                BufferLength,
+                                ByteOffset,
+                                Key,
+                                FALSE);
 }
 
 /*
@@ -3091,6 +3466,16 @@ NtSetInformationFile(IN HANDLE FileHandle,
     PAGED_CODE();
     IOTRACE(IO_API_DEBUG, "FileHandle: %p\n", FileHandle);
 
+    /* Completion notification modes only live in the file object, no driver needs to see them */
+    if (FileInformationClass == FileIoCompletionNotificationInformation)
+    {
+        return IopSetCompletionNotificationModes(FileHandle,
+                                                 IoStatusBlock,
+                                                 FileInformation,
+                                                 Length,
+                                                 PreviousMode);
+    }
+
     /* Check if we're called from user mode */
     if (PreviousMode != KernelMode)
     {
@@ -3954,10 +4339,11 @@ NtWriteFile(IN HANDLE FileHandle,
                 }
                 _SEH2_END;
 
-                /* Signal the completion event */
+                /* Signal the completion event, unless the caller doesn't want it for fast I/O */
                 if (EventObject)
                 {
-                    KeSetEvent(EventObject, 0, FALSE);
+                    if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                        KeSetEvent(EventObject, 0, FALSE);
                     ObDereferenceObject(EventObject);
                 }
 
@@ -4093,6 +4479,9 @@ NtWriteFile(IN HANDLE FileHandle,
                                         IopWriteTransfer);
 }
 
+/*
+ * @implemented
+ */
 NTSTATUS
 NTAPI
 NtWriteFileGather(IN HANDLE FileHandle,
@@ -4105,8 +4494,17 @@ NtWriteFileGather(IN HANDLE FileHandle,
                   IN PLARGE_INTEGER ByteOffset,
                   IN PULONG Key OPTIONAL)
 {
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
+    /* Build the IRP for the whole page list */
+    return IopScatterGatherFile(FileHandle,
+                                Event,
+                                UserApcRoutine,
+                                UserApcContext,
+                                UserIoStatusBlock,
+                                BufferDescription,
+                                BufferLength,
+                                ByteOffset,
+                                Key,
+                                TRUE);
 }
 
 /*
@@ -399,8 +399,12 @@ IopCompleteRequest(IN PKAPC Apc,
         }
         else if (FileObject)
         {
-            /* Signal the file object and set the status */
-            KeSetEvent(&FileObject->Event, 0, FALSE);
+            /* Signal the file object, unless the caller asked us not to, and set the status */
+            if (!(FileObject->Flags & FO_SKIP_SET_EVENT) ||
+                (FileObject->Flags & FO_SYNCHRONOUS_IO))
+            {
+                KeSetEvent(&FileObject->Event, 0, FALSE);
+            }
             FileObject->FinalStatus = Irp->IoStatus.Status;
 
             /*
@@ -460,9 +464,16 @@ IopCompleteRequest(IN PKAPC Apc,
             KeInsertQueueApc(&Irp->Tail.Apc, Irp->UserIosb, NULL, 2);
         }
         else if ((Port) &&
-                 (Irp->Overlay.AsynchronousParameters.UserApcContext))
+                 (Irp->Overlay.AsynchronousParameters.UserApcContext) &&
+                 ((Irp->PendingReturned) ||
+                  !(NT_SUCCESS(Irp->IoStatus.Status)) ||
+                  !(FileObject->Flags & FO_SKIP_COMPLETION_PORT)))
         {
-            /* We have an I/O Completion setup... create the special Overlay */
+            /*
+             * We have an I/O Completion setup... create the special Overlay.
+             * Requests which succeeded right away don't get one if the caller
+             * asked to skip the port, it already has the result.
+             */
             Irp->Tail.CompletionKey = Key;
             Irp->Tail.Overlay.PacketType = IopCompletionPacketIrp;
             KeInsertQueue(Port, &Irp->Tail.Overlay.ListEntry);
@@ -93,6 +93,9 @@ KiSystemStartupBootStack(VOID)
     }
     else
     {
+        /* Find the NUMA node of this processor */
+        KiSetProcessorNode(Prcb);
+
         /* Initialize the startup thread */
         KiInitializeHandBuiltThread(Thread, Process, KernelStack);
 
@@ -525,6 +525,9 @@ KiInitializeKernel(IN PKPROCESS InitProcess,
     }
     else
     {
+        /* Find the NUMA node of this processor */
+        KiSetProcessorNode(Prcb);
+
         /* FIXME */
         DPRINT1("SMP Boot support not yet present\n");
     }
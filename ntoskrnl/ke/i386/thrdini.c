@@ -294,15 +294,36 @@ KiIdleLoop(VOID)
             KiRetireDpcList(Prcb);
         }
 
+#ifdef CONFIG_SMP
+        /* If we just ran out of work, try to take some from a busy CPU */
+        if (Prcb->IdleSchedule)
+        {
+            _enable();
+            KiIdleSchedule(Prcb);
+            _disable();
+        }
+#endif
+
         /* Check if a new thread is scheduled for execution */
         if (Prcb->NextThread)
         {
             /* Enable interrupts */
             _enable();
 
+            /* Other processors can replace or take back the standby thread */
+            KiAcquirePrcbLock(Prcb);
+
             /* Capture current thread data */
             OldThread = Prcb->CurrentThread;
             NewThread = Prcb->NextThread;
+            if (NewThread == OldThread)
+            {
+                /* The standby thread was taken back, keep idling */
+                Prcb->NextThread = NULL;
+                NewThread->State = Running;
+                KiReleasePrcbLock(Prcb);
+                continue;
+            }
 
             /* Set new thread data */
             Prcb->NextThread = NULL;
@@ -310,6 +331,7 @@ KiIdleLoop(VOID)
 
             /* The thread is now running */
             NewThread->State = Running;
+            KiReleasePrcbLock(Prcb);
 
             /* Switch away from the idle thread */
             KiSwapContext(APC_LEVEL, OldThread);
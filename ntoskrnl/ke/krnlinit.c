@@ -36,9 +36,11 @@ CCHAR KeNumberProcessors = 0;
 
 /* NUMA Node Support */
 KNODE KiNode0;
-PKNODE KeNodeBlock[1];
+KNODE KiNodeInit[MAXIMUM_NUMA_NODES - 1];
+PKNODE KeNodeBlock[MAXIMUM_NUMA_NODES];
 UCHAR KeNumberNodes = 1;
 UCHAR KeProcessNodeSeed;
+HAL_NUMA_TOPOLOGY_INTERFACE KiNumaTopology;
 
 /* Initial Process and Thread */
 ETHREAD KiInitialThread;
@@ -287,6 +289,74 @@ KiInitSpinLocks(IN PKPRCB Prcb,
     }
 }
 
+VOID
+NTAPI
+KiSetProcessorNode(IN PKPRCB Prcb)
+{
+    PKNODE Node;
+    USHORT Identifier;
+    UCHAR NodeNumber = 0;
+
+    /* Ask the HAL which node the processor lives on, if there's more than one */
+    if (KeNumberNodes > 1)
+    {
+        if (!NT_SUCCESS(KiNumaTopology.QueryProcessorNode(Prcb->Number,
+                                                          &Identifier,
+                                                          &NodeNumber)) ||
+            (NodeNumber >= KeNumberNodes))
+        {
+            /* The SRAT doesn't know about it, so keep it on the first node */
+            DPRINT1("No NUMA node for processor %u\n", Prcb->Number);
+            NodeNumber = 0;
+        }
+    }
+
+    /* The first processor of a node seeds the ideal processor selection */
+    Node = KeNodeBlock[NodeNumber];
+    if (!Node->ProcessorMask) Node->Seed = (UCHAR)Prcb->Number;
+
+    /* Link the processor and the node */
+    Node->ProcessorMask |= Prcb->SetMember;
+    Prcb->ParentNode = Node;
+    Prcb->NodeColor = Node->Color;
+    Prcb->NodeShiftedColor = Node->MmShiftedColor;
+}
+
+CODE_SEG("INIT")
+VOID
+NTAPI
+KeNumaInitialize(VOID)
+{
+    HAL_NUMA_TOPOLOGY_INTERFACE NumaTopology;
+    PKPRCB Prcb = KeGetCurrentPrcb();
+    ULONG ReturnedLength, NumberOfNodes, i;
+    NTSTATUS Status;
+
+    /* Ask the HAL for the NUMA topology, there is none without a SRAT */
+    Status = HalQuerySystemInformation(HalNumaTopologyInterface,
+                                       sizeof(NumaTopology),
+                                       &NumaTopology,
+                                       &ReturnedLength);
+    if (!NT_SUCCESS(Status) || (NumaTopology.NumberOfNodes <= 1)) return;
+
+    /* Set up the other nodes */
+    NumberOfNodes = min(NumaTopology.NumberOfNodes, MAXIMUM_NUMA_NODES);
+    for (i = 1; i < NumberOfNodes; i++)
+    {
+        KeNodeBlock[i] = &KiNodeInit[i - 1];
+        KeNodeBlock[i]->NodeNumber = (UCHAR)i;
+        KeNodeBlock[i]->Color = (UCHAR)i;
+    }
+    KiNumaTopology = NumaTopology;
+    KeNumberNodes = (UCHAR)NumberOfNodes;
+
+    /* Now move the boot processor to its real node */
+    KiNode0.ProcessorMask &= ~Prcb->SetMember;
+    KiSetProcessorNode(Prcb);
+    DPRINT1("NUMA: %u nodes, boot processor on node %u\n",
+            KeNumberNodes, Prcb->ParentNode->NodeNumber);
+}
+
 CODE_SEG("INIT")
 BOOLEAN
 NTAPI
@@ -301,5 +371,8 @@ KeInitSystem(VOID)
 
     /* Initialize non-portable parts of the kernel */
     KiInitMachineDependent();
+
+    /* Let idle processors skip clock ticks if the HAL can */
+    KiInitializeDynamicTick();
     return TRUE;
 }
@@ -62,6 +62,46 @@ KiActivateWaiterQueue(IN PKQUEUE Queue)
     }
 }
 
+/*
+ * Moves more entries to a batch, for a thread which is already running for the queue
+ */
+static
+ULONG
+KiRemoveQueueEntries(IN PKQUEUE Queue,
+                     OUT PLIST_ENTRY *EntryArray,
+                     IN ULONG Removed,
+                     IN ULONG Count)
+{
+    PLIST_ENTRY QueueEntry;
+
+    /* Take whatever is queued, up to the size of the batch */
+    while (Removed < Count)
+    {
+        QueueEntry = Queue->EntryListHead.Flink;
+        if (QueueEntry == &Queue->EntryListHead) break;
+
+        /* Check if the entry is valid. If not, bugcheck */
+        if (!(QueueEntry->Flink) || !(QueueEntry->Blink))
+        {
+            /* Invalid item */
+            KeBugCheckEx(INVALID_WORK_QUEUE_ITEM,
+                         (ULONG_PTR)QueueEntry,
+                         (ULONG_PTR)Queue,
+                         (ULONG_PTR)NULL,
+                         (ULONG_PTR)((PWORK_QUEUE_ITEM)QueueEntry)->
+                                     WorkerRoutine);
+        }
+
+        /* Remove the Entry */
+        Queue->Header.SignalState--;
+        RemoveEntryList(QueueEntry);
+        QueueEntry->Flink = NULL;
+        EntryArray[Removed++] = QueueEntry;
+    }
+
+    return Removed;
+}
+
 /*
  * Returns the previous number of entries in the queue
  */
@@ -233,14 +273,19 @@ KeReadStateQueue(IN PKQUEUE Queue)
 /*
  * @implemented
  */
-PLIST_ENTRY
+ULONG
 NTAPI
-KeRemoveQueue(IN PKQUEUE Queue,
-              IN KPROCESSOR_MODE WaitMode,
-              IN PLARGE_INTEGER Timeout OPTIONAL)
+KeRemoveQueueEx(IN PKQUEUE Queue,
+                IN KPROCESSOR_MODE WaitMode,
+                IN BOOLEAN Alertable,
+                IN PLARGE_INTEGER Timeout OPTIONAL,
+                OUT PLIST_ENTRY *EntryArray,
+                IN ULONG Count)
 {
     PLIST_ENTRY QueueEntry;
     LONG_PTR Status;
+    ULONG Removed = 0;
+    KIRQL OldIrql;
     PKTHREAD Thread = KeGetCurrentThread();
     PKQUEUE PreviousQueue;
     PKWAIT_BLOCK WaitBlock = &Thread->WaitBlock[0];
@@ -252,6 +297,7 @@ KeRemoveQueue(IN PKQUEUE Queue,
     ULONG Hand = 0;
     ASSERT_QUEUE(Queue);
     ASSERT_IRQL_LESS_OR_EQUAL(DISPATCH_LEVEL);
+    ASSERT(Count != 0);
 
     /* Check if the Lock is already held */
     if (Thread->WaitNext)
@@ -327,6 +373,10 @@ KeRemoveQueue(IN PKQUEUE Queue,
             /* Remove the Entry */
             RemoveEntryList(QueueEntry);
             QueueEntry->Flink = NULL;
+            EntryArray[Removed++] = QueueEntry;
+
+            /* Take the rest of the batch while we hold the lock */
+            Removed = KiRemoveQueueEntries(Queue, EntryArray, Removed, Count);
 
             /* Nothing to wait on */
             break;
@@ -344,12 +394,12 @@ KeRemoveQueue(IN PKQUEUE Queue,
             }
             else
             {
-                /* Fail if there's a User APC Pending */
-                if ((WaitMode != KernelMode) &&
-                    (Thread->ApcState.UserApcPending))
+                /* Fail if we were alerted or there's a User APC Pending */
+                Status = KiCheckAlertability(Thread, Alertable, WaitMode);
+                if (Status != STATUS_WAIT_0)
                 {
                     /* Return the status and increase the pending threads */
-                    QueueEntry = (PLIST_ENTRY)STATUS_USER_APC;
+                    EntryArray[Removed++] = (PLIST_ENTRY)Status;
                     Queue->CurrentCount++;
                     break;
                 }
@@ -362,7 +412,7 @@ KeRemoveQueue(IN PKQUEUE Queue,
                     if ((ULONG64)InterruptTime.QuadPart >= Timer->DueTime.QuadPart)
                     {
                         /* It did, so we don't need to wait */
-                        QueueEntry = (PLIST_ENTRY)STATUS_TIMEOUT;
+                        EntryArray[Removed++] = (PLIST_ENTRY)STATUS_TIMEOUT;
                         Queue->CurrentCount++;
                         break;
                     }
@@ -404,7 +454,22 @@ KeRemoveQueue(IN PKQUEUE Queue,
                 Thread->WaitReason = 0;
 
                 /* Check if we were executing an APC */
-                if (Status != STATUS_KERNEL_APC) return (PLIST_ENTRY)Status;
+                if (Status != STATUS_KERNEL_APC)
+                {
+                    /* We either got an entry handed over, or the wait failed */
+                    EntryArray[Removed++] = (PLIST_ENTRY)Status;
+                    if ((Count > 1) &&
+                        (Status != STATUS_TIMEOUT) &&
+                        (Status != STATUS_USER_APC) &&
+                        (Status != STATUS_ALERTED))
+                    {
+                        /* Pick up whatever was queued behind it as well */
+                        OldIrql = KiAcquireDispatcherLock();
+                        Removed = KiRemoveQueueEntries(Queue, EntryArray, Removed, Count);
+                        KiReleaseDispatcherLock(OldIrql);
+                    }
+                    return Removed;
+                }
 
                 /* Check if we had a timeout */
                 if (Timeout)
@@ -427,6 +492,22 @@ KeRemoveQueue(IN PKQUEUE Queue,
     /* Unlock Database and return */
     KiReleaseDispatcherLockFromSynchLevel();
     KiExitDispatcher(Thread->WaitIrql);
+    return Removed;
+}
+
+/*
+ * @implemented
+ */
+PLIST_ENTRY
+NTAPI
+KeRemoveQueue(IN PKQUEUE Queue,
+              IN KPROCESSOR_MODE WaitMode,
+              IN PLARGE_INTEGER Timeout OPTIONAL)
+{
+    PLIST_ENTRY QueueEntry;
+
+    /* Remove a single entry, without alerts */
+    KeRemoveQueueEx(Queue, WaitMode, FALSE, Timeout, &QueueEntry, 1);
     return QueueEntry;
 }
 
@@ -15,9 +15,17 @@
 #ifdef _WIN64
 # define InterlockedOrSetMember(Destination, SetMember) \
     InterlockedOr64((PLONG64)Destination, SetMember);
+# define InterlockedAndSetMember(Destination, SetMember) \
+    InterlockedAnd64((PLONG64)Destination, SetMember);
+# define BitScanForwardAffinity(Index, Mask) \
+    BitScanForward64(Index, Mask)
 #else
 # define InterlockedOrSetMember(Destination, SetMember) \
     InterlockedOr((PLONG)Destination, SetMember);
+# define InterlockedAndSetMember(Destination, SetMember) \
+    InterlockedAnd((PLONG)Destination, SetMember);
+# define BitScanForwardAffinity(Index, Mask) \
+    BitScanForward(Index, Mask)
 #endif
 
 /* GLOBALS *******************************************************************/
@@ -27,13 +35,162 @@ ULONG_PTR KiIdleSMTSummary;
 
 /* FUNCTIONS *****************************************************************/
 
+//
+// Picks the processor a thread should be queued on out of the given set: the
+// ideal processor first, then the one the thread last ran on (its caches are
+// likely still warm), then the current one (which saves an IPI), and finally
+// the lowest numbered one.
+//
+static
+ULONG
+KiSelectCandidateProcessor(IN PKTHREAD Thread,
+                           IN KAFFINITY ProcessorSet)
+{
+    ULONG Processor;
+    ASSERT(ProcessorSet != 0);
+
+    /* Check the ideal processor first */
+    Processor = Thread->IdealProcessor;
+    if (ProcessorSet & AFFINITY_MASK(Processor)) return Processor;
+
+    /* Then the processor the thread ran on last */
+    Processor = Thread->NextProcessor;
+    if (ProcessorSet & AFFINITY_MASK(Processor)) return Processor;
+
+    /* Then the current processor */
+    Processor = KeGetCurrentProcessorNumber();
+    if (ProcessorSet & AFFINITY_MASK(Processor)) return Processor;
+
+    /* Otherwise take the first one in the set */
+    BitScanForwardAffinity(&Processor, ProcessorSet);
+    return Processor;
+}
+
+#ifdef CONFIG_SMP
+//
+// Removes the highest priority thread from another processor's ready queues
+// that is allowed to run on the given processor. Both PRCBs must be locked.
+//
+static
+PKTHREAD
+KiStealReadyThread(IN PKPRCB TargetPrcb,
+                   IN PKPRCB Prcb)
+{
+    ULONG Summary, Priority;
+    PLIST_ENTRY ListHead, NextEntry;
+    PKTHREAD Thread;
+
+    /* Scan the ready queues from the highest priority down */
+    Summary = TargetPrcb->ReadySummary;
+    while (Summary)
+    {
+        BitScanReverse(&Priority, Summary);
+        ListHead = &TargetPrcb->DispatcherReadyListHead[Priority];
+        ASSERT(IsListEmpty(ListHead) == FALSE);
+
+        /* Look for the first thread whose affinity includes us */
+        for (NextEntry = ListHead->Flink;
+             NextEntry != ListHead;
+             NextEntry = NextEntry->Flink)
+        {
+            Thread = CONTAINING_RECORD(NextEntry, KTHREAD, WaitListEntry);
+            ASSERT(Thread->State == Ready);
+            ASSERT(Thread->NextProcessor == TargetPrcb->Number);
+
+            if (Thread->Affinity & Prcb->SetMember)
+            {
+                /* Remove it and update the ready summary if the list emptied */
+                if (RemoveEntryList(&Thread->WaitListEntry))
+                {
+                    TargetPrcb->ReadySummary ^= PRIORITY_MASK(Priority);
+                }
+
+                return Thread;
+            }
+        }
+
+        /* Nothing usable at this priority, try the next one */
+        Summary ^= PRIORITY_MASK(Priority);
+    }
+
+    /* Nothing found */
+    return NULL;
+}
+#endif
+
 PKTHREAD
 FASTCALL
 KiIdleSchedule(IN PKPRCB Prcb)
 {
-    /* FIXME: TODO */
-    ASSERTMSG("SMP: Not yet implemented\n", FALSE);
+#ifdef CONFIG_SMP
+    PKPRCB TargetPrcb, FirstPrcb, SecondPrcb;
+    PKTHREAD Thread = NULL;
+    ULONG Number, Index;
+    ASSERT(Prcb == KeGetCurrentPrcb());
+
+    /* This is a one-shot scan, it gets requested again the next time we idle */
+    Prcb->IdleSchedule = FALSE;
+
+    /* Walk the other processors, starting with our neighbour */
+    Number = Prcb->Number;
+    for (Index = 1; Index < (ULONG)KeNumberProcessors; Index++)
+    {
+        if (++Number == (ULONG)KeNumberProcessors) Number = 0;
+
+        /* Skip processors that are not running or have nothing queued */
+        if (!(KeActiveProcessors & AFFINITY_MASK(Number))) continue;
+        TargetPrcb = KiProcessorBlock[Number];
+        if (!(TargetPrcb) || !(TargetPrcb->ReadySummary)) continue;
+
+        /* Lock both PRCBs in processor order so two idle CPUs can't deadlock */
+        if (Number < Prcb->Number)
+        {
+            FirstPrcb = TargetPrcb;
+            SecondPrcb = Prcb;
+        }
+        else
+        {
+            FirstPrcb = Prcb;
+            SecondPrcb = TargetPrcb;
+        }
+        KiAcquirePrcbLock(FirstPrcb);
+        KiAcquirePrcbLock(SecondPrcb);
+
+        /* Check if someone handed us a thread in the meantime */
+        if (Prcb->NextThread)
+        {
+            /* We're not idle anymore, so don't take anything */
+            KiReleasePrcbLock(SecondPrcb);
+            KiReleasePrcbLock(FirstPrcb);
+            return NULL;
+        }
+
+        /* Try to take a thread from this processor */
+        Thread = KiStealReadyThread(TargetPrcb, Prcb);
+        if (Thread)
+        {
+            /* Move it over and set it on standby */
+            Thread->NextProcessor = Prcb->Number;
+            Thread->State = Standby;
+            Prcb->NextThread = Thread;
+
+            /* We're no longer idle */
+            InterlockedAndSetMember(&KiIdleSummary, ~Prcb->SetMember);
+        }
+
+        /* Release the locks and stop if we got something */
+        KiReleasePrcbLock(SecondPrcb);
+        KiReleasePrcbLock(FirstPrcb);
+        if (Thread) break;
+    }
+
+    /* Return the thread we took, if any */
+    return Thread;
+#else
+    /* There's nobody to take work from on UP */
+    Prcb->IdleSchedule = FALSE;
     return NULL;
+#endif
 }
 
 VOID
@@ -80,7 +237,8 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
 {
     PKPRCB Prcb;
     BOOLEAN Preempted;
-    ULONG Processor = 0;
+    ULONG Processor;
+    KAFFINITY IdleSet;
     KPRIORITY OldPriority;
     PKTHREAD NextThread;
 
@@ -228,21 +386,43 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
     OldPriority = Thread->Priority;
     Thread->Preempted = FALSE;
 
-    /* Queue the thread on CPU 0 and get the PRCB and lock it */
-    Thread->NextProcessor = 0;
-    Prcb = KiProcessorBlock[0];
+    /* Check if any processor this thread can run on is idle */
+    IdleSet = KiIdleSummary & Thread->Affinity;
+    if (IdleSet)
+    {
+        /* Pick the best idle one */
+        Processor = KiSelectCandidateProcessor(Thread, IdleSet);
+    }
+    else
+    {
+        /* Pick the best one out of the whole affinity */
+        Processor = KiSelectCandidateProcessor(Thread,
+                                               Thread->Affinity &
+                                               KeActiveProcessors);
+    }
+
+    /* Get the PRCB and lock it */
+    Prcb = KiProcessorBlock[Processor];
     KiAcquirePrcbLock(Prcb);
 
-    /* Check if we have an idle summary */
-    if (KiIdleSummary)
+    /* Check if the processor is still idle now that we own its PRCB */
+    if ((KiIdleSummary & Prcb->SetMember) &&
+        (!(Prcb->NextThread) || (Prcb->NextThread == Prcb->IdleThread)))
     {
-        /* Clear it and set this thread as the next one */
-        KiIdleSummary = 0;
+        /* Clear its idle bit and set this thread as the next one */
+        InterlockedAndSetMember(&KiIdleSummary, ~Prcb->SetMember);
+        Thread->NextProcessor = (UCHAR)Processor;
         Thread->State = Standby;
         Prcb->NextThread = Thread;
 
-        /* Unlock the PRCB and return */
+        /* Unlock the PRCB */
         KiReleasePrcbLock(Prcb);
+
+        /* Wake the processor up if it isn't this one */
+        if (KeGetCurrentProcessorNumber() != Processor)
+        {
+            KiIpiSend(AFFINITY_MASK(Processor), IPI_DPC);
+        }
         return;
     }
 
@@ -339,9 +519,6 @@ KiSelectNextThread(IN PKPRCB Prcb)
         /* Enable idle scheduling */
         InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
         Prcb->IdleSchedule = TRUE;
-
-        /* FIXME: SMT support */
-        ASSERTMSG("SMP: Not yet implemented\n", FALSE);
     }
 
     /* Sanity checks and return the thread */
@@ -385,8 +562,9 @@ KiSwapThread(IN PKTHREAD CurrentThread,
         }
         else
         {
-            /* Set the idle summary */
+            /* Set the idle summary and look for work elsewhere once idle */
             InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
+            Prcb->IdleSchedule = TRUE;
 
             /* Schedule the idle thread */
             NextThread = Prcb->IdleThread;
@@ -664,9 +842,8 @@ KiSetPriorityThread(IN PKTHREAD Thread,
             }
             else if (Thread->State == DeferredReady)
             {
-                /* FIXME: TODO */
-                DPRINT1("Deferred state not yet supported\n");
-                ASSERT(FALSE);
+                /* It will be queued at whatever priority it has when readied */
+                Thread->Priority = (SCHAR)Priority;
             }
             else
             {
@@ -686,6 +863,12 @@ KiSetAffinityThread(IN PKTHREAD Thread,
                     IN KAFFINITY Affinity)
 {
     KAFFINITY OldAffinity;
+#ifdef CONFIG_SMP
+    PKPRCB Prcb;
+    ULONG Processor;
+    PKTHREAD NextThread;
+    BOOLEAN RequestInterrupt = FALSE;
+#endif
 
     /* Get the current affinity */
     OldAffinity = Thread->UserAffinity;
@@ -704,9 +887,70 @@ KiSetAffinityThread(IN PKTHREAD Thread,
     /* Check if system affinity is disabled */
     if (!Thread->SystemAffinityActive)
     {
+        /* It is, so the new affinity takes effect right away */
+        Thread->Affinity = Affinity;
+
 #ifdef CONFIG_SMP
-        /* FIXME: TODO */
-        DPRINT1("Affinity support disabled!\n");
+        /* Make sure the ideal processor is still part of the affinity */
+        if (!(Affinity & AFFINITY_MASK(Thread->IdealProcessor)))
+        {
+            Thread->IdealProcessor =
+                (UCHAR)KiSelectCandidateProcessor(Thread,
+                                                  Affinity & KeActiveProcessors);
+        }
+
+        /* Check if the thread is bound to a processor it may not use anymore */
+        Processor = Thread->NextProcessor;
+        if (!(Affinity & AFFINITY_MASK(Processor)))
+        {
+            /* Get the PRCB and lock it */
+            Prcb = KiProcessorBlock[Processor];
+            KiAcquirePrcbLock(Prcb);
+
+            if ((Thread->State == Ready) &&
+                !(Thread->ProcessReadyQueue) &&
+                (Thread->NextProcessor == Prcb->Number))
+            {
+                /* Remove it from the ready queue and dispatch it again */
+                if (RemoveEntryList(&Thread->WaitListEntry))
+                {
+                    Prcb->ReadySummary ^= PRIORITY_MASK(Thread->Priority);
+                }
+                KiInsertDeferredReadyList(Thread);
+            }
+            else if ((Thread->State == Standby) &&
+                     (Thread == Prcb->NextThread))
+            {
+                /* Replace it with a local ready thread or the idle thread */
+                NextThread = KiSelectNextThread(Prcb);
+                NextThread->State = Standby;
+                Prcb->NextThread = NextThread;
+
+                /* And dispatch it again */
+                KiInsertDeferredReadyList(Thread);
+            }
+            else if ((Thread->State == Running) &&
+                     (Thread == Prcb->CurrentThread) &&
+                     !(Prcb->NextThread))
+            {
+                /* Preempt it, it will be requeued on a valid processor */
+                NextThread = KiSelectNextThread(Prcb);
+                NextThread->State = Standby;
+                Prcb->NextThread = NextThread;
+                RequestInterrupt = TRUE;
+            }
+
+            /* Release the PRCB lock */
+            KiReleasePrcbLock(Prcb);
+
+            /* Check if we need an interrupt on another CPU */
+            if ((RequestInterrupt) &&
+                (KeGetCurrentProcessorNumber() != Processor))
+            {
+                /* We do, send an IPI */
+                KiIpiSend(AFFINITY_MASK(Processor), IPI_DPC);
+            }
+        }
 #endif
     }
 
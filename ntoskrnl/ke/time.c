@@ -17,6 +17,10 @@
 LONG KiTickOffset;
 ULONG KeTimeAdjustment;
 BOOLEAN KiTimeAdjustmentEnabled = FALSE;
+HAL_DYNAMIC_TICK_INTERFACE KiDynamicTick;
+
+/* Longest stretch an idle processor may go without a clock tick: 1 second */
+#define KI_DYNAMIC_TICK_MAXIMUM_INTERVAL (1000 * 10000)
 
 /* FUNCTIONS ******************************************************************/
 
@@ -53,12 +57,105 @@ KiCheckForTimerExpiration(
         {
             /* Request a DPC to handle this */
             Prcb->TimerRequest = (ULONG_PTR)TrapFrame;
-            Prcb->TimerHand = Hand;
+            Prcb->TimerHand = KeTickCount.LowPart;
             HalRequestSoftwareInterrupt(DISPATCH_LEVEL);
         }
     }
 }
 
+FORCEINLINE
+VOID
+KiCheckForSkippedTimerExpiration(
+    PKPRCB Prcb,
+    PKTRAP_FRAME TrapFrame,
+    ULARGE_INTEGER InterruptTime,
+    ULONG FirstTick,
+    ULONG Ticks)
+{
+    ULONG Hand, i;
+
+    /* Check every hand the clock went past, the expiration DPC scans on from the first due one */
+    for (i = 0; (i <= Ticks) && (i < TIMER_TABLE_SIZE); i++)
+    {
+        Hand = (FirstTick + i) & (TIMER_TABLE_SIZE - 1);
+        if (KiTimerTableListHead[Hand].Time.QuadPart <= InterruptTime.QuadPart)
+        {
+            /* Check if we are already doing expiration */
+            if (!Prcb->TimerRequest)
+            {
+                /* Request a DPC to handle this */
+                Prcb->TimerRequest = (ULONG_PTR)TrapFrame;
+                Prcb->TimerHand = FirstTick + i;
+                HalRequestSoftwareInterrupt(DISPATCH_LEVEL);
+            }
+            break;
+        }
+    }
+}
+
+CODE_SEG("INIT")
+VOID
+NTAPI
+KiInitializeDynamicTick(VOID)
+{
+    HAL_DYNAMIC_TICK_INTERFACE DynamicTick;
+    ULONG ReturnedLength;
+    NTSTATUS Status;
+
+    /* Ask the HAL whether it can stop the clock tick while idle */
+    Status = HalQuerySystemInformation(HalDynamicTickInterface,
+                                       sizeof(DynamicTick),
+                                       &DynamicTick,
+                                       &ReturnedLength);
+    if (!NT_SUCCESS(Status)) return;
+
+    /* Keep the tick count within reach of a single timer table scan */
+    DynamicTick.MaximumInterval = min(DynamicTick.MaximumInterval,
+                                      KI_DYNAMIC_TICK_MAXIMUM_INTERVAL);
+    KiDynamicTick = DynamicTick;
+    DPRINT1("Dynamic tick enabled, up to %I64u ms idle\n",
+            KiDynamicTick.MaximumInterval / 10000);
+}
+
+BOOLEAN
+FASTCALL
+KiStopClockTick(VOID)
+{
+    ULARGE_INTEGER InterruptTime;
+    ULONGLONG DueTime, Interval;
+    ULONG i;
+
+    /* The HAL must support it, and the debugger polls for break-in on every tick */
+    if (!KiDynamicTick.StopClockTick || KdDebuggerEnabled) return FALSE;
+
+    /* The clock only interrupts the boot processor, so it can't skip ticks with others around */
+    if (KeNumberProcessors > 1) return FALSE;
+
+    /* Don't bother if timer expiration is already on its way */
+    if (KeGetCurrentPrcb()->TimerRequest) return FALSE;
+
+    /*
+     * Find the earliest due time in the timer table. An entry can be early
+     * when its first timer was cancelled, which only wakes us up sooner.
+     */
+    DueTime = MAXLONGLONG;
+    for (i = 0; i < TIMER_TABLE_SIZE; i++)
+    {
+        if (KiTimerTableListHead[i].Time.QuadPart < DueTime)
+        {
+            DueTime = KiTimerTableListHead[i].Time.QuadPart;
+        }
+    }
+
+    /* Get the interval from the last clock tick */
+    InterruptTime.QuadPart = *(ULONGLONG*)&SharedUserData->InterruptTime;
+    if (DueTime <= InterruptTime.QuadPart) return FALSE;
+    Interval = min(DueTime - InterruptTime.QuadPart, KiDynamicTick.MaximumInterval);
+
+    /* Let the HAL program its one-shot timer */
+    return KiDynamicTick.StopClockTick(Interval);
+}
+
 VOID
 FASTCALL
 KeUpdateSystemTime(IN PKTRAP_FRAME TrapFrame,
@@ -68,6 +165,7 @@ KeUpdateSystemTime(IN PKTRAP_FRAME TrapFrame,
     PKPRCB Prcb = KeGetCurrentPrcb();
     ULARGE_INTEGER CurrentTime, InterruptTime;
     LONG OldTickOffset;
+    ULONG Ticks, OldTickCount;
 
     /* Check if this tick is being skipped */
     if (Prcb->SkipTick)
@@ -104,23 +202,43 @@ KeUpdateSystemTime(IN PKTRAP_FRAME TrapFrame,
     /* Check for full tick */
     if (OldTickOffset <= (LONG)Increment)
     {
+        /* More than one tick went by if the HAL skipped some while idle */
+        Ticks = 1 + ((LONG)Increment - OldTickOffset) / (LONG)KeMaximumIncrement;
+        OldTickCount = KeTickCount.LowPart;
+
         /* Update the system time */
         CurrentTime.QuadPart = *(ULONGLONG*)&SharedUserData->SystemTime;
-        CurrentTime.QuadPart += KeTimeAdjustment;
+        CurrentTime.QuadPart += (ULONGLONG)KeTimeAdjustment * Ticks;
         KiWriteSystemTime(&SharedUserData->SystemTime, CurrentTime);
 
         /* Update the tick count */
-        CurrentTime.QuadPart = (*(ULONGLONG*)&KeTickCount) + 1;
+        CurrentTime.QuadPart = (*(ULONGLONG*)&KeTickCount) + Ticks;
         KiWriteSystemTime(&KeTickCount, CurrentTime);
 
         /* Update it in the shared user data */
         KiWriteSystemTime(&SharedUserData->TickCount, CurrentTime);
 
         /* Check for expiration with the new tick count as well */
-        KiCheckForTimerExpiration(Prcb, TrapFrame, InterruptTime);
+        if (Ticks == 1)
+        {
+            KiCheckForTimerExpiration(Prcb, TrapFrame, InterruptTime);
+        }
+        else
+        {
+            /* Look at the skipped hands too */
+            KiCheckForSkippedTimerExpiration(Prcb,
+                                             TrapFrame,
+                                             InterruptTime,
+                                             OldTickCount,
+                                             Ticks);
+
+            /* The skipped ticks were spent in the idle thread */
+            Prcb->KernelTime += Ticks - 1;
+            Prcb->IdleThread->KernelTime += Ticks - 1;
+        }
 
         /* Reset the tick offset */
-        KiTickOffset += KeMaximumIncrement;
+        KiTickOffset += KeMaximumIncrement * Ticks;
 
         /* Update processor/thread runtime */
         KeUpdateRunTime(TrapFrame, Irql);
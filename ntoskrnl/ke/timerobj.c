@@ -295,6 +295,21 @@ KeSetTimerEx(IN OUT PKTIMER Timer,
              IN LARGE_INTEGER DueTime,
              IN LONG Period,
              IN PKDPC Dpc OPTIONAL)
+{
+    /* Call the coalescable version with no tolerable delay */
+    return KeSetCoalescableTimer(Timer, DueTime, Period, 0, Dpc);
+}
+
+/*
+ * @implemented
+ */
+BOOLEAN
+NTAPI
+KeSetCoalescableTimer(IN OUT PKTIMER Timer,
+                      IN LARGE_INTEGER DueTime,
+                      IN ULONG Period,
+                      IN ULONG TolerableDelay,
+                      IN PKDPC Dpc OPTIONAL)
 {
     KIRQL OldIrql;
     BOOLEAN Inserted;
@@ -302,8 +317,8 @@ KeSetTimerEx(IN OUT PKTIMER Timer,
     BOOLEAN RequestInterrupt = FALSE;
     ASSERT_TIMER(Timer);
     ASSERT(KeGetCurrentIrql() <= DISPATCH_LEVEL);
-    DPRINT("KeSetTimerEx(): Timer %p, DueTime %I64d, Period %d, Dpc %p\n",
-           Timer, DueTime.QuadPart, Period, Dpc);
+    DPRINT("KeSetCoalescableTimer(): Timer %p, DueTime %I64d, Period %lu, Delay %lu, Dpc %p\n",
+           Timer, DueTime.QuadPart, Period, TolerableDelay, Dpc);
 
     /* Lock the Database and Raise IRQL */
     OldIrql = KiAcquireDispatcherLock();
@@ -315,6 +330,7 @@ KeSetTimerEx(IN OUT PKTIMER Timer,
     /* Set Default Timer Data */
     Timer->Dpc = Dpc;
     Timer->Period = Period;
+    KiSetTimerTolerableDelay(Timer, TolerableDelay);
     if (!KiComputeDueTime(Timer, DueTime, &Hand))
     {
         /* Signal the timer */
@@ -31,14 +31,17 @@ typedef struct _POOL_DPC_CONTEXT
 } POOL_DPC_CONTEXT, *PPOOL_DPC_CONTEXT;
 
 ULONG ExpNumberOfPagedPools;
+ULONG ExpNumberOfNonPagedPools;
 POOL_DESCRIPTOR NonPagedPoolDescriptor;
 PPOOL_DESCRIPTOR ExpPagedPoolDescriptor[16 + 1];
+PPOOL_DESCRIPTOR ExpNonPagedPoolDescriptor[MAXIMUM_NUMA_NODES];
 PPOOL_DESCRIPTOR PoolVector[2];
 PKGUARDED_MUTEX ExpPagedPoolMutex;
 SIZE_T PoolTrackTableSize, PoolTrackTableMask;
 SIZE_T PoolBigPageTableSize, PoolBigPageTableHash;
 ULONG ExpBigTableExpansionFailed;
 PPOOL_TRACKER_TABLE PoolTrackTable;
+PPOOL_TRACKER_TABLE ExPoolTagTables[MAXIMUM_PROCESSORS];
 PPOOL_TRACKER_BIG_PAGES PoolBigPageTable;
 KSPIN_LOCK ExpTaggedPoolLock;
 ULONG PoolHitTag;
@@ -462,6 +465,130 @@ ExpComputePartialHashForAddress(IN PVOID BaseAddress)
     return (Result >> 24) ^ (Result >> 16) ^ (Result >> 8) ^ Result;
 }
 
+FORCEINLINE
+PPOOL_TRACKER_TABLE
+ExpGetPoolTrackerTable(VOID)
+{
+    PPOOL_TRACKER_TABLE Table;
+
+    //
+    // Every processor counts into its own copy of the tracker table once it has
+    // one, so that allocations on different processors don't keep bouncing the
+    // same cache lines around. Until then, they share the boot table.
+    //
+    Table = ExPoolTagTables[KeGetCurrentProcessorNumber()];
+    return Table ? Table : PoolTrackTable;
+}
+
+static
+PPOOL_TRACKER_TABLE
+ExpFindOrCreatePoolTracker(IN PPOOL_TRACKER_TABLE Table,
+                           IN ULONG Key)
+{
+    ULONG Hash, Index;
+    KIRQL OldIrql;
+    PPOOL_TRACKER_TABLE TableEntry;
+
+    //
+    // Compute the hash for this key, and loop all the possible buckets
+    //
+    Hash = ExpComputeHashForTag(Key, PoolTrackTableMask);
+    Index = Hash;
+    while (TRUE)
+    {
+        //
+        // Do we already have an entry for this tag?
+        //
+        TableEntry = &Table[Hash];
+        if (TableEntry->Key == Key) return TableEntry;
+
+        //
+        // We don't have an entry yet, but we've found a free bucket for it
+        //
+        if (!(TableEntry->Key) && (Hash != PoolTrackTableSize - 1))
+        {
+            //
+            // We need to hold the lock while creating a new entry, since other
+            // processors might be in this code path as well. This is also true
+            // of the per-processor tables, because the thread which got us here
+            // may have been moved to another processor since it picked it.
+            //
+            ExAcquireSpinLock(&ExpTaggedPoolLock, &OldIrql);
+            if (!TableEntry->Key)
+            {
+                //
+                // We've won the race, so now create this entry in the bucket
+                //
+                TableEntry->Key = Key;
+            }
+            ExReleaseSpinLock(&ExpTaggedPoolLock, OldIrql);
+
+            //
+            // Now we force the loop to run again, and we should now end up in
+            // the code path above which returns the entry
+            //
+            continue;
+        }
+
+        //
+        // This path is hit when we don't have an entry, and the current bucket
+        // is full, so we simply try the next one
+        //
+        Hash = (Hash + 1) & PoolTrackTableMask;
+        if (Hash == Index) break;
+    }
+
+    //
+    // And finally this path is hit when all the buckets are full, and we need
+    // some expansion. This path is not yet supported in ReactOS
+    //
+    return NULL;
+}
+
+static
+BOOLEAN
+ExpAccumulatePoolTracker(IN PPOOL_TRACKER_TABLE Table,
+                         IN PPOOL_TRACKER_TABLE Source)
+{
+    ULONG Hash, Index;
+    PPOOL_TRACKER_TABLE TableEntry;
+
+    //
+    // Find the bucket of this tag in the merged table, or the first free one.
+    // Nobody else can see the merged table, so there is no locking here.
+    //
+    Hash = ExpComputeHashForTag(Source->Key, PoolTrackTableMask);
+    Index = Hash;
+    do
+    {
+        TableEntry = &Table[Hash];
+        if (!(TableEntry->Key) && (Hash != PoolTrackTableSize - 1))
+        {
+            RtlZeroMemory(TableEntry, sizeof(*TableEntry));
+            TableEntry->Key = Source->Key;
+        }
+
+        if (TableEntry->Key == Source->Key)
+        {
+            //
+            // Sum up the counters, note that frees may have happened on another
+            // processor than the allocations, so only the sums are meaningful
+            //
+            TableEntry->NonPagedAllocs += Source->NonPagedAllocs;
+            TableEntry->NonPagedFrees += Source->NonPagedFrees;
+            TableEntry->NonPagedBytes += Source->NonPagedBytes;
+            TableEntry->PagedAllocs += Source->PagedAllocs;
+            TableEntry->PagedFrees += Source->PagedFrees;
+            TableEntry->PagedBytes += Source->PagedBytes;
+            return TRUE;
+        }
+
+        Hash = (Hash + 1) & PoolTrackTableMask;
+    } while (Hash != Index);
+
+    return FALSE;
+}
+
 #if DBG
 /*
  * FORCEINLINE
@@ -480,10 +607,35 @@ ExpComputePartialHashForAddress(IN PVOID BaseAddress)
     DPRINT1(fmt, ##__VA_ARGS__)
 #endif
 
+static
+PPOOL_TRACKER_TABLE
+ExpLookupPoolTracker(IN PPOOL_TRACKER_TABLE Table,
+                     IN ULONG Key)
+{
+    ULONG Hash, Index;
+
+    //
+    // Walk the buckets of this key until we find it, or an empty one which
+    // means that it was never used in this table
+    //
+    Hash = ExpComputeHashForTag(Key, PoolTrackTableMask);
+    Index = Hash;
+    do
+    {
+        if (Table[Hash].Key == Key) return &Table[Hash];
+        if (!Table[Hash].Key) break;
+        Hash = (Hash + 1) & PoolTrackTableMask;
+    } while (Hash != Index);
+
+    return NULL;
+}
+
 VOID
 MiDumpPoolConsumers(BOOLEAN CalledFromDbg, ULONG Tag, ULONG Mask, ULONG Flags)
 {
     SIZE_T i;
+    ULONG Processor, Other;
+    PPOOL_TRACKER_TABLE Table;
     BOOLEAN Verbose;
 
     //
@@ -522,64 +674,120 @@ MiDumpPoolConsumers(BOOLEAN CalledFromDbg, ULONG Tag, ULONG Mask, ULONG Flags)
     }
 
     //
-    // We'll extract allocations for all the tracked pools
+    // We'll extract allocations for all the tracked pools, summing the tables
+    // of all processors. We can't allocate here, so each tag is printed when
+    // we meet it in the first table where it shows up.
     //
-    for (i = 0; i < PoolTrackTableSize; ++i)
+    for (Processor = 0; Processor < (ULONG)KeNumberProcessors; Processor++)
     {
-        PPOOL_TRACKER_TABLE TableEntry;
+        Table = ExPoolTagTables[Processor];
+        if (!Table) continue;
 
-        TableEntry = &PoolTrackTable[i];
-
-        //
-        // We only care about tags which have allocated memory
-        //
-        if (TableEntry->NonPagedBytes != 0 || TableEntry->PagedBytes != 0)
+        for (i = 0; i < PoolTrackTableSize; ++i)
         {
+            PPOOL_TRACKER_TABLE TableEntry;
+            POOL_TRACKER_TABLE Total;
+
+            if (!Table[i].Key) continue;
+
             //
-            // If there's a tag, attempt to do a pretty print
-            // only if it matches the caller's tag, or if
-            // any tag is allowed
-            // For checking whether it matches caller's tag,
-            // use the mask to make sure not to mess with the wildcards
+            // Skip tags which were already printed along with an earlier table
             //
-            if (TableEntry->Key != 0 && TableEntry->Key != TAG_NONE &&
-                (Tag == 0 || (TableEntry->Key & Mask) == (Tag & Mask)))
+            for (Other = 0; Other < Processor; Other++)
             {
-                CHAR Tag[4];
+                if (ExPoolTagTables[Other] &&
+                    ExpLookupPoolTracker(ExPoolTagTables[Other], Table[i].Key))
+                {
+                    break;
+                }
+            }
+            if (Other != Processor) continue;
+
+            Total = Table[i];
+            for (Other = Processor + 1; Other < (ULONG)KeNumberProcessors; Other++)
+            {
+                if (!ExPoolTagTables[Other]) continue;
+
+                TableEntry = ExpLookupPoolTracker(ExPoolTagTables[Other], Total.Key);
+                if (!TableEntry) continue;
 
+                Total.NonPagedAllocs += TableEntry->NonPagedAllocs;
+                Total.NonPagedFrees += TableEntry->NonPagedFrees;
+                Total.NonPagedBytes += TableEntry->NonPagedBytes;
+                Total.PagedAllocs += TableEntry->PagedAllocs;
+                Total.PagedFrees += TableEntry->PagedFrees;
+                Total.PagedBytes += TableEntry->PagedBytes;
+            }
+            TableEntry = &Total;
+
+            //
+            // We only care about tags which have allocated memory
+            //
+            if (TableEntry->NonPagedBytes != 0 || TableEntry->PagedBytes != 0)
+            {
                 //
-                // Extract each 'component' and check whether they are printable
+                // If there's a tag, attempt to do a pretty print
+                // only if it matches the caller's tag, or if
+                // any tag is allowed
+                // For checking whether it matches caller's tag,
+                // use the mask to make sure not to mess with the wildcards
                 //
-                Tag[0] = TableEntry->Key & 0xFF;
-                Tag[1] = TableEntry->Key >> 8 & 0xFF;
-                Tag[2] = TableEntry->Key >> 16 & 0xFF;
-                Tag[3] = TableEntry->Key >> 24 & 0xFF;
-
-                if (ExpTagAllowPrint(Tag[0]) && ExpTagAllowPrint(Tag[1]) && ExpTagAllowPrint(Tag[2]) && ExpTagAllowPrint(Tag[3]))
+                if (TableEntry->Key != 0 && TableEntry->Key != TAG_NONE &&
+                    (Tag == 0 || (TableEntry->Key & Mask) == (Tag & Mask)))
                 {
+                    CHAR Tag[4];
+
                     //
-                    // Print in direct order to make !poolused TAG usage easier
+                    // Extract each 'component' and check whether they are printable
                     //
-                    if (Verbose)
+                    Tag[0] = TableEntry->Key & 0xFF;
+                    Tag[1] = TableEntry->Key >> 8 & 0xFF;
+                    Tag[2] = TableEntry->Key >> 16 & 0xFF;
+                    Tag[3] = TableEntry->Key >> 24 & 0xFF;
+
+                    if (ExpTagAllowPrint(Tag[0]) && ExpTagAllowPrint(Tag[1]) && ExpTagAllowPrint(Tag[2]) && ExpTagAllowPrint(Tag[3]))
                     {
-                        MiDumperPrint(CalledFromDbg, "'%c%c%c%c'\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\n", Tag[0], Tag[1], Tag[2], Tag[3],
-                                      TableEntry->NonPagedAllocs, TableEntry->NonPagedFrees,
-                                      (TableEntry->NonPagedAllocs - TableEntry->NonPagedFrees), TableEntry->NonPagedBytes,
-                                      TableEntry->PagedAllocs, TableEntry->PagedFrees,
-                                      (TableEntry->PagedAllocs - TableEntry->PagedFrees), TableEntry->PagedBytes);
+                        //
+                        // Print in direct order to make !poolused TAG usage easier
+                        //
+                        if (Verbose)
+                        {
+                            MiDumperPrint(CalledFromDbg, "'%c%c%c%c'\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\n", Tag[0], Tag[1], Tag[2], Tag[3],
+                                          TableEntry->NonPagedAllocs, TableEntry->NonPagedFrees,
+                                          (TableEntry->NonPagedAllocs - TableEntry->NonPagedFrees), TableEntry->NonPagedBytes,
+                                          TableEntry->PagedAllocs, TableEntry->PagedFrees,
+                                          (TableEntry->PagedAllocs - TableEntry->PagedFrees), TableEntry->PagedBytes);
+                        }
+                        else
+                        {
+                            MiDumperPrint(CalledFromDbg, "'%c%c%c%c'\t\t%ld\t\t%ld\t\t%ld\t\t%ld\n", Tag[0], Tag[1], Tag[2], Tag[3],
+                                          TableEntry->NonPagedAllocs, TableEntry->NonPagedBytes,
+                                          TableEntry->PagedAllocs, TableEntry->PagedBytes);
+                        }
                     }
                     else
                     {
-                        MiDumperPrint(CalledFromDbg, "'%c%c%c%c'\t\t%ld\t\t%ld\t\t%ld\t\t%ld\n", Tag[0], Tag[1], Tag[2], Tag[3],
-                                      TableEntry->NonPagedAllocs, TableEntry->NonPagedBytes,
-                                      TableEntry->PagedAllocs, TableEntry->PagedBytes);
+                        if (Verbose)
+                        {
+                            MiDumperPrint(CalledFromDbg, "0x%08x\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\n", TableEntry->Key,
+                                          TableEntry->NonPagedAllocs, TableEntry->NonPagedFrees,
+                                          (TableEntry->NonPagedAllocs - TableEntry->NonPagedFrees), TableEntry->NonPagedBytes,
+                                          TableEntry->PagedAllocs, TableEntry->PagedFrees,
+                                          (TableEntry->PagedAllocs - TableEntry->PagedFrees), TableEntry->PagedBytes);
+                        }
+                        else
+                        {
+                            MiDumperPrint(CalledFromDbg, "0x%08x\t%ld\t\t%ld\t\t%ld\t\t%ld\n", TableEntry->Key,
+                                          TableEntry->NonPagedAllocs, TableEntry->NonPagedBytes,
+                                          TableEntry->PagedAllocs, TableEntry->PagedBytes);
+                        }
                     }
                 }
-                else
+                else if (Tag == 0 || (Tag & Mask) == (TAG_NONE & Mask))
                 {
                     if (Verbose)
                     {
-                        MiDumperPrint(CalledFromDbg, "0x%08x\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\n", TableEntry->Key,
+                        MiDumperPrint(CalledFromDbg, "Anon\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\n",
                                       TableEntry->NonPagedAllocs, TableEntry->NonPagedFrees,
                                       (TableEntry->NonPagedAllocs - TableEntry->NonPagedFrees), TableEntry->NonPagedBytes,
                                       TableEntry->PagedAllocs, TableEntry->PagedFrees,
@@ -587,29 +795,12 @@ MiDumpPoolConsumers(BOOLEAN CalledFromDbg, ULONG Tag, ULONG Mask, ULONG Flags)
                     }
                     else
                     {
-                        MiDumperPrint(CalledFromDbg, "0x%08x\t%ld\t\t%ld\t\t%ld\t\t%ld\n", TableEntry->Key,
+                        MiDumperPrint(CalledFromDbg, "Anon\t\t%ld\t\t%ld\t\t%ld\t\t%ld\n",
                                       TableEntry->NonPagedAllocs, TableEntry->NonPagedBytes,
                                       TableEntry->PagedAllocs, TableEntry->PagedBytes);
                     }
                 }
             }
-            else if (Tag == 0 || (Tag & Mask) == (TAG_NONE & Mask))
-            {
-                if (Verbose)
-                {
-                    MiDumperPrint(CalledFromDbg, "Anon\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\n",
-                                  TableEntry->NonPagedAllocs, TableEntry->NonPagedFrees,
-                                  (TableEntry->NonPagedAllocs - TableEntry->NonPagedFrees), TableEntry->NonPagedBytes,
-                                  TableEntry->PagedAllocs, TableEntry->PagedFrees,
-                                  (TableEntry->PagedAllocs - TableEntry->PagedFrees), TableEntry->PagedBytes);
-                }
-                else
-                {
-                    MiDumperPrint(CalledFromDbg, "Anon\t\t%ld\t\t%ld\t\t%ld\t\t%ld\n",
-                                  TableEntry->NonPagedAllocs, TableEntry->NonPagedBytes,
-                                  TableEntry->PagedAllocs, TableEntry->PagedBytes);
-                }
-            }
         }
     }
 
@@ -625,10 +816,9 @@ MiDumpPoolConsumers(BOOLEAN CalledFromDbg, ULONG Tag, ULONG Mask, ULONG Flags)
 CODE_SEG("INIT")
 VOID
 NTAPI
-ExpSeedHotTags(VOID)
+ExpSeedHotTags(IN PPOOL_TRACKER_TABLE TrackTable)
 {
     ULONG i, Key, Hash, Index;
-    PPOOL_TRACKER_TABLE TrackTable = PoolTrackTable;
     ULONG TagList[] =
     {
         '  oI',
@@ -749,9 +939,7 @@ ExpRemovePoolTracker(IN ULONG Key,
                      IN SIZE_T NumberOfBytes,
                      IN POOL_TYPE PoolType)
 {
-    ULONG Hash, Index;
     PPOOL_TRACKER_TABLE Table, TableEntry;
-    SIZE_T TableMask, TableSize;
 
     //
     // Remove the PROTECTED_POOL flag which is not part of the tag
@@ -772,66 +960,37 @@ ExpRemovePoolTracker(IN ULONG Key,
     // way so that the day we DO support session pool, it won't require that
     // many changes
     //
-    Table = PoolTrackTable;
-    TableMask = PoolTrackTableMask;
-    TableSize = PoolTrackTableSize;
-    DBG_UNREFERENCED_LOCAL_VARIABLE(TableSize);
+    Table = ExpGetPoolTrackerTable();
 
     //
-    // Compute the hash for this key, and loop all the possible buckets
+    // The block may have been allocated on another processor, in which case
+    // this is the first time this table sees the tag and the counters of this
+    // processor will go negative. They only make sense once summed up.
     //
-    Hash = ExpComputeHashForTag(Key, TableMask);
-    Index = Hash;
-    while (TRUE)
+    TableEntry = ExpFindOrCreatePoolTracker(Table, Key);
+    if (!TableEntry)
     {
         //
-        // Have we found the entry for this tag? */
-        //
-        TableEntry = &Table[Hash];
-        if (TableEntry->Key == Key)
-        {
-            //
-            // Decrement the counters depending on if this was paged or nonpaged
-            // pool
-            //
-            if ((PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
-            {
-                InterlockedIncrement(&TableEntry->NonPagedFrees);
-                InterlockedExchangeAddSizeT(&TableEntry->NonPagedBytes,
-                                            -(SSIZE_T)NumberOfBytes);
-                return;
-            }
-            InterlockedIncrement(&TableEntry->PagedFrees);
-            InterlockedExchangeAddSizeT(&TableEntry->PagedBytes,
-                                        -(SSIZE_T)NumberOfBytes);
-            return;
-        }
-
-        //
-        // We should have only ended up with an empty entry if we've reached
-        // the last bucket
-        //
-        if (!TableEntry->Key)
-        {
-            DPRINT1("Empty item reached in tracker table. Hash=0x%lx, TableMask=0x%lx, Tag=0x%08lx, NumberOfBytes=%lu, PoolType=%d\n",
-                    Hash, TableMask, Key, (ULONG)NumberOfBytes, PoolType);
-            ASSERT(Hash == TableMask);
-        }
-
-        //
-        // This path is hit when we don't have an entry, and the current bucket
-        // is full, so we simply try the next one
+        // All the buckets are full, and we need some expansion. This path is
+        // not yet supported in ReactOS and so we'll ignore the tag
         //
-        Hash = (Hash + 1) & TableMask;
-        if (Hash == Index) break;
+        DPRINT1("Out of pool tag space, ignoring...\n");
+        return;
     }
 
     //
-    // And finally this path is hit when all the buckets are full, and we need
-    // some expansion. This path is not yet supported in ReactOS and so we'll
-    // ignore the tag
+    // Decrement the counters depending on if this was paged or nonpaged pool
     //
-    DPRINT1("Out of pool tag space, ignoring...\n");
+    if ((PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
+    {
+        InterlockedIncrement(&TableEntry->NonPagedFrees);
+        InterlockedExchangeAddSizeT(&TableEntry->NonPagedBytes,
+                                    -(SSIZE_T)NumberOfBytes);
+        return;
+    }
+    InterlockedIncrement(&TableEntry->PagedFrees);
+    InterlockedExchangeAddSizeT(&TableEntry->PagedBytes,
+                                -(SSIZE_T)NumberOfBytes);
 }
 
 VOID
@@ -840,10 +999,7 @@ ExpInsertPoolTracker(IN ULONG Key,
                      IN SIZE_T NumberOfBytes,
                      IN POOL_TYPE PoolType)
 {
-    ULONG Hash, Index;
-    KIRQL OldIrql;
     PPOOL_TRACKER_TABLE Table, TableEntry;
-    SIZE_T TableMask, TableSize;
 
     //
     // Remove the PROTECTED_POOL flag which is not part of the tag
@@ -865,91 +1021,37 @@ ExpInsertPoolTracker(IN ULONG Key,
     // ASSERT on ReactOS features not yet supported
     //
     ASSERT(!(PoolType & SESSION_POOL_MASK));
-    ASSERT(KeGetCurrentProcessorNumber() == 0);
 
     //
-    // Why the double indirection? Because normally this function is also used
-    // when doing session pool allocations, which has another set of tables,
-    // sizes, and masks that live in session pool. Now we don't support session
-    // pool so we only ever use the regular tables, but I'm keeping the code this
-    // way so that the day we DO support session pool, it won't require that
-    // many changes
+    // Why the double indirection? See ExpRemovePoolTracker
     //
-    Table = PoolTrackTable;
-    TableMask = PoolTrackTableMask;
-    TableSize = PoolTrackTableSize;
-    DBG_UNREFERENCED_LOCAL_VARIABLE(TableSize);
+    Table = ExpGetPoolTrackerTable();
 
     //
-    // Compute the hash for this key, and loop all the possible buckets
+    // Find the entry for this tag, creating it if needed
     //
-    Hash = ExpComputeHashForTag(Key, TableMask);
-    Index = Hash;
-    while (TRUE)
+    TableEntry = ExpFindOrCreatePoolTracker(Table, Key);
+    if (!TableEntry)
     {
         //
-        // Do we already have an entry for this tag? */
+        // All the buckets are full, and we need some expansion. This path is
+        // not yet supported in ReactOS and so we'll ignore the tag
         //
-        TableEntry = &Table[Hash];
-        if (TableEntry->Key == Key)
-        {
-            //
-            // Increment the counters depending on if this was paged or nonpaged
-            // pool
-            //
-            if ((PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
-            {
-                InterlockedIncrement(&TableEntry->NonPagedAllocs);
-                InterlockedExchangeAddSizeT(&TableEntry->NonPagedBytes, NumberOfBytes);
-                return;
-            }
-            InterlockedIncrement(&TableEntry->PagedAllocs);
-            InterlockedExchangeAddSizeT(&TableEntry->PagedBytes, NumberOfBytes);
-            return;
-        }
-
-        //
-        // We don't have an entry yet, but we've found a free bucket for it
-        //
-        if (!(TableEntry->Key) && (Hash != PoolTrackTableSize - 1))
-        {
-            //
-            // We need to hold the lock while creating a new entry, since other
-            // processors might be in this code path as well
-            //
-            ExAcquireSpinLock(&ExpTaggedPoolLock, &OldIrql);
-            if (!PoolTrackTable[Hash].Key)
-            {
-                //
-                // We've won the race, so now create this entry in the bucket
-                //
-                ASSERT(Table[Hash].Key == 0);
-                PoolTrackTable[Hash].Key = Key;
-                TableEntry->Key = Key;
-            }
-            ExReleaseSpinLock(&ExpTaggedPoolLock, OldIrql);
-
-            //
-            // Now we force the loop to run again, and we should now end up in
-            // the code path above which does the interlocked increments...
-            //
-            continue;
-        }
-
-        //
-        // This path is hit when we don't have an entry, and the current bucket
-        // is full, so we simply try the next one
-        //
-        Hash = (Hash + 1) & TableMask;
-        if (Hash == Index) break;
+        DPRINT1("Out of pool tag space, ignoring...\n");
+        return;
     }
 
     //
-    // And finally this path is hit when all the buckets are full, and we need
-    // some expansion. This path is not yet supported in ReactOS and so we'll
-    // ignore the tag
+    // Increment the counters depending on if this was paged or nonpaged pool
     //
-    DPRINT1("Out of pool tag space, ignoring...\n");
+    if ((PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
+    {
+        InterlockedIncrement(&TableEntry->NonPagedAllocs);
+        InterlockedExchangeAddSizeT(&TableEntry->NonPagedBytes, NumberOfBytes);
+        return;
+    }
+    InterlockedIncrement(&TableEntry->PagedAllocs);
+    InterlockedExchangeAddSizeT(&TableEntry->PagedBytes, NumberOfBytes);
 }
 
 CODE_SEG("INIT")
@@ -1101,9 +1203,12 @@ InitializePool(IN POOL_TYPE PoolType,
                       PoolTrackTableSize * sizeof(POOL_TRACKER_TABLE));
 
         //
-        // Finally, add the most used tags to speed up those allocations
+        // Finally, add the most used tags to speed up those allocations. This
+        // table belongs to the boot processor, the others get their own once
+        // they are started.
         //
-        ExpSeedHotTags();
+        ExpSeedHotTags(PoolTrackTable);
+        ExPoolTagTables[0] = PoolTrackTable;
 
         //
         // We now do the exact same thing with the tracker table for big pages
@@ -1189,11 +1294,6 @@ InitializePool(IN POOL_TYPE PoolType,
                                             sizeof(POOL_TRACKER_BIG_PAGES)),
                              NonPagedPool);
 
-        //
-        // No support for NUMA systems at this time
-        //
-        ASSERT(KeNumberNodes == 1);
-
         //
         // Initialize the tag spinlock
         //
@@ -1208,14 +1308,46 @@ InitializePool(IN POOL_TYPE PoolType,
                                    0,
                                    Threshold,
                                    NULL);
-    }
-    else
-    {
+        ExpNonPagedPoolDescriptor[0] = &NonPagedPoolDescriptor;
+
         //
-        // No support for NUMA systems at this time
+        // On NUMA systems, every other node gets its own descriptor, so that
+        // small blocks of a node are carved out of (and freed into) the same
+        // pages. Those come from the node's own memory while it has free or
+        // zeroed pages left, and from the closest other node after that.
+        // These use their own spinlock rather than the global queued one.
         //
-        ASSERT(KeNumberNodes == 1);
+        for (i = 1; i < KeNumberNodes; i++)
+        {
+            Descriptor = ExAllocatePoolWithTag(NonPagedPool,
+                                               sizeof(KSPIN_LOCK) +
+                                               sizeof(POOL_DESCRIPTOR),
+                                               'looP');
+            if (!Descriptor)
+            {
+                //
+                // Not fatal, the remaining nodes will share the first pool
+                //
+                DPRINT1("EXPOOL: No nonpaged pool descriptor for node %lu\n", i);
+                break;
+            }
 
+            KeInitializeSpinLock((PKSPIN_LOCK)(Descriptor + 1));
+            ExInitializePoolDescriptor(Descriptor,
+                                       NonPagedPool,
+                                       i,
+                                       Threshold,
+                                       Descriptor + 1);
+            ExpNonPagedPoolDescriptor[i] = Descriptor;
+        }
+
+        //
+        // Only switch to per-node pools once all the descriptors exist
+        //
+        ExpNumberOfNonPagedPools = (i == KeNumberNodes) ? i : 1;
+    }
+    else
+    {
         //
         // Allocate the pool descriptor
         //
@@ -1257,6 +1389,44 @@ InitializePool(IN POOL_TYPE PoolType,
     }
 }
 
+CODE_SEG("INIT")
+VOID
+NTAPI
+ExpInitializePoolTagTables(VOID)
+{
+    PPOOL_TRACKER_TABLE Table;
+    SIZE_T TableSize;
+    ULONG i;
+
+    //
+    // Now that all the processors are running, give each of them its own
+    // tracker table. It has the same size, and so the same hash, as the boot
+    // one, which makes merging them cheap.
+    //
+    TableSize = PoolTrackTableSize * sizeof(POOL_TRACKER_TABLE);
+    for (i = 1; i < (ULONG)KeNumberProcessors; i++)
+    {
+        Table = MiAllocatePoolPages(NonPagedPool, TableSize);
+        if (!Table)
+        {
+            //
+            // Not fatal, this processor will keep sharing the boot table
+            //
+            DPRINT1("EXPOOL: No tracker table for processor %lu\n", i);
+            break;
+        }
+
+        RtlZeroMemory(Table, TableSize);
+        ExpSeedHotTags(Table);
+        InterlockedExchangePointer((PVOID*)&ExPoolTagTables[i], Table);
+
+        //
+        // Account for it like for the boot table
+        //
+        ExpInsertPoolTracker('looP', ROUND_TO_PAGES(TableSize), NonPagedPool);
+    }
+}
+
 FORCEINLINE
 KIRQL
 ExLockPool(IN PPOOL_DESCRIPTOR Descriptor)
@@ -1267,8 +1437,14 @@ ExLockPool(IN PPOOL_DESCRIPTOR Descriptor)
     if ((Descriptor->PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
     {
         //
-        // Use the queued spin lock
+        // Node pools have their own spin lock, the first one uses the queued one
         //
+        if (Descriptor->LockAddress)
+        {
+            KIRQL OldIrql;
+            KeAcquireSpinLock(Descriptor->LockAddress, &OldIrql);
+            return OldIrql;
+        }
         return KeAcquireQueuedSpinLock(LockQueueNonPagedPoolLock);
     }
     else
@@ -1292,8 +1468,13 @@ ExUnlockPool(IN PPOOL_DESCRIPTOR Descriptor,
     if ((Descriptor->PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
     {
         //
-        // Use the queued spin lock
+        // Node pools have their own spin lock, the first one uses the queued one
         //
+        if (Descriptor->LockAddress)
+        {
+            KeReleaseSpinLock(Descriptor->LockAddress, OldIrql);
+            return;
+        }
         KeReleaseQueuedSpinLock(LockQueueNonPagedPoolLock, OldIrql);
     }
     else
@@ -1313,6 +1494,8 @@ ExpGetPoolTagInfoTarget(IN PKDPC Dpc,
                         IN PVOID SystemArgument2)
 {
     PPOOL_DPC_CONTEXT Context = DeferredContext;
+    PPOOL_TRACKER_TABLE Table;
+    ULONG i, j;
     UNREFERENCED_PARAMETER(Dpc);
     ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
 
@@ -1325,6 +1508,25 @@ ExpGetPoolTagInfoTarget(IN PKDPC Dpc,
                       PoolTrackTable,
                       Context->PoolTrackTableSize * sizeof(POOL_TRACKER_TABLE));
 
+        //
+        // Then fold the tables of the other processors into it. They are all
+        // spinning in here too, so none of them is changing right now.
+        //
+        for (i = 1; i < (ULONG)KeNumberProcessors; i++)
+        {
+            Table = ExPoolTagTables[i];
+            if (!Table) continue;
+
+            for (j = 0; j < Context->PoolTrackTableSize; j++)
+            {
+                if (!Table[j].Key) continue;
+                if (!ExpAccumulatePoolTracker(Context->PoolTrackTable, &Table[j]))
+                {
+                    DPRINT1("Out of pool tag space merging 0x%08lx, ignoring...\n", Table[j].Key);
+                }
+            }
+        }
+
         //
         // This is here because ReactOS does not yet support expansion
         //
@@ -1445,6 +1647,98 @@ ExGetPoolTagInfo(IN PSYSTEM_POOLTAG_INFORMATION SystemInformation,
     return Status;
 }
 
+NTSTATUS
+NTAPI
+ExGetBigPoolInfo(IN PSYSTEM_BIGPOOL_INFORMATION SystemInformation,
+                 IN ULONG SystemInformationLength,
+                 IN OUT PULONG ReturnLength OPTIONAL)
+{
+    ULONG TableSize, CurrentLength;
+    SIZE_T EntryCount;
+    KIRQL OldIrql;
+    NTSTATUS Status = STATUS_SUCCESS;
+    PSYSTEM_BIGPOOL_ENTRY BigEntry;
+    PPOOL_TRACKER_BIG_PAGES Buffer, TrackerEntry;
+    ASSERT(KeGetCurrentIrql() == PASSIVE_LEVEL);
+
+    //
+    // Keep track of how much data the caller's buffer must hold
+    //
+    CurrentLength = FIELD_OFFSET(SYSTEM_BIGPOOL_INFORMATION, AllocatedInfo);
+
+    //
+    // Initialize the caller's buffer
+    //
+    BigEntry = &SystemInformation->AllocatedInfo[0];
+    SystemInformation->Count = 0;
+
+    //
+    // The caller's buffer may be pageable, so take a copy of the table under
+    // the lock first. It can grow while we allocate, in which case retry.
+    //
+    while (TRUE)
+    {
+        EntryCount = PoolBigPageTableSize;
+        TableSize = (ULONG)(EntryCount * sizeof(POOL_TRACKER_BIG_PAGES));
+        Buffer = ExAllocatePoolWithTag(NonPagedPool, TableSize, 'ofnI');
+        if (!Buffer) return STATUS_INSUFFICIENT_RESOURCES;
+
+        KeAcquireSpinLock(&ExpLargePoolTableLock, &OldIrql);
+        if (EntryCount == PoolBigPageTableSize)
+        {
+            RtlCopyMemory(Buffer, PoolBigPageTable, TableSize);
+            KeReleaseSpinLock(&ExpLargePoolTableLock, OldIrql);
+            break;
+        }
+        KeReleaseSpinLock(&ExpLargePoolTableLock, OldIrql);
+        ExFreePoolWithTag(Buffer, 'ofnI');
+    }
+
+    //
+    // Now parse the results
+    //
+    for (TrackerEntry = Buffer; TrackerEntry < (Buffer + EntryCount); TrackerEntry++)
+    {
+        //
+        // If the entry is free, skip it
+        //
+        if ((ULONG_PTR)TrackerEntry->Va & POOL_BIG_TABLE_ENTRY_FREE) continue;
+
+        //
+        // Otherwise, add one more entry to the caller's buffer. Just like for
+        // the tags, keep counting when it is too small so that the caller knows
+        // how much space is needed.
+        //
+        SystemInformation->Count++;
+        CurrentLength += sizeof(*BigEntry);
+        if (SystemInformationLength < CurrentLength)
+        {
+            Status = STATUS_INFO_LENGTH_MISMATCH;
+        }
+        else
+        {
+            //
+            // The low bit of the address tells whether this is nonpaged pool
+            //
+            BigEntry->VirtualAddress = TrackerEntry->Va;
+            if (MmDeterminePoolType(TrackerEntry->Va) == NonPagedPool)
+            {
+                BigEntry->NonPaged = 1;
+            }
+            BigEntry->SizeInBytes = (SIZE_T)TrackerEntry->NumberOfPages << PAGE_SHIFT;
+            BigEntry->TagUlong = TrackerEntry->Key;
+            BigEntry++;
+        }
+    }
+
+    //
+    // Free the temporary copy, return the buffer length and status
+    //
+    ExFreePoolWithTag(Buffer, 'ofnI');
+    if (ReturnLength) *ReturnLength = CurrentLength;
+    return Status;
+}
+
 _IRQL_requires_(DISPATCH_LEVEL)
 BOOLEAN
 NTAPI
@@ -1753,10 +2047,9 @@ ExQueryPoolUsage(OUT PULONG PagedPoolPages,
     // If the system has more than one non-paged pool, copy the other descriptor
     // totals as well
     //
-#if 0
     if (ExpNumberOfNonPagedPools > 1)
     {
-        for (i = 0; i < ExpNumberOfNonPagedPools; i++)
+        for (i = 1; i < ExpNumberOfNonPagedPools; i++)
         {
             PoolDesc = ExpNonPagedPoolDescriptor[i];
             *NonPagedPoolPages += PoolDesc->TotalPages + PoolDesc->TotalBigPages;
@@ -1764,7 +2057,6 @@ ExQueryPoolUsage(OUT PULONG PagedPoolPages,
             *NonPagedPoolFrees += PoolDesc->RunningDeAllocs;
         }
     }
-#endif
 
     //
     // Get the amount of hits in the system lookaside lists
@@ -2006,6 +2298,14 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
         return Entry;
     }
 
+    //
+    // On NUMA systems, small nonpaged blocks come from the current node's pool
+    //
+    if ((PoolType == NonPagedPool) && (ExpNumberOfNonPagedPools > 1))
+    {
+        PoolDesc = ExpNonPagedPoolDescriptor[Prcb->ParentNode->NodeNumber];
+    }
+
     //
     // Should never request 0 bytes from the pool, but since so many drivers do
     // it, we'll just assume they want 1 byte, based on NT's similar behavior
@@ -2211,6 +2511,7 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
                 // was, and the actual size the caller needs/requested.
                 //
                 FragmentEntry->PoolType = 0;
+                FragmentEntry->PoolIndex = PoolDesc->PoolIndex;
                 BlockSize = FragmentEntry->BlockSize;
 
                 //
@@ -2235,6 +2536,7 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
             // and release the lock since we're done
             //
             Entry->PoolType = OriginalType + 1;
+            Entry->PoolIndex = PoolDesc->PoolIndex;
             ExpCheckPoolBlocks(Entry);
             ExUnlockPool(PoolDesc, OldIrql);
 
@@ -2334,6 +2636,7 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
     Entry->Ulong1 = 0;
     Entry->BlockSize = i;
     Entry->PoolType = OriginalType + 1;
+    Entry->PoolIndex = PoolDesc->PoolIndex;
 
     //
     // This page will have two entries -- one for the allocation (which we just
@@ -2346,6 +2649,7 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
     FragmentEntry->Ulong1 = 0;
     FragmentEntry->BlockSize = BlockSize;
     FragmentEntry->PreviousSize = i;
+    FragmentEntry->PoolIndex = PoolDesc->PoolIndex;
 
     //
     // Increment required counters
@@ -2617,6 +2921,14 @@ ExFreePoolWithTag(IN PVOID P,
     PoolType = (Entry->PoolType - 1) & BASE_POOL_TYPE_MASK;
     PoolDesc = PoolVector[PoolType];
 
+    //
+    // On NUMA systems, give nonpaged blocks back to the node they came from
+    //
+    if ((PoolType == NonPagedPool) && (ExpNumberOfNonPagedPools > 1))
+    {
+        PoolDesc = ExpNonPagedPoolDescriptor[Entry->PoolIndex];
+    }
+
     //
     // Make sure that the IRQL makes sense
     //
@@ -232,11 +232,16 @@ extern const ULONG MmProtectToValue[32];
 #define MM_NOIRQL (KIRQL)0xFFFFFFFF
 
 //
-// Returns the color of a page
+// Returns the color of a page. On NUMA systems, the node of the page is
+// stored above MmSecondaryColorNodeShift, and allocations prefer the node
+// of the current processor.
 //
+#define MI_CURRENT_NODE_COLOR               (KeGetCurrentPrcb()->NodeShiftedColor)
 #define MI_GET_PAGE_COLOR(x)                ((x) & MmSecondaryColorMask)
-#define MI_GET_NEXT_COLOR()                 (MI_GET_PAGE_COLOR(++MmSystemPageColor))
-#define MI_GET_NEXT_PROCESS_COLOR(x)        (MI_GET_PAGE_COLOR(++(x)->NextPageColor))
+#define MI_GET_PFN_COLOR(x)                 (MI_GET_PAGE_COLOR(x) | (MiGetPageNode(x) << MmSecondaryColorNodeShift))
+#define MI_GET_COLOR_NODE(x)                (KeNodeBlock[(x) >> MmSecondaryColorNodeShift])
+#define MI_GET_NEXT_COLOR()                 (MI_GET_PAGE_COLOR(++MmSystemPageColor) | MI_CURRENT_NODE_COLOR)
+#define MI_GET_NEXT_PROCESS_COLOR(x)        (MI_GET_PAGE_COLOR(++(x)->NextPageColor) | MI_CURRENT_NODE_COLOR)
 
 //
 // Prototype PTEs that don't yet have a pagefile association
@@ -439,6 +444,15 @@ typedef struct _MMCOLOR_TABLES
     PFN_NUMBER Count;
 } MMCOLOR_TABLES, *PMMCOLOR_TABLES;
 
+#define MI_MAX_NODE_RANGES 32
+
+typedef struct _MI_NODE_RANGE
+{
+    PFN_NUMBER BasePage;
+    PFN_NUMBER EndPage;
+    ULONG Node;
+} MI_NODE_RANGE, *PMI_NODE_RANGE;
+
 typedef struct _MI_LARGE_PAGE_RANGES
 {
     PFN_NUMBER StartFrame;
@@ -604,6 +618,10 @@ extern SIZE_T MmDefaultMaximumNonPagedPool;
 extern ULONG MmMaxAdditionNonPagedPoolPerMb;
 extern ULONG MmSecondaryColors;
 extern ULONG MmSecondaryColorMask;
+extern ULONG MmSecondaryColorNodeShift;
+extern MI_NODE_RANGE MiNodeRanges[MI_MAX_NODE_RANGES];
+extern ULONG MiNumberOfNodeRanges;
+extern UCHAR MiNodeFallbackOrder[MAXIMUM_NUMA_NODES][MAXIMUM_NUMA_NODES];
 extern ULONG MmNumberOfSystemPtes;
 extern ULONG MmMaximumNonPagedPoolPercent;
 extern ULONG MmLargeStackSize;
@@ -664,6 +682,25 @@ extern LIST_ENTRY MmWorkingSetExpansionHead;
 extern KSPIN_LOCK MmExpansionLock;
 extern PETHREAD MiExpansionLockOwner;
 
+FORCEINLINE
+ULONG
+MiGetPageNode(IN PFN_NUMBER PageFrameIndex)
+{
+    ULONG i;
+
+    /* Without NUMA, all memory is on the first node */
+    for (i = 0; i < MiNumberOfNodeRanges; i++)
+    {
+        if ((PageFrameIndex >= MiNodeRanges[i].BasePage) &&
+            (PageFrameIndex < MiNodeRanges[i].EndPage))
+        {
+            return MiNodeRanges[i].Node;
+        }
+    }
+
+    return 0;
+}
+
 FORCEINLINE
 BOOLEAN
 MiIsMemoryTypeFree(TYPE_OF_MEMORY MemoryType)
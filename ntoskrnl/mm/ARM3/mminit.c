@@ -256,6 +256,15 @@ PVOID MmHyperSpaceEnd;
 ULONG MmSecondaryColors;
 ULONG MmSecondaryColorMask;
 
+//
+// NUMA node of each physical page range, and the order in which nodes are
+// tried when the local one runs out of pages (nearest first, per the SLIT)
+//
+ULONG MmSecondaryColorNodeShift;
+MI_NODE_RANGE MiNodeRanges[MI_MAX_NODE_RANGES];
+ULONG MiNumberOfNodeRanges;
+UCHAR MiNodeFallbackOrder[MAXIMUM_NUMA_NODES][MAXIMUM_NUMA_NODES];
+
 //
 // Actual (registry-configurable) size of a GUI thread's stack
 //
@@ -507,7 +516,8 @@ VOID
 NTAPI
 MiComputeColorInformation(VOID)
 {
-    ULONG L2Associativity;
+    ULONG L2Associativity, i;
+    PKPRCB Prcb;
 
     /* Check if no setting was provided already */
     if (!MmSecondaryColors)
@@ -554,6 +564,165 @@ MiComputeColorInformation(VOID)
     /* Compute the mask and store it */
     MmSecondaryColorMask = MmSecondaryColors - 1;
     KeGetCurrentPrcb()->SecondaryColorMask = MmSecondaryColorMask;
+
+    /* The node of a color is stored above the mask */
+    while ((1UL << MmSecondaryColorNodeShift) < MmSecondaryColors)
+    {
+        MmSecondaryColorNodeShift++;
+    }
+
+    /* On NUMA systems, each node gets its own set of colors */
+    if (KeNumberNodes > 1)
+    {
+        /* Tell each node where its colors start */
+        for (i = 0; i < KeNumberNodes; i++)
+        {
+            KeNodeBlock[i]->MmShiftedColor = i << MmSecondaryColorNodeShift;
+        }
+
+        /* And grow the color tables to cover all the nodes */
+        MmSecondaryColors *= KeNumberNodes;
+    }
+
+    /* Now that node colors are known, set them for the boot processor */
+    Prcb = KeGetCurrentPrcb();
+    Prcb->NodeColor = Prcb->ParentNode->Color;
+    Prcb->NodeShiftedColor = Prcb->ParentNode->MmShiftedColor;
+}
+
+CODE_SEG("INIT")
+VOID
+NTAPI
+MiAddNodeRange(IN PFN_NUMBER BasePage,
+               IN PFN_NUMBER EndPage,
+               IN ULONG Node)
+{
+    PMI_NODE_RANGE LastRange;
+
+    /* Pages that belong to no range are on the first node */
+    if (Node == 0) return;
+
+    /* Extend the previous range if this one follows it */
+    if (MiNumberOfNodeRanges)
+    {
+        LastRange = &MiNodeRanges[MiNumberOfNodeRanges - 1];
+        if ((LastRange->EndPage == BasePage) && (LastRange->Node == Node))
+        {
+            LastRange->EndPage = EndPage;
+            return;
+        }
+    }
+
+    /* Otherwise, add a new one if there's still room */
+    if (MiNumberOfNodeRanges == MI_MAX_NODE_RANGES)
+    {
+        DPRINT1("Too many NUMA memory ranges, %Ix-%Ix will be on node 0\n",
+                BasePage, EndPage);
+        return;
+    }
+    MiNodeRanges[MiNumberOfNodeRanges].BasePage = BasePage;
+    MiNodeRanges[MiNumberOfNodeRanges].EndPage = EndPage;
+    MiNodeRanges[MiNumberOfNodeRanges].Node = Node;
+    MiNumberOfNodeRanges++;
+}
+
+CODE_SEG("INIT")
+VOID
+NTAPI
+MiInitializeNodeInformation(IN PLOADER_PARAMETER_BLOCK LoaderBlock)
+{
+    PLIST_ENTRY ListEntry;
+    PMEMORY_ALLOCATION_DESCRIPTOR Descriptor;
+    PFN_NUMBER PageFrameIndex, RunStart, EndPage, Step;
+    ULONG Node, RunNode, i, j, Count;
+    UCHAR Candidate;
+
+    /* Without NUMA, all pages are on the first node and nothing to do */
+    if (KeNumberNodes == 1) return;
+
+    /* Loop the memory descriptors */
+    for (ListEntry = LoaderBlock->MemoryDescriptorListHead.Flink;
+         ListEntry != &LoaderBlock->MemoryDescriptorListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        /* Get the descriptor */
+        Descriptor = CONTAINING_RECORD(ListEntry,
+                                       MEMORY_ALLOCATION_DESCRIPTOR,
+                                       ListEntry);
+
+        /* Skip invisible memory, it never makes it into the PFN database */
+        if ((Descriptor->MemoryType == LoaderFirmwarePermanent) ||
+            (Descriptor->MemoryType == LoaderSpecialMemory) ||
+            (Descriptor->MemoryType == LoaderHALCachedMemory) ||
+            (Descriptor->MemoryType == LoaderBBTMemory) ||
+            (Descriptor->PageCount == 0))
+        {
+            continue;
+        }
+
+        /*
+         * Walk the descriptor in large steps, and only look at each page
+         * when the node changes in between, since ranges are huge
+         */
+        RunStart = Descriptor->BasePage;
+        EndPage = Descriptor->BasePage + Descriptor->PageCount;
+        RunNode = KiNumaTopology.PageToNode(RunStart);
+        PageFrameIndex = RunStart;
+        while (PageFrameIndex < EndPage)
+        {
+            Step = min(256, EndPage - PageFrameIndex);
+            Node = KiNumaTopology.PageToNode(PageFrameIndex + Step - 1);
+            if (Node != RunNode)
+            {
+                /* Find the exact page where the node changes */
+                while (KiNumaTopology.PageToNode(PageFrameIndex) == RunNode)
+                {
+                    PageFrameIndex++;
+                }
+
+                /* Close the current run and start a new one */
+                MiAddNodeRange(RunStart, PageFrameIndex, RunNode);
+                RunStart = PageFrameIndex;
+                RunNode = KiNumaTopology.PageToNode(PageFrameIndex);
+                continue;
+            }
+
+            PageFrameIndex += Step;
+        }
+
+        /* Close the last run of the descriptor */
+        MiAddNodeRange(RunStart, EndPage, RunNode);
+    }
+
+    /* Now build the order in which each node borrows from the others */
+    for (i = 0; i < KeNumberNodes; i++)
+    {
+        /* Start with the node itself, followed by the others in order */
+        MiNodeFallbackOrder[i][0] = (UCHAR)i;
+        Count = 1;
+        for (j = 0; j < KeNumberNodes; j++)
+        {
+            if (j != i) MiNodeFallbackOrder[i][Count++] = (UCHAR)j;
+        }
+
+        /* Then sort the others by their distance, closest first */
+        for (j = 2; j < Count; j++)
+        {
+            Candidate = MiNodeFallbackOrder[i][j];
+            for (Node = j;
+                 (Node > 1) &&
+                 (KiNumaTopology.QueryNodeDistance((UCHAR)i, MiNodeFallbackOrder[i][Node - 1]) >
+                  KiNumaTopology.QueryNodeDistance((UCHAR)i, Candidate));
+                 Node--)
+            {
+                MiNodeFallbackOrder[i][Node] = MiNodeFallbackOrder[i][Node - 1];
+            }
+            MiNodeFallbackOrder[i][Node] = Candidate;
+        }
+    }
+
+    DPRINT1("NUMA: %lu nodes, %lu memory ranges, color shift %lu\n",
+            KeNumberNodes, MiNumberOfNodeRanges, MmSecondaryColorNodeShift);
 }
 
 CODE_SEG("INIT")
@@ -2283,6 +2452,9 @@ MmArmInitSystem(IN ULONG Phase,
         /* Compute color information (L2 cache-separated paging lists) */
         MiComputeColorInformation();
 
+        /* Figure out which node each page belongs to */
+        MiInitializeNodeInformation(LoaderBlock);
+
         // Calculate the number of bytes for the PFN database
         // then add the color tables and convert to pages
         MxPfnAllocation = (MmHighestPhysicalPage + 1) * sizeof(MMPFN);
@@ -191,7 +191,7 @@ MiUnlinkFreeOrZeroedPage(IN PMMPFN Entry)
 
     /* Get the page color */
     OldBlink = MiGetPfnEntryIndex(Entry);
-    Color = OldBlink & MmSecondaryColorMask;
+    Color = MI_GET_PFN_COLOR(OldBlink);
 
     /* Get the first page on the color list */
     ColorTable = &MmFreePagesByColor[ListName][Color];
@@ -239,6 +239,7 @@ MiUnlinkFreeOrZeroedPage(IN PMMPFN Entry)
     /* One less colored page */
     ASSERT(ColorTable->Count >= 1);
     ColorTable->Count--;
+    MI_GET_COLOR_NODE(Color)->FreeCount[ListName]--;
 
     /* ReactOS Hack */
     Entry->OriginalPte.u.Long = 0;
@@ -451,6 +452,7 @@ MiRemovePageByColor(IN PFN_NUMBER PageIndex,
 
     /* One less page */
     ColorTable->Count--;
+    MI_GET_COLOR_NODE(Color)->FreeCount[ListName]--;
 
     /* ReactOS Hack */
     Pfn1->OriginalPte.u.Long = 0;
@@ -470,6 +472,65 @@ MiRemovePageByColor(IN PFN_NUMBER PageIndex,
     return PageIndex;
 }
 
+static
+PFN_NUMBER
+MiFindPageOnNode(IN PKNODE Node,
+                 IN MMLISTS ListName,
+                 IN ULONG CacheColor,
+                 OUT PULONG Color)
+{
+    PFN_NUMBER PageIndex;
+    ULONG i;
+
+    /* Skip nodes that have nothing on this list */
+    if (!Node->FreeCount[ListName]) return LIST_HEAD;
+
+    /* Loop its colors, starting with the one that was asked for */
+    for (i = 0; i <= MmSecondaryColorMask; i++)
+    {
+        PageIndex = MmFreePagesByColor[ListName][Node->MmShiftedColor |
+                                                 MI_GET_PAGE_COLOR(CacheColor + i)].Flink;
+        if (PageIndex != LIST_HEAD)
+        {
+            /* Found one */
+            *Color = Node->MmShiftedColor | MI_GET_PAGE_COLOR(CacheColor + i);
+            return PageIndex;
+        }
+    }
+
+    return LIST_HEAD;
+}
+
+static
+PFN_NUMBER
+MiFindNodePage(IN MMLISTS ListName,
+               IN BOOLEAN TryZeroed,
+               IN OUT PULONG Color)
+{
+    PKNODE Node;
+    PFN_NUMBER PageIndex;
+    ULONG i, CacheColor;
+    PUCHAR FallbackOrder;
+
+    /* Walk the nodes from the closest to the furthest, starting with our own */
+    FallbackOrder = MiNodeFallbackOrder[*Color >> MmSecondaryColorNodeShift];
+    CacheColor = MI_GET_PAGE_COLOR(*Color);
+    for (i = 0; i < KeNumberNodes; i++)
+    {
+        /* Empty both lists of a node before moving on to a further one */
+        Node = KeNodeBlock[FallbackOrder[i]];
+        PageIndex = MiFindPageOnNode(Node, ListName, CacheColor, Color);
+        if ((PageIndex == LIST_HEAD) && (TryZeroed))
+        {
+            PageIndex = MiFindPageOnNode(Node, ZeroedPageList, CacheColor, Color);
+        }
+        if (PageIndex != LIST_HEAD) return PageIndex;
+    }
+
+    /* Nothing on any node */
+    return LIST_HEAD;
+}
+
 PFN_NUMBER
 NTAPI
 MiRemoveAnyPage(IN ULONG Color)
@@ -488,18 +549,22 @@ MiRemoveAnyPage(IN ULONG Color)
     {
         /* Check the colored zero list */
         PageIndex = MmFreePagesByColor[ZeroedPageList][Color].Flink;
+        if ((PageIndex == LIST_HEAD) && (KeNumberNodes > 1))
+        {
+            /* Try the other colors of our node, then the closest nodes */
+            PageIndex = MiFindNodePage(FreePageList, TRUE, &Color);
+        }
+
         if (PageIndex == LIST_HEAD)
         {
             /* Check the free list */
             ASSERT_LIST_INVARIANT(&MmFreePageListHead);
             PageIndex = MmFreePageListHead.Flink;
-            Color = PageIndex & MmSecondaryColorMask;
             if (PageIndex == LIST_HEAD)
             {
                 /* Check the zero list */
                 ASSERT_LIST_INVARIANT(&MmZeroedPageListHead);
                 PageIndex = MmZeroedPageListHead.Flink;
-                Color = PageIndex & MmSecondaryColorMask;
                 ASSERT(PageIndex != LIST_HEAD);
                 if (PageIndex == LIST_HEAD)
                 {
@@ -507,6 +572,9 @@ MiRemoveAnyPage(IN ULONG Color)
                     ASSERT(MmZeroedPageListHead.Total == 0);
                 }
             }
+
+            /* Get the color of the page we found */
+            Color = MI_GET_PFN_COLOR(PageIndex);
         }
     }
 
@@ -541,6 +609,12 @@ MiRemoveZeroPage(IN ULONG Color)
 
     /* Check the colored zero list */
     PageIndex = MmFreePagesByColor[ZeroedPageList][Color].Flink;
+    if ((PageIndex == LIST_HEAD) && (KeNumberNodes > 1))
+    {
+        /* Try the zero lists of the closest nodes first */
+        PageIndex = MiFindNodePage(ZeroedPageList, FALSE, &Color);
+    }
+
     if (PageIndex == LIST_HEAD)
     {
         /* Check the zero list */
@@ -554,12 +628,18 @@ MiRemoveZeroPage(IN ULONG Color)
 
             /* Check the colored free list */
             PageIndex = MmFreePagesByColor[FreePageList][Color].Flink;
+            if ((PageIndex == LIST_HEAD) && (KeNumberNodes > 1))
+            {
+                /* Try the free lists of the closest nodes first */
+                PageIndex = MiFindNodePage(FreePageList, FALSE, &Color);
+            }
+
             if (PageIndex == LIST_HEAD)
             {
                 /* Check the free list */
                 ASSERT_LIST_INVARIANT(&MmFreePageListHead);
                 PageIndex = MmFreePageListHead.Flink;
-                Color = PageIndex & MmSecondaryColorMask;
+                Color = MI_GET_PFN_COLOR(PageIndex);
                 ASSERT(PageIndex != LIST_HEAD);
                 if (PageIndex == LIST_HEAD)
                 {
@@ -570,7 +650,7 @@ MiRemoveZeroPage(IN ULONG Color)
         }
         else
         {
-            Color = PageIndex & MmSecondaryColorMask;
+            Color = MI_GET_PFN_COLOR(PageIndex);
         }
     }
 
@@ -671,7 +751,7 @@ MiInsertPageInFreeList(IN PFN_NUMBER PageFrameIndex)
     MiIncrementAvailablePages();
 
     /* Get the page color */
-    Color = PageFrameIndex & MmSecondaryColorMask;
+    Color = MI_GET_PFN_COLOR(PageFrameIndex);
 
     /* Get the first page on the color list */
     ColorTable = &MmFreePagesByColor[FreePageList][Color];
@@ -699,6 +779,7 @@ MiInsertPageInFreeList(IN PFN_NUMBER PageFrameIndex)
 
     /* And increase the count in the colored list */
     ColorTable->Count++;
+    MI_GET_COLOR_NODE(Color)->FreeCount[FreePageList]++;
 
     /* Notify zero page thread if enough pages are on the free list now */
     if (ListHead->Total >= 8)
@@ -905,7 +986,7 @@ MiInsertPageInList(IN PMMPFNLIST ListHead,
         ASSERT(Pfn1->u4.InPageError == 0);
 
         /* Get the page color */
-        Color = PageFrameIndex & MmSecondaryColorMask;
+        Color = MI_GET_PFN_COLOR(PageFrameIndex);
 
         /* Get the list for this color */
         ColorHead = &MmFreePagesByColor[ZeroedPageList][Color];
@@ -935,6 +1016,7 @@ MiInsertPageInList(IN PMMPFNLIST ListHead,
 
         /* One more paged on the colored list */
         ColorHead->Count++;
+        MI_GET_COLOR_NODE(Color)->FreeCount[ZeroedPageList]++;
 
 #if MI_TRACE_PFNS
             //ASSERT(MI_PFN_CURRENT_USAGE == MI_USAGE_NOT_SET);
@@ -1002,7 +1002,7 @@ _WARN("MiSessionCommitPageTables halfplemented for amd64")
             OldIrql = MiAcquirePfnLock();
             MI_SET_USAGE(MI_USAGE_PAGE_TABLE);
             MI_SET_PROCESS2(PsGetCurrentProcess()->ImageFileName);
-            Color = (++MmSessionSpace->Color) & MmSecondaryColorMask;
+            Color = MI_GET_PAGE_COLOR(++MmSessionSpace->Color) | MI_CURRENT_NODE_COLOR;
             PageFrameNumber = MiRemoveZeroPage(Color);
             TempPde.u.Hard.PageFrameNumber = PageFrameNumber;
             MI_WRITE_VALID_PDE(StartPde, TempPde);
@@ -221,6 +221,9 @@ MmAccessFault(IN ULONG FaultCode,
 #endif
     }
 
+    /* One more page fault */
+    InterlockedIncrement(&KeGetCurrentPrcb()->MmPageFaultCount);
+
     /* Handle shared user page, which doesn't have a VAD / MemoryArea */
     if (PAGE_ALIGN(Address) == (PVOID)MM_SHARED_USER_DATA_VA)
     {
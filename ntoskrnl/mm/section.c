@@ -62,6 +62,18 @@ extern MMSESSION MmSession;
 
 static LARGE_INTEGER TinyTime = {{-1L, -1L}};
 
+/*
+ * Page fault read clustering: a fault reads in a window of neighbouring pages
+ * with a single paging I/O. The window starts larger for images, which are
+ * mostly read in full, and doubles while a view is faulted in sequentially.
+ */
+#define MM_READ_CLUSTER_DATA    _64K
+#define MM_READ_CLUSTER_IMAGE   (2 * _64K)
+#define MM_READ_CLUSTER_MAX     (64 * PAGE_SIZE)
+
+/* Flushing writes runs of adjacent dirty pages with a single paging I/O */
+#define MM_WRITE_CLUSTER_MAX    (64 * PAGE_SIZE)
+
 #ifndef NEWCC
 KEVENT MmWaitPageEvent;
 
@@ -1180,6 +1192,25 @@ MiCopyFromUserPage(PFN_NUMBER DestPage, const VOID *SrcAddress)
     return STATUS_SUCCESS;
 }
 
+/* Scan a 64-bit page mask with the 32-bit intrinsics, which are available everywhere */
+FORCEINLINE
+BOOLEAN
+MiBitScanForwardPageMask(
+    _Out_ PULONG Index,
+    _In_ ULONG64 Mask)
+{
+    if (_BitScanForward(Index, (ULONG)Mask))
+        return TRUE;
+
+    if (_BitScanForward(Index, (ULONG)(Mask >> 32)))
+    {
+        *Index += 32;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
 static
 NTSTATUS
 NTAPI
@@ -1189,10 +1220,11 @@ MmMakeSegmentResident(
     _In_ ULONG Length,
     _In_opt_ PLARGE_INTEGER ValidDataLength)
 {
-    /* Let's use a 64K granularity. */
+    /* The range starts on a 64K boundary and is read in chunks of up to MM_READ_CLUSTER_MAX */
     LONGLONG RangeStart, RangeEnd;
     NTSTATUS Status;
     PFILE_OBJECT FileObject = Segment->FileObject;
+    PKPRCB Prcb;
 
     /* Calculate our range, aligned on 64K if possible. */
     Status = RtlLongLongAdd(Offset, Length, &RangeEnd);
@@ -1212,11 +1244,11 @@ MmMakeSegmentResident(
     }
 
     /* Let's gooooooooo */
-    for ( ; RangeStart < RangeEnd; RangeStart += _64K)
+    for ( ; RangeStart < RangeEnd; RangeStart += MM_READ_CLUSTER_MAX)
     {
         /* First take a look at where we miss pages */
-        ULONG ToReadPageBits = 0;
-        LONGLONG ChunkEnd = RangeStart + _64K;
+        ULONG64 ToReadPageBits = 0;
+        LONGLONG ChunkEnd = RangeStart + MM_READ_CLUSTER_MAX;
 
         if (ChunkEnd > RangeEnd)
             ChunkEnd = RangeEnd;
@@ -1246,7 +1278,7 @@ MmMakeSegmentResident(
                 continue;
             }
 
-            ToReadPageBits |= 1UL << ((ChunkOffset - RangeStart) >> PAGE_SHIFT);
+            ToReadPageBits |= 1ULL << ((ChunkOffset - RangeStart) >> PAGE_SHIFT);
 
             /* Put a wait entry here */
             MmSetPageEntrySectionSegment(Segment, &CurrentOffset, MAKE_SWAP_SSE(MM_WAIT_ENTRY));
@@ -1265,7 +1297,7 @@ MmMakeSegmentResident(
         {
             /* Move forward if there is a hole */
             ULONG BitSet;
-            if (!_BitScanForward(&BitSet, ToReadPageBits))
+            if (!MiBitScanForwardPageMask(&BitSet, ToReadPageBits))
             {
                 /* Nothing more to read */
                 break;
@@ -1274,11 +1306,12 @@ MmMakeSegmentResident(
             ChunkOffset += BitSet * PAGE_SIZE;
             ASSERT(ChunkOffset < ChunkEnd);
 
-            /* Get the range we have to read */
-            _BitScanForward(&BitSet, ~ToReadPageBits);
+            /* Get the range we have to read, the whole chunk if there is no hole */
+            if (!MiBitScanForwardPageMask(&BitSet, ~ToReadPageBits))
+                BitSet = 64;
             ULONG ReadLength = BitSet * PAGE_SIZE;
 
-            ASSERT(ReadLength <= _64K);
+            ASSERT(ReadLength <= MM_READ_CLUSTER_MAX);
 
             /* Clamp (This is for image mappings */
             if ((ChunkOffset + ReadLength) > ChunkEnd)
@@ -1355,6 +1388,11 @@ MmMakeSegmentResident(
 
             KeLowerIrql(OldIrql);
 
+            /* Account for the paging read, the ratio tells how well faults are clustered */
+            Prcb = KeGetCurrentPrcb();
+            InterlockedIncrement(&Prcb->MmPageReadIoCount);
+            InterlockedExchangeAdd(&Prcb->MmPageReadCount, BYTES_TO_PAGES(ReadLength));
+
             if (Status == STATUS_END_OF_FILE)
             {
                 DPRINT1("Got STATUS_END_OF_FILE at offset %I64d for file %wZ.\n", FileOffset.QuadPart, &FileObject->FileName);
@@ -1401,7 +1439,7 @@ AssignPagesToSegment:
             MmUnlockSectionSegment(Segment);
 
             IoFreeMdl(Mdl);
-            ToReadPageBits >>= BitSet;
+            ToReadPageBits = (BitSet < 64) ? (ToReadPageBits >> BitSet) : 0;
             ChunkOffset += BitSet * PAGE_SIZE;
         }
     }
@@ -1490,6 +1528,74 @@ MmAlterViewAttributes(PMMSUPPORT AddressSpace,
     MmUnlockSectionSegment(Segment);
 }
 
+FORCEINLINE
+VOID
+MiLogSectionPageFault(
+    _In_ PMM_SECTION_SEGMENT Segment,
+    _In_ PLARGE_INTEGER Offset,
+    _In_ BOOLEAN HardFault)
+{
+    LONGLONG LogOffset = Offset->QuadPart;
+    ULONG Flags = HardFault ? PF_FAULT_HARD : 0;
+
+    if (!CcPfEnablePrefetcher || Segment->FileObject == NULL)
+        return;
+
+    /* Image sections are logged by RVA, so that the prefetcher can replay them through a new section */
+    if (!FlagOn(*Segment->Flags, MM_DATAFILE_SEGMENT))
+    {
+        LogOffset += Segment->Image.VirtualAddress;
+        Flags |= PF_FAULT_IMAGE;
+    }
+
+    CcPfLogPageFault(Segment->FileObject, LogOffset, Flags);
+}
+
+/*
+ * Returns how many bytes to read in for a fault at the given segment offset,
+ * and remembers where the next fault of a sequential scan of the view would
+ * land. The address space must be locked.
+ */
+static
+ULONG
+MiGetFaultReadCluster(
+    _In_ PMEMORY_AREA MemoryArea,
+    _In_ PMM_SECTION_SEGMENT Segment,
+    _In_ LONGLONG Offset)
+{
+    ULONG Cluster = MemoryArea->SectionData.ReadCluster;
+    LONGLONG ViewEnd, ClusterEnd;
+
+    if ((Cluster != 0) && (Offset == MemoryArea->SectionData.NextFaultOffset))
+    {
+        /* The view is being read sequentially, read further ahead */
+        Cluster = min(Cluster * 2, MM_READ_CLUSTER_MAX);
+    }
+    else if (!FlagOn(*Segment->Flags, MM_DATAFILE_SEGMENT))
+    {
+        Cluster = MM_READ_CLUSTER_IMAGE;
+    }
+    else
+    {
+        Cluster = MM_READ_CLUSTER_DATA;
+    }
+    MemoryArea->SectionData.ReadCluster = Cluster;
+
+    /* The read starts on the 64K boundary below the fault, keep it within one chunk */
+    ClusterEnd = Offset - (Offset % _64K) + Cluster;
+
+    /* There's no point in reading past the end of the view */
+    ViewEnd = MemoryArea->SectionData.ViewOffset +
+              (MA_GetEndingAddress(MemoryArea) - MA_GetStartingAddress(MemoryArea));
+    if (ClusterEnd > ViewEnd)
+        ClusterEnd = ViewEnd;
+    if (ClusterEnd <= Offset)
+        ClusterEnd = Offset + PAGE_SIZE;
+
+    MemoryArea->SectionData.NextFaultOffset = ClusterEnd;
+    return (ULONG)(ClusterEnd - Offset);
+}
+
 NTSTATUS
 NTAPI
 MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
@@ -1498,6 +1604,7 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
                              BOOLEAN Locked)
 {
     LARGE_INTEGER Offset;
+    ULONG ReadLength;
     PFN_NUMBER Page;
     NTSTATUS Status;
     PMM_SECTION_SEGMENT Segment;
@@ -1745,15 +1852,19 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
             return STATUS_SUCCESS;
         }
 
+        ReadLength = MiGetFaultReadCluster(MemoryArea, Segment, Offset.QuadPart);
+
         MmUnlockSectionSegment(Segment);
         MmUnlockAddressSpace(AddressSpace);
 
+        MiLogSectionPageFault(Segment, &Offset, TRUE);
+
         /* The data must be paged in. Lock the file, so that the VDL doesn't get updated behind us. */
         FsRtlAcquireFileExclusive(Segment->FileObject);
 
         PFSRTL_COMMON_FCB_HEADER FcbHeader = Segment->FileObject->FsContext;
 
-        Status = MmMakeSegmentResident(Segment, Offset.QuadPart, PAGE_SIZE, &FcbHeader->ValidDataLength);
+        Status = MmMakeSegmentResident(Segment, Offset.QuadPart, ReadLength, &FcbHeader->ValidDataLength);
 
         FsRtlReleaseFile(Segment->FileObject);
 
@@ -1877,6 +1988,8 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
         MmSharePageEntrySectionSegment(Segment, &Offset);
         MmUnlockSectionSegment(Segment);
 
+        MiLogSectionPageFault(Segment, &Offset, FALSE);
+
         MiSetPageEvent(Process, Address);
         DPRINT("Address 0x%p\n", Address);
         return STATUS_SUCCESS;
@@ -4731,6 +4844,177 @@ MmMakeDataSectionResident(
     return Status;
 }
 
+static
+NTSTATUS
+MiPrefetchSegment(
+    _In_ PMM_SECTION_SEGMENT Segment,
+    _In_ LONGLONG Offset,
+    _In_ ULONG Length)
+{
+    NTSTATUS Status;
+    PFSRTL_COMMON_FCB_HEADER FcbHeader = Segment->FileObject->FsContext;
+
+    /* Same as when paging in: lock the file, so that the VDL doesn't get updated behind us. */
+    FsRtlAcquireFileExclusive(Segment->FileObject);
+    Status = MmMakeSegmentResident(Segment, Offset, Length, &FcbHeader->ValidDataLength);
+    FsRtlReleaseFile(Segment->FileObject);
+
+    return Status;
+}
+
+/*
+ * Reads a range of a file backed section in, without mapping it.
+ * Offset is a file offset for data sections, and an RVA for image sections.
+ * The caller must keep the section referenced for the pages to stay resident.
+ */
+NTSTATUS
+NTAPI
+MmPrefetchSectionRange(
+    _In_ PVOID SectionObject,
+    _In_ LONGLONG Offset,
+    _In_ ULONG Length)
+{
+    PSECTION Section = SectionObject;
+    PMM_SECTION_SEGMENT Segment;
+    LONGLONG End, SegmentStart, SegmentEnd, Start;
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG i;
+
+    PAGED_CODE();
+
+    if (!NT_SUCCESS(RtlLongLongAdd(Offset, Length, &End)) || (Offset < 0))
+        return STATUS_INVALID_PARAMETER;
+
+    if (!Section->u.Flags.Image)
+    {
+        Segment = (PMM_SECTION_SEGMENT)Section->Segment;
+
+        if (Segment->FileObject == NULL || FlagOn(*Segment->Flags, MM_PHYSICALMEMORY_SEGMENT))
+            return STATUS_INVALID_PARAMETER;
+
+        /* Don't go past the section */
+        if (Offset >= Segment->RawLength.QuadPart)
+            return STATUS_SUCCESS;
+        if (End > Segment->RawLength.QuadPart)
+            Length = (ULONG)(Segment->RawLength.QuadPart - Offset);
+
+        return MiPrefetchSegment(Segment, Offset, Length);
+    }
+
+    /* Read the part of the range backed by each segment of the image */
+    PMM_IMAGE_SECTION_OBJECT ImageSectionObject = (PMM_IMAGE_SECTION_OBJECT)Section->Segment;
+    for (i = 0; i < ImageSectionObject->NrSegments; i++)
+    {
+        Segment = &ImageSectionObject->Segments[i];
+
+        SegmentStart = Segment->Image.VirtualAddress;
+        SegmentEnd = SegmentStart + Segment->RawLength.QuadPart;
+        if (End <= SegmentStart || Offset >= SegmentEnd)
+            continue;
+
+        Start = max(Offset, SegmentStart);
+        Status = MiPrefetchSegment(Segment,
+                                   Start - SegmentStart,
+                                   (ULONG)(min(End, SegmentEnd) - Start));
+        if (!NT_SUCCESS(Status))
+            break;
+    }
+
+    return Status;
+}
+
+/*
+ * Writes the run of dirty pages starting at the given offset, up to the end of
+ * the range or MM_WRITE_CLUSTER_MAX, with a single paging write. The MDL must
+ * be large enough for MM_WRITE_CLUSTER_MAX. Returns the number of pages written.
+ */
+_Requires_exclusive_lock_held_(Segment->Lock)
+static
+ULONG
+MiWriteSegmentCluster(
+    _In_ PMM_SECTION_SEGMENT Segment,
+    _In_ PMDL Mdl,
+    _In_ LONGLONG Offset,
+    _In_ LONGLONG End)
+{
+    PPFN_NUMBER Pages = MmGetMdlPfnArray(Mdl);
+    LARGE_INTEGER CurrentOffset, FileOffset;
+    IO_STATUS_BLOCK IoStatus;
+    ULONG_PTR Entry;
+    ULONG PageCount, i;
+    BOOLEAN DirtyAgain;
+    NTSTATUS Status;
+    KEVENT Event;
+    PKPRCB Prcb;
+
+    /* Take the pages of the run, the way MmCheckDirtySegment does with one */
+    for (PageCount = 0, CurrentOffset.QuadPart = Offset;
+         (PageCount < MM_WRITE_CLUSTER_MAX / PAGE_SIZE) && (CurrentOffset.QuadPart < End);
+         PageCount++, CurrentOffset.QuadPart += PAGE_SIZE)
+    {
+        Entry = MmGetPageEntrySectionSegment(Segment, &CurrentOffset);
+        if ((Entry == 0) || IS_SWAP_FROM_SSE(Entry) || !IS_DIRTY_SSE(Entry))
+            break;
+
+        Pages[PageCount] = PFN_FROM_SSE(Entry);
+
+        /* Mark it as write in progress and clean */
+        Entry = MAKE_SSE(PAGE_FROM_SSE(Entry), SHARE_COUNT_FROM_SSE(Entry) + 1);
+        Entry = WRITE_SSE(Entry);
+        MmSetPageEntrySectionSegment(Segment, &CurrentOffset, Entry);
+        MmSetCleanAllRmaps(Pages[PageCount]);
+    }
+    ASSERT(PageCount != 0);
+
+    MmUnlockSectionSegment(Segment);
+
+    Mdl->ByteCount = PageCount * PAGE_SIZE;
+    Mdl->MdlFlags |= MDL_PAGES_LOCKED;
+    FileOffset.QuadPart = Segment->Image.FileOffset + Offset;
+
+    KeInitializeEvent(&Event, NotificationEvent, FALSE);
+    Status = IoSynchronousPageWrite(Segment->FileObject, Mdl, &FileOffset, &Event, &IoStatus);
+    if (Status == STATUS_PENDING)
+    {
+        KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
+        Status = IoStatus.Status;
+    }
+    if (Mdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
+    {
+        MmUnmapLockedPages(Mdl->MappedSystemVa, Mdl);
+    }
+
+    /* The ratio of the two tells how large the flushes are */
+    Prcb = KeGetCurrentPrcb();
+    InterlockedIncrement(&Prcb->MmMappedWriteIoCount);
+    InterlockedExchangeAdd(&Prcb->MmMappedPagesWriteCount, PageCount);
+
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Paging write of %lu pages FAILED: Status 0x%08x!\n", PageCount, Status);
+    }
+
+    MmLockSectionSegment(Segment);
+
+    /* Drop the write references, keeping the pages dirtied meanwhile dirty */
+    for (i = 0, CurrentOffset.QuadPart = Offset; i < PageCount; i++, CurrentOffset.QuadPart += PAGE_SIZE)
+    {
+        Entry = MmGetPageEntrySectionSegment(Segment, &CurrentOffset);
+        ASSERT(PFN_FROM_SSE(Entry) == Pages[i]);
+
+        DirtyAgain = !NT_SUCCESS(Status) || IS_DIRTY_SSE(Entry) || MmIsDirtyPageRmap(Pages[i]);
+
+        Entry = MAKE_SSE(Pages[i] << PAGE_SHIFT, SHARE_COUNT_FROM_SSE(Entry) - 1);
+        if (DirtyAgain)
+        {
+            Entry = DIRTY_SSE(Entry);
+        }
+        MmSetPageEntrySectionSegment(Segment, &CurrentOffset, Entry);
+    }
+
+    return PageCount;
+}
+
 NTSTATUS
 NTAPI
 MmFlushSegment(
@@ -4741,6 +5025,8 @@ MmFlushSegment(
 {
     LARGE_INTEGER FlushStart, FlushEnd;
     NTSTATUS Status;
+    PMDL Mdl;
+    ULONG PageCount;
 
     if (Offset)
     {
@@ -4764,6 +5050,9 @@ MmFlushSegment(
 
     ASSERT(*Segment->Flags & MM_DATAFILE_SEGMENT);
 
+    /* Used to write the runs of dirty pages. Without it, we write them one by one */
+    Mdl = IoAllocateMdl(NULL, MM_WRITE_CLUSTER_MAX, FALSE, FALSE, NULL);
+
     MmLockSectionSegment(Segment);
 
     if (!Offset)
@@ -4777,6 +5066,8 @@ MmFlushSegment(
         {
             MmUnlockSectionSegment(Segment);
             MmDereferenceSegment(Segment);
+            if (Mdl)
+                IoFreeMdl(Mdl);
             if (Iosb)
             {
                 Iosb->Status = STATUS_SUCCESS;
@@ -4796,6 +5087,17 @@ MmFlushSegment(
     {
         ULONG_PTR Entry = MmGetPageEntrySectionSegment(Segment, &FlushStart);
 
+        if (IS_DIRTY_SSE(Entry) && !IS_SWAP_FROM_SSE(Entry) && Mdl)
+        {
+            PageCount = MiWriteSegmentCluster(Segment, Mdl, FlushStart.QuadPart, FlushEnd.QuadPart);
+
+            if (Iosb)
+                Iosb->Information += PageCount * PAGE_SIZE;
+
+            FlushStart.QuadPart += PageCount * PAGE_SIZE;
+            continue;
+        }
+
         if (IS_DIRTY_SSE(Entry))
         {
             MmCheckDirtySegment(Segment, &FlushStart, FALSE, FALSE);
@@ -4811,6 +5113,9 @@ MmFlushSegment(
 
     MmDereferenceSegment(Segment);
 
+    if (Mdl)
+        IoFreeMdl(Mdl);
+
     if (Iosb)
         Iosb->Status = STATUS_SUCCESS;
 
@@ -674,6 +674,7 @@
 @ stdcall KeRemoveEntryDeviceQueue(ptr ptr)
 @ stdcall KeRemoveQueue(ptr long ptr)
 @ stdcall KeRemoveQueueDpc(ptr)
+@ stdcall KeRemoveQueueEx(ptr long long ptr ptr long)
 @ stdcall KeRemoveSystemServiceTable(long)
 @ stdcall KeResetEvent(ptr)
 @ stdcall -arch=i386 KeRestoreFloatingPointState(ptr)
@@ -686,6 +687,7 @@
 @ extern KeServiceDescriptorTable
 @ stdcall KeSetAffinityThread(ptr long)
 @ stdcall KeSetBasePriorityThread(ptr long)
+@ stdcall KeSetCoalescableTimer(ptr long long long long ptr)
 @ stdcall KeSetDmaIoCoherency(long)
 @ stdcall KeSetEvent(ptr long long)
 @ stdcall KeSetEventBoostPriority(ptr ptr)
@@ -1519,6 +1521,7 @@
 @ stdcall ZwSetSystemInformation(long ptr long)
 @ stdcall ZwSetSystemTime(ptr ptr)
 @ stdcall ZwSetTimer(ptr ptr ptr ptr long long ptr)
+@ stdcall ZwSetTimerEx(ptr long ptr long)
 @ stdcall ZwSetValueKey(ptr ptr long long ptr long)
 @ stdcall ZwSetVolumeInformationFile(ptr ptr ptr long long)
 @ stdcall ZwTerminateJobObject(ptr long)
@@ -21,6 +21,234 @@ POBJECT_TYPE ObpDirectoryObjectType = NULL;
 
 /* PRIVATE FUNCTIONS ******************************************************/
 
+/*++
+* @name ObpQueueDeletedEntry
+*
+*     The ObpQueueDeletedEntry routine puts an unlinked entry on the deleted
+*     list of the current read epoch.
+*
+* @param Directory
+*        Directory the entry was unlinked from. Must be locked exclusively.
+*
+* @param Entry
+*        Entry to free once no lookup can be looking at it.
+*
+* @return None.
+*
+* @remarks The chain link of the entry is left alone, as lookups may still
+*          be walking past it.
+*
+*--*/
+static
+VOID
+ObpQueueDeletedEntry(IN POBJECT_DIRECTORY Directory,
+                     IN POBJECT_DIRECTORY_ENTRY Entry)
+{
+    POBP_DIRECTORY_EXTENSION Extension = OBP_DIRECTORY_TO_EXTENSION(Directory);
+    POBP_DIRECTORY_ENTRY DeletedEntry;
+    LONG Epoch = Extension->ReaderEpoch;
+
+    DeletedEntry = CONTAINING_RECORD(Entry, OBP_DIRECTORY_ENTRY, Entry);
+    DeletedEntry->NextDeleted = Extension->DeletedEntries[Epoch];
+    Extension->DeletedEntries[Epoch] = DeletedEntry;
+}
+
+/*++
+* @name ObpFreeDeletedEntries
+*
+*     The ObpFreeDeletedEntries routine frees the entries and tables which
+*     were unlinked during a read epoch.
+*
+* @param Extension
+*        Private state of the directory.
+*
+* @param Epoch
+*        Read epoch whose deleted lists to free.
+*
+* @return None.
+*
+* @remarks The caller makes sure no lookup can still see them.
+*
+*--*/
+static
+VOID
+ObpFreeDeletedEntries(IN POBP_DIRECTORY_EXTENSION Extension,
+                      IN LONG Epoch)
+{
+    POBP_DIRECTORY_ENTRY Entry, NextEntry;
+    POBP_DIRECTORY_TABLE Table, NextTable;
+
+    for (Entry = Extension->DeletedEntries[Epoch]; Entry; Entry = NextEntry)
+    {
+        NextEntry = Entry->NextDeleted;
+        ExFreePoolWithTag(Entry, OB_DIR_TAG);
+    }
+    Extension->DeletedEntries[Epoch] = NULL;
+
+    for (Table = Extension->DeletedTables[Epoch]; Table; Table = NextTable)
+    {
+        NextTable = Table->NextDeleted;
+        ExFreePoolWithTag(Table, OB_DIR_TAG);
+    }
+    Extension->DeletedTables[Epoch] = NULL;
+}
+
+/*++
+* @name ObpAdvanceDirectoryEpoch
+*
+*     The ObpAdvanceDirectoryEpoch routine moves new lookups to the other
+*     read epoch, once the lookups of the previous one are gone.
+*
+* @param Directory
+*        Directory to advance. Must be locked exclusively.
+*
+* @return None.
+*
+* @remarks What was unlinked during the previous epoch can only be seen by
+*          the lookups counted in it, or by older ones which were drained
+*          before the current epoch started. So it is freed as soon as the
+*          previous epoch is empty, and the current epoch becomes the
+*          previous one. If it isn't empty, nothing is done and the next
+*          writer tries again; the lookups are never waited for.
+*
+*--*/
+static
+VOID
+ObpAdvanceDirectoryEpoch(IN POBJECT_DIRECTORY Directory)
+{
+    POBP_DIRECTORY_EXTENSION Extension = OBP_DIRECTORY_TO_EXTENSION(Directory);
+    LONG Previous = Extension->ReaderEpoch ^ 1;
+
+    /* Lookups of the previous epoch may still be walking the chains */
+    if (InterlockedCompareExchange(&Extension->ReaderCount[Previous], 0, 0) != 0) return;
+
+    /* They are gone, free what they could see and send new lookups there */
+    ObpFreeDeletedEntries(Extension, Previous);
+    InterlockedExchange(&Extension->ReaderEpoch, Previous);
+}
+
+/*++
+* @name ObpFreeDirectoryBuckets
+*
+*     The ObpFreeDirectoryBuckets routine frees every entry of a hash table.
+*
+* @param Buckets
+*        Hash buckets to empty.
+*
+* @param BucketCount
+*        Number of buckets.
+*
+* @return None.
+*
+* @remarks Only the entries are freed, the objects aren't touched.
+*
+*--*/
+static
+VOID
+ObpFreeDirectoryBuckets(IN POBJECT_DIRECTORY_ENTRY *Buckets,
+                        IN ULONG BucketCount)
+{
+    POBJECT_DIRECTORY_ENTRY Entry, NextEntry;
+    ULONG i;
+
+    for (i = 0; i < BucketCount; i++)
+    {
+        for (Entry = Buckets[i]; Entry; Entry = NextEntry)
+        {
+            NextEntry = Entry->ChainLink;
+            ExFreePoolWithTag(Entry, OB_DIR_TAG);
+        }
+        Buckets[i] = NULL;
+    }
+}
+
+/*++
+* @name ObpExpandDirectory
+*
+*     The ObpExpandDirectory routine moves the entries of a directory to a
+*     hash table about twice as large as the current one.
+*
+* @param Directory
+*        Directory to expand. Must be locked exclusively.
+*
+* @return None. The directory keeps its current table if there isn't enough
+*         memory for a new one.
+*
+* @remarks Lookups may be walking the current chains, so the new table gets
+*          copies of the entries and the old ones are queued for freeing
+*          once these lookups are done.
+*
+*--*/
+static
+VOID
+ObpExpandDirectory(IN POBJECT_DIRECTORY Directory)
+{
+    POBP_DIRECTORY_EXTENSION Extension = OBP_DIRECTORY_TO_EXTENSION(Directory);
+    POBP_DIRECTORY_TABLE OldTable, NewTable;
+    POBJECT_DIRECTORY_ENTRY *OldBuckets;
+    POBJECT_DIRECTORY_ENTRY Entry, NewEntry;
+    ULONG OldCount, NewCount, Size, i, Index;
+
+    /* Get the current table and pick the new size */
+    OldTable = Extension->Table;
+    OldBuckets = ObpGetDirectoryBuckets(Directory, &OldCount);
+    if (OldCount >= OBP_DIRECTORY_MAX_BUCKETS) return;
+    NewCount = min(OldCount * 2 + 1, OBP_DIRECTORY_MAX_BUCKETS);
+
+    /* Allocate the new table */
+    Size = FIELD_OFFSET(OBP_DIRECTORY_TABLE, HashBuckets[NewCount]);
+    NewTable = ExAllocatePoolWithTag(PagedPool, Size, OB_DIR_TAG);
+    if (!NewTable) return;
+    RtlZeroMemory(NewTable, Size);
+    NewTable->BucketCount = NewCount;
+
+    /* Copy every entry to its new bucket */
+    for (i = 0; i < OldCount; i++)
+    {
+        for (Entry = OldBuckets[i]; Entry; Entry = Entry->ChainLink)
+        {
+            NewEntry = ExAllocatePoolWithTag(PagedPool,
+                                             sizeof(OBP_DIRECTORY_ENTRY),
+                                             OB_DIR_TAG);
+            if (!NewEntry)
+            {
+                /* Give up, the current table still works */
+                ObpFreeDirectoryBuckets(NewTable->HashBuckets, NewCount);
+                ExFreePoolWithTag(NewTable, OB_DIR_TAG);
+                return;
+            }
+
+            NewEntry->HashValue = Entry->HashValue;
+            NewEntry->Object = Entry->Object;
+            Index = Entry->HashValue % NewCount;
+            NewEntry->ChainLink = NewTable->HashBuckets[Index];
+            NewTable->HashBuckets[Index] = NewEntry;
+        }
+    }
+
+    /* Switch to the new table */
+    InterlockedExchangePointer((PVOID*)&Extension->Table, NewTable);
+
+    /*
+     * Lookups may still be using the old table, so it goes away with the
+     * current epoch. The embedded buckets are left as they are; nothing
+     * looks at them once the directory has a table.
+     */
+    for (i = 0; i < OldCount; i++)
+    {
+        for (Entry = OldBuckets[i]; Entry; Entry = Entry->ChainLink)
+        {
+            ObpQueueDeletedEntry(Directory, Entry);
+        }
+    }
+    if (OldTable)
+    {
+        OldTable->NextDeleted = Extension->DeletedTables[Extension->ReaderEpoch];
+        Extension->DeletedTables[Extension->ReaderEpoch] = OldTable;
+    }
+    ObpAdvanceDirectoryEpoch(Directory);
+}
+
 /*++
 * @name ObpInsertEntryDirectory
 *
@@ -37,7 +265,8 @@ POBJECT_TYPE ObpDirectoryObjectType = NULL;
 *
 * @return TRUE if the object was inserted, FALSE otherwise.
 *
-* @remarks None.
+* @remarks The hash table is expanded once it holds more than
+*          OBP_DIRECTORY_LOAD_FACTOR entries per bucket.
 *
 *--*/
 BOOLEAN
@@ -46,9 +275,12 @@ ObpInsertEntryDirectory(IN POBJECT_DIRECTORY Parent,
                         IN POBP_LOOKUP_CONTEXT Context,
                         IN POBJECT_HEADER ObjectHeader)
 {
+    POBP_DIRECTORY_EXTENSION Extension = OBP_DIRECTORY_TO_EXTENSION(Parent);
     POBJECT_DIRECTORY_ENTRY *AllocatedEntry;
+    POBJECT_DIRECTORY_ENTRY *Buckets;
     POBJECT_DIRECTORY_ENTRY NewEntry;
     POBJECT_HEADER_NAME_INFO HeaderNameInfo;
+    ULONG BucketCount;
 
     /* Make sure we have a name */
     ASSERT(ObjectHeader->NameInfoOffset != 0);
@@ -67,7 +299,7 @@ ObpInsertEntryDirectory(IN POBJECT_DIRECTORY Parent,
 
     /* Allocate a new Directory Entry */
     NewEntry = ExAllocatePoolWithTag(PagedPool,
-                                     sizeof(OBJECT_DIRECTORY_ENTRY),
+                                     sizeof(OBP_DIRECTORY_ENTRY),
                                      OB_DIR_TAG);
     if (!NewEntry) return FALSE;
 
@@ -77,18 +309,27 @@ ObpInsertEntryDirectory(IN POBJECT_DIRECTORY Parent,
     /* Get the Object Name Information */
     HeaderNameInfo = OBJECT_HEADER_TO_NAME_INFO(ObjectHeader);
 
+    /* Associate the Object */
+    NewEntry->Object = &ObjectHeader->Body;
+
     /* Get the Allocated entry */
-    AllocatedEntry = &Parent->HashBuckets[Context->HashIndex];
+    Buckets = ObpGetDirectoryBuckets(Parent, &BucketCount);
+    AllocatedEntry = &Buckets[Context->HashValue % BucketCount];
 
-    /* Set it */
+    /* Set it, lookups may be walking this chain as we do */
     NewEntry->ChainLink = *AllocatedEntry;
-    *AllocatedEntry = NewEntry;
-
-    /* Associate the Object */
-    NewEntry->Object = &ObjectHeader->Body;
+    InterlockedExchangePointer((PVOID*)AllocatedEntry, NewEntry);
 
     /* Associate the Directory */
     HeaderNameInfo->Directory = Parent;
+
+    /* Grow the hash table if the chains are getting long */
+    if ((++Extension->EntryCount > BucketCount * OBP_DIRECTORY_LOAD_FACTOR) &&
+        (BucketCount < OBP_DIRECTORY_MAX_BUCKETS))
+    {
+        ObpExpandDirectory(Parent);
+    }
+
     return TRUE;
 }
 
@@ -150,7 +391,9 @@ ObpGetShadowDirectory(IN POBJECT_DIRECTORY Directory)
 *
 * @return Pointer to the object which was found, or NULL otherwise.
 *
-* @remarks None.
+* @remarks If the caller didn't lock the directory, the hash chain is walked
+*          without taking the directory lock; see ObpEnterDirectoryRead.
+*          Candidates are then referenced before their name is compared.
 *
 *--*/
 PVOID
@@ -166,10 +409,11 @@ ObpLookupEntryDirectory(IN POBJECT_DIRECTORY Directory,
     POBJECT_HEADER ObjectHeader;
     ULONG HashValue;
     ULONG HashIndex;
+    ULONG BucketCount;
     LONG TotalChars;
+    LONG Epoch = 0;
     WCHAR CurrentChar;
-    POBJECT_DIRECTORY_ENTRY *AllocatedEntry;
-    POBJECT_DIRECTORY_ENTRY *LookupBucket;
+    POBJECT_DIRECTORY_ENTRY *Buckets;
     POBJECT_DIRECTORY_ENTRY CurrentEntry;
     PVOID FoundObject = NULL;
     PWSTR Buffer;
@@ -207,37 +451,54 @@ ObpLookupEntryDirectory(IN POBJECT_DIRECTORY Directory,
         else HashValue += (CurrentChar - ('a'-'A'));
     }
 
-    /* Merge it with our number of hash buckets */
-    HashIndex = HashValue % 37;
-
     /* Save the result */
     Context->HashValue = HashValue;
-    Context->HashIndex = (USHORT)HashIndex;
 
 DoItAgain:
-    /* Get the root entry and set it as our lookup bucket */
-    AllocatedEntry = &Directory->HashBuckets[HashIndex];
-    LookupBucket = AllocatedEntry;
-
     /* Check if the directory is already locked */
     if (!Context->DirectoryLocked)
     {
-        /* Lock it */
-        ObpAcquireDirectoryLockShared(Directory, Context);
+        /* Keep the chains alive while we walk them */
+        Epoch = ObpEnterDirectoryRead(Directory);
     }
 
+    /* Merge the hash with the current number of hash buckets */
+    Buckets = ObpGetDirectoryBuckets(Directory, &BucketCount);
+    HashIndex = HashValue % BucketCount;
+    Context->HashIndex = (USHORT)HashIndex;
+
     /* Start looping */
-    while ((CurrentEntry = *AllocatedEntry))
+    for (CurrentEntry = *(POBJECT_DIRECTORY_ENTRY volatile *)&Buckets[HashIndex];
+         CurrentEntry;
+         CurrentEntry = *(POBJECT_DIRECTORY_ENTRY volatile *)&CurrentEntry->ChainLink)
     {
         /* Do the hashes match? */
         if (CurrentEntry->HashValue == HashValue)
         {
             /* Make sure that it has a name */
             ObjectHeader = OBJECT_TO_OBJECT_HEADER(CurrentEntry->Object);
-
-            /* Get the name information */
             ASSERT(ObjectHeader->NameInfoOffset != 0);
-            HeaderNameInfo = OBJECT_HEADER_TO_NAME_INFO(ObjectHeader);
+
+            if (Context->DirectoryLocked)
+            {
+                /* The lock keeps the object and its name alive */
+                HeaderNameInfo = OBJECT_HEADER_TO_NAME_INFO(ObjectHeader);
+            }
+            else
+            {
+                /*
+                 * Nothing stops the object from being deleted under us, so
+                 * reference it and its name first, and skip it if either one
+                 * is already going away.
+                 */
+                if (!ObReferenceObjectSafe(CurrentEntry->Object)) continue;
+                HeaderNameInfo = ObpReferenceNameInfo(ObjectHeader);
+                if (!HeaderNameInfo)
+                {
+                    ObDereferenceObjectDeferDelete(CurrentEntry->Object);
+                    continue;
+                }
+            }
 
             /* Do the names match? */
             if ((Name->Length == HeaderNameInfo->Name.Length) &&
@@ -245,34 +506,23 @@ DoItAgain:
             {
                 break;
             }
-        }
 
-        /* Move to the next entry */
-        AllocatedEntry = &CurrentEntry->ChainLink;
+            if (!Context->DirectoryLocked)
+            {
+                /* Not this one, drop the references again */
+                ObpDereferenceNameInfo(HeaderNameInfo);
+                ObDereferenceObjectDeferDelete(CurrentEntry->Object);
+            }
+        }
     }
 
     /* Check if we still have an entry */
     if (CurrentEntry)
     {
-        /* Set this entry as the first, to speed up incoming insertion */
-        if (AllocatedEntry != LookupBucket)
-        {
-            /* Check if the directory was locked or convert the lock */
-            if ((Context->DirectoryLocked) ||
-                (ExConvertPushLockSharedToExclusive(&Directory->Lock)))
-            {
-                /* Set the Current Entry */
-                *AllocatedEntry = CurrentEntry->ChainLink;
-
-                /* Link to the old Hash Entry */
-                CurrentEntry->ChainLink = *LookupBucket;
-
-                /* Set the new Hash Entry */
-                *LookupBucket = CurrentEntry;
-            }
-        }
-
-        /* Save the found object */
+        /*
+         * Don't move it to the front of the chain: lookups no longer hold
+         * the lock, so the chains are only changed by inserts and deletes.
+         */
         FoundObject = CurrentEntry->Object;
         goto Quickie;
     }
@@ -281,8 +531,8 @@ DoItAgain:
         /* Check if the directory was locked */
         if (!Context->DirectoryLocked)
         {
-            /* Release the lock */
-            ObpReleaseDirectoryLock(Directory, Context);
+            /* Leave the read section */
+            ObpLeaveDirectoryRead(Directory, Epoch);
         }
 
         /* Check if we should scan the shadow directory */
@@ -302,18 +552,20 @@ Quickie:
     /* Check if we inserted an object */
     if (FoundObject)
     {
-        /* Get the object name information */
-        ObjectHeader = OBJECT_TO_OBJECT_HEADER(FoundObject);
-        ObpReferenceNameInfo(ObjectHeader);
-
-        /* Reference the object being looked up */
-        ObReferenceObject(FoundObject);
-
         /* Check if the directory was locked */
-        if (!Context->DirectoryLocked)
+        if (Context->DirectoryLocked)
+        {
+            /* Get the object name information */
+            ObjectHeader = OBJECT_TO_OBJECT_HEADER(FoundObject);
+            ObpReferenceNameInfo(ObjectHeader);
+
+            /* Reference the object being looked up */
+            ObReferenceObject(FoundObject);
+        }
+        else
         {
-            /* Release the lock */
-            ObpReleaseDirectoryLock(Directory, Context);
+            /* The walk referenced it already, so we can leave the read section */
+            ObpLeaveDirectoryRead(Directory, Epoch);
         }
     }
 
@@ -344,7 +596,8 @@ Quickie:
 *
 * @return TRUE if the object was deleted, FALSE otherwise.
 *
-* @remarks None.
+* @remarks The entry is only freed once no lookup can be looking at it,
+*          which may be after a later insert or delete.
 *
 *--*/
 BOOLEAN
@@ -353,27 +606,67 @@ ObpDeleteEntryDirectory(POBP_LOOKUP_CONTEXT Context)
 {
     POBJECT_DIRECTORY Directory;
     POBJECT_DIRECTORY_ENTRY *AllocatedEntry;
+    POBJECT_DIRECTORY_ENTRY *Buckets;
     POBJECT_DIRECTORY_ENTRY CurrentEntry;
+    ULONG BucketCount;
 
     /* Get the Directory */
     Directory = Context->Directory;
     if (!Directory) return FALSE;
 
-    /* Get the Entry */
-    AllocatedEntry = &Directory->HashBuckets[Context->HashIndex];
-    CurrentEntry = *AllocatedEntry;
+    /* Find the Entry of the object we looked up */
+    Buckets = ObpGetDirectoryBuckets(Directory, &BucketCount);
+    AllocatedEntry = &Buckets[Context->HashValue % BucketCount];
+    while ((CurrentEntry = *AllocatedEntry))
+    {
+        if (CurrentEntry->Object == Context->Object) break;
+        AllocatedEntry = &CurrentEntry->ChainLink;
+    }
+    if (!CurrentEntry) return FALSE;
 
-    /* Unlink the Entry */
-    *AllocatedEntry = CurrentEntry->ChainLink;
-    CurrentEntry->ChainLink = NULL;
+    /* Unlink the Entry, leaving its link for lookups still walking past it */
+    InterlockedExchangePointer((PVOID*)AllocatedEntry, CurrentEntry->ChainLink);
+    OBP_DIRECTORY_TO_EXTENSION(Directory)->EntryCount--;
 
-    /* Free it */
-    ExFreePoolWithTag(CurrentEntry, OB_DIR_TAG);
+    /* Free it once these lookups are done, without waiting for them */
+    ObpQueueDeletedEntry(Directory, CurrentEntry);
+    ObpAdvanceDirectoryEpoch(Directory);
 
     /* Return */
     return TRUE;
 }
 
+/*++
+* @name ObpDeleteDirectory
+*
+*     The ObpDeleteDirectory routine is the delete procedure of the
+*     directory object type.
+*
+* @param ObjectBody
+*        Directory being deleted.
+*
+* @return None.
+*
+* @remarks Frees the expanded hash table, if the directory had one, and
+*          the entries which were still waiting to be freed.
+*
+*--*/
+VOID
+NTAPI
+ObpDeleteDirectory(IN PVOID ObjectBody)
+{
+    POBP_DIRECTORY_EXTENSION Extension = OBP_DIRECTORY_TO_EXTENSION(ObjectBody);
+
+    /* Named objects reference their directory, so it must be empty by now */
+    ASSERT(Extension->EntryCount == 0);
+    if (Extension->Table) ExFreePoolWithTag(Extension->Table, OB_DIR_TAG);
+
+    /* And nobody can be looking it up anymore */
+    ASSERT(Extension->ReaderCount[0] == 0 && Extension->ReaderCount[1] == 0);
+    ObpFreeDeletedEntries(Extension, 0);
+    ObpFreeDeletedEntries(Extension, 1);
+}
+
 /* FUNCTIONS **************************************************************/
 
 /*++
@@ -511,7 +804,8 @@ NtQueryDirectoryObject(IN HANDLE DirectoryHandle,
     POBJECT_DIRECTORY_INFORMATION DirectoryInfo;
     ULONG Length, TotalLength;
     ULONG Count, CurrentEntry;
-    ULONG Hash;
+    ULONG Hash, BucketCount;
+    POBJECT_DIRECTORY_ENTRY *Buckets;
     POBJECT_DIRECTORY_ENTRY Entry;
     POBJECT_HEADER ObjectHeader;
     POBJECT_HEADER_NAME_INFO ObjectNameInfo;
@@ -586,10 +880,11 @@ NtQueryDirectoryObject(IN HANDLE DirectoryHandle,
 
     /* Set default status and start looping */
     Status = STATUS_NO_MORE_ENTRIES;
-    for (Hash = 0; Hash < 37; Hash++)
+    Buckets = ObpGetDirectoryBuckets(Directory, &BucketCount);
+    for (Hash = 0; Hash < BucketCount; Hash++)
     {
         /* Get this entry and loop all of them */
-        Entry = Directory->HashBuckets[Hash];
+        Entry = Buckets[Hash];
         while (Entry)
         {
             /* Check if we should process this entry */
@@ -802,14 +1097,16 @@ NtCreateDirectoryObject(OUT PHANDLE DirectoryHandle,
                             ObjectAttributes,
                             PreviousMode,
                             NULL,
-                            sizeof(OBJECT_DIRECTORY),
+                            sizeof(OBJECT_DIRECTORY) +
+                            sizeof(OBP_DIRECTORY_EXTENSION),
                             0,
                             0,
                             (PVOID*)&Directory);
     if (!NT_SUCCESS(Status)) return Status;
 
     /* Setup the object */
-    RtlZeroMemory(Directory, sizeof(OBJECT_DIRECTORY));
+    RtlZeroMemory(Directory,
+                  sizeof(OBJECT_DIRECTORY) + sizeof(OBP_DIRECTORY_EXTENSION));
     ExInitializePushLock(&Directory->Lock);
     Directory->SessionId = -1;
 
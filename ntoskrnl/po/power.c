@@ -480,6 +480,16 @@ VOID
 FASTCALL
 PopIdle0(IN PPROCESSOR_POWER_STATE PowerState)
 {
+    /* Let the HAL skip clock ticks until the next timer is due */
+    if (KiStopClockTick())
+    {
+        HalProcessorIdle();
+
+        /* Catch up on the skipped ticks now, if something else woke us up */
+        KiDynamicTick.RestartClockTick();
+        return;
+    }
+
     /* FIXME: Extremly naive implementation */
     HalProcessorIdle();
 }
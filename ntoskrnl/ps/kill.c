@@ -1125,7 +1125,8 @@ PspExitProcess(IN BOOLEAN LastThread,
             /* FIXME: Check job status code and do I/O completion if needed */
         }
 
-        /* FIXME: Notify the Prefetcher */
+        /* Notify the Prefetcher */
+        if (CcPfEnablePrefetcher) CcPfProcessExitNotification(Process);
     }
     else
     {
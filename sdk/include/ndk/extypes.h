@@ -313,6 +313,9 @@ typedef enum _SYSTEM_INFORMATION_CLASS
     SystemPrefetchPathInformation,
     SystemVerifierFaultsInformation,
     MaxSystemInfoClass,
+#ifdef __REACTOS__
+    SystemWorkQueueInformation = 0x100,
+#endif
 } SYSTEM_INFORMATION_CLASS;
 
 //
@@ -341,6 +344,36 @@ typedef enum _TIMER_INFORMATION_CLASS
     TimerBasicInformation
 } TIMER_INFORMATION_CLASS;
 
+#ifdef NTOS_MODE_USER
+
+//
+//  Set Information Classes for NtSetTimerEx
+//
+typedef enum _TIMER_SET_INFORMATION_CLASS
+{
+    TimerSetCoalescableTimer,
+    MaxTimerInfoClass,
+#ifdef __REACTOS__
+    TimerSetHighResolution = 0x100
+#endif
+} TIMER_SET_INFORMATION_CLASS;
+
+//
+// Coalescable Timer Information for NtSetTimerEx
+//
+typedef struct _TIMER_SET_COALESCABLE_TIMER_INFO
+{
+    LARGE_INTEGER DueTime;
+    PTIMER_APC_ROUTINE TimerApcRoutine;
+    PVOID TimerContext;
+    struct _COUNTED_REASON_CONTEXT *WakeContext;
+    ULONG Period;
+    ULONG TolerableDelay;
+    PBOOLEAN PreviousState;
+} TIMER_SET_COALESCABLE_TIMER_INFO, *PTIMER_SET_COALESCABLE_TIMER_INFO;
+
+#endif
+
 //
 //  System Information Classes for NtQuerySemaphore
 //
@@ -1402,7 +1435,45 @@ typedef struct _SYSTEM_NUMA_INFORMATION
     };
 } SYSTEM_NUMA_INFORMATION, *PSYSTEM_NUMA_INFORMATION;
 
-// FIXME: Class 56-63
+// Class 56
+#define PF_CURRENT_VERSION 17
+#define PF_SYSINFO_MAGIC_NUMBER 'kuhC'
+
+typedef enum _PREFETCHER_INFORMATION_CLASS
+{
+    PrefetcherRetrieveTrace = 1,
+    PrefetcherSystemParameters,
+    PrefetcherBootPhase,
+#ifdef __REACTOS__
+    PrefetcherStatistics = 0x100,
+#endif
+} PREFETCHER_INFORMATION_CLASS;
+
+typedef struct _PREFETCHER_INFORMATION
+{
+    ULONG Version;
+    ULONG Magic;
+    PREFETCHER_INFORMATION_CLASS PrefetcherInformationClass;
+    PVOID PrefetcherInformation;
+    ULONG PrefetcherInformationLength;
+} PREFETCHER_INFORMATION, *PPREFETCHER_INFORMATION;
+
+// PrefetcherStatistics (ReactOS extension)
+typedef struct _SYSTEM_PREFETCHER_STATISTICS
+{
+    ULONG EnabledFlags;
+    ULONG ActiveTraces;
+    ULONG TracesCompleted;
+    ULONG TracesSaved;
+    ULONG ScenariosPrefetched;
+    ULONG PagesPrefetched;
+    ULONG PrefetchedHits;
+    ULONG PrefetchedMisses;
+    ULONG ColdHits;
+    ULONG ColdMisses;
+} SYSTEM_PREFETCHER_STATISTICS, *PSYSTEM_PREFETCHER_STATISTICS;
+
+// FIXME: Class 57-63
 
 // Class 64
 typedef struct _SYSTEM_HANDLE_TABLE_ENTRY_INFO_EX
@@ -1424,7 +1495,31 @@ typedef struct _SYSTEM_HANDLE_INFORMATION_EX
     SYSTEM_HANDLE_TABLE_ENTRY_INFO_EX Handle[1];
 } SYSTEM_HANDLE_INFORMATION_EX, *PSYSTEM_HANDLE_INFORMATION_EX;
 
-// FIXME: Class 65-97
+// FIXME: Class 65
+
+// Class 66
+typedef struct _SYSTEM_BIGPOOL_ENTRY
+{
+    union
+    {
+        PVOID VirtualAddress;
+        ULONG_PTR NonPaged:1;
+    };
+    SIZE_T SizeInBytes;
+    union
+    {
+        UCHAR Tag[4];
+        ULONG TagUlong;
+    };
+} SYSTEM_BIGPOOL_ENTRY, *PSYSTEM_BIGPOOL_ENTRY;
+
+typedef struct _SYSTEM_BIGPOOL_INFORMATION
+{
+    ULONG Count;
+    SYSTEM_BIGPOOL_ENTRY AllocatedInfo[1];
+} SYSTEM_BIGPOOL_INFORMATION, *PSYSTEM_BIGPOOL_INFORMATION;
+
+// FIXME: Class 67-97
 
 //
 // Hotpatch flags
@@ -1532,6 +1627,29 @@ typedef struct _SYSTEM_MEMORY_LIST_INFORMATION
     SIZE_T ModifiedPageCountPageFile;
 } SYSTEM_MEMORY_LIST_INFORMATION, *PSYSTEM_MEMORY_LIST_INFORMATION;
 
+//
+// Class 0x100 (ReactOS extension)
+//
+typedef struct _SYSTEM_WORK_QUEUE_ENTRY
+{
+    UCHAR NodeNumber;
+    UCHAR QueueType;
+    USHORT Reserved;
+    ULONG WorkerCount;
+    ULONG DynamicThreadCount;
+    ULONG QueueDepth;
+    ULONG WorkItemsQueued;
+    ULONG WorkItemsProcessed;
+    ULONG WorkItemsStolen;
+    ULONGLONG WaitTime;
+} SYSTEM_WORK_QUEUE_ENTRY, *PSYSTEM_WORK_QUEUE_ENTRY;
+
+typedef struct _SYSTEM_WORK_QUEUE_INFORMATION
+{
+    ULONG Count;
+    SYSTEM_WORK_QUEUE_ENTRY Queue[1];
+} SYSTEM_WORK_QUEUE_INFORMATION, *PSYSTEM_WORK_QUEUE_INFORMATION;
+
 #ifdef __cplusplus
 }; // extern "C"
 #endif
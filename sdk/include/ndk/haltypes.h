@@ -186,6 +186,60 @@ typedef struct _HAL_PRIVATE_DISPATCH
 #endif
 } HAL_PRIVATE_DISPATCH, *PHAL_PRIVATE_DISPATCH;
 
+//
+// HAL NUMA Topology Interface
+//
+typedef
+ULONG
+(NTAPI *PHALNUMAPAGETONODE)(
+    _In_ ULONG_PTR PhysicalPageNumber
+);
+
+typedef
+NTSTATUS
+(NTAPI *PHALNUMAQUERYPROCESSORNODE)(
+    _In_ ULONG ProcessorNumber,
+    _Out_ PUSHORT Identifier,
+    _Out_ PUCHAR Node
+);
+
+typedef
+UCHAR
+(NTAPI *PHALNUMAQUERYNODEDISTANCE)(
+    _In_ UCHAR FromNode,
+    _In_ UCHAR ToNode
+);
+
+typedef struct _HAL_NUMA_TOPOLOGY_INTERFACE
+{
+    ULONG NumberOfNodes;
+    PHALNUMAQUERYPROCESSORNODE QueryProcessorNode;
+    PHALNUMAPAGETONODE PageToNode;
+    PHALNUMAQUERYNODEDISTANCE QueryNodeDistance; // ReactOS extension
+} HAL_NUMA_TOPOLOGY_INTERFACE, *PHAL_NUMA_TOPOLOGY_INTERFACE;
+
+//
+// HAL Dynamic Tick Interface (ReactOS extension)
+//
+typedef
+BOOLEAN
+(NTAPI *PHALSTOPCLOCKTICK)(
+    _In_ ULONGLONG Interval
+);
+
+typedef
+VOID
+(NTAPI *PHALRESTARTCLOCKTICK)(
+    VOID
+);
+
+typedef struct _HAL_DYNAMIC_TICK_INTERFACE
+{
+    ULONGLONG MaximumInterval;
+    PHALSTOPCLOCKTICK StopClockTick;
+    PHALRESTARTCLOCKTICK RestartClockTick;
+} HAL_DYNAMIC_TICK_INTERFACE, *PHAL_DYNAMIC_TICK_INTERFACE;
+
 //
 // HAL Supported Range
 //
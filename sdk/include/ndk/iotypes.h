@@ -648,12 +648,10 @@ typedef struct _FILE_DIRECTORY_INFORMATION
     WCHAR FileName[1];
 } FILE_DIRECTORY_INFORMATION, *PFILE_DIRECTORY_INFORMATION;
 
-typedef struct _FILE_IO_COMPLETION_INFORMATION
+typedef struct _FILE_IO_COMPLETION_NOTIFICATION_INFORMATION
 {
-    PVOID KeyContext;
-    PVOID ApcContext;
-    IO_STATUS_BLOCK IoStatusBlock;
-} FILE_IO_COMPLETION_INFORMATION, *PFILE_IO_COMPLETION_INFORMATION;
+    ULONG Flags;
+} FILE_IO_COMPLETION_NOTIFICATION_INFORMATION, *PFILE_IO_COMPLETION_NOTIFICATION_INFORMATION;
 
 typedef struct _FILE_ATTRIBUTE_TAG_INFORMATION
 {
@@ -769,6 +767,16 @@ typedef struct _IO_ERROR_LOG_MESSAGE
 
 #endif
 
+//
+// I/O Completion Packet, as returned by NtRemoveIoCompletionEx
+//
+typedef struct _FILE_IO_COMPLETION_INFORMATION
+{
+    PVOID KeyContext;
+    PVOID ApcContext;
+    IO_STATUS_BLOCK IoStatusBlock;
+} FILE_IO_COMPLETION_INFORMATION, *PFILE_IO_COMPLETION_INFORMATION;
+
 //
 // I/O Completion Information structures
 //
@@ -1946,6 +1946,20 @@ struct _RTL_MEMORY_STREAM
     HANDLE ProcessHandle;
 };
 
+#if (_WIN32_WINNT >= _WIN32_WINNT_VISTA) || (defined(__REACTOS__) && defined(_NTDLLBUILD_))
+//
+// Thread Pool I/O Callback
+//
+typedef VOID
+(NTAPI *PTP_IO_CALLBACK)(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context,
+    _In_ PVOID ApcContext,
+    _In_ PIO_STATUS_BLOCK IoStatusBlock,
+    _In_ PTP_IO Io
+);
+#endif
+
 #endif /* NTOS_MODE_USER */
 
 #ifdef __cplusplus
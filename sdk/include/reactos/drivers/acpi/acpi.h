@@ -39,6 +39,7 @@ typedef struct _ACPI_BIOS_MULTI_NODE
 #define XSDT_SIGNATURE 'TDSX'
 #define BOOT_SIGNATURE 'TOOB'
 #define SRAT_SIGNATURE 'TARS'
+#define SLIT_SIGNATURE 'TILS'
 #define WDRT_SIGNATURE 'TRDW'
 #define BGRT_SIGNATURE  0x54524742      	// "BGRT"
 
@@ -238,6 +239,100 @@ typedef struct _ACPI_SRAT
     ULONG Reserved[2];
 } ACPI_SRAT, *PACPI_SRAT;
 
+//
+// SRAT, SLIT and MADT sub-structures, byte packed as laid out by the firmware
+//
+#include <pshpack1.h>
+#define SRAT_PROCESSOR_AFFINITY         0
+#define SRAT_MEMORY_AFFINITY            1
+#define SRAT_X2APIC_AFFINITY            2
+
+#define SRAT_AFFINITY_ENABLED           0x1
+#define SRAT_MEMORY_HOT_PLUGGABLE       0x2
+
+typedef struct _ACPI_SRAT_ENTRY
+{
+    UCHAR Type;
+    UCHAR Length;
+} ACPI_SRAT_ENTRY, *PACPI_SRAT_ENTRY;
+
+typedef struct _ACPI_SRAT_PROCESSOR
+{
+    ACPI_SRAT_ENTRY Entry;
+    UCHAR ProximityDomainLow;
+    UCHAR ApicId;
+    ULONG Flags;
+    UCHAR SapicEid;
+    UCHAR ProximityDomainHigh[3];
+    ULONG ClockDomain;
+} ACPI_SRAT_PROCESSOR, *PACPI_SRAT_PROCESSOR;
+
+typedef struct _ACPI_SRAT_MEMORY
+{
+    ACPI_SRAT_ENTRY Entry;
+    ULONG ProximityDomain;
+    USHORT Reserved;
+    ULONGLONG Base;
+    ULONGLONG Length;
+    ULONG Reserved2;
+    ULONG Flags;
+    ULONGLONG Reserved3;
+} ACPI_SRAT_MEMORY, *PACPI_SRAT_MEMORY;
+
+typedef struct _ACPI_SRAT_X2APIC
+{
+    ACPI_SRAT_ENTRY Entry;
+    USHORT Reserved;
+    ULONG ProximityDomain;
+    ULONG X2ApicId;
+    ULONG Flags;
+    ULONG ClockDomain;
+    ULONG Reserved2;
+} ACPI_SRAT_X2APIC, *PACPI_SRAT_X2APIC;
+
+typedef struct _ACPI_SLIT
+{
+    DESCRIPTION_HEADER Header;
+    ULONGLONG NumberOfLocalities;
+    UCHAR Entry[ANYSIZE_ARRAY];
+} ACPI_SLIT, *PACPI_SLIT;
+
+#define MADT_LOCAL_APIC                 0
+#define MADT_LOCAL_X2APIC               9
+
+#define MADT_PROCESSOR_ENABLED          0x1
+
+typedef struct _ACPI_MADT
+{
+    DESCRIPTION_HEADER Header;
+    ULONG LocalApicAddress;
+    ULONG Flags;
+} ACPI_MADT, *PACPI_MADT;
+
+typedef struct _ACPI_MADT_ENTRY
+{
+    UCHAR Type;
+    UCHAR Length;
+} ACPI_MADT_ENTRY, *PACPI_MADT_ENTRY;
+
+typedef struct _ACPI_MADT_PROCESSOR_APIC
+{
+    ACPI_MADT_ENTRY Entry;
+    UCHAR ProcessorId;
+    UCHAR ApicId;
+    ULONG Flags;
+} ACPI_MADT_PROCESSOR_APIC, *PACPI_MADT_PROCESSOR_APIC;
+
+typedef struct _ACPI_MADT_PROCESSOR_X2APIC
+{
+    ACPI_MADT_ENTRY Entry;
+    USHORT Reserved;
+    ULONG X2ApicId;
+    ULONG Flags;
+    ULONG ProcessorUid;
+} ACPI_MADT_PROCESSOR_X2APIC, *PACPI_MADT_PROCESSOR_X2APIC;
+#include <poppack.h>
+
 typedef struct _BGRT_TABLE
 {
     DESCRIPTION_HEADER Header;
@@ -42,7 +42,10 @@ typedef enum _HAL_QUERY_INFORMATION_CLASS {
   HalProcessorBrandString,
   HalHypervisorInformation,
   HalPlatformTimerInformation,
-  HalAcpiAuditInformation
+  HalAcpiAuditInformation,
+#ifdef __REACTOS__
+  HalDynamicTickInterface = 0x100
+#endif
 } HAL_QUERY_INFORMATION_CLASS, *PHAL_QUERY_INFORMATION_CLASS;
 
 typedef enum _HAL_SET_INFORMATION_CLASS {
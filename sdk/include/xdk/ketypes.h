@@ -1107,7 +1107,10 @@ typedef VOID
 
 typedef enum _TIMER_SET_INFORMATION_CLASS {
   TimerSetCoalescableTimer,
-  MaxTimerInfoClass
+  MaxTimerInfoClass,
+#ifdef __REACTOS__
+  TimerSetHighResolution = 0x100
+#endif
 } TIMER_SET_INFORMATION_CLASS;
 
 #if (NTDDI_VERSION >= NTDDI_WIN7)
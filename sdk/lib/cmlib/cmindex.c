@@ -353,6 +353,43 @@ Return:
     return ReturnIndex;
 }
 
+static ULONG
+NTAPI
+CmpFindSubKeyInHashLeaf(IN PHHIVE Hive,
+                        IN PCM_KEY_FAST_INDEX FastIndex,
+                        IN PCUNICODE_STRING SearchName)
+{
+    ULONG HashKey, i;
+    PCM_INDEX FastEntry;
+
+    /* Make sure it's really a hash */
+    ASSERT(FastIndex->Signature == CM_KEY_HASH_LEAF);
+
+    /* Compute the hash key for the name */
+    HashKey = CmpComputeHashKey(0, SearchName, FALSE);
+
+    /* Loop all the entries */
+    for (i = 0; i < FastIndex->Count; i++)
+    {
+        /* Get the entry */
+        FastEntry = &FastIndex->List[i];
+
+        /* Compare the hash first, so that only likely matches touch the key */
+        if (FastEntry->HashKey == HashKey)
+        {
+            /* Go ahead for a full compare */
+            if (!(CmpDoCompareKeyName(Hive, SearchName, FastEntry->Cell)))
+            {
+                /* It matched, return its index */
+                return i;
+            }
+        }
+    }
+
+    /* If we got here then we failed */
+    return FastIndex->Count;
+}
+
 ULONG
 NTAPI
 CmpFindSubKeyInLeaf(IN PHHIVE Hive,
@@ -380,6 +417,21 @@ CmpFindSubKeyInLeaf(IN PHHIVE Hive,
         return 0;
     }
 
+    /*
+     * Hash leaves let us skip the names that can't possibly match. If the key
+     * isn't there, we still need the binary search to tell where it belongs.
+     */
+    if (Index->Signature == CM_KEY_HASH_LEAF)
+    {
+        i = CmpFindSubKeyInHashLeaf(Hive, (PCM_KEY_FAST_INDEX)Index, SearchName);
+        if (i < Index->Count)
+        {
+            *SubKey = ((PCM_KEY_FAST_INDEX)Index)->List[i].Cell;
+            return i;
+        }
+        i = High / 2;
+    }
+
     /* Start compare loop */
     while (TRUE)
     {
@@ -647,35 +699,12 @@ CmpFindSubKeyByHash(IN PHHIVE Hive,
                     IN PCM_KEY_FAST_INDEX FastIndex,
                     IN PCUNICODE_STRING SearchName)
 {
-    ULONG HashKey, i;
-    PCM_INDEX FastEntry;
-
-    /* Make sure it's really a hash */
-    ASSERT(FastIndex->Signature == CM_KEY_HASH_LEAF);
-
-    /* Compute the hash key for the name */
-    HashKey = CmpComputeHashKey(0, SearchName, FALSE);
-
-    /* Loop all the entries */
-    for (i = 0; i < FastIndex->Count; i++)
-    {
-        /* Get the entry */
-        FastEntry = &FastIndex->List[i];
-
-        /* Compare the hash first */
-        if (FastEntry->HashKey == HashKey)
-        {
-            /* Go ahead for a full compare */
-            if (!(CmpDoCompareKeyName(Hive, SearchName, FastEntry->Cell)))
-            {
-                /* It matched, return the cell */
-                return FastEntry->Cell;
-            }
-        }
-    }
+    ULONG i;
 
-    /* If we got here then we failed */
-    return HCELL_NIL;
+    /* Find the entry, and return its cell */
+    i = CmpFindSubKeyInHashLeaf(Hive, FastIndex, SearchName);
+    if (i >= FastIndex->Count) return HCELL_NIL;
+    return FastIndex->List[i].Cell;
 }
 
 HCELL_INDEX
@@ -111,6 +111,12 @@
         IN ULONG NumberToFind,
         IN ULONG HintIndex);
 
+    ULONG NTAPI
+    RtlFindClearBits(
+        IN PRTL_BITMAP BitMapHeader,
+        IN ULONG NumberToFind,
+        IN ULONG HintIndex);
+
     VOID NTAPI
     RtlSetBits(
         IN PRTL_BITMAP BitMapHeader,
@@ -237,6 +237,22 @@ typedef BOOLEAN
     SIZE_T BufferLength
 );
 
+typedef struct _HV_WRITE_SEGMENT
+{
+    PVOID Buffer;
+    ULONG Length;
+} HV_WRITE_SEGMENT, *PHV_WRITE_SEGMENT;
+
+/* Writes the segments one after another, starting at FileOffset */
+typedef BOOLEAN
+(CMAPI *PFILE_WRITE_GATHER_ROUTINE)(
+    struct _HHIVE *RegistryHive,
+    ULONG FileType,
+    PULONG FileOffset,
+    PHV_WRITE_SEGMENT Segments,
+    ULONG SegmentCount
+);
+
 typedef BOOLEAN
 (CMAPI *PFILE_SET_SIZE_ROUTINE)(
     struct _HHIVE *RegistryHive,
@@ -329,6 +345,9 @@ typedef struct _HHIVE
     ULONG StorageTypeCount;
     ULONG Version;
     DUAL Storage[HTYPE_COUNT];
+
+    /* ReactOS specific: optional, set by the host after HvInitialize */
+    PFILE_WRITE_GATHER_ROUTINE FileWriteGather;
 } HHIVE, *PHHIVE;
 
 #define IsFreeCell(Cell)    ((Cell)->Size >= 0)
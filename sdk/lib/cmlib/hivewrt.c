@@ -9,6 +9,170 @@
 #define NDEBUG
 #include <debug.h>
 
+/*
+ * Dirty blocks are not written one by one: runs of blocks which are
+ * contiguous in the file are gathered, and written with a single call.
+ * The blocks of a run may live in separate bins in memory: they are
+ * handed to FileWriteGather when the host provides it, or copied to
+ * a bounce buffer otherwise.
+ */
+#define HV_MAX_WRITE_SIZE       (256 * 1024)
+#define HV_MAX_WRITE_SEGMENTS   (HV_MAX_WRITE_SIZE / HBLOCK_SIZE)
+
+typedef struct _HV_WRITE_CONTEXT
+{
+    PHHIVE RegistryHive;
+    ULONG FileType;
+    ULONG FileOffset;
+    ULONG Length;
+    ULONG SegmentCount;
+    PUCHAR BounceBuffer;
+    HV_WRITE_SEGMENT Segments[HV_MAX_WRITE_SEGMENTS];
+} HV_WRITE_CONTEXT, *PHV_WRITE_CONTEXT;
+
+static PHV_WRITE_CONTEXT CMAPI
+HvpCreateWriteContext(
+    PHHIVE RegistryHive,
+    ULONG FileType)
+{
+    PHV_WRITE_CONTEXT Context;
+
+    Context = RegistryHive->Allocate(sizeof(HV_WRITE_CONTEXT), FALSE, TAG_CM);
+    if (Context == NULL)
+    {
+        return NULL;
+    }
+
+    Context->RegistryHive = RegistryHive;
+    Context->FileType = FileType;
+    Context->FileOffset = 0;
+    Context->Length = 0;
+    Context->SegmentCount = 0;
+
+    /* Without a gather routine, we copy the segments of a run. If this fails, runs get split. */
+    Context->BounceBuffer = NULL;
+    if (RegistryHive->FileWriteGather == NULL)
+    {
+        Context->BounceBuffer = RegistryHive->Allocate(HV_MAX_WRITE_SIZE, FALSE, TAG_CM);
+    }
+
+    return Context;
+}
+
+static BOOLEAN CMAPI
+HvpFlushWriteContext(
+    PHV_WRITE_CONTEXT Context)
+{
+    PHHIVE RegistryHive = Context->RegistryHive;
+    ULONG FileOffset = Context->FileOffset;
+    ULONG Offset;
+    ULONG i;
+    BOOLEAN Success = TRUE;
+
+    if (Context->SegmentCount == 0)
+    {
+        return TRUE;
+    }
+
+    if (Context->SegmentCount == 1)
+    {
+        Success = RegistryHive->FileWrite(RegistryHive, Context->FileType, &FileOffset,
+                                          Context->Segments[0].Buffer,
+                                          Context->Segments[0].Length);
+    }
+    else if (RegistryHive->FileWriteGather != NULL)
+    {
+        Success = RegistryHive->FileWriteGather(RegistryHive, Context->FileType, &FileOffset,
+                                                Context->Segments, Context->SegmentCount);
+    }
+    else if (Context->BounceBuffer != NULL)
+    {
+        Offset = 0;
+        for (i = 0; i < Context->SegmentCount; i++)
+        {
+            RtlCopyMemory(Context->BounceBuffer + Offset,
+                          Context->Segments[i].Buffer,
+                          Context->Segments[i].Length);
+            Offset += Context->Segments[i].Length;
+        }
+
+        Success = RegistryHive->FileWrite(RegistryHive, Context->FileType, &FileOffset,
+                                          Context->BounceBuffer, Context->Length);
+    }
+    else
+    {
+        for (i = 0; i < Context->SegmentCount && Success; i++)
+        {
+            Success = RegistryHive->FileWrite(RegistryHive, Context->FileType, &FileOffset,
+                                              Context->Segments[i].Buffer,
+                                              Context->Segments[i].Length);
+            FileOffset += Context->Segments[i].Length;
+        }
+    }
+
+    Context->Length = 0;
+    Context->SegmentCount = 0;
+
+    return Success;
+}
+
+static BOOLEAN CMAPI
+HvpQueueWrite(
+    PHV_WRITE_CONTEXT Context,
+    ULONG FileOffset,
+    PVOID Buffer,
+    ULONG Length)
+{
+    PHV_WRITE_SEGMENT Segment;
+
+    ASSERT(Length <= HV_MAX_WRITE_SIZE);
+
+    /* Start a new run if this doesn't follow the current one in the file, or if it's full */
+    if (Context->SegmentCount != 0 &&
+        (FileOffset != Context->FileOffset + Context->Length ||
+         Context->Length + Length > HV_MAX_WRITE_SIZE))
+    {
+        if (!HvpFlushWriteContext(Context))
+        {
+            return FALSE;
+        }
+    }
+
+    if (Context->SegmentCount == 0)
+    {
+        Context->FileOffset = FileOffset;
+    }
+    else
+    {
+        /* Extend the last segment if the buffer is contiguous in memory as well */
+        Segment = &Context->Segments[Context->SegmentCount - 1];
+        if ((PUCHAR)Segment->Buffer + Segment->Length == (PUCHAR)Buffer)
+        {
+            Segment->Length += Length;
+            Context->Length += Length;
+            return TRUE;
+        }
+    }
+
+    Segment = &Context->Segments[Context->SegmentCount++];
+    Segment->Buffer = Buffer;
+    Segment->Length = Length;
+    Context->Length += Length;
+
+    return TRUE;
+}
+
+static VOID CMAPI
+HvpFreeWriteContext(
+    PHV_WRITE_CONTEXT Context)
+{
+    if (Context->BounceBuffer != NULL)
+    {
+        Context->RegistryHive->Free(Context->BounceBuffer, 0);
+    }
+    Context->RegistryHive->Free(Context, 0);
+}
+
 static BOOLEAN CMAPI
 HvpWriteLog(
     PHHIVE RegistryHive)
@@ -22,6 +186,7 @@ HvpWriteLog(
     ULONG LastIndex;
     PVOID BlockPtr;
     BOOLEAN Success;
+    PHV_WRITE_CONTEXT WriteContext;
     static ULONG PrintCount = 0;
 
     if (PrintCount++ == 0)
@@ -78,7 +243,13 @@ HvpWriteLog(
         return FALSE;
     }
 
-    /* Write dirty blocks */
+    WriteContext = HvpCreateWriteContext(RegistryHive, HFILE_TYPE_LOG);
+    if (WriteContext == NULL)
+    {
+        return FALSE;
+    }
+
+    /* Write dirty blocks. They are packed in the log, so they all go in the same runs. */
     FileOffset = BufferSize;
     BlockIndex = 0;
     while (BlockIndex < RegistryHive->Storage[Stable].Length)
@@ -92,11 +263,10 @@ HvpWriteLog(
 
         BlockPtr = (PVOID)RegistryHive->Storage[Stable].BlockList[BlockIndex].BlockAddress;
 
-        /* Write hive block */
-        Success = RegistryHive->FileWrite(RegistryHive, HFILE_TYPE_LOG,
-                                         &FileOffset, BlockPtr, HBLOCK_SIZE);
-        if (!Success)
+        /* Queue hive block */
+        if (!HvpQueueWrite(WriteContext, FileOffset, BlockPtr, HBLOCK_SIZE))
         {
+            HvpFreeWriteContext(WriteContext);
             return FALSE;
         }
 
@@ -104,6 +274,13 @@ HvpWriteLog(
         FileOffset += HBLOCK_SIZE;
     }
 
+    Success = HvpFlushWriteContext(WriteContext);
+    HvpFreeWriteContext(WriteContext);
+    if (!Success)
+    {
+        return FALSE;
+    }
+
     Success = RegistryHive->FileSetSize(RegistryHive, HFILE_TYPE_LOG, FileOffset, FileOffset);
     if (!Success)
     {
@@ -151,8 +328,10 @@ HvpWriteHive(
     ULONG FileOffset;
     ULONG BlockIndex;
     ULONG LastIndex;
+    ULONG RunLength;
     PVOID BlockPtr;
     BOOLEAN Success;
+    PHV_WRITE_CONTEXT WriteContext;
 
     ASSERT(RegistryHive->ReadOnly == FALSE);
     ASSERT(RegistryHive->BaseBlock->Length ==
@@ -182,6 +361,12 @@ HvpWriteHive(
         return FALSE;
     }
 
+    WriteContext = HvpCreateWriteContext(RegistryHive, HFILE_TYPE_PRIMARY);
+    if (WriteContext == NULL)
+    {
+        return FALSE;
+    }
+
     BlockIndex = 0;
     while (BlockIndex < RegistryHive->Storage[Stable].Length)
     {
@@ -193,20 +378,40 @@ HvpWriteHive(
             {
                 break;
             }
-        }
 
-        BlockPtr = (PVOID)RegistryHive->Storage[Stable].BlockList[BlockIndex].BlockAddress;
-        FileOffset = (BlockIndex + 1) * HBLOCK_SIZE;
+            /* Get the whole dirty run */
+            RunLength = RtlFindClearBits(&RegistryHive->DirtyVector, 1, BlockIndex);
+            if (RunLength == ~0U || RunLength <= BlockIndex ||
+                RunLength > RegistryHive->Storage[Stable].Length)
+            {
+                RunLength = RegistryHive->Storage[Stable].Length;
+            }
+            RunLength -= BlockIndex;
+        }
+        else
+        {
+            RunLength = RegistryHive->Storage[Stable].Length - BlockIndex;
+        }
 
-        /* Write hive block */
-        Success = RegistryHive->FileWrite(RegistryHive, HFILE_TYPE_PRIMARY,
-                                          &FileOffset, BlockPtr, HBLOCK_SIZE);
-        if (!Success)
+        /* Queue hive blocks of the run */
+        for (; RunLength != 0; RunLength--, BlockIndex++)
         {
-            return FALSE;
+            BlockPtr = (PVOID)RegistryHive->Storage[Stable].BlockList[BlockIndex].BlockAddress;
+            FileOffset = (BlockIndex + 1) * HBLOCK_SIZE;
+
+            if (!HvpQueueWrite(WriteContext, FileOffset, BlockPtr, HBLOCK_SIZE))
+            {
+                HvpFreeWriteContext(WriteContext);
+                return FALSE;
+            }
         }
+    }
 
-        BlockIndex++;
+    Success = HvpFlushWriteContext(WriteContext);
+    HvpFreeWriteContext(WriteContext);
+    if (!Success)
+    {
+        return FALSE;
     }
 
     Success = RegistryHive->FileFlush(RegistryHive, HFILE_TYPE_PRIMARY, NULL, 0);
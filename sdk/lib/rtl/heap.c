@@ -2017,11 +2017,38 @@ RtlAllocateHeap(IN PVOID HeapPtr,
 
     Index = AllocationSize >> HEAP_ENTRY_SHIFT;
 
+    /* Small blocks without extra stuff come from the low fragmentation front end, if it's on */
+    if (Heap->FrontEndHeap &&
+        Index <= HEAP_LFH_MAX_BLOCK_UNITS &&
+        !(EntryFlags & HEAP_ENTRY_EXTRA_PRESENT) &&
+        !(Flags & HEAP_NO_SERIALIZE))
+    {
+        InUseEntry = RtlpLfhAllocate(Heap, Index, Size, EntryFlags);
+        if (InUseEntry)
+        {
+            /* Zero memory if that was requested */
+            if (Flags & HEAP_ZERO_MEMORY)
+                RtlZeroMemory(InUseEntry + 1, Size);
+
+            return InUseEntry + 1;
+        }
+
+        /* No memory for a new user block, the back end may still find some */
+    }
+
     /* Acquire the lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
         RtlEnterHeapLock(Heap->LockVariable, TRUE);
         HeapLocked = TRUE;
+
+        /* Count small blocks, many of one size turn the front end on */
+        if (!Heap->FrontEndHeap &&
+            Index <= HEAP_LFH_MAX_BLOCK_UNITS &&
+            !(EntryFlags & HEAP_ENTRY_EXTRA_PRESENT))
+        {
+            RtlpLfhTrackUsage(Heap, Index, TRUE);
+        }
     }
 
     /* Depending on the size, the allocation is going to be done from dedicated,
@@ -2229,7 +2256,7 @@ BOOLEAN NTAPI RtlFreeHeap(
         /* Check this entry, fail if it's invalid */
         if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY) ||
             (((ULONG_PTR)Ptr & 0x7) != 0) ||
-            (HeapEntry->SegmentOffset >= HEAP_SEGMENTS))
+            (HeapEntry->SegmentOffset >= HEAP_SEGMENTS && !RtlpIsLfhBlock(HeapEntry)))
         {
             /* This is an invalid block */
             DPRINT1("HEAP: Trying to free an invalid address %p!\n", Ptr);
@@ -2246,6 +2273,10 @@ BOOLEAN NTAPI RtlFreeHeap(
     }
     _SEH2_END;
 
+    /* Blocks of the front end go back to it without taking the lock */
+    if (RtlpIsLfhBlock(HeapEntry))
+        return RtlpLfhFree(Heap, HeapEntry);
+
     /* Lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2281,6 +2312,15 @@ BOOLEAN NTAPI RtlFreeHeap(
         /* Normal allocation */
         BlockSize = HeapEntry->Size;
 
+        /* Keep the front end's usage counters in balance */
+        if (Locked &&
+            !Heap->FrontEndHeap &&
+            BlockSize <= HEAP_LFH_MAX_BLOCK_UNITS &&
+            !(HeapEntry->Flags & HEAP_ENTRY_EXTRA_PRESENT))
+        {
+            RtlpLfhTrackUsage(Heap, BlockSize, FALSE);
+        }
+
         // TODO: Tagging
 
         /* Coalesce in kernel mode, and in usermode if it's not disabled */
@@ -2661,6 +2701,10 @@ RtlReAllocateHeap(HANDLE HeapPtr,
         return NULL;
     }
 
+    /* Blocks of the front end are either reused as they are or moved */
+    if (RtlpIsLfhBlock((PHEAP_ENTRY)Ptr - 1))
+        return RtlpLfhReAllocate(Heap, Flags, Ptr, Size);
+
     /* Calculate allocation size and index */
     if (Size)
         AllocationSize = Size;
@@ -3236,6 +3280,13 @@ RtlpValidateHeapEntry(
     if ((ULONG_PTR)HeapEntry & (HEAP_ENTRY_SIZE - 1)) goto invalid_entry;
     if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY)) goto invalid_entry;
 
+    /* Blocks of the front end live inside a busy block of the back end */
+    if (RtlpIsLfhBlock(HeapEntry))
+    {
+        if (!RtlpLfhValidateEntry(Heap, HeapEntry)) goto invalid_entry;
+        return TRUE;
+    }
+
     BigAllocation = HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC;
     Segment = Heap->Segments[HeapEntry->SegmentOffset];
 
@@ -3989,6 +4040,9 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
                       IN PVOID HeapInformation,
                       IN SIZE_T HeapInformationLength)
 {
+    PHEAP Heap = (PHEAP)HeapHandle;
+    NTSTATUS Status;
+
     /* Setting heap information is not really supported except for enabling LFH */
     if (HeapInformationClass == HeapCompatibilityInformation)
     {
@@ -4000,13 +4054,25 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
         }
 
         /* Check for a special magic value for enabling LFH */
-        if (*(PULONG)HeapInformation != 2)
+        if (*(PULONG)HeapInformation != HEAP_FRONT_LOWFRAGHEAP)
         {
             return STATUS_UNSUCCESSFUL;
         }
 
-        DPRINT1("RtlSetHeapInformation() needs to enable LFH\n");
-        return STATUS_SUCCESS;
+        /* Page heaps and heaps without a lock can't have it */
+        if (!Heap ||
+            (Heap->ForceFlags & HEAP_FLAG_PAGE_ALLOCS) ||
+            (Heap->Flags & HEAP_NO_SERIALIZE))
+        {
+            return STATUS_UNSUCCESSFUL;
+        }
+
+        /* Once enabled it stays on for the life of the heap */
+        RtlEnterHeapLock(Heap->LockVariable, TRUE);
+        Status = RtlpActivateLowFragHeap(Heap);
+        RtlLeaveHeapLock(Heap->LockVariable);
+
+        return Status;
     }
 
     return STATUS_SUCCESS;
@@ -23,6 +23,16 @@
 #endif
 #define HEAP_MAX_BLOCK_SIZE ((0x80000 - PAGE_SIZE) >> HEAP_ENTRY_SHIFT)
 
+/* Low fragmentation front end definitions */
+#define HEAP_FRONT_LOWFRAGHEAP      2
+#define HEAP_LFH_BUCKETS            80
+#define HEAP_LFH_MAX_BLOCK_UNITS    256 /* 2K on x86, 4K on x64, header included */
+#define HEAP_LFH_MAX_SLOTS          16
+#define HEAP_LFH_USER_BLOCK_SIZE    0x4000
+#define HEAP_LFH_MIN_BLOCK_COUNT    8
+#define HEAP_LFH_MAX_BLOCK_COUNT    1024
+#define HEAP_LFH_ZONE_COUNT         64
+
 #define ARENA_INUSE_FILLER     0xBAADF00D
 #define ARENA_FREE_FILLER      0xFEEEFEEE
 #define HEAP_TAIL_FILL         0xab
@@ -271,6 +281,9 @@ typedef struct _HEAP
     UCHAR FrontEndHeapType;
     HEAP_COUNTERS Counters;
     HEAP_TUNING_PARAMETERS TuningParameters;
+    /* Live back end blocks of each LFH bucket's size, counted until the LFH is
+       turned on. Vista keeps this elsewhere, but nothing outside RTL looks at it */
+    USHORT FrontEndHeapUsageData[HEAP_LFH_BUCKETS]; //FIXME: non-Vista
 } HEAP, *PHEAP;
 
 typedef struct _HEAP_SEGMENT
@@ -318,6 +331,64 @@ typedef struct _HEAP_VIRTUAL_ALLOC_ENTRY
     HEAP_ENTRY BusyBlock;
 } HEAP_VIRTUAL_ALLOC_ENTRY, *PHEAP_VIRTUAL_ALLOC_ENTRY;
 
+/* Blocks of the low fragmentation front end keep this in their LFHFlags */
+#define HEAP_LFH_BLOCK 0x80
+
+typedef union _HEAP_LFH_INTERLOCK
+{
+    struct
+    {
+        USHORT Depth;
+        USHORT FreeEntryOffset;
+        ULONG Sequence:30;
+        ULONG Active:1;
+        ULONG Queued:1;
+    };
+    LONGLONG Exchange;
+} HEAP_LFH_INTERLOCK, *PHEAP_LFH_INTERLOCK;
+
+typedef struct _HEAP_LFH_USER_BLOCK
+{
+    struct _HEAP_LFH_SUBSEGMENT *SubSegment;
+    ULONG_PTR Reserved;
+} HEAP_LFH_USER_BLOCK, *PHEAP_LFH_USER_BLOCK;
+
+C_ASSERT(sizeof(HEAP_LFH_USER_BLOCK) == sizeof(HEAP_ENTRY));
+
+typedef struct _HEAP_LFH_SUBSEGMENT
+{
+    volatile HEAP_LFH_INTERLOCK Interlock;
+    PHEAP_LFH_USER_BLOCK UserBlocks;
+    struct _HEAP_LFH_BUCKET *Bucket;
+    USHORT BlockCount;
+    BOOLEAN Listed;
+    LIST_ENTRY ListEntry;
+} HEAP_LFH_SUBSEGMENT, *PHEAP_LFH_SUBSEGMENT;
+
+typedef struct _HEAP_LFH_BUCKET
+{
+    USHORT BlockUnits;
+    USHORT BlockCount;
+    ULONG PartialCount;
+    LIST_ENTRY PartialSubSegments;
+    PHEAP_LFH_SUBSEGMENT volatile ActiveSubSegments[HEAP_LFH_MAX_SLOTS];
+} HEAP_LFH_BUCKET, *PHEAP_LFH_BUCKET;
+
+typedef struct _HEAP_LFH
+{
+    PHEAP Heap;
+    ULONG SlotMask;
+    LIST_ENTRY FreeSubSegments;
+    HEAP_LFH_BUCKET Buckets[HEAP_LFH_BUCKETS];
+} HEAP_LFH, *PHEAP_LFH;
+
+FORCEINLINE BOOLEAN
+RtlpIsLfhBlock(PHEAP_ENTRY HeapEntry)
+{
+    return !(HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC) &&
+           HeapEntry->LFHFlags == HEAP_LFH_BLOCK;
+}
+
 /* Global variables */
 extern RTL_CRITICAL_SECTION RtlpProcessHeapsListLock;
 extern BOOLEAN RtlpPageHeapEnabled;
@@ -343,6 +414,35 @@ RtlpValidateHeapEntry(PHEAP Heap, PHEAP_ENTRY HeapEntry);
 BOOLEAN NTAPI
 RtlpValidateHeapHeaders(PHEAP Heap, BOOLEAN Recalculate);
 
+/* heaplfh.c */
+NTSTATUS NTAPI
+RtlpActivateLowFragHeap(PHEAP Heap);
+
+VOID NTAPI
+RtlpLfhTrackUsage(PHEAP Heap,
+                  SIZE_T Index,
+                  BOOLEAN Allocated);
+
+PHEAP_ENTRY NTAPI
+RtlpLfhAllocate(PHEAP Heap,
+                SIZE_T Index,
+                SIZE_T Size,
+                UCHAR EntryFlags);
+
+BOOLEAN NTAPI
+RtlpLfhFree(PHEAP Heap,
+            PHEAP_ENTRY HeapEntry);
+
+PVOID NTAPI
+RtlpLfhReAllocate(PHEAP Heap,
+                  ULONG Flags,
+                  PVOID Ptr,
+                  SIZE_T Size);
+
+BOOLEAN NTAPI
+RtlpLfhValidateEntry(PHEAP Heap,
+                     PHEAP_ENTRY HeapEntry);
+
 /* heapdbg.c */
 HANDLE NTAPI
 RtlDebugCreateHeap(ULONG Flags,
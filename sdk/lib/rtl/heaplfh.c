@@ -0,0 +1,645 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS system libraries
+ * FILE:            lib/rtl/heaplfh.c
+ * PURPOSE:         RTL Heap low fragmentation front end
+ */
+
+/* Small blocks are grouped by size into buckets. Each bucket carves its
+   blocks out of user blocks, which are ordinary busy blocks of the back end.
+   A subsegment describes one user block and keeps its free blocks in a
+   singly linked list of offsets, which is updated with a single 64-bit
+   compare-exchange, so that allocating and freeing never take the heap lock.
+   Each bucket has a few affinity slots holding the subsegment threads
+   allocate from, and a thread always uses the same slot. The heap lock is
+   only taken to get a new subsegment for a slot, to put a subsegment which
+   got free blocks back on the bucket's list, and to give user blocks back. */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl.h>
+#include <heap.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* FUNCTIONS *****************************************************************/
+
+FORCEINLINE
+ULONG
+RtlpLfhBucketIndex(SIZE_T Units)
+{
+    /* One unit granularity up to 32 units, then 16 buckets for each power of two */
+    if (Units <= 32) return (ULONG)Units - 1;
+    if (Units <= 64) return 32 + ((ULONG)Units - 33) / 2;
+    if (Units <= 128) return 48 + ((ULONG)Units - 65) / 4;
+    return 64 + ((ULONG)Units - 129) / 8;
+}
+
+FORCEINLINE
+USHORT
+RtlpLfhBucketUnits(ULONG Index)
+{
+    if (Index < 32) return (USHORT)(Index + 1);
+    if (Index < 48) return (USHORT)(34 + (Index - 32) * 2);
+    if (Index < 64) return (USHORT)(68 + (Index - 48) * 4);
+    return (USHORT)(136 + (Index - 64) * 8);
+}
+
+FORCEINLINE
+ULONG
+RtlpLfhBucketBlockCount(USHORT BlockUnits)
+{
+    ULONG BlockCount;
+
+    /* Aim at a fixed user block size, within limits */
+    BlockCount = HEAP_LFH_USER_BLOCK_SIZE / (BlockUnits << HEAP_ENTRY_SHIFT);
+    if (BlockCount < HEAP_LFH_MIN_BLOCK_COUNT) BlockCount = HEAP_LFH_MIN_BLOCK_COUNT;
+    if (BlockCount > HEAP_LFH_MAX_BLOCK_COUNT) BlockCount = HEAP_LFH_MAX_BLOCK_COUNT;
+    return BlockCount;
+}
+
+FORCEINLINE
+ULONG
+RtlpLfhCurrentSlot(PHEAP_LFH Lfh)
+{
+    /* A thread always comes back to the same slot */
+    return ((ULONG)(ULONG_PTR)NtCurrentTeb()->ClientId.UniqueThread >> 2) & Lfh->SlotMask;
+}
+
+NTSTATUS NTAPI
+RtlpActivateLowFragHeap(PHEAP Heap)
+{
+    PHEAP_LFH Lfh;
+    PHEAP_LFH_BUCKET Bucket;
+    ULONG Index, Slots, BlockCount;
+
+    /* The caller holds the heap lock */
+    if (Heap->FrontEndHeap) return STATUS_SUCCESS;
+
+    /* The front end only serves plain growable user mode heaps */
+    if (RtlpGetMode() != UserMode ||
+        (Heap->ForceFlags & HEAP_FLAG_PAGE_ALLOCS) ||
+        RtlpHeapIsSpecial(Heap->Flags) ||
+        !(Heap->Flags & HEAP_GROWABLE) ||
+        (Heap->Flags & (HEAP_NO_SERIALIZE |
+                        HEAP_TAIL_CHECKING_ENABLED |
+                        HEAP_FREE_CHECKING_ENABLED |
+                        HEAP_CREATE_ALIGN_16)))
+    {
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    /* The front end lives in the back end, it goes away with the heap */
+    Lfh = RtlAllocateHeap(Heap, HEAP_NO_SERIALIZE | HEAP_ZERO_MEMORY, sizeof(HEAP_LFH));
+    if (!Lfh) return STATUS_NO_MEMORY;
+
+    /* One affinity slot per processor, rounded up to a power of two */
+    for (Slots = 1;
+         Slots < NtCurrentPeb()->NumberOfProcessors && Slots < HEAP_LFH_MAX_SLOTS;
+         Slots <<= 1);
+
+    Lfh->Heap = Heap;
+    Lfh->SlotMask = Slots - 1;
+    InitializeListHead(&Lfh->FreeSubSegments);
+
+    for (Index = 0; Index < HEAP_LFH_BUCKETS; Index++)
+    {
+        Bucket = &Lfh->Buckets[Index];
+        Bucket->BlockUnits = RtlpLfhBucketUnits(Index);
+
+        BlockCount = RtlpLfhBucketBlockCount(Bucket->BlockUnits);
+        Bucket->BlockCount = (USHORT)BlockCount;
+
+        InitializeListHead(&Bucket->PartialSubSegments);
+    }
+
+    /* Publish it last, allocations look at the pointer without the lock */
+    Heap->FrontEndHeapType = HEAP_FRONT_LOWFRAGHEAP;
+    InterlockedExchangePointer(&Heap->FrontEndHeap, Lfh);
+
+    DPRINT("Low fragmentation heap enabled for heap %p with %lu slots\n", Heap, Slots);
+    return STATUS_SUCCESS;
+}
+
+VOID NTAPI
+RtlpLfhTrackUsage(PHEAP Heap,
+                  SIZE_T Index,
+                  BOOLEAN Allocated)
+{
+    PUSHORT Usage;
+    ULONG Bucket;
+
+    /* The caller holds the heap lock and made sure that the size fits a bucket */
+    Bucket = RtlpLfhBucketIndex(Index);
+    Usage = &Heap->FrontEndHeapUsageData[Bucket];
+
+    if (!Allocated)
+    {
+        if (*Usage) (*Usage)--;
+        return;
+    }
+
+    /* Only turn the front end on once one size has enough live blocks to fill
+       a whole user block. Below that, the buckets and the partly used user
+       blocks would cost more memory than the back end wastes on fragmentation */
+    if (++(*Usage) < RtlpLfhBucketBlockCount(RtlpLfhBucketUnits(Bucket))) return;
+
+    if (!NT_SUCCESS(RtlpActivateLowFragHeap(Heap)))
+    {
+        /* Don't try again too soon */
+        *Usage = 0;
+    }
+}
+
+static
+VOID
+RtlpLfhReleaseSubSegment(PHEAP Heap,
+                         PHEAP_LFH Lfh,
+                         PHEAP_LFH_SUBSEGMENT SubSegment)
+{
+    HEAP_LFH_INTERLOCK Current;
+    PHEAP_LFH_USER_BLOCK UserBlocks;
+
+    /* Take it off the bucket */
+    RemoveEntryList(&SubSegment->ListEntry);
+    SubSegment->Bucket->PartialCount--;
+    SubSegment->Listed = FALSE;
+
+    /* Nobody can pop from it, and all its blocks are free, so nobody pushes either.
+       Only the sequence survives, it keeps stale allocators from succeeding */
+    Current.Exchange = SubSegment->Interlock.Exchange;
+    Current.Depth = 0;
+    Current.FreeEntryOffset = 0;
+    Current.Sequence++;
+    Current.Queued = 0;
+    InterlockedExchange64(&SubSegment->Interlock.Exchange, Current.Exchange);
+
+    UserBlocks = SubSegment->UserBlocks;
+    SubSegment->UserBlocks = NULL;
+
+    /* The descriptor is kept for reuse */
+    InsertHeadList(&Lfh->FreeSubSegments, &SubSegment->ListEntry);
+
+    RtlFreeHeap(Heap, HEAP_NO_SERIALIZE, UserBlocks);
+}
+
+static
+VOID
+RtlpLfhTrimSubSegment(PHEAP Heap,
+                      PHEAP_LFH_SUBSEGMENT SubSegment)
+{
+    HEAP_LFH_INTERLOCK Current;
+
+    /* The caller holds the heap lock. Keep one spare subsegment per bucket */
+    Current.Exchange = SubSegment->Interlock.Exchange;
+    if (SubSegment->Listed &&
+        !Current.Active &&
+        Current.Depth == SubSegment->BlockCount &&
+        SubSegment->Bucket->PartialCount > 1)
+    {
+        RtlpLfhReleaseSubSegment(Heap, (PHEAP_LFH)Heap->FrontEndHeap, SubSegment);
+    }
+}
+
+static
+VOID
+RtlpLfhQueueSubSegment(PHEAP Heap,
+                       PHEAP_LFH_SUBSEGMENT SubSegment)
+{
+    PHEAP_LFH_BUCKET Bucket;
+
+    /* Whoever sets the queued bit puts the subsegment on its bucket's list */
+    RtlEnterHeapLock(Heap->LockVariable, TRUE);
+
+    Bucket = SubSegment->Bucket;
+    InsertTailList(&Bucket->PartialSubSegments, &SubSegment->ListEntry);
+    Bucket->PartialCount++;
+    SubSegment->Listed = TRUE;
+
+    /* Its blocks may have all come back meanwhile */
+    RtlpLfhTrimSubSegment(Heap, SubSegment);
+
+    RtlLeaveHeapLock(Heap->LockVariable);
+}
+
+static
+PHEAP_LFH_SUBSEGMENT
+RtlpLfhCreateSubSegment(PHEAP Heap,
+                        PHEAP_LFH Lfh,
+                        PHEAP_LFH_BUCKET Bucket)
+{
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    PHEAP_LFH_USER_BLOCK UserBlocks;
+    HEAP_LFH_INTERLOCK Current;
+    PHEAP_ENTRY HeapEntry;
+    USHORT Offset;
+    ULONG Index;
+
+    /* The caller holds the heap lock. Descriptors come in zones which are never freed */
+    if (IsListEmpty(&Lfh->FreeSubSegments))
+    {
+        SubSegment = RtlAllocateHeap(Heap,
+                                     HEAP_NO_SERIALIZE | HEAP_ZERO_MEMORY,
+                                     HEAP_LFH_ZONE_COUNT * sizeof(HEAP_LFH_SUBSEGMENT));
+        if (!SubSegment) return NULL;
+
+        for (Index = 0; Index < HEAP_LFH_ZONE_COUNT; Index++)
+            InsertTailList(&Lfh->FreeSubSegments, &SubSegment[Index].ListEntry);
+    }
+
+    /* Get the user block from the back end */
+    UserBlocks = RtlAllocateHeap(Heap,
+                                 HEAP_NO_SERIALIZE,
+                                 sizeof(HEAP_LFH_USER_BLOCK) +
+                                 ((SIZE_T)Bucket->BlockCount * Bucket->BlockUnits << HEAP_ENTRY_SHIFT));
+    if (!UserBlocks) return NULL;
+
+    SubSegment = CONTAINING_RECORD(RemoveHeadList(&Lfh->FreeSubSegments),
+                                   HEAP_LFH_SUBSEGMENT,
+                                   ListEntry);
+
+    /* Chain all blocks, in address order */
+    HeapEntry = (PHEAP_ENTRY)(UserBlocks + 1);
+    Offset = sizeof(HEAP_LFH_USER_BLOCK) >> HEAP_ENTRY_SHIFT;
+    for (Index = 0; Index < Bucket->BlockCount; Index++)
+    {
+        HeapEntry->Size = Bucket->BlockUnits;
+        HeapEntry->Flags = 0;
+        HeapEntry->SmallTagIndex = 0;
+        HeapEntry->PreviousSize = Offset;
+        HeapEntry->LFHFlags = HEAP_LFH_BLOCK;
+        HeapEntry->UnusedBytes = 0;
+
+        Offset += Bucket->BlockUnits;
+        *(PUSHORT)(HeapEntry + 1) = (Index + 1 < Bucket->BlockCount) ? Offset : 0;
+        HeapEntry += Bucket->BlockUnits;
+    }
+
+    UserBlocks->SubSegment = SubSegment;
+    UserBlocks->Reserved = 0;
+    SubSegment->UserBlocks = UserBlocks;
+    SubSegment->Bucket = Bucket;
+    SubSegment->BlockCount = Bucket->BlockCount;
+    SubSegment->Listed = FALSE;
+
+    /* A reused descriptor keeps counting its sequence */
+    Current.Exchange = SubSegment->Interlock.Exchange;
+    Current.Depth = Bucket->BlockCount;
+    Current.FreeEntryOffset = sizeof(HEAP_LFH_USER_BLOCK) >> HEAP_ENTRY_SHIFT;
+    Current.Sequence++;
+    Current.Active = 0;
+    Current.Queued = 0;
+    InterlockedExchange64(&SubSegment->Interlock.Exchange, Current.Exchange);
+
+    return SubSegment;
+}
+
+static
+PHEAP_LFH_SUBSEGMENT
+RtlpLfhActivateSubSegment(PHEAP Heap,
+                          PHEAP_LFH Lfh,
+                          PHEAP_LFH_BUCKET Bucket)
+{
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    HEAP_LFH_INTERLOCK Old, New;
+
+    RtlEnterHeapLock(Heap->LockVariable, TRUE);
+
+    /* Prefer a subsegment which has free blocks already */
+    if (!IsListEmpty(&Bucket->PartialSubSegments))
+    {
+        SubSegment = CONTAINING_RECORD(RemoveHeadList(&Bucket->PartialSubSegments),
+                                       HEAP_LFH_SUBSEGMENT,
+                                       ListEntry);
+        Bucket->PartialCount--;
+        SubSegment->Listed = FALSE;
+    }
+    else
+    {
+        SubSegment = RtlpLfhCreateSubSegment(Heap, Lfh, Bucket);
+        if (!SubSegment)
+        {
+            RtlLeaveHeapLock(Heap->LockVariable);
+            return NULL;
+        }
+    }
+
+    /* Blocks may still be freed into it while we mark it active */
+    do
+    {
+        Old.Exchange = SubSegment->Interlock.Exchange;
+        New = Old;
+        New.Sequence++;
+        New.Active = 1;
+        New.Queued = 0;
+    } while (InterlockedCompareExchange64(&SubSegment->Interlock.Exchange,
+                                          New.Exchange,
+                                          Old.Exchange) != Old.Exchange);
+
+    RtlLeaveHeapLock(Heap->LockVariable);
+    return SubSegment;
+}
+
+static
+VOID
+RtlpLfhDeactivateSubSegment(PHEAP Heap,
+                            PHEAP_LFH_BUCKET Bucket,
+                            PHEAP_LFH_SUBSEGMENT SubSegment)
+{
+    HEAP_LFH_INTERLOCK Old, New;
+
+    do
+    {
+        Old.Exchange = SubSegment->Interlock.Exchange;
+
+        /* Somebody else may have done it already */
+        if (!Old.Active || SubSegment->Bucket != Bucket) return;
+
+        New = Old;
+        New.Sequence++;
+        New.Active = 0;
+        New.Queued = (Old.Depth != 0);
+    } while (InterlockedCompareExchange64(&SubSegment->Interlock.Exchange,
+                                          New.Exchange,
+                                          Old.Exchange) != Old.Exchange);
+
+    /* An empty one is queued by the first free instead */
+    if (New.Queued) RtlpLfhQueueSubSegment(Heap, SubSegment);
+}
+
+static
+PHEAP_ENTRY
+RtlpLfhPopEntry(PHEAP_LFH_BUCKET Bucket,
+                PHEAP_LFH_SUBSEGMENT SubSegment)
+{
+    HEAP_LFH_INTERLOCK Old, New;
+    PHEAP_ENTRY HeapEntry = NULL;
+
+    /* The subsegment may be released and reused under us, its user block
+       can be gone by the time we read the next offset out of it */
+    _SEH2_TRY
+    {
+        for (;;)
+        {
+            Old.Exchange = SubSegment->Interlock.Exchange;
+            if (!Old.Active || SubSegment->Bucket != Bucket) break;
+
+            New = Old;
+            New.Sequence++;
+
+            if (!Old.Depth)
+            {
+                /* Exhausted, the first free puts it back on the bucket's list */
+                New.Active = 0;
+                if (InterlockedCompareExchange64(&SubSegment->Interlock.Exchange,
+                                                 New.Exchange,
+                                                 Old.Exchange) == Old.Exchange)
+                {
+                    break;
+                }
+                continue;
+            }
+
+            HeapEntry = (PHEAP_ENTRY)SubSegment->UserBlocks + Old.FreeEntryOffset;
+            New.Depth--;
+            New.FreeEntryOffset = *(volatile USHORT *)(HeapEntry + 1);
+
+            if (InterlockedCompareExchange64(&SubSegment->Interlock.Exchange,
+                                             New.Exchange,
+                                             Old.Exchange) == Old.Exchange)
+            {
+                break;
+            }
+            HeapEntry = NULL;
+        }
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        HeapEntry = NULL;
+    }
+    _SEH2_END;
+
+    return HeapEntry;
+}
+
+PHEAP_ENTRY NTAPI
+RtlpLfhAllocate(PHEAP Heap,
+                SIZE_T Index,
+                SIZE_T Size,
+                UCHAR EntryFlags)
+{
+    PHEAP_LFH Lfh = (PHEAP_LFH)Heap->FrontEndHeap;
+    PHEAP_LFH_BUCKET Bucket;
+    PHEAP_LFH_SUBSEGMENT volatile *Slot;
+    PHEAP_LFH_SUBSEGMENT SubSegment, Previous;
+    PHEAP_ENTRY HeapEntry;
+
+    Bucket = &Lfh->Buckets[RtlpLfhBucketIndex(Index)];
+    Slot = &Bucket->ActiveSubSegments[RtlpLfhCurrentSlot(Lfh)];
+
+    for (;;)
+    {
+        SubSegment = *Slot;
+        if (SubSegment)
+        {
+            HeapEntry = RtlpLfhPopEntry(Bucket, SubSegment);
+            if (HeapEntry) break;
+
+            /* It ran out of blocks or was taken away, drop it from the slot */
+            InterlockedCompareExchangePointer((PVOID *)Slot, NULL, SubSegment);
+            continue;
+        }
+
+        SubSegment = RtlpLfhActivateSubSegment(Heap, Lfh, Bucket);
+        if (!SubSegment) return NULL;
+
+        /* Whatever another thread put in the slot meanwhile goes back to the bucket */
+        Previous = InterlockedExchangePointer((PVOID *)Slot, SubSegment);
+        if (Previous && Previous != SubSegment)
+            RtlpLfhDeactivateSubSegment(Heap, Bucket, Previous);
+    }
+
+    HeapEntry->Flags = EntryFlags;
+    HeapEntry->SmallTagIndex = 0;
+    HeapEntry->UnusedBytes = (UCHAR)((HeapEntry->Size << HEAP_ENTRY_SHIFT) - Size);
+
+    return HeapEntry;
+}
+
+static
+PHEAP_LFH_SUBSEGMENT
+RtlpLfhGetSubSegment(PHEAP Heap,
+                     PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH Lfh = (PHEAP_LFH)Heap->FrontEndHeap;
+    PHEAP_LFH_USER_BLOCK UserBlocks;
+    PHEAP_LFH_SUBSEGMENT SubSegment = NULL;
+
+    if (!Lfh) return NULL;
+
+    /* The pointer comes from the caller, so check everything it leads to */
+    _SEH2_TRY
+    {
+        if (HeapEntry->PreviousSize)
+        {
+            UserBlocks = (PHEAP_LFH_USER_BLOCK)(HeapEntry - HeapEntry->PreviousSize);
+            SubSegment = UserBlocks->SubSegment;
+
+            if (!SubSegment ||
+                SubSegment->UserBlocks != UserBlocks ||
+                SubSegment->Bucket < &Lfh->Buckets[0] ||
+                SubSegment->Bucket >= &Lfh->Buckets[HEAP_LFH_BUCKETS] ||
+                SubSegment->Bucket->BlockUnits != HeapEntry->Size)
+            {
+                SubSegment = NULL;
+            }
+        }
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        SubSegment = NULL;
+    }
+    _SEH2_END;
+
+    return SubSegment;
+}
+
+BOOLEAN NTAPI
+RtlpLfhFree(PHEAP Heap,
+            PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    HEAP_LFH_INTERLOCK Old, New;
+
+    SubSegment = RtlpLfhGetSubSegment(Heap, HeapEntry);
+    if (!SubSegment)
+    {
+        DPRINT1("HEAP: Trying to free an invalid front end block %p!\n", HeapEntry + 1);
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    HeapEntry->Flags = 0;
+
+    do
+    {
+        Old.Exchange = SubSegment->Interlock.Exchange;
+        *(PUSHORT)(HeapEntry + 1) = Old.FreeEntryOffset;
+
+        New = Old;
+        New.Depth++;
+        New.FreeEntryOffset = HeapEntry->PreviousSize;
+        New.Sequence++;
+
+        /* An inactive subsegment that gets a free block needs to be found again */
+        if (!Old.Active) New.Queued = 1;
+    } while (InterlockedCompareExchange64(&SubSegment->Interlock.Exchange,
+                                          New.Exchange,
+                                          Old.Exchange) != Old.Exchange);
+
+    if (!Old.Active)
+    {
+        if (!Old.Queued)
+        {
+            RtlpLfhQueueSubSegment(Heap, SubSegment);
+        }
+        else if (New.Depth == SubSegment->BlockCount)
+        {
+            /* The descriptors are never freed, so it's safe to look at it again under the lock */
+            RtlEnterHeapLock(Heap->LockVariable, TRUE);
+            RtlpLfhTrimSubSegment(Heap, SubSegment);
+            RtlLeaveHeapLock(Heap->LockVariable);
+        }
+    }
+
+    return TRUE;
+}
+
+PVOID NTAPI
+RtlpLfhReAllocate(PHEAP Heap,
+                  ULONG Flags,
+                  PVOID Ptr,
+                  SIZE_T Size)
+{
+    PHEAP_ENTRY InUseEntry = (PHEAP_ENTRY)Ptr - 1;
+    SIZE_T OldSize, BlockSize;
+    PVOID NewBaseAddress;
+    EXCEPTION_RECORD ExceptionRecord;
+
+    if (!(InUseEntry->Flags & HEAP_ENTRY_BUSY))
+    {
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+        return Ptr;
+    }
+
+    BlockSize = InUseEntry->Size << HEAP_ENTRY_SHIFT;
+    OldSize = BlockSize - InUseEntry->UnusedBytes;
+
+    /* Reuse the block if the new size still fits it well enough, extra stuff needs the back end */
+    if (!(Flags & HEAP_EXTRA_FLAGS_MASK) &&
+        !Heap->PseudoTagEntries &&
+        Size <= BlockSize - sizeof(HEAP_ENTRY) &&
+        BlockSize - Size <= MAXUCHAR)
+    {
+        InUseEntry->UnusedBytes = (UCHAR)(BlockSize - Size);
+
+        if (Size > OldSize && (Flags & HEAP_ZERO_MEMORY))
+            RtlZeroMemory((PCHAR)Ptr + OldSize, Size - OldSize);
+
+        return Ptr;
+    }
+
+    /* Front end blocks never grow in place */
+    if (Flags & HEAP_REALLOC_IN_PLACE_ONLY)
+    {
+        DPRINT1("Realloc in place failed, but it was the only option\n");
+        NewBaseAddress = NULL;
+    }
+    else
+    {
+        NewBaseAddress = RtlAllocateHeap(Heap, Flags & ~HEAP_ZERO_MEMORY, Size);
+        if (NewBaseAddress)
+        {
+            if (Size < OldSize)
+                RtlMoveMemory(NewBaseAddress, Ptr, Size);
+            else
+                RtlMoveMemory(NewBaseAddress, Ptr, OldSize);
+
+            if (Size > OldSize && (Flags & HEAP_ZERO_MEMORY))
+                RtlZeroMemory((PCHAR)NewBaseAddress + OldSize, Size - OldSize);
+
+            RtlpLfhFree(Heap, InUseEntry);
+        }
+    }
+
+    if (!NewBaseAddress && (Flags & HEAP_GENERATE_EXCEPTIONS))
+    {
+        ExceptionRecord.ExceptionCode = STATUS_NO_MEMORY;
+        ExceptionRecord.ExceptionRecord = NULL;
+        ExceptionRecord.NumberParameters = 1;
+        ExceptionRecord.ExceptionFlags = 0;
+        ExceptionRecord.ExceptionInformation[0] = Size;
+
+        RtlRaiseException(&ExceptionRecord);
+    }
+
+    return NewBaseAddress;
+}
+
+BOOLEAN NTAPI
+RtlpLfhValidateEntry(PHEAP Heap,
+                     PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+
+    if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY)) return FALSE;
+
+    SubSegment = RtlpLfhGetSubSegment(Heap, HeapEntry);
+    if (!SubSegment) return FALSE;
+
+    /* The user block itself is a busy block of the back end */
+    return RtlpValidateHeapEntry(Heap, (PHEAP_ENTRY)SubSegment->UserBlocks - 1);
+}
+
+/* EOF */
@@ -0,0 +1,1827 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS system libraries
+ * FILE:            lib/rtl/threadpool.c
+ * PURPOSE:         Vista thread pool (Tp*) implementation
+ */
+
+/* Every pool owns an I/O completion port, which is the only queue there is.
+   Posting a callback queues a packet whose key is the callback object, and
+   I/O objects bind their file to the same port with themselves as the key,
+   so work items, timers, waits and I/O completions all come out of one
+   NtRemoveIoCompletion in the worker threads.
+
+   Worker threads are started on demand: when something is queued and no
+   thread is idle, a new one is added as long as fewer threads than there
+   are processors are running short callbacks. Callbacks marked as long
+   running don't count against that, and when the queue stops moving for a
+   while the pool assumes its threads are blocked and adds one anyway.
+   Threads idle for longer than TP_WORKER_IDLE_TIMEOUT leave, down to the
+   pool minimum.
+
+   Timers of all pools share one timer queue, driven by a single kernel
+   timer that is always armed for the earliest deadline. A timer may fire
+   anywhere within its window, so the kernel timer is armed for the end of
+   the earliest window, and every timer already due at that point fires
+   together with it.
+
+   Waits are batched: a waiter thread waits for up to TP_WAITER_MAX_WAITS
+   handles at once. Only the waiter thread touches its handle array, other
+   threads send it registrations as APCs, so a wait that was satisfied is
+   never lost to a concurrent update of the array.
+
+   The number of callbacks queued and running is counted per object under
+   the pool lock, which is what waiting for and canceling callbacks rely
+   on. Packets can't be taken back out of the port, so each one carries the
+   object's generation in its APC context. Canceling resets the count and
+   starts a new generation, and the worker that dequeues a packet from an
+   older one drops it, so it can't run in place of a later post. */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl_vista.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* These live in rtl_vista as well, but the NDK doesn't declare them */
+DWORD
+NTAPI
+RtlRunOnceExecuteOnce(PRTL_RUN_ONCE RunOnce,
+                      PRTL_RUN_ONCE_INIT_FN InitFn,
+                      PVOID Parameter,
+                      PVOID *Context);
+
+VOID
+NTAPI
+RtlInitializeConditionVariable(OUT PRTL_CONDITION_VARIABLE ConditionVariable);
+
+VOID
+NTAPI
+RtlWakeAllConditionVariable(IN OUT PRTL_CONDITION_VARIABLE ConditionVariable);
+
+NTSTATUS
+NTAPI
+RtlSleepConditionVariableCS(IN OUT PRTL_CONDITION_VARIABLE ConditionVariable,
+                            IN OUT PRTL_CRITICAL_SECTION CriticalSection,
+                            IN const LARGE_INTEGER * TimeOut OPTIONAL);
+
+/* TYPES ********************************************************************/
+
+#define TP_DEFAULT_MAX_THREADS      500
+#define TP_WORKER_IDLE_TIMEOUT      (-20 * 1000 * 10000LL)  /* 20 seconds */
+#define TP_STARVATION_TIMEOUT       50                      /* milliseconds */
+#define TP_WAITER_MAX_WAITS         MAXIMUM_WAIT_OBJECTS
+
+typedef enum _TP_OBJECT_TYPE
+{
+    TpObjectSimple,
+    TpObjectWork,
+    TpObjectTimer,
+    TpObjectWait,
+    TpObjectIo
+} TP_OBJECT_TYPE;
+
+#define TP_OBJECT_LONG_FUNCTION     0x1
+#define TP_OBJECT_RELEASED          0x2
+
+struct _TP_POOL
+{
+    volatile LONG RefCount;
+    HANDLE CompletionPort;
+    RTL_CRITICAL_SECTION Lock;
+    RTL_CONDITION_VARIABLE CallbacksDone;
+    ULONG Concurrency;
+    ULONG MinThreads;
+    ULONG MaxThreads;
+    ULONG Threads;
+    ULONG IdleThreads;
+    ULONG LongThreads;
+    ULONG Queued;
+    ULONG LastDequeueTick;
+    BOOLEAN Shutdown;
+};
+
+struct _TP_CLEANUP_GROUP
+{
+    volatile LONG RefCount;
+    RTL_CRITICAL_SECTION Lock;
+    LIST_ENTRY Members;
+};
+
+typedef struct _TP_WAITER *PTP_WAITER;
+
+typedef struct _TP_OBJECT
+{
+    /* kernel32 keeps the Win32 I/O callback here, this must stay first */
+    PVOID Win32Callback;
+    TP_OBJECT_TYPE Type;
+    volatile LONG RefCount;
+    ULONG Flags;
+    PTP_POOL Pool;
+    PVOID Callback;
+    PVOID Context;
+    PTP_CLEANUP_GROUP CleanupGroup;
+    PTP_CLEANUP_GROUP_CANCEL_CALLBACK CleanupGroupCancelCallback;
+    PTP_SIMPLE_CALLBACK FinalizationCallback;
+    PVOID RaceDll;
+    LIST_ENTRY GroupEntry;
+
+    /* Protected by the pool lock */
+    ULONG Pending;
+    ULONG Running;
+    ULONG Waiters;
+    ULONG Generation;
+
+    union
+    {
+        /* Protected by the timer queue lock */
+        struct
+        {
+            LIST_ENTRY ListEntry;
+            LARGE_INTEGER DueTime;
+            LARGE_INTEGER Deadline;
+            LONG Period;
+            LONG WindowLength;
+            BOOLEAN Set;
+        } Timer;
+
+        /* Protected by the waiter lock */
+        struct
+        {
+            PTP_WAITER Waiter;
+            HANDLE Handle;
+            LARGE_INTEGER Timeout;
+            ULONG_PTR Sequence;
+        } Wait;
+    } u;
+} TP_OBJECT, *PTP_OBJECT;
+
+typedef struct _TP_WAIT_ENTRY
+{
+    PTP_OBJECT Object;
+    ULONG_PTR Sequence;
+    HANDLE Handle;
+    LARGE_INTEGER Timeout;
+} TP_WAIT_ENTRY, *PTP_WAIT_ENTRY;
+
+typedef struct _TP_WAITER
+{
+    LIST_ENTRY ListEntry;
+    HANDLE Thread;
+
+    /* Slots handed out, protected by the waiter lock */
+    ULONG Reserved;
+
+    /* Only touched by the waiter thread */
+    ULONG Count;
+    TP_WAIT_ENTRY Entries[TP_WAITER_MAX_WAITS];
+} TP_WAITER;
+
+struct _TP_CALLBACK_INSTANCE
+{
+    PTP_OBJECT Object;
+    BOOLEAN Disassociated;
+    BOOLEAN MayRunLong;
+    HANDLE Event;
+    HANDLE Semaphore;
+    ULONG SemaphoreReleaseCount;
+    HANDLE Mutex;
+    PRTL_CRITICAL_SECTION CriticalSection;
+    PVOID DllHandle;
+};
+
+/* GLOBALS *******************************************************************/
+
+static PTP_POOL RtlpTpDefaultPool;
+
+static RTL_RUN_ONCE RtlpTpTimerQueueOnce = RTL_RUN_ONCE_INIT;
+static RTL_CRITICAL_SECTION RtlpTpTimerLock;
+static LIST_ENTRY RtlpTpTimerList;
+static HANDLE RtlpTpTimerHandle;
+
+static RTL_RUN_ONCE RtlpTpWaitersOnce = RTL_RUN_ONCE_INIT;
+static RTL_CRITICAL_SECTION RtlpTpWaiterLock;
+static LIST_ENTRY RtlpTpWaiterList;
+
+/* PRIVATE FUNCTIONS *********************************************************/
+
+static
+NTSTATUS
+RtlpTpCreateThread(IN PTHREAD_START_ROUTINE StartRoutine,
+                   IN PVOID Parameter,
+                   OUT PHANDLE ThreadHandle OPTIONAL)
+{
+    NTSTATUS Status;
+    HANDLE Thread;
+
+    Status = RtlCreateUserThread(NtCurrentProcess(),
+                                 NULL,
+                                 FALSE,
+                                 0,
+                                 0,
+                                 0,
+                                 StartRoutine,
+                                 Parameter,
+                                 &Thread,
+                                 NULL);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    if (ThreadHandle)
+        *ThreadHandle = Thread;
+    else
+        NtClose(Thread);
+
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+RtlpTpDereferencePool(IN PTP_POOL Pool)
+{
+    if (InterlockedDecrement(&Pool->RefCount))
+        return;
+
+    NtClose(Pool->CompletionPort);
+    RtlDeleteCriticalSection(&Pool->Lock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+}
+
+static
+NTSTATUS
+RtlpTpCreatePool(OUT PTP_POOL *PoolReturn)
+{
+    PTP_POOL Pool;
+    NTSTATUS Status;
+
+    Pool = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Pool));
+    if (!Pool)
+        return STATUS_NO_MEMORY;
+
+    Status = RtlInitializeCriticalSection(&Pool->Lock);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+        return Status;
+    }
+
+    /* The port lets as many threads run as there are processors */
+    Pool->Concurrency = NtCurrentPeb()->NumberOfProcessors;
+    Status = NtCreateIoCompletion(&Pool->CompletionPort,
+                                  IO_COMPLETION_ALL_ACCESS,
+                                  NULL,
+                                  Pool->Concurrency);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlDeleteCriticalSection(&Pool->Lock);
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+        return Status;
+    }
+
+    RtlInitializeConditionVariable(&Pool->CallbacksDone);
+    Pool->RefCount = 1;
+    Pool->MaxThreads = TP_DEFAULT_MAX_THREADS;
+    Pool->LastDequeueTick = NtGetTickCount();
+
+    *PoolReturn = Pool;
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+RtlpTpGetDefaultPool(OUT PTP_POOL *PoolReturn)
+{
+    PTP_POOL Pool;
+    NTSTATUS Status;
+
+    if (!RtlpTpDefaultPool)
+    {
+        Status = RtlpTpCreatePool(&Pool);
+        if (!NT_SUCCESS(Status))
+            return Status;
+
+        /* Somebody else may have been quicker */
+        if (InterlockedCompareExchangePointer((PVOID*)&RtlpTpDefaultPool, Pool, NULL) != NULL)
+            RtlpTpDereferencePool(Pool);
+    }
+
+    *PoolReturn = RtlpTpDefaultPool;
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+RtlpTpDereferenceGroup(IN PTP_CLEANUP_GROUP CleanupGroup)
+{
+    if (InterlockedDecrement(&CleanupGroup->RefCount))
+        return;
+
+    RtlDeleteCriticalSection(&CleanupGroup->Lock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, CleanupGroup);
+}
+
+static
+VOID
+RtlpTpLeaveGroup(IN PTP_OBJECT Object)
+{
+    PTP_CLEANUP_GROUP CleanupGroup = Object->CleanupGroup;
+
+    if (!CleanupGroup)
+        return;
+
+    RtlEnterCriticalSection(&CleanupGroup->Lock);
+    if (!IsListEmpty(&Object->GroupEntry))
+    {
+        RemoveEntryList(&Object->GroupEntry);
+        InitializeListHead(&Object->GroupEntry);
+    }
+    RtlLeaveCriticalSection(&CleanupGroup->Lock);
+}
+
+static
+VOID
+RtlpTpReferenceObject(IN PTP_OBJECT Object)
+{
+    InterlockedIncrement(&Object->RefCount);
+}
+
+static
+BOOLEAN
+RtlpTpTryReferenceObject(IN PTP_OBJECT Object)
+{
+    LONG RefCount;
+
+    /* Objects on their way out can still be found in their cleanup group */
+    do
+    {
+        RefCount = Object->RefCount;
+        if (!RefCount)
+            return FALSE;
+    } while (InterlockedCompareExchange(&Object->RefCount, RefCount + 1, RefCount) != RefCount);
+
+    return TRUE;
+}
+
+static
+VOID
+RtlpTpDereferenceObject(IN PTP_OBJECT Object)
+{
+    if (InterlockedDecrement(&Object->RefCount))
+        return;
+
+    if (Object->CleanupGroup)
+    {
+        RtlpTpLeaveGroup(Object);
+        RtlpTpDereferenceGroup(Object->CleanupGroup);
+    }
+
+    if (Object->RaceDll)
+        LdrUnloadDll(Object->RaceDll);
+
+    RtlpTpDereferencePool(Object->Pool);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Object);
+}
+
+static
+VOID
+RtlpTpReleaseObject(IN PTP_OBJECT Object)
+{
+    /* Once the caller let go of it, the cleanup group doesn't own it anymore */
+    RtlpTpLeaveGroup(Object);
+    Object->Flags |= TP_OBJECT_RELEASED;
+    RtlpTpDereferenceObject(Object);
+}
+
+static
+NTSTATUS
+RtlpTpAllocObject(OUT PTP_OBJECT *ObjectReturn,
+                  IN TP_OBJECT_TYPE Type,
+                  IN PVOID Callback,
+                  IN PVOID Context,
+                  IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTP_CLEANUP_GROUP CleanupGroup = NULL;
+    PTP_OBJECT Object;
+    PTP_POOL Pool;
+    NTSTATUS Status;
+
+    if (!ObjectReturn || !Callback)
+        return STATUS_INVALID_PARAMETER;
+
+    if (CallbackEnviron && CallbackEnviron->Version != 1 && CallbackEnviron->Version != 3)
+        return STATUS_INVALID_PARAMETER;
+
+    if (CallbackEnviron && CallbackEnviron->Pool)
+    {
+        Pool = CallbackEnviron->Pool;
+    }
+    else
+    {
+        Status = RtlpTpGetDefaultPool(&Pool);
+        if (!NT_SUCCESS(Status))
+            return Status;
+    }
+
+    Object = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Object));
+    if (!Object)
+        return STATUS_NO_MEMORY;
+
+    Object->Type = Type;
+    Object->RefCount = 1;
+    Object->Pool = Pool;
+    Object->Callback = Callback;
+    Object->Context = Context;
+    InitializeListHead(&Object->GroupEntry);
+    if (Type == TpObjectTimer)
+        InitializeListHead(&Object->u.Timer.ListEntry);
+
+    if (CallbackEnviron)
+    {
+        /* Keep the DLL the callbacks live in loaded for as long as we are */
+        if (CallbackEnviron->RaceDll)
+        {
+            Status = LdrAddRefDll(0, CallbackEnviron->RaceDll);
+            if (!NT_SUCCESS(Status))
+            {
+                RtlFreeHeap(RtlGetProcessHeap(), 0, Object);
+                return Status;
+            }
+            Object->RaceDll = CallbackEnviron->RaceDll;
+        }
+
+        if (CallbackEnviron->u.s.LongFunction)
+            Object->Flags |= TP_OBJECT_LONG_FUNCTION;
+
+        CleanupGroup = CallbackEnviron->CleanupGroup;
+        Object->CleanupGroupCancelCallback = CallbackEnviron->CleanupGroupCancelCallback;
+        Object->FinalizationCallback = CallbackEnviron->FinalizationCallback;
+    }
+
+    InterlockedIncrement(&Pool->RefCount);
+
+    if (CleanupGroup)
+    {
+        InterlockedIncrement(&CleanupGroup->RefCount);
+        Object->CleanupGroup = CleanupGroup;
+
+        RtlEnterCriticalSection(&CleanupGroup->Lock);
+        InsertTailList(&CleanupGroup->Members, &Object->GroupEntry);
+        RtlLeaveCriticalSection(&CleanupGroup->Lock);
+    }
+
+    *ObjectReturn = Object;
+    return STATUS_SUCCESS;
+}
+
+/* The caller holds the pool lock */
+static
+BOOLEAN
+RtlpTpNeedWorker(IN PTP_POOL Pool,
+                 IN ULONG Demand)
+{
+    if (Pool->Threads >= Pool->MaxThreads)
+        return FALSE;
+
+    if (Pool->Threads < Pool->MinThreads)
+        return TRUE;
+
+    /* Idle threads will pick it up */
+    if (Pool->IdleThreads >= Demand)
+        return FALSE;
+
+    /* More short callbacks than processors would only fight each other */
+    if (Pool->Threads - Pool->LongThreads < Pool->Concurrency)
+        return TRUE;
+
+    /* Unless the queue hasn't moved for a while and the threads are blocked */
+    return (NtGetTickCount() - Pool->LastDequeueTick >= TP_STARVATION_TIMEOUT);
+}
+
+static ULONG NTAPI RtlpTpWorkerThread(IN PVOID Parameter);
+
+static
+NTSTATUS
+RtlpTpStartWorker(IN PTP_POOL Pool)
+{
+    NTSTATUS Status;
+
+    /* The caller already counted the thread */
+    InterlockedIncrement(&Pool->RefCount);
+    Status = RtlpTpCreateThread(RtlpTpWorkerThread, Pool, NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to start a pool thread: 0x%lx\n", Status);
+
+        RtlEnterCriticalSection(&Pool->Lock);
+        Pool->Threads--;
+        RtlLeaveCriticalSection(&Pool->Lock);
+        RtlpTpDereferencePool(Pool);
+    }
+
+    return Status;
+}
+
+/* The caller holds the pool lock */
+static
+VOID
+RtlpTpSignalCallbacksDone(IN PTP_OBJECT Object)
+{
+    if (!Object->Pending && !Object->Running && Object->Waiters)
+        RtlWakeAllConditionVariable(&Object->Pool->CallbacksDone);
+}
+
+static
+NTSTATUS
+RtlpTpQueueCallback(IN PTP_OBJECT Object,
+                    IN ULONG_PTR Information)
+{
+    PTP_POOL Pool = Object->Pool;
+    BOOLEAN StartWorker;
+    ULONG Generation;
+    NTSTATUS Status;
+
+    /* Every packet in the port holds a reference */
+    RtlpTpReferenceObject(Object);
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    Generation = Object->Generation;
+    Object->Pending++;
+    Pool->Queued++;
+    StartWorker = RtlpTpNeedWorker(Pool, Pool->Queued);
+    if (StartWorker)
+        Pool->Threads++;
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    Status = NtSetIoCompletion(Pool->CompletionPort,
+                               Object,
+                               (PVOID)(ULONG_PTR)Generation,
+                               STATUS_SUCCESS,
+                               Information);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlEnterCriticalSection(&Pool->Lock);
+        if (Object->Pending && Object->Generation == Generation)
+            Object->Pending--;
+        Pool->Queued--;
+        RtlpTpSignalCallbacksDone(Object);
+        RtlLeaveCriticalSection(&Pool->Lock);
+        RtlpTpDereferenceObject(Object);
+    }
+
+    if (StartWorker)
+        RtlpTpStartWorker(Pool);
+
+    return Status;
+}
+
+static
+VOID
+RtlpTpWaitForCallbacks(IN PTP_OBJECT Object,
+                       IN BOOLEAN CancelPendingCallbacks)
+{
+    PTP_POOL Pool = Object->Pool;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+
+    /* Completions can't be taken back out of the port, so I/O is never canceled */
+    if (CancelPendingCallbacks && Object->Type != TpObjectIo)
+    {
+        /* The packets already queued now belong to an old generation */
+        Object->Generation++;
+        Object->Pending = 0;
+        RtlpTpSignalCallbacksDone(Object);
+    }
+
+    Object->Waiters++;
+    while (Object->Pending || Object->Running)
+    {
+        RtlSleepConditionVariableCS(&Pool->CallbacksDone, &Pool->Lock, NULL);
+    }
+    Object->Waiters--;
+
+    RtlLeaveCriticalSection(&Pool->Lock);
+}
+
+static
+VOID
+RtlpTpCallbackDone(IN PTP_CALLBACK_INSTANCE Instance)
+{
+    PTP_OBJECT Object = Instance->Object;
+    PTP_POOL Pool = Object->Pool;
+
+    if (Instance->Disassociated)
+        return;
+    Instance->Disassociated = TRUE;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    Object->Running--;
+    RtlpTpSignalCallbacksDone(Object);
+    RtlLeaveCriticalSection(&Pool->Lock);
+}
+
+static
+VOID
+RtlpTpRunCallback(IN PTP_OBJECT Object,
+                  IN PVOID ApcContext,
+                  IN PIO_STATUS_BLOCK IoStatusBlock)
+{
+    TP_CALLBACK_INSTANCE Instance;
+    PTP_POOL Pool = Object->Pool;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    if (!Object->Pending ||
+        (Object->Type != TpObjectIo &&
+         (ULONG)(ULONG_PTR)ApcContext != Object->Generation))
+    {
+        /* Canceled while it was queued, or a completion nobody asked for */
+        RtlLeaveCriticalSection(&Pool->Lock);
+        if (Object->Type != TpObjectIo)
+            RtlpTpDereferenceObject(Object);
+        return;
+    }
+    Object->Pending--;
+    Object->Running++;
+    if (Object->Flags & TP_OBJECT_LONG_FUNCTION)
+        Pool->LongThreads++;
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    RtlZeroMemory(&Instance, sizeof(Instance));
+    Instance.Object = Object;
+    Instance.MayRunLong = !!(Object->Flags & TP_OBJECT_LONG_FUNCTION);
+
+    switch (Object->Type)
+    {
+        case TpObjectSimple:
+            ((PTP_SIMPLE_CALLBACK)Object->Callback)(&Instance, Object->Context);
+            break;
+
+        case TpObjectWork:
+            ((PTP_WORK_CALLBACK)Object->Callback)(&Instance, Object->Context, (PTP_WORK)Object);
+            break;
+
+        case TpObjectTimer:
+            ((PTP_TIMER_CALLBACK)Object->Callback)(&Instance, Object->Context, (PTP_TIMER)Object);
+            break;
+
+        case TpObjectWait:
+            ((PTP_WAIT_CALLBACK)Object->Callback)(&Instance,
+                                                  Object->Context,
+                                                  (PTP_WAIT)Object,
+                                                  (TP_WAIT_RESULT)IoStatusBlock->Information);
+            break;
+
+        case TpObjectIo:
+            ((PTP_IO_CALLBACK)Object->Callback)(&Instance,
+                                                Object->Context,
+                                                ApcContext,
+                                                IoStatusBlock,
+                                                (PTP_IO)Object);
+            break;
+    }
+
+    if (Object->FinalizationCallback)
+        Object->FinalizationCallback(&Instance, Object->Context);
+
+    /* What the callback asked to be done once it returns */
+    if (Instance.CriticalSection)
+        RtlLeaveCriticalSection(Instance.CriticalSection);
+    if (Instance.Mutex)
+        NtReleaseMutant(Instance.Mutex, NULL);
+    if (Instance.Semaphore)
+        NtReleaseSemaphore(Instance.Semaphore, Instance.SemaphoreReleaseCount, NULL);
+    if (Instance.Event)
+        NtSetEvent(Instance.Event, NULL);
+
+    RtlpTpCallbackDone(&Instance);
+
+    if (Instance.MayRunLong)
+    {
+        RtlEnterCriticalSection(&Pool->Lock);
+        Pool->LongThreads--;
+        RtlLeaveCriticalSection(&Pool->Lock);
+    }
+
+    if (Instance.DllHandle)
+        LdrUnloadDll(Instance.DllHandle);
+
+    RtlpTpDereferenceObject(Object);
+}
+
+static
+ULONG
+NTAPI
+RtlpTpWorkerThread(IN PVOID Parameter)
+{
+    PTP_POOL Pool = Parameter;
+    IO_STATUS_BLOCK IoStatusBlock;
+    LARGE_INTEGER Timeout;
+    PVOID Key, ApcContext;
+    NTSTATUS Status;
+
+    for (;;)
+    {
+        RtlEnterCriticalSection(&Pool->Lock);
+        Pool->IdleThreads++;
+        RtlLeaveCriticalSection(&Pool->Lock);
+
+        Timeout.QuadPart = TP_WORKER_IDLE_TIMEOUT;
+        Status = NtRemoveIoCompletion(Pool->CompletionPort,
+                                      &Key,
+                                      &ApcContext,
+                                      &IoStatusBlock,
+                                      &Timeout);
+
+        RtlEnterCriticalSection(&Pool->Lock);
+        Pool->IdleThreads--;
+
+        if (Status == STATUS_SUCCESS && Key)
+        {
+            /* Completions of I/O objects were never counted as queued */
+            if (((PTP_OBJECT)Key)->Type != TpObjectIo)
+                Pool->Queued--;
+            Pool->LastDequeueTick = NtGetTickCount();
+            RtlLeaveCriticalSection(&Pool->Lock);
+
+            RtlpTpRunCallback(Key, ApcContext, &IoStatusBlock);
+            continue;
+        }
+
+        /* Keep the minimum around, unless the pool is going away */
+        if (Status == STATUS_TIMEOUT && !Pool->Shutdown && Pool->Threads <= Pool->MinThreads)
+        {
+            RtlLeaveCriticalSection(&Pool->Lock);
+            continue;
+        }
+
+        Pool->Threads--;
+        RtlLeaveCriticalSection(&Pool->Lock);
+        break;
+    }
+
+    RtlpTpDereferencePool(Pool);
+    RtlExitUserThread(STATUS_SUCCESS);
+    return 0;
+}
+
+/* The caller holds the timer queue lock */
+static
+VOID
+RtlpTpInsertTimer(IN PTP_OBJECT Timer)
+{
+    PLIST_ENTRY Entry;
+    PTP_OBJECT Other;
+
+    /* The queue is sorted by the latest time each timer may fire */
+    for (Entry = RtlpTpTimerList.Flink; Entry != &RtlpTpTimerList; Entry = Entry->Flink)
+    {
+        Other = CONTAINING_RECORD(Entry, TP_OBJECT, u.Timer.ListEntry);
+        if (Other->u.Timer.Deadline.QuadPart > Timer->u.Timer.Deadline.QuadPart)
+            break;
+    }
+    InsertTailList(Entry, &Timer->u.Timer.ListEntry);
+}
+
+/* The caller holds the timer queue lock */
+static
+VOID
+RtlpTpArmTimerQueue(VOID)
+{
+    PTP_OBJECT Timer;
+
+    if (IsListEmpty(&RtlpTpTimerList))
+    {
+        NtCancelTimer(RtlpTpTimerHandle, NULL);
+        return;
+    }
+
+    Timer = CONTAINING_RECORD(RtlpTpTimerList.Flink, TP_OBJECT, u.Timer.ListEntry);
+    NtSetTimer(RtlpTpTimerHandle, &Timer->u.Timer.Deadline, NULL, NULL, FALSE, 0, NULL);
+}
+
+static
+ULONG
+NTAPI
+RtlpTpTimerThread(IN PVOID Parameter)
+{
+    LIST_ENTRY Expired;
+    PLIST_ENTRY Entry, Next;
+    LARGE_INTEGER Now;
+    PTP_OBJECT Timer;
+
+    for (;;)
+    {
+        NtWaitForSingleObject(RtlpTpTimerHandle, FALSE, NULL);
+        NtQuerySystemTime(&Now);
+        InitializeListHead(&Expired);
+
+        RtlEnterCriticalSection(&RtlpTpTimerLock);
+
+        /* Everything already due goes together with the timer that woke us */
+        for (Entry = RtlpTpTimerList.Flink; Entry != &RtlpTpTimerList; Entry = Next)
+        {
+            Next = Entry->Flink;
+            Timer = CONTAINING_RECORD(Entry, TP_OBJECT, u.Timer.ListEntry);
+            if (Timer->u.Timer.DueTime.QuadPart > Now.QuadPart)
+                continue;
+
+            RemoveEntryList(Entry);
+            RtlpTpReferenceObject(Timer);
+            InsertTailList(&Expired, &Timer->u.Timer.ListEntry);
+        }
+
+        /* Put periodic timers back for their next period */
+        for (Entry = Expired.Flink; Entry != &Expired; Entry = Entry->Flink)
+        {
+            Timer = CONTAINING_RECORD(Entry, TP_OBJECT, u.Timer.ListEntry);
+            if (!Timer->u.Timer.Period)
+                continue;
+
+            Timer->u.Timer.DueTime.QuadPart += Timer->u.Timer.Period * 10000LL;
+            if (Timer->u.Timer.DueTime.QuadPart < Now.QuadPart)
+                Timer->u.Timer.DueTime.QuadPart = Now.QuadPart + Timer->u.Timer.Period * 10000LL;
+            Timer->u.Timer.Deadline.QuadPart = Timer->u.Timer.DueTime.QuadPart +
+                                               Timer->u.Timer.WindowLength * 10000LL;
+        }
+
+        while (!IsListEmpty(&Expired))
+        {
+            Entry = RemoveHeadList(&Expired);
+            Timer = CONTAINING_RECORD(Entry, TP_OBJECT, u.Timer.ListEntry);
+
+            if (Timer->u.Timer.Period)
+                RtlpTpInsertTimer(Timer);
+            else
+            {
+                InitializeListHead(Entry);
+                Timer->u.Timer.Set = FALSE;
+            }
+
+            RtlpTpQueueCallback(Timer, 0);
+            RtlpTpDereferenceObject(Timer);
+        }
+
+        RtlpTpArmTimerQueue();
+        RtlLeaveCriticalSection(&RtlpTpTimerLock);
+    }
+
+    return 0;
+}
+
+static
+ULONG
+NTAPI
+RtlpTpInitializeTimerQueue(IN PRTL_RUN_ONCE RunOnce,
+                           IN PVOID Parameter,
+                           IN OUT PVOID *Context)
+{
+    NTSTATUS Status;
+
+    Status = RtlInitializeCriticalSection(&RtlpTpTimerLock);
+    if (!NT_SUCCESS(Status))
+        return FALSE;
+
+    InitializeListHead(&RtlpTpTimerList);
+
+    Status = NtCreateTimer(&RtlpTpTimerHandle, TIMER_ALL_ACCESS, NULL, SynchronizationTimer);
+    if (NT_SUCCESS(Status))
+    {
+        Status = RtlpTpCreateThread(RtlpTpTimerThread, NULL, NULL);
+        if (NT_SUCCESS(Status))
+            return TRUE;
+
+        NtClose(RtlpTpTimerHandle);
+    }
+
+    DPRINT1("Failed to start the timer queue: 0x%lx\n", Status);
+    RtlDeleteCriticalSection(&RtlpTpTimerLock);
+    return FALSE;
+}
+
+static
+VOID
+NTAPI
+RtlpTpWaiterAddApc(IN PVOID NormalContext,
+                   IN PVOID SystemArgument1,
+                   IN PVOID SystemArgument2)
+{
+    PTP_WAITER Waiter = NormalContext;
+    PTP_OBJECT Wait = SystemArgument1;
+    PTP_WAIT_ENTRY WaitEntry;
+
+    /* Only stale entries whose removal couldn't be queued take up room here */
+    if (Waiter->Count == TP_WAITER_MAX_WAITS)
+    {
+        DPRINT1("Waiter %p is full, dropping wait %p\n", Waiter, Wait);
+        RtlpTpDereferenceObject(Wait);
+        return;
+    }
+
+    /* The registration's reference moves into the entry */
+    WaitEntry = &Waiter->Entries[Waiter->Count++];
+    WaitEntry->Object = Wait;
+    WaitEntry->Sequence = (ULONG_PTR)SystemArgument2;
+
+    RtlEnterCriticalSection(&RtlpTpWaiterLock);
+    WaitEntry->Handle = Wait->u.Wait.Handle;
+    WaitEntry->Timeout = Wait->u.Wait.Timeout;
+    RtlLeaveCriticalSection(&RtlpTpWaiterLock);
+}
+
+static
+VOID
+RtlpTpWaiterRemoveEntry(IN PTP_WAITER Waiter,
+                        IN ULONG Index)
+{
+    PTP_OBJECT Wait = Waiter->Entries[Index].Object;
+
+    Waiter->Entries[Index] = Waiter->Entries[--Waiter->Count];
+    RtlpTpDereferenceObject(Wait);
+}
+
+static
+VOID
+NTAPI
+RtlpTpWaiterRemoveApc(IN PVOID NormalContext,
+                      IN PVOID SystemArgument1,
+                      IN PVOID SystemArgument2)
+{
+    PTP_WAITER Waiter = NormalContext;
+    PTP_OBJECT Wait = SystemArgument1;
+    ULONG Index;
+
+    for (Index = 0; Index < Waiter->Count; Index++)
+    {
+        if (Waiter->Entries[Index].Object == Wait &&
+            Waiter->Entries[Index].Sequence == (ULONG_PTR)SystemArgument2)
+        {
+            RtlpTpWaiterRemoveEntry(Waiter, Index);
+            break;
+        }
+    }
+
+    RtlpTpDereferenceObject(Wait);
+}
+
+static
+VOID
+RtlpTpWaiterFire(IN PTP_WAITER Waiter,
+                 IN ULONG Index,
+                 IN TP_WAIT_RESULT WaitResult)
+{
+    PTP_WAIT_ENTRY WaitEntry = &Waiter->Entries[Index];
+    PTP_OBJECT Wait = WaitEntry->Object;
+    BOOLEAN Current;
+
+    /* Waits are one-shot, unless it was set again in the meantime it is done */
+    RtlEnterCriticalSection(&RtlpTpWaiterLock);
+    Current = (Wait->u.Wait.Waiter == Waiter && Wait->u.Wait.Sequence == WaitEntry->Sequence);
+    if (Current)
+    {
+        Wait->u.Wait.Waiter = NULL;
+        Waiter->Reserved--;
+    }
+    RtlLeaveCriticalSection(&RtlpTpWaiterLock);
+
+    if (Current)
+        RtlpTpQueueCallback(Wait, WaitResult);
+
+    RtlpTpWaiterRemoveEntry(Waiter, Index);
+}
+
+static
+ULONG
+NTAPI
+RtlpTpWaiterThread(IN PVOID Parameter)
+{
+    PTP_WAITER Waiter = Parameter;
+    HANDLE Handles[TP_WAITER_MAX_WAITS];
+    LARGE_INTEGER Timeout, Now, Zero;
+    NTSTATUS Status;
+    ULONG Index;
+
+    for (;;)
+    {
+        Timeout.QuadPart = MAXLONGLONG;
+        for (Index = 0; Index < Waiter->Count; Index++)
+        {
+            Handles[Index] = Waiter->Entries[Index].Handle;
+            if (Waiter->Entries[Index].Timeout.QuadPart < Timeout.QuadPart)
+                Timeout = Waiter->Entries[Index].Timeout;
+        }
+
+        /* Registrations come in as APCs, so the wait has to be alertable */
+        if (!Waiter->Count)
+        {
+            Timeout.LowPart = 0;
+            Timeout.HighPart = 0x80000000;
+            Status = NtDelayExecution(TRUE, &Timeout);
+        }
+        else
+        {
+            Status = NtWaitForMultipleObjects(Waiter->Count,
+                                              Handles,
+                                              WaitAny,
+                                              TRUE,
+                                              Timeout.QuadPart == MAXLONGLONG ? NULL : &Timeout);
+        }
+
+        if (Status == STATUS_USER_APC || Status == STATUS_ALERTED || !Waiter->Count)
+            continue;
+
+        if (Status < STATUS_WAIT_0 + Waiter->Count)
+        {
+            RtlpTpWaiterFire(Waiter, Status - STATUS_WAIT_0, WAIT_OBJECT_0);
+        }
+        else if (Status >= STATUS_ABANDONED_WAIT_0 && Status < STATUS_ABANDONED_WAIT_0 + Waiter->Count)
+        {
+            RtlpTpWaiterFire(Waiter, Status - STATUS_ABANDONED_WAIT_0, WAIT_ABANDONED_0);
+        }
+        else if (!NT_SUCCESS(Status))
+        {
+            /* One of the handles is bad, find it so that the others keep working */
+            Zero.QuadPart = 0;
+            for (Index = 0; Index < Waiter->Count; )
+            {
+                if (NT_SUCCESS(NtWaitForSingleObject(Waiter->Entries[Index].Handle, FALSE, &Zero)))
+                {
+                    Index++;
+                    continue;
+                }
+
+                DPRINT1("Dropping wait %p on bad handle %p\n",
+                        Waiter->Entries[Index].Object, Waiter->Entries[Index].Handle);
+                RtlEnterCriticalSection(&RtlpTpWaiterLock);
+                if (Waiter->Entries[Index].Object->u.Wait.Waiter == Waiter &&
+                    Waiter->Entries[Index].Object->u.Wait.Sequence == Waiter->Entries[Index].Sequence)
+                {
+                    Waiter->Entries[Index].Object->u.Wait.Waiter = NULL;
+                    Waiter->Reserved--;
+                }
+                RtlLeaveCriticalSection(&RtlpTpWaiterLock);
+                RtlpTpWaiterRemoveEntry(Waiter, Index);
+            }
+            continue;
+        }
+
+        /* Whatever timed out, the wait itself or in the meantime */
+        NtQuerySystemTime(&Now);
+        for (Index = 0; Index < Waiter->Count; )
+        {
+            if (Waiter->Entries[Index].Timeout.QuadPart <= Now.QuadPart)
+                RtlpTpWaiterFire(Waiter, Index, WAIT_TIMEOUT);
+            else
+                Index++;
+        }
+    }
+
+    return 0;
+}
+
+static
+ULONG
+NTAPI
+RtlpTpInitializeWaiters(IN PRTL_RUN_ONCE RunOnce,
+                        IN PVOID Parameter,
+                        IN OUT PVOID *Context)
+{
+    InitializeListHead(&RtlpTpWaiterList);
+    return NT_SUCCESS(RtlInitializeCriticalSection(&RtlpTpWaiterLock));
+}
+
+/* The caller holds the waiter lock */
+static
+PTP_WAITER
+RtlpTpGetWaiter(VOID)
+{
+    PLIST_ENTRY Entry;
+    PTP_WAITER Waiter;
+    NTSTATUS Status;
+
+    for (Entry = RtlpTpWaiterList.Flink; Entry != &RtlpTpWaiterList; Entry = Entry->Flink)
+    {
+        Waiter = CONTAINING_RECORD(Entry, TP_WAITER, ListEntry);
+        if (Waiter->Reserved < TP_WAITER_MAX_WAITS)
+            return Waiter;
+    }
+
+    Waiter = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Waiter));
+    if (!Waiter)
+        return NULL;
+
+    Status = RtlpTpCreateThread(RtlpTpWaiterThread, Waiter, &Waiter->Thread);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to start a waiter thread: 0x%lx\n", Status);
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Waiter);
+        return NULL;
+    }
+
+    InsertTailList(&RtlpTpWaiterList, &Waiter->ListEntry);
+    return Waiter;
+}
+
+/* The caller holds the waiter lock */
+static
+VOID
+RtlpTpUnregisterWait(IN PTP_OBJECT Wait)
+{
+    PTP_WAITER Waiter = Wait->u.Wait.Waiter;
+
+    if (!Waiter)
+        return;
+
+    Wait->u.Wait.Waiter = NULL;
+    Waiter->Reserved--;
+
+    RtlpTpReferenceObject(Wait);
+    if (!NT_SUCCESS(NtQueueApcThread(Waiter->Thread,
+                                     RtlpTpWaiterRemoveApc,
+                                     Waiter,
+                                     Wait,
+                                     (PVOID)Wait->u.Wait.Sequence)))
+    {
+        /* The entry is left behind until it fires, and is dropped as stale then */
+        RtlpTpDereferenceObject(Wait);
+    }
+}
+
+/* PUBLIC FUNCTIONS **********************************************************/
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocPool(OUT PTP_POOL *PoolReturn,
+            IN PVOID Reserved)
+{
+    if (!PoolReturn)
+        return STATUS_INVALID_PARAMETER;
+
+    return RtlpTpCreatePool(PoolReturn);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleasePool(IN OUT PTP_POOL Pool)
+{
+    ULONG Threads;
+
+    if (Pool == RtlpTpDefaultPool)
+    {
+        DPRINT1("The default pool can't be released\n");
+        return;
+    }
+
+    /* Tell the threads to leave once the queue is drained, objects still
+       using the pool keep it alive */
+    RtlEnterCriticalSection(&Pool->Lock);
+    Pool->Shutdown = TRUE;
+    Pool->MinThreads = 0;
+    Threads = Pool->Threads;
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    while (Threads--)
+    {
+        NtSetIoCompletion(Pool->CompletionPort, NULL, NULL, STATUS_SUCCESS, 0);
+    }
+
+    RtlpTpDereferencePool(Pool);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetPoolMaxThreads(IN OUT PTP_POOL Pool,
+                    IN ULONG MaxThreads)
+{
+    /* Threads over the limit leave when they run out of work */
+    RtlEnterCriticalSection(&Pool->Lock);
+    Pool->MaxThreads = max(MaxThreads, 1);
+    if (Pool->MinThreads > Pool->MaxThreads)
+        Pool->MinThreads = Pool->MaxThreads;
+    RtlLeaveCriticalSection(&Pool->Lock);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpSetPoolMinThreads(IN OUT PTP_POOL Pool,
+                    IN ULONG MinThreads)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    BOOLEAN StartWorker;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    Pool->MinThreads = MinThreads;
+    if (Pool->MaxThreads < MinThreads)
+        Pool->MaxThreads = MinThreads;
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    /* The minimum is there right away */
+    for (;;)
+    {
+        RtlEnterCriticalSection(&Pool->Lock);
+        StartWorker = (Pool->Threads < Pool->MinThreads);
+        if (StartWorker)
+            Pool->Threads++;
+        RtlLeaveCriticalSection(&Pool->Lock);
+
+        if (!StartWorker)
+            break;
+
+        Status = RtlpTpStartWorker(Pool);
+        if (!NT_SUCCESS(Status))
+            break;
+    }
+
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocCleanupGroup(OUT PTP_CLEANUP_GROUP *CleanupGroupReturn)
+{
+    PTP_CLEANUP_GROUP CleanupGroup;
+    NTSTATUS Status;
+
+    if (!CleanupGroupReturn)
+        return STATUS_INVALID_PARAMETER;
+
+    CleanupGroup = RtlAllocateHeap(RtlGetProcessHeap(), 0, sizeof(*CleanupGroup));
+    if (!CleanupGroup)
+        return STATUS_NO_MEMORY;
+
+    Status = RtlInitializeCriticalSection(&CleanupGroup->Lock);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, CleanupGroup);
+        return Status;
+    }
+
+    CleanupGroup->RefCount = 1;
+    InitializeListHead(&CleanupGroup->Members);
+
+    *CleanupGroupReturn = CleanupGroup;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseCleanupGroupMembers(IN OUT PTP_CLEANUP_GROUP CleanupGroup,
+                             IN BOOLEAN CancelPendingCallbacks,
+                             IN OUT PVOID CleanupParameter OPTIONAL)
+{
+    LIST_ENTRY Members;
+    PLIST_ENTRY Entry;
+    PTP_OBJECT Object;
+
+    /* Take everything out of the group at once, new members aren't our business */
+    InitializeListHead(&Members);
+    RtlEnterCriticalSection(&CleanupGroup->Lock);
+    while (!IsListEmpty(&CleanupGroup->Members))
+    {
+        Entry = RemoveHeadList(&CleanupGroup->Members);
+        Object = CONTAINING_RECORD(Entry, TP_OBJECT, GroupEntry);
+        if (RtlpTpTryReferenceObject(Object))
+            InsertTailList(&Members, Entry);
+        else
+            InitializeListHead(Entry);
+    }
+    RtlLeaveCriticalSection(&CleanupGroup->Lock);
+
+    while (!IsListEmpty(&Members))
+    {
+        Entry = RemoveHeadList(&Members);
+        InitializeListHead(Entry);
+        Object = CONTAINING_RECORD(Entry, TP_OBJECT, GroupEntry);
+
+        /* No new callbacks */
+        if (Object->Type == TpObjectTimer)
+            TpSetTimer((PTP_TIMER)Object, NULL, 0, 0);
+        else if (Object->Type == TpObjectWait)
+            TpSetWait((PTP_WAIT)Object, NULL, NULL);
+
+        RtlpTpWaitForCallbacks(Object, CancelPendingCallbacks);
+
+        if (CancelPendingCallbacks && Object->CleanupGroupCancelCallback)
+            Object->CleanupGroupCancelCallback(Object->Context, CleanupParameter);
+
+        /* Release it on behalf of the caller, simple callbacks already are */
+        if (!(Object->Flags & TP_OBJECT_RELEASED))
+        {
+            Object->Flags |= TP_OBJECT_RELEASED;
+            RtlpTpDereferenceObject(Object);
+        }
+        RtlpTpDereferenceObject(Object);
+    }
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseCleanupGroup(IN OUT PTP_CLEANUP_GROUP CleanupGroup)
+{
+    RtlpTpDereferenceGroup(CleanupGroup);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpSimpleTryPost(IN PTP_SIMPLE_CALLBACK Callback,
+                IN OUT PVOID Context OPTIONAL,
+                IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = RtlpTpAllocObject(&Object, TpObjectSimple, Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    /* It stays in its cleanup group until the callback is done with it */
+    Object->Flags |= TP_OBJECT_RELEASED;
+    Status = RtlpTpQueueCallback(Object, 0);
+    RtlpTpDereferenceObject(Object);
+
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocWork(OUT PTP_WORK *WorkReturn,
+            IN PTP_WORK_CALLBACK Callback,
+            IN OUT PVOID Context OPTIONAL,
+            IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    return RtlpTpAllocObject((PTP_OBJECT*)WorkReturn, TpObjectWork, Callback, Context, CallbackEnviron);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpPostWork(IN OUT PTP_WORK Work)
+{
+    RtlpTpQueueCallback((PTP_OBJECT)Work, 0);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForWork(IN OUT PTP_WORK Work,
+              IN BOOLEAN CancelPendingCallbacks)
+{
+    RtlpTpWaitForCallbacks((PTP_OBJECT)Work, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseWork(IN OUT PTP_WORK Work)
+{
+    RtlpTpReleaseObject((PTP_OBJECT)Work);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocTimer(OUT PTP_TIMER *TimerReturn,
+             IN PTP_TIMER_CALLBACK Callback,
+             IN OUT PVOID Context OPTIONAL,
+             IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    /* The timer queue is shared by all pools and only started when needed */
+    if (RtlRunOnceExecuteOnce(&RtlpTpTimerQueueOnce, RtlpTpInitializeTimerQueue, NULL, NULL) != STATUS_SUCCESS)
+        return STATUS_NO_MEMORY;
+
+    return RtlpTpAllocObject((PTP_OBJECT*)TimerReturn, TpObjectTimer, Callback, Context, CallbackEnviron);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetTimer(IN OUT PTP_TIMER TimerObject,
+           IN PLARGE_INTEGER DueTime OPTIONAL,
+           IN LONG Period,
+           IN LONG WindowLength OPTIONAL)
+{
+    PTP_OBJECT Timer = (PTP_OBJECT)TimerObject;
+    LARGE_INTEGER Now;
+    BOOLEAN First;
+
+    NtQuerySystemTime(&Now);
+
+    RtlEnterCriticalSection(&RtlpTpTimerLock);
+
+    First = (RtlpTpTimerList.Flink == &Timer->u.Timer.ListEntry);
+    if (Timer->u.Timer.Set)
+    {
+        RemoveEntryList(&Timer->u.Timer.ListEntry);
+        InitializeListHead(&Timer->u.Timer.ListEntry);
+        Timer->u.Timer.Set = FALSE;
+    }
+
+    if (DueTime)
+    {
+        /* Relative times are negative, zero means right now */
+        if (DueTime->QuadPart < 0)
+            Timer->u.Timer.DueTime.QuadPart = Now.QuadPart - DueTime->QuadPart;
+        else if (DueTime->QuadPart == 0)
+            Timer->u.Timer.DueTime = Now;
+        else
+            Timer->u.Timer.DueTime = *DueTime;
+
+        Timer->u.Timer.Period = max(Period, 0);
+        Timer->u.Timer.WindowLength = max(WindowLength, 0);
+        Timer->u.Timer.Deadline.QuadPart = Timer->u.Timer.DueTime.QuadPart +
+                                           Timer->u.Timer.WindowLength * 10000LL;
+        Timer->u.Timer.Set = TRUE;
+        RtlpTpInsertTimer(Timer);
+
+        First |= (RtlpTpTimerList.Flink == &Timer->u.Timer.ListEntry);
+    }
+
+    /* The kernel timer only needs to move when the head changed */
+    if (First)
+        RtlpTpArmTimerQueue();
+
+    RtlLeaveCriticalSection(&RtlpTpTimerLock);
+}
+
+/*
+ * @implemented
+ */
+BOOLEAN
+NTAPI
+TpIsTimerSet(IN PTP_TIMER Timer)
+{
+    return ((PTP_OBJECT)Timer)->u.Timer.Set;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForTimer(IN OUT PTP_TIMER Timer,
+               IN BOOLEAN CancelPendingCallbacks)
+{
+    RtlpTpWaitForCallbacks((PTP_OBJECT)Timer, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseTimer(IN OUT PTP_TIMER Timer)
+{
+    TpSetTimer(Timer, NULL, 0, 0);
+    RtlpTpReleaseObject((PTP_OBJECT)Timer);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocWait(OUT PTP_WAIT *WaitReturn,
+            IN PTP_WAIT_CALLBACK Callback,
+            IN OUT PVOID Context OPTIONAL,
+            IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    if (RtlRunOnceExecuteOnce(&RtlpTpWaitersOnce, RtlpTpInitializeWaiters, NULL, NULL) != STATUS_SUCCESS)
+        return STATUS_NO_MEMORY;
+
+    return RtlpTpAllocObject((PTP_OBJECT*)WaitReturn, TpObjectWait, Callback, Context, CallbackEnviron);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetWait(IN OUT PTP_WAIT WaitObject,
+          IN HANDLE Handle OPTIONAL,
+          IN PLARGE_INTEGER Timeout OPTIONAL)
+{
+    PTP_OBJECT Wait = (PTP_OBJECT)WaitObject;
+    PTP_WAITER Waiter;
+    LARGE_INTEGER Now;
+
+    RtlEnterCriticalSection(&RtlpTpWaiterLock);
+
+    RtlpTpUnregisterWait(Wait);
+    Wait->u.Wait.Sequence++;
+
+    if (!Handle)
+    {
+        RtlLeaveCriticalSection(&RtlpTpWaiterLock);
+        return;
+    }
+
+    /* Relative times are negative, no timeout at all means forever */
+    if (!Timeout)
+    {
+        Wait->u.Wait.Timeout.QuadPart = MAXLONGLONG;
+    }
+    else if (Timeout->QuadPart <= 0)
+    {
+        NtQuerySystemTime(&Now);
+        Wait->u.Wait.Timeout.QuadPart = Now.QuadPart - Timeout->QuadPart;
+    }
+    else
+    {
+        Wait->u.Wait.Timeout = *Timeout;
+    }
+    Wait->u.Wait.Handle = Handle;
+
+    Waiter = RtlpTpGetWaiter();
+    if (!Waiter)
+    {
+        RtlLeaveCriticalSection(&RtlpTpWaiterLock);
+        return;
+    }
+
+    RtlpTpReferenceObject(Wait);
+    if (!NT_SUCCESS(NtQueueApcThread(Waiter->Thread,
+                                     RtlpTpWaiterAddApc,
+                                     Waiter,
+                                     Wait,
+                                     (PVOID)Wait->u.Wait.Sequence)))
+    {
+        RtlpTpDereferenceObject(Wait);
+        RtlLeaveCriticalSection(&RtlpTpWaiterLock);
+        return;
+    }
+
+    Wait->u.Wait.Waiter = Waiter;
+    Waiter->Reserved++;
+
+    RtlLeaveCriticalSection(&RtlpTpWaiterLock);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForWait(IN OUT PTP_WAIT Wait,
+              IN BOOLEAN CancelPendingCallbacks)
+{
+    RtlpTpWaitForCallbacks((PTP_OBJECT)Wait, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseWait(IN OUT PTP_WAIT Wait)
+{
+    TpSetWait(Wait, NULL, NULL);
+    RtlpTpReleaseObject((PTP_OBJECT)Wait);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocIoCompletion(OUT PTP_IO *IoReturn,
+                    IN HANDLE File,
+                    IN PTP_IO_CALLBACK Callback,
+                    IN OUT PVOID Context OPTIONAL,
+                    IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    FILE_COMPLETION_INFORMATION CompletionInfo;
+    IO_STATUS_BLOCK IoStatusBlock;
+    PTP_OBJECT Io;
+    NTSTATUS Status;
+
+    Status = RtlpTpAllocObject(&Io, TpObjectIo, Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    /* Completions of the file go straight to the pool's port */
+    CompletionInfo.Port = Io->Pool->CompletionPort;
+    CompletionInfo.Key = Io;
+    Status = NtSetInformationFile(File,
+                                  &IoStatusBlock,
+                                  &CompletionInfo,
+                                  sizeof(CompletionInfo),
+                                  FileCompletionInformation);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlpTpReleaseObject(Io);
+        return Status;
+    }
+
+    *IoReturn = (PTP_IO)Io;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpStartAsyncIoOperation(IN OUT PTP_IO IoObject)
+{
+    PTP_OBJECT Io = (PTP_OBJECT)IoObject;
+    PTP_POOL Pool = Io->Pool;
+    BOOLEAN StartWorker;
+
+    /* The completion to come holds a reference, like a queued callback */
+    RtlpTpReferenceObject(Io);
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    Io->Pending++;
+    StartWorker = RtlpTpNeedWorker(Pool, Pool->Queued + 1);
+    if (StartWorker)
+        Pool->Threads++;
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    if (StartWorker)
+        RtlpTpStartWorker(Pool);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCancelAsyncIoOperation(IN OUT PTP_IO IoObject)
+{
+    PTP_OBJECT Io = (PTP_OBJECT)IoObject;
+    PTP_POOL Pool = Io->Pool;
+
+    /* The operation completed synchronously or failed, nothing will come */
+    RtlEnterCriticalSection(&Pool->Lock);
+    if (Io->Pending)
+        Io->Pending--;
+    RtlpTpSignalCallbacksDone(Io);
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    RtlpTpDereferenceObject(Io);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForIoCompletion(IN OUT PTP_IO Io,
+                      IN BOOLEAN CancelPendingCallbacks)
+{
+    RtlpTpWaitForCallbacks((PTP_OBJECT)Io, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseIoCompletion(IN OUT PTP_IO Io)
+{
+    RtlpTpReleaseObject((PTP_OBJECT)Io);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpCallbackMayRunLong(IN OUT PTP_CALLBACK_INSTANCE Instance)
+{
+    PTP_POOL Pool = Instance->Object->Pool;
+    NTSTATUS Status = STATUS_SUCCESS;
+    BOOLEAN StartWorker = FALSE;
+
+    if (Instance->MayRunLong)
+        return STATUS_SUCCESS;
+
+    /* This thread stops counting as a short callback, which may let the
+       pool start another one for whatever is still queued */
+    RtlEnterCriticalSection(&Pool->Lock);
+    Instance->MayRunLong = TRUE;
+    Pool->LongThreads++;
+    if (!Pool->IdleThreads)
+    {
+        if (Pool->Threads < Pool->MaxThreads)
+        {
+            Pool->Threads++;
+            StartWorker = TRUE;
+        }
+        else
+        {
+            Status = STATUS_TOO_MANY_THREADS;
+        }
+    }
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    if (StartWorker)
+        Status = RtlpTpStartWorker(Pool);
+
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpDisassociateCallback(IN OUT PTP_CALLBACK_INSTANCE Instance)
+{
+    RtlpTpCallbackDone(Instance);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackSetEventOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                               IN HANDLE Event)
+{
+    Instance->Event = Event;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackReleaseSemaphoreOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                       IN HANDLE Semaphore,
+                                       IN ULONG ReleaseCount)
+{
+    Instance->Semaphore = Semaphore;
+    Instance->SemaphoreReleaseCount = ReleaseCount;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackReleaseMutexOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                   IN HANDLE Mutex)
+{
+    Instance->Mutex = Mutex;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackLeaveCriticalSectionOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                           IN OUT PRTL_CRITICAL_SECTION CriticalSection)
+{
+    Instance->CriticalSection = CriticalSection;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackUnloadDllOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                IN PVOID DllHandle)
+{
+    Instance->DllHandle = DllHandle;
+}
+
+/* EOF */
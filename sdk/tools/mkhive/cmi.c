@@ -85,6 +85,31 @@ CmpFileWrite(
     return (fwrite(Buffer, 1, BufferLength, File) == BufferLength);
 }
 
+static BOOLEAN
+NTAPI
+CmpFileWriteGather(
+    IN PHHIVE RegistryHive,
+    IN ULONG FileType,
+    IN PULONG FileOffset,
+    IN PHV_WRITE_SEGMENT Segments,
+    IN ULONG SegmentCount)
+{
+    PCMHIVE CmHive = (PCMHIVE)RegistryHive;
+    FILE *File = CmHive->FileHandles[HFILE_TYPE_PRIMARY];
+    ULONG i;
+
+    if (fseek(File, *FileOffset, SEEK_SET) != 0)
+        return FALSE;
+
+    for (i = 0; i < SegmentCount; i++)
+    {
+        if (fwrite(Segments[i].Buffer, 1, Segments[i].Length, File) != Segments[i].Length)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
 static BOOLEAN
 NTAPI
 CmpFileSetSize(
@@ -139,6 +164,9 @@ CmiInitializeHive(
         return Status;
     }
 
+    /* Dirty runs spanning several bins are written in one go */
+    Hive->Hive.FileWriteGather = CmpFileWriteGather;
+
     // HACK: See the HACK from r31253
     if (!CmCreateRootNode(&Hive->Hive, Name))
     {